@@ -40,14 +40,17 @@
 #include "functions.h"
 #include "hwfp.h"
 #include "integer.h"
+#include "list.h"
 #include "parser.h"
 #include "range.h"
 #include "renderer.h"
 #include "runtime.h"
 #include "settings.h"
+#include "symbol.h"
 #include "tag.h"
 #include "unit.h"
 #include "user_interface.h"
+#include "variables.h"
 
 #include <cctype>
 #include <cmath>
@@ -143,7 +146,7 @@ algebraic_p algebraic::as_hwfp(value x)
 //   Return a hardware floating-point value if possible
 // ----------------------------------------------------------------------------
 {
-    if (Settings.HardwareFloatingPoint())
+    if (Settings.HardwareFloatingPointEnabled())
     {
         uint prec = Settings.Precision();
         if (prec <= 7)
@@ -163,7 +166,7 @@ bool algebraic::hwfp_promotion(algebraic_g &x)
     if (!x)
         return false;
 
-    if (!Settings.HardwareFloatingPoint())
+    if (!Settings.HardwareFloatingPointEnabled())
         return false;
     uint prec = Settings.Precision();
     if (prec > 16)
@@ -916,6 +919,168 @@ algebraic_p algebraic::exact_angle(int num, int denom, angle_unit aunit)
 }
 
 
+// ============================================================================
+//
+//   Memoization of pure functions
+//
+// ============================================================================
+//   With MemoizeFunctions, results of user functions are remembered, keyed
+//   by the function, the independent variable and the argument values.
+//   All entries are dropped when globals move, since this is when function
+//   definitions or free global variables may have changed, or when the
+//   current directory or settings change.
+
+#ifndef FUNCTION_MEMO
+// Number of function results remembered, must be a power of two
+#define FUNCTION_MEMO           32
+#endif // FUNCTION_MEMO
+
+struct function_memo
+// ----------------------------------------------------------------------------
+//   A small two-way set-associative table of function results
+// ----------------------------------------------------------------------------
+{
+    struct entry
+    {
+        object_g    function;
+        object_g    independent;
+        object_g    arguments;
+        algebraic_g value;
+    };
+
+    entry       entries[FUNCTION_MEMO];
+    directory_p directory;
+    uint        settings;
+    uint        generation;
+
+    static function_memo &current()
+    {
+        static function_memo memo;
+        return memo;
+    }
+
+    void validate()
+    // ------------------------------------------------------------------------
+    //   Drop all entries if the context where functions were evaluated changed
+    // ------------------------------------------------------------------------
+    {
+        uint        gen = directory::generation;
+        uint        set = Settings.hash();
+        directory_p dir = rt.variables(0);
+        if (gen != generation || set != settings || dir != directory)
+        {
+            for (entry &e : entries)
+            {
+                e.function = e.independent = e.arguments = nullptr;
+                e.value = nullptr;
+            }
+            generation = gen;
+            settings = set;
+            directory = dir;
+        }
+    }
+
+    static uint index(object_p args)
+    // ------------------------------------------------------------------------
+    //   Hash the argument values
+    // ------------------------------------------------------------------------
+    {
+        byte_p p    = byte_p(args);
+        size_t sz   = args->size();
+        uint   hash = 2166136261U;
+        for (size_t i = 0; i < sz; i++)
+            hash = (hash ^ p[i]) * 16777619U;
+        return (hash ^ (hash >> 16)) & (FUNCTION_MEMO - 2);
+    }
+
+    bool matches(const entry &e, object_p fn, object_p indep, object_p args)
+    // ------------------------------------------------------------------------
+    //   Check if an entry is for the given function and arguments
+    // ------------------------------------------------------------------------
+    {
+        return e.value &&
+            (+e.function == fn || e.function->is_same_as(fn)) &&
+            (e.independent ? indep && e.independent->is_same_as(indep)
+                           : !indep) &&
+            e.arguments->is_same_as(args);
+    }
+};
+
+
+static object_p memo_independent()
+// ----------------------------------------------------------------------------
+//   Name of the current independent variable if there is one
+// ----------------------------------------------------------------------------
+{
+    symbol_g *indep = expression::independent;
+    return indep ? object_p(+*indep) : nullptr;
+}
+
+
+algebraic_p algebraic::memo_lookup(object_p fn, object_p args)
+// ----------------------------------------------------------------------------
+//   Return a previously computed value of the function if there is one
+// ----------------------------------------------------------------------------
+{
+    if (!fn || !args)
+        return nullptr;
+    function_memo &memo  = function_memo::current();
+    object_p       indep = memo_independent();
+    memo.validate();
+    uint idx = function_memo::index(args);
+    for (uint way = 0; way < 2; way++)
+    {
+        function_memo::entry &e = memo.entries[idx + way];
+        if (memo.matches(e, fn, indep, args))
+        {
+            record(algebraic, "Memoized value for %t at %u", fn, idx + way);
+            return e.value;
+        }
+    }
+    return nullptr;
+}
+
+
+void algebraic::memo_record(object_p fn, object_p args, algebraic_p value)
+// ----------------------------------------------------------------------------
+//   Remember the value of a function for the given arguments
+// ----------------------------------------------------------------------------
+{
+    if (!fn || !args || !value)
+        return;
+    function_memo &memo  = function_memo::current();
+    object_p       indep = memo_independent();
+    memo.validate();
+    uint idx = function_memo::index(args);
+
+    // Keep the most recent value in the first way, move the older to second
+    function_memo::entry &first = memo.entries[idx];
+    function_memo::entry &second = memo.entries[idx + 1];
+    if (!memo.matches(first, fn, indep, args))
+        second = first;
+    first.function = fn;
+    first.independent = indep;
+    first.arguments = args;
+    first.value = value;
+}
+
+
+object_p algebraic::memo_arguments(uint count)
+// ----------------------------------------------------------------------------
+//   Build the key for arguments on the stack, without removing them
+// ----------------------------------------------------------------------------
+{
+    if (count == 1)
+        return rt.stack(0);
+    scribble scr;
+    for (uint i = 0; i < count; i++)
+        if (object_g obj = rt.stack(count + ~i))
+            if (!rt.append(obj))
+                return nullptr;
+    return list::make(ID_list, scr.scratch(), scr.growth());
+}
+
+
 algebraic_p algebraic::evaluate_function(program_r eq, algebraic_r x)
 // ----------------------------------------------------------------------------
 //   Evaluate the eq object as a function
@@ -926,6 +1091,11 @@ algebraic_p algebraic::evaluate_function(program_r eq, algebraic_r x)
 //   - Something that evaluates using the indep and returns it on the stack,
 //     for example 'X + 1' (assuming X is the independent variable)
 {
+    bool memo = Settings.MemoizeFunctions();
+    if (memo)
+        if (algebraic_p value = memo_lookup(+eq, +x))
+            return value;
+
     if (!rt.push(+x))
         return nullptr;
     rt.clear_error();
@@ -957,10 +1127,242 @@ algebraic_p algebraic::evaluate_function(program_r eq, algebraic_r x)
             rt.invalid_function_error();
         return nullptr;
     }
+    if (memo)
+        memo_record(+eq, +x, algebraic_p(result));
     return algebraic_p(result);
 }
 
 
+// ============================================================================
+//
+//   Compiled evaluation of expressions with hardware doubles
+//
+// ============================================================================
+//   The expression is already in postfix form, so each object maps to one
+//   opcode of a small stack machine. The independent variable is encoded as
+//   ID_symbol, and constants as ID_hwdouble, taken in order from constants.
+
+fast_function::fast_function(program_r eq, object_p name, bool enable)
+// ----------------------------------------------------------------------------
+//   Compile an expression, leave length at 0 if we cannot
+// ----------------------------------------------------------------------------
+    : length(0)
+{
+    if (!enable || !eq || !name || eq->type() != object::ID_expression)
+        return;
+    symbol_p sym = name->as<symbol>();
+    if (!sym)
+        return;
+
+    uint   len    = 0;
+    uint   consts = 0;
+    int    depth  = 0;
+    for (object_p obj : *eq)
+    {
+        if (len >= MAX_CODE)
+            return;
+        object::id ty = obj->type();
+        int        in = 1;
+        switch (ty)
+        {
+        case object::ID_symbol:
+            if (!symbol_p(obj)->is_same_as(sym))
+                return;
+            in = 0;
+            break;
+
+        case object::ID_integer:
+        case object::ID_neg_integer:
+        case object::ID_decimal:
+        case object::ID_neg_decimal:
+        case object::ID_fraction:
+        case object::ID_neg_fraction:
+        case object::ID_hwfloat:
+        case object::ID_hwdouble:
+            if (consts >= MAX_CONSTANTS ||
+                !real_value(obj, constants[consts]))
+                return;
+            consts++;
+            ty = object::ID_hwdouble;
+            in = 0;
+            break;
+
+        case object::ID_add:
+        case object::ID_subtract:
+        case object::ID_multiply:
+        case object::ID_divide:
+        case object::ID_pow:
+        case object::ID_atan2:
+        case object::ID_hypot:
+            in = 2;
+            break;
+
+        case object::ID_neg:
+        case object::ID_abs:
+        case object::ID_inv:
+        case object::ID_sq:
+        case object::ID_cubed:
+        case object::ID_sqrt:
+        case object::ID_cbrt:
+        case object::ID_sin:
+        case object::ID_cos:
+        case object::ID_tan:
+        case object::ID_asin:
+        case object::ID_acos:
+        case object::ID_atan:
+        case object::ID_sinh:
+        case object::ID_cosh:
+        case object::ID_tanh:
+        case object::ID_asinh:
+        case object::ID_acosh:
+        case object::ID_atanh:
+        case object::ID_ln:
+        case object::ID_exp:
+        case object::ID_log10:
+        case object::ID_exp10:
+        case object::ID_log2:
+        case object::ID_exp2:
+        case object::ID_ln1p:
+        case object::ID_expm1:
+            break;
+
+        default:
+            return;
+        }
+
+        // Check stack usage
+        if (depth < in)
+            return;
+        depth = depth - in + 1;
+        if (depth > MAX_STACK)
+            return;
+        code[len++] = ty;
+    }
+    if (depth == 1)
+        length = len;
+}
+
+
+bool fast_function::hardware()
+// ----------------------------------------------------------------------------
+//   Check if the current settings would compute with hardware floating point
+// ----------------------------------------------------------------------------
+{
+    return Settings.HardwareFloatingPointEnabled() && Settings.Precision() <= 16;
+}
+
+
+bool fast_function::real_value(object_p obj, double &value)
+// ----------------------------------------------------------------------------
+//   Convert a real number to double
+// ----------------------------------------------------------------------------
+{
+    switch (obj->type())
+    {
+    case object::ID_integer:
+        value = double(integer_p(obj)->value<ularge>());
+        return true;
+    case object::ID_neg_integer:
+        value = -double(integer_p(obj)->value<ularge>());
+        return true;
+    case object::ID_decimal:
+    case object::ID_neg_decimal:
+        value = decimal_p(obj)->to_double();
+        return true;
+    case object::ID_fraction:
+    case object::ID_neg_fraction:
+        value = double(fraction_p(obj)->numerator_value()) /
+                double(fraction_p(obj)->denominator_value());
+        if (obj->type() == object::ID_neg_fraction)
+            value = -value;
+        return true;
+    case object::ID_hwfloat:
+        value = hwfloat_p(obj)->value();
+        return true;
+    case object::ID_hwdouble:
+        value = hwdouble_p(obj)->value();
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+bool fast_function::run(double x, double &y) const
+// ----------------------------------------------------------------------------
+//   Run the compiled code, return false if the result is not finite
+// ----------------------------------------------------------------------------
+{
+    typedef hwfp<double> hw;
+    double stack[MAX_STACK];
+    uint   sp     = 0;
+    uint   consts = 0;
+    for (uint i = 0; i < length; i++)
+    {
+        double &a = stack[sp ? sp - 1 : 0];
+        double  b = sp >= 2 ? stack[sp - 2] : 0.0;
+        switch (code[i])
+        {
+        case object::ID_symbol:   stack[sp++] = x;                   break;
+        case object::ID_hwdouble: stack[sp++] = constants[consts++]; break;
+
+        case object::ID_add:      stack[sp-- - 2] = b + a;           break;
+        case object::ID_subtract: stack[sp-- - 2] = b - a;           break;
+        case object::ID_multiply: stack[sp-- - 2] = b * a;           break;
+        case object::ID_divide:   stack[sp-- - 2] = b / a;           break;
+        case object::ID_pow:      stack[sp-- - 2] = std::pow(b, a);  break;
+        case object::ID_hypot:    stack[sp-- - 2] = std::hypot(b, a); break;
+        case object::ID_atan2:
+            stack[sp-- - 2] = hw::to_angle(std::atan2(b, a));
+            break;
+
+        case object::ID_neg:      a = -a;                            break;
+        case object::ID_abs:      a = std::fabs(a);                  break;
+        case object::ID_inv:      a = 1.0 / a;                       break;
+        case object::ID_sq:       a = a * a;                         break;
+        case object::ID_cubed:    a = a * a * a;                     break;
+        case object::ID_sqrt:     a = std::sqrt(a);                  break;
+        case object::ID_cbrt:     a = std::cbrt(a);                  break;
+        case object::ID_sin:      a = std::sin(hw::from_angle(a));   break;
+        case object::ID_cos:      a = std::cos(hw::from_angle(a));   break;
+        case object::ID_tan:      a = std::tan(hw::from_angle(a));   break;
+        case object::ID_asin:     a = hw::to_angle(std::asin(a));    break;
+        case object::ID_acos:     a = hw::to_angle(std::acos(a));    break;
+        case object::ID_atan:     a = hw::to_angle(std::atan(a));    break;
+        case object::ID_sinh:     a = std::sinh(a);                  break;
+        case object::ID_cosh:     a = std::cosh(a);                  break;
+        case object::ID_tanh:     a = std::tanh(a);                  break;
+        case object::ID_asinh:    a = std::asinh(a);                 break;
+        case object::ID_acosh:    a = std::acosh(a);                 break;
+        case object::ID_atanh:    a = std::atanh(a);                 break;
+        case object::ID_ln:       a = std::log(a);                   break;
+        case object::ID_exp:      a = std::exp(a);                   break;
+        case object::ID_log10:    a = std::log10(a);                 break;
+        case object::ID_exp10:    a = std::pow(10.0, a);             break;
+        case object::ID_log2:     a = std::log2(a);                  break;
+        case object::ID_exp2:     a = std::exp2(a);                  break;
+        case object::ID_ln1p:     a = std::log1p(a);                 break;
+        case object::ID_expm1:    a = std::expm1(a);                 break;
+        default:                  return false;
+        }
+    }
+    y = stack[0];
+    return std::isfinite(y);
+}
+
+
+algebraic_p fast_function::evaluate(program_r eq, algebraic_r x) const
+// ----------------------------------------------------------------------------
+//   Evaluate with compiled code if possible, otherwise use the interpreter
+// ----------------------------------------------------------------------------
+{
+    double xv, yv;
+    if (length && x && real_value(x, xv) && run(xv, yv))
+        return hwdouble::make(yv);
+    return algebraic::evaluate_function(eq, x);
+}
+
+
 algebraic_p algebraic::evaluate() const
 // ----------------------------------------------------------------------------
 //   Evaluate an algebraic value as an algebraic
@@ -112,6 +112,11 @@ struct algebraic : command
         return evaluate_function(eq, x);
     }
 
+    // Remember results of functions when MemoizeFunctions is set
+    static algebraic_p memo_lookup(object_p fn, object_p args);
+    static void        memo_record(object_p fn, object_p args, algebraic_p value);
+    static object_p    memo_arguments(uint count);
+
     // Evaluate an algebraic as an algebraic
     algebraic_p evaluate() const;
 
@@ -142,4 +147,29 @@ struct algebraic : command
 typedef algebraic_p (*algebraic_fn)(algebraic_r x);
 typedef algebraic_p (*arithmetic_fn)(algebraic_r x, algebraic_r y);
 
+
+struct fast_function
+// ----------------------------------------------------------------------------
+//   An expression compiled for evaluation with hardware doubles
+// ----------------------------------------------------------------------------
+//   This is used in the inner loops of plot, solve and integrate.
+//   Only expressions made of real constants, the independent variable and
+//   common real functions are compiled. Other expressions, or samples where
+//   the compiled code does not produce a finite real, use the interpreter.
+{
+    fast_function(program_r eq, object_p name, bool enable = true);
+    bool        compiled() const        { return length != 0; }
+    algebraic_p evaluate(program_r eq, algebraic_r x) const;
+    bool        run(double x, double &y) const;
+    static bool hardware();
+    static bool real_value(object_p obj, double &value);
+
+private:
+
+    enum { MAX_CODE = 64, MAX_CONSTANTS = 16, MAX_STACK = 16 };
+    object::id  code[MAX_CODE];         // Opcode is the operation ID
+    double      constants[MAX_CONSTANTS];
+    uint        length;                 // Number of opcodes
+};
+
 #endif // ALGEBRAIC_H
@@ -41,6 +41,7 @@
 #include "integer.h"
 #include "list.h"
 #include "polynomial.h"
+#include "program.h"
 #include "runtime.h"
 #include "settings.h"
 #include "tag.h"
@@ -1501,6 +1502,54 @@ algebraic_p arithmetic::non_numeric<struct atan2>(algebraic_r x, algebraic_r y)
 //
 // ============================================================================
 
+static inline bool small_integer(object_p obj, large &value)
+// ----------------------------------------------------------------------------
+//   Check if an object is a native integer, and return its signed value
+// ----------------------------------------------------------------------------
+{
+    object::id ty = obj->type();
+    if (ty != object::ID_integer && ty != object::ID_neg_integer)
+        return false;
+    integer_p i = integer_p(obj);
+    if (!i->native())
+        return false;
+    ularge magnitude = i->value<ularge>();
+    value = ty == object::ID_neg_integer ? -large(magnitude) : large(magnitude);
+    return true;
+}
+
+
+static inline bool small_integer_op(object::id  op,
+                                    object_p    y,
+                                    object_p    x,
+                                    algebraic_p &result)
+// ----------------------------------------------------------------------------
+//   Add, subtract or multiply two small integers with native arithmetic
+// ----------------------------------------------------------------------------
+//   Returns false if the operands or the result do not fit in 63 bits, in
+//   which case the generic code deals with the operation and promotion.
+{
+    large yv, xv, rv;
+    if (!small_integer(y, yv) || !small_integer(x, xv))
+        return false;
+
+    bool overflow;
+    switch (op)
+    {
+    case object::ID_add:      overflow = __builtin_add_overflow(yv, xv, &rv); break;
+    case object::ID_subtract: overflow = __builtin_sub_overflow(yv, xv, &rv); break;
+    case object::ID_multiply: overflow = __builtin_mul_overflow(yv, xv, &rv); break;
+    default:                  return false;
+    }
+    if (overflow || rv == INT64_MIN)
+        return false;
+
+    object::id ty = rv < 0 ? object::ID_neg_integer : object::ID_integer;
+    result = rt.make<integer>(ty, ularge(rv < 0 ? -rv : rv));
+    return true;
+}
+
+
 algebraic_p arithmetic::evaluate(id          op,
                                  algebraic_r xr,
                                  algebraic_r yr,
@@ -1512,6 +1561,11 @@ algebraic_p arithmetic::evaluate(id          op,
     if (!xr || !yr || rt.error())
         return nullptr;
 
+    // Fast path for small integers
+    algebraic_p fast = nullptr;
+    if (!Settings.NumericalResults() && small_integer_op(op, +xr, +yr, fast))
+        return fast;
+
     record(arithmetic, "Op %u x=%t y=%t", op, +xr, +yr);
     algebraic_g x   = xr;
     algebraic_g y   = yr;
@@ -1544,22 +1598,34 @@ algebraic_p arithmetic::evaluate(id          op,
             yt = algebraic::based_promotion(y);
         }
 
-        if (!is_bignum(xt) && !is_bignum(yt))
+        uint ws = Settings.WordSize();
+        if (based && ws <= 64)
+        {
+            // Based numbers that fit in a machine word, including 64-bit ones
+            ularge xv = 0, yv = 0;
+            if (bignum::based_word(x, xv) && bignum::based_word(y, yv))
+            {
+                id xit = is_bignum(xt) ? ID_based_integer : xt;
+                id yit = is_bignum(yt) ? ID_based_integer : yt;
+                if (ops.integer_ok(xit, yit, xv, yv))
+                {
+                    if (ws < 64)
+                        xv &= (1ULL << ws) - 1ULL;
+                    return bignum::based_word(xt, xv);
+                }
+            }
+        }
+        else if (!is_bignum(xt) && !is_bignum(yt))
         {
             // Perform conversion of integer values to the same base
             integer_p xi = integer_p(object_p(+x));
             integer_p yi = integer_p(object_p(+y));
-            uint      ws = Settings.WordSize();
-            if (xi->native() && yi->native() && (ws < 64 || !based))
+            if (xi->native() && yi->native() && !based)
             {
                 ularge xv = xi->value<ularge>();
                 ularge yv = yi->value<ularge>();
                 if (ops.integer_ok(xt, yt, xv, yv))
-                {
-                    if (based)
-                        xv &= (1UL << ws) - 1UL;
                     return rt.make<integer>(xt, xv);
-                }
             }
         }
 
@@ -1783,6 +1849,23 @@ object::result arithmetic::evaluate(id op, ops_t ops)
     object_p xo = strip(rt.stack(0));
     if (!xo || !yo)
         return ERROR;
+
+    // Fast path for small integers, e.g. counters and indexes
+    if ((op == ID_add || op == ID_subtract || op == ID_multiply) &&
+        !Settings.NumericalResults())
+    {
+        algebraic_p r = nullptr;
+        if (small_integer_op(op, yo, xo, r))
+        {
+            if (r)
+            {
+                rt.drop();
+                if (rt.top(r))
+                    return OK;
+            }
+            return ERROR;
+        }
+    }
     algebraic_g y = yo->as_extended_algebraic();
     algebraic_g x = xo->as_extended_algebraic();
     if (!x || !y)
@@ -1986,7 +2069,7 @@ algebraic_g pow(algebraic_r xr, ularge y)
     algebraic_g x = xr;
     if (x->is_decimal() &&
         !decimal::precision_adjust::adjusted &&
-        !(Settings.HardwareFloatingPoint() && Settings.Precision() <= 16))
+        !(Settings.HardwareFloatingPointEnabled() && Settings.Precision() <= 16))
     {
         decimal::precision_adjust prec(3);
         r = pow(xr, y);
@@ -2183,6 +2266,245 @@ COMMAND_BODY(Div2)
 }
 
 
+// ============================================================================
+//
+//   Modular exponentiation and inverse on integers
+//
+// ============================================================================
+
+static bignum_p modular_argument(uint level)
+// ----------------------------------------------------------------------------
+//   Fetch an integer argument on the stack as a bignum
+// ----------------------------------------------------------------------------
+{
+    object_p obj = object::strip(rt.stack(level));
+    if (!obj)
+        return nullptr;
+    while (tag_p tg = obj->as<tag>())
+        obj = tg->tagged_object();
+    if (!object::is_integer(obj->type()))
+    {
+        rt.type_error();
+        return nullptr;
+    }
+    return bignum::promote(obj);
+}
+
+
+COMMAND_BODY(PowMod)
+// ----------------------------------------------------------------------------
+//   Compute y^x mod m, reducing at each step
+// ----------------------------------------------------------------------------
+{
+    bignum_g m = modular_argument(0);
+    bignum_g x = m ? modular_argument(1) : nullptr;
+    bignum_g y = x ? modular_argument(2) : nullptr;
+    if (!y)
+        return ERROR;
+    bignum_g r = bignum::powmod(y, x, m);
+    if (r && rt.drop(2) && rt.top(r))
+        return OK;
+    return ERROR;
+}
+
+
+COMMAND_BODY(ModInv)
+// ----------------------------------------------------------------------------
+//   Compute the inverse of x modulo m
+// ----------------------------------------------------------------------------
+{
+    bignum_g m = modular_argument(0);
+    bignum_g x = m ? modular_argument(1) : nullptr;
+    if (!x)
+        return ERROR;
+    bignum_g r = bignum::modinv(x, m);
+    if (r && rt.drop() && rt.top(r))
+        return OK;
+    return ERROR;
+}
+
+
+// ============================================================================
+//
+//   Primality and factorization of integers
+//
+// ============================================================================
+
+static object_p prime_value(bignum_r x)
+// ----------------------------------------------------------------------------
+//   Return a result as a small integer if it fits
+// ----------------------------------------------------------------------------
+{
+    if (integer_p i = x->as_integer())
+        return i;
+    return +x;
+}
+
+
+COMMAND_BODY(IsPrime)
+// ----------------------------------------------------------------------------
+//   Return True if the integer is a prime number
+// ----------------------------------------------------------------------------
+{
+    bignum_g x = modular_argument(0);
+    if (!x)
+        return ERROR;
+    bool prime = bignum::is_prime(x);
+    if (rt.error())
+        return ERROR;
+    if (object_p value = static_object(prime ? ID_True : ID_False))
+        if (rt.top(value))
+            return OK;
+    return ERROR;
+}
+
+
+COMMAND_BODY(Factors)
+// ----------------------------------------------------------------------------
+//   Return the prime factors of an integer as { p1 e1 p2 e2 ... }
+// ----------------------------------------------------------------------------
+{
+    bignum_g x = modular_argument(0);
+    if (!x)
+        return ERROR;
+    if (x->is_zero())
+    {
+        rt.value_error();
+        return ERROR;
+    }
+
+    stack_depth_restore sdr;
+    if (!bignum::prime_factors(x))
+        return ERROR;
+
+    // Sort the factors, smallest deepest in the stack
+    uint count = rt.depth() - sdr.depth;
+    for (uint i = 1; i < count; i++)
+    {
+        for (uint j = i; j > 0; j--)
+        {
+            bignum_g lo = bignum_p(rt.stack(count - j));
+            bignum_g hi = bignum_p(rt.stack(count - 1 - j));
+            if (!(hi < lo))
+                break;
+            rt.stack(count - j, +hi);
+            rt.stack(count - 1 - j, +lo);
+        }
+    }
+
+    // Group identical factors with their multiplicity
+    uint pushed = 0;
+    if (x->type() == ID_neg_bignum)
+    {
+        object_g minus = integer::make(-1);
+        object_g one   = integer::make(1);
+        if (!rt.push(minus) || !rt.push(one))
+            return ERROR;
+        pushed += 2;
+    }
+    for (uint i = 0; i < count; )
+    {
+        bignum_g p     = bignum_p(rt.stack(count - 1 - i + pushed));
+        uint     exp   = 1;
+        for (i++; i < count; i++, exp++)
+        {
+            bignum_g q = bignum_p(rt.stack(count - 1 - i + pushed));
+            if (q != p)
+                break;
+        }
+        object_g pv = prime_value(p);
+        object_g ev = integer::make(exp);
+        if (!pv || !ev || !rt.push(pv) || !rt.push(ev))
+            return ERROR;
+        pushed += 2;
+    }
+    list_g result = list::list_from_stack(pushed, ID_list);
+    if (!result)
+        return ERROR;
+    rt.drop(count);
+    if (rt.top(result))
+        return OK;
+    return ERROR;
+}
+
+
+static object::result prime_step(bool up)
+// ----------------------------------------------------------------------------
+//   Find the next or previous prime number
+// ----------------------------------------------------------------------------
+{
+    bignum_g x = modular_argument(0);
+    if (!x)
+        return object::ERROR;
+    bignum_g one = bignum::make(1);
+    bignum_g two = bignum::make(2);
+    if (!one || !two)
+        return object::ERROR;
+
+    bool negative = x->type() == object::ID_neg_bignum;
+    if (up && (negative || x < two))
+    {
+        x = two;
+    }
+    else
+    {
+        if (!up && (negative || x <= two))
+        {
+            rt.value_error();
+            return object::ERROR;
+        }
+        bignum_g three = bignum::make(3);
+        if (!up && x == three)
+        {
+            x = two;
+        }
+        else
+        {
+            // Step to the next odd candidate, then test every other value
+            x = up ? x + one : x - one;
+            size_t xs = 0;
+            if (x && !(x->value(&xs)[0] & 1))
+                x = up ? x + one : x - one;
+            while (x && !bignum::is_prime(x))
+            {
+                if (rt.error())
+                    return object::ERROR;
+                if (program::interrupted())
+                {
+                    rt.interrupted_error();
+                    return object::ERROR;
+                }
+                x = up ? x + two : x - two;
+            }
+        }
+    }
+    if (!x)
+        return object::ERROR;
+    if (object_g value = prime_value(x))
+        if (rt.top(value))
+            return object::OK;
+    return object::ERROR;
+}
+
+
+COMMAND_BODY(NextPrime)
+// ----------------------------------------------------------------------------
+//   Return the smallest prime number larger than the argument
+// ----------------------------------------------------------------------------
+{
+    return prime_step(true);
+}
+
+
+COMMAND_BODY(PrevPrime)
+// ----------------------------------------------------------------------------
+//   Return the largest prime number smaller than the argument
+// ----------------------------------------------------------------------------
+{
+    return prime_step(false);
+}
+
+
 #define ARITHMETIC_DEFINE(derived)      arithmetic::target_fn derived::target;
 
 ARITHMETIC_DEFINE(add);
@@ -262,6 +262,12 @@ ARITHMETIC_DECLARE(hypot,           POWER);
 ARITHMETIC_DECLARE(atan2,           POWER);
 
 COMMAND_DECLARE(Div2, 2);
+COMMAND_DECLARE(PowMod, 3);
+COMMAND_DECLARE(ModInv, 2);
+COMMAND_DECLARE(IsPrime, 1);
+COMMAND_DECLARE(Factors, 1);
+COMMAND_DECLARE(NextPrime, 1);
+COMMAND_DECLARE(PrevPrime, 1);
 
 
 
@@ -34,6 +34,8 @@
 #include "expression.h"
 #include "functions.h"
 #include "grob.h"
+#include "hwfp.h"
+#include "settings.h"
 #include "stack-cmds.h"
 #include "stats.h"
 #include "tag.h"
@@ -480,6 +482,633 @@ array_p array::build(size_t rows, size_t columns, item_fn items, void *data)
 
 
 
+// ============================================================================
+//
+//    Dense numerical matrices
+//
+// ============================================================================
+//   When computing with hardware floating-point, a matrix or vector where
+//   all elements are decimal or hardware floating-point values is processed
+//   as a packed copy of doubles in the scratchpad. The result is converted
+//   back to an array of hardware floating-point values, which is what the
+//   generic element-wise arithmetic would have produced in that mode.
+//   Anything else, including exact values, goes through the generic code.
+
+struct dense
+// ----------------------------------------------------------------------------
+//   A packed copy of a real matrix or vector in the scratchpad
+// ----------------------------------------------------------------------------
+//   The scratchpad moves whenever objects are created, so the values are
+//   located by their offset, and copied with memcpy since the scratchpad
+//   has no particular alignment. Instances must be destroyed in reverse
+//   order of allocation, which is the case for local variables.
+{
+    dense(): rows(0), columns(0), offset(0), size(0) {}
+    ~dense()
+    {
+        if (size)
+            rt.free(size);
+    }
+
+    static bool enabled()
+    {
+        return Settings.HardwareFloatingPointEnabled() && Settings.Precision() <= 16;
+    }
+
+    bool allocate(size_t r, size_t c)
+    {
+        size_t sz = r * (c ? c : 1) * sizeof(double);
+        offset = rt.allocated();
+        if (!rt.allocate(sz))
+            return false;
+        rows = r;
+        columns = c;
+        size = sz;
+        return true;
+    }
+
+    size_t items() const        { return rows * (columns ? columns : 1); }
+    byte  *base() const         { return rt.scratchpad()-rt.allocated()+offset; }
+    double get(size_t i) const
+    {
+        double v;
+        memcpy(&v, base() + i * sizeof(double), sizeof(double));
+        return v;
+    }
+    void set(size_t i, double v) const
+    {
+        memcpy(base() + i * sizeof(double), &v, sizeof(double));
+    }
+
+    bool               load(array_r a);
+    array_p            store(bool raw = false) const;
+
+    static bool        value(object_p obj, double &v);
+    static algebraic_p make_value(double v);
+    static object_p    item(size_t, size_t, size_t r, size_t c, void *data);
+    static object_p    raw_item(size_t, size_t, size_t r, size_t c, void *data);
+
+    size_t rows;
+    size_t columns;             // Zero for a vector
+    size_t offset;              // Offset in the scratchpad
+    size_t size;                // Allocated size
+};
+
+
+bool dense::value(object_p obj, double &v)
+// ----------------------------------------------------------------------------
+//   Read an inexact real element
+// ----------------------------------------------------------------------------
+{
+    switch (obj->type())
+    {
+    case object::ID_decimal:
+    case object::ID_neg_decimal:
+        v = decimal_p(obj)->to_double();
+        return true;
+    case object::ID_hwfloat:
+        v = hwfloat_p(obj)->value();
+        return true;
+    case object::ID_hwdouble:
+        v = hwdouble_p(obj)->value();
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+algebraic_p dense::make_value(double v)
+// ----------------------------------------------------------------------------
+//   Build a hardware floating-point value for the current precision
+// ----------------------------------------------------------------------------
+{
+    if (Settings.Precision() <= 7)
+        return hwfloat::make(float(v));
+    return hwdouble::make(v);
+}
+
+
+bool dense::load(array_r a)
+// ----------------------------------------------------------------------------
+//   Load a matrix or vector, return false if it is not homogeneous
+// ----------------------------------------------------------------------------
+{
+    if (!enabled() || !a)
+        return false;
+
+    size_t r = 0, c = 0;
+    if (!a->is_matrix(&r, &c, false))
+    {
+        c = 0;
+        if (!a->is_vector(&r, false))
+            return false;
+    }
+    if (!r || !allocate(r, c))
+        return false;
+
+    size_t i = 0;
+    for (object_p row : *a)
+    {
+        if (c)
+        {
+            for (object_p obj : *list_p(row))
+            {
+                double v;
+                if (!value(obj, v))
+                    return false;
+                set(i++, v);
+            }
+        }
+        else
+        {
+            double v;
+            if (!value(row, v))
+                return false;
+            set(i++, v);
+        }
+    }
+    return i == items();
+}
+
+
+object_p dense::item(size_t, size_t, size_t r, size_t c, void *data)
+// ----------------------------------------------------------------------------
+//   Build an element of the result
+// ----------------------------------------------------------------------------
+{
+    const dense &d = *((const dense *) data);
+    return make_value(d.get(r * (d.columns ? d.columns : 1) + c));
+}
+
+
+object_p dense::raw_item(size_t, size_t, size_t r, size_t c, void *data)
+// ----------------------------------------------------------------------------
+//   Build an element keeping the full double precision
+// ----------------------------------------------------------------------------
+{
+    const dense &d = *((const dense *) data);
+    return hwdouble::make(d.get(r * (d.columns ? d.columns : 1) + c));
+}
+
+
+array_p dense::store(bool raw) const
+// ----------------------------------------------------------------------------
+//   Convert the packed values back into an array
+// ----------------------------------------------------------------------------
+//   Raw values are kept as hwdouble irrespective of precision, which is
+//   used for the cached LU factorization.
+{
+    return array::build(rows, columns, raw ? raw_item : item, (void *) this);
+}
+
+
+static bool dense_add_sub(array_r x, array_r y, bool sub, array_g &result)
+// ----------------------------------------------------------------------------
+//   Add or subtract two dense arrays of the same shape
+// ----------------------------------------------------------------------------
+{
+    dense dx, dy;
+    if (!dx.load(x) || !dy.load(y))
+        return false;
+    if (dx.rows != dy.rows || dx.columns != dy.columns)
+        return false;
+
+    size_t n = dx.items();
+    for (size_t i = 0; i < n; i++)
+        dx.set(i, sub ? dx.get(i) - dy.get(i) : dx.get(i) + dy.get(i));
+    result = dx.store();
+    return true;
+}
+
+
+static bool dense_scalar(array_r a, arithmetic_fn fn, algebraic_r s,
+                         bool left, array_g &result)
+// ----------------------------------------------------------------------------
+//   Apply a basic arithmetic operation between a dense array and a scalar
+// ----------------------------------------------------------------------------
+//   All elements are computed in one pass, and only the result is allocated
+{
+    enum { ADD, SUB, MUL, DIV } op;
+    if (fn == add::evaluate)
+        op = ADD;
+    else if (fn == subtract::evaluate)
+        op = SUB;
+    else if (fn == multiply::evaluate)
+        op = MUL;
+    else if (fn == divide::evaluate)
+        op = DIV;
+    else
+        return false;
+
+    double sv;
+    if (!dense::enabled() || !dense::value(+s, sv))
+        return false;
+    if (op == DIV && !left && sv == 0.0)
+        return false;
+
+    dense d;
+    if (!d.load(a))
+        return false;
+
+    size_t n = d.items();
+    for (size_t i = 0; i < n; i++)
+    {
+        double x = left ? sv : d.get(i);
+        double y = left ? d.get(i) : sv;
+        double r;
+        switch (op)
+        {
+        case ADD:       r = x + y; break;
+        case SUB:       r = x - y; break;
+        case MUL:       r = x * y; break;
+        default:
+            if (y == 0.0)       // Let the generic code report the error
+                return false;
+            r = x / y;
+            break;
+        }
+        d.set(i, r);
+    }
+    result = d.store();
+    return true;
+}
+
+
+array_p array::map(arithmetic_fn fn, algebraic_r y) const
+// ----------------------------------------------------------------------------
+//   Right-apply an arithmetic function on all elements in the array
+// ----------------------------------------------------------------------------
+{
+    array_g x = this;
+    array_g dres;
+    if (dense_scalar(x, fn, y, false, dres))
+        return dres;
+    return array_p(x->list::map(fn, y));
+}
+
+
+array_p array::map(algebraic_r x, arithmetic_fn fn) const
+// ----------------------------------------------------------------------------
+//   Left-apply an arithmetic function on all elements in the array
+// ----------------------------------------------------------------------------
+{
+    array_g y = this;
+    array_g dres;
+    if (dense_scalar(y, fn, x, true, dres))
+        return dres;
+    return array_p(y->list::map(x, fn));
+}
+
+
+#ifndef DENSE_PANEL
+#define DENSE_PANEL     32
+#endif
+
+static void dense_multiply(const dense &a, const dense &b, const dense &r)
+// ----------------------------------------------------------------------------
+//   Blocked product kernel, r = a * b
+// ----------------------------------------------------------------------------
+//   The product is computed TILE output columns at a time, with the
+//   sums held in FPU registers. A panel of up to DENSE_PANEL rows of b and
+//   the matching slice of each a row are copied to aligned local buffers,
+//   which are on the C stack, i.e. in DTCM on hardware that puts it there.
+//   This avoids unaligned scratchpad accesses in the inner loop.
+{
+    size_t n = a.rows;
+    size_t m = a.columns;
+    size_t q = b.columns ? b.columns : 1;
+    enum { TILE = 4 };          // Matches the number of sums below
+    double bp[DENSE_PANEL][TILE];
+    double ap[DENSE_PANEL];
+
+    for (size_t i = 0; i < n * q; i++)
+        r.set(i, 0.0);
+
+    for (size_t k0 = 0; k0 < m; k0 += DENSE_PANEL)
+    {
+        size_t kn = m - k0 < DENSE_PANEL ? m - k0 : DENSE_PANEL;
+        for (size_t j0 = 0; j0 < q; j0 += TILE)
+        {
+            size_t jn = q - j0 < TILE ? q - j0 : size_t(TILE);
+            // Zero terms can only be skipped if 0·b is zero, not NaN
+            bool finite = true;
+            for (size_t k = 0; k < kn; k++)
+            {
+                for (size_t j = 0; j < TILE; j++)
+                {
+                    bp[k][j] = j < jn ? b.get((k0 + k) * q + j0 + j) : 0.0;
+                    finite = finite && std::isfinite(bp[k][j]);
+                }
+            }
+
+            for (size_t i = 0; i < n; i++)
+            {
+                for (size_t k = 0; k < kn; k++)
+                    ap[k] = a.get(i * m + k0 + k);
+
+                double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+                for (size_t k = 0; k < kn; k++)
+                {
+                    double av = ap[k];
+                    if (av == 0.0 && finite)
+                        continue;
+                    s0 += av * bp[k][0];
+                    s1 += av * bp[k][1];
+                    s2 += av * bp[k][2];
+                    s3 += av * bp[k][3];
+                }
+                double sums[TILE] = { s0, s1, s2, s3 };
+                for (size_t j = 0; j < jn; j++)
+                {
+                    size_t o = i * q + j0 + j;
+                    r.set(o, r.get(o) + sums[j]);
+                }
+            }
+        }
+    }
+}
+
+
+static bool dense_mul(array_r x, array_r y, array_g &result)
+// ----------------------------------------------------------------------------
+//   Multiply a dense matrix by a dense matrix or vector
+// ----------------------------------------------------------------------------
+{
+    dense dx, dy;
+    if (!dx.load(x) || !dx.columns || !dy.load(y) || dx.columns != dy.rows)
+        return false;
+
+    dense dr;
+    if (!dr.allocate(dx.rows, dy.columns))
+        return false;
+    dense_multiply(dx, dy, dr);
+    result = dr.store();
+    return true;
+}
+
+
+static bool dense_dot(array_r x, array_r y, algebraic_g &result)
+// ----------------------------------------------------------------------------
+//   Dot product of two dense vectors
+// ----------------------------------------------------------------------------
+{
+    dense dx, dy;
+    if (!dx.load(x) || dx.columns || !dy.load(y) || dy.columns)
+        return false;
+    if (dx.rows != dy.rows)
+        return false;
+
+    // Four independent sums to keep the FPU pipeline busy
+    size_t n  = dx.rows;
+    size_t i  = 0;
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += dx.get(i + 0) * dy.get(i + 0);
+        s1 += dx.get(i + 1) * dy.get(i + 1);
+        s2 += dx.get(i + 2) * dy.get(i + 2);
+        s3 += dx.get(i + 3) * dy.get(i + 3);
+    }
+    for (; i < n; i++)
+        s0 += dx.get(i) * dy.get(i);
+    result = dense::make_value((s0 + s1) + (s2 + s3));
+    return true;
+}
+
+
+static bool dense_transpose(array_r x, array_g &result)
+// ----------------------------------------------------------------------------
+//   Transpose a dense matrix
+// ----------------------------------------------------------------------------
+{
+    dense dx, dr;
+    if (!dx.load(x) || !dx.columns || !dr.allocate(dx.columns, dx.rows))
+        return false;
+    for (size_t i = 0; i < dx.rows; i++)
+        for (size_t j = 0; j < dx.columns; j++)
+            dr.set(j * dx.rows + i, dx.get(i * dx.columns + j));
+    result = dr.store();
+    return true;
+}
+
+
+static bool dense_pivot(const dense &m, size_t n, size_t i, size_t &pivot)
+// ----------------------------------------------------------------------------
+//   Find the row with the largest element in column i, false if all zero
+// ----------------------------------------------------------------------------
+{
+    double best = 0.0;
+    for (size_t j = i; j < n; j++)
+    {
+        double v = fabs(m.get(j * n + i));
+        if (v > best)
+        {
+            best = v;
+            pivot = j;
+        }
+    }
+    return best != 0.0;
+}
+
+
+struct dense_lu_cache
+// ----------------------------------------------------------------------------
+//   The last LU factorization that was computed
+// ----------------------------------------------------------------------------
+{
+    array_g matrix;             // Matrix that was factored
+    array_g factors;            // L below the diagonal, U on and above
+    array_g pivots;             // Row exchanged with row i at step i
+};
+
+
+static bool dense_factor(array_r a, dense &lu, dense &piv, bool &singular)
+// ----------------------------------------------------------------------------
+//   LU factorization with partial pivoting, shared by DET, INV and /
+// ----------------------------------------------------------------------------
+//   The last factorization is cached, so that solving repeatedly with the
+//   same left-hand side, or computing its inverse and determinant, only
+//   costs a substitution. L has an implicit unit diagonal.
+{
+    static dense_lu_cache cache;
+
+    singular = false;
+    if (!dense::enabled() || !a)
+        return false;
+    if (cache.matrix &&
+        (+cache.matrix == +a || cache.matrix->is_same_as(+a)))
+    {
+        record(matrix, "Reusing LU factorization of %t", +a);
+        return lu.load(cache.factors) && piv.load(cache.pivots);
+    }
+
+    if (!lu.load(a) || lu.rows != lu.columns)
+        return false;
+    size_t n = lu.rows;
+    if (!piv.allocate(n, 0))
+        return false;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t pivot = i;
+        if (!dense_pivot(lu, n, i, pivot))
+        {
+            record(matrix, "Singular matrix in LU factorization");
+            singular = true;
+            return true;
+        }
+        piv.set(i, double(pivot));
+        if (pivot != i)
+        {
+            for (size_t k = 0; k < n; k++)
+            {
+                double t = lu.get(i * n + k);
+                lu.set(i * n + k, lu.get(pivot * n + k));
+                lu.set(pivot * n + k, t);
+            }
+        }
+
+        double u = lu.get(i * n + i);
+        for (size_t j = i + 1; j < n; j++)
+        {
+            double f = lu.get(j * n + i) / u;
+            lu.set(j * n + i, f);
+            if (f != 0.0)
+                for (size_t k = i + 1; k < n; k++)
+                    lu.set(j * n + k, lu.get(j * n + k) - f * lu.get(i * n + k));
+        }
+    }
+
+    cache.matrix = nullptr;
+    cache.factors = lu.store(true);
+    cache.pivots = piv.store(true);
+    if (cache.factors && cache.pivots)
+        cache.matrix = array_p(rt.clone(a));  // a may be changed in place
+    return true;
+}
+
+
+static void dense_substitute(const dense &lu, const dense &piv, const dense &b)
+// ----------------------------------------------------------------------------
+//   Solve A.X = B in place in b, given the LU factorization of A
+// ----------------------------------------------------------------------------
+{
+    size_t n = lu.rows;
+    size_t q = b.columns ? b.columns : 1;
+    for (size_t c = 0; c < q; c++)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t p = size_t(piv.get(i));
+            if (p != i)
+            {
+                double t = b.get(i * q + c);
+                b.set(i * q + c, b.get(p * q + c));
+                b.set(p * q + c, t);
+            }
+        }
+        for (size_t i = 1; i < n; i++)
+        {
+            double sum = b.get(i * q + c);
+            for (size_t k = 0; k < i; k++)
+                sum -= lu.get(i * n + k) * b.get(k * q + c);
+            b.set(i * q + c, sum);
+        }
+        for (size_t i = n; i-- > 0; )
+        {
+            double sum = b.get(i * q + c);
+            for (size_t k = i + 1; k < n; k++)
+                sum -= lu.get(i * n + k) * b.get(k * q + c);
+            b.set(i * q + c, sum / lu.get(i * n + i));
+        }
+    }
+}
+
+
+static bool dense_determinant(array_r x, algebraic_g &result)
+// ----------------------------------------------------------------------------
+//   Compute the determinant of a dense matrix from its LU factorization
+// ----------------------------------------------------------------------------
+{
+    dense lu, piv;
+    bool  singular = false;
+    if (!dense_factor(x, lu, piv, singular))
+        return false;
+    if (singular)
+    {
+        result = integer::make(0);
+        return true;
+    }
+
+    size_t n   = lu.rows;
+    double det = 1.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        det *= lu.get(i * n + i);
+        if (size_t(piv.get(i)) != i)
+            det = -det;
+    }
+    result = dense::make_value(det);
+    return true;
+}
+
+
+static bool dense_invert(array_r x, array_g &result)
+// ----------------------------------------------------------------------------
+//   Invert a dense matrix by solving against the identity
+// ----------------------------------------------------------------------------
+{
+    dense lu, piv;
+    bool  singular = false;
+    if (!dense_factor(x, lu, piv, singular))
+        return false;
+    if (singular)
+    {
+        rt.zero_divide_error();
+        result = nullptr;
+        return true;
+    }
+
+    dense  dr;
+    size_t n = lu.rows;
+    if (!dr.allocate(n, n))
+        return false;
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            dr.set(i * n + j, i == j ? 1.0 : 0.0);
+    dense_substitute(lu, piv, dr);
+    result = dr.store();
+    return true;
+}
+
+
+static bool dense_solve(array_r b, array_r a, array_g &result)
+// ----------------------------------------------------------------------------
+//   Compute b / a, i.e. solve a.X = b, without computing the inverse of a
+// ----------------------------------------------------------------------------
+{
+    dense lu, piv;
+    bool  singular = false;
+    if (!dense_factor(a, lu, piv, singular))
+        return false;
+
+    dense db;
+    if (!db.load(b) || db.rows != lu.rows)
+        return false;
+    if (singular)
+    {
+        rt.zero_divide_error();
+        result = nullptr;
+        return true;
+    }
+    dense_substitute(lu, piv, db);
+    result = db.store();
+    return true;
+}
+
+
+
 // ============================================================================
 //
 //    Additive operations
@@ -510,6 +1139,8 @@ algebraic_p array::determinant() const
     size_t cx, rx;
     size_t depth = rt.depth();
     algebraic_g det = this;
+    if (dense_determinant(array_g(this), det))
+        return det;
     if (is_matrix(&rx, &cx))
     {
         if (rx != cx)
@@ -755,6 +1386,38 @@ do                                              \
 #endif // SIMULATOR
 
 
+static bool invert_finite(object_p x)
+// ----------------------------------------------------------------------------
+//   Check if a matrix element is a finite real number
+// ----------------------------------------------------------------------------
+//   Zero terms are only skipped between finite real numbers, where the
+//   result is the same. Symbolic, infinite or NaN entries keep the full
+//   computation, so that results like 0·∞ do not change.
+{
+    return x && x->is_real() && x->is_simplifiable();
+}
+
+
+static bool invert_row_finite(size_t n, size_t pm, size_t pt, size_t i)
+// ----------------------------------------------------------------------------
+//   Check if row i only holds finite real numbers in both matrices
+// ----------------------------------------------------------------------------
+{
+    for (uint mat = 0; mat < 2; mat++)
+    {
+        size_t p = mat ? pt : pm;
+        for (size_t k = mat ? 0 : i; k < n; k++)
+        {
+            size_t   oik = i * n + k;
+            object_p mik = rt.stack(p + ~oik);
+            if (!invert_finite(mik))
+                return false;
+        }
+    }
+    return true;
+}
+
+
 array_p array::invert() const
 // ----------------------------------------------------------------------------
 //   Compute the inverse of a square matrix
@@ -820,6 +1483,10 @@ array_p array::invert() const
     size_t depth = rt.depth();
     id     atype = type();
 
+    array_g dense_inv;
+    if (dense_invert(array_g(this), dense_inv))
+        return dense_inv;
+
     if (is_matrix(&rx, &cx))
     {
         if (rx != cx)
@@ -929,6 +1596,7 @@ array_p array::invert() const
             // Loop below row i to compute r[j] = r[j] * a - r[i] * c
             record(matrix, "Zeroing sub-diagonals below %u", i);
             cleaner purge;
+            bool finite = invert_row_finite(n, pm, pt, i);
             for (size_t j = i + 1; j < n; j++)
             {
                 // Fetch value on diagonal and in next row
@@ -941,6 +1609,10 @@ array_p array::invert() const
                 if (!ca)
                     goto err;
 
+                // For sparse matrices, r[j] is often already zero in column i
+                // In that case, only r[j] = r[j] * a remains to be done
+                bool skip = finite && ca->is_zero(false);
+
                 // Traverse columns in r[j] for the two matrices
                 for (uint mat = 0; mat < 2; mat++)
                 {
@@ -959,7 +1631,10 @@ array_p array::invert() const
                             goto err;
                         mjka = mjk->as_algebraic();
                         mika = mik->as_algebraic();
-                        mjka = aa * mjka - ca * mika;
+                        if (skip && invert_finite(mjk))
+                            mjka = aa * mjka;
+                        else
+                            mjka = aa * mjka - ca * mika;
                         if (!mjka)
                             goto err;
                         mjka = purge(mjka);
@@ -993,6 +1668,7 @@ array_p array::invert() const
                 }
             }
             dump_matrix("After making diagonal of row %u unity", i);
+            finite = invert_row_finite(n, pm, pt, i);
 
             // For j < i, transform r[j] = r[j] - z * r[i]
             for (uint j = 0; j < i; j++)
@@ -1004,6 +1680,8 @@ array_p array::invert() const
                 ca = z->as_algebraic();
                 if (!ca)
                     goto err;
+                bool czero = finite && ca->is_zero(false);
+                bool skip = invert_finite(ca);
 
                 // This is only needed on the right matrix
                 for (uint mat = 0; mat < 2; mat++)
@@ -1021,6 +1699,9 @@ array_p array::invert() const
                         object_p mjk = rt.stack(p + ~ojk);
                         if (!mik || !mjk)
                             goto err;
+                        if ((czero || (skip && mik->is_zero(false))) &&
+                            invert_finite(mjk))
+                            continue;
                         mika = mik->as_algebraic();
                         mjka = mjk->as_algebraic();
                         if (!mika || !mjka)
@@ -1153,6 +1834,10 @@ algebraic_p array::dot(array_r &x, array_r &y)
     if (!x || !y)
         return nullptr;
 
+    algebraic_g dres;
+    if (dense_dot(x, y, dres))
+        return dres;
+
     array::iterator xi = x->begin();
     array::iterator yi = y->begin();
     size_t          count  = 0;
@@ -2583,6 +3268,9 @@ array_p array::transpose() const
 {
     array_g a    = this;
     size_t  rows = 0, columns = 0;
+    array_g result;
+    if (dense_transpose(a, result))
+        return result;
     if (a->is_matrix(&rows, &columns, true))
         return array::from_stack(rows, columns, true);
     return nullptr;
@@ -2644,6 +3332,10 @@ array_p array::add_sub(array_r x, array_r y, bool sub)
     if (!x || !y)
         return nullptr;
 
+    array_g dres;
+    if (dense_add_sub(x, y, sub, dres))
+        return dres;
+
     stack_depth_restore sdr;
     array::iterator xi = x->begin();
     array::iterator yi = y->begin();
@@ -2757,6 +3449,10 @@ array_p array::mul(array_r x, array_r y)
     if (!x || !y)
         return nullptr;
 
+    array_g dres;
+    if (dense_mul(x, y, dres))
+        return dres;
+
     stack_depth_restore sdr;
     array::iterator xi = x->begin();
     array::iterator yi = y->begin();
@@ -2918,6 +3614,9 @@ array_p operator/(array_r x, array_r y)
 //   Divide two arrays
 // ----------------------------------------------------------------------------
 {
+    array_g dres;
+    if (dense_solve(x, y, dres))
+        return dres;
     array_g yi = y->invert();
     if (!yi)
         return nullptr;
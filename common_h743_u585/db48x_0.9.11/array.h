@@ -53,15 +53,8 @@ struct array : list
         return array_p(list::map(fn));
     }
 
-    array_p map(arithmetic_fn fn, algebraic_r y) const
-    {
-        return array_p(list::map(fn, y));
-    }
-
-    array_p map(algebraic_r x, arithmetic_fn fn) const
-    {
-        return array_p(list::map(x, fn));
-    }
+    array_p map(arithmetic_fn fn, algebraic_r y) const;
+    array_p map(algebraic_r x, arithmetic_fn fn) const;
 
     // Append data
     array_p append(array_p a) const     { return array_p(list::append(a)); }
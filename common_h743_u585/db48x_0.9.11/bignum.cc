@@ -33,15 +33,18 @@
 #include "fraction.h"
 #include "integer.h"
 #include "parser.h"
+#include "program.h"
 #include "renderer.h"
 #include "runtime.h"
 #include "settings.h"
 #include "utf8.h"
+#include "util.h"
 
 #include <stdio.h>
 
 
 RECORDER(bignum, 16, "Bignums");
+RECORDER(primes, 16, "Primality tests and factorization");
 
 bignum::bignum(id type, integer_g value)
 // ----------------------------------------------------------------------------
@@ -103,6 +106,60 @@ integer_p bignum::as_integer() const
 }
 
 
+bool bignum::based_word(object_p x, ularge &value)
+// ----------------------------------------------------------------------------
+//   Read a non-negative integer or bignum that fits in 64 bits
+// ----------------------------------------------------------------------------
+{
+    id ty = x->type();
+    if (ty == ID_neg_integer || ty == ID_neg_bignum || !is_integer(ty))
+        return false;
+    if (is_bignum(ty))
+    {
+        size_t size = 0;
+        byte_p p    = bignum_p(x)->value(&size);
+        if (size > sizeof(ularge))
+            return false;
+        value = 0;
+        for (uint i = 0; i < size; i++)
+            value |= ularge(p[i]) << (i * 8);
+        return true;
+    }
+    integer_p i = integer_p(x);
+    if (!i->native())
+        return false;
+    value = i->value<ularge>();
+    return true;
+}
+
+
+algebraic_p bignum::based_word(id type, ularge value)
+// ----------------------------------------------------------------------------
+//   Build a based number of the base of type, as a bignum if over 63 bits
+// ----------------------------------------------------------------------------
+{
+    id ity = ID_based_integer;
+    id bty = ID_based_bignum;
+    switch (type)
+    {
+#if CONFIG_FIXED_BASED_OBJECTS
+    case ID_hex_integer:
+    case ID_hex_bignum: ity = ID_hex_integer; bty = ID_hex_bignum; break;
+    case ID_dec_integer:
+    case ID_dec_bignum: ity = ID_dec_integer; bty = ID_dec_bignum; break;
+    case ID_oct_integer:
+    case ID_oct_bignum: ity = ID_oct_integer; bty = ID_oct_bignum; break;
+    case ID_bin_integer:
+    case ID_bin_bignum: ity = ID_bin_integer; bty = ID_bin_bignum; break;
+#endif // CONFIG_FIXED_BASED_OBJECTS
+    default:            break;
+    }
+    if (value >> 63)
+        return rt.make<bignum>(bty, value);
+    return rt.make<integer>(ity, value);
+}
+
+
 HELP_BODY(bignum)
 // ----------------------------------------------------------------------------
 //    Help topic for big integers
@@ -122,16 +179,6 @@ static size_t render_num(renderer &r,
 //   This is necessary because the arm-none-eabi-gcc printf can't do 64-bit
 //   I'm getting non-sensible output
 {
-    // If we render to a file, need to first render to scratchpad to be able to
-    // revert the digits in memory before writing
-    if (r.file_save())
-    {
-        renderer tmp(r.expression(), r.editing(), r.stack());
-        size_t result = render_num(tmp, num, base, fmt);
-        r.put(tmp.text(), result);
-        return result;
-    }
-
     // Upper / lower rendering
     bool upper = *fmt == '^';
     bool lower = *fmt == 'v';
@@ -162,43 +209,40 @@ static size_t render_num(renderer &r,
     else
         r.flush();
 
-    // Get denominator for the base
-    size_t findex = r.size();
-    bignum_g b = rt.make<bignum>(object::ID_bignum, base);
-    bignum_g n = (bignum *) num;
-
-    // Keep dividing by the base until we get 0
-    uint sep = 0;
-    do
+    // Compute all the digits at once, then emit them with separators
+    bignum_g n      = (bignum *) num;
+    text_g   digits = bignum::to_digits(n, base);
+    if (!digits)
+        return r.size();
+    // Format digit groups in a buffer, flushed when it may not hold more,
+    // since each digit takes at most 3 bytes, and a separator 4 bytes
+    byte   buffer[128];
+    size_t used   = 0;
+    byte   sepbuf[4];
+    size_t seplen = spacing ? utf8_encode(space, sepbuf) : 0;
+    size_t count  = 0;
+    digits->value(&count);
+    for (size_t d = 0; d < count; d++)
     {
-        bignum_g remainder = nullptr;
-        bignum_g quotient = nullptr;
-        if (!bignum::quorem(n, b, bignum::ID_bignum, &quotient, &remainder))
-            break;
-        uint digit = remainder->value<uint>();
-        if (digit > base)
+        if (used + 3 + seplen > sizeof(buffer))
         {
-            printf("Ooops: digit=%u, base=%u\n", digit, base);
-            bignum::quorem(n, b, bignum::ID_bignum, &quotient, &remainder);
+            r.put(cstring(buffer), used);
+            used = 0;
         }
-        unicode c = upper        ? fancy_upper_digits[digit]
-                  : lower        ? fancy_lower_digits[digit]
-                  : (digit < 10) ? digit + '0'
-                                 : digit + ('A' - 10);
-        r.put(c);
-        n = quotient;
-
-        if (!n->is_zero() && ++sep == spacing)
+        if (d && spacing && (count - d) % spacing == 0)
         {
-            sep = 0;
-            r.put(space);
+            memcpy(buffer + used, sepbuf, seplen);
+            used += seplen;
         }
-    } while (!n->is_zero());
-
-    // Revert the digits
-    byte *dest  = (byte *) r.text();
-    bool multibyte = upper || lower || (spacing && space > 0xFF);
-    utf8_reverse(dest + findex, dest + r.size(), multibyte);
+        uint digit = digits->value()[d];       // Re-read, put may GC
+        if (upper || lower)
+            used += utf8_encode(upper ? fancy_upper_digits[digit]
+                                      : fancy_lower_digits[digit],
+                                buffer + used);
+        else
+            buffer[used++] = digit < 10 ? digit + '0' : digit + ('A' - 10);
+    }
+    r.put(cstring(buffer), used);
 
     // Add suffix if there is one
     if (fancy_base)
@@ -317,8 +361,19 @@ int bignum::compare(bignum_r xg, bignum_r yg, bool magnitude)
     int result = xs - ys;
     if (!result)
     {
-        // Compare, starting with highest order
-        for (int i = xs - 1; !result && i >= 0; i--)
+        // Compare, starting with highest order, four bytes at a time
+        int i = xs - 1;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; i >= 3; i -= 4)
+        {
+            uint32_t xw = limb(x, i - 3);
+            uint32_t yw = limb(y, i - 3);
+            if (xw != yw)
+                return (xw < yw) == (!magnitude && xt == ID_neg_bignum)
+                    ? 1 : -1;
+        }
+#endif // __ORDER_LITTLE_ENDIAN__
+        for (; !result && i >= 0; i--)
             result = x[i] - y[i];
     }
 
@@ -337,13 +392,28 @@ int bignum::compare(bignum_r xg, bignum_r yg, bool magnitude)
 // ============================================================================
 
 // Operations with carry
-static inline uint16_t add_op(byte x, byte y, byte c) { return x + y + (c != 0);}
-static inline uint16_t sub_op(byte x, byte y, byte c) { return x - y - (c != 0);}
 static inline uint16_t neg_op(byte x, byte c)         { return -x - (c != 0); }
 static inline byte     not_op(byte x, byte  )         { return ~x; }
-static inline byte     and_op(byte x, byte y, byte  ) { return x & y; }
-static inline byte     or_op (byte x, byte y, byte  ) { return x | y; }
-static inline byte     xor_op(byte x, byte y, byte  ) { return x ^ y; }
+
+// Binary operations work on bytes or on 32-bit limbs, with carry above
+#define BIGNUM_BINARY_OP(Name, Expr)                                    \
+struct Name                                                             \
+{                                                                       \
+    uint16_t operator()(byte x, byte y, uint16_t c) const               \
+    {                                                                   \
+        return uint16_t(Expr);                                          \
+    }                                                                   \
+    uint64_t operator()(uint32_t x, uint32_t y, uint64_t c) const       \
+    {                                                                   \
+        return uint64_t(Expr);                                          \
+    }                                                                   \
+}
+
+BIGNUM_BINARY_OP(add_op, uint64_t(x) + y + (c != 0));
+BIGNUM_BINARY_OP(sub_op, uint64_t(x) - y - (c != 0));
+BIGNUM_BINARY_OP(and_op, ((void) c, x & y));
+BIGNUM_BINARY_OP(or_op,  ((void) c, x | y));
+BIGNUM_BINARY_OP(xor_op, ((void) c, x ^ y));
 
 
 inline object::id bignum::opposite_type(id type)
@@ -422,19 +492,19 @@ bignum_p bignum::add_sub(bignum_r y, bignum_r x, bool issub)
                   : cmp == 0 ? ID_bignum
                   : issub    ? xt
                              : opposite_type(xt);
-            return binary<false>(sub_op, yg, xg, ty);
+            return binary<false>(sub_op(), yg, xg, ty);
         }
         else
         {
             // abs Y < abs X: result has type of X
             id ty = issub ? opposite_type(xt) : xt;
-            return binary<false>(sub_op, xg, yg, ty);
+            return binary<false>(sub_op(), xg, yg, ty);
         }
     }
 
     // We have the same sign, add items
     id ty = issub ? opposite_type(xt) : xt;
-    return binary<false>(add_op, yg, xg, ty);
+    return binary<false>(add_op(), yg, xg, ty);
 }
 
 
@@ -486,7 +556,7 @@ bignum_p operator&(bignum_r y, bignum_r x)
 //   Perform a binary and operation
 // ----------------------------------------------------------------------------
 {
-    return bignum::binary<false>(and_op, x, y, x->type());
+    return bignum::binary<false>(and_op(), x, y, x->type());
 }
 
 
@@ -495,7 +565,7 @@ bignum_p operator|(bignum_r y, bignum_r x)
 //   Perform a binary or operation
 // ----------------------------------------------------------------------------
 {
-    return bignum::binary<false>(or_op, x, y, x->type());
+    return bignum::binary<false>(or_op(), x, y, x->type());
 }
 
 
@@ -504,7 +574,134 @@ bignum_p operator^(bignum_r y, bignum_r x)
 //   Perform a binary xor operation
 // ----------------------------------------------------------------------------
 {
-    return bignum::binary<false>(xor_op, x, y, x->type());
+    return bignum::binary<false>(xor_op(), x, y, x->type());
+}
+
+
+#ifndef BIGNUM_KARATSUBA_BYTES
+#define BIGNUM_KARATSUBA_BYTES  48      // Operand size for Karatsuba, in bytes
+#endif
+
+static void mul_schoolbook(byte *r, size_t rs,
+                           byte_p x, size_t xs, byte_p y, size_t ys)
+// ----------------------------------------------------------------------------
+//   Compute the low rs bytes of x * y into r, byte by byte
+// ----------------------------------------------------------------------------
+{
+    for (size_t i = 0; i < rs; i++)
+        r[i] = 0;
+    for (size_t xi = 0; xi < xs && xi < rs; xi++)
+    {
+        uint xd = x[xi];
+        if (!xd)
+            continue;
+        uint   c  = 0;
+        size_t ri = xi;
+        for (size_t yi = 0; yi < ys && ri < rs; yi++, ri++)
+        {
+            c += r[ri] + xd * y[yi];
+            r[ri] = byte(c);
+            c >>= 8;
+        }
+        for (; c && ri < rs; ri++)
+        {
+            c += r[ri];
+            r[ri] = byte(c);
+            c >>= 8;
+        }
+    }
+}
+
+
+static size_t add_bytes(byte *r, byte_p x, size_t xs, byte_p y, size_t ys)
+// ----------------------------------------------------------------------------
+//   Compute r = x + y with xs >= ys, return the size of r
+// ----------------------------------------------------------------------------
+{
+    uint c = 0;
+    for (size_t i = 0; i < xs; i++)
+    {
+        c += x[i] + (i < ys ? y[i] : 0);
+        r[i] = byte(c);
+        c >>= 8;
+    }
+    r[xs] = byte(c);
+    return xs + 1;
+}
+
+
+static void add_in(byte *r, size_t rs, byte_p x, size_t xs)
+// ----------------------------------------------------------------------------
+//   Compute r += x, where the result fits in rs bytes
+// ----------------------------------------------------------------------------
+{
+    uint c = 0;
+    for (size_t i = 0; i < rs && (c || i < xs); i++)
+    {
+        c += r[i] + (i < xs ? x[i] : 0);
+        r[i] = byte(c);
+        c >>= 8;
+    }
+}
+
+
+static void sub_in(byte *r, size_t rs, byte_p x, size_t xs)
+// ----------------------------------------------------------------------------
+//   Compute r -= x, where r >= x
+// ----------------------------------------------------------------------------
+{
+    uint b = 0;
+    for (size_t i = 0; i < rs && (b || i < xs); i++)
+    {
+        uint d = (i < xs ? x[i] : 0) + b;
+        b = r[i] < d;
+        r[i] = byte(r[i] - d);
+    }
+}
+
+
+static void mul_karatsuba(byte *r,
+                          byte_p x, size_t xs, byte_p y, size_t ys,
+                          byte *scratch)
+// ----------------------------------------------------------------------------
+//   Compute r = x * y in xs + ys bytes, using Karatsuba for large operands
+// ----------------------------------------------------------------------------
+//   With x = x1 * B^m + x0 and y = y1 * B^m + y0, we have
+//      x * y = z2 * B^2m + z1 * B^m + z0
+//      z0 = x0 * y0, z2 = x1 * y1, z1 = (x0 + x1) * (y0 + y1) - z0 - z2
+//   The scratch area needs about 4 * (xs + ys) bytes
+{
+    size_t m = std::max(xs, ys) / 2;
+    if (xs < BIGNUM_KARATSUBA_BYTES || ys < BIGNUM_KARATSUBA_BYTES ||
+        xs <= m || ys <= m)
+    {
+        mul_schoolbook(r, xs + ys, x, xs, y, ys);
+        return;
+    }
+
+    // z0 goes in low part of result, z2 in high part
+    size_t x1s = xs - m;
+    size_t y1s = ys - m;
+    mul_karatsuba(r,       x,     m,   y,     m,   scratch);
+    mul_karatsuba(r + 2*m, x + m, x1s, y + m, y1s, scratch);
+
+    // Compute the sums and their product in the scratch area
+    byte  *sx  = scratch;
+    size_t sxs = m >= x1s ? add_bytes(sx, x, m, x + m, x1s)
+                          : add_bytes(sx, x + m, x1s, x, m);
+    byte  *sy  = sx + sxs;
+    size_t sys = m >= y1s ? add_bytes(sy, y, m, y + m, y1s)
+                          : add_bytes(sy, y + m, y1s, y, m);
+    byte  *z1  = sy + sys;
+    size_t z1s = sxs + sys;
+    mul_karatsuba(z1, sx, sxs, sy, sys, z1 + z1s);
+
+    // z1 -= z0 + z2, then add it in the middle of the result
+    sub_in(z1, z1s, r, 2 * m);
+    sub_in(z1, z1s, r + 2 * m, x1s + y1s);
+    while (z1s && !z1[z1s - 1])
+        z1s--;
+    add_in(r + m, xs + ys - m, z1, z1s);
 }
 
 
@@ -528,50 +725,29 @@ bignum_p bignum::multiply(bignum_r yg, bignum_r xg, id ty)
     }
     if (wbits && needed > wbytes)
         needed = wbytes;
-    byte *buffer = rt.allocate(needed);       // May GC here
+
+    // Karatsuba works on the full product, and needs scratch space
+    bool   karatsuba = (needed == xs + ys &&
+                        xs >= BIGNUM_KARATSUBA_BYTES &&
+                        ys >= BIGNUM_KARATSUBA_BYTES);
+    size_t allocated = needed + (karatsuba ? 4 * needed + 64 : 0);
+    byte *buffer = rt.allocate(allocated);    // May GC here
     if (!buffer)
         return nullptr;                       // Out of memory
     x = xg->value(&xs);                       // Re-read after potential GC
     y = yg->value(&ys);
 
-    // Zero-initialie the result
-    for (size_t i = 0; i < needed; i++)
-        buffer[i] = 0;
-
-    // Loop on all bytes of x then y
-    for (size_t xi = 0; xi < xs; xi++)
-    {
-        byte xd = x[xi];
-        for (int bit = 0; xd && bit < 8; bit++)
-        {
-            if (xd & (1<<bit))
-            {
-                uint c = 0;
-                size_t yi;
-                for (yi = 0; yi < ys && xi + yi < needed; yi++)
-                {
-                    c += buffer[xi + yi] + (y[yi] << bit);
-                    buffer[xi + yi] = byte(c);
-                    c >>= 8;
-                }
-                while (c && xi + yi < needed)
-                {
-                    c += buffer[xi + yi];
-                    buffer[xi + yi] = byte(c);
-                    c >>= 8;
-                    yi++;
-                }
-                xd &= ~(1<<bit);
-            }
-        }
-    }
+    if (karatsuba)
+        mul_karatsuba(buffer, x, xs, y, ys, buffer + needed);
+    else
+        mul_schoolbook(buffer, needed, x, xs, y, ys);
 
     size_t sz = needed;
     while (sz > 0 && buffer[sz-1] == 0)
         sz--;
     gcbytes buf = buffer;
     bignum_g result = rt.make<bignum>(ty, buf, sz);
-    rt.free(needed);
+    rt.free(allocated);
     return result;
 }
 
@@ -591,6 +767,139 @@ bignum_p operator*(bignum_r y, bignum_r x)
 }
 
 
+static void divide_limbs(byte *quotient, size_t &qs,
+                         byte *remainder, size_t &rs,
+                         byte_p y, size_t ys, byte_p x, size_t xs,
+                         uint16_t *u)
+// ----------------------------------------------------------------------------
+//   Divide y by x using Knuth's algorithm D with 16-bit limbs
+// ----------------------------------------------------------------------------
+//   The u scratch area holds ys + xs/2 + 4 limbs
+{
+    while (xs && !x[xs - 1])
+        xs--;
+    while (ys && !y[ys - 1])
+        ys--;
+    qs = rs = 0;
+
+    // Trivial case where the quotient is 0
+    size_t n  = (xs + 1) / 2;
+    size_t un = (ys + 1) / 2;
+    if (un < n)
+    {
+        memcpy(remainder, y, ys);
+        rs = ys;
+        return;
+    }
+
+    // Load limbs: u = y with an extra top limb, v = x, q = quotient
+    size_t    m = un - n;
+    uint16_t *v = u + un + 1;
+    uint16_t *q = v + n;
+    for (size_t i = 0; i < un; i++)
+        u[i] = y[2*i] | (2*i + 1 < ys ? y[2*i + 1] << 8 : 0);
+    for (size_t i = 0; i < n; i++)
+        v[i] = x[2*i] | (2*i + 1 < xs ? x[2*i + 1] << 8 : 0);
+    u[un] = 0;
+
+    if (n == 1)
+    {
+        // Single limb divisor: short division
+        uint32_t d = v[0];
+        uint32_t r = 0;
+        for (size_t j = un; j --> 0; )
+        {
+            uint32_t t = (r << 16) | u[j];
+            q[j] = t / d;
+            r = t % d;
+        }
+        u[0] = r;
+    }
+    else
+    {
+        // Normalize so that the top bit of the divisor is set
+        int s = __builtin_clz(v[n-1]) - 16;
+        for (size_t i = n - 1; i > 0; i--)
+            v[i] = (v[i] << s) | (v[i-1] >> (16 - s));
+        v[0] <<= s;
+        u[un] = u[un-1] >> (16 - s);
+        for (size_t i = un - 1; i > 0; i--)
+            u[i] = (u[i] << s) | (u[i-1] >> (16 - s));
+        u[0] <<= s;
+
+        for (size_t j = m + 1; j --> 0; )
+        {
+            // Estimate quotient limb from the top two limbs
+            uint32_t num  = (uint32_t(u[j+n]) << 16) | u[j+n-1];
+            uint32_t qhat = num / v[n-1];
+            uint32_t rhat = num % v[n-1];
+            while (qhat >= 0x10000 ||
+                   qhat * v[n-2] > ((rhat << 16) | u[j+n-2]))
+            {
+                qhat--;
+                rhat += v[n-1];
+                if (rhat >= 0x10000)
+                    break;
+            }
+
+            // Multiply and subtract
+            uint32_t carry  = 0;
+            int32_t  borrow = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint32_t p = qhat * v[i] + carry;
+                carry = p >> 16;
+                int32_t t = int32_t(u[i+j]) - int32_t(p & 0xFFFF) - borrow;
+                u[i+j] = uint16_t(t);
+                borrow = t < 0;
+            }
+            int32_t t = int32_t(u[j+n]) - int32_t(carry) - borrow;
+            u[j+n] = uint16_t(t);
+
+            // The estimate can be one too large: add back
+            if (t < 0)
+            {
+                qhat--;
+                uint32_t c = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    c += uint32_t(u[i+j]) + v[i];
+                    u[i+j] = uint16_t(c);
+                    c >>= 16;
+                }
+                u[j+n] = uint16_t(u[j+n] + c);
+            }
+            q[j] = qhat;
+        }
+
+        // Unnormalize the remainder
+        for (size_t i = 0; i < n; i++)
+            u[i] = (u[i] >> s) |
+                (i + 1 < n ? uint16_t(u[i+1] << (16 - s)) : 0);
+    }
+
+    // Store quotient and remainder as bytes
+    for (size_t j = 0; j <= m; j++)
+    {
+        quotient[2*j] = byte(q[j]);
+        if (2*j + 1 < ys)
+            quotient[2*j + 1] = byte(q[j] >> 8);
+    }
+    qs = std::min(2 * (m + 1), ys);
+    while (qs && !quotient[qs - 1])
+        qs--;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        remainder[2*i] = byte(u[i]);
+        remainder[2*i + 1] = byte(u[i] >> 8);
+    }
+    rs = 2 * n;
+    while (rs && !remainder[rs - 1])
+        rs--;
+}
+
+
 bool bignum::quorem(bignum_r yg, bignum_r xg, id ty, bignum_g *q, bignum_g *r)
 // ----------------------------------------------------------------------------
 //   Compute quotient and remainder of two bignums, as bignums
@@ -620,7 +929,9 @@ bool bignum::quorem(bignum_r yg, bignum_r xg, id ty, bignum_g *q, bignum_g *r)
     size_t wbits = wordsize(xt);
     size_t wbytes = (wbits + 7) / 8;
     size_t needed = ys + xs + 1;              // No need to check maxbignum
-    byte *buffer = rt.allocate(needed);       // May GC here
+    size_t limbs  = ys + xs / 2 + 4;          // Scratch for 16-bit limbs
+    size_t allocated = needed + 2 * limbs + 1;
+    byte *buffer = rt.allocate(allocated);    // May GC here
     if (!buffer)
         return false;                         // Out of memory
     x = xg->value(&xs);                       // Re-read after potential GC
@@ -634,53 +945,10 @@ bool bignum::quorem(bignum_r yg, bignum_r xg, id ty, bignum_g *q, bignum_g *r)
     for (uint i = 0; i < needed; i++)
         buffer[i] = 0;
 
-    // Loop on the numerator
-    for (int yi = ys-1; yi >= 0; yi--)
-    {
-        for (int bit = 7; bit >= 0; bit--)
-        {
-            // Shift remainder left by one bit, add numerator bit
-            uint16_t c = (y[yi] >> bit) & 1;
-            int delta = 0;
-            for (uint ri = 0; ri < rs; ri++)
-            {
-                c += (remainder[ri] << 1);
-                remainder[ri] = byte(c);
-                if (int d = remainder[ri] - x[ri])
-                    delta = d;
-                c >>= 8;
-            }
-
-            if (c)
-            {
-                if (int d = c - x[rs])
-                    delta = d;
-                remainder[rs++] = c;
-            }
-            if (rs != xs)
-                delta = int(rs) - int(xs);
-
-            // If remainder >= denominator, add to quotient, subtract from rem
-            if (delta >= 0)
-            {
-                quotient[yi] |= (1 << bit);
-                if (qs < size_t(yi + 1))
-                    qs = yi + 1;
-
-                c = 0;
-                for (uint ri = 0; ri < rs; ri++)
-                {
-                    c = remainder[ri] - (ri < xs ? x[ri] : 0) - c;
-                    remainder[ri] = byte(c);
-                    c = c > 0xFF;
-                }
-
-                // Strip zeroes at top of remainder
-                while (rs > 0 && remainder[rs-1] == 0)
-                    rs--;
-            }
-        } // numerator bit loop
-    } // numerator byte loop
+    // Divide using 16-bit limbs in the scratch area after the results
+    uintptr_t scratch = (uintptr_t(buffer + needed) + 1) & ~uintptr_t(1);
+    divide_limbs(quotient, qs, remainder, rs, y, ys, x, xs,
+                 (uint16_t *) scratch);
 
     // Generate results
     gcutf8 qg = quotient;
@@ -700,11 +968,312 @@ bool bignum::quorem(bignum_r yg, bignum_r xg, id ty, bignum_g *q, bignum_g *r)
         *r = rt.make<bignum>(ty, rg, rs);
         ok = bignum_p(*r) != nullptr;
     }
-    rt.free(needed);
+    rt.free(allocated);
     return ok;
 }
 
 
+// ============================================================================
+//
+//   Radix conversion
+//
+// ============================================================================
+//   Conversion between bignum and digits recursively splits the number using
+//   powers chunk^(2^i) of the base, where chunk is the largest power of the
+//   base that fits in 16 bits. Leaves use short division or multiplication
+//   by chunk, so that each step processes a 16-bit chunk of digits.
+
+#ifndef BIGNUM_RADIX_LEAF
+#define BIGNUM_RADIX_LEAF       32      // Leaf size for radix conversion
+#endif
+
+struct radix
+// ----------------------------------------------------------------------------
+//   Powers of the base used for radix conversion
+// ----------------------------------------------------------------------------
+{
+    enum { MAX_LEVELS = 32 };
+
+    radix(uint base): base(base), chunk(base), width(1), levels(0)
+    {
+        while (chunk * base <= 0xFFFF)
+        {
+            chunk *= base;
+            width++;
+        }
+    }
+
+    byte *powers(byte *p, size_t limit, byte *scratch)
+    // ------------------------------------------------------------------------
+    //   Compute powers of the chunk at p up to the given size, return end
+    // ------------------------------------------------------------------------
+    {
+        power[0] = p;
+        p[0] = byte(chunk);
+        p[1] = byte(chunk >> 8);
+        psize[0] = p[1] ? 2 : 1;
+        p += psize[0];
+        levels = 1;
+        while (levels < MAX_LEVELS && 2 * psize[levels-1] <= limit)
+        {
+            byte_p last = power[levels-1];
+            size_t ls   = psize[levels-1];
+            mul_karatsuba(p, last, ls, last, ls, scratch);
+            size_t ps = 2 * ls;
+            while (ps && !p[ps - 1])
+                ps--;
+            power[levels] = p;
+            psize[levels] = ps;
+            p += ps;
+            levels++;
+        }
+        return p;
+    }
+
+    uint        base;                   // Base for the conversion
+    uint        chunk;                  // Largest power of base in 16 bits
+    uint        width;                  // Number of digits in a chunk
+    uint        levels;                 // Number of powers computed
+    byte_p      power[MAX_LEVELS];      // power[i] = chunk^(2^i)
+    size_t      psize[MAX_LEVELS];      // Size of power[i] in bytes
+};
+
+
+static byte *radix_render(const radix &rx, byte *out,
+                          byte *x, size_t xs, size_t pad, byte *tmp)
+// ----------------------------------------------------------------------------
+//   Write the digits of x ending at out, return the first digit
+// ----------------------------------------------------------------------------
+//   When pad is zero, leading zeros are stripped, otherwise we emit exactly
+//   pad digits. The value of x is destroyed in the process.
+{
+    while (xs && !x[xs - 1])
+        xs--;
+
+    // Find a power of the chunk about half the size of x
+    uint level = rx.levels;
+    if (xs > BIGNUM_RADIX_LEAF)
+        while (level --> 0)
+            if (rx.psize[level] < xs && 2 * rx.psize[level] <= xs + 1)
+                break;
+
+    if (xs <= BIGNUM_RADIX_LEAF || level >= rx.levels)
+    {
+        // Leaf: short division by the chunk on x, in place
+        size_t count = 0;
+        while (xs)
+        {
+            uint r = 0;
+            for (size_t i = xs; i --> 0; )
+            {
+                r = (r << 8) | x[i];
+                x[i] = byte(r / rx.chunk);
+                r %= rx.chunk;
+            }
+            while (xs && !x[xs - 1])
+                xs--;
+            for (uint d = 0; d < rx.width; d++)
+            {
+                *--out = byte(r % rx.base);
+                r /= rx.base;
+            }
+            count += rx.width;
+        }
+        if (pad)
+        {
+            while (count < pad)
+            {
+                *--out = 0;
+                count++;
+            }
+        }
+        else
+        {
+            while (count > 1 && !*out)
+            {
+                out++;
+                count--;
+            }
+            if (!count)
+                *--out = 0;
+        }
+        return out;
+    }
+
+    // Split x = q * power + r using the scratch area
+    byte_p    p   = rx.power[level];
+    size_t    ps  = rx.psize[level];
+    byte     *q   = tmp;
+    byte     *r   = q + xs;
+    byte     *end = r + ps + 1;
+    uintptr_t u   = (uintptr_t(end) + 1) & ~uintptr_t(1);
+    size_t    qs  = 0;
+    size_t    rs  = 0;
+    divide_limbs(q, qs, r, rs, x, xs, p, ps, (uint16_t *) u);
+
+    // Low part has exactly width * 2^level digits, high part has the rest
+    size_t low = size_t(rx.width) << level;
+    out = radix_render(rx, out, r, rs, low, end);
+    return radix_render(rx, out, q, qs, pad ? pad - low : 0, end);
+}
+
+
+text_p bignum::to_digits(bignum_r xg, uint base)
+// ----------------------------------------------------------------------------
+//   Return the digits of a bignum, most significant first, as digit values
+// ----------------------------------------------------------------------------
+{
+    size_t xs = 0;
+    byte_p x  = xg->value(&xs);
+    while (xs && !x[xs - 1])
+        xs--;
+
+    // Base 2 has the most digits, 8 per byte
+    uint   lg        = 0;
+    while (base >> (lg + 1))
+        lg++;
+    radix  rx(base);
+    size_t digits    = (8 * xs + lg - 1) / lg + rx.width + 1;
+    size_t allocated = digits + 10 * xs + 64 * radix::MAX_LEVELS + 256;
+    byte  *buffer    = rt.allocate(allocated);  // May GC here
+    if (!buffer)
+        return nullptr;
+    x = xg->value(&xs);                         // Re-read after potential GC
+    while (xs && !x[xs - 1])
+        xs--;
+
+    // Layout: digits, copy of x, powers, scratch
+    byte *end  = buffer + digits;
+    byte *copy = end;
+    memcpy(copy, x, xs);
+    byte *tmp  = rx.powers(copy + xs, (xs + 1) / 2, copy + 2 * xs + 64);
+    byte *out  = radix_render(rx, end, copy, xs, 0, tmp);
+
+    gcutf8 dg = out;
+    text_p result = rt.make<text>(ID_text, dg, end - out);
+    rt.free(allocated);
+    return result;
+}
+
+
+static size_t radix_bytes(const radix &rx, size_t count)
+// ----------------------------------------------------------------------------
+//   Upper bound for the size in bytes of a value with count digits
+// ----------------------------------------------------------------------------
+{
+    uint bits = 1;
+    while ((1U << bits) < rx.base)
+        bits++;
+    return (count * bits + 7) / 8 + 2 * radix::MAX_LEVELS + 2;
+}
+
+
+static size_t radix_parse(const radix &rx, byte *x,
+                          byte_p digits, size_t count, byte *tmp)
+// ----------------------------------------------------------------------------
+//   Compute the value of count digit values into x, return its size
+// ----------------------------------------------------------------------------
+{
+    // Find the largest power of the chunk covering at most half the digits
+    uint level = rx.levels;
+    if (count > 2 * BIGNUM_RADIX_LEAF)
+        while (level --> 0)
+            if ((size_t(rx.width) << level) * 2 <= count)
+                break;
+
+    if (count <= 2 * BIGNUM_RADIX_LEAF || level >= rx.levels)
+    {
+        // Leaf: multiply by the chunk and add digits, in place
+        size_t xs = 0;
+        size_t first = count % rx.width;
+        if (!first)
+            first = rx.width;
+        for (size_t d = 0; d < count; )
+        {
+            uint c = 0;
+            for (size_t end = d ? d + rx.width : first; d < end; d++)
+                c = c * rx.base + digits[d];
+            for (size_t i = 0; i < xs; i++)
+            {
+                c += x[i] * rx.chunk;
+                x[i] = byte(c);
+                c >>= 8;
+            }
+            while (c)
+            {
+                x[xs++] = byte(c);
+                c >>= 8;
+            }
+        }
+        return xs;
+    }
+
+    // Split digits into a high part and a low part with width * 2^level digits
+    size_t low = size_t(rx.width) << level;
+    size_t high = count - low;
+    byte  *h   = tmp;
+    size_t hs  = radix_parse(rx, h, digits, high, h + radix_bytes(rx, high));
+    byte  *l   = h + hs;
+    size_t ls  = radix_parse(rx, l, digits + high, low, l + radix_bytes(rx, low));
+
+    // x = h * power + l
+    byte_p p   = rx.power[level];
+    size_t ps  = rx.psize[level];
+    size_t xs  = hs + ps;
+    if (hs)
+        mul_karatsuba(x, h, hs, p, ps, l + ls);
+    else
+        memset(x, 0, xs);
+    add_in(x, xs, l, ls);
+    while (xs && !x[xs - 1])
+        xs--;
+    return xs;
+}
+
+
+bignum_p bignum::from_digits(id type, gcutf8 src, size_t count, uint base)
+// ----------------------------------------------------------------------------
+//   Build a bignum from count digits in the given base
+// ----------------------------------------------------------------------------
+//   The digits are ASCII characters that have been checked by the caller
+{
+    radix  rx(base);
+    size_t xs        = radix_bytes(rx, count);
+    size_t allocated = count + 12 * xs + 128 * radix::MAX_LEVELS + 256;
+    byte  *buffer    = rt.allocate(allocated); // May GC here
+    if (!buffer)
+        return nullptr;
+
+    // Convert ASCII digits to digit values
+    byte_p s      = src;
+    byte  *digits = buffer;
+    for (size_t d = 0; d < count; d++)
+    {
+        byte c = s[d];
+        digits[d] = c <= '9' ? c - '0' : (c | 0x20) - ('a' - 10);
+    }
+
+    // Layout: digits, result, powers, scratch
+    byte  *x   = digits + count;
+    byte  *pw  = x + xs;
+    byte  *tmp = rx.powers(pw, xs / 2 + 1, pw + xs + 64);
+    size_t sz  = radix_parse(rx, x, digits, count, tmp);
+
+    bignum_p result = nullptr;
+    if (sz * 8 > Settings.MaxNumberBits())
+    {
+        rt.number_too_big_error();
+    }
+    else
+    {
+        gcbytes xg = x;
+        result = rt.make<bignum>(type, xg, sz);
+    }
+    rt.free(allocated);
+    return result;
+}
+
+
 static bignum_p divide_and_optimize(bignum_r y, bignum_r x)
 // ----------------------------------------------------------------------------
 //   Invoked we are called through the arithmetic optimization target
@@ -784,6 +1353,1351 @@ bignum_p bignum::pow(bignum_r yr, bignum_r xr)
 }
 
 
+static size_t gcd_trailing(const uint32_t *x)
+// ----------------------------------------------------------------------------
+//   Count trailing zero bits in a non-zero limb array
+// ----------------------------------------------------------------------------
+{
+    size_t z = 0;
+    while (!x[z / 32])
+        z += 32;
+    return z + __builtin_ctz(x[z / 32]);
+}
+
+
+static size_t gcd_shift(uint32_t *x, size_t xn, size_t bits)
+// ----------------------------------------------------------------------------
+//   Shift a limb array right by the given number of bits, return new size
+// ----------------------------------------------------------------------------
+{
+    size_t w = bits / 32;
+    uint   s = bits % 32;
+    xn -= w;
+    for (size_t i = 0; i < xn; i++)
+        x[i] = (x[i + w] >> s) |
+            (s && i + 1 < xn ? x[i + w + 1] << (32 - s) : 0);
+    while (xn && !x[xn - 1])
+        xn--;
+    return xn;
+}
+
+
+static int gcd_compare(const uint32_t *x, size_t xn,
+                       const uint32_t *y, size_t yn)
+// ----------------------------------------------------------------------------
+//   Compare two trimmed limb arrays
+// ----------------------------------------------------------------------------
+{
+    if (xn != yn)
+        return xn < yn ? -1 : 1;
+    for (size_t i = xn; i --> 0; )
+        if (x[i] != y[i])
+            return x[i] < y[i] ? -1 : 1;
+    return 0;
+}
+
+
+static uint32_t *gcd_odd(uint32_t *u, size_t &un, uint32_t *v, size_t vn)
+// ----------------------------------------------------------------------------
+//   GCD of two odd non-zero limb arrays, return the result and its size
+// ----------------------------------------------------------------------------
+//   Both arrays are used as work areas
+{
+    // Subtract the smaller from the larger until they are equal
+    while (int cmp = gcd_compare(u, un, v, vn))
+    {
+        if (cmp < 0)
+        {
+            std::swap(u, v);
+            std::swap(un, vn);
+        }
+        uint32_t borrow = 0;
+        for (size_t i = 0; i < un; i++)
+        {
+            uint32_t y = i < vn ? v[i] : 0;
+            uint32_t d = u[i] - y - borrow;
+            borrow = borrow ? u[i] <= y : u[i] < y;
+            u[i] = d;
+        }
+        while (un && !u[un - 1])
+            un--;
+        un = gcd_shift(u, un, gcd_trailing(u));
+    }
+    return u;
+}
+
+
+bignum_p bignum::gcd(bignum_r ag, bignum_r bg)
+// ----------------------------------------------------------------------------
+//   Binary GCD of the magnitudes of a and b, working on 32-bit limbs
+// ----------------------------------------------------------------------------
+//   This only needs scratch space, and no intermediate bignum object
+{
+    if (!ag || !bg)
+        return nullptr;
+
+    size_t as = 0;
+    size_t bs = 0;
+    byte_p a  = ag->value(&as);
+    byte_p b  = bg->value(&bs);
+    size_t an = (as + 3) / 4;
+    size_t bn = (bs + 3) / 4;
+    size_t allocated = 8 * (an + bn) + 16;
+    byte *buffer = rt.allocate(allocated);      // May GC here
+    if (!buffer)
+        return nullptr;
+    a = ag->value(&as);                         // Re-read after potential GC
+    b = bg->value(&bs);
+
+    // Load limbs, result bytes go after them
+    uintptr_t aligned = (uintptr_t(buffer) + 3) & ~uintptr_t(3);
+    uint32_t *u = (uint32_t *) aligned;
+    uint32_t *v = u + an;
+    byte     *out = (byte *) (v + bn);
+    for (size_t i = 0; i < an; i++)
+        u[i] = 0;
+    for (size_t i = 0; i < bn; i++)
+        v[i] = 0;
+    for (size_t i = 0; i < as; i++)
+        u[i / 4] |= uint32_t(a[i]) << (8 * (i % 4));
+    for (size_t i = 0; i < bs; i++)
+        v[i / 4] |= uint32_t(b[i]) << (8 * (i % 4));
+    while (an && !u[an - 1])
+        an--;
+    while (bn && !v[bn - 1])
+        bn--;
+
+    size_t k = 0;
+    if (!an || !bn)
+    {
+        // gcd(x, 0) = x
+        if (!an)
+        {
+            u = v;
+            an = bn;
+        }
+    }
+    else
+    {
+        // Remove common powers of two, then make both odd
+        size_t za = gcd_trailing(u);
+        size_t zb = gcd_trailing(v);
+        k = std::min(za, zb);
+        an = gcd_shift(u, an, za);
+        bn = gcd_shift(v, bn, zb);
+        u = gcd_odd(u, an, v, bn);
+    }
+
+    // Store u << k as bytes
+    size_t os = 4 * an + k / 8 + 2;
+    for (size_t i = 0; i < os; i++)
+        out[i] = 0;
+    for (size_t i = 0; i < 4 * an; i++)
+    {
+        byte   bv  = byte(u[i / 4] >> (8 * (i % 4)));
+        size_t bit = 8 * i + k;
+        out[bit / 8] |= byte(bv << (bit % 8));
+        if (bit % 8)
+            out[bit / 8 + 1] |= byte(bv >> (8 - bit % 8));
+    }
+    while (os && !out[os - 1])
+        os--;
+
+    gcbytes og = out;
+    bignum_p result = rt.make<bignum>(ID_bignum, og, os);
+    rt.free(allocated);
+    return result;
+}
+
+
+// ============================================================================
+//
+//   Modular arithmetic
+//
+// ============================================================================
+
+static size_t mod_bytes(byte *r, byte_p x, size_t xs, byte_p m, size_t ms,
+                        byte *scratch)
+// ----------------------------------------------------------------------------
+//   Compute r = x mod m, where r has ms + 1 bytes
+// ----------------------------------------------------------------------------
+//   The scratch area needs 3 * xs + ms + 9 bytes
+{
+    byte     *q  = scratch;
+    uintptr_t u  = (uintptr_t(q + xs) + 1) & ~uintptr_t(1);
+    size_t    qs = 0;
+    size_t    rs = 0;
+    divide_limbs(q, qs, r, rs, x, xs, m, ms, (uint16_t *) u);
+    return rs;
+}
+
+
+static void mont_load(uint32_t *x, size_t n, byte_p b, size_t bs)
+// ----------------------------------------------------------------------------
+//   Load bytes into n 32-bit limbs
+// ----------------------------------------------------------------------------
+{
+    for (size_t i = 0; i < n; i++)
+        x[i] = 0;
+    for (size_t i = 0; i < bs; i++)
+        x[i / 4] |= uint32_t(b[i]) << (8 * (i % 4));
+}
+
+
+static void mont_mul(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                     const uint32_t *m, size_t n, uint32_t minv,
+                     uint32_t *t)
+// ----------------------------------------------------------------------------
+//   Montgomery product r = a * b / 2^(32n) mod m, t has n + 2 limbs
+// ----------------------------------------------------------------------------
+//   This interleaves multiplication and reduction one limb at a time
+{
+    for (size_t i = 0; i < n + 2; i++)
+        t[i] = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t c = 0;
+        for (size_t j = 0; j < n; j++)
+        {
+            c += uint64_t(a[j]) * b[i] + t[j];
+            t[j] = uint32_t(c);
+            c >>= 32;
+        }
+        c += t[n];
+        t[n] = uint32_t(c);
+        t[n + 1] = uint32_t(c >> 32);
+
+        uint32_t q = t[0] * minv;
+        c = (uint64_t(q) * m[0] + t[0]) >> 32;
+        for (size_t j = 1; j < n; j++)
+        {
+            c += uint64_t(q) * m[j] + t[j];
+            t[j - 1] = uint32_t(c);
+            c >>= 32;
+        }
+        c += t[n];
+        t[n - 1] = uint32_t(c);
+        t[n] = t[n + 1] + uint32_t(c >> 32);
+    }
+
+    // Result is less than 2m, subtract m if needed
+    bool ge = t[n] != 0;
+    if (!ge)
+    {
+        ge = true;
+        for (size_t i = n; i --> 0; )
+        {
+            if (t[i] != m[i])
+            {
+                ge = t[i] > m[i];
+                break;
+            }
+        }
+    }
+    uint32_t borrow = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t y = ge ? m[i] : 0;
+        uint32_t d = t[i] - y - borrow;
+        borrow = borrow ? t[i] <= y : t[i] < y;
+        r[i] = d;
+    }
+}
+
+
+bignum_p bignum::powmod(bignum_r yg, bignum_r xg, bignum_r mg)
+// ----------------------------------------------------------------------------
+//   Compute y^x mod m, reducing at each step
+// ----------------------------------------------------------------------------
+//   Odd moduli use Montgomery multiplication on 32-bit limbs, even moduli
+//   use a division after each multiplication.
+{
+    if (!yg || !xg || !mg)
+        return nullptr;
+    if (mg->is_zero())
+    {
+        rt.zero_divide_error();
+        return nullptr;
+    }
+
+    id     yt    = yg->type();
+    id     mt    = mg->type();
+    id     ty    = is_based(mt) ? mt : is_based(yt) ? yt : ID_bignum;
+    size_t wbits = wordsize(ty);
+    size_t wbytes = (wbits + 7) / 8;
+
+    // Negative exponents use the modular inverse
+    bignum_g y = yg;
+    if (xg->type() == ID_neg_bignum)
+    {
+        y = modinv(yg, mg);
+        if (!y)
+            return nullptr;
+    }
+    bool negative = y->type() == ID_neg_bignum;
+
+    size_t ys = 0;
+    size_t xs = 0;
+    size_t ms = 0;
+    byte_p m  = mg->value(&ms);
+    y->value(&ys);
+    size_t n         = (ms + 3) / 4;
+    size_t big       = std::max(ys, 8 * n) + 1;
+    size_t allocated = 2 * (4 * n + 1) + (3 * big + ms + 9) + (8 * n + 1)
+                     + 4 * (5 * n + 2) + 3 + 2 * ms + 2 * (ms + 1);
+    byte  *buffer    = rt.allocate(allocated); // May GC here
+    if (!buffer)
+        return nullptr;
+    byte_p yv = y->value(&ys);                 // Re-read after potential GC
+    byte_p x  = xg->value(&xs);
+    m = mg->value(&ms);
+
+    // Layout: reduced base, temporary, division scratch, R^2, limbs
+    byte *yr  = buffer;
+    byte *tb  = yr + 4 * n + 1;
+    byte *scr = tb + 4 * n + 1;
+    byte *num = scr + 3 * big + ms + 9;
+    byte *end = num + 8 * n + 1;
+    byte  one = 1;
+
+    // Reduce the base, and make it positive
+    size_t as = mod_bytes(yr, yv, ys, m, ms, scr);
+    if (negative && as)
+    {
+        memcpy(tb, m, ms);
+        sub_in(tb, ms, yr, as);
+        memcpy(yr, tb, ms);
+        as = ms;
+        while (as && !yr[as - 1])
+            as--;
+    }
+
+    // Find the top bit of the exponent
+    while (xs && !x[xs - 1])
+        xs--;
+    size_t bits = 8 * xs;
+    if (xs)
+        bits -= __builtin_clz(x[xs - 1]) - 24;
+
+    byte  *result = nullptr;
+    size_t rs     = 0;
+    if (m[0] & 1)
+    {
+        // Montgomery form: a * R mod m, with R = 2^(32n)
+        uintptr_t aligned = (uintptr_t(end) + 3) & ~uintptr_t(3);
+        uint32_t *mm  = (uint32_t *) aligned;
+        uint32_t *a   = mm + n;
+        uint32_t *acc = a + n;
+        uint32_t *r2  = acc + n;
+        uint32_t *t   = r2 + n;
+        mont_load(mm, n, m, ms);
+
+        // Compute -1/m mod 2^32 with Newton's iteration
+        uint32_t inv = mm[0];
+        for (uint i = 0; i < 5; i++)
+            inv *= 2 - mm[0] * inv;
+        uint32_t minv = -inv;
+
+        // R^2 mod m, computed by division
+        for (size_t i = 0; i < 8 * n; i++)
+            num[i] = 0;
+        num[8 * n] = 1;
+        size_t r2s = mod_bytes(tb, num, 8 * n + 1, m, ms, scr);
+        mont_load(r2, n, tb, r2s);
+        mont_load(a, n, yr, as);
+        mont_mul(a, a, r2, mm, n, minv, t);
+        mont_load(acc, n, &one, 1);
+        mont_mul(acc, acc, r2, mm, n, minv, t);
+
+        // Left-to-right square and multiply
+        for (size_t bit = bits; bit --> 0; )
+        {
+            mont_mul(acc, acc, acc, mm, n, minv, t);
+            if ((x[bit / 8] >> (bit % 8)) & 1)
+                mont_mul(acc, acc, a, mm, n, minv, t);
+        }
+
+        // Back from Montgomery form
+        mont_load(r2, n, &one, 1);
+        mont_mul(acc, acc, r2, mm, n, minv, t);
+        for (size_t i = 0; i < 4 * n; i++)
+            tb[i] = byte(acc[i / 4] >> (8 * (i % 4)));
+        result = tb;
+        rs = 4 * n;
+    }
+    else
+    {
+        // Even modulus: multiply, then divide
+        byte  *prod = end;
+        byte  *acc  = prod + 2 * ms;
+        size_t accs = 1;
+        acc[0] = 1;
+        for (size_t bit = bits; bit --> 0; )
+        {
+            mul_schoolbook(prod, 2 * accs, acc, accs, acc, accs);
+            accs = mod_bytes(acc, prod, 2 * accs, m, ms, scr);
+            if ((x[bit / 8] >> (bit % 8)) & 1)
+            {
+                mul_schoolbook(prod, accs + as, acc, accs, yr, as);
+                accs = mod_bytes(acc, prod, accs + as, m, ms, scr);
+            }
+        }
+        result = acc;
+        rs = accs;
+    }
+    while (rs && !result[rs - 1])
+        rs--;
+    if (wbits && rs > wbytes)
+        rs = wbytes;
+
+    gcbytes rg = result;
+    bignum_p r = rt.make<bignum>(ty, rg, rs);
+    rt.free(allocated);
+    return r;
+}
+
+
+bignum_p bignum::modinv(bignum_r xg, bignum_r mg)
+// ----------------------------------------------------------------------------
+//   Compute the inverse of x modulo m with the extended Euclid algorithm
+// ----------------------------------------------------------------------------
+{
+    if (!xg || !mg)
+        return nullptr;
+    if (mg->is_zero())
+    {
+        rt.zero_divide_error();
+        return nullptr;
+    }
+
+    // Work on |m| and on x reduced to [0, |m|)
+    size_t   ms = 0;
+    gcbytes  mb = mg->value(&ms);
+    bignum_g m  = rt.make<bignum>(ID_bignum, mb, ms);
+    bignum_g r1 = powmod(xg, bignum::make(1), m);
+    bignum_g r0 = m;
+    bignum_g t0 = bignum::make(0);
+    bignum_g t1 = bignum::make(1);
+    while (r1 && t1 && !r1->is_zero())
+    {
+        bignum_g q, r;
+        if (!quorem(r0, r1, ID_bignum, &q, &r))
+            return nullptr;
+        bignum_g qt = q * t1;
+        bignum_g t  = t0 - qt;
+        r0 = r1;
+        r1 = r;
+        t0 = t1;
+        t1 = t;
+    }
+    if (!r1 || !t1)
+        return nullptr;
+    if (!r0->is_one())
+    {
+        rt.value_error();
+        return nullptr;
+    }
+    if (t0->type() == ID_neg_bignum)
+        t0 = t0 + m;
+
+    id xt = xg->type();
+    id mt = mg->type();
+    id ty = is_based(mt) ? mt : is_based(xt) ? xt : ID_bignum;
+    if (ty != ID_bignum)
+    {
+        size_t  ts = 0;
+        gcbytes tb = t0->value(&ts);
+        t0 = rt.make<bignum>(ty, tb, ts);
+    }
+    return t0;
+}
+
+
+// ============================================================================
+//
+//   Primality and factorization
+//
+// ============================================================================
+//
+//   Values that fit in 64 bits use a deterministic Miller-Rabin test, with
+//   Montgomery arithmetic on machine words. Larger values use Baillie-PSW,
+//   i.e. a strong probable prime test to base 2 followed by a strong Lucas
+//   test, with Montgomery multiplication on 32-bit limbs. Factorization
+//   removes small factors by trial division, then splits the composites
+//   that remain with Brent's variant of Pollard's rho.
+//   Limb arrays live in the scratchpad, and no object is created while
+//   they are in use, so that garbage collection cannot move them.
+
+#ifndef PRIME_TRIAL_LIMIT
+// Largest divisor tried by trial division before Pollard's rho
+#define PRIME_TRIAL_LIMIT       997
+#endif // PRIME_TRIAL_LIMIT
+
+#ifndef PRIME_RHO_BATCH
+// Number of rho steps whose differences are multiplied before a gcd
+#define PRIME_RHO_BATCH         64
+#endif // PRIME_RHO_BATCH
+
+#ifndef PRIME_SQUARE_CHECK
+// Number of Lucas parameters tried before checking for a perfect square
+#define PRIME_SQUARE_CHECK      16
+#endif // PRIME_SQUARE_CHECK
+
+
+struct prime_mont64
+// ----------------------------------------------------------------------------
+//   Montgomery arithmetic modulo an odd 64-bit value, with R = 2^64
+// ----------------------------------------------------------------------------
+{
+    prime_mont64(uint64_t m): m(m), minv(0), one(0), r2(0)
+    {
+        // -1/m mod 2^64 with Newton's iteration, R mod m and R^2 mod m
+        uint64_t inv = m;
+        for (uint i = 0; i < 5; i++)
+            inv *= 2 - m * inv;
+        minv = -inv;
+        one = (0 - m) % m;
+        r2 = one;
+        for (uint i = 0; i < 64; i++)
+            r2 = add(r2, r2);
+    }
+
+    uint64_t add(uint64_t a, uint64_t b) const
+    {
+        uint64_t s = a + b;
+        if (s < a || s >= m)
+            s -= m;
+        return s;
+    }
+
+    uint64_t sub(uint64_t a, uint64_t b) const
+    {
+        return a >= b ? a - b : a - b + m;
+    }
+
+    uint64_t mul(uint64_t a, uint64_t b) const
+    {
+        uint64_t hi = 0;
+        uint64_t lo = mul_wide(a, b, hi);
+        uint64_t qh = 0;
+        mul_wide(lo * minv, m, qh);
+        // The low halves add up to 0 or 2^64, the result is below 2m
+        uint64_t t = hi + qh;
+        bool     c = t < hi;
+        uint64_t r = t + (lo != 0);
+        c |= r < t;
+        if (c || r >= m)
+            r -= m;
+        return r;
+    }
+
+    uint64_t to(uint64_t x) const
+    {
+        return mul(x % m, r2);
+    }
+
+    uint64_t pow(uint64_t a, uint64_t e) const
+    {
+        uint64_t r = one;
+        while (e)
+        {
+            if (e & 1)
+                r = mul(r, a);
+            a = mul(a, a);
+            e >>= 1;
+        }
+        return r;
+    }
+
+    uint64_t m, minv, one, r2;
+};
+
+
+static bool prime_is_prime64(uint64_t n)
+// ----------------------------------------------------------------------------
+//   Deterministic Miller-Rabin test for 64-bit values
+// ----------------------------------------------------------------------------
+//   The seven bases are known to have no common strong pseudoprime below 2^64
+{
+    static const byte small[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+    if (n < 2)
+        return false;
+    for (byte p : small)
+        if (n % p == 0)
+            return n == p;
+    if (n < 37 * 37)
+        return true;
+
+    static const uint64_t bases[] =
+    {
+        2, 325, 9375, 28178, 450775, 9780504, 1795265022
+    };
+    prime_mont64 mt(n);
+    uint64_t     minus = mt.sub(0, mt.one);
+    uint64_t     d     = n - 1;
+    uint         s     = __builtin_ctzll(d);
+    d >>= s;
+    for (uint64_t a : bases)
+    {
+        a %= n;
+        if (!a)
+            continue;
+        uint64_t x = mt.pow(mt.to(a), d);
+        if (x == mt.one || x == minus)
+            continue;
+        uint r = 1;
+        for (; r < s; r++)
+        {
+            x = mt.mul(x, x);
+            if (x == minus || x == mt.one)
+                break;
+        }
+        if (r >= s || x != minus)
+            return false;
+    }
+    return true;
+}
+
+
+static uint64_t prime_gcd64(uint64_t a, uint64_t b)
+// ----------------------------------------------------------------------------
+//   Euclid's algorithm on 64-bit values
+// ----------------------------------------------------------------------------
+{
+    while (b)
+    {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+static uint64_t prime_rho64(uint64_t n)
+// ----------------------------------------------------------------------------
+//   Brent's rho on an odd composite 64-bit value, 0 if interrupted
+// ----------------------------------------------------------------------------
+//   The values stay in Montgomery form, which does not change the gcds
+{
+    prime_mont64 mt(n);
+    for (uint64_t c = 1; c < n; c++)
+    {
+        uint64_t cm = mt.to(c);
+        uint64_t y  = mt.to(2);
+        uint64_t x  = y;
+        uint64_t ys = y;
+        uint64_t q  = mt.one;
+        uint64_t g  = 1;
+        for (uint64_t r = 1; g == 1; r *= 2)
+        {
+            x = y;
+            for (uint64_t i = 0; i < r; i++)
+            {
+                if (i % PRIME_RHO_BATCH == 0 && program::interrupted())
+                    return 0;
+                y = mt.add(mt.mul(y, y), cm);
+            }
+            for (uint64_t k = 0; k < r && g == 1; k += PRIME_RHO_BATCH)
+            {
+                if (program::interrupted())
+                    return 0;
+                ys = y;
+                uint64_t batch = std::min<uint64_t>(PRIME_RHO_BATCH, r - k);
+                for (uint64_t i = 0; i < batch; i++)
+                {
+                    y = mt.add(mt.mul(y, y), cm);
+                    q = mt.mul(q, x > y ? x - y : y - x);
+                }
+                g = prime_gcd64(q, n);
+            }
+        }
+
+        // The batch product hit a multiple of n, redo the last steps
+        if (g == n)
+        {
+            do
+            {
+                ys = mt.add(mt.mul(ys, ys), cm);
+                g = prime_gcd64(x > ys ? x - ys : ys - x, n);
+            } while (g == 1);
+        }
+        if (g != n)
+            return g;
+    }
+    return 0;
+}
+
+
+static bool prime_split64(uint64_t n, uint64_t *factors, uint &count)
+// ----------------------------------------------------------------------------
+//   Add the prime factors of n to the array, false if interrupted
+// ----------------------------------------------------------------------------
+{
+    if (n < 2)
+        return true;
+    for (uint64_t d = 2; d <= PRIME_TRIAL_LIMIT && d * d <= n; d += 1 + (d > 2))
+    {
+        while (n % d == 0)
+        {
+            factors[count++] = d;
+            n /= d;
+        }
+    }
+    if (n == 1)
+        return true;
+    if (prime_is_prime64(n))
+    {
+        factors[count++] = n;
+        return true;
+    }
+    uint64_t d = prime_rho64(n);
+    if (!d)
+        return false;
+    return prime_split64(d, factors, count) &&
+           prime_split64(n / d, factors, count);
+}
+
+
+static uint32_t prime_mod_small(byte_p x, size_t xs, uint32_t d)
+// ----------------------------------------------------------------------------
+//   Remainder of a bignum magnitude by a small divisor
+// ----------------------------------------------------------------------------
+//   d must be less than 2^23 so that the computation fits in 32 bits
+{
+    uint32_t r = 0;
+    for (size_t i = xs; i --> 0; )
+        r = ((r << 8) | x[i]) % d;
+    return r;
+}
+
+
+static int prime_jacobi(int32_t d, byte_p x, size_t xs)
+// ----------------------------------------------------------------------------
+//   Jacobi symbol (d/n) for a small odd d and a large odd n
+// ----------------------------------------------------------------------------
+{
+    int      result = 1;
+    uint32_t a      = d < 0 ? -d : d;
+    uint32_t n4     = x[0] & 3;
+    if (d < 0 && n4 == 3)
+        result = -result;
+    if ((a & 3) == 3 && n4 == 3)
+        result = -result;
+
+    // Quadratic reciprocity reduces to (n mod a / a)
+    uint32_t b = a;
+    a = prime_mod_small(x, xs, b);
+    while (a)
+    {
+        while (!(a & 1))
+        {
+            a >>= 1;
+            uint32_t r = b & 7;
+            if (r == 3 || r == 5)
+                result = -result;
+        }
+        std::swap(a, b);
+        if ((a & 3) == 3 && (b & 3) == 3)
+            result = -result;
+        a %= b;
+    }
+    return b == 1 ? result : 0;
+}
+
+
+struct prime_limbs
+// ----------------------------------------------------------------------------
+//   Montgomery arithmetic modulo an odd bignum on 32-bit limbs
+// ----------------------------------------------------------------------------
+//   Limb arrays are carved out of a scratch buffer, each with n + 2 limbs
+{
+    static size_t scratch(size_t ms, size_t arrays)
+    {
+        size_t n = (ms + 3) / 4;
+        return 4 * (arrays + 4) * (n + 2) + 4;
+    }
+
+    prime_limbs(byte *buffer, byte_p mb, size_t ms)
+        : n((ms + 3) / 4), minv(0), m(), one(), r2(), t(), next()
+    {
+        uintptr_t aligned = (uintptr_t(buffer) + 3) & ~uintptr_t(3);
+        next = (uint32_t *) aligned;
+        m    = take();
+        one  = take();
+        r2   = take();
+        t    = take();
+        mont_load(m, n + 2, mb, ms);
+
+        uint32_t inv = m[0];
+        for (uint i = 0; i < 5; i++)
+            inv *= 2 - m[0] * inv;
+        minv = -inv;
+
+        // R mod m and R^2 mod m by doubling 1
+        small(one, 1);
+        for (size_t i = 0; i < 32 * n; i++)
+            add(one, one, one);
+        copy(r2, one);
+        for (size_t i = 0; i < 32 * n; i++)
+            add(r2, r2, r2);
+    }
+
+    uint32_t *take()
+    {
+        uint32_t *r = next;
+        next += n + 2;
+        for (size_t i = 0; i < n + 2; i++)
+            r[i] = 0;
+        return r;
+    }
+
+    void copy(uint32_t *r, const uint32_t *a) const
+    {
+        for (size_t i = 0; i < n; i++)
+            r[i] = a[i];
+    }
+
+    bool is(const uint32_t *a, const uint32_t *b) const
+    {
+        for (size_t i = 0; i < n; i++)
+            if (a[i] != b[i])
+                return false;
+        return true;
+    }
+
+    bool zero(const uint32_t *a) const
+    {
+        for (size_t i = 0; i < n; i++)
+            if (a[i])
+                return false;
+        return true;
+    }
+
+    void small(uint32_t *r, uint32_t v) const
+    {
+        for (size_t i = 0; i < n; i++)
+            r[i] = 0;
+        r[0] = v;
+    }
+
+    void reduce(uint32_t *r, bool carry) const
+    {
+        // Subtract m if there was a carry or if r >= m
+        bool ge = carry;
+        if (!ge)
+        {
+            ge = true;
+            for (size_t i = n; i --> 0; )
+            {
+                if (r[i] != m[i])
+                {
+                    ge = r[i] > m[i];
+                    break;
+                }
+            }
+        }
+        if (ge)
+        {
+            uint32_t borrow = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint32_t d = r[i] - m[i] - borrow;
+                borrow = borrow ? r[i] <= m[i] : r[i] < m[i];
+                r[i] = d;
+            }
+        }
+    }
+
+    void add(uint32_t *r, const uint32_t *a, const uint32_t *b) const
+    {
+        uint64_t c = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            c += uint64_t(a[i]) + b[i];
+            r[i] = uint32_t(c);
+            c >>= 32;
+        }
+        reduce(r, c);
+    }
+
+    void sub(uint32_t *r, const uint32_t *a, const uint32_t *b) const
+    {
+        uint32_t borrow = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t d = a[i] - b[i] - borrow;
+            borrow = borrow ? a[i] <= b[i] : a[i] < b[i];
+            r[i] = d;
+        }
+        if (borrow)
+        {
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                c += uint64_t(r[i]) + m[i];
+                r[i] = uint32_t(c);
+                c >>= 32;
+            }
+        }
+    }
+
+    void half(uint32_t *r, const uint32_t *a) const
+    {
+        // Add m to odd values, then shift the n + 1 limb sum right
+        bool     odd = a[0] & 1;
+        uint64_t c   = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            c += uint64_t(a[i]) + (odd ? m[i] : 0);
+            r[i] = uint32_t(c);
+            c >>= 32;
+        }
+        for (size_t i = 0; i < n; i++)
+            r[i] = (r[i] >> 1) | ((i + 1 < n ? r[i + 1] : uint32_t(c)) << 31);
+    }
+
+    void mul(uint32_t *r, const uint32_t *a, const uint32_t *b) const
+    {
+        mont_mul(r, a, b, m, n, minv, t);
+    }
+
+    void to(uint32_t *r, int32_t v) const
+    {
+        // Montgomery form of a small signed value
+        small(r, v < 0 ? -v : v);
+        mul(r, r, r2);
+        if (v < 0 && !zero(r))
+        {
+            uint32_t borrow = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint32_t d = m[i] - r[i] - borrow;
+                borrow = borrow ? m[i] <= r[i] : m[i] < r[i];
+                r[i] = d;
+            }
+        }
+    }
+
+    void pow(uint32_t *r, const uint32_t *a, const uint32_t *e,
+             size_t bits) const
+    {
+        copy(r, one);
+        for (size_t bit = bits; bit --> 0; )
+        {
+            mul(r, r, r);
+            if ((e[bit / 32] >> (bit % 32)) & 1)
+                mul(r, r, a);
+        }
+    }
+
+    size_t    n;
+    uint32_t  minv;
+    uint32_t *m, *one, *r2, *t, *next;
+};
+
+
+static size_t prime_odd_part(prime_limbs &l, uint32_t *d, size_t &s)
+// ----------------------------------------------------------------------------
+//   Remove the trailing zeros of d, return the number of bits left
+// ----------------------------------------------------------------------------
+{
+    size_t dn = l.n + 1;
+    while (dn && !d[dn - 1])
+        dn--;
+    s = gcd_trailing(d);
+    dn = gcd_shift(d, dn, s);
+    return 32 * dn - __builtin_clz(d[dn - 1]);
+}
+
+
+static bool prime_strong_base2(prime_limbs &l)
+// ----------------------------------------------------------------------------
+//   Strong probable prime test to base 2
+// ----------------------------------------------------------------------------
+{
+    uint32_t *d     = l.take();
+    uint32_t *a     = l.take();
+    uint32_t *x     = l.take();
+    uint32_t *minus = l.take();
+    size_t    s     = 0;
+    l.copy(d, l.m);
+    d[0] &= ~1U;
+    size_t bits = prime_odd_part(l, d, s);
+
+    l.to(a, 2);
+    l.pow(x, a, d, bits);
+    l.small(minus, 0);
+    l.sub(minus, minus, l.one);
+    if (l.is(x, l.one) || l.is(x, minus))
+        return true;
+    for (size_t r = 1; r < s; r++)
+    {
+        l.mul(x, x, x);
+        if (l.is(x, minus))
+            return true;
+        if (l.is(x, l.one))
+            return false;
+    }
+    return false;
+}
+
+
+static bool prime_strong_lucas(prime_limbs &l, int32_t D)
+// ----------------------------------------------------------------------------
+//   Strong Lucas probable prime test with P = 1 and Q = (1 - D) / 4
+// ----------------------------------------------------------------------------
+{
+    uint32_t *d  = l.take();
+    uint32_t *u  = l.take();
+    uint32_t *v  = l.take();
+    uint32_t *qk = l.take();
+    uint32_t *qm = l.take();
+    uint32_t *dm = l.take();
+    uint32_t *w  = l.take();
+
+    // n + 1 = d * 2^s
+    uint64_t c = 1;
+    for (size_t i = 0; i < l.n; i++)
+    {
+        c += l.m[i];
+        d[i] = uint32_t(c);
+        c >>= 32;
+    }
+    d[l.n] = uint32_t(c);
+    size_t s    = 0;
+    size_t bits = prime_odd_part(l, d, s);
+
+    l.copy(u, l.one);
+    l.copy(v, l.one);
+    l.to(qm, (1 - D) / 4);
+    l.copy(qk, qm);
+    l.to(dm, D);
+    for (size_t bit = bits - 1; bit --> 0; )
+    {
+        // U(2k) = U(k) V(k), V(2k) = V(k)^2 - 2 Q^k
+        l.mul(u, u, v);
+        l.mul(v, v, v);
+        l.sub(v, v, qk);
+        l.sub(v, v, qk);
+        l.mul(qk, qk, qk);
+        if ((d[bit / 32] >> (bit % 32)) & 1)
+        {
+            // U(k+1) = (U(k) + V(k)) / 2, V(k+1) = (D U(k) + V(k)) / 2
+            l.mul(w, dm, u);
+            l.add(w, w, v);
+            l.add(u, u, v);
+            l.half(u, u);
+            l.half(v, w);
+            l.mul(qk, qk, qm);
+        }
+    }
+    if (l.zero(u) || l.zero(v))
+        return true;
+    for (size_t r = 1; r < s; r++)
+    {
+        l.mul(v, v, v);
+        l.sub(v, v, qk);
+        l.sub(v, v, qk);
+        if (l.zero(v))
+            return true;
+        l.mul(qk, qk, qk);
+    }
+    return false;
+}
+
+
+static bool prime_is_square(bignum_r x)
+// ----------------------------------------------------------------------------
+//   Check if x is a perfect square using Newton's integer square root
+// ----------------------------------------------------------------------------
+{
+    size_t xs = 0;
+    x->value(&xs);
+    bignum_g r = bignum::make(1);
+    r = r << uint(4 * xs);
+    while (r)
+    {
+        bignum_g q;
+        if (!bignum::quorem(x, r, object::ID_bignum, &q, nullptr))
+            return false;
+        bignum_g n = r + q;
+        n = n >> 1U;
+        if (!n || !(n < r))
+            break;
+        r = n;
+    }
+    if (!r)
+        return false;
+    bignum_g sq = r * r;
+    return sq && sq == x;
+}
+
+
+bool bignum::is_prime(bignum_r x)
+// ----------------------------------------------------------------------------
+//   Primality test, deterministic to 64 bits, Baillie-PSW beyond
+// ----------------------------------------------------------------------------
+{
+    if (!x || x->type() == ID_neg_bignum)
+        return false;
+    size_t xs = 0;
+    byte_p xb = x->value(&xs);
+    while (xs && !xb[xs - 1])
+        xs--;
+    if (xs <= sizeof(uint64_t))
+        return prime_is_prime64(x->value<uint64_t>());
+    if (!(xb[0] & 1))
+        return false;
+    for (uint32_t d = 3; d <= PRIME_TRIAL_LIMIT; d += 2)
+        if (!prime_mod_small(xb, xs, d))
+            return false;
+
+    // Selfridge's method: first D in 5, -7, 9, -11, ... with (D/n) = -1
+    int32_t D = 5;
+    for (uint tries = 1; ; tries++)
+    {
+        xb = x->value(&xs);
+        int j = prime_jacobi(D, xb, xs);
+        if (j < 0)
+            break;
+        if (j == 0)
+            return false;
+        if (tries == PRIME_SQUARE_CHECK && prime_is_square(x))
+            return false;
+        D = D > 0 ? -(D + 2) : 2 - D;
+    }
+
+    size_t allocated = prime_limbs::scratch(xs, 7);
+    byte  *buffer    = rt.allocate(allocated); // May GC here
+    if (!buffer)
+        return false;
+    xb = x->value(&xs);                         // Re-read after potential GC
+    prime_limbs l(buffer, xb, xs);
+    byte      *work = (byte *) l.next;          // Each test reuses the arrays
+    bool       result = prime_strong_base2(l);
+    l.next = (uint32_t *) work;
+    result = result && prime_strong_lucas(l, D);
+    rt.free(allocated);
+    return result;
+}
+
+
+static bool prime_rho_gcd(const prime_limbs &l, const uint32_t *a,
+                          uint32_t *gu, uint32_t *gv,
+                          uint32_t *&g, size_t &gn)
+// ----------------------------------------------------------------------------
+//   Compute gcd(a, m) in g using gu and gv, return true if it is not 1
+// ----------------------------------------------------------------------------
+{
+    size_t n = l.n;
+    if (l.zero(a))
+    {
+        g  = l.m;
+        gn = n;
+        return true;
+    }
+    size_t un = n;
+    size_t vn = n;
+    for (size_t i = 0; i < n; i++)
+    {
+        gu[i] = a[i];
+        gv[i] = l.m[i];
+    }
+    while (un && !gu[un - 1])
+        un--;
+    while (vn && !gv[vn - 1])
+        vn--;
+    un = gcd_shift(gu, un, gcd_trailing(gu));
+    g  = gcd_odd(gu, un, gv, vn);
+    gn = un;
+    return gn > 1 || g[0] != 1;
+}
+
+
+static bignum_p prime_rho(bignum_r x)
+// ----------------------------------------------------------------------------
+//   Brent's rho on an odd composite bignum, nullptr if interrupted
+// ----------------------------------------------------------------------------
+{
+    size_t xs = 0;
+    x->value(&xs);
+    size_t allocated = prime_limbs::scratch(xs, 9);     // 8 + result
+    byte  *buffer    = rt.allocate(allocated); // May GC here
+    if (!buffer)
+        return nullptr;
+    byte_p      xb = x->value(&xs);             // Re-read after potential GC
+    prime_limbs l(buffer, xb, xs);
+    size_t      n  = l.n;
+    uint32_t   *cm = l.take();
+    uint32_t   *x0 = l.take();
+    uint32_t   *y  = l.take();
+    uint32_t   *ys = l.take();
+    uint32_t   *q  = l.take();
+    uint32_t   *df = l.take();
+    uint32_t   *gu = l.take();
+    uint32_t   *gv = l.take();
+    uint32_t   *g  = nullptr;
+    size_t      gn = 0;
+    bool        interrupted = false;
+
+    for (uint32_t c = 1; !interrupted; c++)
+    {
+        l.small(cm, c);
+        l.to(y, 2);
+        l.copy(q, l.one);
+        bool split = false;
+        for (ularge r = 1; !split; r *= 2)
+        {
+            l.copy(x0, y);
+            for (ularge i = 0; i < r; i++)
+            {
+                if (i % PRIME_RHO_BATCH == 0 && program::interrupted())
+                {
+                    interrupted = true;
+                    break;
+                }
+                l.mul(y, y, y);
+                l.add(y, y, cm);
+            }
+            for (ularge k = 0; k < r && !split && !interrupted;
+                 k += PRIME_RHO_BATCH)
+            {
+                if (program::interrupted())
+                {
+                    interrupted = true;
+                    break;
+                }
+                l.copy(ys, y);
+                ularge batch = std::min<ularge>(PRIME_RHO_BATCH, r - k);
+                for (ularge i = 0; i < batch; i++)
+                {
+                    l.mul(y, y, y);
+                    l.add(y, y, cm);
+                    l.sub(df, x0, y);
+                    l.mul(q, q, df);
+                }
+                split = prime_rho_gcd(l, q, gu, gv, g, gn);
+            }
+            if (interrupted)
+                break;
+        }
+        if (interrupted)
+            break;
+
+        // The batch product hit a multiple of n, redo the last steps
+        if (g == l.m)
+        {
+            do
+            {
+                l.mul(ys, ys, ys);
+                l.add(ys, ys, cm);
+                l.sub(df, x0, ys);
+            } while (!prime_rho_gcd(l, df, gu, gv, g, gn));
+        }
+        if (g != l.m && gcd_compare(g, gn, l.m, n))
+            break;
+        record(primes, "Rho failed with c=%u", c);
+    }
+
+    bignum_p result = nullptr;
+    if (interrupted)
+    {
+        rt.interrupted_error();
+    }
+    else
+    {
+        byte *out = (byte *) l.next;
+        for (size_t i = 0; i < 4 * gn; i++)
+            out[i] = byte(g[i / 4] >> (8 * (i % 4)));
+        size_t os = 4 * gn;
+        while (os && !out[os - 1])
+            os--;
+        gcbytes og = out;
+        result = rt.make<bignum>(object::ID_bignum, og, os);
+    }
+    rt.free(allocated);
+    return result;
+}
+
+
+static bool prime_push(ularge value)
+// ----------------------------------------------------------------------------
+//   Push a prime factor on the stack as a bignum
+// ----------------------------------------------------------------------------
+{
+    bignum_g b = rt.make<bignum>(object::ID_bignum, value);
+    return b && rt.push(+b);
+}
+
+
+static bool prime_split(bignum_g n, bool trial)
+// ----------------------------------------------------------------------------
+//   Push the prime factors of n > 0 on the stack
+// ----------------------------------------------------------------------------
+{
+    size_t ns = 0;
+    byte_p nb = n->value(&ns);
+    while (ns && !nb[ns - 1])
+        ns--;
+    if (ns <= sizeof(uint64_t))
+    {
+        uint64_t factors[64];
+        uint     count = 0;
+        if (!prime_split64(n->value<uint64_t>(), factors, count))
+        {
+            rt.interrupted_error();
+            return false;
+        }
+        for (uint i = 0; i < count; i++)
+            if (!prime_push(factors[i]))
+                return false;
+        return true;
+    }
+
+    for (uint32_t d = 2; trial && d <= PRIME_TRIAL_LIMIT; d += 1 + (d > 2))
+    {
+        nb = n->value(&ns);
+        while (!prime_mod_small(nb, ns, d))
+        {
+            bignum_g dv = bignum::make(d);
+            bignum_g q;
+            if (!prime_push(d) ||
+                !bignum::quorem(n, dv, object::ID_bignum, &q, nullptr))
+                return false;
+            n = q;
+            nb = n->value(&ns);
+            if (ns <= sizeof(uint64_t))
+                return prime_split(n, false);
+        }
+    }
+
+    if (bignum::is_prime(n))
+        return rt.push(+n);
+    if (rt.error())
+        return false;
+    bignum_g d = prime_rho(n);
+    bignum_g q;
+    if (!d || !bignum::quorem(n, d, object::ID_bignum, &q, nullptr))
+        return false;
+    return prime_split(d, false) && prime_split(q, false);
+}
+
+
+bool bignum::prime_factors(bignum_r x)
+// ----------------------------------------------------------------------------
+//   Push the prime factors of the magnitude of x on the stack, unsorted
+// ----------------------------------------------------------------------------
+{
+    if (!x)
+        return false;
+    size_t   xs = 0;
+    gcbytes  xb = x->value(&xs);
+    bignum_g n  = rt.make<bignum>(ID_bignum, xb, xs);
+    return n && prime_split(n, true);
+}
+
+
 static size_t fraction_render(big_fraction_p o, renderer &r, bool negative)
 // ----------------------------------------------------------------------------
 //   Common code for positive and negative fractions
@@ -170,6 +170,10 @@ struct bignum : text
     template <typename Int>
     static bignum_p make(Int value);
 
+    // Based numbers of up to 64 bits as machine words, for WordSize <= 64
+    static bool        based_word(object_p x, ularge &value);
+    static algebraic_p based_word(id type, ularge value);
+
 public:
     // Arithmetic internal routines
     static int compare(bignum_r x, bignum_r y, bool magnitude = false);
@@ -184,10 +188,35 @@ public:
     template<bool extend, typename Op>
     static bignum_p unary(Op op, bignum_r x);
 
+    static uint32_t limb(byte_p p, size_t i)
+    // ------------------------------------------------------------------------
+    //   Read four bytes of a bignum as a little-endian 32-bit limb
+    // ------------------------------------------------------------------------
+    {
+        uint32_t w;
+        memcpy(&w, p + i, sizeof(w));
+        return w;
+    }
+
+    static void limb(byte *p, size_t i, uint32_t w)
+    // ------------------------------------------------------------------------
+    //   Write a 32-bit limb as four bytes of a bignum
+    // ------------------------------------------------------------------------
+    {
+        memcpy(p + i, &w, sizeof(w));
+    }
+
     static bignum_p add_sub(bignum_r y, bignum_r x, bool subtract);
     static bignum_p multiply(bignum_r y, bignum_r x, id ty);
     static bool quorem(bignum_r y, bignum_r x, id ty, bignum_g *q, bignum_g *r);
     static bignum_p pow(bignum_r y, bignum_r x);
+    static bignum_p gcd(bignum_r a, bignum_r b);
+    static bignum_p powmod(bignum_r y, bignum_r x, bignum_r m);
+    static bignum_p modinv(bignum_r x, bignum_r m);
+    static bool     is_prime(bignum_r x);
+    static bool     prime_factors(bignum_r x);
+    static text_p   to_digits(bignum_r x, uint base);
+    static bignum_p from_digits(id type, gcutf8 src, size_t count, uint base);
     static bignum_p shift(bignum_r x, int bits, bool rotate, bool arith);
 
     static bignum_p promote(object_p ival);
@@ -337,10 +366,20 @@ bignum_p bignum::binary(Op op, bignum_r xg, bignum_r yg, id ty)
     x = xg->value(&xs);                         // Re-read after potential GC
     y = yg->value(&ys);
 
-    // Process the part that is common to X and Y
+    // Process the part that is common to X and Y, four bytes at a time
     size_t i = 0;
     size_t max = std::min(std::min(xs, ys), needed);
-    for (i = 0; i < max; i++)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t cw = 0;
+    for (; i + 4 <= max; i += 4)
+    {
+        cw = op(limb(x, i), limb(y, i), cw);
+        limb(buffer, i, uint32_t(cw));
+        cw >>= 32;
+    }
+    c = byte(cw);
+#endif // __ORDER_LITTLE_ENDIAN__
+    for (; i < max; i++)
     {
         byte xd = x[i];
         byte yd = y[i];
@@ -76,6 +76,7 @@ struct blitter
     {
         MONOCHROME,         // Monochrome bitmap, e.g. fonts
         MONOCHROME_REVERSE, // Monochrome bitmap, reverse X axis (DM42)
+        MONOCHROME_NATIVE,  // Monochrome screen in Sharp LCD order (DBh743)
         GRAY_4BPP,          // Gray, 4 bits per pixel (HP50G and related)
         RGB_16BPP,          // RGB16 (HP Prime)
     };
@@ -1050,6 +1051,42 @@ union blitter::color<blitter::mode::MONOCHROME_REVERSE>
 };
 
 
+template <>
+union blitter::color<blitter::mode::MONOCHROME_NATIVE>
+// ------------------------------------------------------------------------
+//  Color representation (1-bit, Sharp memory LCD)
+// ------------------------------------------------------------------------
+//  Same colors as MONOCHROME_REVERSE, but in the panel's own X order
+{
+    color(uint8_t red, uint8_t green, uint8_t blue)
+        : value((red + green + green + blue) / 4 < 128)
+    {
+    }
+    color(pixword pix): value(pix == 0) {}
+
+    uint8_t red()
+    {
+        return !value * 255;
+    }
+    uint8_t green()
+    {
+        return !value * 255;
+    }
+    uint8_t blue()
+    {
+        return !value * 255;
+    }
+
+    enum
+    {
+        BPP = 1
+    };
+
+  public:
+    bool value : 1; // The color value is 0 or 1
+};
+
+
 template <>
 union blitter::color<blitter::mode::GRAY_4BPP>
 // ------------------------------------------------------------------------
@@ -1296,6 +1333,65 @@ union blitter::pattern<blitter::mode::MONOCHROME_REVERSE>
 };
 
 
+template <>
+union blitter::pattern<blitter::mode::MONOCHROME_NATIVE>
+// ------------------------------------------------------------------------
+//   Pattern for 1-bit screens in Sharp LCD order
+// ------------------------------------------------------------------------
+{
+    uint64_t bits;
+
+    enum
+    {
+        BPP  = 1,
+        SIZE = 8
+    }; // 64-bit = 8x8 1-bit pattern
+    enum : uint64_t
+    {
+        SOLID = 0xFFFFFFFFFFFFFFFFull
+    };
+    using color = blitter::color<MONOCHROME_NATIVE>;
+
+  public:
+    // Build a solid pattern from a single color
+    pattern(color c) : bits(c.value * SOLID)
+    {
+    }
+
+    // Build a checkered pattern for a given RGB level
+    pattern(uint8_t red, uint8_t green, uint8_t blue) : bits(0)
+    {
+        // Compute a gray value beteen 0 and 64, number of pixels to fill
+        uint16_t gray = (red + green + green + blue + 4) / 16;
+        if (gray == 32) // Hand tweak 50% gray
+            bits = 0xAAAAAAAAAAAAAAAAull;
+        else
+            // Generate a pattern with "gray" bits lit "at random"
+            for (int bit = 0; bit < 64 && gray; bit++, gray--)
+                bits |= 1ULL << (79 * bit % 64);
+    }
+
+    // Shared constructors
+    template <uint N>
+    pattern(color colors[N]);
+    pattern(color a, color b);
+    pattern(color a, color b, color c, color d);
+
+    // Pattern from bits
+    pattern(uint64_t bits = ~0ULL): bits(bits) {}
+
+    // Some pre-defined shades of gray
+    static const pattern black;
+    static const pattern gray10;
+    static const pattern gray25;
+    static const pattern gray50;
+    static const pattern gray75;
+    static const pattern gray90;
+    static const pattern white;
+    static const pattern invert;
+};
+
+
 template <>
 union blitter::pattern<blitter::mode::GRAY_4BPP>
 // ------------------------------------------------------------------------
@@ -1408,12 +1504,12 @@ template <blitter::clipping Clip,
           typename Dst,
           typename Src,
           blitter::mode CMode>
-void blitter::blit(Dst           &dst,
-                   const Src     &src,
-                   const rect    &drect,
-                   const point   &spos,
-                   blitop         op,
-                   pattern<CMode> colors)
+HOT void blitter::blit(Dst           &dst,
+                       const Src     &src,
+                       const rect    &drect,
+                       const point   &spos,
+                       blitop         op,
+                       pattern<CMode> colors)
 // ----------------------------------------------------------------------------
 //   Generalized multi-bpp blitting routine
 // ----------------------------------------------------------------------------
@@ -1760,6 +1856,24 @@ CONVERT(MONOCHROME_REVERSE, MONOCHROME)
 }
 
 
+CONVERT(MONOCHROME, MONOCHROME_NATIVE)
+// ----------------------------------------------------------------------------
+//   The MONOCHROME_NATIVE mode flips black and white
+// ----------------------------------------------------------------------------
+{
+    return ~data;
+}
+
+
+CONVERT(MONOCHROME_NATIVE, MONOCHROME)
+// ----------------------------------------------------------------------------
+//   The MONOCHROME_NATIVE mode flips black and white
+// ----------------------------------------------------------------------------
+{
+    return ~data;
+}
+
+
 CONVERT(GRAY_4BPP, MONOCHROME)
 // ----------------------------------------------------------------------------
 //   Convert a monochrome bitmap to Gray 4 BPP
@@ -1811,6 +1925,23 @@ CONVERT(RGB_16BPP, MONOCHROME_REVERSE)
     return cvt;
 }
 
+CONVERT(GRAY_4BPP, MONOCHROME_NATIVE)
+// ----------------------------------------------------------------------------
+//   Same colors as MONOCHROME_REVERSE
+// ----------------------------------------------------------------------------
+{
+    return convert<GRAY_4BPP, MONOCHROME_REVERSE>(data);
+}
+
+
+CONVERT(RGB_16BPP, MONOCHROME_NATIVE)
+// ----------------------------------------------------------------------------
+//   Same colors as MONOCHROME_REVERSE
+// ----------------------------------------------------------------------------
+{
+    return convert<RGB_16BPP, MONOCHROME_REVERSE>(data);
+}
+
 #undef CONVERT
 
 
@@ -2062,22 +2193,43 @@ void blitter::surface<Mode>::line(coord   x1,
     coord y  = y1;
     size  wn = (width - 1) / 2;
     size  wp = width / 2;
+    bool  xr = dx >= dy;
+    coord rx = x;
+    coord ry = y;
 
+    // Consecutive points on the same row (or column for steep lines) form
+    // a run, and the squares of a run are drawn as one rectangle, so that
+    // the blitter writes whole words per span instead of pixel by pixel
     while (true)
     {
-        fill<Clip>(x - wn, y - wn, x + wp, y + wp, fg);
-        if (x == x2 && y == y2)
-            break;
-        if (d >= 0)
+        coord px   = x;
+        coord py   = y;
+        bool  last = x == x2 && y == y2;
+        if (!last)
         {
-            x += sx;
-            d -= dy;
+            if (d >= 0)
+            {
+                x += sx;
+                d -= dy;
+            }
+            if (d < 0)
+            {
+                y += sy;
+                d += dx;
+            }
         }
-        if (d < 0)
+        if (last || (xr ? y != ry : x != rx))
         {
-            y += sy;
-            d += dx;
+            coord xl = rx < px ? rx : px;
+            coord xh = rx < px ? px : rx;
+            coord yl = ry < py ? ry : py;
+            coord yh = ry < py ? py : ry;
+            fill<Clip>(xl - wn, yl - wn, xh + wp, yh + wp, fg);
+            rx = x;
+            ry = y;
         }
+        if (last)
+            break;
     }
 }
 
@@ -2105,34 +2257,56 @@ void blitter::surface<Mode>::ellipse(coord   x1,
     coord y  = 0;
     size  wn = width / 2;
     size  wp = (width - 1) / 2;
+    coord rx = x;
+    coord ry = y;
+    bool  fy = true;
 
+    // As for lines, points along a vertical or horizontal run are drawn
+    // as a single rectangle in each quadrant. Filled ellipses only need
+    // one span per row, which is the widest, i.e. the first one.
     do
     {
-        if (width)
-        {
-            fill<Clip>(xc + x - wn, yc + y - wn, xc + x + wp, yc + y + wp, fg);
-            fill<Clip>(xc - x - wn, yc + y - wn, xc - x + wp, yc + y + wp, fg);
-            fill<Clip>(xc + x - wn, yc - y - wn, xc + x + wp, yc - y + wp, fg);
-            fill<Clip>(xc - x - wn, yc - y - wn, xc - x + wp, yc - y + wp, fg);
-        }
-        else
-        {
-            fill<Clip>(xc - x, yc - y, xc + x + 1, yc - y + 1, fg);
-            fill<Clip>(xc - x, yc + y, xc + x + 1, yc + y + 1, fg);
-        }
+        coord px = x;
+        coord py = y;
+        bool  fill_row = fy;
 
         int dx = b2 * x;
         int dy = a2 * y;
+        fy = false;
         if (d <= 0)
         {
             y++;
             d += dy;
+            fy = true;
         }
         if (d >= 0)
         {
             x--;
             d -= dx;
         }
+
+        if (width)
+        {
+            if (x < 0 || (x != rx && y != ry))
+            {
+                // The run is from (rx, ry) to (px, py), px <= rx, py >= ry
+                coord xl = xc - rx - wn, xr = xc - px + wp;
+                coord xL = xc + px - wn, xR = xc + rx + wp;
+                coord yt = yc - py - wn, yb = yc - ry + wp;
+                coord yT = yc + ry - wn, yB = yc + py + wp;
+                fill<Clip>(xL, yT, xR, yB, fg);
+                fill<Clip>(xl, yT, xr, yB, fg);
+                fill<Clip>(xL, yt, xR, yb, fg);
+                fill<Clip>(xl, yt, xr, yb, fg);
+                rx = x;
+                ry = y;
+            }
+        }
+        else if (fill_row)
+        {
+            fill<Clip>(xc - px, yc - py, xc + px + 1, yc - py + 1, fg);
+            fill<Clip>(xc - px, yc + py, xc + px + 1, yc + py + 1, fg);
+        }
     }
     while (x >= 0);
 }
@@ -83,6 +83,106 @@ static uint matches(utf8 start, size_t size, utf8 name)
 
 
 
+#ifndef CATALOG_MATCHES
+#define CATALOG_MATCHES 256
+#endif
+
+static struct catalog_matches
+// ----------------------------------------------------------------------------
+//   The sorted indexes matching the word typed last, prefix matches first
+// ----------------------------------------------------------------------------
+//   Each letter typed with the catalog open narrows the previous search, so
+//   the commands to test are only those that matched before, not the whole
+//   table. The count and the listing of the menu also share the same search.
+{
+    char     word[32];                  // Word typed, lowercase
+    size_t   size;                      // Size of the word
+    uint     count;                     // Number of matching commands
+    uint     prefix;                    // Number of matches at start of name
+    bool     valid;                     // Set if we have all the matches
+    uint16_t ids[CATALOG_MATCHES];      // Indexes in sorted_ids
+} catalog;
+
+
+static bool catalog_extends(utf8 start, size_t size)
+// ----------------------------------------------------------------------------
+//   Check if the typed word extends the word for the cached matches
+// ----------------------------------------------------------------------------
+{
+    if (!catalog.valid || catalog.size > size)
+        return false;
+    for (size_t i = 0; i < catalog.size; i++)
+        if (tolower(start[i]) != catalog.word[i])
+            return false;
+    return true;
+}
+
+
+static bool catalog_add(uint16_t i, uint &nprefix, uint &nother,
+                        uint16_t *other, uint found)
+// ----------------------------------------------------------------------------
+//   Record a match, prefix matches go in place, others in a side buffer
+// ----------------------------------------------------------------------------
+{
+    if (nprefix + nother >= CATALOG_MATCHES)
+        return false;
+    if (found == 1)
+        catalog.ids[nprefix++] = i;
+    else
+        other[nother++] = i;
+    return true;
+}
+
+
+static void catalog_search(utf8 start, size_t size)
+// ----------------------------------------------------------------------------
+//   Build the list of matches for the given word
+// ----------------------------------------------------------------------------
+{
+    if (catalog.valid && catalog.size == size && catalog_extends(start, size))
+        return;
+
+    static uint16_t other[CATALOG_MATCHES];
+    uint nprefix = 0;
+    uint nother  = 0;
+    bool valid   = size < sizeof(catalog.word);
+
+    if (valid && catalog_extends(start, size))
+    {
+        // Narrow down the previous matches, merging the two sorted groups
+        // since a former prefix match may now match only inside the name
+        uint p = 0, o = catalog.prefix, pe = catalog.prefix, oe = catalog.count;
+        while (p < pe || o < oe)
+        {
+            uint16_t i = (o >= oe || (p < pe && catalog.ids[p] < catalog.ids[o]))
+                ? catalog.ids[p++]
+                : catalog.ids[o++];
+            cstring name = command::spellings[command::sorted_ids[i]].name;
+            if (uint found = matches(start, size, utf8(name)))
+                catalog_add(i, nprefix, nother, other, found);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; valid && i < command::sorted_ids_count; i++)
+        {
+            uint16_t j = command::sorted_ids[i];
+            if (cstring name = command::spellings[j].name)
+                if (uint found = matches(start, size, utf8(name)))
+                    valid = catalog_add(i, nprefix, nother, other, found);
+        }
+    }
+
+    memcpy(catalog.ids + nprefix, other, nother * sizeof(*other));
+    catalog.count = nprefix + nother;
+    catalog.prefix = nprefix;
+    catalog.valid = valid;
+    catalog.size = valid ? size : 0;
+    for (size_t i = 0; valid && i < size; i++)
+        catalog.word[i] = tolower(start[i]);
+}
+
+
 uint Catalog::count_commands()
 // ----------------------------------------------------------------------------
 //    Count the commands to display in the catalog
@@ -93,13 +193,16 @@ uint Catalog::count_commands()
     bool   filter = ui.current_word(start, size);
     uint   count  = 0;
 
-    for (size_t i = 0; i < spelling_count; i++)
+    if (filter)
     {
-        object::id ty = object::spellings[i].type;
-        if (!object::is_command(ty))
-            continue;
+        catalog_search(start, size);
+        if (catalog.valid)
+            return catalog.count;
+    }
 
-        if (cstring name = spellings[i].name)
+    for (size_t i = 0; i < sorted_ids_count; i++)
+    {
+        if (cstring name = spellings[sorted_ids[i]].name)
             if (!filter || matches(start, size, utf8(name)))
                 count++;
     }
@@ -117,43 +220,39 @@ void Catalog::list_commands(info &mi)
     size_t size   = 0;
     bool   filter = ui.current_word(start, size);
 
-    if (!sorted_ids)
-        initialize_sorted_ids();
-
-    if (sorted_ids)
+    if (filter)
     {
-        for (uint pass = 0; pass < uint(filter) + 1; pass++)
+        catalog_search(start, size);
+        if (catalog.valid)
         {
-            for (size_t i = 0; i < sorted_ids_count; i++)
+            for (uint m = 0; m < catalog.count; m++)
             {
-                uint16_t j = sorted_ids[i];
-                auto &s = object::spellings[j];
-                id ty  = s.type;
-                if (cstring name = s.name)
-                {
-                    uint ok = !filter;
-                    if (!ok)
-                    {
-                        ok = matches(start, size, utf8(name));
-                        if (ok)
-                            ok = pass ? ok != 1 : ok == 1;
-                    }
-                    if (ok)
-                        menu::items(mi, name, command::static_object(ty));
-                }
+                auto &s = object::spellings[sorted_ids[catalog.ids[m]]];
+                menu::items(mi, s.name, command::static_object(s.type));
             }
+            return;
         }
     }
-    else
+
+    for (uint pass = 0; pass < uint(filter) + 1; pass++)
     {
-        // Fallback if we did not have enough memory for sorted_ids
-        for (size_t i = 0; i < spelling_count; i++)
+        for (size_t i = 0; i < sorted_ids_count; i++)
         {
-            object::id ty = object::spellings[i].type;
-            if (object::is_command(ty))
-                if (cstring name = spellings[i].name)
-                    if (!filter || matches(start, size, utf8(name)))
-                        menu::items(mi, name, command::static_object(ty));
+            uint16_t j = sorted_ids[i];
+            auto &s = object::spellings[j];
+            id ty  = s.type;
+            if (cstring name = s.name)
+            {
+                uint ok = !filter;
+                if (!ok)
+                {
+                    ok = matches(start, size, utf8(name));
+                    if (ok)
+                        ok = pass ? ok != 1 : ok == 1;
+                }
+                if (ok)
+                    menu::items(mi, name, command::static_object(ty));
+            }
         }
     }
 }
@@ -95,7 +95,7 @@ symbol_g characters_file::next()
 //
 // ============================================================================
 
-static const cstring basic_characters[] =
+static constexpr cstring basic_characters[] =
 // ----------------------------------------------------------------------------
 //   List of basic characters
 // ----------------------------------------------------------------------------
@@ -277,6 +277,90 @@ static const cstring basic_characters[] =
 };
 //   clang-format on
 
+static constexpr size_t BASIC_CHARACTERS =
+    sizeof(basic_characters) / sizeof(basic_characters[0]);
+
+
+// ============================================================================
+//
+//   Built-in character menu pages, split at compile time
+//
+// ============================================================================
+//   Instead of scanning the table for the n-th titled entry and counting
+//   its code points each time a menu is shown, this is all done once by
+//   the compiler, and the result is stored in flash.
+
+struct character_page
+// ----------------------------------------------------------------------------
+//   Location and size of a built-in character menu
+// ----------------------------------------------------------------------------
+{
+    uint16_t entry;             // Index of characters in basic_characters
+    uint16_t count;             // Code points shown in the menu
+    uint16_t length;            // Size in bytes of the characters
+};
+
+
+static constexpr size_t basic_character_menus()
+// ----------------------------------------------------------------------------
+//   Count built-in character menus, i.e. entries with a title
+// ----------------------------------------------------------------------------
+{
+    size_t menus = 0;
+    for (size_t u = 0; u < BASIC_CHARACTERS; u += 2)
+        if (basic_characters[u] && *basic_characters[u])
+            menus++;
+    return menus;
+}
+
+static constexpr size_t BASIC_MENUS = basic_character_menus();
+
+
+struct character_pages
+// ----------------------------------------------------------------------------
+//   All built-in character menus
+// ----------------------------------------------------------------------------
+{
+    character_page page[BASIC_MENUS];
+};
+
+
+static constexpr character_pages build_character_pages()
+// ----------------------------------------------------------------------------
+//   Split the built-in characters into menus
+// ----------------------------------------------------------------------------
+//   The menu shows code points up to the first control character
+{
+    character_pages pages{};
+    size_t          menu = 0;
+    for (size_t u = 0; u < BASIC_CHARACTERS; u += 2)
+    {
+        if (basic_characters[u] && *basic_characters[u])
+        {
+            cstring chars  = basic_characters[u + 1];
+            size_t  length = 0;
+            size_t  count  = 0;
+            bool    shown  = true;
+            for (; chars[length]; length++)
+            {
+                byte c = byte(chars[length]);
+                if (c < ' ')
+                    shown = false;
+                if (shown && (c & 0xC0) != 0x80)
+                    count++;
+            }
+            pages.page[menu].entry  = u + 1;
+            pages.page[menu].count  = count;
+            pages.page[menu].length = length;
+            menu++;
+        }
+    }
+    return pages;
+}
+
+static constexpr character_pages basic_pages = build_character_pages();
+
+
 
 
 
@@ -295,7 +379,6 @@ symbol_p character_menu::characters(size_t *matchptr) const
     // Use the characters loaded from the characters file
     characters_file cfile(CFILE);
     size_t   matching = 0;
-    size_t   maxu   = sizeof(basic_characters) / sizeof(basic_characters[0]);
     id       type   = this->type();
     id       menu   = ID_CharactersMenu00;
     symbol_g mchars = nullptr;
@@ -325,21 +408,13 @@ symbol_p character_menu::characters(size_t *matchptr) const
     // Disable built-in characters if we loaded a file
     if (!matching || Settings.ShowBuiltinCharacters())
     {
-        for (size_t u = 0; u < maxu; u += 2)
+        size_t builtin = size_t(type) - size_t(menu);
+        if (type >= menu && builtin < BASIC_MENUS)
         {
-            if (basic_characters[u] && *basic_characters[u])
-            {
-                if (menu == type)
-                {
-                    utf8   mtxt = utf8(basic_characters[u + 1]);
-                    size_t len  = strlen(cstring(mtxt));
-                    mchars      = symbol::make(mtxt, len);
-                    for (utf8 p = mtxt; *p && *p >= ' '; p = utf8_next(p))
-                        matching++;
-                    break;
-                }
-                menu = id(menu + 1);
-            }
+            const character_page &page = basic_pages.page[builtin];
+            utf8 mtxt = utf8(basic_characters[page.entry]);
+            mchars = symbol::make(mtxt, page.length);
+            matching += page.count;
         }
     }
 
@@ -393,7 +468,6 @@ uint character_menu::build_general_menu(menu_info &mi)
     uint   infile   = 0;
     uint   count    = 0;
     uint   maxmenus = ID_CharactersMenu99 - ID_CharactersMenu00;
-    size_t maxu     = sizeof(basic_characters) / sizeof(basic_characters[0]);
     characters_file cfile(CFILE);
 
     // List all menu entries in the file (up to 100)
@@ -407,9 +481,7 @@ uint character_menu::build_general_menu(menu_info &mi)
     // Count built-in character menu titles
     if (!infile || Settings.ShowBuiltinCharacters())
     {
-        for (size_t u = 0; u < maxu; u += 2)
-            if (basic_characters[u] && *basic_characters[u])
-                count++;
+        count = BASIC_MENUS;
         if (infile + count > maxmenus)
             count = maxmenus - infile;
     }
@@ -434,16 +506,9 @@ uint character_menu::build_general_menu(menu_info &mi)
     }
     if (!infile || Settings.ShowBuiltinCharacters())
     {
-        for (size_t u = 0; u < maxu; u += 2)
-        {
-            if (basic_characters[u] && *basic_characters[u])
-            {
-                if (infile >= maxmenus)
-                    break;
-                items(mi, basic_characters[u],
-                      id(ID_CharactersMenu00+infile++));
-            }
-        }
+        for (size_t m = 0; m < BASIC_MENUS && infile < maxmenus; m++)
+            items(mi, basic_characters[basic_pages.page[m].entry - 1],
+                  id(ID_CharactersMenu00+infile++));
     }
 
     return true;
@@ -467,7 +532,6 @@ uint character_menu::build_for_code(menu_info &mi, unicode cp)
 {
     // Use the characters loaded from the characters file
     characters_file cfile(CFILE);
-    size_t   maxu      = sizeof(basic_characters) / sizeof(basic_characters[0]);
     symbol_g menuchars = nullptr;
     uint     offset    = 0;
 
@@ -505,7 +569,7 @@ uint character_menu::build_for_code(menu_info &mi, unicode cp)
      // Disable built-in characters if we loaded a file
     if (!menuchars || Settings.ShowBuiltinCharacters())
     {
-        for (size_t u = 0; u < maxu; u += 2)
+        for (size_t u = 0; u < BASIC_CHARACTERS; u += 2)
         {
             if (!basic_characters[u] || !*basic_characters[u])
             {
@@ -87,141 +87,88 @@ object::id command::lookup(utf8 name, size_t &maxlen, bool eq)
 //   Lookup a command and return its ID
 // ----------------------------------------------------------------------------
 {
-    id     type  = id(0);
     size_t len   = maxlen;
 
-    if (!sorted_ids)
+    // Binary search in the sorted IDs
+    size_t low  = 0;
+    size_t high = sorted_ids_count;
+
+    // Compute the maximum possible size for the command
+    size_t max = maxlen;
+    if (is_valid_as_name_initial(name) ||
+        (!eq && utf8_codepoint(name) == L'↑')) // e.g. ↑Match
     {
-        if (!initialize_sorted_ids())
-        {
-            static bool shown = false;
-            if (!shown)
-            {
-                shown = true;
-                ui.draw_message("Warning: Could not initialize sorted IDs",
-                                "Catalog and object parsing will be slower");
-            }
-        }
+        for (max = utf8_size(name, max);
+             max < maxlen && !is_separator(name + max);
+             max += utf8_size(name + max, maxlen - max))
+            /* nop */;
     }
-
-    // Binary search if we have sorted IDs
-    if (sorted_ids)
+    else
     {
-        size_t low  = 0;
-        size_t high = sorted_ids_count;
-
-        // Compute the maximum possible size for the command
-        size_t max = maxlen;
-        if (is_valid_as_name_initial(name) ||
-            (!eq && utf8_codepoint(name) == L'↑')) // e.g. ↑Match
+        // '=' is special because there is == (two consecutive separators)
+        if (name[0] == '=')
         {
-            for (max = utf8_size(name, max);
-                 max < maxlen && !is_separator(name + max);
-                 max += utf8_size(name + max, maxlen - max))
-                /* nop */;
+            maxlen = (max > 1 && name[1] == '=') ? 2 : 1;
+            return  maxlen == 2 ? ID_TestSame : ID_TestEQ;
         }
         else
         {
-            // '=' is special because there is == (two consecutive separators)
-            if (name[0] == '=')
-            {
-                maxlen = (max > 1 && name[1] == '=') ? 2 : 1;
-                return  maxlen == 2 ? ID_TestSame : ID_TestEQ;
-            }
-            else
-            {
-                // All non-names cmds are 1 character
-                max = utf8_size(name, maxlen);
-            }
+            // All non-names cmds are 1 character
+            max = utf8_size(name, maxlen);
         }
+    }
 
-        while (true)
-        {
-            uint mid = (low + high) / 2;
-            uint16_t spidx = sorted_ids[mid];
-            auto    &s     = spellings[spidx];
-            id       type  = s.type;
-            int      cmp   = -1;
+    while (true)
+    {
+        uint mid = (low + high) / 2;
+        uint16_t spidx = sorted_ids[mid];
+        auto    &s     = spellings[spidx];
+        id       type  = s.type;
+        int      cmp   = -1;
 
-            if (is_command(type))
+        if (is_command(type))
+        {
+            if (utf8 cmd = utf8(s.name))
             {
-                if (utf8 cmd = utf8(s.name))
-                {
-                    // When parsing an equation skip x³ command spelling,
-                    // since we parse x³ as cubed(x).
-                    bool xsq = (eq && (type == ID_sq  || type == ID_cubed ||
-                                       type == ID_inv || type == ID_fact) &&
-                                *cmd == 'x');
+                // When parsing an equation skip x³ command spelling,
+                // since we parse x³ as cubed(x).
+                bool xsq = (eq && (type == ID_sq  || type == ID_cubed ||
+                                   type == ID_inv || type == ID_fact) &&
+                            *cmd == 'x');
 
-                    // No function name like `min` while parsing units
-                    bool uskip = unit::mode && is_valid_as_name_initial(cmd);
+                // No function name like `min` while parsing units
+                bool uskip = unit::mode && is_valid_as_name_initial(cmd);
 
-                    len = strlen(cstring(cmd));
-                    if (len <= max)
-                    {
-                        cmp = strncasecmp(cstring(cmd), cstring(name), len);
-                        if (cmp == 0 && at_end(name, max, cmd, len, eq))
-                        {
-                            if (uskip || xsq)
-                                return id(0);
-                            maxlen = len;
-                            return type;
-                        }
-                        if (cmp == 0)
-                            cmp = -1; // Logically equivalent to cmd ending in 0
-                    }
-                    else
+                len = strlen(cstring(cmd));
+                if (len <= max)
+                {
+                    cmp = strncasecmp(cstring(cmd), cstring(name), len);
+                    if (cmp == 0 && at_end(name, max, cmd, len, eq))
                     {
-                        cmp = strncasecmp(cstring(cmd), cstring(name), max);
-                        if (cmp == 0)
-                            cmp = 1; // Logically equivalent to name ending in 0
+                        if (uskip || xsq)
+                            return id(0);
+                        maxlen = len;
+                        return type;
                     }
+                    if (cmp == 0)
+                        cmp = -1; // Logically equivalent to cmd ending in 0
+                }
+                else
+                {
+                    cmp = strncasecmp(cstring(cmd), cstring(name), max);
+                    if (cmp == 0)
+                        cmp = 1; // Logically equivalent to name ending in 0
                 }
             }
-
-            if (mid == low)
-                return id(0);
-            if (cmp < 0)
-                low = mid;
-            else
-                high = mid;
         }
-    }
-
-    id found = id(0);
-    for (size_t i = 0; i < spelling_count; i++)
-    {
-        if (!is_command(spellings[i].type))
-            continue;
-        if (utf8 cmd = utf8(spellings[i].name))
-        {
-            if (type != spellings[i].type)
-            {
-                type = spellings[i].type;
 
-                // When parsing an equation, parse x³ as cubed(x)
-                if (eq && (type == ID_sq  || type == ID_cubed ||
-                           type == ID_inv || type == ID_fact))
-                    continue;
-            }
-
-            // No function names like `min` while parsing units
-            if (unit::mode && is_valid_as_name_initial(cmd))
-                continue;
-
-            len = strlen(cstring(cmd));
-            if (len <= maxlen
-                && strncasecmp(cstring(name), cstring(cmd), len) == 0
-                && at_end(name, maxlen, cmd, len, eq))
-            {
-                found = type;
-                break;
-            }
-        }
+        if (mid == low)
+            return id(0);
+        if (cmp < 0)
+            low = mid;
+        else
+            high = mid;
     }
-    if (found)
-        maxlen  = len;
-    return found;
 }
 
 
@@ -324,175 +271,156 @@ int32_t command::int32_arg(uint level)
 //   Sorted IDs for the catalog
 //
 // ============================================================================
+//   The sorted table is computed at compile time from ids.tbl, so that it
+//   lives in flash, uses no heap, and does not slow down the first parse.
 
-uint16_t *command::sorted_ids       = nullptr;
-size_t    command::sorted_ids_count = 0;
+static constexpr object::spelling sorting_spellings[] =
+// ----------------------------------------------------------------------------
+//   Compile-time copy of object::spellings, must expand the same way
+// ----------------------------------------------------------------------------
+//   This is only used in constant expressions, so it takes no space
+{
+#define ALIAS(ty, name)         { object::ID_##ty, name },
+#define ID(ty)                  ALIAS(ty, #ty)
+#define NAMED(ty, name)         ALIAS(ty, name) ALIAS(ty, #ty)
+#include "ids.tbl"
+};
 
+enum { SORTING_SPELLINGS = sizeof(sorting_spellings) / sizeof(*sorting_spellings) };
 
-#ifdef DEOPTIMIZE_CATALOG
-// This is necessary on the DM32, where otherwise we access memory too
-// fast and end up with bad data in the sorted array
-#  pragma GCC push_options
-#  pragma GCC optimize("-O2")
-#endif // DEOPTIMIZE_CATALOG
 
-static int sort_ids(const void *left, const void *right)
+static constexpr int sort_compare(uint l, uint r)
 // ----------------------------------------------------------------------------
-//   Sort the IDs alphabetically based on their fancy name
+//   Compare spellings like strcasecmp, then by index for a stable order
 // ----------------------------------------------------------------------------
 {
-    uint16_t l = *((uint16_t *) left);
-    uint16_t r = *((uint16_t *) right);
-    if (!object::spellings[l].name || !object::spellings[r].name)
-        return !!object::spellings[l].name - !!object::spellings[r].name;
-    return strcasecmp(object::spellings[l].name, object::spellings[r].name);
+    cstring ln = sorting_spellings[l].name;
+    cstring rn = sorting_spellings[r].name;
+    for (uint i = 0; ; i++)
+    {
+        int lc = byte(ln[i]);
+        int rc = byte(rn[i]);
+        if (lc >= 'A' && lc <= 'Z')
+            lc += 'a' - 'A';
+        if (rc >= 'A' && rc <= 'Z')
+            rc += 'a' - 'A';
+        if (lc != rc)
+            return lc - rc;
+        if (!lc)
+            break;
+    }
+    return int(l) - int(r);
 }
 
 
-bool command::initialize_sorted_ids()
+template <size_t N>
+struct sorting_table
+// ----------------------------------------------------------------------------
+//   A table of spelling indexes built at compile time
+// ----------------------------------------------------------------------------
+{
+    uint16_t ids[N];
+    size_t   count;
+};
+
+
+static constexpr sorting_table<SORTING_SPELLINGS> sort_spellings()
 // ----------------------------------------------------------------------------
-//   Sort IDs alphabetically
+//   Sort the command spellings alphabetically, removing duplicates
 // ----------------------------------------------------------------------------
 {
-    // Count number of items to put in the list
-    uint count = 0;
-    for (uint i = 0; i < object::spelling_count; i++)
-        if (object::id ty = object::spellings[i].type)
+    sorting_table<SORTING_SPELLINGS> t = {};
+    uint n = 0;
+    for (uint i = 0; i < SORTING_SPELLINGS; i++)
+        if (object::id ty = sorting_spellings[i].type)
             if (object::is_command(ty))
-                if (object::spellings[i].name)
-                    count++;
+                if (sorting_spellings[i].name)
+                    t.ids[n++] = i;
 
-    sorted_ids = (uint16_t *) realloc(sorted_ids, count * sizeof(uint16_t));
-    if (sorted_ids)
+    // Heap sort, since it does not recurse and has a bounded cost
+    for (uint start = n / 2; start-- > 0; )
     {
-        uint cmd = 0;
-        for (uint i = 0; i < object::spelling_count; i++)
-            if (object::id ty = object::spellings[i].type)
-                if (object::is_command(ty))
-                    if (object::spellings[i].name)
-                        sorted_ids[cmd++] = i;
-        qsort(sorted_ids, count, sizeof(sorted_ids[0]), sort_ids);
-
-        // Make sure we have unique commands in the catalog
-        cstring spelling = nullptr;
-        cmd = 0;
-        for (uint i = 0; i < count; i++)
+        for (uint root = start; 2 * root + 1 < n; )
         {
-            uint16_t j = sorted_ids[i];
-            auto &s = object::spellings[j];
-
-            if (object::is_command(s.type))
-            {
-                if (cstring sp = s.name)
-                {
-                    if (!spelling ||
-                        (spelling != sp && strcasecmp(sp, spelling) != 0))
-                    {
-                        sorted_ids[cmd++] = sorted_ids[i];
-                        spelling = sp;
-                    }
-                    else if (cmd)
-                    {
-                        uint c = sorted_ids[cmd - 1];
-                        auto &last = object::spellings[c];
-                        if (s.type != last.type)
-                        {
-                            record(command_error,
-                                   "Types %u and %u have same spelling "
-                                   "%+s and %+s",
-                                   s.type, last.type, spelling, sp);
-                        }
-                    }
-                }
-            }
-            else
-            {
-                // Do not remove this code
-                // It seems useless, but without it, the catalog is
-                // badly broken on DM42. Apparently, the loop is a bit
-                // too fast, and we end up adding a varying, but too small,
-                // number of commands to the array
-                debug_printf(5, "Not a command for %u, type %u[%s]",
-                             i, s.type, object::name(s.type));
-                debug_wait(-1);
-            }
+            uint child = 2 * root + 1;
+            if (child + 1 < n && sort_compare(t.ids[child], t.ids[child+1]) < 0)
+                child++;
+            if (sort_compare(t.ids[root], t.ids[child]) >= 0)
+                break;
+            uint16_t tmp = t.ids[root];
+            t.ids[root] = t.ids[child];
+            t.ids[child] = tmp;
+            root = child;
+        }
+    }
+    for (uint end = n; end-- > 1; )
+    {
+        uint16_t tmp = t.ids[0];
+        t.ids[0] = t.ids[end];
+        t.ids[end] = tmp;
+        for (uint root = 0; 2 * root + 1 < end; )
+        {
+            uint child = 2 * root + 1;
+            if (child + 1 < end &&
+                sort_compare(t.ids[child], t.ids[child+1]) < 0)
+                child++;
+            if (sort_compare(t.ids[root], t.ids[child]) >= 0)
+                break;
+            tmp = t.ids[root];
+            t.ids[root] = t.ids[child];
+            t.ids[child] = tmp;
+            root = child;
         }
-        sorted_ids_count = cmd;
+    }
 
-#if SIMULATOR
-        if (RECORDER_TRACE(command_sorting))
+    // Make sure we have unique commands in the catalog, keep the first one
+    uint cmd = 0;
+    for (uint i = 0; i < n; i++)
+    {
+        cstring sp = sorting_spellings[t.ids[i]].name;
+        cstring last = cmd ? sorting_spellings[t.ids[cmd-1]].name : nullptr;
+        bool same = last != nullptr;
+        for (uint c = 0; same; c++)
         {
-            if (RECORDER_TRACE(command_sorting) > 1)
-            {
-                for (size_t i = 0; i < sorted_ids_count; i++)
-                {
-                    auto s = spellings[sorted_ids[i]];
-                    record(command_sorting, "%u: %u %s spelled %s",
-                           i, s.type, object::name(s.type), s.name);
-                }
-            }
-            else
-            {
-                for (int pass = 0; pass < 3; pass++)
-                {
-                    cstring types[3] = { "DMNONE", "DM42", "DM32" };
-                    printf("<!--- %s --->\n", types[pass]);
-                    bool shown[object::NUM_IDS] = { false };
-                    for (size_t i = 0; i < sorted_ids_count; i++)
-                    {
-                        auto s = spellings[sorted_ids[i]];
-                        if (!shown[s.type])
-                        {
-                            size_t curlen = strlen(cstring(s.name));
-                            size_t shortest = curlen;
-                            for (size_t j = 0; j < sorted_ids_count; j++)
-                            {
-                                auto a = spellings[sorted_ids[j]];
-                                if (a.type == s.type)
-                                {
-                                    size_t len = strlen(cstring(a.name));
-                                    if (len < shortest)
-                                        shortest = len;
-                                }
-                            }
-                            if (shortest == curlen)
-                            {
-                                int count = 0;
-                                shown[s.type] = true;
-                                printf("* `%s`", s.name);
-                                for (size_t j = 0;
-                                     !pass && j < sorted_ids_count;
-                                     j++)
-                                {
-                                    auto a = spellings[sorted_ids[j]];
-                                    if (a.type == s.type && j != i)
-                                    {
-                                        count++;
-                                        if (count == 1)
-                                            printf(" (");
-                                        else
-                                            printf(", ");
-                                        printf("`%s`", a.name);
-                                    }
-                                }
-                                if (count)
-                                    printf(")");
-                                printf("\n");
-                            }
-                        }
-                    }
-                    printf("<!--- !%s --->\n", types[pass]);
-                }
-            }
+            int lc = byte(sp[c]);
+            int rc = byte(last[c]);
+            if (lc >= 'A' && lc <= 'Z')
+                lc += 'a' - 'A';
+            if (rc >= 'A' && rc <= 'Z')
+                rc += 'a' - 'A';
+            same = lc == rc;
+            if (!lc)
+                break;
         }
-#endif // SIMULATOR
+        if (!same)
+            t.ids[cmd++] = t.ids[i];
     }
-    return sorted_ids;
+    t.count = cmd;
+    return t;
+}
+
+
+static constexpr auto sorting_all = sort_spellings();
+
+
+template <size_t N>
+static constexpr sorting_table<N> sort_trim()
+// ----------------------------------------------------------------------------
+//   Only keep the useful part of the table
+// ----------------------------------------------------------------------------
+{
+    sorting_table<N> t = {};
+    for (uint i = 0; i < N; i++)
+        t.ids[i] = sorting_all.ids[i];
+    t.count = N;
+    return t;
 }
 
-#ifdef DEOPTIMIZE_CATALOG
-#pragma GCC pop_options
-#endif // DEOPTIMIZE_CATALOG
+
+static constexpr auto sorted_table = sort_trim<sorting_all.count>();
+
+const uint16_t *const command::sorted_ids       = sorted_table.ids;
+const size_t          command::sorted_ids_count = sorted_table.count;
 
 
 
@@ -76,11 +76,9 @@ public:
     RENDER_DECL(command);
 
 public:
-    // Sorting command IDs for faster lookup, used in the catalog and parsing
-    static uint16_t *sorted_ids;
-    static size_t    sorted_ids_count;
-
-    static bool      initialize_sorted_ids();
+    // Sorted command IDs for faster lookup, used in the catalog and parsing
+    static const uint16_t *const sorted_ids;
+    static const size_t          sorted_ids_count;
 };
 
 
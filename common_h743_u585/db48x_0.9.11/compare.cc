@@ -34,6 +34,7 @@
 #include "hwfp.h"
 #include "integer.h"
 #include "locals.h"
+#include "program.h"
 
 
 RECORDER(compare,       16, "Comparison operations");
@@ -59,6 +60,24 @@ algebraic_p comparison::evaluate(algebraic_r x, algebraic_r y)
 }
 
 
+static inline bool is_decimal(object::id ty)
+// ----------------------------------------------------------------------------
+//   Check if a type is a variable-precision decimal
+// ----------------------------------------------------------------------------
+{
+    return ty == object::ID_decimal || ty == object::ID_neg_decimal;
+}
+
+
+static inline bool decimal_in_place()
+// ----------------------------------------------------------------------------
+//   Check if decimals are compared as is, and not as hardware floats
+// ----------------------------------------------------------------------------
+{
+    return !Settings.HardwareFloatingPointEnabled() || Settings.Precision() > 16;
+}
+
+
 bool comparison::compare(int *cmp, algebraic_r x, algebraic_r y)
 // ----------------------------------------------------------------------------
 //   Compare objects left and right, return -1, 0 or +1
@@ -125,6 +144,32 @@ bool comparison::compare(int *cmp, algebraic_r x, algebraic_r y)
         return true;
     }
 
+    /* Decimals against decimals or small integers, without allocating */
+    bool xdec = is_decimal(xt);
+    bool ydec = is_decimal(yt);
+    if ((xdec || ydec) && decimal_in_place())
+    {
+        if (xdec && ydec)
+        {
+            *cmp = decimal::compare_in_place(decimal_p(+x), decimal_p(+y), 0);
+            return true;
+        }
+        if (xdec && (yt == ID_integer || yt == ID_neg_integer))
+        {
+            decimal_g xd = decimal_p(+x);
+            ularge    yv = integer_p(+y)->value<ularge>();
+            *cmp = decimal::compare_integer(xd, yt, yv);
+            return true;
+        }
+        if (ydec && (xt == ID_integer || xt == ID_neg_integer))
+        {
+            decimal_g yd = decimal_p(+y);
+            ularge    xv = integer_p(+x)->value<ularge>();
+            *cmp = -decimal::compare_integer(yd, xt, xv);
+            return true;
+        }
+    }
+
     /* Real data types */
     algebraic_g xa = algebraic_p(+x);
     algebraic_g ya = algebraic_p(+y);
@@ -363,6 +408,18 @@ object::result comparison::is_same(bool names)
         }
     }
 
+    // A compiled program is the same as its source
+    if (xt == ID_compiled)
+    {
+        x = compiled_p(x)->source();
+        xt = x->type();
+    }
+    if (yt == ID_compiled)
+    {
+        y = compiled_p(y)->source();
+        yt = y->type();
+    }
+
     if (xt == yt)
     {
         size_t xs = x->size();
@@ -403,6 +460,22 @@ bool smaller_magnitude(algebraic_r x, algebraic_r y)
 //   Compare magnitude
 // ----------------------------------------------------------------------------
 {
+    // Compare in place for the solver's usual decimal and integer values
+    if (x && y)
+    {
+        object::id xt = x->type();
+        object::id yt = y->type();
+        if (is_decimal(xt) && is_decimal(yt) && decimal_in_place())
+        {
+            decimal_g xd = decimal_p(+x);
+            decimal_g yd = decimal_p(+y);
+            return decimal::compare_magnitude(xd, yd) < 0;
+        }
+        if ((xt == object::ID_integer || xt == object::ID_neg_integer) &&
+            (yt == object::ID_integer || yt == object::ID_neg_integer))
+            return integer_p(+x)->value<ularge>() <
+                   integer_p(+y)->value<ularge>();
+    }
     return algebraic::compare(abs::run(x), abs::run(y)) < 0;
 }
 
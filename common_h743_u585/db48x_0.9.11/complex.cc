@@ -33,6 +33,7 @@
 #include "arithmetic.h"
 #include "compare.h"
 #include "functions.h"
+#include "hwfp.h"
 #include "parser.h"
 #include "renderer.h"
 #include "runtime.h"
@@ -235,6 +236,58 @@ complex_g operator-(complex_r x, complex_r y)
 }
 
 
+static bool hardware_value(algebraic_r x, double &v)
+// ----------------------------------------------------------------------------
+//   Read a hardware floating-point part if hardware arithmetic is enabled
+// ----------------------------------------------------------------------------
+{
+    switch (x->type())
+    {
+    case object::ID_hwfloat:
+        v = hwfloat_p(+x)->value();
+        return true;
+    case object::ID_hwdouble:
+        v = hwdouble_p(+x)->value();
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+static bool hardware_parts(algebraic_r x, double &xv, algebraic_r y, double &yv)
+// ----------------------------------------------------------------------------
+//   Check if both parts of a complex can be computed with the FPU
+// ----------------------------------------------------------------------------
+{
+    return fast_function::hardware()
+        && hardware_value(x, xv)
+        && hardware_value(y, yv);
+}
+
+
+static algebraic_p hardware_make(double v)
+// ----------------------------------------------------------------------------
+//   Build a hardware floating-point value for the current precision
+// ----------------------------------------------------------------------------
+{
+    if (Settings.Precision() <= 7)
+        return hwfloat::make(float(v));
+    return hwdouble::make(v);
+}
+
+
+static rectangular_p hardware_make(double re, double im)
+// ----------------------------------------------------------------------------
+//   Build a rectangular complex from hardware floating-point values
+// ----------------------------------------------------------------------------
+{
+    algebraic_g r = hardware_make(re);
+    algebraic_g i = hardware_make(im);
+    return rectangular::make(r, i);
+}
+
+
 complex_g operator*(complex_r x, complex_r y)
 // ----------------------------------------------------------------------------
 //   If both are in rectangular form, rectangular, otherwise polar
@@ -255,6 +308,9 @@ complex_g operator*(complex_r x, complex_r y)
     algebraic_g xi = xx->im();
     algebraic_g yr = yy->re();
     algebraic_g yi = yy->im();
+    double      a, b, c, d;
+    if (hardware_parts(xr, a, xi, b) && hardware_parts(yr, c, yi, d))
+        return hardware_make(a * c - b * d, a * d + b * c);
     return rectangular::make(xr*yr-xi*yi, xr*yi+xi*yr);
 }
 
@@ -279,6 +335,20 @@ complex_g operator/(complex_r x, complex_r y)
     algebraic_g b = xx->im();
     algebraic_g c = yy->re();
     algebraic_g d = yy->im();
+    double      av, bv, cv, dv;
+    if (hardware_parts(a, av, b, bv) && hardware_parts(c, cv, d, dv))
+    {
+        // Smith's algorithm, avoids overflow and underflow in c^2+d^2
+        if (std::fabs(cv) >= std::fabs(dv))
+        {
+            double q = dv / cv;
+            double s = cv + dv * q;
+            return hardware_make((av + bv * q) / s, (bv - av * q) / s);
+        }
+        double q = cv / dv;
+        double s = cv * q + dv;
+        return hardware_make((av * q + bv) / s, (bv * q - av) / s);
+    }
     algebraic_g r = sq::run(c) + sq::run(d);
     return rectangular::make((a*c+b*d)/r, (b*c-a*d)/r);
 }
@@ -493,6 +563,9 @@ algebraic_g rectangular::mod() const
     rectangular_g o = this;
     algebraic_g   r = o->re();
     algebraic_g   i = o->im();
+    double        rv, iv;
+    if (hardware_parts(r, rv, i, iv))
+        return hardware_make(std::hypot(rv, iv));
     return hypot::evaluate(r, i);
 }
 
@@ -518,6 +591,10 @@ algebraic_g rectangular::pifrac() const
     if (!r || !i)
         return nullptr;
 
+    double rv, iv;
+    if (hardware_parts(r, rv, i, iv))
+        return hardware_make(std::atan2(iv, rv) / M_PI);
+
     settings::SaveAngleMode sam(ID_PiRadians); // Enable 'exact' optimizations
     settings::SaveSetAngleUnits ssau(false);   // Do not add angle to result
     algebraic_g a = atan2::evaluate(i, r);
@@ -677,6 +754,10 @@ algebraic_g polar::re() const
 {
     polar_g     o = this;
     algebraic_g m = o->mod();
+    algebraic_g p = o->pifrac();
+    double      mv, pv;
+    if (m && p && hardware_parts(m, mv, p, pv))
+        return hardware_make(mv * std::cos(pv * M_PI));
     algebraic_g a = o->arg(Settings.AngleMode());
     return m * cos::run(a);
 }
@@ -688,6 +769,10 @@ algebraic_g polar::im() const
 {
     polar_g     o = this;
     algebraic_g m = o->mod();
+    algebraic_g p = o->pifrac();
+    double      mv, pv;
+    if (m && p && hardware_parts(m, mv, p, pv))
+        return hardware_make(mv * std::sin(pv * M_PI));
     algebraic_g a = o->arg(Settings.AngleMode());
     return m * sin::run(a);
 }
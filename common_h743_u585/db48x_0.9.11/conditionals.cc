@@ -581,6 +581,9 @@ EVAL_BODY(case_skip_conditional)
 //   Skip to the end of a case statement
 // ----------------------------------------------------------------------------
 {
+    object_p end = command::static_object(ID_case_end_conditional);
+    if (rt.run_skip_to(end))
+        return OK;
     while (object_p next = rt.run_next(0))
         if (next->type() == ID_case_end_conditional)
             break;
@@ -1043,8 +1043,26 @@ constant_p constant::do_lookup(config_r cfg, utf8 txt, size_t len, bool error)
     size_t    clen     = 0;
     uint      idx      = 0;
 
-    // Check in-file constants
-    if (cfile.valid())
+    // Check in-file constants, using the index if there is one
+    uint defs = cfile.valid() ? cfile.index_definitions() : 0;
+    if (defs != ~0U)
+    {
+        uint row = 0;
+        uint want = unit_file::INDEX_DEFINITION;
+        while (cfile.index_find(txt, len, want, 0, row, &idx))
+        {
+            cfile.seek(row);
+            if (symbol_p name = cfile.next(false))
+            {
+                ctxt = cstring(name->value(&clen));
+                if (len == clen && memcmp(txt, ctxt, len) == 0)
+                    return constant::make(cfg.type, idx);
+            }
+            row++;
+        }
+        idx = defs;
+    }
+    else if (cfile.valid())
     {
         cfile.seek(0);
         while (symbol_g category = cfile.next(true))
@@ -1513,6 +1531,26 @@ object::result constant::lookup_command(config_r cfg, bool numerical)
 
     if (constant_p cst = constant::do_lookup(cfg, txt, len, false))
     {
+        // Numerical values of builtin constants are cached at the current
+        // precision, only units with expressions need to be evaluated again
+        if (numerical && cfg.builtins == basic_constants)
+        {
+            constant_g  ccst = cst;
+            algebraic_g spec = ccst->specification();
+            if (spec && (ccst->value_index() == 0 || spec->as<array>()))
+            {
+                if (algebraic_p value = ccst->numerical_value())
+                {
+                    unit_p u = unit::get(value);
+                    if (!u || u->value()->is_real())
+                        return rt.top(value) ? OK : ERROR;
+                }
+            }
+            if (rt.error())
+                return ERROR;
+            cst = ccst;
+        }
+
         if (object_p value = cst->do_value(cfg))
         {
             if (numerical)
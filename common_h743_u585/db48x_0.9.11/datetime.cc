@@ -94,6 +94,48 @@ bool to_time(object_p tobj, tm_t &tm, bool error)
 }
 
 
+bool native_integer(algebraic_p x, large &value)
+// ----------------------------------------------------------------------------
+//   Check if a value is an integer that fits in a native type
+// ----------------------------------------------------------------------------
+{
+    if (!x)
+        return false;
+    object::id ty = x->type();
+    if (ty != object::ID_integer && ty != object::ID_neg_integer)
+        return false;
+    integer_p i = integer_p(x);
+    if (!i->native())
+        return false;
+    value = i->value<ularge>();
+    if (ty == object::ID_neg_integer)
+        value = -value;
+    return true;
+}
+
+
+bool split_date(ularge dval, dt_t &dt)
+// ----------------------------------------------------------------------------
+//   Split a YYYYMMDD value into a dt_t, checking that it is valid
+// ----------------------------------------------------------------------------
+{
+    uint d = dval % 100;
+    dval /= 100;
+    uint m = dval % 100;
+    ularge y = dval / 100;
+
+    const uint days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool bisext = m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+    if (m < 1 || m > 12 || d < 1 || d > days[m-1] + bisext || y > 0xFFFF)
+        return false;
+
+    dt.year  = y;
+    dt.month = m;
+    dt.day   = d;
+    return true;
+}
+
+
 uint to_date(object_p dtobj, dt_t &dt, tm_t &tm, bool error)
 // ----------------------------------------------------------------------------
 //   Convert a YYYYMMDD.HHMMSS value to a date and optional time
@@ -118,29 +160,30 @@ uint to_date(object_p dtobj, dt_t &dt, tm_t &tm, bool error)
         return 0;
     }
 
+    // Plain YYYYMMDD integers, e.g. results of DATE or DATE+, need no math
+    large ival;
+    if (native_integer(date, ival))
+    {
+        if (ival < 0 || !split_date(ival, dt))
+        {
+            if (error)
+                rt.invalid_date_error();
+            return 0;
+        }
+        return 1;
+    }
+
     algebraic_g factor = integer::make(100);
     algebraic_g time = integer::make(1);
     time = date % time;
 
-    uint d = date->as_uint32(0, false) % 100;
-    date = date / factor;
-    uint m = date->as_uint32(0, false) % 100;
-    date = date / factor;
-    uint y = date->as_uint32(0,false);
-
-    const uint days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-    bool bisext = m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
-    if (m < 1 || m > 12 || d < 1 || d > days[m-1] + bisext)
+    if (!split_date(date->as_uint32(0, false), dt))
     {
         if (error)
             rt.invalid_date_error();
         return 0;
     }
 
-    dt.year  = y;
-    dt.month = m;
-    dt.day   = d;
-
     if (time && !time->is_zero())
     {
         time = time * factor;
@@ -200,8 +243,7 @@ algebraic_p julian_day_number(const dt_t &dt, const tm_t &tm)
 // ----------------------------------------------------------------------------
 {
     ularge csecs = (tm.hour * 3600 + tm.min * 60 + tm.sec) * 100 + tm.csec;
-    ularge jval = julian_day_number(dt.day, dt.month, dt.year);
-    algebraic_g jdn = integer::make(jval);
+    algebraic_g jdn = integer::make(julian_day_number(dt));
     if (csecs)
     {
         algebraic_g frac = +fraction::make(integer::make(csecs),
@@ -230,7 +272,7 @@ ularge julian_day_number(int d, int m, int y)
 //   Compute the Julian day number given day, month and year
 // ----------------------------------------------------------------------------
 {
-    uint rm = (m-14)/12;
+    int rm = (m-14)/12;
     ularge jdn = ((1461 * (y + 4800 + rm)) / 4
                   + (367 * (m - 2 - 12 * rm)) / 12
                   - (3 * ((y + 4900 + rm) / 100)) / 4
@@ -240,6 +282,79 @@ ularge julian_day_number(int d, int m, int y)
 }
 
 
+ularge julian_day_number(const dt_t &dt)
+// ----------------------------------------------------------------------------
+//   Compute the Julian day number for a dt_t structure
+// ----------------------------------------------------------------------------
+{
+    return julian_day_number(dt.day, dt.month, dt.year);
+}
+
+
+void date_from_julian_day(ularge jdn, dt_t &dt)
+// ----------------------------------------------------------------------------
+//   Compute the date for a given Julian day number
+// ----------------------------------------------------------------------------
+{
+    enum
+    {
+        y = 4716,
+        j = 1401,
+        m = 2,
+        n = 12,
+        r = 4,
+        p = 1461,
+        v = 3,
+        u = 5,
+        s = 153,
+        w = 2,
+        B = 274277,
+        C = -38
+    };
+
+    large jd = jdn;
+    large f = jd + j + (((4 * jd + B) / 146097) * 3) / 4 + C;
+    large e = r * f + v;
+    large g = (e % p) / r;
+    large h = u * g + w;
+    dt.day   = (h % s) / u + 1;
+    dt.month = (h / s + m ) % n + 1;
+    dt.year  = e / p - y + (n + m - dt.month) / n;
+}
+
+
+ularge date_value(const dt_t &dt)
+// ----------------------------------------------------------------------------
+//   Return the YYYYMMDD value for a date
+// ----------------------------------------------------------------------------
+{
+    return dt.year * 10000ULL + dt.month * 100 + dt.day;
+}
+
+
+uint day_of_week(const dt_t &dt)
+// ----------------------------------------------------------------------------
+//   Return the day of the week, 0 being Monday
+// ----------------------------------------------------------------------------
+{
+    return julian_day_number(dt) % 7;
+}
+
+
+static algebraic_p julian_day_date(ularge jdn)
+// ----------------------------------------------------------------------------
+//   Build a date object for an integral Julian day number
+// ----------------------------------------------------------------------------
+{
+    dt_t dt;
+    date_from_julian_day(jdn, dt);
+    if (integer_g date = integer::make(date_value(dt)))
+        if (unit_p result = unit::make(+date, +symbol::make("date")))
+            return result;
+    return nullptr;
+}
+
+
 algebraic_p date_from_julian_day(object_p jdn, bool error)
 // ----------------------------------------------------------------------------
 //   Create a day from a Julian day object
@@ -250,34 +365,14 @@ algebraic_p date_from_julian_day(object_p jdn, bool error)
 
     if (algebraic_g jval = jdn->as_real())
     {
-        large jdn = jval->as_int64(0, error);
+        large ival;
+        if (native_integer(jval, ival) && ival >= 0)
+            return julian_day_date(ularge(ival));
 
-        enum
-        {
-            y = 4716,
-            j = 1401,
-            m = 2,
-            n = 12,
-            r = 4,
-            p = 1461,
-            v = 3,
-            u = 5,
-            s = 153,
-            w = 2,
-            B = 274277,
-            C = -38
-        };
-
-        large f = jdn + j + (((4 * jdn + B) / 146097) * 3) / 4 + C;
-        large e = r * f + v;
-        large g = (e % p) / r;
-        large h = u * g + w;
-        uint day = (h % s) / u + 1;
-        uint month = (h / s + m ) % n + 1;
-        uint year = e / p - y + (n + m - month) / n;
-        ularge dval = year * 10000 + month * 100 + day;
-
-        algebraic_g date = integer::make(dval);
+        dt_t dt;
+        date_from_julian_day(jval->as_int64(0, error), dt);
+
+        algebraic_g date = integer::make(date_value(dt));
         algebraic_g fp = integer::make(1);
         fp = jval % fp;
         if (!fp->is_zero())
@@ -310,7 +405,18 @@ algebraic_p days_between_dates(object_p date1, object_p date2, bool error)
 {
     dt_t dt1, dt2;
     tm_t tm1{}, tm2{};
-    if (to_date(date1, dt1, tm1, error) && to_date(date2, dt2, tm2, error))
+    uint k1 = to_date(date1, dt1, tm1, error);
+    uint k2 = k1 ? to_date(date2, dt2, tm2, error) : 0;
+    if (k1 == 1 && k2 == 1)
+    {
+        // Neither date has a time part, the difference is integral
+        large diff = large(julian_day_number(dt1)) - julian_day_number(dt2);
+        if (integer_g days = integer::make(diff))
+            if (unit_p result = unit::make(+days, +symbol::make("d")))
+                return result;
+        return nullptr;
+    }
+    if (k1 && k2)
     {
         algebraic_g day1 = julian_day_number(dt1, tm1);
         algebraic_g day2 = julian_day_number(dt2, tm2);
@@ -331,7 +437,17 @@ static algebraic_p days_after(object_p date, object_p days, bool error, int s)
     {
         dt_t dt;
         tm_t tm{};
-        if (to_date(date, dt, tm, error))
+        uint kind = to_date(date, dt, tm, error);
+        large count;
+        if (kind == 1 && native_integer(num, count))
+        {
+            // Whole days added to a date without time: stay in integers
+            large jdn = julian_day_number(dt);
+            jdn = s > 0 ? jdn + count : jdn - count;
+            if (jdn >= 0)
+                return julian_day_date(ularge(jdn));
+        }
+        if (kind)
         {
             algebraic_g jdn = julian_day_number(dt, tm);
             jdn = s > 0 ? jdn + num : jdn - num;
@@ -618,8 +734,7 @@ size_t render_date(renderer &r, algebraic_g date)
 
     if (Settings.ShowDayOfWeek())
     {
-        ularge jdn = julian_day_number(day, month, year);
-        uint dow = jdn % 7;
+        uint dow = julian_day_number(day, month, year) % 7;
         r.printf("%s ", get_wday_shortcut(dow));
     }
 
@@ -44,6 +44,14 @@ algebraic_p to_days(object_p days, bool error = true);
 algebraic_p julian_day_number(algebraic_p date, bool error = true);
 ularge julian_day_number(int d, int m, int y);
 
+// Native date arithmetic on Julian day numbers, without allocating objects
+bool   native_integer(algebraic_p x, large &value);
+bool   split_date(ularge yyyymmdd, dt_t &dt);
+ularge julian_day_number(const dt_t &dt);
+void   date_from_julian_day(ularge jdn, dt_t &dt);
+ularge date_value(const dt_t &dt);
+uint   day_of_week(const dt_t &dt); // 0 = Monday
+
 // Convert Julian day number to date
 algebraic_p date_from_julian_day(object_p jdn, bool error = true);
 
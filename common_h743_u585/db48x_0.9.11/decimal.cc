@@ -803,29 +803,47 @@ decimal_p decimal::from_bignum(bignum_p valuep)
 }
 
 
-decimal_p decimal::from_random_seed(bignum_p valuep)
+decimal_p decimal::from_random_seed(const ularge *words, size_t count)
 // ----------------------------------------------------------------------------
-//    Create a decimal number from a bignum interpreted as a random seed
+//    Create a decimal number from a little-endian random seed
 // ----------------------------------------------------------------------------
+//    Groups of 12 digits are taken from the low end of the seed, and each
+//    group lands 12 digits further right. The division by 10^12 is done
+//    on 16-bit digits so that the partial remainders fit in 64 bits.
 {
-    if (!valuep)
+    ularge value[64];               // RandomGeneratorBits is at most 4096
+    if (!words || !count || count > sizeof(value) / sizeof(value[0]))
         return nullptr;
-    id        itype  = valuep->type();
-    id        type   = ID_decimal;
-    decimal_g result = make(type, 0);
-    decimal_g digits;
-    large     exp    = 0;
-    bignum_g  value  = valuep;
-    bignum_g  div    = bignum::make(1000000000000UL);
-    bignum_g  kigit;
 
-    while (!value->is_zero())
+    const ularge div    = 1000000000000ULL;
+    id           type   = ID_decimal;
+    decimal_g    result = make(type, 0);
+    decimal_g    digits;
+    large        exp    = 0;
+    memcpy(value, words, count * sizeof(ularge));
+
+    size_t top = count;
+    while (top && !value[top - 1])
+        top--;
+    while (top)
     {
+        ularge rem = 0;
+        for (size_t w = top; w --> 0; )
+        {
+            ularge q = 0;
+            for (int h = 3; h >= 0; h--)
+            {
+                rem = (rem << 16) | ((value[w] >> (16 * h)) & 0xFFFF);
+                q = (q << 16) | (rem / div);
+                rem %= div;
+            }
+            value[w] = q;
+        }
+        while (top && !value[top - 1])
+            top--;
+
         exp -= 12;
-        if (!bignum::quorem(value, div, itype, &value, &kigit))
-            return nullptr;
-        ularge kigval = kigit->value<ularge>();
-        digits = make(type, kigval, exp);
+        digits = make(type, rem, exp);
         result = result + digits;
     }
 
@@ -1308,6 +1326,63 @@ bignum_p decimal::to_bignum() const
 }
 
 
+static bool to_fraction_words(decimal::info shape, uint count, uint decimals,
+                              ularge &n1, ularge &d1,
+                              ularge &n2, ularge &d2)
+// ----------------------------------------------------------------------------
+//   Continued fraction expansion of short decimals with machine words
+// ----------------------------------------------------------------------------
+//   A decimal with up to 5 kigits is exactly a / b, with b a power of 10
+//   that fits in 64 bits, so the expansion is Euclid's algorithm on a and b.
+//   The stopping rules are those of decimal::to_fraction(): stop when the
+//   remainder r / b is zero, or when its exponent is below -decimals,
+//   which is the case when r * 10^(decimals+1) < b.
+{
+    // Check that we can compute the exact value in machine words
+    large k = 3 * large(shape.nkigits) - shape.exponent;
+    if (shape.nkigits > 5 || k <= 0 || k > 18)
+        return false;
+    ularge a = 0;
+    for (size_t i = 0; i < shape.nkigits; i++)
+    {
+        decimal::kint kig = decimal::kigit(shape.base, i);
+        if (kig >= 1000)
+            return false;
+        a = a * 1000 + kig;
+    }
+    ularge b = 1;
+    for (large i = 0; i < k; i++)
+        b *= 10;
+
+    // Threshold for the remainder, zero if 10^(decimals+1) exceeds b
+    ularge limit = b - 1;
+    for (uint i = 0; i <= decimals && limit; i++)
+        limit /= 10;
+
+    ularge r = a % b;
+    n1 = a / b;
+    d1 = 1;
+    n2 = 1;
+    d2 = 0;
+    while (count--)
+    {
+        if (r == 0 || r <= limit)
+            break;
+        ularge i = b / r;
+        ularge t = n1;
+        n1 = i * n1 + n2;
+        n2 = t;
+        t = d1;
+        d1 = i * d1 + d2;
+        d2 = t;
+        t = r;
+        r = b % r;
+        b = t;
+    }
+    return true;
+}
+
+
 algebraic_p decimal::to_fraction(uint count, uint decimals) const
 // ----------------------------------------------------------------------------
 //   Convert a decimal value to a fraction
@@ -1322,6 +1397,42 @@ algebraic_p decimal::to_fraction(uint count, uint decimals) const
     if (fp->is_zero())
         return ip->to_integer();
 
+    uint maxdec = Settings.Precision() - 3;
+    if (decimals > maxdec)
+        decimals = maxdec;
+
+    // Fast path for short decimals. The early exit of the loop below when
+    // the convergent rounds to the input can only happen before the final
+    // convergent if the previous one already does, so check that one.
+    ularge wn1, wd1, wn2, wd2;
+    if (to_fraction_words(num->shape(), count, decimals, wn1, wd1, wn2, wd2))
+    {
+        bool usable = wd2 == 0;
+        if (!usable)
+        {
+            fraction_g prev = fraction::make(integer::make(wn2),
+                                             integer::make(wd2));
+            decimal_g  pval = prev ? decimal::from_fraction(prev) : nullptr;
+            if (neg && pval)
+                pval = decimal::neg(pval);
+            decimal_g  err  = pval ? num - pval : nullptr;
+            if (!err)
+                return nullptr;
+            usable = !err->is_zero();
+        }
+        if (usable)
+        {
+            n1 = bignum::make(wn1);
+            d1 = bignum::make(wd1);
+            algebraic_g result = d1->is_one()
+                ? algebraic_p(+n1)
+                : algebraic_p(+big_fraction::make(n1, d1));
+            if (neg && result)
+                result = -result;
+            return +result;
+        }
+    }
+
     if (neg)
     {
         ip = decimal::neg(ip);
@@ -1333,10 +1444,6 @@ algebraic_p decimal::to_fraction(uint count, uint decimals) const
     n2 = d1;
     d2 = bignum::make(0);
 
-    uint maxdec = Settings.Precision() - 3;
-    if (decimals > maxdec)
-        decimals = maxdec;
-
     while (count--)
     {
         // Check if the decimal part is small enough
@@ -1381,11 +1488,369 @@ algebraic_p decimal::to_fraction(uint count, uint decimals) const
 }
 
 
+// ============================================================================
+//
+//   Conversions to and from hardware floating-point
+//
+// ============================================================================
+//
+//   A decimal value is M * 10^p, where M holds up to 18 digits from the
+//   kigits, and a binary value is m * 2^e. Since 10^p = 5^p * 2^p, one can
+//   be computed from the other exactly with a 128-bit product or quotient
+//   by 5^p, as long as 5^p fits in 64 bits. This gives correctly rounded
+//   results without rendering or parsing any text. When kigits are left
+//   over, the result is only used if M and M + 1 round to the same binary
+//   value. Values outside of the exact range go through text as before.
+
+static const uint binary_max_pow5 = 27;         // 5^27 < 2^63
+
+
+static ularge binary_pow5(uint q)
+// ----------------------------------------------------------------------------
+//   Return 5^q for q <= binary_max_pow5
+// ----------------------------------------------------------------------------
+{
+    ularge r = 1;
+    while (q--)
+        r *= 5;
+    return r;
+}
+
+
+static uint binary_bits(ularge hi, ularge lo)
+// ----------------------------------------------------------------------------
+//   Number of significant bits in a 128-bit value
+// ----------------------------------------------------------------------------
+{
+    if (hi)
+        return 128 - __builtin_clzll(hi);
+    if (lo)
+        return 64 - __builtin_clzll(lo);
+    return 0;
+}
+
+
+static void binary_shift(ularge &hi, ularge &lo, int shift)
+// ----------------------------------------------------------------------------
+//   Shift a 128-bit value left (shift > 0) or right (shift < 0)
+// ----------------------------------------------------------------------------
+{
+    if (shift >= 128 || shift <= -128)
+    {
+        hi = lo = 0;
+    }
+    else if (shift >= 64)
+    {
+        hi = lo << (shift - 64);
+        lo = 0;
+    }
+    else if (shift > 0)
+    {
+        hi = (hi << shift) | (lo >> (64 - shift));
+        lo <<= shift;
+    }
+    else if (shift <= -64)
+    {
+        lo = hi >> (-shift - 64);
+        hi = 0;
+    }
+    else if (shift < 0)
+    {
+        lo = (lo >> -shift) | (hi << (64 + shift));
+        hi >>= -shift;
+    }
+}
+
+
+static bool binary_below(ularge hi, ularge lo, uint bits)
+// ----------------------------------------------------------------------------
+//   Check if any of the low bits of a 128-bit value is set
+// ----------------------------------------------------------------------------
+{
+    if (bits >= 128)
+        return hi || lo;
+    if (bits >= 64)
+        return lo || (bits > 64 && (hi << (128 - bits)));
+    return bits && (lo << (64 - bits));
+}
+
+
+static ularge binary_divide(ularge hi, ularge lo, ularge d, ularge &rem)
+// ----------------------------------------------------------------------------
+//   Divide a 128-bit value by d, where hi < d so that the quotient fits
+// ----------------------------------------------------------------------------
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 n = ((unsigned __int128) hi << 64) | lo;
+    rem = ularge(n % d);
+    return ularge(n / d);
+#else // !__SIZEOF_INT128__
+    ularge q = 0;
+    for (uint i = 0; i < 64; i++)
+    {
+        bool top = hi >> 63;
+        hi = (hi << 1) | (lo >> 63);
+        lo <<= 1;
+        q <<= 1;
+        if (top || hi >= d)
+        {
+            hi -= d;
+            q |= 1;
+        }
+    }
+    rem = hi;
+    return q;
+#endif // __SIZEOF_INT128__
+}
+
+
+static bool binary_round(ularge hi, ularge lo, bool sticky, uint bits,
+                         ularge &mant, int &exp)
+// ----------------------------------------------------------------------------
+//   Round a 128-bit value to the given number of bits, to nearest even
+// ----------------------------------------------------------------------------
+//   Sticky indicates that the actual value is a little above hi:lo
+{
+    uint size = binary_bits(hi, lo);
+    if (size <= bits)
+    {
+        // Exact, unless we were told there was something below
+        mant = lo;
+        exp  = 0;
+        return !sticky;
+    }
+    uint   shift = size - bits;
+    ularge h     = hi;
+    ularge l     = lo;
+    binary_shift(h, l, -int(shift));
+    mant = l;
+    ularge hh = hi;
+    ularge hl = lo;
+    binary_shift(hh, hl, 1 - int(shift));
+    bool half  = hl & 1;
+    bool below = sticky || binary_below(hi, lo, shift - 1);
+    if (half && (below || (mant & 1)))
+    {
+        mant++;
+        if (mant >> bits)
+        {
+            mant >>= 1;
+            shift++;
+        }
+    }
+    exp = shift;
+    return true;
+}
+
+
+static bool binary_from_decimal(ularge m, large p, bool sticky, uint bits,
+                                ularge &mant, int &exp)
+// ----------------------------------------------------------------------------
+//   Correctly rounded binary value of m * 10^p
+// ----------------------------------------------------------------------------
+{
+    if (p >= 0)
+    {
+        if (p > large(binary_max_pow5))
+            return false;
+        ularge hi = 0;
+        ularge lo = mul_wide(m, binary_pow5(p), hi);
+        if (!binary_round(hi, lo, sticky, bits, mant, exp))
+            return false;
+        exp += p;
+        return true;
+    }
+
+    // Divide m * 2^t by 5^q with t chosen so that the quotient has 64 bits
+    uint q = -p;
+    if (q > binary_max_pow5)
+        return false;
+    ularge d  = binary_pow5(q);
+    int    t  = 63 + binary_bits(0, d) - binary_bits(0, m);
+    ularge hi = 0;
+    ularge lo = m;
+    binary_shift(hi, lo, t);
+    ularge rem = 0;
+    ularge quo = binary_divide(hi, lo, d, rem);
+    if (!binary_round(0, quo, sticky || rem, bits, mant, exp))
+        return false;
+    exp -= t + int(q);
+    return true;
+}
+
+
+bool decimal::to_binary(uint bits, double &result) const
+// ----------------------------------------------------------------------------
+//   Direct conversion to a binary value with the given mantissa size
+// ----------------------------------------------------------------------------
+{
+    info s = shape();
+    if (s.exponent > large(Settings.MaximumDecimalExponent()))
+        return false;
+    bool negative = type() == ID_neg_decimal;
+    if (!s.nkigits)
+    {
+        result = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    // Accumulate up to 18 digits, remember if anything non-zero is left
+    ularge m    = 0;
+    size_t used = 0;
+    for (; used < s.nkigits && used < 6; used++)
+    {
+        kint k = kigit(s.base, used);
+        if (k >= 1000)
+            return false;
+        m = m * 1000 + k;
+    }
+    bool sticky = false;
+    for (size_t i = used; i < s.nkigits && !sticky; i++)
+    {
+        kint k = kigit(s.base, i);
+        if (k >= 1000)
+            return false;
+        sticky = k != 0;
+    }
+    large p = s.exponent - 3 * large(used);
+    if (!sticky)
+    {
+        while (p < 0 && m % 10 == 0)
+        {
+            m /= 10;
+            p++;
+        }
+    }
+    while (p > 0 && m < 100000000000000000ULL)
+    {
+        m *= 10;
+        p--;
+    }
+
+    ularge mant = 0;
+    int    exp  = 0;
+    if (!binary_from_decimal(m, p, sticky, bits, mant, exp))
+        return false;
+    if (sticky)
+    {
+        // The value is between m and m + 1, which must round the same way
+        ularge mant1 = 0;
+        int    exp1  = 0;
+        if (!binary_from_decimal(m + 1, p, false, bits, mant1, exp1) ||
+            mant1 != mant || exp1 != exp)
+            return false;
+    }
+    result = std::ldexp(double(mant), exp);
+    if (negative)
+        result = -result;
+    return true;
+}
+
+
+static bool binary_to_digits(ularge m, int e, large q, ularge &digits)
+// ----------------------------------------------------------------------------
+//   Compute m * 2^e / 10^q rounded to nearest even
+// ----------------------------------------------------------------------------
+{
+    if (q <= 0)
+    {
+        uint s = -q;
+        if (s > binary_max_pow5)
+            return false;
+        ularge hi    = 0;
+        ularge lo    = mul_wide(m, binary_pow5(s), hi);
+        int    shift = e + int(s);
+        uint   size  = binary_bits(hi, lo);
+        if (shift >= 0)
+        {
+            if (size + shift > 64)
+                return false;
+            digits = lo << shift;
+            return true;
+        }
+        uint   drop = -shift;
+        if (size > drop + 64)
+            return false;
+        ularge h = hi;
+        ularge l = lo;
+        binary_shift(h, l, shift);
+        digits = l;
+        ularge hh = hi;
+        ularge hl = lo;
+        binary_shift(hh, hl, shift + 1);
+        bool half  = hl & 1;
+        bool below = binary_below(hi, lo, drop - 1);
+        if (half && (below || (digits & 1)))
+            digits++;
+        return true;
+    }
+
+    if (q > large(binary_max_pow5))
+        return false;
+    ularge d     = binary_pow5(q);
+    int    shift = e - int(q);
+    if (shift < 0 || binary_bits(0, m) + shift > 127)
+        return false;
+    ularge hi = 0;
+    ularge lo = m;
+    binary_shift(hi, lo, shift);
+    if (hi >= d)
+        return false;
+    ularge rem = 0;
+    digits = binary_divide(hi, lo, d, rem);
+    if (2 * rem > d || (2 * rem == d && (digits & 1)))
+        digits++;
+    return true;
+}
+
+
+static bool binary_to_decimal(double x, ularge &digits, large &exp)
+// ----------------------------------------------------------------------------
+//   Compute exactly the 18 significant digits of a binary value
+// ----------------------------------------------------------------------------
+{
+    const ularge low  = 100000000000000000ULL;
+    const ularge high = 10 * low;
+    int          e2   = 0;
+    double       f    = std::frexp(std::fabs(x), &e2);
+    ularge       m    = ularge(std::ldexp(f, 53));
+    int          e    = e2 - 53;
+    if (!m)
+    {
+        digits = 0;
+        exp = 0;
+        return true;
+    }
+
+    // Estimate the decimal exponent, then correct it if necessary
+    large q = large(std::floor((e2 - 1) * 0.30102999566398120)) - 17;
+    for (uint tries = 0; tries < 3; tries++)
+    {
+        if (!binary_to_digits(m, e, q, digits))
+            return false;
+        if (digits >= high)
+            q++;
+        else if (digits < low)
+            q--;
+        else
+            break;
+    }
+    if (digits < low || digits >= high)
+        return false;
+    exp = q;
+    return true;
+}
+
+
 float decimal::to_float() const
 // ----------------------------------------------------------------------------
 //   Convert decimal value to float
 // ----------------------------------------------------------------------------
 {
+    double direct = 0;
+    if (to_binary(24, direct))
+        return float(direct);
+
     settings::SaveFancyExponent   saveFancyExponent(false);
     settings::SaveDecimalComma    saveDecimalComma(false);
     settings::SaveMantissaSpacing saveMantissaSpacing(0);
@@ -1405,6 +1870,10 @@ double decimal::to_double() const
 //   Convert decimal value to double
 // ----------------------------------------------------------------------------
 {
+    double direct = 0;
+    if (to_binary(53, direct))
+        return direct;
+
     settings::SaveFancyExponent   saveFancyExponent(false);
     settings::SaveDecimalComma    saveDecimalComma(false);
     settings::SaveMantissaSpacing saveMantissaSpacing(0);
@@ -1426,6 +1895,14 @@ decimal_p decimal::from(double x)
 {
     if (std::isfinite(x))
     {
+        ularge digits = 0;
+        large  exp    = 0;
+        if (binary_to_decimal(x, digits, exp))
+        {
+            id type = digits && std::signbit(x) ? ID_neg_decimal : ID_decimal;
+            return rt.make<decimal>(type, digits, exp);
+        }
+
         renderer r;
         r.printf("%.18g", x);
         parser p(r.text(), r.size());
@@ -1443,32 +1920,12 @@ decimal_p decimal::from(double x)
 }
 
 
-int decimal::compare(decimal_r x, decimal_r y, uint epsilon)
+static int compare_kigits(decimal::info xi, decimal::info yi, uint epsilon)
 // ----------------------------------------------------------------------------
-//   Return -1, 0 or 1 for comparison
+//   Compare magnitudes in place, return negative, zero or positive
 // ----------------------------------------------------------------------------
 //   epsilon indicates how many digits we are considering
 {
-    // Quick exit if identical pointers
-    if (+x == +y)
-        return 0;
-
-    // Check if input is nullptr - If so, nullptr is smaller than value
-    if (!x || !y)
-        return !!x - !!y;
-
-    id   xty = x->type();
-    id   yty = y->type();
-
-    // Check negative vs. positive
-    if (xty != yty)
-        return (xty == ID_decimal) - (yty == ID_decimal);
-
-    // Read information from both numbers
-    int  sign = xty == ID_neg_decimal ? -1 : 1;
-    info xi   = x->shape();
-    info yi   = y->shape();
-
     // Check special case of zero
     size_t xs = xi.nkigits;
     size_t ys = yi.nkigits;
@@ -1477,7 +1934,7 @@ int decimal::compare(decimal_r x, decimal_r y, uint epsilon)
     large xe   = xs ? xi.exponent : std::numeric_limits<large>::min();
     large ye   = ys ? yi.exponent : std::numeric_limits<large>::min();
     if (xe != ye)
-        return sign * (xe > ye ? 1 : -1);
+        return xe > ye ? 1 : -1;
 
     // If same exponent, compare mantissa digits starting with highest one
     byte_p xb = xi.base;
@@ -1494,27 +1951,27 @@ int decimal::compare(decimal_r x, decimal_r y, uint epsilon)
         size_t e = (epsilon + 2) / 3;
         for (size_t i = 0; i < e; i++)
         {
-            uint xk = i < xs ? kigit(xb, i) : 0;
-            uint yk = i < ys ? kigit(yb, i) : 0;
+            uint xk = i < xs ? decimal::kigit(xb, i) : 0;
+            uint yk = i < ys ? decimal::kigit(yb, i) : 0;
             if (i+1 == l)
             {
                 xk /= d;
                 yk /= d;
             }
             if (int diff = xk - yk)
-                return sign * diff;
+                return diff;
         }
     }
     else
     {
         size_t s  = std::min(xs, ys);
         for (size_t i = 0; i < s; i++)
-            if (int diff = kigit(xb, i) - kigit(yb, i))
-                return sign * diff;
+            if (int diff = decimal::kigit(xb, i) - decimal::kigit(yb, i))
+                return diff;
 
         // If all kigits were the same, longest number is larger
         if (xs != ys)
-            return sign * int(xs - ys);
+            return int(xs - ys);
     }
 
     // Otherwise, numbers are identical
@@ -1522,6 +1979,68 @@ int decimal::compare(decimal_r x, decimal_r y, uint epsilon)
 }
 
 
+int decimal::compare(decimal_r x, decimal_r y, uint epsilon)
+// ----------------------------------------------------------------------------
+//   Return -1, 0 or 1 for comparison
+// ----------------------------------------------------------------------------
+{
+    // Quick exit if identical pointers
+    if (+x == +y)
+        return 0;
+
+    // Check if input is nullptr - If so, nullptr is smaller than value
+    if (!x || !y)
+        return !!x - !!y;
+
+    return compare_in_place(+x, +y, epsilon);
+}
+
+
+int decimal::compare_in_place(decimal_p x, decimal_p y, uint epsilon)
+// ----------------------------------------------------------------------------
+//   Compare without allocating or checking for nullptr, for sorts and solver
+// ----------------------------------------------------------------------------
+{
+    info xi   = x->shape();
+    info yi   = y->shape();
+
+    // Check negative vs. positive, negative zero compares equal to zero
+    bool xneg = x->type() == ID_neg_decimal && xi.nkigits;
+    bool yneg = y->type() == ID_neg_decimal && yi.nkigits;
+    if (xneg != yneg)
+        return int(yneg) - int(xneg);
+
+    int cmp = compare_kigits(xi, yi, epsilon);
+    return xneg ? -cmp : cmp;
+}
+
+
+int decimal::compare_magnitude(decimal_r x, decimal_r y, uint epsilon)
+// ----------------------------------------------------------------------------
+//   Compare absolute values in place
+// ----------------------------------------------------------------------------
+{
+    if (!x || !y)
+        return !!x - !!y;
+    return compare_kigits(x->shape(), y->shape(), epsilon);
+}
+
+
+int decimal::compare_integer(decimal_r x, id ity, ularge value)
+// ----------------------------------------------------------------------------
+//   Compare with an integer value, building its decimal form on the C stack
+// ----------------------------------------------------------------------------
+{
+    if (!x)
+        return -1;
+    id ty = ity == ID_neg_integer ? ID_neg_decimal : ID_decimal;
+    alignas(decimal) byte buffer[2 * sizeof(ularge) + 16];
+    ASSERT(required_memory(ty, value) <= sizeof(buffer));
+    decimal_p y = new((decimal *) buffer) decimal(ty, value);
+    return compare_in_place(+x, y, 0);
+}
+
+
 
 // ============================================================================
 //
@@ -1575,12 +2094,12 @@ arithmetic_fn target(algebraic_r x, algebraic_r y)
 // ----------------------------------------------------------------------------
 {
     return x->is_decimal() && y->is_decimal() &&
-        (!Settings.HardwareFloatingPoint() || Settings.Precision() > 16)
+        (!Settings.HardwareFloatingPointEnabled() || Settings.Precision() > 16)
         ? decimal_wrapper<code> : nullptr;
 }
 
 
-decimal_p decimal::add(decimal_r x, decimal_r y)
+HOT decimal_p decimal::add(decimal_r x, decimal_r y)
 // ----------------------------------------------------------------------------
 //   Addition of two numbers with the same sign
 // ----------------------------------------------------------------------------
@@ -1695,7 +2214,7 @@ decimal_p decimal::add(decimal_r x, decimal_r y)
 }
 
 
-decimal_p decimal::subtract(decimal_r x, decimal_r y)
+HOT decimal_p decimal::subtract(decimal_r x, decimal_r y)
 // ----------------------------------------------------------------------------
 //   Subtraction of two numbers with the same sign
 // ----------------------------------------------------------------------------
@@ -1798,7 +2317,7 @@ decimal_p decimal::subtract(decimal_r x, decimal_r y)
 }
 
 
-decimal_p decimal::multiply(decimal_r x, decimal_r y)
+HOT decimal_p decimal::multiply(decimal_r x, decimal_r y)
 // ----------------------------------------------------------------------------
 //   Multiplication of two decimal numbers
 // ----------------------------------------------------------------------------
@@ -1829,38 +2348,43 @@ decimal_p decimal::multiply(decimal_r x, decimal_r y)
     size_t   ps  = (Settings.Precision() + 2) / 3;
     size_t   rs  = std::min(ps, xs + ys + 1);
 
-    // Allocate the mantissa
+    // Allocate the mantissa, unpacked inputs and column sums
+    // Column sums fit in 32 bits: 3334 products of at most 999*999
     scribble scr;
-    kint    *rb = (kint *) rt.allocate(rs * sizeof(kint));
-    if (!rb)
+    size_t   cs = rs * sizeof(uint32_t) + sizeof(uint32_t) - 1;
+    byte    *sb = rt.allocate((rs + xs + ys) * sizeof(kint) + cs);
+    if (!sb)
         return nullptr;
+    kint     *rb  = (kint *) sb;
+    kint     *xp  = rb + rs;
+    kint     *yp  = xp + xs;
+    uintptr_t ca  = uintptr_t(yp + ys) + sizeof(uint32_t) - 1;
+    uint32_t *col = (uint32_t *) (ca & ~uintptr_t(sizeof(uint32_t) - 1));
+
+    // Read the kigits from both inputs once
+    unpack_kigits(+xb, xp, xs);
+    unpack_kigits(+yb, yp, ys);
 
-    // Zero the result before doing sums on it
+    // Sum products in each column, ignoring carries
     for (size_t ri = 0; ri < rs; ri++)
-        rb[ri] = 0;
+        col[ri] = 0;
+    for (size_t xi = 0; xi < xs && xi < rs; xi++)
+    {
+        uint   xk  = xp[xi];
+        size_t yn  = std::min(ys, rs - xi);
+        uint32_t *cp = col + xi;
+        if (xk)
+            for (size_t yi = 0; yi < yn; yi++)
+                cp[yi] += xk * yp[yi];
+    }
 
-    // Sum on all digits
+    // Propagate carries once, from least to most significant kigit
     uint carry = 0;
-    for (size_t xi = 0; xi < xs; xi++)
+    for (size_t ri = rs; ri --> 0; )
     {
-        kint xk = kigit(xb, xi);
-        for (size_t yi = 0; yi < ys; yi++)
-        {
-            size_t ri = xi + yi;
-            if (ri >= rs)
-                break;
-            kint yk = kigit(yb, yi);
-            uint rk = xk * yk;
-            while (rk)
-            {
-                rk += rb[ri];
-                rb[ri] = rk % 1000;
-                rk /= 1000;
-                if (ri-- == 0)
-                    break;
-            }
-            carry += rk;
-        }
+        uint32_t rk = col[ri] + carry;
+        rb[ri] = rk % 1000;
+        carry = rk / 1000;
     }
 
     // Check if a carry remains above top
@@ -1916,7 +2440,7 @@ decimal_p decimal::multiply(decimal_r x, decimal_r y)
 }
 
 
-decimal_p decimal::divide(decimal_r x, decimal_r y)
+HOT decimal_p decimal::divide(decimal_r x, decimal_r y)
 // ----------------------------------------------------------------------------
 //   Division of two decimal numbers
 // ----------------------------------------------------------------------------
@@ -1971,10 +2495,8 @@ decimal_p decimal::divide(decimal_r x, decimal_r y)
     kint    *qp = rp + rs;
     kint    *xp = qp + qs;
     kint    *yp = xp + xs;
-    for (size_t xi = 0; xi < xs; xi++)
-        xp[xi] = kigit(+xb, xi);
-    for (size_t yi = 0; yi < ys; yi++)
-        yp[yi] = kigit(+yb, yi);
+    unpack_kigits(+xb, xp, xs);
+    unpack_kigits(+yb, yp, ys);
 
     // Initialize remainder and quotient with 0
     size_t rqs = rs + qs;
@@ -2216,11 +2738,39 @@ decimal_p decimal::sqrt(decimal_r x)
 
     large     exponent = x->exponent();
     decimal_g half     = make(5, -1);
-    decimal_g next     = make(5, (-exponent - 1) / 2);
-    decimal_g current  = x * next;
+    decimal_g next;
+    decimal_g current;
+    uint      digits   = 0;
+    if (exponent > -300 && exponent < 300)
+    {
+        // Start from the hardware square root, about 15 correct digits
+        current = from(std::sqrt(x->to_double()));
+        digits  = 15;
+    }
+    if (!current)
+    {
+        digits  = 0;
+        next    = make(5, (-exponent - 1) / 2);
+        current = x * next;
+    }
     if (current && !current->is_zero())
     {
         precision_adjust prec;
+
+        // Each Newton step doubles the correct digits, so only the last
+        // steps need to be computed at full precision
+        uint target = Settings.Precision();
+        while (digits && 2 * digits < target)
+        {
+            digits *= 2;
+            Settings.Precision((digits + 5) / 3 * 3);
+            next = (current + x / current) * half;
+            if (!next)
+                break;
+            current = next;
+        }
+        Settings.Precision(target);
+
         for (uint i = 0; i < 2 * prec; i++)
         {
             next = (current + x / current) * half;
@@ -2241,11 +2791,38 @@ decimal_p decimal::cbrt(decimal_r x)
 {
     large     exponent = x->exponent();
     decimal_g third    = inv(make(3));
-    decimal_g next     = make(1, -2 * exponent / 3);
-    decimal_g current  = x * next;
+    decimal_g next;
+    decimal_g current;
+    uint      digits   = 0;
+    if (exponent > -300 && exponent < 300)
+    {
+        // Start from the hardware cube root, about 15 correct digits
+        current = from(std::cbrt(x->to_double()));
+        digits  = 15;
+    }
+    if (!current)
+    {
+        digits  = 0;
+        next    = make(1, -2 * exponent / 3);
+        current = x * next;
+    }
     if (current && !current->is_zero())
     {
         precision_adjust prec;
+
+        // As for sqrt, only the last Newton steps need full precision
+        uint target = Settings.Precision();
+        while (digits && 2 * digits < target)
+        {
+            digits *= 2;
+            Settings.Precision((digits + 5) / 3 * 3);
+            next = ((current + current) + x / (current * current)) * third;
+            if (!next)
+                break;
+            current = next;
+        }
+        Settings.Precision(target);
+
         for (uint i = 0; i < 2 * prec; i++)
         {
             next = ((current + current) + x / (current * current)) * third;
@@ -2716,12 +3293,16 @@ decimal_p decimal::ln1p(decimal_r x)
     record(decimal, "Taylor series with %t exp=%ld eexp=%ld ipart=%ld",
            +scaled, texp, eexp, ipart);
 
-    // Taylor's serie
-    decimal_g sum = scaled;
-    power = scaled;
-    for (uint i = 2; i < 3*prec; i++)
+    // Use ln(1+x) = 2 atanh(x/(2+x)), which converges much faster than the
+    // Taylor series of ln(1+x): for |x| < 1/2, we have |x/(2+x)| < 1/3
+    decimal_g two = make(2);
+    decimal_g z   = scaled / (two + scaled);
+    decimal_g z2  = z * z;
+    decimal_g sum = z;
+    power = z;
+    for (uint i = 3; i < 3*prec; i += 2)
     {
-        power = power * scaled;
+        power = power * z2;
         scale = make(i);
         scale = power / scale;
 
@@ -2731,15 +3312,13 @@ decimal_p decimal::ln1p(decimal_r x)
         // If what we add no longer has an impact, we can exit
         if (scale->exponent() + large(prec) < sum->exponent())
         {
-            record(decimal, "Taylor exits at %u exp=%ld", i, scale->exponent());
+            record(decimal, "Series exits at %u exp=%ld", i, scale->exponent());
             break;
         }
 
-        if (i & 1)
-            sum = sum + scale;
-        else
-            sum = sum - scale;
+        sum = sum + scale;
     }
+    sum = sum + sum;
     record(decimal, "Power at exit %t exponent %ld", +power, power->exponent());
     record(decimal, "Sum   at exit %t exponent %ld", +sum, sum->exponent());
 
@@ -2765,31 +3344,50 @@ decimal_p decimal::expm1(decimal_r x)
     if (!x->split(ip, fp))
         return nullptr;
 
-    // Prepare power factor and square that we multiply by every time
-    decimal_g one =  make(1);
+    decimal_g one = make(1);
     decimal_g sum = fp;
-    decimal_g fact = one;
-    decimal_g power = fp;
+    decimal_g fact;
+    decimal_g power;
     decimal_g tmp;
 
     precision_adjust prec;
-    for (uint i = 2; i < prec; i++)
+    if (!fp->is_zero())
     {
-        power = power * fp;
-        tmp = make(i);
-        fact = fact * tmp;
+        // Divide the argument by 2^k so that the series converges faster,
+        // then use expm1(2y) = expm1(y) * (expm1(y) + 2) k times.
+        // Each of these steps can double the relative error, so add digits
+        uint k = 0;
+        while (k * k < prec && k < 40)
+            k++;
+        precision_adjust guard(k * 3 / 10 + 1, true);
+
+        tmp = make(1ULL << k);
+        decimal_g r = fp / tmp;
+        sum   = r;
+        power = r;
+        for (uint i = 2; i < prec; i++)
+        {
+            tmp   = make(i);
+            power = power * r;
+            power = power / tmp;        // r^i / i!
 
-        tmp = power / fact;     // x^2 / 2!
+            // Check if we ran out of memory
+            if (!sum || !power)
+                return nullptr;
 
-        // Check if we ran out of memory
-        if (!sum || !tmp)
-            return nullptr;
+            // If what we add no longer has an impact, we can exit
+            if (power->exponent() + large(Settings.Precision()) <
+                sum->exponent())
+                break;
 
-        // If what we add no longer has an impact, we can exit
-        if (tmp->exponent() + large(prec) < sum->exponent())
-            break;
+            sum = sum + power;
+        }
 
-        sum = sum + tmp;
+        tmp = make(2);
+        for (uint i = 0; i < k && sum; i++)
+            sum = sum * (sum + tmp);
+        if (!sum)
+            return nullptr;
     }
 
     if (ip)
@@ -3464,30 +4062,57 @@ decimal::ccache &decimal::constants()
         size_t nkigs   = (precision + 2) / 3;
         cst->pi        = rt.make<decimal>(1, nkigs, gcbytes(decimal_pi));
         cst->e         = rt.make<decimal>(1, nkigs, gcbytes(decimal_e));
-        cst->log10     = nullptr;
-        cst->log2      = nullptr;
-        cst->sq2pi     = nullptr;
-        cst->oosqpi    = nullptr;
-        cst->lpi       = nullptr;
-        cst->precision = precision;
+        cst->log10.value  = nullptr;
+        cst->log2.value   = nullptr;
+        cst->sq2pi.value  = nullptr;
+        cst->oosqpi.value = nullptr;
+        cst->lpi.value    = nullptr;
+        cst->precision    = precision;
         cleaner::disable();
     }
     return *cst;
 }
 
 
+bool decimal::ccache::computed::reuse(size_t precision)
+// ----------------------------------------------------------------------------
+//   Round a more precise value computed earlier instead of recomputing it
+// ----------------------------------------------------------------------------
+{
+    if (!best || digits < precision)
+        return false;
+    record(decimal, "Rounding constant from %u to %u digits", digits, precision);
+    value = digits == precision ? +best : best->precision(precision);
+    return value.Safe() != nullptr;
+}
+
+
+void decimal::ccache::computed::update(decimal_p v, size_t precision)
+// ----------------------------------------------------------------------------
+//   Record a newly computed value
+// ----------------------------------------------------------------------------
+{
+    value = v;
+    if (v && precision > digits)
+    {
+        best   = v;
+        digits = precision;
+    }
+    cleaner::disable();
+}
+
+
 decimal_r decimal::ccache::ln10()
 // ----------------------------------------------------------------------------
 //   Compute and cache the natural logarithm of 10
 // ----------------------------------------------------------------------------
 {
-    if (!log10)
+    if (!log10.value && !log10.reuse(precision))
     {
         decimal_g ten = make(10);
-        log10 = ln(ten);
-        cleaner::disable();
+        log10.update(ln(ten), precision);
     }
-    return log10;
+    return log10.value;
 }
 
 
@@ -3496,13 +4121,12 @@ decimal_r decimal::ccache::ln2()
 //   Compute and cache the natural logarithm of 2
 // ----------------------------------------------------------------------------
 {
-    if (!log2)
+    if (!log2.value && !log2.reuse(precision))
     {
         decimal_g two = make(2);
-        log2 = ln(two);
-        cleaner::disable();
+        log2.update(ln(two), precision);
     }
-    return log2;
+    return log2.value;
 }
 
 
@@ -3511,12 +4135,9 @@ decimal_r decimal::ccache::lnpi()
 //   Compute and cache the natural logarithm of pi
 // ----------------------------------------------------------------------------
 {
-    if (!lpi)
-    {
-        lpi = ln(pi);
-        cleaner::disable();
-    }
-    return lpi;
+    if (!lpi.value && !lpi.reuse(precision))
+        lpi.update(ln(pi), precision);
+    return lpi.value;
 }
 
 
@@ -3525,12 +4146,9 @@ decimal_r decimal::ccache::sqrt_2pi()
 //   Compute and cache sqrt(pi)
 // ----------------------------------------------------------------------------
 {
-    if (!sq2pi)
-    {
-        sq2pi = sqrt(pi + pi);
-        cleaner::disable();
-    }
-    return sq2pi;
+    if (!sq2pi.value && !sq2pi.reuse(precision))
+        sq2pi.update(sqrt(pi + pi), precision);
+    return sq2pi.value;
 }
 
 
@@ -3539,14 +4157,13 @@ decimal_r decimal::ccache::one_over_sqrt_pi()
 //   Compute and cache 1/sqrt(pi)
 // ----------------------------------------------------------------------------
 {
-    if (!oosqpi)
+    if (!oosqpi.value && !oosqpi.reuse(precision))
     {
         decimal_g one = make(1);
         decimal_g sqpi = sqrt(pi);
-        oosqpi = one / sqpi;
-        cleaner::disable();
+        oosqpi.update(one / sqpi, precision);
     }
-    return oosqpi;
+    return oosqpi.value;
 }
 
 
@@ -114,11 +114,7 @@ struct decimal : algebraic
         byte *p = (byte *) payload(this);
         p = leb128(p, exp);
         p = leb128(p, nkigs);
-        const kint *kigsp = kigs.Safe();
-        if (nkigs)
-            p[(nkigs * 10 + 7) / 8 - 1] = 0;
-        for (uint i = 0; i < nkigs; i++)
-            kigit(p, i, kigsp[i]);
+        pack_kigits(p, kigs.Safe(), nkigs);
     }
     static size_t required_memory(id type, large exp, size_t n, gcp<kint>)
     {
@@ -214,7 +210,7 @@ struct decimal : algebraic
 
     static decimal_p from_integer(integer_p value);
     static decimal_p from_bignum(bignum_p value);
-    static decimal_p from_random_seed(bignum_p value);
+    static decimal_p from_random_seed(const ularge *words, size_t count);
     static decimal_p from_fraction(fraction_p value);
     static decimal_p from_big_fraction(big_fraction_p value);
     // ------------------------------------------------------------------------
@@ -301,6 +297,55 @@ struct decimal : algebraic
     }
 
 
+    static void unpack_kigits(byte_p base, kint *kigs, size_t count)
+    // ------------------------------------------------------------------------
+    //    Unpack count kigits, four at a time (40 bits in 5 bytes)
+    // ------------------------------------------------------------------------
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4, base += 5)
+        {
+            uint32_t hi = ((uint32_t(base[0]) << 24) |
+                           (uint32_t(base[1]) << 16) |
+                           (uint32_t(base[2]) << 8)  |
+                           base[3]);
+            kigs[i+0] = hi >> 22;
+            kigs[i+1] = (hi >> 12) & 1023;
+            kigs[i+2] = (hi >> 2) & 1023;
+            kigs[i+3] = ((hi & 3) << 8) | base[4];
+        }
+        for (size_t k = 0; i < count; i++, k++)
+            kigs[i] = kigit(base, k);
+    }
+
+
+    static void pack_kigits(byte *base, const kint *kigs, size_t count)
+    // ------------------------------------------------------------------------
+    //    Pack count kigits, four at a time (40 bits in 5 bytes)
+    // ------------------------------------------------------------------------
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4, base += 5)
+        {
+            uint32_t hi = ((uint32_t(kigs[i+0]) << 22) |
+                           (uint32_t(kigs[i+1]) << 12) |
+                           (uint32_t(kigs[i+2]) << 2)  |
+                           (kigs[i+3] >> 8));
+            base[0] = hi >> 24;
+            base[1] = hi >> 16;
+            base[2] = hi >> 8;
+            base[3] = hi;
+            base[4] = byte(kigs[i+3]);
+        }
+        if (i < count)
+        {
+            base[((count - i) * 10 + 7) / 8 - 1] = 0;
+            for (size_t k = 0; i < count; i++, k++)
+                kigit(base, k, kigs[i]);
+        }
+    }
+
+
     kint kigit(size_t index) const
     // ------------------------------------------------------------------------
     //   Return the given kigit for the current number
@@ -432,8 +477,12 @@ struct decimal : algebraic
     // ------------------------------------------------------------------------
 
     static int       compare(decimal_r x, decimal_r y, uint epsilon = 0);
+    static int       compare_in_place(decimal_p x, decimal_p y, uint epsilon);
+    static int       compare_magnitude(decimal_r x, decimal_r y,
+                                       uint epsilon = 0);
+    static int       compare_integer(decimal_r x, id ity, ularge value);
     // ------------------------------------------------------------------------
-    //   Return a comparision between the two values
+    //   Return a comparision between the two values, without allocating
     // ------------------------------------------------------------------------
 
 
@@ -503,6 +552,7 @@ struct decimal : algebraic
 
     float            to_float() const;
     double           to_double() const;
+    bool             to_binary(uint bits, double &result) const;
     static decimal_p from(float x)      { return from(double(x)); }
     static decimal_p from(double x);
     // ------------------------------------------------------------------------
@@ -596,17 +646,32 @@ struct decimal : algebraic
     // ------------------------------------------------------------------------
     //  Constants are re-created whenever precision changes
     // ------------------------------------------------------------------------
+    //  Computed constants also keep the most precise value computed so far,
+    //  so that going back to a lower precision only requires rounding it
     {
         ccache(): precision(), gamma_na(0), gamma_ck(nullptr) {}
 
+        struct computed
+        // --------------------------------------------------------------------
+        //   A computed constant, tagged with the precision it was computed at
+        // --------------------------------------------------------------------
+        {
+            computed(): value(), best(), digits(0) {}
+            bool      reuse(size_t precision);
+            void      update(decimal_p v, size_t precision);
+            decimal_g value;    // Value at current precision
+            decimal_g best;     // Most precise value computed so far
+            size_t    digits;   // Precision of best
+        };
+
         size_t  precision;
         decimal_g pi;
         decimal_g e;
-        decimal_g log10;
-        decimal_g log2;
-        decimal_g sq2pi;
-        decimal_g oosqpi;
-        decimal_g lpi;
+        computed  log10;
+        computed  log2;
+        computed  sq2pi;
+        computed  oosqpi;
+        computed  lpi;
 
         size_t    gamma_na;
         decimal_g *gamma_ck;
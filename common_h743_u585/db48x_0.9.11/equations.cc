@@ -1484,6 +1484,49 @@ PARSE_BODY(equation)
 }
 
 
+#ifndef EQUATION_VALUE_CACHE
+#define EQUATION_VALUE_CACHE    8
+#endif
+
+object_p equation::value() const
+// ----------------------------------------------------------------------------
+//   Return the parsed value of an equation, keeping the last few around
+// ----------------------------------------------------------------------------
+//   Browsing the library, solving or rendering with ShowEquationBody would
+//   otherwise parse the same definition text again each time.
+{
+    static object_g values[EQUATION_VALUE_CACHE];
+    static uint     indexes[EQUATION_VALUE_CACHE];
+    static uint     next = 0;
+
+    uint idx = index();
+    for (uint i = 0; i < EQUATION_VALUE_CACHE; i++)
+    {
+        if (values[i] && indexes[i] == idx)
+        {
+            record(equations, "Cached value %t for index %u", +values[i], idx);
+            return values[i];
+        }
+    }
+
+    if (object_p obj = do_value(equations))
+    {
+        if (id ty = obj->type())
+        {
+            if (ty == ID_equation || ty == ID_expression ||
+                ty == ID_list || ty == ID_array)
+            {
+                uint slot = next++ % EQUATION_VALUE_CACHE;
+                values[slot] = obj;
+                indexes[slot] = idx;
+                return obj;
+            }
+        }
+    }
+    return nullptr;
+}
+
+
 EVAL_BODY(equation)
 // ----------------------------------------------------------------------------
 //   Equations always evaluate to their value
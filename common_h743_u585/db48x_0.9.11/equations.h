@@ -73,15 +73,7 @@ struct equation : constant
     {
         return do_name(equations, size);
     }
-    object_p value() const
-    {
-        if (object_p obj = do_value(equations))
-            if (id ty = obj->type())
-                if (ty == ID_equation || ty == ID_expression ||
-                    ty == ID_list || ty == ID_array)
-                    return obj;
-        return nullptr;
-    }
+    object_p value() const;
 
     static const config equations;
     OBJECT_DECL(equation);
@@ -58,6 +58,7 @@ object_g *expression::dependent_value               = nullptr;
 bool      expression::in_algebraic                  = false;
 bool      expression::contains_independent_variable = false;
 uint      expression::constant_index                = 0;
+uint      expression::symbolic_pass                 = 0;
 
 
 // Used to match and build user-defined function calls for deriv/integ
@@ -1268,6 +1269,49 @@ static size_t check_match(size_t eq, size_t eqsz,
 }
 
 
+static bool rewrite_candidate(expression_r eq, expression_r from)
+// ----------------------------------------------------------------------------
+//   Quick check that eq contains all the objects the pattern must match
+// ----------------------------------------------------------------------------
+//   Any object in the pattern that is not a wildcard or an integer must match
+//   an identical object at the top level of the equation, notably operators.
+//   If a type is missing from the equation, no sub-expression can match, and
+//   we can skip the expansion and the scan of all sub-expressions, which is
+//   where most of the time goes when applying large rule sets.
+//   Series of rewrites apply many rules to the same equation, so the types
+//   present in the last equation are kept in a bitmap. Global objects are
+//   not cached, since they are not guaranteed to stay at the same address.
+{
+    static expression_g last;
+    static uint32_t     present[(object::NUM_IDS + 31) / 32];
+
+    if (+last != +eq || rt.is_global(+eq))
+    {
+        memset(present, 0, sizeof(present));
+        for (object_p obj : *eq)
+        {
+            uint ty = obj->type();
+            present[ty / 32] |= 1U << (ty % 32);
+        }
+        last = rt.is_global(+eq) ? nullptr : +eq;
+    }
+
+    bool explicit_wildcards = Settings.ExplicitWildcards();
+    for (object_p obj : *from)
+    {
+        uint ty = obj->type();
+        if (ty == object::ID_integer)
+            continue;
+        if (ty == object::ID_symbol &&
+            symbol_p(obj)->starts_with("&") == explicit_wildcards)
+            continue;
+        if (~present[ty / 32] & (1U << (ty % 32)))
+            return false;
+    }
+    return true;
+}
+
+
 expression_p expression::rewrite(expression_r from,
                                  expression_r to,
                                  expression_r cond,
@@ -1284,6 +1328,13 @@ expression_p expression::rewrite(expression_r from,
     if (!from || !to || rt.error())
         return nullptr;
 
+    // Bail out early if the pattern cannot match anywhere
+    if (!rewrite_candidate(expression_g(this), from))
+    {
+        record(rewrites, "Skipping %t->%t for %t", +from, +to, this);
+        return this;
+    }
+
     // Remember the current stack depth and locals
     size_t       locals   = rt.locals();
     size_t       depth    = rt.depth();
@@ -2455,8 +2506,119 @@ grob_p expression::graph(grapher &g, uint depth, int &precedence)
 }
 
 
+// ============================================================================
+//
+//   Cache for graphical rendering of expressions
+//
+// ============================================================================
+//   Redrawing the stack or the equation being solved renders the same
+//   expressions again and again, and every render allocates a grob for each
+//   node. The last rendered expressions are remembered with the grapher
+//   parameters that influence the result, notably the font, so that retries
+//   with a smaller font skip the sizes that were already known not to fit.
+//   Expressions repeated inside a list or an array also share their grob.
+//   Layouts from measure-only passes are remembered as well. They give the
+//   size of a graph, but are never returned when pixels are needed.
+//   Failures are only remembered if they were not caused by the time limit.
+
+#ifndef EXPRESSION_GRAPH_CACHE
+// Number of expression graphs that are remembered
+#define EXPRESSION_GRAPH_CACHE  4
+#endif // EXPRESSION_GRAPH_CACHE
+
+
+struct graph_memo
+// ----------------------------------------------------------------------------
+//   Recently rendered expressions
+// ----------------------------------------------------------------------------
+{
+    graph_memo(): next(0) {}
+
+    static graph_memo &current()
+    {
+        static graph_memo memo;
+        return memo;
+    }
+
+    static uint32_t digest(expression_p eq, const grapher &g)
+    {
+        uint32_t hash = 2166136261u ^ Settings.hash();
+        byte_p   bytes = byte_p(eq);
+        size_t   size = eq->size();
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        uint32_t params[] =
+        {
+            g.maxw, g.maxh, uint32_t(g.font),
+            uint32_t(g.foreground.bits), uint32_t(g.background.bits),
+            uint32_t(g.stack | g.graph << 1)
+        };
+        for (uint32_t p : params)
+            hash = (hash ^ p) * 16777619u;
+        return hash;
+    }
+
+    bool lookup(expression_r eq, uint32_t hash, grob_p &result,
+                coord &voffset, bool measure) const
+    {
+        for (uint i = 0; i < EXPRESSION_GRAPH_CACHE; i++)
+        {
+            if (digests[i] == hash && input[i] &&
+                (measure || !output[i] || output[i]->type() != object::ID_layout) &&
+                (+input[i] == +eq || input[i]->is_same_as(+eq)))
+            {
+                result = output[i];
+                voffset = voffsets[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void remember(expression_r eq, uint32_t hash, grob_p result,
+                  coord voffset)
+    {
+        uint i = next++ % EXPRESSION_GRAPH_CACHE;
+        input[i] = rt.is_global(+eq) ? expression_p(rt.clone(+eq)) : +eq;
+        output[i] = result;
+        digests[i] = hash;
+        voffsets[i] = voffset;
+    }
+
+    expression_g input[EXPRESSION_GRAPH_CACHE];
+    grob_g       output[EXPRESSION_GRAPH_CACHE];
+    uint32_t     digests[EXPRESSION_GRAPH_CACHE];
+    coord        voffsets[EXPRESSION_GRAPH_CACHE];
+    uint         next;
+};
+
+
 GRAPH_BODY(expression)
 // ----------------------------------------------------------------------------
+//   Render an expression graphically, using the cache if possible
+// ----------------------------------------------------------------------------
+{
+    expression_g expr = o;
+    uint32_t     hash = graph_memo::digest(expr, g);
+    grob_p       known = nullptr;
+    coord        voffset = 0;
+    graph_memo  &memo = graph_memo::current();
+    if (memo.lookup(expr, hash, known, voffset, g.measure))
+    {
+        record(expression, "Graph of %t found in cache", +expr);
+        g.voffset = voffset;
+        return known;
+    }
+
+    grob_g result = graph_uncached(expr, g);
+    if (!rt.error() && (result || sys_current_ms() - g.start <= g.duration))
+        memo.remember(expr, hash, result, g.voffset);
+    return result;
+}
+
+
+grob_p expression::graph_uncached(expression_r o, grapher &g)
+// ----------------------------------------------------------------------------
 //   Render an expression graphically
 // ----------------------------------------------------------------------------
 {
@@ -2877,10 +3039,51 @@ EVAL_BODY(funcall)
 //   Function calls get evaluated immediately
 // ----------------------------------------------------------------------------
 {
+    if (Settings.MemoizeFunctions())
+        return o->run_memoized();
     return o->run(true);
 }
 
 
+object::result funcall::run_memoized() const
+// ----------------------------------------------------------------------------
+//   Evaluate the arguments, then reuse an earlier result of the function
+// ----------------------------------------------------------------------------
+{
+    funcall_g fc    = this;
+    object_p  first = objects();
+    object_p  end   = skip();
+    object_p  name  = nullptr;
+    for (object_p obj = first; obj < end; obj = obj->skip())
+        name = obj;
+    if (!name || name->type() != ID_symbol)
+        return run(true);
+
+    // Evaluate the arguments
+    object_g fn    = name;
+    size_t   depth = rt.depth();
+    size_t   calls = rt.call_depth();
+    if (!rt.run_push(first, name) || program::run_loop(calls) != OK)
+        return ERROR;
+    size_t   count = rt.depth() - depth;
+    object_g args  = count ? memo_arguments(count) : nullptr;
+    if (args)
+    {
+        if (algebraic_p value = memo_lookup(fn, args))
+            return rt.drop(count) && rt.push(value) ? OK : ERROR;
+    }
+
+    // Evaluate the function itself
+    if (fn->evaluate() != OK || program::run_loop(calls) != OK)
+        return ERROR;
+    if (args && rt.depth() == depth + 1)
+        if (object_p value = rt.top())
+            if (value->is_algebraic())
+                memo_record(fn, args, algebraic_p(value));
+    return OK;
+}
+
+
 array_p funcall::args() const
 // ----------------------------------------------------------------------------
 //   Return an array with the arguments to the funcall
@@ -3412,6 +3615,76 @@ expression_p expression::reorder_terms() const
 }
 
 
+// ============================================================================
+//
+//   Sharing simplifications during symbolic passes
+//
+// ============================================================================
+//   Expressions are flat RPN sequences, so identical sub-expressions cannot
+//   share storage. Symbolic passes like derivatives, primitives or isolating
+//   a variable still tend to simplify the same sub-expressions again and
+//   again. While such a pass runs, `symbolic_pass` holds a unique pass
+//   number, and the results of `simplify()` are remembered for that pass,
+//   keyed on the contents of the input, so that each distinct expression is
+//   only simplified once. Entries from other passes are ignored, since the
+//   independent variable and settings may differ.
+
+#ifndef SIMPLIFY_CACHE
+#define SIMPLIFY_CACHE  16
+#endif // SIMPLIFY_CACHE
+
+static uint symbolic_passes = 0;
+
+
+struct simplify_memo
+// ----------------------------------------------------------------------------
+//   Results of simplifications in the current symbolic pass
+// ----------------------------------------------------------------------------
+{
+    simplify_memo(): next(0) {}
+
+    static simplify_memo &current()
+    {
+        static simplify_memo memo;
+        return memo;
+    }
+
+    static uint32_t digest(expression_p eq)
+    {
+        uint32_t hash = 2166136261u;
+        byte_p   bytes = byte_p(eq);
+        size_t   size = eq->size();
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+
+    expression_p lookup(expression_r eq, uint32_t hash) const
+    {
+        for (uint i = 0; i < SIMPLIFY_CACHE; i++)
+            if (pass[i] == expression::symbolic_pass && digests[i] == hash &&
+                input[i] && input[i]->is_same_as(+eq))
+                return output[i];
+        return nullptr;
+    }
+
+    void remember(expression_r eq, uint32_t hash, expression_r result)
+    {
+        uint i = next++ % SIMPLIFY_CACHE;
+        input[i] = rt.is_global(+eq) ? expression_p(rt.clone(+eq)) : +eq;
+        output[i] = result;
+        digests[i] = hash;
+        pass[i] = input[i] ? expression::symbolic_pass : 0;
+    }
+
+    expression_g input[SIMPLIFY_CACHE];
+    expression_g output[SIMPLIFY_CACHE];
+    uint32_t     digests[SIMPLIFY_CACHE];
+    uint         pass[SIMPLIFY_CACHE];
+    uint         next;
+};
+
+
 expression_p expression::simplify() const
 // ----------------------------------------------------------------------------
 //   Run various rewrites to simplify equations
@@ -3421,7 +3694,20 @@ expression_p expression::simplify() const
     expression_g eq = this;
     if (!eq->is_simplifiable())
         return eq;
-    return eq->rewrites(
+
+    // Check if we already simplified this in the current symbolic pass
+    uint32_t hash = 0;
+    if (symbolic_pass)
+    {
+        hash = simplify_memo::digest(eq);
+        if (expression_p known = simplify_memo::current().lookup(eq, hash))
+        {
+            record(expression, "Simplify %t shared result %t", +eq, known);
+            return known;
+        }
+    }
+
+    expression_g result = eq->rewrites(
         // Compute constant sub-expressions
         A+B,            A+B,
         A*B,            A*B,
@@ -3520,6 +3806,10 @@ expression_p expression::simplify() const
         log10(exp10(X)),X,
         exp10(log10(X)),X
         );
+
+    if (symbolic_pass && result && !rt.error() && !program::interrupted())
+        simplify_memo::current().remember(eq, hash, result);
+    return result;
 }
 
 
@@ -3633,6 +3923,7 @@ expression_p expression::isolate(symbol_r sym) const
     save<symbol_g *> sindep(independent, (symbol_g *) &sym);
     save<object_g *> sindval(independent_value, nullptr);
     save<uint>       sconstant(constant_index, 0);
+    save<uint>       spass(symbolic_pass, ++symbolic_passes);
     expression_g eq = this;
     if (eq)
     {
@@ -3930,14 +4221,114 @@ static algebraic_p derivative_funcall_build(funcall_p src, funcall_p repl)
 }
 
 
+#ifndef SYMBOLIC_CACHE
+// Number of derivatives and primitives remembered
+#define SYMBOLIC_CACHE          8
+#endif // SYMBOLIC_CACHE
+
+struct symbolic_cache
+// ----------------------------------------------------------------------------
+//   Remember recent derivatives and primitives
+// ----------------------------------------------------------------------------
+//   Results only depend on the expression, the variable and the settings.
+//   Cached objects are temporaries referenced by GC pointers, so they move
+//   with garbage collection. Sources that are globals are cloned, since a
+//   store could overwrite them.
+{
+    struct entry
+    {
+        expression_g source;
+        symbol_g     name;
+        expression_g result;
+        object::id   kind;
+        uint         hash;
+    };
+
+    symbolic_cache(): settings(0), next(0) {}
+
+    entry entries[SYMBOLIC_CACHE];
+    uint  settings;
+    uint  next;
+
+    static symbolic_cache &current()
+    {
+        static symbolic_cache cache;
+        return cache;
+    }
+
+    static uint hash(object::id kind, expression_p eq, symbol_p name)
+    // ------------------------------------------------------------------------
+    //   Hash the kind of operation, expression and variable name
+    // ------------------------------------------------------------------------
+    {
+        uint   h = 2166136261U ^ kind;
+        byte_p p = byte_p(eq);
+        for (size_t i = 0, sz = eq->size(); i < sz; i++)
+            h = (h ^ p[i]) * 16777619U;
+        p = byte_p(name);
+        for (size_t i = 0, sz = name->size(); i < sz; i++)
+            h = (h ^ p[i]) * 16777619U;
+        return h;
+    }
+
+    static expression_p lookup(object::id kind, expression_p eq, symbol_p name)
+    // ------------------------------------------------------------------------
+    //   Return a cached result if there is one
+    // ------------------------------------------------------------------------
+    {
+        symbolic_cache &cache = current();
+        uint            set   = Settings.hash();
+        if (cache.settings != set)
+        {
+            for (entry &e : cache.entries)
+            {
+                e.source = nullptr;
+                e.name = nullptr;
+                e.result = nullptr;
+            }
+            cache.settings = set;
+            return nullptr;
+        }
+        uint h = hash(kind, eq, name);
+        for (entry &e : cache.entries)
+            if (e.result && e.hash == h && e.kind == kind &&
+                e.source->is_same_as(eq) && e.name->is_same_as(name))
+                return e.result;
+        return nullptr;
+    }
+
+    static void remember(object::id kind, expression_r eq, symbol_r name,
+                         expression_r result)
+    // ------------------------------------------------------------------------
+    //   Record a result, replacing the oldest entry
+    // ------------------------------------------------------------------------
+    {
+        symbolic_cache &cache = current();
+        entry          &e     = cache.entries[cache.next];
+        e.source = rt.is_global(eq) ? expression_p(rt.clone(eq)) : +eq;
+        e.name = rt.is_global(name) ? symbol_p(rt.clone(name)) : +name;
+        e.result = result;
+        e.kind = kind;
+        e.hash = hash(kind, eq, name);
+        if (!e.source || !e.name)
+            e.result = nullptr;
+        cache.next = (cache.next + 1) % SYMBOLIC_CACHE;
+    }
+};
+
+
 expression_p expression::derivative(symbol_r sym) const
 // ----------------------------------------------------------------------------
 //   Compute the derivative of the
 // ----------------------------------------------------------------------------
 {
+    if (expression_p cached = symbolic_cache::lookup(ID_Derivative, this, sym))
+        return cached;
+    expression_g           source = this;
     save<symbol_g *>       sindep(independent, (symbol_g *) &sym);
     save<object_g *>       sindval(independent_value, nullptr);
     save<uint>             sconstant(constant_index, 0);
+    save<uint>             spass(symbolic_pass, ++symbolic_passes);
     save<bool>             usave(unit::nodates, true);
     save<funcall_match_fn> smatch(funcall_match, derivative_funcall_match);
     save<funcall_build_fn> sbuild(funcall_build, derivative_funcall_build);
@@ -4030,6 +4421,8 @@ expression_p expression::derivative(symbol_r sym) const
         }
         if (Settings.AutoSimplify())
             result = result->simplify();
+        if (result)
+            symbolic_cache::remember(ID_Derivative, source, sym, result);
     }
     return result;
 }
@@ -4113,9 +4506,13 @@ expression_p expression::primitive(symbol_r sym) const
 //   Compute the primitive of the
 // ----------------------------------------------------------------------------
 {
+    if (expression_p cached = symbolic_cache::lookup(ID_Primitive, this, sym))
+        return cached;
+    expression_g           source = this;
     save<symbol_g *>       sindep(independent, (symbol_g *) &sym);
     save<object_g *>       sindval(independent_value, nullptr);
     save<uint>             sconstant(constant_index, 0);
+    save<uint>             spass(symbolic_pass, ++symbolic_passes);
     save<bool>             usave(unit::nodates, true);
     expression_g           eq = this;
     eq = expression::make(ID_Primitive, algebraic_g(eq), algebraic_g(sym));
@@ -4241,6 +4638,8 @@ expression_p expression::primitive(symbol_r sym) const
         }
         if (Settings.AutoSimplify())
             result = result->simplify();
+        if (result)
+            symbolic_cache::remember(ID_Primitive, source, sym, result);
     }
     return result;
 }
@@ -292,6 +292,7 @@ protected:
 
 public:
     static grob_p   graph(grapher &g, uint depth, int &precedence);
+    static grob_p   graph_uncached(expression_r o, grapher &g);
     static grob_p   parentheses(grapher &g, grob_g x, uint padding = 0);
     static grob_p   abs_norm(grapher &g, grob_g x, uint padding = 2);
     static grob_p   root(grapher &g, grob_g x);
@@ -355,6 +356,7 @@ public:
     static bool         in_algebraic;
     static bool         contains_independent_variable;
     static uint         constant_index;
+    static uint         symbolic_pass;
 
     typedef size_t (*funcall_match_fn)(funcall_p pat, funcall_p repl);
     typedef algebraic_p (*funcall_build_fn)(funcall_p src, funcall_p repl);
@@ -378,6 +380,7 @@ struct funcall : expression
 
     object_p arg(uint depth) const;
     array_p  args() const;
+    result   run_memoized() const;
 
 public:
     OBJECT_DECL(funcall);
@@ -115,7 +115,7 @@ static uint32_t computed_checksum = 0;
 static byte     file_magic[]      = FILE_MAGIC;
 
 
-static uint32_t id_checksum()
+uint32_t files::id_checksum()
 // ----------------------------------------------------------------------------
 //   A checksum of all ID names, used to identify changes in binary format
 // ----------------------------------------------------------------------------
@@ -130,6 +130,15 @@ static uint32_t id_checksum()
 }
 
 
+file::mode files::write_mode()
+// ----------------------------------------------------------------------------
+//   Select compressed or plain output for state and object files
+// ----------------------------------------------------------------------------
+{
+    return Settings.CompressFiles() ? file::COMPRESSING : file::WRITING;
+}
+
+
 bool files::store_binary(text_p name, object_p value) const
 // ----------------------------------------------------------------------------
 //  Store object in binary format
@@ -137,7 +146,31 @@ bool files::store_binary(text_p name, object_p value) const
 {
     if (value)
     {
-        file f(filename(name, true), file::WRITING);
+        object_g saved = value;
+        text_p   path  = filename(name, true);
+        value = saved;
+#if USE_ASYNC_IO
+        // Small enough objects are written in the background
+        if (cstring err = file::io_error())
+        {
+            rt.error(err);
+            return false;
+        }
+        uint32_t checksum = id_checksum();
+        size_t   size     = value->size();
+        byte    *buf      = nullptr;
+        if (!Settings.CompressFiles() &&
+            (buf = file::async_start(path, sizeof(file_magic) +
+                                     sizeof(checksum) + size)))
+        {
+            memcpy(buf, file_magic, sizeof(file_magic));
+            memcpy(buf + sizeof(file_magic), &checksum, sizeof(checksum));
+            memcpy(buf + sizeof(file_magic) + sizeof(checksum), value, size);
+            file::async_submit();
+            return true;
+        }
+#endif // USE_ASYNC_IO
+        file f(path, write_mode());
         if (f.valid())
         {
             uint32_t checksum = id_checksum();
@@ -159,7 +192,7 @@ bool files::store_source(text_p name, object_p value) const
 {
     if (value)
     {
-        file f(filename(name, true), file::WRITING);
+        file f(filename(name, true), write_mode());
         if (f.valid())
         {
             renderer r(f);
@@ -179,7 +212,26 @@ bool files::store_text(text_p name, text_p value) const
 {
     if (value)
     {
-        file f(filename(name, true), file::WRITING);
+        text_g saved = value;
+        text_p path  = filename(name, true);
+        value = saved;
+#if USE_ASYNC_IO
+        // Small enough texts are written in the background
+        if (cstring err = file::io_error())
+        {
+            rt.error(err);
+            return false;
+        }
+        size_t len = 0;
+        utf8   txt = value->value(&len);
+        if (byte *buf = file::async_start(path, len))
+        {
+            memcpy(buf, txt, len);
+            file::async_submit();
+            return true;
+        }
+#endif // USE_ASYNC_IO
+        file f(path, file::WRITING);
         if (f.valid())
         {
             size_t len = 0;
@@ -200,7 +252,7 @@ bool files::store_list(text_p name, list_p value) const
 {
     if (value)
     {
-        file f(filename(name, true), file::WRITING);
+        file f(filename(name, true), write_mode());
         if (f.valid())
         {
             renderer r(f);
@@ -432,6 +484,10 @@ list_p files::recall_list(text_p name, bool as_array) const
 // ----------------------------------------------------------------------------
 //  Recall list from a CSV file
 // ----------------------------------------------------------------------------
+//  Rows and the items of the current row are accumulated on the stack, and
+//  the result is only built once at the end. This avoids copying the whole
+//  result for each row, which made loading large files quadratic and left
+//  a trail of garbage that had to be collected repeatedly.
 {
     file f(filename(name), file::READING);
     if (!f.valid())
@@ -442,9 +498,9 @@ list_p files::recall_list(text_p name, bool as_array) const
     }
 
     id       ty     = as_array ? ID_array : ID_list;
-    list_g   result = list::make(ty, nullptr, 0);
     object_g item   = nullptr;
-    list_g   row    = nullptr;
+    uint     rows   = 0;
+    uint     items  = 0;
     int      cols   = 0;
     int      kcols  = -1;
     bool     intxt  = false;
@@ -453,6 +509,7 @@ list_p files::recall_list(text_p name, bool as_array) const
     uint     brack  = 0;
     uint     curly  = 0;
     uint     nonsp  = 0;
+    stack_depth_restore sdr;
 
     // Loop on the input file and process it as if it was being typed
     size_t   bytes  = 0;
@@ -486,13 +543,12 @@ list_p files::recall_list(text_p name, bool as_array) const
             nonsp = 0;
             if (!item)
                 break;
-            byte_p b  = byte_p(+item);
-            size_t sz = item->size();
-            list_g li = rt.make<list>(ty, b, sz);
 
-            if (row || c == ';' || c == ',')
+            if (items || c == ';' || c == ',')
             {
-                row = row ? row + li : li;
+                if (!rt.push(item))
+                    return nullptr;
+                items++;
                 if (c == ';' || c == ',')
                     cols++;
             }
@@ -505,37 +561,33 @@ list_p files::recall_list(text_p name, bool as_array) const
                 {
                     if (ty != ID_list)
                     {
+                        // Turn the rows we already have into lists
                         ty = ID_list;
-                        list_g copy = list::make(ty, nullptr, 0);
-                        for (object_p obj : *result)
+                        for (uint r = 0; r < rows; r++)
                         {
-                            list_g ci;
+                            object_p obj = rt.stack(items + r);
                             if (list_p li = obj->as_array_or_list())
                             {
-                                b = byte_p(li->objects(&sz));
-                                ci = list::make(b, sz);
-                                obj = ci;
+                                size_t sz = 0;
+                                byte_p b  = byte_p(li->objects(&sz));
+                                obj = list::make(b, sz);
+                                if (!obj || !rt.stack(items + r, obj))
+                                    return nullptr;
                             }
-                            b = byte_p(obj);
-                            ci = list::make(b, obj->size());
-                            copy = copy + ci;
-                        }
-                        if (row)
-                        {
-                            b = byte_p(row->objects(&sz));
-                            row = list::make(b, sz);
                         }
-                        result = copy;
                     }
                 }
-                if (row)
+                if (items)
                 {
-                    b = byte_p(+row);
-                    sz = row->size();
-                    li = rt.make<list>(ty, b, sz);
+                    list_g row = list::list_from_stack(items, ty);
+                    if (!row)
+                        return nullptr;
+                    item = +row;
                 }
-                result = result + li;
-                row = nullptr;
+                if (!rt.push(item))
+                    return nullptr;
+                rows++;
+                items = 0;
                 cols = 0;
             }
             rt.clear();
@@ -549,10 +601,10 @@ list_p files::recall_list(text_p name, bool as_array) const
             bytes += count;
         }
     }
-    if (row)
-        result = result + row;
+    rt.clear();
 
-    return result;
+    // Items of an unterminated last row are added to the result
+    return list::list_from_stack(rows + items, ty);
 }
 
 
@@ -855,15 +907,16 @@ bool files::store_grob(text_p name, grob_p value) const
             if (ok)
                 ok = f.write((const char *) palette, sizeof(palette));
 
-            char zero = 0;
+            // Write one padded, byte-reversed row at a time
+            byte row[dstride];
             for (uint r = height; r --> 0 && ok; )
             {
                 byte_p scan = pixels + sstride * r;
-                char *src = (char *) scan + sstride;
-                for (uint c = 0; c < sstride && ok; c++)
-                    ok = f.write(--src, 1);
+                for (uint c = 0; c < sstride; c++)
+                    row[c] = scan[sstride - 1 - c];
                 for (uint c = sstride; c < dstride; c++)
-                    ok = f.write(&zero, 1);
+                    row[c] = 0;
+                ok = f.write((const char *) row, dstride);
             }
 
             if (ok)
@@ -913,15 +966,16 @@ grob_p files::recall_grob(text_p name) const
             size_t     sstride = b.info.imageSize / height;
 
             ok = int(width) == b.info.width && int(height) == b.info.height;
-            char ignore;
+
+            // Read one padded row at a time, reversing the bytes
+            size_t rowlen = sstride > dstride ? sstride : dstride;
+            byte   row[rowlen];
             for (uint r = height; r --> 0 && ok; )
             {
                 byte *scan = (byte *) pixels + dstride * r;
-                char *dst = (char *) scan + dstride;
+                ok = f.read((char *) row, rowlen);
                 for (uint c = 0; c < dstride && ok; c++)
-                    ok = f.read(--dst, 1);
-                for (uint c = dstride; c < sstride; c++)
-                    ok = f.read(&ignore, 1);
+                    scan[dstride - 1 - c] = row[c];
             }
         }
 
@@ -85,6 +85,12 @@ struct files : text
 
     // Build a file name from current path
     text_p   filename(text_p name, bool writing = false) const;
+
+    // Checksum identifying the binary format of objects
+    static uint32_t id_checksum();
+
+    // Mode for writing state and object files, compressed if selected
+    static file::mode write_mode();
 };
 
 // Marker for valid binary files
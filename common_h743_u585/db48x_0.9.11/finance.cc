@@ -29,13 +29,18 @@
 
 #include "finance.h"
 
+#include "arithmetic.h"
+#include "compare.h"
 #include "equations.h"
 #include "expression.h"
+#include "functions.h"
 #include "solve.h"
 #include "variables.h"
 #include "user_interface.h"
 #include "tag.h"
 
+RECORDER(tvm, 16, "Time value of money solver");
+
 
 expression_p FinanceSolverMenu::equation()
 // ----------------------------------------------------------------------------
@@ -110,6 +115,202 @@ static algebraic_p tvm_variable(cstring name)
 }
 
 
+// ============================================================================
+//
+//   Dedicated TVM solver
+//
+// ============================================================================
+//
+//   The TVM equation is, with i = I%Yr/(100*PYr), v = (1+i)^-n and k = 1+i
+//   when paying at the beginning of the period, k = 1 otherwise:
+//
+//       k*Pmt*(1-v)/i + FV*v + PV = 0
+//
+//   This can be solved in closed form for n, Pmt, FV and PV, and solved with
+//   Newton steps using an analytic derivative for i.  This is much faster
+//   than the generic solver, which evaluates the whole expression at every
+//   step.  It also gives the limit when I%Yr is zero.
+
+#ifndef TVM_MAX_ITERATIONS
+#define TVM_MAX_ITERATIONS      50
+#endif
+
+enum tvm_index { TVM_PYR, TVM_N, TVM_IYR, TVM_PMT, TVM_FV, TVM_PV, TVM_COUNT };
+
+
+static algebraic_p tvm_rate(algebraic_r n, algebraic_r pmt,
+                            algebraic_r fv, algebraic_r pv,
+                            algebraic_r guess, bool beg)
+// ----------------------------------------------------------------------------
+//   Solve for the periodic rate using Newton's method
+// ----------------------------------------------------------------------------
+//   With A = (1-v)/i, we have dv/di = -n*v/(1+i) and dA/di = (-dv/di - A)/i
+{
+    algebraic_g zero = integer::make(0);
+    algebraic_g one  = integer::make(1);
+    algebraic_g eps  = algebraic::epsilon(Settings.SolverImprecision());
+    algebraic_g i    = guess;
+    if (!i || i->is_zero(false))
+        i = fraction::make(integer::make(1), integer::make(100));
+
+    algebraic_g i1, v, a, k, f, dv, da, df, d;
+    for (uint iter = 0; iter < TVM_MAX_ITERATIONS; iter++)
+    {
+        if (program::interrupted() || rt.error())
+            return nullptr;
+        if (i->is_zero(false))
+            return nullptr;
+
+        i1 = one + i;
+        v  = pow(i1, -n);
+        a  = (one - v) / i;
+        k  = beg ? i1 : one;
+        f  = k * pmt * a + fv * v + pv;
+        dv = -n * v / i1;
+        da = (-dv - a) / i;
+        df = pmt * (k * da + (beg ? a : zero)) + fv * dv;
+        if (!df || df->is_zero(false))
+            return nullptr;
+        d = f / df;
+        i = i - d;
+        if (!i || !i->is_real())
+            return nullptr;
+        record(tvm, "TVM rate step %u i=%t f=%t df=%t", iter, +i, +f, +df);
+        if (algebraic_g ip = i + one)
+            if (ip->is_negative(false) || ip->is_zero(false))
+                return nullptr;
+        if (d->is_zero(false) || smaller_magnitude(d, i * eps))
+            return i;
+    }
+    return nullptr;
+}
+
+
+algebraic_p FinanceSolverMenu::solve(program_r eq, symbol_r name)
+// ----------------------------------------------------------------------------
+//   Solve the TVM equation for a variable, return nullptr if not applicable
+// ----------------------------------------------------------------------------
+//   This returns nullptr without error if the generic solver should be used,
+//   e.g. for a non-real value or when solving for PYr
+{
+    bool       beg = Settings.TVMPayAtBeginningOfPeriod();
+    equation_p tvm = equation::lookup(beg ? "TVMBeg" : "TVMEnd");
+    object_p   def = tvm ? tvm->value() : nullptr;
+    if (!eq || !name || !def || !eq->is_same_as(def))
+        return nullptr;
+
+    uint which = TVM_COUNT;
+    for (uint v = 0; v < TVM_COUNT; v++)
+        if (name->matches(tvm_vars[v]))
+            which = v;
+    if (which == TVM_COUNT || which == TVM_PYR)
+        return nullptr;
+
+    algebraic_g vals[TVM_COUNT];
+    for (uint v = 0; v < TVM_COUNT; v++)
+    {
+        symbol_g sym = symbol::make(tvm_vars[v]);
+        object_p obj = sym ? directory::recall_all(sym, false) : nullptr;
+        if (obj)
+            vals[v] = obj->as_algebraic();
+        if (v != which && (!vals[v] || !vals[v]->is_real()))
+            return nullptr;
+    }
+
+    algebraic_g &n   = vals[TVM_N];
+    algebraic_g &iyr = vals[TVM_IYR];
+    algebraic_g &pmt = vals[TVM_PMT];
+    algebraic_g &fv  = vals[TVM_FV];
+    algebraic_g &pv  = vals[TVM_PV];
+    algebraic_g  one = integer::make(1);
+    algebraic_g  pct = integer::make(100) * vals[TVM_PYR];
+    algebraic_g  x;
+
+    record(tvm, "TVM solver for %+s", tvm_vars[which]);
+    if (which == TVM_IYR)
+    {
+        algebraic_g guess = iyr ? iyr / pct : algebraic_g();
+        x = tvm_rate(n, pmt, fv, pv, guess, beg);
+        if (!x)
+        {
+            // Let the generic solver try harder from the same guess
+            rt.clear_error();
+            return nullptr;
+        }
+        x = x * pct;
+    }
+    else if (iyr->is_zero(false))
+    {
+        // Limit when the interest rate is zero: PV + n*Pmt + FV = 0
+        switch (which)
+        {
+        case TVM_N:     x = -(pv + fv) / pmt;   break;
+        case TVM_PMT:   x = -(pv + fv) / n;     break;
+        case TVM_FV:    x = -(pv + pmt * n);    break;
+        case TVM_PV:    x = -(fv + pmt * n);    break;
+        }
+    }
+    else
+    {
+        algebraic_g i  = iyr / pct;
+        algebraic_g i1 = one + i;
+        algebraic_g k  = beg ? i1 : one;
+        algebraic_g kp = k * pmt / i;
+        if (which == TVM_N)
+        {
+            // v = (kp + PV) / (kp - FV), n = -ln(v) / ln(1+i)
+            algebraic_g v = (kp + pv) / (kp - fv);
+            if (v && !v->is_negative(false) && !v->is_zero(false))
+                x = -ln::run(v) / ln1p::run(i);
+        }
+        else
+        {
+            algebraic_g v = pow(i1, -n);
+            algebraic_g a = (one - v) * kp;
+            switch (which)
+            {
+            case TVM_PMT:       x = -(pv + fv * v) * i / (k * (one - v)); break;
+            case TVM_FV:        x = -(pv + a) / v;                        break;
+            case TVM_PV:        x = -(a + fv * v);                        break;
+            }
+        }
+    }
+
+    if (!x || rt.error() || !x->is_real())
+        return nullptr;
+    if (!directory::store_here(name, x))
+        return nullptr;
+    return x;
+}
+
+
+static algebraic_p tvm_balance(algebraic_r pv, algebraic_r pmt,
+                               algebraic_r ipp, uint periods)
+// ----------------------------------------------------------------------------
+//   Compute the balance after the given number of periods in closed form
+// ----------------------------------------------------------------------------
+//   Each period computes B' = B*(1+i) + Pmt, except the first one when paying
+//   at the beginning of the period, which computes B' = B + Pmt.  This gives
+//   B(k) = B(0)*(1+i)^k + Pmt*((1+i)^k-1)/i, or B(0)+k*Pmt if i is zero.
+{
+    algebraic_g balance = pv;
+    if (!periods)
+        return balance;
+    if (Settings.TVMPayAtBeginningOfPeriod())
+    {
+        balance = balance + pmt;
+        periods--;
+    }
+
+    algebraic_g k = integer::make(periods);
+    if (ipp->is_zero(false))
+        return balance + k * pmt;
+    algebraic_g one = integer::make(1);
+    algebraic_g g   = pow(one + ipp, k);
+    return balance * g + pmt * (g - one) / ipp;
+}
+
+
 COMMAND_BODY(TVMAmort)
 // ----------------------------------------------------------------------------
 //   Amortize payments
@@ -128,24 +329,10 @@ COMMAND_BODY(TVMAmort)
 
         if (!rt.error())
         {
-            algebraic_g principal = integer::make(0);
-            algebraic_g interest  = integer::make(0);
-            algebraic_g balance   = pv;
-
-            algebraic_g mi, mp;
-
-            for (uint i = 0; i < n; i++)
-            {
-                if (i || Settings.TVMPayAtEndOfPeriod())
-                    mi = -balance * ipp; // Monthly interest
-                else
-                    mi = integer::make(0);
-                mp = pmt - mi;
-
-                interest = interest + mi;
-                principal = principal + mp;
-                balance = balance + mp;
-            }
+            // The sum of principal payments is the change in balance
+            algebraic_g balance   = tvm_balance(pv, pmt, ipp, n);
+            algebraic_g principal = balance - pv;
+            algebraic_g interest  = integer::make(n) * pmt - principal;
 
             FinanceSolverMenu::round(principal);
             FinanceSolverMenu::round(interest);
@@ -215,18 +402,22 @@ COMMAND_BODY(TVMAmortTable)
 
         if (!rt.error())
         {
-            algebraic_g principal = integer::make(0);
-            algebraic_g interest  = integer::make(0);
-            algebraic_g balance   = pv;
+            // Skip directly to the first period that we display
+            uint        skip      = first > 1 ? first - 1 : 0;
+            algebraic_g balance   = tvm_balance(pv, pmt, ipp, skip);
+            algebraic_g principal = balance - pv;
+            algebraic_g interest  = integer::make(skip) * pmt - principal;
 
             algebraic_g mi, mp;
             scribble    ascr;
 
             int         last = first + count;
             int         s    = 1;
-            for (int i = 1; i < last; i++)
+            for (int i = int(skip) + 1; i < last; i++)
             {
-                if (i || Settings.TVMPayAtEndOfPeriod())
+                if (program::interrupted())
+                    return ERROR;
+                if (i > 1 || Settings.TVMPayAtEndOfPeriod())
                     mi = -balance * ipp; // Monthly interest
                 else
                     mi = integer::make(0);
@@ -49,6 +49,7 @@ struct FinanceSolverMenu : menu
     static expression_p equation();
     static bool active();
     static bool round(algebraic_g &value);
+    static algebraic_p solve(program_r eq, symbol_r name);
 
 public:
     OBJECT_DECL(FinanceSolverMenu);
@@ -30,6 +30,7 @@
 #include "font.h"
 
 #include "dmcp.h"
+#include "file.h"
 #include "parser.h"
 #include "recorder.h"
 #include "renderer.h"
@@ -92,15 +93,48 @@ font_p HelpTitleFont;
 font_p HelpSubTitleFont;
 
 
+#if USE_RESOURCE_FLASH
+static font_p resource_font(cstring path)
+// ----------------------------------------------------------------------------
+//   Return a font loaded in the resource flash, if there is a valid one
+// ----------------------------------------------------------------------------
+{
+    uint   size = 0;
+    font_p font = font_p(file::resource(path, &size));
+    if (font)
+    {
+        object::id ty = font->type();
+        if ((ty == object::ID_sparse_font || ty == object::ID_dense_font) &&
+            font->size() <= size)
+            return font;
+        record(fonts_error, "Invalid font %s in resource flash", path);
+    }
+    return nullptr;
+}
+#endif // USE_RESOURCE_FLASH
+
+static void font_cache_clear();
+static void font_cache_index();
+
+
 void font_defaults()
 // ----------------------------------------------------------------------------
 //    Initialize the fonts for the user interface
 // ----------------------------------------------------------------------------
 {
+#if USE_RESOURCE_FLASH
+#define GENERATED_FONT(name)                                    \
+    extern byte name##_sparse_font_data[];                      \
+    name = resource_font("fonts/" #name ".dbf");                \
+    if (!name)                                                  \
+        name = (font_p) name##_sparse_font_data;
+#else // !USE_RESOURCE_FLASH
 #define GENERATED_FONT(name)                    \
     extern byte name##_sparse_font_data[];      \
     name = (font_p) name##_sparse_font_data;
+#endif // USE_RESOURCE_FLASH
 
+    font_cache_clear();
     GENERATED_FONT(HelpFont);
     GENERATED_FONT(ReducedFont);
     GENERATED_FONT(StackFont);
@@ -114,21 +148,35 @@ void font_defaults()
     HelpCodeFont     = LibMonoFont11x18;
     HelpTitleFont    = StackFont;
     HelpSubTitleFont = ReducedFont;
+    font_cache_index();
 }
 
 
+#ifndef FONT_CACHE_GLYPHS
+#define FONT_CACHE_GLYPHS       128     // Must be a power of two
+#endif
+#ifndef FONT_CACHE_RANGES
+#define FONT_CACHE_RANGES       256     // Code point ranges for all fonts
+#endif
+
 struct font_cache
 // ----------------------------------------------------------------------------
 //   A data structure to accelerate access to font offsets for a given font
 // ----------------------------------------------------------------------------
+//   Glyphs are in an open-addressed hash table keyed on font and code point.
+//   Each font also gets a table of the start of its code point ranges, so
+//   that a miss does not rescan the LEB128 data from the start of the font.
 {
     // Use same size as font data
     using fint  = font::fint;
     using fuint = font::fuint;
 
-    enum { MAX_GLYPHS = 128 };
+    enum { MAX_GLYPHS = FONT_CACHE_GLYPHS, MAX_RANGES = FONT_CACHE_RANGES };
+    enum { MAX_FONTS = 16 };
 
-    font_cache(): cache((data *) malloc(sizeof(data) * MAX_GLYPHS)), size(0) { }
+    font_cache()
+        : cache((data *) calloc(MAX_GLYPHS, sizeof(data))), size(0),
+          ranges(), fonts(), nfonts(0), nranges(0) { }
     ~font_cache() { free(cache); }
 
 
@@ -156,7 +204,7 @@ struct font_cache
             this->advance   = advance;
         }
 
-        font_p  font;      // Font being cached
+        font_p  font;      // Font being cached, null for a free entry
         byte_p  bitmap;    // Bitmap data for glyph
         unicode codepoint; // Codepoint in that font
         fint    x;         // X position (meaning depends on font type)
@@ -167,27 +215,41 @@ struct font_cache
     } __attribute((packed))__;
 
 
+    struct range
+    // ------------------------------------------------------------------------
+    //   Start of a code point range in the font data
+    // ------------------------------------------------------------------------
+    {
+        byte_p  start;     // Range header (first code point, count)
+        fuint   first;     // First code point in range
+        fint    x;         // Dense fonts: bitmap column of first code point
+    };
+
+
+    static size_t hash(font_p font, unicode codepoint)
+    // ------------------------------------------------------------------------
+    //   Hash a font and code point into the table
+    // ------------------------------------------------------------------------
+    {
+        uintptr_t key = (uintptr_t(font) >> 2) * 0x9E3779B1u;
+        return (key ^ (codepoint * 0x85EBCA77u)) & (MAX_GLYPHS - 1);
+    }
+
+
     data *lookup(font_p font, unicode codepoint)
     // ------------------------------------------------------------------------
-    //   Lookup data in the LRU cache
+    //   Lookup data in the hash table
     // ------------------------------------------------------------------------
     {
         if (size)
         {
-            size_t count = size < MAX_GLYPHS ? size : size_t(MAX_GLYPHS);
-            data  *last  = cache + (size + ~0) % MAX_GLYPHS;
-            data  *d     = last;
-            for (size_t i = 0; i < count; i++)
+            size_t i = hash(font, codepoint);
+            while (cache[i].font)
             {
+                data *d = cache + i;
                 if (d->font == font && d->codepoint == codepoint)
-                {
-                    // Bring it back to front for faster lookup next
-                    if (i > 0)
-                        std::swap(*d, *last);
-                    return last;
-                }
-                if (d-- < cache)
-                    d = cache + count - 1;
+                    return d;
+                i = (i + 1) & (MAX_GLYPHS - 1);
             }
         }
         return nullptr;
@@ -203,20 +265,239 @@ struct font_cache
                  fuint   h,
                  fuint   advance)
     // ------------------------------------------------------------------------
-    //   Insert a new entry in the cache
+    //   Insert a new entry in the cache, starting afresh when mostly full
     // ------------------------------------------------------------------------
     {
-        data *last = cache + (size++ % MAX_GLYPHS);
-        last->set(font, codepoint, bitmap, x, y, w, h, advance);
-        return last;
+        if (size >= MAX_GLYPHS * 3 / 4)
+        {
+            record(font_cache, "Glyph cache full, flushing %u entries", size);
+            glyphs_clear();
+        }
+        size_t i = hash(font, codepoint);
+        while (cache[i].font &&
+               (cache[i].font != font || cache[i].codepoint != codepoint))
+            i = (i + 1) & (MAX_GLYPHS - 1);
+        data *d = cache + i;
+        if (!d->font)
+            size++;
+        d->set(font, codepoint, bitmap, x, y, w, h, advance);
+        return d;
+    }
+
+
+    byte_p range_start(font_p font, byte_p p, unicode codepoint,
+                       bool dense, fint *x = nullptr)
+    // ------------------------------------------------------------------------
+    //   Return the header of the last range starting at or before codepoint
+    // ------------------------------------------------------------------------
+    //   p points to the first range header. Ranges are recorded on the first
+    //   lookup in a font. If tables are full, later ranges are scanned as
+    //   before, starting from the last recorded one.
+    {
+        uint f = font_index(font, p, dense);
+        if (f >= nfonts)
+            return p;
+
+        range *first = ranges + fonts[f].first;
+        range *last  = first + fonts[f].count;
+        range *found = nullptr;
+        while (first < last)
+        {
+            range *mid = first + (last - first) / 2;
+            if (mid->first <= codepoint)
+            {
+                found = mid;
+                first = mid + 1;
+            }
+            else
+            {
+                last = mid;
+            }
+        }
+        if (!found)
+            return p;
+        if (x)
+            *x = found->x;
+        return found->start;
+    }
+
+
+    uint font_index(font_p font, byte_p p, bool dense)
+    // ------------------------------------------------------------------------
+    //   Return the index of the font, recording its ranges if necessary
+    // ------------------------------------------------------------------------
+    //   Font data can be replaced at the same address, e.g. when the resource
+    //   flash is reloaded. A fingerprint of the font size and range headers
+    //   detects this, and rebuilds the tables (and drops cached glyphs).
+    {
+        size_t   size  = font->size();
+        uint32_t check = fingerprint(font, p, size);
+        uint     f;
+        for (f = 0; f < nfonts; f++)
+        {
+            if (fonts[f].font == font)
+            {
+                if (fonts[f].size == size && fonts[f].check == check)
+                    return f;
+                record(font_cache, "Font %p changed, rebuilding tables", font);
+                clear();
+                f = 0;
+                break;
+            }
+        }
+        if (nfonts >= MAX_FONTS)
+            return MAX_FONTS;
+        fonts[f].font  = font;
+        fonts[f].size  = size;
+        fonts[f].check = check;
+        fonts[f].first = nranges;
+        fonts[f].count = scan_ranges(p, dense);
+        nfonts++;
+        return f;
+    }
+
+
+    void index(font_p font)
+    // ------------------------------------------------------------------------
+    //   Record the code point ranges of a font when it is loaded
+    // ------------------------------------------------------------------------
+    {
+        object::id ty = font->type();
+        if (ty != object::ID_sparse_font && ty != object::ID_dense_font)
+            return;
+        byte_p p      = font->payload();
+        leb128<size_t>(p);
+        fuint  height = leb128<fuint>(p);
+        bool   dense  = ty == object::ID_dense_font;
+        if (dense)
+        {
+            fuint width = leb128<fuint>(p);
+            p += (height * width + 7) / 8;
+        }
+        font_index(font, p, dense);
+    }
+
+
+    static uint32_t fingerprint(font_p font, byte_p p, size_t size)
+    // ------------------------------------------------------------------------
+    //   Hash the first range headers of a font
+    // ------------------------------------------------------------------------
+    {
+        byte_p   end  = byte_p(font) + size;
+        uint32_t hash = 2166136261u ^ uint32_t(size);
+        for (uint i = 0; i < 32 && p + i < end; i++)
+            hash = (hash ^ p[i]) * 16777619u;
+        return hash;
+    }
+
+
+    uint scan_ranges(byte_p p, bool dense)
+    // ------------------------------------------------------------------------
+    //   Record code point ranges of a font, return number of ranges
+    // ------------------------------------------------------------------------
+    {
+        uint  count = 0;
+        fint  x     = 0;
+        while (nranges < MAX_RANGES)
+        {
+            byte_p start   = p;
+            fuint  firstCP = leb128<fuint>(p);
+            fuint  numCPs  = leb128<fuint>(p);
+            if (!firstCP && !numCPs)
+                break;
+
+            range &r = ranges[nranges++];
+            r.start  = start;
+            r.first  = firstCP;
+            r.x      = x;
+            count++;
+
+            for (fuint cp = 0; cp < numCPs; cp++)
+            {
+                if (dense)
+                {
+                    x += leb128<fuint>(p);
+                    continue;
+                }
+                leb128<fint>(p);
+                leb128<fint>(p);
+                fuint w = leb128<fuint>(p);
+                fuint h = leb128<fuint>(p);
+                leb128<fuint>(p);
+                p += (w * h + 7) / 8;
+            }
+        }
+        record(font_cache, "Recorded %u ranges, %u in use", count, nranges);
+        return count;
+    }
+
+
+    void glyphs_clear()
+    // ------------------------------------------------------------------------
+    //   Forget cached glyphs
+    // ------------------------------------------------------------------------
+    {
+        for (size_t i = 0; size && i < MAX_GLYPHS; i++)
+            cache[i].font = nullptr;
+        size = 0;
+    }
+
+
+    void clear()
+    // ------------------------------------------------------------------------
+    //   Forget cached glyphs and ranges, e.g. when fonts change
+    // ------------------------------------------------------------------------
+    {
+        glyphs_clear();
+        nfonts = 0;
+        nranges = 0;
     }
 
 private:
-    data  *cache;
-    size_t size;
+    struct font_ranges
+    {
+        font_p   font;
+        size_t   size;       // Size of the font when ranges were recorded
+        uint32_t check;      // Fingerprint of the range headers
+        uint     first;      // Index of first range in ranges[]
+        uint     count;      // Number of ranges recorded for font
+    };
+
+    data        *cache;
+    size_t       size;
+    range        ranges[MAX_RANGES];
+    font_ranges  fonts[MAX_FONTS];
+    uint         nfonts;
+    uint         nranges;
 } FontCache;
 
 
+static void font_cache_clear()
+// ----------------------------------------------------------------------------
+//   Clear the font cache
+// ----------------------------------------------------------------------------
+{
+    FontCache.clear();
+}
+
+
+static void font_cache_index()
+// ----------------------------------------------------------------------------
+//   Rebuild the code point range tables for the user interface fonts
+// ----------------------------------------------------------------------------
+{
+    font_p fonts[] =
+    {
+        EditorFont, StackFont, ReducedFont, ErrorFont, MenuFont, HelpFont,
+        HelpBoldFont, HelpItalicFont, HelpCodeFont, HelpTitleFont,
+        HelpSubTitleFont
+    };
+    for (font_p f : fonts)
+        if (f)
+            FontCache.index(f);
+}
+
+
 bool font::glyph(unicode codepoint, glyph_info &g) const
 // ----------------------------------------------------------------------------
 //   Dynamic dispatch to the available font classes
@@ -270,6 +551,10 @@ bool sparse_font::glyph(unicode codepoint, glyph_info &g) const
     // Check if cached
     font_cache::data *data = FontCache.lookup(this, codepoint);
 
+    // Skip ranges before the code point, unless we need the width of '0'
+    if (!data && !fixed)
+        p = FontCache.range_start(this, p, codepoint, false);
+
     record(sparse_fonts, "Looking up %u, got cache %p", codepoint, data);
     while (!data)
     {
@@ -369,6 +654,10 @@ bool dense_font::glyph(unicode codepoint, glyph_info &g) const
     fint   x          = 0;
     size_t bitmapSize = (height * width + 7) / 8;
     p += bitmapSize;
+
+    // Skip ranges before the code point, unless we need the width of '0'
+    if (!data && !fixed)
+        p = FontCache.range_start(this, p, codepoint, true, &x);
     while (!data)
     {
         // Check code point range
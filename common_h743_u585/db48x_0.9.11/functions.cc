@@ -37,6 +37,7 @@
 #include "decimal.h"
 #include "expression.h"
 #include "fraction.h"
+#include "hwfp.h"
 #include "integer.h"
 #include "integrate.h"
 #include "list.h"
@@ -1488,6 +1489,61 @@ NFUNCTION_BODY(perm)
 }
 
 
+static algebraic_p sum_product_fast(program_r   prg,
+                                    symbol_r    name,
+                                    algebraic_r init,
+                                    algebraic_r last,
+                                    bool        product,
+                                    bool       &done)
+// ----------------------------------------------------------------------------
+//   Accumulate a sum or product in hardware doubles using compiled code
+// ----------------------------------------------------------------------------
+//   Sums use compensated (Kahan) summation, so that adding many small terms
+//   like in Σ(k;1;10000;1/k^2) does not lose precision as the sum grows.
+//   If the body can't be compiled or gives a non-finite value, done is false
+//   and the caller uses the interpreter.
+{
+    done = false;
+    double a = 0.0, b = 0.0;
+    if (!fast_function::real_value(init, a) ||
+        !fast_function::real_value(last, b))
+        return nullptr;
+    fast_function fast(prg, +name);
+    if (!fast.compiled())
+        return nullptr;
+
+    double acc  = product ? 1.0 : 0.0;
+    double lost = 0.0;
+    uint   n    = 0;
+    for (double k = a; k <= b; k += 1.0)
+    {
+        double y = 0.0;
+        if (!fast.run(k, y))
+            return nullptr;
+        if (product)
+        {
+            acc *= y;
+        }
+        else
+        {
+            double t = y - lost;
+            double s = acc + t;
+            lost = (s - acc) - t;
+            acc = s;
+        }
+        if (!std::isfinite(acc))
+            return nullptr;
+        if (++n % 1024 == 0 && program::interrupted())
+        {
+            done = true;
+            return nullptr;
+        }
+    }
+    done = true;
+    return hwdouble::make(acc);
+}
+
+
 static algebraic_p sum_product(object::id op,
                                algebraic_g args[], uint arity)
 // ----------------------------------------------------------------------------
@@ -1516,7 +1572,20 @@ static algebraic_p sum_product(object::id op,
         return nullptr;
     }
 
-    if (init->is_integer() && last->is_integer())
+    // With hardware floating point, compile the body and accumulate doubles,
+    // unless integer bounds call for an exact result
+    bool exact = init->is_integer() && last->is_integer();
+    if (fast_function::hardware() && (Settings.NumericalResults() || !exact))
+    {
+        program_g   prg = program_p(+expr);
+        bool        done = false;
+        algebraic_g result = sum_product_fast(prg, name, init, last,
+                                              op == object::ID_multiply, done);
+        if (done)
+            return result;
+    }
+
+    if (exact)
     {
         program_g        prg  = program_p(+expr);
         large            a    = init->as_int64(0, false);
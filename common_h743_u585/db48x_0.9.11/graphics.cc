@@ -79,9 +79,13 @@ PlotParametersAccess::PlotParametersAccess()
       xticks(integer::make(1)),
       yticks(integer::make(1)),
       xlabel(text::make("x")),
-      ylabel(text::make("y"))
+      ylabel(text::make("y")),
+      dxmin(0), dxrange(0), dwidth(0),
+      dymax(0), dyrange(0), dheight(0),
+      hwtransform(false)
 {
     parse();
+    prepare();
 }
 
 
@@ -440,13 +444,79 @@ coord PlotParametersAccess::size_adjust(object_r    p,
 
 
 
+void PlotParametersAccess::prepare()
+// ----------------------------------------------------------------------------
+//   Precompute the coordinate transforms with hardware floating-point
+// ----------------------------------------------------------------------------
+//   Plots convert every sample to pixels, and doing it with algebraic
+//   arithmetic costs a subtraction, a division and a multiplication, each
+//   allocating a result. If the ranges have a double form, positions with a
+//   double form are converted with the FPU, in the same order of operations.
+//   This must be called again if xmin, xmax, ymin or ymax are changed.
+{
+    double x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+    hwtransform = false;
+    if (!fast_function::real_value(+xmin, x0) ||
+        !fast_function::real_value(+xmax, x1) ||
+        !fast_function::real_value(+ymin, y0) ||
+        !fast_function::real_value(+ymax, y1))
+        return;
+
+    dxmin   = x0;
+    dxrange = x1 - x0;
+    dwidth  = display_width();
+    dymax   = y1;
+    dyrange = y0 - y1;
+    dheight = display_height();
+    hwtransform = std::isfinite(dxrange) && std::isfinite(dyrange) &&
+                  dxrange != 0 && dyrange != 0;
+}
+
+
+bool PlotParametersAccess::fast_pixel(object_p pos, bool y,
+                                      coord &result) const
+// ----------------------------------------------------------------------------
+//   Convert a position to pixels with hardware floating-point if possible
+// ----------------------------------------------------------------------------
+//   Out of range values use pixel_adjust, which wraps like as_int32
+{
+    double value = 0;
+    if (!hwtransform || !pos || !fast_function::real_value(pos, value))
+        return false;
+    return fast_pixel(value, y, result);
+}
+
+
+bool PlotParametersAccess::fast_pixel(double value, bool y,
+                                      coord &result) const
+// ----------------------------------------------------------------------------
+//   Convert a hardware floating-point position to pixels
+// ----------------------------------------------------------------------------
+{
+    if (!hwtransform)
+        return false;
+    double pixel = y
+        ? (value - dymax) / dyrange * dheight
+        : (value - dxmin) / dxrange * dwidth;
+    if (!(pixel > -1e9 && pixel < 1e9))
+        return false;
+    result = coord(int32_t(pixel));
+    return true;
+}
+
+
 coord PlotParametersAccess::pair_pixel_x(object_r pos) const
 // ----------------------------------------------------------------------------
 //   Given a position (can be a complex, a list or a vector), return x
 // ----------------------------------------------------------------------------
 {
     if (object_g x = pos->child(0))
+    {
+        coord result = 0;
+        if (fast_pixel(+x, false, result))
+            return result;
         return pixel_adjust(x, xmin, xmax, display_width());
+    }
     return 0;
 }
 
@@ -457,7 +527,12 @@ coord PlotParametersAccess::pair_pixel_y(object_r pos) const
 // ----------------------------------------------------------------------------
 {
     if (object_g y = pos->child(1))
+    {
+        coord result = 0;
+        if (fast_pixel(+y, true, result))
+            return result;
         return pixel_adjust(y, ymax, ymin, display_height());
+    }
     return 0;
 }
 
@@ -467,6 +542,9 @@ coord PlotParametersAccess::pixel_x(algebraic_r x) const
 //   Adjust a position given as an algebraic value
 // ----------------------------------------------------------------------------
 {
+    coord result = 0;
+    if (fast_pixel(+x, false, result))
+        return result;
     object_g xo = object_p(+x);
     return pixel_adjust(xo, xmin, xmax, display_width());
 }
@@ -477,6 +555,9 @@ coord PlotParametersAccess::pixel_y(algebraic_r y) const
 //   Adjust a position given as an algebraic value
 // ----------------------------------------------------------------------------
 {
+    coord result = 0;
+    if (fast_pixel(+y, true, result))
+        return result;
     object_g yo = object_p(+y);
     return pixel_adjust(yo, ymax, ymin, display_height());
 }
@@ -1139,6 +1220,327 @@ COMMAND_BODY(CompileToExpression){ return compile_to(validate_expression); }
 //
 // ============================================================================
 
+// ============================================================================
+//
+//    Browsing large lists and matrices
+//
+// ============================================================================
+//   Rendering a large matrix or list as a single grob for `Show` can exhaust
+//   memory before anything is displayed. Instead, large lists and arrays, as
+//   well as those that do not fit, are shown as a table where only visible
+//   cells are rendered, each with a bounded renderer. Cells are remembered
+//   in a small cache so that moving the cursor only renders new cells.
+//   The arrow keys and 4, 6, 8, 2 move the cursor, with larger steps after
+//   shift. Enter opens the editor with the current cell and the index for
+//   Put, so that validating the edit replaces the cell in the object.
+
+#ifndef SHOW_TABLE_ITEMS
+// Above this number of items, lists and arrays are browsed as tables
+#define SHOW_TABLE_ITEMS        64
+#endif // SHOW_TABLE_ITEMS
+
+#ifndef SHOW_TABLE_COLUMNS
+// Maximum number of columns shown at once
+#define SHOW_TABLE_COLUMNS      4
+#endif // SHOW_TABLE_COLUMNS
+
+#ifndef SHOW_CELL_CACHE
+// Number of rendered cells that are remembered
+#define SHOW_CELL_CACHE         64
+#endif // SHOW_CELL_CACHE
+
+#ifndef SHOW_CELL_LENGTH
+// Maximum number of bytes rendered for a cell
+#define SHOW_CELL_LENGTH        48
+#endif // SHOW_CELL_LENGTH
+
+
+struct show_table
+// ----------------------------------------------------------------------------
+//   A table view of a list or matrix
+// ----------------------------------------------------------------------------
+{
+    show_table(list_r items);
+
+    object_p    item(size_t r, size_t c) const;
+    text_p      cell(size_t r, size_t c);
+    void        draw(size_t r0, size_t c0, size_t vrows, size_t vcols);
+    static bool browsable(object_p obj);
+
+    list_g      items;
+    size_t      rows;
+    size_t      columns;
+    size_t      row;
+    size_t      column;
+    bool        matrix;
+    size_t      cached_row[SHOW_CELL_CACHE];
+    size_t      cached_col[SHOW_CELL_CACHE];
+    text_g      cached[SHOW_CELL_CACHE];
+};
+
+
+show_table::show_table(list_r items)
+// ----------------------------------------------------------------------------
+//   Find the shape of the object to browse
+// ----------------------------------------------------------------------------
+    : items(items), rows(items->items()), columns(1), row(0), column(0),
+      matrix(false), cached_row(), cached_col(), cached()
+{
+    if (array_p a = items->as<array>())
+    {
+        size_t r = 0, c = 0;
+        if (a->is_matrix(&r, &c, false))
+        {
+            rows    = r;
+            columns = c;
+            matrix  = true;
+        }
+    }
+}
+
+
+bool show_table::browsable(object_p obj)
+// ----------------------------------------------------------------------------
+//   Check if an object should be shown as a table
+// ----------------------------------------------------------------------------
+{
+    list_p li = obj->as_array_or_list();
+    return li && li->items() > SHOW_TABLE_ITEMS;
+}
+
+
+object_p show_table::item(size_t r, size_t c) const
+// ----------------------------------------------------------------------------
+//   Return the item at the given position
+// ----------------------------------------------------------------------------
+{
+    object_p obj = items->at(r);
+    if (matrix && obj)
+        if (list_p li = obj->as_array_or_list())
+            obj = li->at(c);
+    return obj;
+}
+
+
+text_p show_table::cell(size_t r, size_t c)
+// ----------------------------------------------------------------------------
+//   Return the rendered text for a cell, using the cache if possible
+// ----------------------------------------------------------------------------
+{
+    uint i = (r * columns + c) % SHOW_CELL_CACHE;
+    if (cached[i] && cached_row[i] == r && cached_col[i] == c)
+        return cached[i];
+
+    object_g obj = item(r, c);
+    if (!obj)
+        return nullptr;
+    renderer rd(nullptr, SHOW_CELL_LENGTH, true);
+    size_t   len = obj->render(rd);
+    utf8     out = rd.text();
+    if (rd.full())
+    {
+        // Drop any partial character at the end of a truncated cell
+        while (len && (out[len - 1] & 0xC0) == 0x80)
+            len--;
+        if (len && out[len - 1] >= 0xC0)
+            len--;
+    }
+    text_g   txt = text::make(out, len);
+    cached[i]     = txt;
+    cached_row[i] = r;
+    cached_col[i] = c;
+    return txt;
+}
+
+
+void show_table::draw(size_t r0, size_t c0, size_t vrows, size_t vcols)
+// ----------------------------------------------------------------------------
+//   Draw the visible window of the table
+// ----------------------------------------------------------------------------
+{
+    font_p font   = Settings.stack_font();
+    size   lh     = font->height();
+    char   buf[48];
+
+    Screen.fill(pattern::white);
+
+    // Header with the shape and the cursor position
+    if (matrix)
+        snprintf(buf, sizeof(buf), "%u×%u  [%u, %u]",
+                 uint(rows), uint(columns), uint(row + 1), uint(column + 1));
+    else
+        snprintf(buf, sizeof(buf), "%u items  [%u]",
+                 uint(rows), uint(row + 1));
+    Screen.text(2, 0, utf8(buf), font, pattern::black);
+    Screen.fill(0, lh, LCD_W - 1, lh, pattern::gray50);
+
+    // Row numbers
+    snprintf(buf, sizeof(buf), "%u", uint(rows));
+    size  labelw = font->width(utf8(buf)) + 4;
+    size  cellw  = (LCD_W - labelw) / vcols;
+    coord y      = lh + 2;
+    for (size_t r = r0; r < r0 + vrows && r < rows; r++)
+    {
+        snprintf(buf, sizeof(buf), "%u", uint(r + 1));
+        Screen.clip(0, y, labelw - 2, y + lh - 1);
+        Screen.text(2, y, utf8(buf), font, pattern::gray50);
+
+        for (size_t c = c0; c < c0 + vcols && c < columns; c++)
+        {
+            coord x  = labelw + (c - c0) * cellw;
+            coord x2 = x + cellw - 2;
+            bool  at = r == row && c == column;
+            Screen.clip(x, y, x2, y + lh - 1);
+            if (at)
+                Screen.fill(x, y, x2, y + lh - 1, pattern::black);
+            size_t len = 0;
+            if (text_p txt = cell(r, c))
+            {
+                utf8 out = txt->value(&len);
+                Screen.text(x + 2, y, out, len, font,
+                            at ? pattern::white : pattern::black);
+            }
+            else
+            {
+                break;
+            }
+        }
+        Screen.clip(0, 0, LCD_W, LCD_H);
+        y += lh;
+    }
+    Screen.clip(0, 0, LCD_W, LCD_H);
+}
+
+
+static object::result show_browse(object_r obj)
+// ----------------------------------------------------------------------------
+//   Browse a large list or matrix interactively
+// ----------------------------------------------------------------------------
+{
+    list_g     items = obj->as_array_or_list();
+    show_table table(items);
+    if (!table.rows || !table.columns)
+        return object::OK;
+
+    font_p  font    = Settings.stack_font();
+    size_t  vrows   = (LCD_H - font->height() - 2) / font->height();
+    size_t  vcols   = table.columns < SHOW_TABLE_COLUMNS
+                    ? table.columns : SHOW_TABLE_COLUMNS;
+    size_t  r0      = 0;
+    size_t  c0      = 0;
+    size_t  delta   = 1;
+    bool    running = true;
+    bool    edit    = false;
+    int     key     = 0;
+
+    ui.draw_graphics();
+    while (running)
+    {
+        // Keep the cursor in the visible window
+        if (table.row < r0)
+            r0 = table.row;
+        else if (table.row >= r0 + vrows)
+            r0 = table.row + 1 - vrows;
+        if (table.column < c0)
+            c0 = table.column;
+        else if (table.column >= c0 + vcols)
+            c0 = table.column + 1 - vcols;
+
+        table.draw(r0, c0, vrows, vcols);
+        if (rt.error())
+            break;
+        ui.draw_dirty(0, 0, LCD_W-1, LCD_H-1);
+        refresh_dirty();
+
+        bool update = false;
+        while (!update)
+        {
+            set_timer(TIMER1, 60);
+            if (usb_powered())
+                reset_auto_off();
+            power_check(true);
+
+            key = 0;
+            if (!key_empty())
+            {
+                key = key_pop();
+#if SIMULATOR
+                extern int last_key;
+                record(tests_rpl,
+                       "Show table popped key %d, last=%d", key, last_key);
+                process_test_key(key);
+#endif // SIMULATOR
+            }
+            switch(key)
+            {
+            case KEY_EXIT:
+            case KEY_BSP:
+                running = false;
+                update = true;
+                break;
+            case KEY_ENTER:
+                running = false;
+                update = true;
+                edit = true;
+                break;
+            case KEY_SHIFT:
+                delta = delta == 1 ? vrows : 1;
+                break;
+            case KEY_DOWN:
+            case KEY_2:
+                table.row = table.row + delta < table.rows
+                    ? table.row + delta : table.rows - 1;
+                update = true;
+                break;
+            case KEY_UP:
+            case KEY_8:
+                table.row = table.row > delta ? table.row - delta : 0;
+                update = true;
+                break;
+            case KEY_6:
+                table.column = table.column + delta < table.columns
+                    ? table.column + delta : table.columns - 1;
+                update = true;
+                break;
+            case KEY_4:
+                table.column = table.column > delta ? table.column - delta : 0;
+                update = true;
+                break;
+            case KEY_SCREENSHOT:
+                screenshot();
+                break;
+            case 0:
+                break;
+            default:
+                beep(440, 20);
+                break;
+            }
+#if SIMULATOR && !WASM
+            if (tests::running && test_command && key_empty())
+                process_test_commands();
+#endif // SIMULATOR && !WASM
+        }
+    }
+    sys_timer_disable(TIMER0);
+    sys_timer_disable(TIMER1);
+    redraw_lcd(true);
+
+    if (edit && !rt.error())
+    {
+        // Edit the cell, with the index to Put it back in the object
+        char buf[48];
+        if (table.matrix)
+            snprintf(buf, sizeof(buf), "{ %u %u } ",
+                     uint(table.row + 1), uint(table.column + 1));
+        else
+            snprintf(buf, sizeof(buf), "%u ", uint(table.row + 1));
+        if (object_p value = table.item(table.row, table.column))
+            return ui.insert_object(value, buf, " Put", true);
+    }
+    return rt.error() ? object::ERROR : object::OK;
+}
+
+
 COMMAND_BODY(Show)
 // ----------------------------------------------------------------------------
 //   Show the top-level of the stack graphically, using entire screen
@@ -1156,9 +1558,13 @@ object::result show(object_r obj)
 {
     if (obj)
     {
+        if (show_table::browsable(obj))
+            return show_browse(obj);
         grob_g graph = obj->graph(true);
         if (!graph)
         {
+            if (!rt.error() && obj->as_array_or_list())
+                return show_browse(obj);
             if (!rt.error())
                 rt.graph_does_not_fit_error();
             return object::ERROR;
@@ -2417,6 +2823,7 @@ COMMAND_BODY(Center)
             ppar.xmax = cx + w;
             ppar.ymin = cy - h;
             ppar.ymax = cy + h;
+            ppar.prepare();
             if (ppar.write())
             {
                 rt.drop();
@@ -99,6 +99,15 @@ struct PlotParametersAccess
 
     coord           pixel_x(algebraic_r pos) const;
     coord           pixel_y(algebraic_r pos) const;
+
+    void            prepare();
+    bool            fast_pixel(object_p pos, bool y, coord &result) const;
+    bool            fast_pixel(double pos, bool y, coord &result) const;
+
+    // Hardware floating-point copy of the ranges, see prepare()
+    double          dxmin, dxrange, dwidth;
+    double          dymax, dyrange, dheight;
+    bool            hwtransform;
 };
 
 
@@ -139,6 +148,23 @@ do                                                                      \
     }                                                                   \
 }                                                                       \
 while(0)
+#elif USE_NATIVE_LCD
+#define DISPLAY(op)                                                     \
+do                                                                      \
+{                                                                       \
+    grob_p pict = user_display();                                       \
+    if (pict)                                                           \
+    {                                                                   \
+        grob::surface display = pict->pixels();                         \
+        op;                                                             \
+    }                                                                   \
+    else                                                                \
+    {                                                                   \
+        surface display = Screen;                                       \
+        op;                                                             \
+    }                                                                   \
+}                                                                       \
+while(0)
 #else // !CONFIG_COLOR
 #define DISPLAY(op)                                     \
 do                                                      \
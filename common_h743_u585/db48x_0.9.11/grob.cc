@@ -574,6 +574,35 @@ RENDER_BODY(bitmap)
 
 
 
+// ============================================================================
+//
+//   Layout: Size of a graphic object, without pixels
+//
+// ============================================================================
+
+SIZE_BODY(layout)
+// ----------------------------------------------------------------------------
+//   A layout only holds the width and height
+// ----------------------------------------------------------------------------
+{
+    byte_p p = o->payload();
+    p = leb128skip(p);
+    p = leb128skip(p);
+    return ptrdiff(p, o);
+}
+
+
+RENDER_BODY(layout)
+// ----------------------------------------------------------------------------
+//  Render the layout size
+// ----------------------------------------------------------------------------
+{
+    r.printf("Layout %u x %u", o->width(), o->height());
+    return r.size();
+}
+
+
+
 #ifdef CONFIG_COLOR
 // ============================================================================
 //
@@ -617,8 +646,10 @@ RENDER_BODY(pixmap)
     }
     return r.size();
 }
+#endif // CONFIG_COLOR
 
 
+#if defined(CONFIG_COLOR) || USE_NATIVE_LCD
 // ============================================================================
 //
 //   Black and white patterns
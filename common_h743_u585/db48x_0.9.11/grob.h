@@ -41,6 +41,7 @@
 GCP(grob);
 GCP(bitmap);
 GCP(pixmap);
+GCP(layout);
 
 struct grob : object
 // ----------------------------------------------------------------------------
@@ -206,6 +207,8 @@ struct grob : object
         pixsize h        = 0;
         byte_p  bitmap   = pixels(&w, &h);
         pixsize scanline = type() == ID_grob ? (w + 7) / 8 * 8 : w;
+        if (type() == ID_layout)
+            return surface((pixword *) bitmap, w, h, scanline).clip(0, 0, -1, -1);
         return surface((pixword *) bitmap, w, h, scanline).clip(clip);
     }
 
@@ -278,6 +281,31 @@ public:
 };
 
 
+struct layout : grob
+// ----------------------------------------------------------------------------
+//   Size of a graphic object without any pixels, for measure-only passes
+// ----------------------------------------------------------------------------
+//   The surface of a layout has an empty clipping area, so that drawing into
+//   it or from it does nothing, but its width and height are those of the
+//   graphic object that would have been rendered.
+{
+    layout(id type, pixsize w, pixsize h): grob(type, w, h) {}
+
+    static layout_p make(pixsize w, pixsize h)
+    // ------------------------------------------------------------------------
+    //   Build a layout with the given size
+    // ------------------------------------------------------------------------
+    {
+        return rt.make<layout>(w, h);
+    }
+
+public:
+    OBJECT_DECL(layout);
+    SIZE_DECL(layout);
+    RENDER_DECL(layout);
+};
+
+
 #if CONFIG_COLOR
 struct pixmap : grob
 // ----------------------------------------------------------------------------
@@ -362,7 +390,8 @@ struct grapher
           background(bg),
           stack(stack),
           expression(expr),
-          graph(graph)
+          graph(graph),
+          measure(false)
     {}
 
     grapher(const grapher &other) = default;
@@ -370,7 +399,8 @@ struct grapher
     grob_p grob(size w, size h)
     {
         if (w <= maxw && h <= maxh && sys_current_ms() - start <= duration)
-            return Settings.CompatibleGROBs() ? grob::make(w, h)
+            return measure                    ? grob_p(layout::make(w, h))
+                 : Settings.CompatibleGROBs() ? grob::make(w, h)
                                               : bitmap::make(w, h);
         return nullptr;
     }
@@ -406,6 +436,7 @@ struct grapher
     bool          stack;
     bool          expression;
     bool          graph;
+    bool          measure;      // Only compute sizes, see object::fit_graph
 };
 
 #endif // GROB_H
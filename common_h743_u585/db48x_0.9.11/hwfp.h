@@ -216,7 +216,7 @@ struct hwfp : hwfp_base
         object::id ty  = flt ? ID_hwfloat : ID_hwdouble;
         uint       prc = flt ? 7 : 16;
         return x->type() == ty && y->type() == ty &&
-            Settings.HardwareFloatingPoint() && Settings.Precision() <= prc
+            Settings.HardwareFloatingPointEnabled() && Settings.Precision() <= prc
             ? hwfp_wrapper<code> : nullptr;
     }
 
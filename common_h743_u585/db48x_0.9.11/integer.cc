@@ -388,10 +388,12 @@ PARSE_BODY(integer)
             bresult = bbase * bresult; // Order matters for types
             bresult = bvalue + bresult;
 
+            // Scan remaining digits, then convert them all at once
+            size_t tail = 0;
             while (count--)
             {
-                v = value[*gs];
-                ++gs;
+                byte_p d = gs + tail++;
+                v = value[*d];
                 if (v == NODIGIT)
                     break;
 
@@ -405,14 +407,23 @@ PARSE_BODY(integer)
                         else
                             break;
                     }
-                    rt.based_digit_error().source(s - 1);
+                    rt.based_digit_error().source(d);
                     return err;
                 }
-                record(integer, "Digit %c value %u in bignum", s[-1], v);
-                bvalue  = rt.make<bignum>(type, v);
-                bresult = bbase * bresult; // Order matters for types
+                record(integer, "Digit %c value %u in bignum", *d, v);
+            }
+            size_t ndigits = v >= base ? tail - 1 : tail;
+            if (ndigits)
+            {
+                bignum_g bcount = rt.make<bignum>(ID_bignum, ndigits);
+                bignum_g bscale = bignum::pow(bbase, bcount);
+                bvalue  = bignum::from_digits(type, gcutf8(gs), ndigits, base);
+                if (!bscale || !bvalue)
+                    return ERROR;
+                bresult = bscale * bresult;
                 bresult = bvalue + bresult;
             }
+            gs += tail;
 
             s    = gs;
             endp = ge;
@@ -599,16 +610,6 @@ static size_t render_num(renderer &r,
 //   This is necessary because the arm-none-eabi-gcc printf can't do 64-bit
 //   I'm getting non-sensible output
 {
-    // If we render to a file, need to first render to scratchpad to be able to
-    // revert the digits in memory before writing
-    if (r.file_save())
-    {
-        renderer tmp(r.expression(), r.editing(), r.stack());
-        size_t result = render_num(tmp, num, base, fmt);
-        r.put(tmp.text(), result);
-        return result;
-    }
-
     // Upper / lower rendering
     bool upper = *fmt == '^';
     bool lower = *fmt == 'v';
@@ -653,33 +654,42 @@ static size_t render_num(renderer &r,
     else
         r.flush();
 
-    // Get denominator for the base
-    size_t findex = r.size();
+    // Keep dividing by the base until we get 0, filling the buffer from the
+    // end so that digits come out in order. The worst case is 64 binary
+    // digits, each followed by a 4-byte separator.
+    byte   buffer[64 * 5];
+    byte  *end    = buffer + sizeof(buffer);
+    byte  *p      = end;
+    byte   sepbuf[4];
+    size_t seplen = spacing ? utf8_encode(space, sepbuf) : 0;
     ularge n      = num->value<ularge>();
-
-    // Keep dividing by the base until we get 0
-    uint sep = 0;
+    uint   sep    = 0;
     do
     {
         ularge digit = n % base;
         n /= base;
-        unicode c = upper        ? fancy_upper_digits[digit]
-                  : lower        ? fancy_lower_digits[digit]
-                  : (digit < 10) ? digit + '0'
-                                 : digit + ('A' - 10);
-        r.put(c);
+        if (upper || lower)
+        {
+            byte   enc[4];
+            size_t len = utf8_encode(upper ? fancy_upper_digits[digit]
+                                           : fancy_lower_digits[digit],
+                                     enc);
+            p -= len;
+            memcpy(p, enc, len);
+        }
+        else
+        {
+            *--p = digit < 10 ? digit + '0' : digit + ('A' - 10);
+        }
 
         if (n && ++sep == spacing)
         {
             sep = 0;
-            r.put(space);
+            p -= seplen;
+            memcpy(p, sepbuf, seplen);
         }
     } while (n);
-
-    // Revert the digits
-    byte *dest  = (byte *) r.text();
-    bool multibyte = upper || lower || (spacing && space > 0xFF);
-    utf8_reverse(dest + findex, dest + r.size(), multibyte);
+    r.put(cstring(p), end - p);
 
     // Add suffix
     if (fancy_base)
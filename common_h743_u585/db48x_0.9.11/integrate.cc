@@ -42,6 +42,8 @@
 #include "symbol.h"
 #include "tag.h"
 
+#include <cmath>
+
 RECORDER(integrate, 16, "Numerical integration");
 RECORDER(integrate_error, 16, "Numerical integrationsol");
 
@@ -130,6 +132,95 @@ NFUNCTION_BODY(Integrate)
 }
 
 
+static algebraic_p tanh_sinh(program_g            eq,
+                             const fast_function &fast,
+                             algebraic_g          lx,
+                             algebraic_g          hx,
+                             algebraic_g          eps)
+// ----------------------------------------------------------------------------
+//   Double-exponential (tanh-sinh) quadrature
+// ----------------------------------------------------------------------------
+//   With x = tanh(π/2 sinh t), the transformed integrand decays
+//   double-exponentially at both ends, which also handles integrable
+//   singularities at the endpoints. Each level halves the step h and only
+//   evaluates the new odd nodes, reusing the sum of the previous levels.
+//   Nodes are computed from s = exp(-π sinh t) to keep their distance to the
+//   endpoints accurate:
+//      distance to endpoint    d = (b-a)/2 * 2s/(1+s)
+//      weight                  w = π/2 cosh t * 4s/(1+s)^2
+{
+    algebraic_g one  = integer::make(1);
+    algebraic_g half = decimal::make(5, -1);
+    algebraic_g pi2  = algebraic::pi() * half;
+    algebraic_g hl   = (hx - lx) * half;
+    algebraic_g h    = one;
+    algebraic_g sum, prev, est, t, s, s1, d, w, x, y, dl, dh;
+    if (!one || !half || !pi2 || !hl)
+        return nullptr;
+
+    // Truncate the t range where s is well below the working precision
+    double tmax = std::asinh(2 * Settings.Precision() * 2.302585093 / M_PI);
+    int    max  = Settings.IntegrationIterations();
+
+    // Center node, t = 0
+    x   = lx + hl;
+    y   = fast.evaluate(eq, x);
+    sum = y * pi2;
+    if (!sum)
+        return nullptr;
+
+    for (int level = 0; level <= max && !program::interrupted(); level++)
+    {
+        ularge steps  = ularge(tmax * (ularge(1) << level));
+        ularge stride = level ? 2 : 1;
+        for (ularge j = 1; j <= steps; j += stride)
+        {
+            t  = h * algebraic_g(integer::make(j));
+            s  = pi2 * sinh::run(t);
+            s  = exp::run(-(s + s));
+            s1 = one + s;
+            d  = hl * (s + s) / s1;
+            w  = pi2 * cosh::run(t) * (s + s + s + s) / (s1 * s1);
+            x  = lx + d;
+            y  = hx - d;
+            dl = x - lx;
+            dh = hx - y;
+            if (!w || !dl || !dh)
+                return nullptr;
+
+            // Stop when nodes are no longer distinct from the endpoints
+            bool low  = !dl->is_zero(false);
+            bool high = !dh->is_zero(false);
+            if (!low && !high)
+                break;
+            if (low)
+                sum = sum + w * fast.evaluate(eq, x);
+            if (high && sum)
+                sum = sum + w * fast.evaluate(eq, y);
+            record(integrate, "[%d:%llu] t=%t sum=%t", level, j, +t, +sum);
+            if (!sum)
+                return nullptr;
+        }
+
+        // Check if we converged
+        est = sum * h * hl;
+        if (!est)
+            return nullptr;
+        if (prev)
+        {
+            x = est - prev;
+            if (smaller_magnitude(x, est * eps))
+                return est;
+        }
+        prev = est;
+        h = h * half;
+    }
+
+    rt.precision_loss_error();
+    return nullptr;
+}
+
+
 algebraic_p integrate(program_g   eq,
                       symbol_g    name,
                       algebraic_g lx,
@@ -179,6 +270,13 @@ algebraic_p integrate(program_g   eq,
     // Select numerical computations (doing this with fraction is slow)
     settings::SaveNumericalResults snr(true);
 
+    // Compile the function for hardware floating-point when possible
+    fast_function fast(eq, +name, fast_function::hardware());
+
+    // Double-exponential quadrature when selected
+    if (Settings.TanhSinhIntegration())
+        return tanh_sinh(eq, fast, lx, hx, eps);
+
     // Initial integration step and first trapezoidal step
     dv = two;
     algebraic_g hl2 = (hx - lx) * half;
@@ -213,7 +311,7 @@ algebraic_p integrate(program_g   eq,
             dx = hl2 * du;                        // (b-a)/2 du
 
             // Evaluate equation
-            y  = algebraic::evaluate_function(eq, x);
+            y  = fast.evaluate(eq, x);
 
             // Sum elements, and approximate when necessary
             sy = sy + y * dx;
@@ -29,8 +29,10 @@
 
 #include "library.h"
 
+#include "dmcp.h"
 #include "program.h"
 #include "renderer.h"
+#include "unit.h"
 
 
 RECORDER(library,         16, "Xlib objects");
@@ -202,6 +204,224 @@ utf8 library_menu::name(id type, size_t &len)
 }
 
 
+#if USE_XIP_LIBRARY
+// ============================================================================
+//
+//   Libraries installed in flash
+//
+// ============================================================================
+//   Library objects are copied in the QSPI user area the first time they are
+//   attached, and then used in place like ROM objects. They do not use any
+//   memory and do not need to be loaded again. The area is erased when it is
+//   full, when the library configuration file changes, or when a previous
+//   install was interrupted. Flash words can only be programmed once after an
+//   erase, so a new entry is only written where the area is still blank, and
+//   each entry carries a checksum so that one that did not verify is ignored.
+
+#define XIP_MAGIC       0x42494C58      // "XLIB"
+#define XIP_ENTRY       0x59525445      // "ETRY"
+#define XIP_WORD        32              // Flash write granularity
+
+struct xip_header
+// ----------------------------------------------------------------------------
+//   Header of the flash area, identifies the library configuration
+// ----------------------------------------------------------------------------
+{
+    uint32_t    magic;                  // XIP_MAGIC
+    uint32_t    stamp;                  // Modification time of library.csv
+    uint32_t    size;                   // Size of library.csv
+    uint32_t    padding[5];             // Up to one flash word
+};
+
+
+struct xip_entry
+// ----------------------------------------------------------------------------
+//   An entry in flash, followed by the library name and the object
+// ----------------------------------------------------------------------------
+{
+    uint32_t    magic;                  // XIP_ENTRY
+    uint32_t    name_size;              // Size of the name
+    uint32_t    object_size;            // Size of the object
+    uint32_t    checksum;               // FNV-1a of the name and object
+};
+
+
+static bool xip_current(xip_header &current)
+// ----------------------------------------------------------------------------
+//   Build the header for the current configuration, check if flash has it
+// ----------------------------------------------------------------------------
+{
+    unit_file cfile(xlib::library.file);
+    current = xip_header();
+    current.magic = XIP_MAGIC;
+    current.stamp = cfile.modified();
+    current.size  = cfile.size();
+
+    const xip_header *header = (const xip_header *) qspi_user_addr();
+    return (header->magic == current.magic &&
+            header->stamp == current.stamp &&
+            header->size  == current.size);
+}
+
+
+static uint32_t xip_checksum(byte_p data, size_t size,
+                             uint32_t hash = 2166136261u)
+// ----------------------------------------------------------------------------
+//   Checksum of the name and object of an entry
+// ----------------------------------------------------------------------------
+{
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+
+static bool xip_blank(size_t offset, size_t size)
+// ----------------------------------------------------------------------------
+//   Check if a part of the flash area is erased
+// ----------------------------------------------------------------------------
+{
+    byte_p base = qspi_user_addr();
+    for (size_t i = 0; i < size; i++)
+        if (base[offset + i] != 0xFF)
+            return false;
+    return true;
+}
+
+
+static inline size_t xip_padded(size_t size)
+// ----------------------------------------------------------------------------
+//   Round a size up to whole flash words
+// ----------------------------------------------------------------------------
+{
+    return (size + XIP_WORD - 1) / XIP_WORD * XIP_WORD;
+}
+
+
+static object_p xip_find(utf8 name, size_t len, size_t &end)
+// ----------------------------------------------------------------------------
+//   Find a library object in flash, or return where the entries end
+// ----------------------------------------------------------------------------
+{
+    byte_p base   = qspi_user_addr();
+    size_t size   = qspi_user_size();
+    size_t offset = sizeof(xip_header);
+    while (offset + sizeof(xip_entry) <= size)
+    {
+        const xip_entry *entry = (const xip_entry *) (base + offset);
+        if (entry->magic != XIP_ENTRY)
+            break;
+        size_t esize = xip_padded(sizeof(xip_entry) +
+                                  entry->name_size + entry->object_size);
+        if (esize > size - offset)
+            break;
+        byte_p ename = (byte_p) (entry + 1);
+        if (entry->name_size == len && memcmp(ename, name, len) == 0 &&
+            entry->checksum == xip_checksum(ename,
+                                            len + entry->object_size))
+        {
+            end = offset;
+            return object_p(ename + len);
+        }
+        offset += esize;
+    }
+    end = offset;
+    return nullptr;
+}
+
+
+static object_p xip_install(utf8 name, size_t len, object_p value)
+// ----------------------------------------------------------------------------
+//   Copy a library object in flash, return the copy
+// ----------------------------------------------------------------------------
+{
+    // Objects may point to the flash area, so it can only be erased at boot
+    xip_header current;
+    size_t     end = 0;
+    if (!xip_current(current))
+        return nullptr;
+    if (object_p existing = xip_find(name, len, end))
+        return existing;
+
+    size_t vsize = value->size();
+    size_t total = xip_padded(sizeof(xip_entry) + len + vsize);
+    if (end + total > size_t(qspi_user_size()))
+        return nullptr;
+
+    // Words left by an interrupted install cannot be programmed again
+    if (!xip_blank(end, total))
+    {
+        record(library, "Flash at %u is not blank, not installing", end);
+        return nullptr;
+    }
+
+    // Write one flash word at a time, the word with the magic number last
+    uint32_t  sum   = xip_checksum(byte_p(value), vsize,
+                                   xip_checksum(name, len));
+    xip_entry entry = { XIP_ENTRY, uint32_t(len), uint32_t(vsize), sum };
+    byte_p    eptr  = (byte_p) &entry;
+    byte_p    vptr  = (byte_p) value;
+    byte      word[XIP_WORD];
+    for (size_t o = XIP_WORD; o <= total; o += XIP_WORD)
+    {
+        size_t w = o < total ? o : 0;
+        for (size_t i = 0; i < XIP_WORD; i++)
+        {
+            size_t b = w + i;
+            byte   c = 0xFF;
+            if (b < sizeof(entry))
+                c = eptr[b];
+            else if ((b -= sizeof(entry)) < len)
+                c = name[b];
+            else if ((b -= len) < vsize)
+                c = vptr[b];
+            word[i] = c;
+        }
+        if (qspi_user_write(word, XIP_WORD, end + w, 0))
+            return nullptr;
+    }
+
+    // An entry that does not verify fails its checksum and is skipped
+    byte_p   written = qspi_user_addr() + end;
+    object_p result  = object_p(written + sizeof(entry) + len);
+    if (memcmp(written, &entry, sizeof(entry)) != 0 ||
+        memcmp(written + sizeof(entry), name, len) != 0 ||
+        memcmp(result, value, vsize) != 0)
+    {
+        record(library, "Flash verification failed for %.*s", int(len), name);
+        return nullptr;
+    }
+    record(library, "Installed %.*s in flash at %p", int(len), name, result);
+    return result;
+}
+
+
+void xlib::prepare_flash()
+// ----------------------------------------------------------------------------
+//   At boot, erase the flash area if it is stale or mostly full
+// ----------------------------------------------------------------------------
+//   This must be called before any object can refer to the flash area
+{
+    if (!sys_disk_ok())
+        return;
+
+    xip_header current;
+    size_t     end   = 0;
+    size_t     room  = qspi_user_size();
+    bool       valid = xip_current(current);
+    if (valid)
+    {
+        xip_find(nullptr, ~0U, end);
+        if (end + room / 8 <= room && xip_blank(end, room - end))
+            return;
+    }
+    record(library, "Erasing flash area, %+s",
+           valid ? "full or damaged" : "stale");
+    qspi_user_write((uint8_t *) &current, sizeof(current), 0, 1);
+}
+#endif // USE_XIP_LIBRARY
+
+
 object_p xlib::attach() const
 // ----------------------------------------------------------------------------
 //   Attach the library at the given index
@@ -218,11 +438,30 @@ object_p xlib::attach() const
             if (!rt.attach(idx+1))
                 return nullptr;;
 
-        value = xl->value();
+#if USE_XIP_LIBRARY
+        // Check if the library was installed in flash
+        xip_header current;
+        size_t     end  = 0;
+        size_t     nlen = 0;
+        utf8       name = xl->name(&nlen);
+        if (name && xip_current(current))
+            value = xip_find(name, nlen, end);
         if (!value)
+#endif // USE_XIP_LIBRARY
         {
-            rt.invalid_xlib_error();
-            return nullptr;
+            value = xl->value();
+            if (!value)
+            {
+                rt.invalid_xlib_error();
+                return nullptr;
+            }
+#if USE_XIP_LIBRARY
+            object_g loaded = value;
+            name = xl->name(&nlen);
+            value = name ? xip_install(name, nlen, loaded) : nullptr;
+            if (!value)
+                value = loaded;
+#endif // USE_XIP_LIBRARY
         }
         rt.xlib(idx, value);
         cleaner::disable();
@@ -81,6 +81,9 @@ struct xlib : constant
     object_p            detach() const;
     static bool         operation(object_p obj, object_p (xlib::*op)() const);
     static xlib_p       from_object(object_p obj);
+#if USE_XIP_LIBRARY
+    static void         prepare_flash();
+#endif // USE_XIP_LIBRARY
 
     static const config library;
     OBJECT_DECL(xlib);
@@ -30,11 +30,17 @@
 #include "list.h"
 
 #include "algebraic.h"
+#include "arithmetic.h"
 #include "array.h"
 #include "compare.h"
 #include "constants.h"
+#include "decimal.h"
 #include "expression.h"
+#include "fraction.h"
+#include "functions.h"
 #include "grob.h"
+#include "hwfp.h"
+#include "integer.h"
 #include "locals.h"
 #include "parser.h"
 #include "polynomial.h"
@@ -43,10 +49,12 @@
 #include "renderer.h"
 #include "runtime.h"
 #include "symbol.h"
+#include "sysmenu.h"
 #include "unit.h"
 #include "utf8.h"
 #include "variables.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -573,6 +581,10 @@ intptr_t list::list_render(renderer &r, unicode open, unicode close) const
     // Loop on all objects inside the list
     for (object_g obj : *list)
     {
+        // Stop rendering items once the output budget is exhausted
+        if (r.full())
+            return r.size();
+
         id oty = obj->type();
         if (oty == ID_program || oty == ID_list || oty == ID_array)
         {
@@ -1041,6 +1053,15 @@ list_p list::list_from_stack(uint depth, id ty)
 //  Make a list from the stack as an object
 // ----------------------------------------------------------------------------
 {
+    // Room for the copy in the scratchpad and for the resulting list
+    size_t size = 0;
+    for (uint i = 0; i < depth; i++)
+        if (object_p obj = rt.stack(i))
+            size += obj->size();
+    reservation room(2 * size + leb128size(ty) + leb128size(size));
+    if (!room)
+        return nullptr;
+
     scribble scr;
     for (uint i = 0; i < depth; i++)
         if (object_g obj = rt.stack(depth + ~i))
@@ -1230,6 +1251,64 @@ COMMAND_BODY(GetI)
 }
 
 
+static bool put_in_place(symbol_r name, object_p items, bool increment)
+// ----------------------------------------------------------------------------
+//   Overwrite an element of a list or array stored in a variable
+// ----------------------------------------------------------------------------
+//   When the new element encodes with the same size as the one it replaces,
+//   the bytes of the variable can be overwritten directly, instead of
+//   building a new list and storing it back, which is O(N) for each PUT.
+//   Any reference to the old value, e.g. on the stack, is cloned first.
+//   Like a regular store, the change is journaled, and caches keyed on
+//   directory::generation are invalidated.
+{
+    if (!rt.is_global(items) || !object::is_array_or_list(items->type()))
+        return false;
+
+    // Only update variables in the current path, e.g. not local values
+    directory *dir = nullptr;
+    for (uint depth = 0; (dir = rt.variables(depth)); depth++)
+        if (object_p found = dir->lookup(+name))
+            if (found->skip() == items)
+                break;
+    if (!dir)
+        return false;
+
+    object_g value = rt.top();
+    object_g old   = items->at(rt.stack(1));
+    if (!old || !value)
+        return false;
+    size_t size = old->size();
+    if (value->size() != size || old->type() == object::ID_directory)
+        return false;
+
+    rt.clone_global(items, items->size());
+    value = rt.top();
+    memmove((byte *) +old, (byte_p) +value, size);
+    record(list, "Put in place %t at %p", +value, +old);
+    directory::globals_moved();
+#if USE_STATE_JOURNAL
+    state_journal(dir, +name, items);
+#endif // USE_STATE_JOURNAL
+
+    if (increment)
+    {
+        object_g index = rt.stack(1);
+        bool wrap = items->next_index(&+index);
+        if (!index)
+            return false;
+        rt.stack(1, +index);
+        Settings.IndexWrapped(wrap);
+        rt.drop(1);
+    }
+    else
+    {
+        rt.drop(3);
+    }
+    return true;
+}
+
+
 static object::result put(bool increment)
 // ----------------------------------------------------------------------------
 //   Put element in structure, incrementing index or not
@@ -1244,6 +1323,13 @@ static object::result put(bool increment)
             items = directory::recall_all(name, true);
             if (!items)
                 return object::ERROR;
+
+            // Fast path when the new element has the same size as the old
+            symbol_g sym = name;
+            if (put_in_place(sym, items, increment))
+                return object::OK;
+            if (rt.error())
+                return object::ERROR;
         }
 
         if (object_g result = items->at(rt.stack(1), rt.top()))
@@ -1525,15 +1611,101 @@ list_p list::tail() const
 }
 
 
+static object::id single_command(object_p prg)
+// ----------------------------------------------------------------------------
+//   Return the command in a program like « sin », or the command itself
+// ----------------------------------------------------------------------------
+{
+    if (!prg)
+        return object::ID_object;
+    if (prg->type() == object::ID_program)
+    {
+        object_p cmd = nullptr;
+        for (object_p obj : *program_p(prg))
+        {
+            if (cmd)
+                return object::ID_object;
+            cmd = obj;
+        }
+        prg = cmd;
+        if (!prg)
+            return object::ID_object;
+    }
+    return prg->type();
+}
+
+
+static algebraic_fn direct_function(object_p prg)
+// ----------------------------------------------------------------------------
+//   Check if the program is a built-in function we can call directly
+// ----------------------------------------------------------------------------
+//   This bypasses the RPL evaluator and the stack for each element
+{
+    switch (single_command(prg))
+    {
+#define DIRECT(fn)      case object::ID_##fn: return fn::evaluate;
+        DIRECT(sqrt);   DIRECT(cbrt);   DIRECT(sq);     DIRECT(cubed);
+        DIRECT(sin);    DIRECT(cos);    DIRECT(tan);
+        DIRECT(asin);   DIRECT(acos);   DIRECT(atan);
+        DIRECT(sinh);   DIRECT(cosh);   DIRECT(tanh);
+        DIRECT(asinh);  DIRECT(acosh);  DIRECT(atanh);
+        DIRECT(ln);     DIRECT(log10);  DIRECT(log2);   DIRECT(ln1p);
+        DIRECT(exp);    DIRECT(exp10);  DIRECT(exp2);   DIRECT(expm1);
+        DIRECT(erf);    DIRECT(erfc);   DIRECT(tgamma); DIRECT(lgamma);
+        DIRECT(abs);    DIRECT(sign);   DIRECT(neg);    DIRECT(inv);
+        DIRECT(IntPart);DIRECT(FracPart);DIRECT(ceil);  DIRECT(floor);
+        DIRECT(re);     DIRECT(im);     DIRECT(arg);    DIRECT(conj);
+#undef DIRECT
+    default:
+        return nullptr;
+    }
+}
+
+
+static arithmetic_fn direct_arithmetic(object_p prg)
+// ----------------------------------------------------------------------------
+//   Check if the program is a built-in arithmetic operator
+// ----------------------------------------------------------------------------
+{
+    switch (single_command(prg))
+    {
+    case object::ID_add:        return add::evaluate;
+    case object::ID_subtract:   return subtract::evaluate;
+    case object::ID_multiply:   return multiply::evaluate;
+    case object::ID_divide:     return divide::evaluate;
+    case object::ID_pow:        return pow::evaluate;
+    default:                    return nullptr;
+    }
+}
+
+
+static algebraic_p direct_argument(object_p obj)
+// ----------------------------------------------------------------------------
+//   Check if an element can be passed directly to a C++ function
+// ----------------------------------------------------------------------------
+//   Lists, arrays and polynomials have special cases in the stack-based
+//   evaluation of functions, so they go through the RPL evaluator.
+{
+    obj = object::strip(obj);
+    object::id ty = obj->type();
+    if (!object::is_algebraic(ty) || object::is_array_or_list(ty) ||
+        ty == object::ID_polynomial)
+        return nullptr;
+    return algebraic_p(obj);
+}
+
+
 list_p list::map(object_p prgobj) const
 // ----------------------------------------------------------------------------
 //   Apply an RPL object (nominally a program) on all elements in the list
 // ----------------------------------------------------------------------------
 {
-    id       ty    = type();
-    object_g prg   = prgobj;
-    size_t   depth = rt.depth();
-    scribble scr;
+    id           ty    = type();
+    object_g     prg   = prgobj;
+    size_t       depth = rt.depth();
+    algebraic_fn fn    = direct_function(prgobj);
+    algebraic_g  arg;
+    scribble     scr;
     for (object_p obj : *this)
     {
         id oty = obj->type();
@@ -1542,6 +1714,12 @@ list_p list::map(object_p prgobj) const
             list_g sub = list_p(obj)->map(prg);
             obj = +sub;
         }
+        else if (fn && (arg = direct_argument(obj)))
+        {
+            rt.command(object::static_object(single_command(prg)));
+            arg = fn(arg);
+            obj = +arg;
+        }
         else
         {
             if (!rt.push(obj))
@@ -1572,32 +1750,127 @@ error:
 }
 
 
+static bool native_reduce(list_p li, object::id op,
+                          object_g &result, size_t &done)
+// ----------------------------------------------------------------------------
+//   Sum or multiply leading integers or hardware doubles in machine words
+// ----------------------------------------------------------------------------
+//   This stops at the first item of another type, or when the integer
+//   accumulator would overflow. What was accumulated then becomes the first
+//   operand of the generic reduction, which promotes to bignums as needed.
+//   Sums of hardware doubles use Kahan compensation.
+{
+    if (op != object::ID_add && op != object::ID_multiply)
+        return true;
+
+    bool       add  = op == object::ID_add;
+    large      iacc = add ? 0 : 1;
+    double     facc = add ? 0 : 1;
+    double     comp = 0;
+    object::id kind = object::ID_object;
+    size_t     count = 0;
+    for (object_p obj : *li)
+    {
+        object::id ty = obj->type();
+        if (ty == object::ID_integer || ty == object::ID_neg_integer)
+        {
+            integer_p i = integer_p(obj);
+            if (kind == object::ID_hwdouble || !i->native())
+                break;
+            ularge mag = i->value<ularge>();
+            if (mag > ularge(INT64_MAX))
+                break;
+            large value = ty == object::ID_neg_integer ? -large(mag) : large(mag);
+            large next  = 0;
+            if (add ? __builtin_add_overflow(iacc, value, &next)
+                    : __builtin_mul_overflow(iacc, value, &next))
+                break;
+            iacc = next;
+            kind = object::ID_integer;
+        }
+        else if (ty == object::ID_hwdouble)
+        {
+            if (kind == object::ID_integer)
+                break;
+            double value = hwdouble_p(obj)->value();
+            if (add)
+            {
+                double y = value - comp;
+                double t = facc + y;
+                comp = (t - facc) - y;
+                facc = t;
+            }
+            else
+            {
+                facc *= value;
+            }
+            kind = object::ID_hwdouble;
+        }
+        else
+        {
+            break;
+        }
+        count++;
+    }
+
+    // Below two items, there is nothing to gain
+    if (count < 2)
+        return true;
+    if (kind == object::ID_integer)
+        result = integer::make(iacc);
+    else
+        result = hwdouble::make(facc);
+    if (!result)
+        return false;
+    done = count;
+    return true;
+}
+
+
 object_p list::reduce(object_p prgobj) const
 // ----------------------------------------------------------------------------
 //   Apply an RPL object (nominally a program) on pairs of list elements
 // ----------------------------------------------------------------------------
 {
-    object_g prg    = prgobj;
-    size_t   depth  = rt.depth();
-    object_g result = nullptr;
+    object_g      prg    = prgobj;
+    size_t        depth  = rt.depth();
+    object_g      result = nullptr;
+    arithmetic_fn fn     = direct_arithmetic(prgobj);
+    algebraic_g   x, y;
+    size_t        skip   = 0;
+    if (!native_reduce(this, prgobj->type(), result, skip))
+        goto error;
     for (object_p obj : *this)
     {
-        if (!rt.push(obj))
-            goto error;
+        if (skip)
+        {
+            skip--;
+            continue;
+        }
         if (!result)
         {
             result = obj;
+            continue;
         }
-        else
+        if (fn && (x = direct_argument(result)) && (y = direct_argument(obj)))
         {
-            if (program::run(prg, true) != OK)
+            // Built-in operator: accumulate without using the stack
+            rt.command(object::static_object(single_command(prg)));
+            x = fn(x, y);
+            result = +x;
+            if (!result)
                 goto error;
-            if (rt.depth() != depth + 1)
-                rt.misbehaving_program_error();
-            result = rt.top();
+            continue;
         }
+        if (!rt.push(result) || !rt.push(obj))
+            goto error;
+        if (program::run(prg, true) != OK)
+            goto error;
+        if (rt.depth() != depth + 1)
+            rt.misbehaving_program_error();
         if (rt.error())
             goto error;
+        result = rt.pop();
     }
     if (rt.depth() > depth)
         rt.drop(rt.depth() - depth);
@@ -1664,14 +1937,25 @@ list_p list::pair_map(object_p prgobj) const
 //   Apply an RPL object (nominally a program) to combine successive elements
 // ----------------------------------------------------------------------------
 {
-    id       ty    = type();
-    object_g prg   = prgobj;
-    size_t   depth = rt.depth();
-    object_g prev;
-    scribble scr;
+    id            ty    = type();
+    object_g      prg   = prgobj;
+    size_t        depth = rt.depth();
+    arithmetic_fn fn    = direct_arithmetic(prgobj);
+    algebraic_g   x, y;
+    object_g      prev;
+    scribble      scr;
     for (object_g obj : *this)
     {
-        if (prev)
+        if (prev && fn &&
+            (x = direct_argument(obj)) && (y = direct_argument(prev)))
+        {
+            // Built-in operator: same argument order as from the stack
+            rt.command(object::static_object(single_command(prg)));
+            x = fn(x, y);
+            if (!x || !rt.append(+x))
+                goto error;
+        }
+        else if (prev)
         {
             if (!rt.push(obj) || !rt.push(prev))
                 goto error;
@@ -2737,6 +3021,114 @@ symbol_p list::contains(symbol_p vsym) const
 }
 
 
+#ifndef LIST_INDEX_STRIDE
+#define LIST_INDEX_STRIDE       16
+#endif
+
+#ifndef LIST_INDEX_CHECKPOINTS
+#define LIST_INDEX_CHECKPOINTS  64
+#endif
+
+#ifndef LIST_INDEX_CACHE
+#define LIST_INDEX_CACHE        2
+#endif
+
+struct list_index
+// ----------------------------------------------------------------------------
+//   Checkpoints recording the offset of every stride-th element of a list
+// ----------------------------------------------------------------------------
+//   Offsets are relative to the first object, so they remain valid when the
+//   garbage collector moves the list, which the gcp takes care of. A global
+//   list can be overwritten in place by a store, so the index also records
+//   the directory generation and the size of the list it was built for.
+{
+    list_g      items;
+    uint        generation;
+    size_t      length;
+    size_t      stride;
+    uint        count;
+    uint        used;
+    uint32_t    offsets[LIST_INDEX_CHECKPOINTS];
+};
+
+
+object_p list::at(size_t index) const
+// ----------------------------------------------------------------------------
+//   Return the n-th element in the list
+// ----------------------------------------------------------------------------
+//   For large indexes, we lazily build a table of checkpoints for the list,
+//   so that walking a large list by index does not become quadratic.
+//   When the table is full, we drop every other checkpoint and double the
+//   stride, so that the cost of an access remains bounded by the stride.
+{
+    if (index < LIST_INDEX_STRIDE)
+        return *iterator(this, index);
+
+    static list_index indexes[LIST_INDEX_CACHE];
+    static uint       clock = 0;
+
+    size_t      length = this->size();
+    list_index *e      = nullptr;
+    for (uint i = 0; i < LIST_INDEX_CACHE && !e; i++)
+        if (+indexes[i].items == this &&
+            indexes[i].generation == directory::generation &&
+            indexes[i].length == length)
+            e = &indexes[i];
+    if (!e)
+    {
+        // Reuse the entry for this list if it is stale
+        for (uint i = 0; i < LIST_INDEX_CACHE && !e; i++)
+            if (+indexes[i].items == this)
+                e = &indexes[i];
+    }
+    if (!e)
+    {
+        e = &indexes[0];
+        for (uint i = 1; i < LIST_INDEX_CACHE; i++)
+            if (indexes[i].used < e->used)
+                e = &indexes[i];
+    }
+    if (+e->items != this ||
+        e->generation != directory::generation ||
+        e->length != length)
+    {
+        record(list, "Building index for %p", this);
+        e->items = this;
+        e->generation = directory::generation;
+        e->length = length;
+        e->stride = LIST_INDEX_STRIDE;
+        e->count = 1;
+        e->offsets[0] = 0;
+    }
+    e->used = ++clock;
+
+    size_t size  = 0;
+    byte_p first = byte_p(objects(&size));
+    size_t check = index / e->stride;
+    if (check >= e->count)
+        check = e->count - 1;
+    size_t offset = e->offsets[check];
+    size_t pos    = check * e->stride;
+    while (pos < index && offset < size)
+    {
+        offset += object_p(first + offset)->size();
+        pos++;
+        if (pos == e->count * e->stride && offset < size)
+        {
+            if (e->count >= LIST_INDEX_CHECKPOINTS)
+            {
+                for (uint i = 0; i < LIST_INDEX_CHECKPOINTS / 2; i++)
+                    e->offsets[i] = e->offsets[2 * i];
+                e->count = LIST_INDEX_CHECKPOINTS / 2;
+                e->stride *= 2;
+            }
+            e->offsets[e->count++] = offset;
+        }
+    }
+    return offset < size ? object_p(first + offset) : nullptr;
+}
+
+
 object_p list::row(size_t index) const
 // ----------------------------------------------------------------------------
 //   Return the given row or item
@@ -2800,6 +3192,174 @@ list_p list::sort() const
 }
 
 
+static bool sort_key(object_p obj, double &key)
+// ----------------------------------------------------------------------------
+//   Compute a floating-point key for real numbers
+// ----------------------------------------------------------------------------
+{
+    switch (obj->type())
+    {
+    case object::ID_integer:
+        key = double(integer_p(obj)->value<ularge>());
+        return true;
+    case object::ID_neg_integer:
+        key = -double(integer_p(obj)->value<ularge>());
+        return true;
+    case object::ID_fraction:
+    case object::ID_neg_fraction:
+    {
+        fraction_p f = fraction_p(obj);
+        key = double(f->numerator_value()) / double(f->denominator_value());
+        if (obj->type() == object::ID_neg_fraction)
+            key = -key;
+        return true;
+    }
+    case object::ID_decimal:
+    case object::ID_neg_decimal:
+        key = decimal_p(obj)->to_double();
+        return key == key;
+    case object::ID_hwfloat:
+        key = hwfloat_p(obj)->value();
+        return key == key;
+    case object::ID_hwdouble:
+        key = hwdouble_p(obj)->value();
+        return key == key;
+    default:
+        return false;
+    }
+}
+
+
+struct sort_index
+// ----------------------------------------------------------------------------
+//   Keys and permutation for a decorated value sort, in the scratchpad
+// ----------------------------------------------------------------------------
+//   Computing the value comparison for numbers is expensive, since it
+//   performs a subtraction. For real numbers, we precompute a double key
+//   once per item, and only use the full comparison when keys are too close
+//   to decide, or for items that have no key. The stack items themselves
+//   are not moved, and the permutation is kept in the scratchpad.
+//   Since the scratchpad moves when objects are created, which can happen
+//   during the full comparison, everything is located by offset.
+{
+    sort_index(): count(0), offset(0), size(0) {}
+    ~sort_index()
+    {
+        if (size)
+            rt.free(size);
+    }
+
+    bool allocate(size_t n)
+    {
+        size_t sz = n * (sizeof(double) + 2 * sizeof(uint32_t));
+        offset = rt.allocated();
+        if (!rt.allocate(sz))
+            return false;
+        count = n;
+        size = sz;
+        return true;
+    }
+
+    byte *base() const { return rt.scratchpad() - rt.allocated() + offset; }
+    double key(size_t i) const
+    {
+        double v;
+        memcpy(&v, base() + i * sizeof(double), sizeof(double));
+        return v;
+    }
+    void key(size_t i, double v) const
+    {
+        memcpy(base() + i * sizeof(double), &v, sizeof(double));
+    }
+    byte *perm(uint buf, size_t i) const
+    {
+        return base() + count * (sizeof(double) + buf * sizeof(uint32_t))
+            + i * sizeof(uint32_t);
+    }
+    uint32_t index(uint buf, size_t i) const
+    {
+        uint32_t v;
+        memcpy(&v, perm(buf, i), sizeof(v));
+        return v;
+    }
+    void index(uint buf, size_t i, uint32_t v) const
+    {
+        memcpy(perm(buf, i), &v, sizeof(v));
+    }
+
+    int  compare(uint32_t x, uint32_t y, bool reverse) const;
+    uint sort(bool reverse) const;
+
+    size_t count;
+    size_t offset;
+    size_t size;
+};
+
+
+int sort_index::compare(uint32_t x, uint32_t y, bool reverse) const
+// ----------------------------------------------------------------------------
+//   Compare stack items x and y, using keys when they decide
+// ----------------------------------------------------------------------------
+{
+    double kx = key(x);
+    double ky = key(y);
+    if (kx == kx && ky == ky)
+    {
+        // Keys may be rounded, only trust them when clearly distinct
+        double d   = kx - ky;
+        double tol = 1e-12 * (kx < 0 ? -kx : kx) + 1e-12 * (ky < 0 ? -ky : ky);
+        if (d > tol)
+            return reverse ? -1 : 1;
+        if (d < -tol)
+            return reverse ? 1 : -1;
+    }
+    object_p xo = rt.stack(x);
+    object_p yo = rt.stack(y);
+    int result = value_compare(&xo, &yo);
+    return reverse ? -result : result;
+}
+
+
+uint sort_index::sort(bool reverse) const
+// ----------------------------------------------------------------------------
+//   Bottom-up merge sort of the permutation, return the buffer holding it
+// ----------------------------------------------------------------------------
+{
+    uint src = 0;
+    for (size_t width = 1; width < count; width *= 2)
+    {
+        uint dst = 1 - src;
+        for (size_t lo = 0; lo < count; lo += 2 * width)
+        {
+            size_t mid = lo + width < count ? lo + width : count;
+            size_t hi  = mid + width < count ? mid + width : count;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+            {
+                uint32_t a = index(src, i);
+                uint32_t b = index(src, j);
+                if (compare(a, b, reverse) <= 0)
+                {
+                    index(dst, k++, a);
+                    i++;
+                }
+                else
+                {
+                    index(dst, k++, b);
+                    j++;
+                }
+            }
+            while (i < mid)
+                index(dst, k++, index(src, i++));
+            while (j < hi)
+                index(dst, k++, index(src, j++));
+        }
+        src = dst;
+    }
+    return src;
+}
+
+
 list_p list::sort(int (*compare)(object_p *x, object_p *y)) const
 // ----------------------------------------------------------------------------
 //  Return a sorted list based on the given comparison function
@@ -2814,6 +3374,38 @@ list_p list::sort(int (*compare)(object_p *x, object_p *y)) const
             return nullptr;
 
     size_t count = sdr.count();
+    bool   reverse = compare == value_compare_reverse;
+    if (count > 1 && (compare == value_compare || reverse))
+    {
+        // Decorate with keys, sort the permutation, undecorate
+        sort_index keys;
+        if (!keys.allocate(count))
+            return nullptr;
+        for (size_t i = 0; i < count; i++)
+        {
+            double k;
+            if (!sort_key(rt.stack(i), k))
+                k = NAN;
+            keys.key(i, k);
+            keys.index(0, i, i);
+        }
+        uint buf = keys.sort(reverse);
+        if (rt.error())
+            return nullptr;
+
+        list_g result = nullptr;
+        {
+            scribble scr;
+            for (size_t i = 0; i < count; i++)
+                if (object_g obj = rt.stack(keys.index(buf, i)))
+                    if (!rt.append(obj))
+                        return nullptr;
+            result = list::make(ty, scr.scratch(), scr.growth());
+        }
+        rt.drop(count);
+        return result;
+    }
+
     if (cmp)
         qsort(rt.stack_base(), count, sizeof(object_p), cmp);
 
@@ -265,13 +265,10 @@ struct list : text
     }
 
 
-    object_p at(size_t index) const
+    object_p at(size_t index) const;
     // ------------------------------------------------------------------------
     //   Return the n-th element in the list
     // ------------------------------------------------------------------------
-    {
-        return *iterator(this, index);
-    }
 
 
     template<typename ...args>
@@ -152,6 +152,23 @@ object::result logical::evaluate(id ty,
 #endif // CONFIG_FIXED_BASED_OBJECTS
     case ID_based_bignum:
     {
+        // Based numbers of 64 bits at most, e.g. #FFFFFFFFFFFFFFFFh
+        size_t ws = Settings.WordSize();
+        id     ty = is_based(xt) ? xt : yt;
+        ularge xv = 0, yv = 0;
+        if (ws <= 64 && is_based(ty) &&
+            bignum::based_word(x, xv) && bignum::based_word(y, yv))
+        {
+            ularge value = native(yv, xv);
+            if (ws < 64)
+                value &= (1ULL << ws) - 1ULL;
+            rt.pop();
+            algebraic_p result = bignum::based_word(ty, value);
+            if (result && rt.top(result))
+                return OK;
+            return ERROR; // Out of memory
+        }
+
         if (!is_bignum(xt))
             xt = bignum_promotion(x);
         if (!is_bignum(yt))
@@ -266,6 +283,20 @@ object::result logical::evaluate(id ty,
 #endif
     case ID_based_bignum:
     {
+        // Based numbers of 64 bits at most, e.g. #FFFFFFFFFFFFFFFFh
+        size_t ws = Settings.WordSize();
+        ularge xv = 0;
+        if (ws <= 64 && is_based(xt) && bignum::based_word(x, xv))
+        {
+            ularge value = native(xv);
+            if (ws < 64)
+                value &= (1ULL << ws) - 1ULL;
+            algebraic_p result = bignum::based_word(xt, value);
+            if (result && rt.top(result))
+                return OK;
+            return ERROR; // Out of memory
+        }
+
         if (!is_bignum(xt))
             xt = bignum_promotion(x);
 
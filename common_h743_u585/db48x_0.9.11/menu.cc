@@ -455,7 +455,7 @@ MENU(NumbersMenu,
      "Σ",       ID_Sum,
      "∏",       ID_Product,
      "QuoRem",  ID_Div2,
-     "Factors", ID_Unimplemented,
+     "Factors", ID_Factors,
      "Ran#",    ID_RandomNumber,
      "Random",  ID_Random,
 
@@ -467,9 +467,11 @@ MENU(NumbersMenu,
      RandomGeneratorOrder::label,       ID_RandomGeneratorOrder,
 
      "→Int",    ID_ToInteger,
-     "IsPrime", ID_Unimplemented,
-     "NextPr",  ID_Unimplemented,
-     "PrevPr",  ID_Unimplemented);
+     "IsPrime", ID_IsPrime,
+     "NextPr",  ID_NextPrime,
+     "PrevPr",  ID_PrevPrime,
+     "PowMod",  ID_PowMod,
+     "ModInv",  ID_ModInv);
 
 
 MENU(AnglesMenu,
@@ -621,7 +623,7 @@ MENU(PolynomialsMenu,
      "MRoot",   ID_Unimplemented,
      "MSolvr",  ID_Unimplemented,
      "PCoef",   ID_Unimplemented,
-     "PRoot",   ID_Unimplemented,
+     "PRoot",   ID_PolynomialRoots,
      "Root",    ID_Root,
 
      "Solve",   ID_Unimplemented,
@@ -790,7 +792,8 @@ MENU(StatisticsMenu,
      "Bins",    ID_FrequencyBins,
      "PopVar",  ID_PopulationVariance,
      "PopSDev", ID_PopulationStandardDeviation,
-     "PCovar",  ID_PopulationCovariance);
+     "PCovar",  ID_PopulationCovariance,
+     "PCTile",  ID_Percentile);
 
 
 MENU(SignalProcessingMenu,
@@ -950,6 +953,8 @@ MENU(DebugMenu,
 
      "Run",             ID_Run,
      "ErrDbg",          ID_DebugOnError,
+     "Compile",         ID_CompilePrograms,
+     "Memo",            ID_MemoizeFunctions,
      "Prog",            ID_ProgramMenu);
 
 
@@ -1228,7 +1233,8 @@ MENU(IntegrationMenu,
      "Indep",   ID_Unimplemented,
 
      "Σ",       ID_Sum,
-     "∏",       ID_Product);
+     "∏",       ID_Product,
+     "TanhSh",  ID_TanhSinhIntegration);
 
 MENU(SolverMenu,
 // ----------------------------------------------------------------------------
@@ -1600,6 +1606,7 @@ MENU(FilesMenu,
      "Voltage", ID_BatteryVoltage,
      "USB?",    ID_USBPowered,
      "Low?",    ID_LowBattery,
+     "Pack",    ID_CompressFiles,
      "Save",    ID_Unimplemented,
      "Load",    ID_Unimplemented,
      "Open",    ID_Unimplemented,
@@ -1739,7 +1746,11 @@ MENU(MemoryMenu,
      "Bytes",   ID_Bytes,
 
      "GC Clr", ID_GCStatsClearAfterRead,
-     "RT Clr", ID_RunStatsClearAfterRead
+     "RT Clr", ID_RunStatsClearAfterRead,
+     "Bench",  ID_Benchmark,
+     "Profile",ID_Profile,
+     "Prof",   ID_ProfileCommands,
+     "MemMap", ID_MemoryMap
 );
 
 
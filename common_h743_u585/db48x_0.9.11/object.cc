@@ -181,6 +181,55 @@ const object::dispatch object::handler[NUM_IDS] =
 };
 
 
+template <typename Obj>
+static constexpr byte size_class_of(size_t (*)(const Obj *))
+// ----------------------------------------------------------------------------
+//   Types with their own SIZE handler need to call it
+// ----------------------------------------------------------------------------
+{
+    return object::SIZE_HANDLER;
+}
+
+
+static constexpr byte size_class_of(size_t (*)(const object *))
+// ----------------------------------------------------------------------------
+//   Types inheriting object::do_size only contain the ID
+// ----------------------------------------------------------------------------
+{
+    return object::SIZE_ID;
+}
+
+
+static constexpr byte size_class_of(size_t (*)(const integer *))
+// ----------------------------------------------------------------------------
+//   Types inheriting integer::do_size contain a single LEB128 value
+// ----------------------------------------------------------------------------
+{
+    return object::SIZE_LEB128;
+}
+
+
+static constexpr byte size_class_of(size_t (*)(const text *))
+// ----------------------------------------------------------------------------
+//   Types inheriting text::do_size have a LEB128 length and a payload
+// ----------------------------------------------------------------------------
+{
+    return object::SIZE_PREFIXED;
+}
+
+
+const byte object::size_classes[NUM_IDS] =
+// ----------------------------------------------------------------------------
+//   Table of size computations for each object type
+// ----------------------------------------------------------------------------
+{
+#define ID(id)          NAMED(id,#id)
+#define CMD(id)         ID(id)
+#define NAMED(id, label)        [ID_##id] = size_class_of(&id::do_size),
+#include "ids.tbl"
+};
+
+
 static inline unicode tolow(unicode cp)
 // ----------------------------------------------------------------------------
 //  A cheap version of tolower for ASCII letters
@@ -1075,6 +1124,30 @@ grob_p object::graph(grapher &g) const
 }
 
 
+grob_p object::fit_graph(grapher &g, bool autoscale) const
+// ----------------------------------------------------------------------------
+//   Find the largest font where the object fits, then render it
+// ----------------------------------------------------------------------------
+//   Each attempt with a font that is too large used to rasterize the whole
+//   object before finding that the outer grob did not fit. Attempts are now
+//   made with layouts, which have the size of the grobs but no pixels, and
+//   the object is rasterized only once with the font that was selected.
+{
+    object_g obj    = this;
+    grob_g   result = nullptr;
+    {
+        save<bool> smeasure(g.measure, true);
+        do
+        {
+            result = obj->graph(g);
+        } while (!result && !rt.error() && autoscale && g.reduce_font());
+    }
+    if (!result || result->type() != ID_layout)
+        return result;
+    return obj->graph(g);
+}
+
+
 grob_p object::as_grob() const
 // ----------------------------------------------------------------------------
 //   Return object as a graphic object
@@ -1803,6 +1876,7 @@ bool object::is_big() const
     case ID_list:
     case ID_program:
     case ID_block:
+    case ID_compiled:
     case ID_array:
     case ID_expression:
         for (object_p o : *(list_p(this)))
@@ -1870,6 +1944,7 @@ int object::type_value(id ty)
         case object::ID_symbol:                 type = 6; break;
         case object::ID_local:                  type = 7; break;
         case object::ID_block:
+        case object::ID_compiled:
         case object::ID_locals:
         case object::ID_program:                type = 8; break;
         case object::ID_fraction:
@@ -276,12 +276,41 @@ struct object
     }
 
 
+    enum size_class : byte
+    // ------------------------------------------------------------------------
+    //   How to compute the size of an object without calling its handler
+    // ------------------------------------------------------------------------
+    {
+        SIZE_HANDLER,           // Call the SIZE handler for the type
+        SIZE_ID,                // Only the ID, e.g. commands
+        SIZE_LEB128,            // ID and one LEB128 value, e.g. integers
+        SIZE_PREFIXED,          // ID, LEB128 length and payload, e.g. text
+    };
+
+
     size_t size() const
     // ------------------------------------------------------------------------
-    //  Compute the size of the object by calling the handler with SIZE
+    //  Compute the size of the object
     // ------------------------------------------------------------------------
+    //  Most objects use one of the common layouts, which are computed inline.
+    //  This matters since skip() is used everywhere we walk memory.
     {
-        return ops().size(this);
+        id     ty = type();
+        byte_p p  = payload();
+        switch (size_classes[ty])
+        {
+        case SIZE_ID:
+            return ptrdiff(p, this);
+        case SIZE_LEB128:
+            return ptrdiff(p, this) + leb128size(p);
+        case SIZE_PREFIXED:
+        {
+            size_t sz = leb128<size_t>(p);
+            return ptrdiff(p + sz, this);
+        }
+        default:
+            return handler[ty].size(this);
+        }
     }
 
 
@@ -362,6 +391,12 @@ struct object
     //   Render like for the `Show` command
     // ------------------------------------------------------------------------
 
+
+    grob_p fit_graph(grapher &g, bool autoscale) const;
+    // ------------------------------------------------------------------------
+    //   Select the font with a measure-only pass, then render once
+    // ------------------------------------------------------------------------
+
 #ifdef DM42
 #  pragma GCC pop_options
 #endif
@@ -587,7 +622,7 @@ struct object
 
 
         template <ids first, ids last>
-        static INLINE bool in_range(id ty)
+        static constexpr INLINE bool in_range(id ty)
         // --------------------------------------------------------------------
         //   Check if a  given type is in the given range
         // --------------------------------------------------------------------
@@ -596,7 +631,7 @@ struct object
         }
 
         template <ids first, ids last, ids more, ids ...rest>
-        static INLINE bool in_range(id ty)
+        static constexpr INLINE bool in_range(id ty)
         // --------------------------------------------------------------------
         //   Check if a  given type is in the given ranges
         // --------------------------------------------------------------------
@@ -607,7 +642,7 @@ struct object
 
 #define ID(x)
 #define ID_RANGE(name, ...)                                             \
-        static INLINE bool name(id ty)                                  \
+        static constexpr INLINE bool name(id ty)                        \
         /* ------------------------------------------------------- */   \
         /*   Range-based type checking (faster than memory reads)  */   \
         /* ------------------------------------------------------- */   \
@@ -620,7 +655,7 @@ struct object
 
 #define ID(x)
 #define ID_RANGE(name, ...)                                             \
-    static INLINE bool name(id ty)                                      \
+    static constexpr INLINE bool name(id ty)                            \
     /* ------------------------------------------------------- */       \
     /*   Range-based type checking (faster than memory reads)  */       \
     /* ------------------------------------------------------- */       \
@@ -984,6 +1019,7 @@ struct object
 
 protected:
     static const dispatch   handler[NUM_IDS];
+    static const byte       size_classes[NUM_IDS];
 
 #if DEBUG
 public:
@@ -42,6 +42,8 @@
 #include "target.h"
 #include "variables.h"
 
+RECORDER(plot, 16, "Plotting");
+
 
 void draw_axes(const PlotParametersAccess &ppar)
 // ----------------------------------------------------------------------------
@@ -131,6 +133,585 @@ uint draw_data(array::iterator &it, array::iterator &end,
 
 
 
+static void draw_plot_error(const PlotParametersAccess &ppar,
+                            algebraic_r x,
+                            bool marker)
+// ----------------------------------------------------------------------------
+//   Show an evaluation error while plotting
+// ----------------------------------------------------------------------------
+{
+    if (marker)
+    {
+        error_save ers;
+        rt.clear_error();
+        size     dh    = display_height();
+        uint64_t errbg = Settings.PlotErrorBackground();
+        coord    rx    = ppar.pixel_x(x);
+        coord    ry    = ppar.pixel_y(ppar.yorigin);
+        if (ry < 0)
+            ry = 0;
+        else if (ry >= coord(dh))
+            ry = dh - 1;
+        rect r(rx, ry - LCD_H/32, rx, ry + LCD_H/32);
+        DISPLAY(display.fill(r, errbg));
+        ui.draw_dirty(r);
+    }
+    if (!rt.error())
+        rt.invalid_function_error();
+    uint64_t fg = Settings.Foreground();
+    uint64_t bg = Settings.Background();
+    DISPLAY(display.text(0, 0, rt.error(), ErrorFont, bg, fg));
+    ui.draw_dirty(0, 0, LCD_W, ErrorFont->height());
+    rt.clear_error();
+}
+
+
+// ============================================================================
+//
+//   Adaptive function plotting
+//
+// ============================================================================
+//
+//   With AdaptivePlotSampling, function plots are drawn in two passes.
+//   The first pass evaluates the function every PLOT_ADAPTIVE_STEP pixels
+//   and shows these samples immediately. The second pass connects them,
+//   subdividing an interval when its midpoint is away from the chord or
+//   when the curve jumps by more than PLOT_ADAPTIVE_JUMP pixels.
+//   Flat regions cost a fraction of the evaluations of a fixed step, and
+//   steep regions get sub-pixel samples that fill the gaps.
+
+#ifndef PLOT_ADAPTIVE_STEP
+// Pixel distance between samples in the first adaptive pass
+#define PLOT_ADAPTIVE_STEP      4
+#endif // PLOT_ADAPTIVE_STEP
+
+#ifndef PLOT_ADAPTIVE_DEPTH
+// Maximum number of subdivisions of an interval of the first pass
+#define PLOT_ADAPTIVE_DEPTH     4
+#endif // PLOT_ADAPTIVE_DEPTH
+
+#ifndef PLOT_ADAPTIVE_JUMP
+// Vertical pixel distance that forces subdivision of an interval
+#define PLOT_ADAPTIVE_JUMP      16
+#endif // PLOT_ADAPTIVE_JUMP
+
+struct adaptive_plot
+// ----------------------------------------------------------------------------
+//   State for adaptive plotting of a function
+// ----------------------------------------------------------------------------
+{
+    struct sample
+    {
+        algebraic_g x;
+        coord       px, py;
+        bool        valid;
+    };
+
+    adaptive_plot(const PlotParametersAccess &ppar,
+                  program_r eq, const fast_function &fast)
+        : ppar(ppar), eq(eq), fast(fast),
+          lw(Settings.LineWidth()), fg(Settings.Foreground()),
+          split(Settings.NoCurveFilling()), start(sys_current_ms())
+    {}
+
+    void evaluate(sample &s)
+    // ------------------------------------------------------------------------
+    //   Evaluate the function at the sample position
+    // ------------------------------------------------------------------------
+    {
+        algebraic_g y = fast.evaluate(eq, s.x);
+        s.valid = y;
+        if (s.valid)
+        {
+            s.px = ppar.pixel_x(s.x);
+            s.py = ppar.pixel_y(y);
+        }
+        else
+        {
+            draw_plot_error(ppar, s.x, true);
+        }
+    }
+
+    void draw(const sample &a, const sample &b)
+    // ------------------------------------------------------------------------
+    //   Draw a segment (or just the end point when curves are not filled)
+    // ------------------------------------------------------------------------
+    {
+        const sample &f = split ? b : a;
+        DISPLAY(display.line(f.px, f.py, b.px, b.py, lw, fg));
+        ui.draw_dirty(std::min(f.px, b.px), std::min(f.py, b.py),
+                      std::max(f.px, b.px), std::max(f.py, b.py));
+        refresh();
+    }
+
+    void refresh()
+    // ------------------------------------------------------------------------
+    //   Periodically update the screen
+    // ------------------------------------------------------------------------
+    {
+        uint now = sys_current_ms();
+        if (now - start >= Settings.PlotRefreshRate())
+        {
+            refresh_dirty();
+            start = sys_current_ms();
+        }
+    }
+
+    bool refine(const sample &a, const sample &b, uint depth)
+    // ------------------------------------------------------------------------
+    //   Connect two samples, subdividing where the curve is not flat
+    // ------------------------------------------------------------------------
+    {
+        if (program::interrupted())
+            return false;
+
+        coord dx = b.px - a.px;
+        coord dy = a.valid && b.valid ? std::abs(b.py - a.py) : 0;
+        if (depth >= PLOT_ADAPTIVE_DEPTH || (dx <= 1 && dy <= 1))
+        {
+            if (a.valid && b.valid)
+                draw(a, b);
+            return true;
+        }
+
+        sample m;
+        m.x = (a.x + b.x) / integer::make(2);
+        if (!m.x)
+            return false;
+        evaluate(m);
+        if (a.valid && b.valid && m.valid && dy <= PLOT_ADAPTIVE_JUMP)
+        {
+            coord chord = (a.py + b.py) / 2;
+            if (std::abs(m.py - chord) <= 1)
+            {
+                draw(a, m);
+                draw(m, b);
+                return true;
+            }
+        }
+        if (!a.valid && !b.valid && !m.valid)
+            return true;
+        return refine(a, m, depth + 1) && refine(m, b, depth + 1);
+    }
+
+    const PlotParametersAccess &ppar;
+    program_g                   eq;
+    const fast_function        &fast;
+    size                        lw;
+    uint64_t                    fg;
+    bool                        split;
+    uint                        start;
+};
+
+
+static object::result draw_adaptive_plot(const PlotParametersAccess &ppar,
+                                         program_r           eq,
+                                         const fast_function &fast,
+                                         algebraic_r          min,
+                                         algebraic_r          max)
+// ----------------------------------------------------------------------------
+//   Draw a function plot with progressive refinement
+// ----------------------------------------------------------------------------
+{
+    typedef adaptive_plot::sample sample;
+    adaptive_plot plot(ppar, eq, fast);
+    size          width = display_width();
+    uint          count = width / PLOT_ADAPTIVE_STEP;
+    if (!count)
+        count = 1;
+    algebraic_g   range = max - min;
+    algebraic_g   scale = integer::make(count);
+
+    // First pass: coarse samples, shown as points right away
+    coord px[count + 1];
+    coord py[count + 1];
+    bool  valid[count + 1];
+    for (uint k = 0; k <= count; k++)
+    {
+        if (program::interrupted())
+            return object::OK;
+        sample s;
+        s.x = min + range * algebraic_g(integer::make(k)) / scale;
+        if (!s.x)
+            return object::ERROR;
+        plot.evaluate(s);
+        px[k] = s.px;
+        py[k] = s.py;
+        valid[k] = s.valid;
+        if (s.valid)
+            plot.draw(s, s);
+    }
+    refresh_dirty();
+
+    // Second pass: connect the samples, refining where necessary
+    sample lo, hi;
+    for (uint k = 0; k < count; k++)
+    {
+        lo.x = min + range * algebraic_g(integer::make(k)) / scale;
+        hi.x = min + range * algebraic_g(integer::make(k + 1)) / scale;
+        if (!lo.x || !hi.x)
+            return object::ERROR;
+        lo.px = px[k];
+        lo.py = py[k];
+        lo.valid = valid[k];
+        hi.px = px[k + 1];
+        hi.py = py[k + 1];
+        hi.valid = valid[k + 1];
+        if (!plot.refine(lo, hi, 0))
+            break;
+    }
+    return object::OK;
+}
+
+
+// ============================================================================
+//
+//   Plot sample cache
+//
+// ============================================================================
+//
+//   The samples of the last equation plot are kept as a list of x and y
+//   values, along with what their evaluation depends on: the equation, the
+//   independent variable, the settings, the current directory and global
+//   variables. Redrawing the same plot, e.g. after leaving it, replays the
+//   samples without evaluating anything. After a pan or zoom, samples that
+//   fall exactly on the new sampling points are reused, and only the
+//   missing ones are evaluated. Large lists go to extended memory if any.
+
+#ifndef PLOT_SAMPLE_CACHE
+// Maximum number of samples kept from the last plot, 0 to disable
+#define PLOT_SAMPLE_CACHE       1024
+#endif // PLOT_SAMPLE_CACHE
+
+struct plot_sample_cache
+// ----------------------------------------------------------------------------
+//   The samples from the last plot and what they depend on
+// ----------------------------------------------------------------------------
+{
+    program_g   equation;
+    symbol_g    independent;
+    list_g      samples;
+    directory_p directory;
+    uint        settings;
+    uint        generation;
+
+    static plot_sample_cache &current()
+    {
+        static plot_sample_cache cache;
+        return cache;
+    }
+};
+
+
+struct plot_samples
+// ----------------------------------------------------------------------------
+//   Look up cached samples and record new ones while plotting
+// ----------------------------------------------------------------------------
+//   Samples must be looked up in increasing x order, which is the order
+//   in which they were recorded. Recorded samples accumulate on the stack.
+{
+    plot_samples(program_r eq, symbol_r independent)
+        : sdr(), it(), end(), count(0), valid(false),
+          enabled(PLOT_SAMPLE_CACHE > 0 && eq && independent),
+          settings(Settings.hash()), equation(eq), name(independent)
+    {
+        plot_sample_cache &cache = plot_sample_cache::current();
+        valid = enabled && cache.samples && cache.equation &&
+            cache.independent && cache.settings == settings &&
+            cache.directory == rt.variables(0) &&
+            cache.generation == directory::generation &&
+            eq->is_same_as(+cache.equation) &&
+            independent->is_same_as(+cache.independent);
+        if (valid)
+        {
+            it = cache.samples->begin();
+            end = cache.samples->end();
+        }
+    }
+
+    ~plot_samples()
+    // ------------------------------------------------------------------------
+    //   Save the recorded samples for the next plot
+    // ------------------------------------------------------------------------
+    {
+        if (!enabled)
+            return;
+        plot_sample_cache &cache = plot_sample_cache::current();
+        error_save ers;
+        cache.samples = list::list_from_stack(sdr.count(), object::ID_list);
+        if (cache.samples)
+        {
+            if (!valid)
+            {
+                cache.equation = program_p(rt.clone(+equation));
+                cache.independent = symbol_p(rt.clone(+name));
+            }
+            cache.directory = rt.variables(0);
+            cache.settings = settings;
+            cache.generation = directory::generation;
+        }
+        record(plot, "Cached %u samples, %+s", count,
+               cache.samples ? "saved" : "failed");
+        rt.clear_error();
+    }
+
+    algebraic_p lookup(algebraic_r x)
+    // ------------------------------------------------------------------------
+    //   Return the cached value for x if there is one
+    // ------------------------------------------------------------------------
+    {
+        while (valid && it != end)
+        {
+            algebraic_g cx  = algebraic_p(*it);
+            int         cmp = 0;
+            if (!comparison::compare(&cmp, cx, x))
+            {
+                rt.clear_error();
+                valid = false;
+                break;
+            }
+            if (cmp > 0)
+                break;
+            ++it;
+            if (it == end)
+                break;
+            algebraic_p cy = algebraic_p(*it);
+            ++it;
+            if (cmp == 0)
+                return cy;
+        }
+        return nullptr;
+    }
+
+    void remember(algebraic_r x, algebraic_r y)
+    // ------------------------------------------------------------------------
+    //   Record a sample for the next plot
+    // ------------------------------------------------------------------------
+    {
+        if (enabled && count < PLOT_SAMPLE_CACHE)
+            if (rt.push(+x) && rt.push(+y))
+                count++;
+    }
+
+    stack_depth_restore sdr;
+    list::iterator      it, end;
+    uint                count;
+    bool                valid;
+    bool                enabled;
+    uint                settings;
+    program_g           equation;
+    symbol_g            name;
+};
+
+
+// ============================================================================
+//
+//   Multiple function plots
+//
+// ============================================================================
+//
+//   When EQ contains a list of functions, they are all plotted in a single
+//   pass over x. The x value of each sample and its pixel column are
+//   computed once and shared by all functions, using hardware doubles when
+//   the plot range allows it. Each function is drawn with its own pen, and
+//   the screen area changed in a column is marked dirty once for all.
+
+#ifndef PLOT_FUNCTIONS
+// Maximum number of functions from a list plotted together
+#define PLOT_FUNCTIONS          8
+#endif // PLOT_FUNCTIONS
+
+struct plot_curve
+// ----------------------------------------------------------------------------
+//   One of the functions being plotted, with its pen and last point
+// ----------------------------------------------------------------------------
+{
+    plot_curve()
+        : eq(), fast(program_g(), nullptr, false), lx(-1), ly(-1), pen(0)
+    {}
+
+    static uint64_t pen_for(uint index)
+    // ------------------------------------------------------------------------
+    //   Select a pen for a curve, the first one using the foreground
+    // ------------------------------------------------------------------------
+    //   On monochrome systems, these colors are rendered as distinct shades
+    {
+        static const pattern pens[] =
+        {
+            pattern(  0,   0, 192),
+            pattern(192,   0,   0),
+            pattern(  0, 128,   0),
+            pattern(160,  96,   0),
+            pattern(128,   0, 160),
+            pattern(  0, 128, 160),
+            pattern( 96,  96,  96),
+        };
+        const uint count = sizeof(pens) / sizeof(pens[0]);
+        if (!index)
+            return Settings.Foreground();
+        return pens[(index - 1) % count].bits;
+    }
+
+    program_g     eq;
+    fast_function fast;
+    coord         lx, ly;
+    uint64_t      pen;
+};
+
+
+static object::result draw_function_plots(const PlotParametersAccess &ppar,
+                                          list_r      functions,
+                                          algebraic_r min,
+                                          algebraic_r max,
+                                          algebraic_r step)
+// ----------------------------------------------------------------------------
+//   Plot all functions in a list with a shared sampling pass
+// ----------------------------------------------------------------------------
+{
+    plot_curve curves[PLOT_FUNCTIONS];
+    uint       count = 0;
+    for (object_p obj : *functions)
+    {
+        if (count >= PLOT_FUNCTIONS)
+        {
+            record(plot, "Only plotting the first %u functions", count);
+            break;
+        }
+        if (obj->type() == object::ID_equation)
+        {
+            obj = equation_p(obj)->value();
+            if (!obj)
+                return object::ERROR;
+        }
+        if (!obj->is_program())
+        {
+            rt.invalid_equation_error();
+            return object::ERROR;
+        }
+        plot_curve &c = curves[count];
+        c.eq = program_p(obj);
+        c.fast = fast_function(c.eq, +ppar.independent);
+        c.pen = plot_curve::pen_for(count);
+        count++;
+    }
+    if (!count)
+    {
+        rt.no_equation_error();
+        return object::ERROR;
+    }
+
+    // Step x with hardware doubles when the range can be represented.
+    // Interpreted functions still get x computed with the original types.
+    double dmin = 0, dmax = 0, dstep = 0;
+    bool   hw = (fast_function::real_value(+min, dmin) &&
+                 fast_function::real_value(+max, dmax) &&
+                 fast_function::real_value(+step, dstep) &&
+                 std::isfinite(dmin) && std::isfinite(dmax) &&
+                 dstep > 0 && std::isfinite(dstep));
+
+    bool        split = Settings.NoCurveFilling();
+    size        lw    = Settings.LineWidth();
+    uint        start = sys_current_ms();
+    algebraic_g x     = min;
+    algebraic_g y;
+    for (ularge k = 0; !program::interrupted(); k++)
+    {
+        double xd = dmin + double(k) * dstep;
+        if (hw)
+        {
+            // Tolerate rounding on the last sample, like decimal stepping
+            if (xd > dmax + dstep * 1e-6)
+                break;
+            x = nullptr;
+        }
+
+        coord rx = 0;
+        if (!hw || !ppar.fast_pixel(xd, false, rx))
+        {
+            if (!x)
+                x = min + step * algebraic_g(integer::make(k));
+            if (!x)
+                return object::ERROR;
+            rx = ppar.pixel_x(x);
+        }
+
+        coord dx0 = rx, dx1 = rx, dy0 = 0, dy1 = -1;
+        for (uint f = 0; f < count; f++)
+        {
+            plot_curve &c  = curves[f];
+            coord       ry = 0;
+            double      yd = 0;
+            bool        ok = false;
+            if (hw && c.fast.compiled() && c.fast.run(xd, yd) &&
+                ppar.fast_pixel(yd, true, ry))
+            {
+                ok = true;
+            }
+            else
+            {
+                if (!x)
+                    x = min + step * algebraic_g(integer::make(k));
+                if (!x)
+                    return object::ERROR;
+                y = c.fast.evaluate(c.eq, x);
+                ok = y;
+                if (ok)
+                    ry = ppar.pixel_y(y);
+            }
+
+            if (ok)
+            {
+                if (c.lx < 0 || split)
+                {
+                    c.lx = rx;
+                    c.ly = ry;
+                }
+                DISPLAY(display.line(c.lx, c.ly, rx, ry, lw, c.pen));
+                dx0 = std::min(dx0, c.lx);
+                dx1 = std::max(dx1, rx);
+                if (dy1 < dy0)
+                {
+                    dy0 = std::min(c.ly, ry);
+                    dy1 = std::max(c.ly, ry);
+                }
+                else
+                {
+                    dy0 = std::min(dy0, std::min(c.ly, ry));
+                    dy1 = std::max(dy1, std::max(c.ly, ry));
+                }
+                c.lx = rx;
+                c.ly = ry;
+            }
+            else
+            {
+                draw_plot_error(ppar, x, true);
+                c.lx = c.ly = -1;
+            }
+        }
+        if (dy1 >= dy0)
+            ui.draw_dirty(dx0, dy0, dx1, dy1);
+
+        if (!hw)
+        {
+            x = x + step;
+            algebraic_g cmp = x > max;
+            if (!cmp)
+                return object::ERROR;
+            if (cmp->as_truth(false))
+                break;
+        }
+
+        uint now = sys_current_ms();
+        if (now - start >= Settings.PlotRefreshRate())
+        {
+            refresh_dirty();
+            start = sys_current_ms();
+        }
+    }
+    return object::OK;
+}
+
+
 object::result draw_plot(object::id                  kind,
                          const PlotParametersAccess &ppar,
                          object_g                    to_plot = nullptr)
@@ -191,6 +772,7 @@ object::result draw_plot(object::id                  kind,
     }
 
     program_g       eq;
+    list_g          functions;
     array_g         data;
     array::iterator it, end;
     size_t          xcol = 0, ycol = 0;
@@ -207,12 +789,15 @@ object::result draw_plot(object::id                  kind,
                 return object::ERROR;
         }
 
-        if (!to_plot->is_program())
+        if (kind == object::ID_Function && to_plot->type() == object::ID_list)
+            functions = list_p(+to_plot);
+        else if (!to_plot->is_program())
         {
             rt.invalid_equation_error();
             return object::ERROR;
         }
-        eq = program_p(+to_plot);
+        else
+            eq = program_p(+to_plot);
     }
     else if (dname == object::ID_StatsData)
     {
@@ -242,14 +827,30 @@ object::result draw_plot(object::id                  kind,
     save<symbol_g *> iref(expression::independent,
                           (symbol_g *) &ppar.independent);
     settings::PrepareForFunctionEvaluation willEvaluateFunction;
+    fast_function fast(eq, +ppar.independent);
     if (ui.draw_graphics())
         if (Settings.DrawPlotAxes())
             draw_axes(ppar);
 
+    if (functions)
+    {
+        result = draw_function_plots(ppar, functions, min, max, step);
+        refresh_dirty();
+        return result;
+    }
+
+    if (kind == object::ID_Function && Settings.AdaptivePlotSampling() &&
+        ppar.resolution->is_zero())
+    {
+        result = draw_adaptive_plot(ppar, eq, fast, min, max);
+        refresh_dirty();
+        return result;
+    }
+
     bool     split_points = Settings.NoCurveFilling();
     size     lw           = Settings.LineWidth();
     uint64_t fg           = Settings.Foreground();
-    uint64_t errbg        = Settings.PlotErrorBackground();
+    plot_samples samples(eq, ppar.independent);
 
     while (!program::interrupted())
     {
@@ -258,7 +859,11 @@ object::result draw_plot(object::id                  kind,
         uint  dcount = 1;
         if (dname == object::ID_Equation)
         {
-            y = algebraic::evaluate_function(eq, x);
+            y = samples.lookup(x);
+            if (!y)
+                y = fast.evaluate(eq, x);
+            if (y)
+                samples.remember(x, y);
         }
         else
         {
@@ -330,29 +935,8 @@ object::result draw_plot(object::id                  kind,
         }
         else
         {
-            if (kind == object::ID_Function)
-            {
-                error_save ers;
-                rt.clear_error();
-                size dh = display_height();
-                rx = ppar.pixel_x(x);
-                ry = ppar.pixel_y(ppar.yorigin);
-                if (ry < 0)
-                    ry = 0;
-                else if (ry >= coord(dh))
-                    ry = dh - 1;
-                rect r(rx, ry - LCD_H/32, rx, ry + LCD_H/32);
-                DISPLAY(display.fill(r, errbg));
-                ui.draw_dirty(r);
-            }
-            if (!rt.error())
-                rt.invalid_function_error();
-            uint64_t fg = Settings.Foreground();
-            uint64_t bg = Settings.Background();
-            DISPLAY(display.text(0, 0, rt.error(), ErrorFont, bg, fg));
-            ui.draw_dirty(0, 0, LCD_W, ErrorFont->height());
+            draw_plot_error(ppar, x, kind == object::ID_Function);
             lx = ly = -1;
-            rt.clear_error();
         }
 
         if (kind != object::ID_Scatter)
@@ -29,7 +29,10 @@
 
 #include "polynomial.h"
 
+#include "algebraic.h"
 #include "arithmetic.h"
+#include "complex.h"
+#include "decimal.h"
 #include "expression.h"
 #include "grob.h"
 #include "integer.h"
@@ -38,6 +41,21 @@
 #include "variables.h"
 #include "util.h"
 
+#include <algorithm>
+#include <complex>
+
+RECORDER(polynomial, 16, "Polynomials");
+
+#ifndef POLYNOMIAL_KARATSUBA
+// Number of coefficients above which we use Karatsuba multiplication
+#define POLYNOMIAL_KARATSUBA    16
+#endif // POLYNOMIAL_KARATSUBA
+
+#ifndef POLYNOMIAL_ROOT_ITERATIONS
+// Maximum number of simultaneous iterations when computing polynomial roots
+#define POLYNOMIAL_ROOT_ITERATIONS      100
+#endif // POLYNOMIAL_ROOT_ITERATIONS
+
 
 polynomial_p polynomial::make(algebraic_p value)
 // ----------------------------------------------------------------------------
@@ -603,6 +621,421 @@ polynomial_p polynomial::sub(polynomial_r x, polynomial_r y)
 }
 
 
+// ============================================================================
+//
+//   Dense univariate polynomials
+//
+// ============================================================================
+//
+//   Polynomials with at most one variable are common (e.g. after collection
+//   in the main variable), and for those, multiplication and division can
+//   work on dense coefficient vectors instead of searching the sparse terms.
+//   The coefficients are kept on the stack so that they are GC-safe.
+//   Positions are counted from the bottom of the stack, which remains stable
+//   as temporaries are pushed on top.
+
+static inline algebraic_p dense_get(size_t pos)
+// ----------------------------------------------------------------------------
+//   Get the coefficient at a given absolute stack position
+// ----------------------------------------------------------------------------
+{
+    return algebraic_p(rt.stack(rt.depth() - 1 - pos));
+}
+
+
+static inline bool dense_set(size_t pos, algebraic_p value)
+// ----------------------------------------------------------------------------
+//   Set the coefficient at a given absolute stack position
+// ----------------------------------------------------------------------------
+{
+    return value && rt.stack(rt.depth() - 1 - pos, value);
+}
+
+
+static bool dense_variable(polynomial_r x, polynomial_r y, symbol_g &var)
+// ----------------------------------------------------------------------------
+//   Check if two polynomials share at most one variable
+// ----------------------------------------------------------------------------
+{
+    size_t xvars = x->variables();
+    size_t yvars = y->variables();
+    if (xvars > 1 || yvars > 1)
+        return false;
+    if (xvars && yvars)
+    {
+        size_t xlen = 0, ylen = 0;
+        utf8   xname = x->variable(0, &xlen);
+        utf8   yname = y->variable(0, &ylen);
+        if (xlen != ylen || symbol::compare(xname, yname, xlen) != 0)
+            return false;
+    }
+    var = nullptr;
+    if (xvars)
+        var = x->variable(size_t(0));
+    else if (yvars)
+        var = y->variable(size_t(0));
+    return true;
+}
+
+
+static bool dense_degree(polynomial_r x, ularge &degree, bool &exact)
+// ----------------------------------------------------------------------------
+//   Find the degree of a univariate polynomial, fail if it is too sparse
+// ----------------------------------------------------------------------------
+{
+    size_t nvars = x->variables();
+    size_t terms = 0;
+    degree = 0;
+    for (auto term : *x)
+    {
+        algebraic_p factor = term.factor();
+        if (!factor->is_fractionable())
+            exact = false;
+        ularge exp = nvars ? term.exponent() : 0;
+        if (degree < exp)
+            degree = exp;
+        terms++;
+    }
+
+    // Expanding x^1000+1 into a thousand coefficients would be wasteful
+    return degree < 2 * terms + POLYNOMIAL_KARATSUBA;
+}
+
+
+static bool dense_push(polynomial_r x, size_t count)
+// ----------------------------------------------------------------------------
+//   Push the coefficients of x on the stack, lowest exponent first
+// ----------------------------------------------------------------------------
+{
+    size_t      base  = rt.depth();
+    size_t      nvars = x->variables();
+    algebraic_g zero  = integer::make(0);
+    for (size_t i = 0; i < count; i++)
+        if (!rt.push(+zero))
+            return false;
+
+    for (auto term : *x)
+    {
+        algebraic_g factor = term.factor();
+        ularge      exp    = nvars ? term.exponent() : 0;
+        if (exp >= count)
+            continue;
+        algebraic_g existing = dense_get(base + exp);
+        if (!existing->is_zero(false))
+            factor = existing + factor;
+        if (!dense_set(base + exp, factor))
+            return false;
+    }
+    return true;
+}
+
+
+static bool dense_schoolbook(size_t x, size_t xn, size_t y, size_t yn)
+// ----------------------------------------------------------------------------
+//   Push the xn+yn-1 coefficients of the product of x and y
+// ----------------------------------------------------------------------------
+{
+    for (size_t k = 0; k + 1 < xn + yn; k++)
+    {
+        algebraic_g sum  = nullptr;
+        size_t      low  = k >= yn ? k - yn + 1 : 0;
+        size_t      high = k < xn ? k : xn - 1;
+        for (size_t i = low; i <= high; i++)
+        {
+            algebraic_g xf = dense_get(x + i);
+            if (xf->is_zero(false))
+                continue;
+            algebraic_g yf = dense_get(y + k - i);
+            if (yf->is_zero(false))
+                continue;
+            algebraic_g prod = xf * yf;
+            sum = sum ? sum + prod : prod;
+            if (!sum)
+                return false;
+        }
+        if (!sum)
+            sum = integer::make(0);
+        if (!sum || !rt.push(+sum))
+            return false;
+    }
+    return true;
+}
+
+
+static bool dense_karatsuba(size_t x, size_t y, size_t n)
+// ----------------------------------------------------------------------------
+//   Push the 2n-1 coefficients of the product of two n-coefficient vectors
+// ----------------------------------------------------------------------------
+//   With x = x1*X^h+x0 and y = y1*X^h+y0, the product is
+//   z2*X^2h + (z1-z2-z0)*X^h + z0, where z2=x1*y1, z0=x0*y0 and
+//   z1=(x1+x0)*(y1+y0), which requires three multiplications instead of four
+{
+    if (n < POLYNOMIAL_KARATSUBA)
+        return dense_schoolbook(x, n, y, n);
+
+    size_t lo   = n / 2;
+    size_t hi   = n - lo;
+    size_t base = rt.depth();
+
+    // Low and high products
+    size_t z0 = base;
+    if (!dense_karatsuba(x, y, lo))
+        return false;
+    size_t z2 = rt.depth();
+    if (!dense_karatsuba(x + lo, y + lo, hi))
+        return false;
+
+    // Sums of the halves
+    size_t sum[2] = { 0, 0 };
+    for (size_t s = 0; s < 2; s++)
+    {
+        size_t v = s ? y : x;
+        sum[s] = rt.depth();
+        for (size_t i = 0; i < hi; i++)
+        {
+            algebraic_g high = dense_get(v + lo + i);
+            if (i < lo)
+            {
+                algebraic_g low = dense_get(v + i);
+                high = high + low;
+                if (!high)
+                    return false;
+            }
+            if (!rt.push(+high))
+                return false;
+        }
+    }
+
+    // Middle product
+    size_t z1 = rt.depth();
+    if (!dense_karatsuba(sum[0], sum[1], hi))
+        return false;
+
+    // Recombine the three products
+    size_t      result = rt.depth();
+    size_t      count  = 2 * n - 1;
+    algebraic_g zero   = integer::make(0);
+    for (size_t k = 0; k < count; k++)
+    {
+        algebraic_g coef = k + 1 < 2 * lo ? dense_get(z0 + k) : +zero;
+        if (k >= 2 * lo)
+            coef = coef + algebraic_g(dense_get(z2 + k - 2 * lo));
+        if (k >= lo && k - lo + 1 < 2 * hi)
+        {
+            size_t      m   = k - lo;
+            algebraic_g mid = dense_get(z1 + m);
+            mid = mid - algebraic_g(dense_get(z2 + m));
+            if (m + 1 < 2 * lo)
+                mid = mid - algebraic_g(dense_get(z0 + m));
+            coef = coef + mid;
+        }
+        if (!coef || !rt.push(+coef))
+            return false;
+    }
+
+    // Move the result down where the caller expects it
+    for (size_t k = 0; k < count; k++)
+        if (!dense_set(base + k, dense_get(result + k)))
+            return false;
+    return rt.drop(rt.depth() - (base + count));
+}
+
+
+static polynomial_p dense_make(symbol_r var, size_t base, size_t count)
+// ----------------------------------------------------------------------------
+//   Build a polynomial from coefficients on the stack, highest exponent first
+// ----------------------------------------------------------------------------
+{
+    scribble scr;
+    byte    *p = rt.allocate(1);
+    if (!p)
+        return nullptr;
+    *p = var ? 1 : 0;
+    if (var)
+    {
+        size_t len = var->length();
+        p = rt.allocate(leb128size(len) + len);
+        if (!p)
+            return nullptr;
+        p = leb128(p, len);
+        memcpy(p, var->value(), len);
+    }
+
+    for (size_t k = count; k--; )
+    {
+        algebraic_g coef = dense_get(base + k);
+        if (coef->is_zero(false) || (!var && k))
+            continue;
+        size_t sz = coef->size();
+        p = rt.allocate(sz + (var ? leb128size(k) : 0));
+        if (!p)
+            return nullptr;
+        memcpy(p, +coef, sz);
+        if (var)
+            leb128(p + sz, k);
+    }
+
+    gcbytes data   = scr.scratch();
+    size_t  datasz = scr.growth();
+    return rt.make<polynomial>(data, datasz);
+}
+
+
+static polynomial_p dense_mul(polynomial_r x, polynomial_r y)
+// ----------------------------------------------------------------------------
+//   Multiply univariate polynomials, return nullptr if not applicable
+// ----------------------------------------------------------------------------
+{
+    symbol_g var;
+    ularge   xdeg = 0, ydeg = 0;
+    bool     exact = true;
+    if (!dense_variable(x, y, var)     ||
+        !dense_degree(x, xdeg, exact)  ||
+        !dense_degree(y, ydeg, exact))
+        return nullptr;
+
+    // Karatsuba only pays off with large operands of similar size, and
+    // is only used on exact coefficients to avoid cancellation errors
+    stack_depth_restore sdr;
+    size_t xn = xdeg + 1;
+    size_t yn = ydeg + 1;
+    size_t n  = xn > yn ? xn : yn;
+    size_t x0 = rt.depth();
+    if (exact && 2 * xn > n && 2 * yn > n && n >= POLYNOMIAL_KARATSUBA)
+    {
+        size_t y0 = x0 + n;
+        if (!dense_push(x, n) || !dense_push(y, n))
+            return nullptr;
+        if (!dense_karatsuba(x0, y0, n))
+            return nullptr;
+        return dense_make(var, y0 + n, 2 * n - 1);
+    }
+
+    size_t y0 = x0 + xn;
+    if (!dense_push(x, xn) || !dense_push(y, yn))
+        return nullptr;
+    if (!dense_schoolbook(x0, xn, y0, yn))
+        return nullptr;
+    return dense_make(var, y0 + yn, xn + yn - 1);
+}
+
+
+static bool dense_quorem(polynomial_r  x,
+                         polynomial_r  y,
+                         polynomial_g &q,
+                         polynomial_g &r,
+                         symbol_r      main)
+// ----------------------------------------------------------------------------
+//   Long division of univariate polynomials in the main variable
+// ----------------------------------------------------------------------------
+{
+    symbol_g var;
+    ularge   xdeg = 0, ydeg = 0;
+    bool     exact = true;
+    if (!dense_variable(x, y, var)     ||
+        (var && (!main || !var->is_same_as(main))) ||
+        !dense_degree(x, xdeg, exact)  ||
+        !dense_degree(y, ydeg, exact))
+        return false;
+
+    stack_depth_restore sdr;
+    size_t xn = xdeg + 1;
+    size_t yn = ydeg + 1;
+    size_t r0 = rt.depth();
+    size_t y0 = r0 + xn;
+    size_t q0 = y0 + yn;
+    if (!dense_push(x, xn) || !dense_push(y, yn))
+        return false;
+
+    // Find the actual leading coefficient of y
+    while (yn && dense_get(y0 + yn - 1)->is_zero(false))
+        yn--;
+    size_t qn = yn && xn >= yn ? xn - yn + 1 : 0;
+    if (!qn)
+    {
+        // Dividing by zero or by a higher-order polynomial
+        q = polynomial::make(integer::make(0));
+        r = x;
+        return true;
+    }
+    algebraic_g zero = integer::make(0);
+    for (size_t i = 0; i < qn; i++)
+        if (!rt.push(+zero))
+            return false;
+
+    algebraic_g lead = dense_get(y0 + yn - 1);
+    for (size_t k = xn; k-- >= yn; )
+    {
+        algebraic_g top = dense_get(r0 + k);
+        if (top->is_zero(false))
+            continue;
+        algebraic_g ratio = top / lead;
+        if (!dense_set(q0 + k - yn + 1, ratio) || !dense_set(r0 + k, zero))
+            return false;
+        for (size_t j = 0; j + 1 < yn; j++)
+        {
+            algebraic_g yf = dense_get(y0 + j);
+            if (yf->is_zero(false))
+                continue;
+            size_t      pos = r0 + k - yn + 1 + j;
+            algebraic_g rf  = dense_get(pos);
+            rf = rf - ratio * yf;
+            if (!dense_set(pos, rf))
+                return false;
+        }
+    }
+
+    q = dense_make(var, q0, qn);
+    r = q ? dense_make(var, r0, yn - 1) : nullptr;
+    return r;
+}
+
+
+static bool dense_horner(polynomial_r poly, algebraic_r x, algebraic_g &result)
+// ----------------------------------------------------------------------------
+//   Evaluate a univariate polynomial with decreasing exponents using Horner
+// ----------------------------------------------------------------------------
+//   Returns false if the terms are not sorted, in which case result is unset
+{
+    ularge last = 0;
+    bool   first = true;
+    for (auto term : *poly)
+    {
+        term.factor();
+        ularge exp = term.exponent();
+        if (!first && exp >= last)
+            return false;
+        last = exp;
+        first = false;
+    }
+
+    result = nullptr;
+    for (auto term : *poly)
+    {
+        algebraic_g factor = term.factor();
+        ularge      exp    = term.exponent();
+        if (result)
+        {
+            ularge      gap   = last - exp;
+            algebraic_g scale = gap == 1 ? x : algebraic_g(::pow(x, gap));
+            result = result * scale + factor;
+        }
+        else
+        {
+            result = factor;
+        }
+        if (!result)
+            return true;
+        last = exp;
+    }
+    if (!result)
+        result = integer::make(0);
+    else if (last)
+        result = result * (last == 1 ? x : algebraic_g(::pow(x, last)));
+    return true;
+}
+
+
 polynomial_p polynomial::mul(polynomial_r x, polynomial_r y)
 // ----------------------------------------------------------------------------
 //   Multiply two polynomials
@@ -610,6 +1043,10 @@ polynomial_p polynomial::mul(polynomial_r x, polynomial_r y)
 {
     if (!x || !y)
         return nullptr;
+    if (polynomial_p dense = dense_mul(x, y))
+        return dense;
+    if (rt.error())
+        return nullptr;
 
     scribble scr;
     gcbytes  result = copy_variables(x);
@@ -784,6 +1221,13 @@ bool polynomial::quorem(polynomial_r  x,
     if (!x || !y)
         return false;
 
+    // Fast path for univariate polynomials in the main variable
+    symbol_g     var    = main_variable();
+    if (dense_quorem(x, y, q, r, var))
+        return true;
+    if (rt.error())
+        return false;
+
     // Initial remainder and quotient
     r = x;
     q = polynomial::make(integer::make(0));
@@ -791,7 +1235,6 @@ bool polynomial::quorem(polynomial_r  x,
         return false;
 
     // Find highest rank in the terms
-    symbol_g     var    = main_variable();
     size_t       rvar   = r->variable(+var);
     size_t       yvar   = y->variable(+var);
     iterator     ri     = r->ranking(rvar);
@@ -1152,8 +1595,15 @@ EVAL_BODY(polynomial)
         vars[v] = alg;
     }
 
-    // Loop over all factors
+    // Univariate polynomials with sorted terms can use Horner's scheme.
+    // Symbolic values would render in Horner form, e.g. (3·X+2)·X+1
     algebraic_g result = nullptr;
+    if (nvars == 1 &&
+        (vars[0]->is_real() || vars[0]->is_complex()) &&
+        dense_horner(poly, vars[0], result))
+        return result && rt.push(+result) ? OK : ERROR;
+
+    // Loop over all factors
     for (auto term : *poly)
     {
         algebraic_g factor = term.factor();
@@ -1704,3 +2154,283 @@ COMMAND_BODY(StoreAlgebraVariable)
     }
     return ERROR;
 }
+
+
+
+// ============================================================================
+//
+//   Polynomial roots
+//
+// ============================================================================
+//
+//   All roots are computed simultaneously with the Aberth-Ehrlich method
+//   using hardware complex doubles. Each iteration corrects every root
+//   with a Newton step divided by the repulsion from all other roots,
+//   which converges cubically for simple roots. When the current precision
+//   exceeds what doubles provide, the roots are then polished with Newton
+//   iterations using the regular (decimal and complex) arithmetic.
+
+typedef std::complex<double> root_t;
+
+
+static bool root_coefficient(algebraic_p coef, root_t &value)
+// ----------------------------------------------------------------------------
+//   Convert a real or complex coefficient to a complex double
+// ----------------------------------------------------------------------------
+{
+    double re = 0.0, im = 0.0;
+    if (coef->is_complex())
+    {
+        rectangular_g z  = complex_p(coef)->as_rectangular();
+        algebraic_g   zr = z ? z->re() : nullptr;
+        algebraic_g   zi = z ? z->im() : nullptr;
+        if (!zr || !fast_function::real_value(+zr, re) ||
+            !zi || !fast_function::real_value(+zi, im))
+            return false;
+    }
+    else if (!fast_function::real_value(coef, re))
+    {
+        return false;
+    }
+    value = root_t(re, im);
+    return std::isfinite(re) && std::isfinite(im);
+}
+
+
+static void root_horner(const root_t *a, size_t n, root_t z,
+                        root_t &p, root_t &dp)
+// ----------------------------------------------------------------------------
+//   Evaluate the polynomial and its derivative, a[0] is the constant term
+// ----------------------------------------------------------------------------
+{
+    p  = a[n];
+    dp = 0.0;
+    for (size_t i = n; i--; )
+    {
+        dp = dp * z + p;
+        p  = p * z + a[i];
+    }
+}
+
+
+static bool root_aberth(const root_t *a, size_t n, root_t *z)
+// ----------------------------------------------------------------------------
+//   Aberth-Ehrlich iterations for the n roots of a polynomial of degree n
+// ----------------------------------------------------------------------------
+{
+    // Start on a circle with the geometric mean of the roots as radius,
+    // with an offset angle to avoid symmetries in the polynomial
+    double radius = std::pow(std::abs(a[0] / a[n]), 1.0 / n);
+    if (!std::isfinite(radius) || radius <= 0.0)
+        radius = 1.0;
+    for (size_t k = 0; k < n; k++)
+        z[k] = std::polar(radius, 2.0 * M_PI * k / n + 0.4);
+
+    for (uint iter = 0; iter < POLYNOMIAL_ROOT_ITERATIONS; iter++)
+    {
+        if (program::interrupted())
+        {
+            rt.interrupted_error();
+            return false;
+        }
+
+        bool converged = true;
+        for (size_t i = 0; i < n; i++)
+        {
+            root_t p, dp;
+            root_horner(a, n, z[i], p, dp);
+            if (p == 0.0)
+                continue;
+
+            root_t sum = 0.0;
+            for (size_t j = 0; j < n; j++)
+                if (j != i)
+                    sum += 1.0 / (z[i] - z[j]);
+            root_t ratio = p / dp;
+            root_t step  = ratio / (1.0 - ratio * sum);
+            if (!std::isfinite(step.real()) || !std::isfinite(step.imag()))
+                continue;
+            z[i] -= step;
+            if (std::abs(step) > 1e-15 * std::abs(z[i]))
+                converged = false;
+        }
+        record(polynomial, "Aberth iteration %u %+s", iter,
+               converged ? "converged" : "continues");
+        if (converged)
+            break;
+    }
+    return true;
+}
+
+
+static algebraic_p root_number(double x)
+// ----------------------------------------------------------------------------
+//   Build a real number for a root component
+// ----------------------------------------------------------------------------
+{
+    if (fast_function::hardware())
+        return hwdouble::make(x);
+    return decimal::from(x);
+}
+
+
+static algebraic_p root_polish(size_t base, size_t n, algebraic_r guess)
+// ----------------------------------------------------------------------------
+//   Polish a root with Newton iterations in the current precision
+// ----------------------------------------------------------------------------
+//   Each step doubles the number of correct digits for a simple root,
+//   starting from the roughly 15 digits of the hardware double estimate
+{
+    algebraic_g z = guess;
+    uint        precision = Settings.Precision();
+    for (uint digits = 15; z && digits < precision; digits *= 2)
+    {
+        algebraic_g p  = dense_get(base + n);
+        algebraic_g dp = integer::make(0);
+        for (size_t i = n; p && dp && i--; )
+        {
+            dp = dp * z + p;
+            p  = p * z + algebraic_g(dense_get(base + i));
+        }
+        if (!p || !dp)
+            return nullptr;
+        if (p->is_zero(false) || dp->is_zero(false))
+            break;
+        z = z - p / dp;
+    }
+    return z;
+}
+
+
+static list_p polynomial_roots(object_r coefs)
+// ----------------------------------------------------------------------------
+//   Compute all the roots of a polynomial as an array
+// ----------------------------------------------------------------------------
+//   The input is either a polynomial or expression in a single variable,
+//   or a list or array of coefficients with the highest order first
+{
+    stack_depth_restore sdr;
+    size_t base = rt.depth();
+    size_t n    = 0;
+
+    if (coefs->is_array_or_list())
+    {
+        list_g coefficients = list_p(+coefs);
+        for (object_p item : *coefficients)
+        {
+            if (!item->is_real() && !item->is_complex())
+            {
+                rt.type_error();
+                return nullptr;
+            }
+            if (!rt.push(item))
+                return nullptr;
+            n++;
+        }
+
+        // Reverse so that the constant term comes first
+        for (size_t i = 0; i < n / 2; i++)
+        {
+            algebraic_g lo = dense_get(base + i);
+            algebraic_g hi = dense_get(base + n - 1 - i);
+            if (!dense_set(base + i, hi) || !dense_set(base + n - 1 - i, lo))
+                return nullptr;
+        }
+    }
+    else
+    {
+        polynomial_g poly = coefs->as<polynomial>();
+        if (!poly)
+            if (expression_p expr = coefs->as<expression>())
+                poly = polynomial::make(expr, true);
+        if (!poly || poly->variables() > 1)
+        {
+            if (!rt.error())
+                rt.type_error();
+            return nullptr;
+        }
+        ularge degree = 0;
+        bool   exact  = true;
+        dense_degree(poly, degree, exact);
+        n = degree + 1;
+        if (!dense_push(poly, n))
+            return nullptr;
+    }
+
+    // Strip leading zeros, and count trailing zeros as roots at the origin
+    while (n && dense_get(base + n - 1)->is_zero(false))
+        n--;
+    if (!n)
+    {
+        rt.value_error();
+        return nullptr;
+    }
+    size_t zeros = 0;
+    while (zeros < n && dense_get(base + zeros)->is_zero(false))
+        zeros++;
+    size_t first  = base + zeros;
+    size_t degree = n - 1 - zeros;
+
+    // Compute the roots with hardware floating-point
+    root_t a[degree + 1];
+    root_t z[degree + 1];
+    bool   real = true;
+    for (size_t i = 0; i <= degree; i++)
+    {
+        algebraic_g coef = dense_get(first + i);
+        if (!root_coefficient(+coef, a[i]))
+        {
+            rt.value_error();
+            return nullptr;
+        }
+        if (a[i].imag() != 0.0)
+            real = false;
+    }
+    if (degree && !root_aberth(a, degree, z))
+        return nullptr;
+
+    // Clean up round-off on real roots of real polynomials, sort roots
+    for (size_t i = 0; i < degree; i++)
+        if (real && std::abs(z[i].imag()) <= 1e-10 * std::abs(z[i]))
+            z[i] = z[i].real();
+    std::sort(z, z + degree, [](const root_t &x, const root_t &y) {
+        return x.real() < y.real() ||
+            (x.real() == y.real() && x.imag() < y.imag());
+    });
+
+    // Build the resulting array, refining the roots if necessary
+    size_t results = rt.depth();
+    for (size_t i = 0; i < zeros; i++)
+        if (!rt.push(integer::make(0)))
+            return nullptr;
+    bool polish = !fast_function::hardware();
+    for (size_t i = 0; i < degree; i++)
+    {
+        algebraic_g root = root_number(z[i].real());
+        if (root && z[i].imag() != 0.0)
+        {
+            algebraic_g im = root_number(z[i].imag());
+            root = im ? rectangular::make(root, im) : nullptr;
+        }
+        if (root && polish)
+            root = root_polish(first, degree, root);
+        if (!root || !rt.push(+root))
+            return nullptr;
+    }
+    return list::list_from_stack(rt.depth() - results, object::ID_array);
+}
+
+
+COMMAND_BODY(PolynomialRoots)
+// ----------------------------------------------------------------------------
+//   Find all the roots of a polynomial (PROOT)
+// ----------------------------------------------------------------------------
+{
+    object_g coefs = rt.top();
+    if (!coefs)
+        return ERROR;
+    if (list_p roots = polynomial_roots(coefs))
+        if (rt.top(roots))
+            return OK;
+    return ERROR;
+}
@@ -164,5 +164,6 @@ COMMAND_DECLARE(FromPolynomial,         1);
 COMMAND_DECLARE(AlgebraConfiguration,   0);
 COMMAND_DECLARE(AlgebraVariable,        0);
 COMMAND_DECLARE(StoreAlgebraVariable,   1);
+COMMAND_DECLARE(PolynomialRoots,        1);
 
 #endif // POLYNOMIAL_H
@@ -28,13 +28,19 @@
 
 #include "program.h"
 
+#include "arithmetic.h"
+#include "constants.h"
 #include "dmcp.h"
+#include "file.h"
+#include "integer.h"
 #include "parser.h"
+#include "renderer.h"
 #include "settings.h"
 #include "sysmenu.h"
 #include "tag.h"
 #include "tests.h"
 #include "unit.h"
+#include "user_interface.h"
 #include "util.h"
 #include "variables.h"
 
@@ -121,9 +127,13 @@ object::result program::run(bool synchronous) const
     bool     outer     = depth == 0 && !running;
     object_p first     = objects();
     object_p end       = skip();
+    if (type() == ID_compiled)
+        compiled_p(this)->body(first, end);
 
     record(program, "Run %p (%p-%p) %+s",
            this, first, end, outer ? "outer" : "inner");
+    if (outer)
+        sys_clock_boost();
 
     if (!rt.run_push(first, end))
         return ERROR;
@@ -171,7 +181,98 @@ object::result program::run(algebraic_p obj, bool sync)
 #endif // DM42
 
 
-object::result program::run_loop(size_t depth)
+#ifndef PROFILE_PROGRAMS
+// Named programs tracked by the profiler, call depth used to attribute time
+#define PROFILE_PROGRAMS        16
+#define PROFILE_DEPTH           32
+#define PROFILE_NAME            16
+#endif // PROFILE_PROGRAMS
+
+struct profile_count
+// ----------------------------------------------------------------------------
+//   Number of evaluations and cumulated time
+// ----------------------------------------------------------------------------
+{
+    uint32_t count;
+    uint32_t us;
+};
+
+struct profile_program
+// ----------------------------------------------------------------------------
+//   Time spent in commands evaluated by a named program
+// ----------------------------------------------------------------------------
+{
+    char          name[PROFILE_NAME];
+    profile_count total;
+};
+
+static profile_count   profile_ids[object::NUM_IDS];
+static profile_program profile_programs[PROFILE_PROGRAMS];
+static uint8_t         profile_frames[PROFILE_DEPTH]; // Program index + 1
+
+
+static int profile_program_index(symbol_p name)
+// ----------------------------------------------------------------------------
+//   Find or allocate the entry for a program name
+// ----------------------------------------------------------------------------
+{
+    size_t len = 0;
+    utf8   txt = name->value(&len);
+    if (len >= PROFILE_NAME)
+        len = PROFILE_NAME - 1;
+    for (int i = 0; i < PROFILE_PROGRAMS; i++)
+    {
+        profile_program &p = profile_programs[i];
+        if (!p.name[0])
+        {
+            memcpy(p.name, txt, len);
+            p.name[len] = 0;
+            return i;
+        }
+        if (strncmp(p.name, cstring(txt), len) == 0 && !p.name[len])
+            return i;
+    }
+    return -1;
+}
+
+
+static void profile_record(object_p obj, size_t depth, uint64_t start)
+// ----------------------------------------------------------------------------
+//   Count an evaluation, and remember which program a call enters
+// ----------------------------------------------------------------------------
+//   Times are inclusive: a command that runs a program synchronously also
+//   counts the commands of that program. Commands run from a named program
+//   are attributed to the innermost one.
+{
+    uint32_t   us = sys_current_us() - start;
+    object::id ty = obj->type();
+    profile_ids[ty].count++;
+    profile_ids[ty].us += us;
+
+    size_t d = depth < PROFILE_DEPTH ? depth : PROFILE_DEPTH - 1;
+    for (size_t f = d + 1; f-- > 0; )
+    {
+        if (profile_frames[f])
+        {
+            profile_count &c = profile_programs[profile_frames[f] - 1].total;
+            c.count++;
+            c.us += us;
+            break;
+        }
+    }
+
+    size_t now = rt.call_depth();
+    if (now > depth && now < PROFILE_DEPTH)
+    {
+        symbol_p name = ty == object::ID_symbol ? symbol_p(obj) : nullptr;
+        profile_frames[now] = name ? profile_program_index(name) + 1 : 0;
+        for (size_t f = now + 1; f < PROFILE_DEPTH; f++)
+            profile_frames[f] = 0;
+    }
+}
+
+
+HOT object::result program::run_loop(size_t depth)
 // ----------------------------------------------------------------------------
 //   Continue executing a program
 // ----------------------------------------------------------------------------
@@ -204,7 +305,17 @@ object::result program::run_loop(size_t depth)
         }
         if (last_args)
             rt.need_save();
-        result = obj->evaluate();
+        if (Settings.ProfileCommands())
+        {
+            size_t   before = rt.call_depth();
+            uint64_t start  = sys_current_us();
+            result = obj->evaluate();
+            profile_record(obj, before, start);
+        }
+        else
+        {
+            result = obj->evaluate();
+        }
 
         if (result != OK)
         {
@@ -231,7 +342,19 @@ object::result program::run_loop(size_t depth)
 }
 
 
-uint program::count_interrupted = 0;
+#ifndef INTERRUPT_CHECK_PERIOD
+// Milliseconds between checks of keys, battery and busy indicator
+#define INTERRUPT_CHECK_PERIOD  10
+#endif // INTERRUPT_CHECK_PERIOD
+
+#ifndef RUNNING_HEADER_PERIOD
+// Milliseconds between header updates while a program runs
+#define RUNNING_HEADER_PERIOD   1000
+#endif // RUNNING_HEADER_PERIOD
+
+static uint last_header_refresh = 0;
+
+uint program::last_interrupt_check = 0;
 uint program::last_interrupted = 0;
 uint program::last_power_check = 1U << 31;
 
@@ -239,11 +362,17 @@ bool program::interrupted()
 // ----------------------------------------------------------------------------
 //   Return true if the current program must be interrupted
 // ----------------------------------------------------------------------------
+//   The millisecond counter is maintained by a timer, and the keyboard task
+//   flags pending [EXIT] presses, so the hot path only reads two words.
+//   Everything else runs at most every INTERRUPT_CHECK_PERIOD ms, instead of
+//   every 32 calls, however fast the evaluation loop is.
 {
-    if (count_interrupted++ < 32)
+    uint ms = sys_current_ms();
+    if (ms - last_interrupt_check < INTERRUPT_CHECK_PERIOD &&
+        !key_exit_pending())
         return halted;
 
-    count_interrupted = 0;
+    last_interrupt_check = ms;
     reset_auto_off();
     uint now = program::read_time();
     if (now - last_power_check >= Settings.BatteryRefresh())
@@ -256,6 +385,14 @@ bool program::interrupted()
         ui.draw_busy();
         last_interrupted = now;
     }
+    if (now - last_header_refresh >= RUNNING_HEADER_PERIOD)
+    {
+        // Keep clock and battery current during long computations.
+        // This does nothing while a program shows graphics.
+        if (ui.draw_header() | ui.draw_battery())
+            refresh_dirty();
+        last_header_refresh = now;
+    }
     while (!key_empty())
     {
         int tail = key_tail();
@@ -316,18 +453,12 @@ uint program::read_battery()
 
 uint program::read_time()
 // ----------------------------------------------------------------------------
-//   Read real-time clock time
+//   Read a monotonic time in milliseconds, for timeouts and statistics
 // ----------------------------------------------------------------------------
-//   The sys_current_ms() function stops running when timers are off.
+//   This uses the microsecond clock instead of the RTC, which has only 10ms
+//   resolution and is slower to read. The RTC is only used for the date.
 {
-    dt_t date;
-    tm_t time;
-    rtc_read(&time, &date);
-    int jd = julian_day(&date);
-    ticks = ((time.sec +
-             time.min * 60 +
-             time.hour * 3600 +
-              jd * 86400) * 100 + time.csec) * 10;
+    ticks = sys_current_us() / 1000;
     return ticks;
 }
 
@@ -359,6 +490,265 @@ EVAL_BODY(block)
 
 
 
+// ============================================================================
+//
+//    Compiled programs
+//
+// ============================================================================
+
+#ifndef COMPILE_WINDOW
+// Number of trailing objects the folding optimizations look at
+#define COMPILE_WINDOW          4
+#endif // COMPILE_WINDOW
+
+RENDER_BODY(compiled)
+// ----------------------------------------------------------------------------
+//   Render the source, so that editing shows what the user entered
+// ----------------------------------------------------------------------------
+{
+    return o->source()->list_render(r, L'«', L'»');
+}
+
+
+uint compiled::mode()
+// ----------------------------------------------------------------------------
+//   The settings that folded results depend on
+// ----------------------------------------------------------------------------
+{
+    uint m = Settings.Precision();
+    m = (m << 1) | Settings.NumericalConstants();
+    m = (m << 1) | Settings.NumericalResults();
+    m = (m << 1) | Settings.HardwareFloatingPointEnabled();
+    m = (m << 1) | Settings.BigFractions();
+    return m;
+}
+
+
+program_p compiled::source() const
+// ----------------------------------------------------------------------------
+//   The source program is the first object in the payload
+// ----------------------------------------------------------------------------
+{
+    return program_p(objects());
+}
+
+
+void compiled::body(object_p &first, object_p &end) const
+// ----------------------------------------------------------------------------
+//   Select the objects to run, falling back to source if settings changed
+// ----------------------------------------------------------------------------
+{
+    program_p src = program_p(first);
+    object_p  m   = src->skip();
+    if (m->type() == ID_integer && integer_p(m)->value<uint>() == mode())
+    {
+        first = m->skip();
+    }
+    else
+    {
+        first = src->objects();
+        end   = src->skip();
+    }
+}
+
+
+static bool compile_number(object_p obj)
+// ----------------------------------------------------------------------------
+//   Check if an object is a value that folding can operate on
+// ----------------------------------------------------------------------------
+{
+    return obj && object::is_real(obj->type());
+}
+
+
+static algebraic_p compile_fold(object::id op, algebraic_r x, algebraic_r y)
+// ----------------------------------------------------------------------------
+//   Compute a constant result, or return nullptr if the op does not fold
+// ----------------------------------------------------------------------------
+//   For unary operations, x is the argument and y is ignored
+{
+    algebraic_g r;
+    switch (op)
+    {
+    case object::ID_add:        r = x + y;      break;
+    case object::ID_subtract:   r = x - y;      break;
+    case object::ID_multiply:   r = x * y;      break;
+    case object::ID_divide:     r = x / y;      break;
+    case object::ID_pow:        r = pow(x, y);  break;
+    case object::ID_neg:        r = -x;         break;
+    case object::ID_sq:         r = x * x;      break;
+    case object::ID_cubed:      r = x * x * x;  break;
+    case object::ID_inv:
+    {
+        algebraic_g one = integer::make(1);
+        r = one / x;
+        break;
+    }
+    default:
+        return nullptr;
+    }
+
+    // Errors such as division by zero are left to run time
+    if (rt.error())
+    {
+        rt.clear_error();
+        return nullptr;
+    }
+    return compile_number(r) ? +r : nullptr;
+}
+
+
+static uint compile_arity(object::id op)
+// ----------------------------------------------------------------------------
+//   Number of constant arguments for operations that fold
+// ----------------------------------------------------------------------------
+{
+    switch (op)
+    {
+    case object::ID_add:
+    case object::ID_subtract:
+    case object::ID_multiply:
+    case object::ID_divide:
+    case object::ID_pow:
+        return 2;
+    case object::ID_neg:
+    case object::ID_sq:
+    case object::ID_cubed:
+    case object::ID_inv:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+
+program_p compiled::make(program_r src)
+// ----------------------------------------------------------------------------
+//   Fold constants and remove no-ops, return source if nothing changed
+// ----------------------------------------------------------------------------
+//   The optimizer looks at the last COMPILE_WINDOW objects it emitted:
+//   - Arithmetic on numbers is replaced with its result
+//   - Numerical constants are replaced with their value
+//   - `number Drop` is removed. `Dup Drop` or `Swap Swap` are kept, since
+//     they report an error when the stack has too few arguments
+//   - Comments are removed, since the source is kept for rendering
+{
+    if (!src || src->type() != ID_program)
+        return src;
+
+    scribble  scr;
+    integer_g m = integer::make(mode());
+    if (!m || !rt.append(src) || !rt.append(m))
+        return nullptr;
+
+    object_g window[COMPILE_WINDOW];
+    size_t   offset[COMPILE_WINDOW];
+    uint     count   = 0;
+    bool     changed = false;
+    bool     numeric = Settings.NumericalConstants() ||
+                       Settings.NumericalResults();
+
+    for (object_g obj : *src)
+    {
+        id   ty   = obj->type();
+        uint drop = 0;
+
+        // Inline the value of constants
+        if (ty == ID_constant && numeric)
+        {
+            if (algebraic_p value = constant_p(+obj)->numerical_value())
+            {
+                obj = value;
+                changed = true;
+            }
+            else if (rt.error())
+            {
+                rt.clear_error();
+            }
+            ty = obj->type();
+        }
+        else if (ty == ID_Pi)
+        {
+            if (algebraic_p pi = constant::lookup("π"))
+            {
+                obj = numeric ? constant_p(pi)->value() : pi;
+                changed = true;
+            }
+            ty = obj->type();
+        }
+
+        // Remove no-ops
+        if (ty == ID_comment)
+        {
+            changed = true;
+            continue;
+        }
+        if (count && ty == ID_Drop)
+        {
+            if (compile_number(window[count - 1]))
+                drop = 1;
+        }
+
+        // Fold arithmetic on constant arguments
+        else if (uint arity = compile_arity(ty))
+        {
+            if (count >= arity)
+            {
+                bool fold = true;
+                for (uint a = 0; a < arity; a++)
+                    fold = fold && compile_number(window[count - 1 - a]);
+                if (fold)
+                {
+                    algebraic_g x = algebraic_p(+window[count - arity]);
+                    algebraic_g y = algebraic_p(+window[count - 1]);
+                    if (algebraic_p r = compile_fold(ty, x, y))
+                    {
+                        obj = r;
+                        drop = arity;
+                    }
+                }
+            }
+        }
+
+        if (drop)
+        {
+            changed = true;
+            count -= drop;
+            rt.free(scr.growth() - offset[count]);
+            if (ty == ID_Drop)
+                continue;
+        }
+
+        // Emit the object, and remember it for later folding
+        if (count == COMPILE_WINDOW)
+        {
+            for (uint w = 1; w < COMPILE_WINDOW; w++)
+            {
+                window[w - 1] = window[w];
+                offset[w - 1] = offset[w];
+            }
+            count--;
+        }
+        window[count] = obj;
+        offset[count] = scr.growth();
+        count++;
+        if (!rt.append(obj))
+            return nullptr;
+    }
+
+    if (!changed)
+        return src;
+
+    gcbytes   scratch = scr.scratch();
+    size_t    alloc   = scr.growth();
+    program_p result  = rt.make<compiled>(ID_compiled, scratch, alloc);
+    record(program, "Compiled %u bytes into %u",
+           src->size(), result ? result->size() : 0);
+    return result;
+}
+
+
+
 // ============================================================================
 //
 //   Debugging
@@ -555,8 +945,14 @@ COMMAND_BODY(RuntimeStatistics)
         tag::make("Refresh",
                   unit::make(integer::make(program::refresh_time), ms));
     tag_g runcycles = tag::make("Runs", integer::make(program::run_cycles));
-
-    if (running && sleeping && runcycles)
+    tag_g switches = tag::make("Clock", integer::make(sys_clock_switches()));
+    tag_g switching =
+        tag::make("Switching",
+                  unit::make(integer::make(sys_clock_switch_us()),
+                             +symbol::make("μs")));
+    tag_g keys = tag::make("Keys", integer::make(sys_key_samples()));
+
+    if (running && sleeping && runcycles && switches && switching && keys)
     {
         scribble scr;
         if (rt.append(running)   &&
@@ -564,8 +960,40 @@ COMMAND_BODY(RuntimeStatistics)
             rt.append(display)   &&
             rt.append(stack)     &&
             rt.append(refresh)   &&
-            rt.append(runcycles))
+            rt.append(runcycles) &&
+            rt.append(switches)  &&
+            rt.append(switching) &&
+            rt.append(keys))
         {
+            // Key to display latency percentiles, then average per stage
+            static const struct
+            {
+                cstring name;
+                uint    percent;
+                key_stage stage;
+            } latencies[] =
+            {
+                { "Latency50", 50, KEY_STAGE_SCAN     },
+                { "Latency90", 90, KEY_STAGE_SCAN     },
+                { "Latency99", 99, KEY_STAGE_SCAN     },
+                { "KeyQueue",  0,  KEY_STAGE_RECEIVED },
+                { "KeyHandle", 0,  KEY_STAGE_HANDLED  },
+                { "KeyDraw",   0,  KEY_STAGE_DRAWN    },
+                { "KeyShow",   0,  KEY_STAGE_SHOWN    },
+            };
+            algebraic_g us = +symbol::make("μs");
+            for (const auto &l : latencies)
+            {
+                uint32_t value = l.stage != KEY_STAGE_SCAN
+                    ? sys_key_stage_us(l.stage)
+                    : sys_key_latency_us(l.percent);
+                tag_g t = tag::make(l.name,
+                                    unit::make(integer::make(value), us));
+                if (!t || !rt.append(t))
+                    return ERROR;
+            }
+
+
             size_t sz = scr.growth();
             gcbytes data = scr.scratch();
             if (array_p a = rt.make<array>(ID_array, data, sz))
@@ -580,6 +1008,8 @@ COMMAND_BODY(RuntimeStatistics)
                         program::stack_display_time = 0;
                         program::refresh_time       = 0;
                         program::run_cycles         = 0;
+                        sys_clock_stats_clear();
+                        sys_key_stats_clear();
                     }
                     return OK;
                 }
@@ -589,3 +1019,383 @@ COMMAND_BODY(RuntimeStatistics)
 
     return  ERROR;
 }
+
+
+
+// ============================================================================
+//
+//   On-target benchmark
+//
+// ============================================================================
+//   Each run appends one line per case to a CSV file, so that results from
+//   different firmware builds on the same hardware can be compared.
+//   The first run also writes a baseline file. Later runs fail with an
+//   error when time, allocations, collections or bytes moved by the GC
+//   grow by more than BENCHMARK_TOLERANCE percent over the baseline.
+//   Deleting the baseline file makes the next run record a new one.
+
+#ifndef BENCHMARK_DIR
+// Directory and file where benchmark results are appended
+#define BENCHMARK_DIR   "/bench"
+#define BENCHMARK_FILE  BENCHMARK_DIR "/bench.csv"
+#define BENCHMARK_BASE  BENCHMARK_DIR "/baseline.csv"
+#endif // BENCHMARK_DIR
+
+#ifndef BENCHMARK_TOLERANCE
+// Percentage by which a metric can exceed the baseline
+#define BENCHMARK_TOLERANCE     10
+#endif // BENCHMARK_TOLERANCE
+
+enum benchmark_kind
+// ----------------------------------------------------------------------------
+//   What a benchmark case runs
+// ----------------------------------------------------------------------------
+{
+    BENCH_RPL,                  // RPL source code
+    BENCH_GC,                   // Full garbage collection
+    BENCH_STACK,                // Stack redraw
+    BENCH_HELP,                 // Help topic lookup
+};
+
+static const struct benchmark_case
+// ----------------------------------------------------------------------------
+//   A benchmark case, run at the given precision
+// ----------------------------------------------------------------------------
+{
+    cstring        name;
+    uint16_t       precision;
+    benchmark_kind kind;
+    cstring        source;
+} benchmark_cases[] =
+{
+    { "Arith12",   12, BENCH_RPL,   "0 1 500 FOR i i 7. / √ + NEXT DROP" },
+    { "Arith24",   24, BENCH_RPL,   "0 1 500 FOR i i 7. / √ + NEXT DROP" },
+    { "Arith100", 100, BENCH_RPL,   "0 1 100 FOR i i 7. / √ + NEXT DROP" },
+    { "Fact",      24, BENCH_RPL,   "1 20 START 100 ! DROP NEXT" },
+    { "MatInv",    24, BENCH_RPL,   "1 20 START "
+                                    "[[4 1 2 0][1 5 1 2][2 1 6 1][0 2 1 7]] "
+                                    "inv DROP NEXT" },
+    { "Root",      24, BENCH_RPL,   "'X^3-2*X-5' 'X' 2 Root DROP 'X' Purge" },
+    { "Integrate", 24, BENCH_RPL,   "0 1 'sin(X)' 'X' Integrate DROP" },
+    { "Map",       24, BENCH_RPL,   "{ } 1 200 FOR i i + NEXT « sq » Map DROP" },
+    { "Sort",      24, BENCH_RPL,   "{ } 1 200 FOR i 200 i - + NEXT Sort DROP" },
+    { "Alloc",     24, BENCH_RPL,   "1 200 START { } 1 50 FOR i i + NEXT DROP "
+                                    "NEXT" },
+    { "GC",        24, BENCH_GC,    nullptr },
+    { "Stack",     24, BENCH_STACK, nullptr },
+    { "Help",      24, BENCH_HELP,  nullptr },
+};
+static const uint benchmark_count =
+    sizeof(benchmark_cases) / sizeof(benchmark_cases[0]);
+
+
+enum benchmark_metric
+// ----------------------------------------------------------------------------
+//   What is measured for each case
+// ----------------------------------------------------------------------------
+{
+    BENCH_TIME,                 // Microseconds
+    BENCH_ALLOCATED,            // Objects allocated
+    BENCH_COLLECTIONS,          // Garbage collection cycles
+    BENCH_MOVED,                // Bytes moved in memory
+    BENCH_METRICS
+};
+
+static cstring const benchmark_metrics[BENCH_METRICS] =
+{
+    "Microseconds", "Allocated", "Collections", "Moved"
+};
+
+typedef uint64_t benchmark_values[BENCH_METRICS];
+
+
+static bool benchmark_baseline(benchmark_values *base)
+// ----------------------------------------------------------------------------
+//   Read the baseline file, lines are Case,Microseconds,Allocated,...
+// ----------------------------------------------------------------------------
+{
+    file csv(BENCHMARK_BASE, file::READING);
+    if (!csv.valid())
+        return false;
+
+    memset(base, 0, benchmark_count * sizeof(*base));
+    char line[80];
+    while (!csv.eof())
+    {
+        uint len = 0;
+        char c;
+        while (!csv.eof() && (c = csv.getchar()) != '\n')
+            if (len < sizeof(line) - 1)
+                line[len++] = c;
+        line[len] = 0;
+
+        char *field = strchr(line, ',');
+        if (!field)
+            continue;
+        *field++ = 0;
+        for (uint i = 0; i < benchmark_count; i++)
+        {
+            if (strcmp(line, benchmark_cases[i].name) == 0)
+            {
+                for (uint m = 0; m < BENCH_METRICS && *field; m++)
+                {
+                    base[i][m] = strtoull(field, &field, 10);
+                    if (*field == ',')
+                        field++;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+
+static bool benchmark_regressed(uint64_t value, uint64_t base)
+// ----------------------------------------------------------------------------
+//   Check if a value exceeds its baseline by more than the tolerance
+// ----------------------------------------------------------------------------
+//   One unit of slack lets counts that were zero or one in the baseline
+//   change a little without failing
+{
+    return value > base + 1 && value * 100 > base * (100+BENCHMARK_TOLERANCE);
+}
+
+
+static object::result benchmark_run(const benchmark_case &bench)
+// ----------------------------------------------------------------------------
+//   Run a single benchmark case
+// ----------------------------------------------------------------------------
+{
+    switch(bench.kind)
+    {
+    case BENCH_RPL:
+        if (program_g prog = program::parse(utf8(bench.source),
+                                            strlen(bench.source)))
+            return program::run(object_p(+prog), true);
+        return object::ERROR;
+    case BENCH_GC:
+        rt.gc(true);
+        return object::OK;
+    case BENCH_STACK:
+        ui.dirty_all();
+        ui.draw_stack();
+        return object::OK;
+    case BENCH_HELP:
+        ui.load_help(utf8("Sort"));
+        ui.clear_help();
+        return object::OK;
+    }
+    return object::ERROR;
+}
+
+
+COMMAND_BODY(Benchmark)
+// ----------------------------------------------------------------------------
+//   Run the benchmark suite, log results and return times per case
+// ----------------------------------------------------------------------------
+{
+    benchmark_values values[benchmark_count];
+    benchmark_values base[benchmark_count];
+    bool          ok[benchmark_count];
+    bool          slower[benchmark_count];
+    bool          regressed = false;
+    save<settings> saved(Settings, Settings);
+
+    for (uint i = 0; i < benchmark_count; i++)
+    {
+        const benchmark_case &bench = benchmark_cases[i];
+        uint depth = rt.depth();
+        Settings.Precision(bench.precision);
+
+        size_t   allocated = rt.GCAllocated;
+        size_t   cycles    = rt.GCCycles;
+        size_t   moved     = rt.GCMoved;
+        uint64_t start     = sys_current_us();
+        ok[i] = benchmark_run(bench) == OK;
+        values[i][BENCH_TIME]        = sys_current_us() - start;
+        values[i][BENCH_ALLOCATED]   = rt.GCAllocated - allocated;
+        values[i][BENCH_COLLECTIONS] = rt.GCCycles - cycles;
+        values[i][BENCH_MOVED]       = rt.GCMoved - moved;
+
+        record(program, "Benchmark %s %llu us %+s",
+               bench.name, values[i][BENCH_TIME], ok[i] ? "ok" : "failed");
+        if (!ok[i])
+            rt.clear_error();
+        if (rt.depth() > depth)
+            rt.drop(rt.depth() - depth);
+    }
+
+    // Compare with the baseline, or record it if there is none
+    check_create_dir(BENCHMARK_DIR);
+    bool compare = benchmark_baseline(base);
+    for (uint i = 0; i < benchmark_count; i++)
+    {
+        slower[i] = false;
+        if (compare && ok[i])
+        {
+            for (uint m = 0; m < BENCH_METRICS; m++)
+            {
+                if (benchmark_regressed(values[i][m], base[i][m]))
+                {
+                    record(program, "Benchmark %s %s %llu, baseline %llu",
+                           benchmark_cases[i].name, benchmark_metrics[m],
+                           values[i][m], base[i][m]);
+                    slower[i] = true;
+                }
+            }
+            regressed |= slower[i];
+        }
+    }
+    if (!compare)
+    {
+        file csv(BENCHMARK_BASE, file::WRITING);
+        if (csv.valid())
+        {
+            renderer r(csv);
+            for (uint i = 0; i < benchmark_count; i++)
+                if (ok[i])
+                    r.printf("%s,%llu,%llu,%llu,%llu\n",
+                             benchmark_cases[i].name,
+                             values[i][BENCH_TIME],
+                             values[i][BENCH_ALLOCATED],
+                             values[i][BENCH_COLLECTIONS],
+                             values[i][BENCH_MOVED]);
+        }
+    }
+
+    // Append results to the CSV file
+    {
+        file csv(BENCHMARK_FILE, file::APPEND);
+        if (!csv.valid())
+        {
+            rt.error(csv.error());
+            return ERROR;
+        }
+        renderer r(csv);
+        uint mhz = sys_core_mhz();
+        if (csv.size() == 0)
+            r.printf("Version,Case,Digits,Microseconds,Cycles,"
+                     "Allocated,Collections,Moved,Result\n");
+        for (uint i = 0; i < benchmark_count; i++)
+            r.printf("%s,%s,%u,%llu,%llu,%llu,%llu,%llu,%s\n",
+                     DB48X_VERSION, benchmark_cases[i].name,
+                     benchmark_cases[i].precision,
+                     values[i][BENCH_TIME], values[i][BENCH_TIME] * mhz,
+                     values[i][BENCH_ALLOCATED],
+                     values[i][BENCH_COLLECTIONS],
+                     values[i][BENCH_MOVED],
+                     !ok[i] ? "Error" : slower[i] ? "Regressed" : "OK");
+    }
+    if (regressed)
+    {
+        rt.benchmark_regression_error();
+        return ERROR;
+    }
+
+    // Return an array of tagged times
+    algebraic_g us = +symbol::make("μs");
+    scribble scr;
+    for (uint i = 0; i < benchmark_count; i++)
+    {
+        tag_g entry = tag::make(benchmark_cases[i].name,
+                                unit::make(integer::make(values[i][BENCH_TIME]),
+                                           us));
+        if (!entry || !rt.append(entry))
+            return ERROR;
+    }
+    size_t  sz   = scr.growth();
+    gcbytes data = scr.scratch();
+    if (array_p a = rt.make<array>(ID_array, data, sz))
+        if (rt.push(a))
+            return OK;
+    return ERROR;
+}
+
+
+
+// ============================================================================
+//
+//   Command profiler
+//
+// ============================================================================
+
+#ifndef PROFILE_TOP
+// Number of most expensive commands returned by Profile
+#define PROFILE_TOP     32
+#endif // PROFILE_TOP
+
+static tag_p profile_entry(gcutf8 name, size_t len, const profile_count &c)
+// ----------------------------------------------------------------------------
+//   Build a Name:{ count time } entry
+// ----------------------------------------------------------------------------
+{
+    integer_g   count = integer::make(c.count);
+    algebraic_g time  = unit::make(integer::make(c.us), +symbol::make("μs"));
+    list_g      data  = list::make(count, time);
+    return tag::make(name, len, +data);
+}
+
+
+COMMAND_BODY(Profile)
+// ----------------------------------------------------------------------------
+//   Return time spent per command and per named program
+// ----------------------------------------------------------------------------
+//   Profiling is enabled by the ProfileCommands setting
+{
+    static bool taken[object::NUM_IDS];
+    list_g      commands, programs;
+
+    memset(taken, 0, sizeof(taken));
+    {
+        scribble scr;
+        for (uint n = 0; n < PROFILE_TOP; n++)
+        {
+            uint best = 0;
+            for (uint i = 1; i < object::NUM_IDS; i++)
+                if (!taken[i] && profile_ids[i].count &&
+                    (!best || profile_ids[i].us > profile_ids[best].us))
+                    best = i;
+            if (!best)
+                break;
+            taken[best] = true;
+            utf8  name = object::fancy(object::id(best));
+            tag_g entry = profile_entry(name, strlen(cstring(name)),
+                                        profile_ids[best]);
+            if (!entry || !rt.append(entry))
+                return ERROR;
+        }
+        gcbytes data = scr.scratch();
+        commands = list::make(ID_list, data, scr.growth());
+    }
+
+    {
+        scribble scr;
+        for (uint i = 0; i < PROFILE_PROGRAMS; i++)
+        {
+            profile_program &p = profile_programs[i];
+            if (!p.name[0])
+                break;
+            tag_g entry = profile_entry(utf8(p.name), strlen(p.name), p.total);
+            if (!entry || !rt.append(entry))
+                return ERROR;
+        }
+        gcbytes data = scr.scratch();
+        programs = list::make(ID_list, data, scr.growth());
+    }
+
+    tag_g cmds  = tag::make("Commands", +commands);
+    tag_g progs = tag::make("Programs", +programs);
+    if (!cmds || !progs)
+        return ERROR;
+    list_g result = list::make(cmds, progs);
+    if (!result || !rt.push(+result))
+        return ERROR;
+
+    if (Settings.RunStatsClearAfterRead())
+    {
+        memset(profile_ids, 0, sizeof(profile_ids));
+        memset(profile_programs, 0, sizeof(profile_programs));
+    }
+    return OK;
+}
@@ -65,7 +65,7 @@ struct program : list
     static uint          battery_voltage;
     static uint          power_voltage;
     static uint          last_power_check;
-    static uint          count_interrupted;
+    static uint          last_interrupt_check;
     static uint          last_interrupted;
     static ularge        run_cycles;
     static ularge        active_time;
@@ -104,6 +104,30 @@ public:
 };
 
 
+GCP(compiled);
+
+struct compiled : program
+// ----------------------------------------------------------------------------
+//   A program with constants folded, which keeps its source for rendering
+// ----------------------------------------------------------------------------
+//   The payload is the source program, an integer encoding the settings that
+//   folding depends on, then the objects that are actually run, so that it
+//   remains a valid sequence of objects for generic list walkers. If these
+//   settings changed since the program was compiled, the source runs instead.
+{
+    compiled(id type, gcbytes bytes, size_t len): program(type, bytes, len) {}
+
+    static program_p     make(program_r source);
+    static uint          mode();
+    program_p            source() const;
+    void                 body(object_p &first, object_p &end) const;
+
+public:
+    OBJECT_DECL(compiled);
+    RENDER_DECL(compiled);
+};
+
+
 COMMAND_DECLARE(Halt,-1);
 COMMAND_DECLARE(Debug,1);
 COMMAND_DECLARE(SingleStep,-1);
@@ -113,5 +137,7 @@ COMMAND_DECLARE(MultipleSteps,1);
 COMMAND_DECLARE(Continue,-1);
 COMMAND_DECLARE(Kill,-1);
 COMMAND_DECLARE(RuntimeStatistics,0);
+COMMAND_DECLARE(Benchmark,0);
+COMMAND_DECLARE(Profile,0);
 
 #endif // PROGRAM_H
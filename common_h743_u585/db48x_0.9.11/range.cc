@@ -32,6 +32,7 @@
 #include "arithmetic.h"
 #include "compare.h"
 #include "functions.h"
+#include "hwfp.h"
 #include "parser.h"
 #include "renderer.h"
 #include "runtime.h"
@@ -328,6 +329,117 @@ algebraic_p range::as_uncertain() const
 //
 // ============================================================================
 
+//   When hardware floating-point is enabled and all endpoints are hardware
+//   values, the bounds are computed with the FPU.  The result of each basic
+//   operation is correctly rounded, so we check if it is exact, and if not
+//   move it outwards by one ulp, which keeps the resulting interval rigorous.
+
+static bool hardware_value(algebraic_r x, double &v)
+// ----------------------------------------------------------------------------
+//   Read a hardware floating-point endpoint
+// ----------------------------------------------------------------------------
+{
+    switch (x->type())
+    {
+    case object::ID_hwfloat:
+        v = hwfloat_p(+x)->value();
+        return true;
+    case object::ID_hwdouble:
+        v = hwdouble_p(+x)->value();
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+static bool hardware_bounds(range_r r, double &lo, double &hi)
+// ----------------------------------------------------------------------------
+//   Check if the bounds of a range can be computed with the FPU
+// ----------------------------------------------------------------------------
+{
+    if (!fast_function::hardware())
+        return false;
+    algebraic_g l = r->lo();
+    algebraic_g h = r->hi();
+    return hardware_value(l, lo) && hardware_value(h, hi);
+}
+
+
+static algebraic_p hardware_bound(double v, bool up)
+// ----------------------------------------------------------------------------
+//   Build a hardware floating-point bound, rounding outwards to float
+// ----------------------------------------------------------------------------
+{
+    if (Settings.Precision() <= 7)
+    {
+        float f = float(v);
+        if (up ? double(f) < v : double(f) > v)
+            f = std::nextafter(f, up ? HUGE_VALF : -HUGE_VALF);
+        return hwfloat::make(f);
+    }
+    return hwdouble::make(v);
+}
+
+
+static range_p hardware_range(object::id type, double lo, double hi)
+// ----------------------------------------------------------------------------
+//   Build a range from hardware bounds, or fail if they are not finite
+// ----------------------------------------------------------------------------
+{
+    if (!std::isfinite(lo) || !std::isfinite(hi))
+        return nullptr;
+    algebraic_g l = hardware_bound(lo, false);
+    algebraic_g h = hardware_bound(hi, true);
+    return range::make(type, l, h);
+}
+
+
+static inline double outwards(double v, double err, bool up)
+// ----------------------------------------------------------------------------
+//   Move a rounded value outwards if the exact result is on that side
+// ----------------------------------------------------------------------------
+//   err is the sign of exact result minus the rounded value
+{
+    if (up ? err > 0.0 : err < 0.0)
+        v = std::nextafter(v, up ? HUGE_VAL : -HUGE_VAL);
+    return v;
+}
+
+
+static double add_bound(double a, double b, bool up)
+// ----------------------------------------------------------------------------
+//   Addition rounded in the given direction, using the exact error of a+b
+// ----------------------------------------------------------------------------
+{
+    double s  = a + b;
+    double bb = s - a;
+    double e  = (a - (s - bb)) + (b - bb);
+    return outwards(s, e, up);
+}
+
+
+static double mul_bound(double a, double b, bool up)
+// ----------------------------------------------------------------------------
+//   Multiplication rounded in the given direction, using the FMA residual
+// ----------------------------------------------------------------------------
+{
+    double p = a * b;
+    return outwards(p, std::fma(a, b, -p), up);
+}
+
+
+static double div_bound(double a, double b, bool up)
+// ----------------------------------------------------------------------------
+//   Division rounded in the given direction, using the FMA residual
+// ----------------------------------------------------------------------------
+{
+    double q = a / b;
+    double r = std::fma(q, b, -a);      // Exact: q*b - a
+    return outwards(q, b < 0.0 ? r : -r, up);
+}
+
+
 range_p operator-(range_r x)
 // ----------------------------------------------------------------------------
 //  Unary minus for ranges
@@ -346,6 +458,12 @@ range_p operator+(range_r x, range_r y)
 {
     if (!x|| !y)
         return nullptr;
+    double xl, xh, yl, yh;
+    if (hardware_bounds(x, xl, xh) && hardware_bounds(y, yl, yh))
+        if (range_p r = hardware_range(y->type(),
+                                       add_bound(xl, yl, false),
+                                       add_bound(xh, yh, true)))
+            return r;
     algebraic_g lo = x->lo() + y->lo();
     algebraic_g hi = x->hi() + y->hi();
     return range::make(y->type(), lo, hi);
@@ -359,6 +477,12 @@ range_p operator-(range_r x, range_r y)
 {
     if (!x|| !y)
         return nullptr;
+    double xl, xh, yl, yh;
+    if (hardware_bounds(x, xl, xh) && hardware_bounds(y, yl, yh))
+        if (range_p r = hardware_range(y->type(),
+                                       add_bound(xl, -yh, false),
+                                       add_bound(xh, -yl, true)))
+            return r;
     algebraic_g lo = x->lo() - y->hi();
     algebraic_g hi = x->hi() - y->lo();
     return range::make(y->type(), lo, hi);
@@ -372,6 +496,20 @@ range_p operator*(range_r x, range_r y)
 {
     if (!x|| !y)
         return nullptr;
+    double xl, xh, yl, yh;
+    if (hardware_bounds(x, xl, xh) && hardware_bounds(y, yl, yh))
+    {
+        double lo = std::fmin(std::fmin(mul_bound(xl, yl, false),
+                                        mul_bound(xl, yh, false)),
+                              std::fmin(mul_bound(xh, yl, false),
+                                        mul_bound(xh, yh, false)));
+        double hi = std::fmax(std::fmax(mul_bound(xl, yl, true),
+                                        mul_bound(xl, yh, true)),
+                              std::fmax(mul_bound(xh, yl, true),
+                                        mul_bound(xh, yh, true)));
+        if (range_p r = hardware_range(y->type(), lo, hi))
+            return r;
+    }
     algebraic_g xlo = x->lo();
     algebraic_g xhi = x->hi();
     algebraic_g ylo = y->lo();
@@ -414,6 +552,20 @@ range_p operator/(range_r x, range_r y)
         yhi = rt.infinity(false);
         return range::make(y->type(), ylo, yhi);
     }
+    double xl, xh, yl, yh;
+    if (hardware_bounds(x, xl, xh) && hardware_bounds(y, yl, yh))
+    {
+        double lo = std::fmin(std::fmin(div_bound(xl, yl, false),
+                                        div_bound(xl, yh, false)),
+                              std::fmin(div_bound(xh, yl, false),
+                                        div_bound(xh, yh, false)));
+        double hi = std::fmax(std::fmax(div_bound(xl, yl, true),
+                                        div_bound(xl, yh, true)),
+                              std::fmax(div_bound(xh, yl, true),
+                                        div_bound(xh, yh, true)));
+        if (range_p r = hardware_range(y->type(), lo, hi))
+            return r;
+    }
     algebraic_g a = xlo / ylo;
     algebraic_g b = xlo / yhi;
     algebraic_g c = xhi / ylo;
@@ -444,13 +596,30 @@ range_p operator^(range_r x, range_r y)
 //
 // ============================================================================
 
-static range_p monotonic(algebraic_fn fn, range_r r, bool down = false)
+typedef double (*hardware_fn)(double);
+
+static range_p monotonic(algebraic_fn fn, range_r r, bool down = false,
+                         hardware_fn hw = nullptr)
 // ----------------------------------------------------------------------------
 //   Compute monotonic functions
 // ----------------------------------------------------------------------------
+//   The library functions are not correctly rounded, so hardware bounds are
+//   always moved outwards by one ulp.
 {
     if (!r)
         return nullptr;
+    double hlo, hhi;
+    if (hw && hardware_bounds(r, hlo, hhi))
+    {
+        hlo = hw(hlo);
+        hhi = hw(hhi);
+        if (down)
+            std::swap(hlo, hhi);
+        hlo = std::nextafter(hlo, -HUGE_VAL);
+        hhi = std::nextafter(hhi, HUGE_VAL);
+        if (range_p result = hardware_range(r->type(), hlo, hhi))
+            return result;
+    }
     algebraic_g lo   = r->lo();
     algebraic_g hi   = r->hi();
     object::id  type = r->type();
@@ -465,7 +634,7 @@ RANGE_BODY(sqrt)
 //   Range implementation of sqrt (monotonic)
 // ----------------------------------------------------------------------------
 {
-    return monotonic(sqrt::evaluate, r);
+    return monotonic(sqrt::evaluate, r, false, ::sqrt);
 }
 
 
@@ -474,7 +643,7 @@ RANGE_BODY(cbrt)
 //   Range implementation of cbrt (monotonic)
 // ----------------------------------------------------------------------------
 {
-    return monotonic(cbrt::evaluate, r);
+    return monotonic(cbrt::evaluate, r, false, ::cbrt);
 }
 
 
@@ -605,7 +774,7 @@ RANGE_BODY(sinh)
 //   Range implementation of sinh
 // ----------------------------------------------------------------------------
 {
-    return monotonic(sinh::evaluate, r);
+    return monotonic(sinh::evaluate, r, false, ::sinh);
 }
 
 RANGE_BODY(cosh)
@@ -620,7 +789,7 @@ RANGE_BODY(cosh)
     bool        lneg = lo->is_negative(false);
     bool        hneg = hi->is_negative(false);
     if (lneg == hneg)
-        return monotonic(cosh::evaluate, r, lneg);
+        return monotonic(cosh::evaluate, r, lneg, ::cosh);
     lo = cosh::evaluate(lo);
     hi = cosh::evaluate(hi);
     range::sort(lo, hi);
@@ -634,7 +803,7 @@ RANGE_BODY(tanh)
 //   Range implementation of tanh
 // ----------------------------------------------------------------------------
 {
-    return monotonic(tanh::evaluate, r);
+    return monotonic(tanh::evaluate, r, false, ::tanh);
 }
 
 
@@ -643,7 +812,7 @@ RANGE_BODY(asinh)
 //   Range implementation of asinh
 // ----------------------------------------------------------------------------
 {
-    return monotonic(asinh::evaluate, r);
+    return monotonic(asinh::evaluate, r, false, ::asinh);
 }
 
 
@@ -652,7 +821,7 @@ RANGE_BODY(acosh)
 //   Range implementation of acosh
 // ----------------------------------------------------------------------------
 {
-    return monotonic(acosh::evaluate, r);
+    return monotonic(acosh::evaluate, r, false, ::acosh);
 }
 
 
@@ -661,7 +830,7 @@ RANGE_BODY(atanh)
 //   Range implementation of atanh
 // ----------------------------------------------------------------------------
 {
-    return monotonic(atanh::evaluate, r);
+    return monotonic(atanh::evaluate, r, false, ::atanh);
 }
 
 
@@ -670,7 +839,7 @@ RANGE_BODY(ln1p)
 //   Range implementation of ln1p
 // ----------------------------------------------------------------------------
 {
-    return monotonic(ln1p::evaluate, r);
+    return monotonic(ln1p::evaluate, r, false, ::log1p);
 }
 
 RANGE_BODY(expm1)
@@ -678,7 +847,7 @@ RANGE_BODY(expm1)
 //   Range implementation of expm1
 // ----------------------------------------------------------------------------
 {
-    return monotonic(expm1::evaluate, r);
+    return monotonic(expm1::evaluate, r, false, ::expm1);
 }
 
 
@@ -687,7 +856,7 @@ RANGE_BODY(ln)
 //   Range implementation of log
 // ----------------------------------------------------------------------------
 {
-    return monotonic(ln::evaluate, r);
+    return monotonic(ln::evaluate, r, false, ::log);
 }
 
 RANGE_BODY(log10)
@@ -695,7 +864,7 @@ RANGE_BODY(log10)
 //   Range implementation of log10
 // ----------------------------------------------------------------------------
 {
-    return monotonic(log10::evaluate, r);
+    return monotonic(log10::evaluate, r, false, ::log10);
 }
 
 
@@ -704,7 +873,7 @@ RANGE_BODY(log2)
 //   Range implementation of log2
 // ----------------------------------------------------------------------------
 {
-    return monotonic(log2::evaluate, r);
+    return monotonic(log2::evaluate, r, false, ::log2);
 }
 
 
@@ -713,7 +882,7 @@ RANGE_BODY(exp)
 //   Range implementation of exp
 // ----------------------------------------------------------------------------
 {
-    return monotonic(exp::evaluate, r);
+    return monotonic(exp::evaluate, r, false, ::exp);
 }
 
 
@@ -731,7 +900,7 @@ RANGE_BODY(exp2)
 //   Range implementation of exp2
 // ----------------------------------------------------------------------------
 {
-    return monotonic(exp2::evaluate, r);
+    return monotonic(exp2::evaluate, r, false, ::exp2);
 }
 
 
@@ -740,7 +909,7 @@ RANGE_BODY(erf)
 //   Range implementation of erf
 // ----------------------------------------------------------------------------
 {
-    return monotonic(erf::evaluate, r);
+    return monotonic(erf::evaluate, r, false, ::erf);
 }
 
 
@@ -749,7 +918,7 @@ RANGE_BODY(erfc)
 //   Range implementation of erfc
 // ----------------------------------------------------------------------------
 {
-    return monotonic(erfc::evaluate, r, true);
+    return monotonic(erfc::evaluate, r, true, ::erfc);
 }
 
 
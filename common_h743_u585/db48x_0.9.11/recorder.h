@@ -43,6 +43,70 @@ void assertion_failed(const char *);
             assertion_failed(#x);                               \
     } while(0)
 
+#elif USE_RTT_RECORDER
+// Events are sent in binary form over RTT, see recorder_rtt() in dmcp.cpp
+#include <stdint.h>
+
+struct recorder_info
+// ----------------------------------------------------------------------------
+//   A recorder, with its runtime trace setting
+// ----------------------------------------------------------------------------
+{
+    recorder_info(const char *name, const char *info);
+    const char    *name;
+    const char    *info;
+    recorder_info *next;
+    uintptr_t      trace;
+};
+
+#define RECORDER(Name, Size, Info)      RECORDER_DEFINE(Name, Size, Info)
+#define RECORDER_TRACE(Name)            (recorder_info_##Name.trace)
+#define RECORDER_ENABLED(Name)          (recorder_info_##Name.trace != 0)
+#define RECORDER_DEFINE(Name, Size, Info)                       \
+    recorder_info recorder_info_##Name(#Name, Info)
+#define RECORDER_DECLARE(Name)                                  \
+    extern recorder_info recorder_info_##Name
+#define RECORDER_TWEAK_DECLARE(Name)
+#define RECORDER_TWEAK_DEFINE(Name, Value, Info)
+#define RECORDER_TWEAK(Name)    0
+#define RECORD(rec, ...)                                        \
+    do                                                          \
+    {                                                           \
+        if (recorder_info_##rec.trace)                          \
+            recorder_event(recorder_info_##rec, __VA_ARGS__);   \
+    } while(0)
+#define record(...)             RECORD(__VA_ARGS__)
+
+RECORDER_DECLARE(assert_error);
+
+void recorder_rtt(recorder_info &rec, const char *format,
+                  unsigned nargs, const uintptr_t *args);
+void recorder_trace_set(const char *spec);
+void recorder_poll();
+
+// Arguments are sent as raw words, floating-point values as float bits
+template <typename T>
+inline uintptr_t recorder_arg(T value)  { return (uintptr_t) value; }
+inline uintptr_t recorder_arg(float value)
+{
+    union { float f; uint32_t u; } bits = { value };
+    return bits.u;
+}
+inline uintptr_t recorder_arg(double value)
+{
+    return recorder_arg(float(value));
+}
+
+template <typename ...Args>
+inline void recorder_event(recorder_info &rec, const char *format,
+                           const Args &...args)
+{
+    const uintptr_t values[sizeof...(args) + 1] = { recorder_arg(args)... };
+    recorder_rtt(rec, format, sizeof...(args), values);
+}
+
+#define ASSERT(x)
+
 #else
 // The DM42 has so little memory (70K) that we can't use it for recorders
 #define RECORDER(Name, Size, Info)
@@ -65,10 +65,7 @@ bool renderer::put(cstring s)
 //   Put a null-terminated string
 // ----------------------------------------------------------------------------
 {
-    for (char c = *s++; c; c = *s++)
-        if (!put(c))
-            return false;
-    return true;
+    return put(s, strlen(s));
 }
 
 
@@ -78,8 +75,56 @@ bool renderer::put(cstring s, size_t len)
 // ----------------------------------------------------------------------------
 {
     for (size_t i = 0; i < len; i++)
+    {
         if (!put(s[i]))
             return false;
+
+        // Runs of characters that need no formatting are written at once
+        if (!needCR && !needSpace)
+        {
+            size_t run = i + 1;
+            while (run < len && !isspace(s[run]) && s[run] != '"')
+                run++;
+            size_t count = run - i - 1;
+            if (count > length - written)
+                count = length - written;
+            if (count)
+            {
+                if (!write(s + i + 1, count))
+                    return false;
+                i += count;
+            }
+        }
+    }
+    return true;
+}
+
+
+bool renderer::write(cstring s, size_t len)
+// ----------------------------------------------------------------------------
+//   Write characters that are neither spaces nor quotes as they are
+// ----------------------------------------------------------------------------
+{
+    if (saving)
+    {
+        if (!saving->write(s, len))
+            return false;
+    }
+    else if (target)
+    {
+        memcpy(target + written, s, len);
+    }
+    else
+    {
+        byte *p = rt.allocate(len);
+        if (!p)
+            return false;
+        memcpy(p, s, len);
+    }
+    written += len;
+    column += len;
+    gotCR = false;
+    gotSpace = false;
     return true;
 }
 
@@ -244,10 +289,14 @@ bool renderer::put(object::id format, utf8 text, size_t len)
     default:
     case object::ID_LongFormNames:
     case object::ID_LongForm:
-        for (cstring p = cstring(text); size_t(utf8(p) - text) < len && *p; p++)
-            result = put(*p);
+    {
+        size_t n = 0;
+        while (n < len && text[n])
+            n++;
+        result = put(cstring(text), n);
         break;
     }
+    }
 
     return result;
 }
@@ -76,6 +76,7 @@ struct renderer
     bool   multiline_stack() const      { return mlstk; }
     file * file_save() const            { return saving; }
     size_t size() const                 { return written; }
+    bool   full() const                 { return written >= length; }
     void   clear()                      { written = 0; }
     utf8   text() const;
 
@@ -128,6 +129,9 @@ struct renderer
             unwrite(written - sz);
     }
 
+protected:
+    bool   write(cstring s, size_t len);
+
 protected:
     char  *target;        // Buffer where we render the object, or nullptr
     size_t length;        // Available space
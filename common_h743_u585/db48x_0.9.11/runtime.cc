@@ -32,6 +32,7 @@
 #include "arithmetic.h"
 #include "compare.h"
 #include "constants.h"
+#include "dmcp.h"
 #include "expression.h"
 #include "integer.h"
 #include "object.h"
@@ -99,6 +100,7 @@ runtime::runtime(byte *mem, size_t size)
       Temporaries(),
       Editing(),
       Scratch(),
+      Reserved(),
       Stack(),
       Args(),
       Undo(),
@@ -109,15 +111,27 @@ runtime::runtime(byte *mem, size_t size)
       CallStack(),
       Returns(),
       HighMem(),
+      StackLow(),
+      ObjHigh(),
+      ExtLow(),
+      ExtTemporaries(),
+      ExtHigh(),
+      ExtThreshold(),
+      ExtFree(),
+      ExtFreeBytes(),
       Cache(),
-      CacheIndex(),
+      CacheCount(),
+      GCWatermark(),
       GCCycles(),
+      GCMinor(),
       GCPurged(),
       GCDuration(),
       GCLPurged(),
       GCLDuration(),
       GCCleared(),
       GCUnclear(),
+      GCAllocated(),
+      GCMoved(),
       SaveArgs(false)
 {
     if (mem)
@@ -126,13 +140,27 @@ runtime::runtime(byte *mem, size_t size)
 }
 
 
-void runtime::memory(byte *memory, size_t size)
+void runtime::memory(byte *memory, size_t size, byte *stack, size_t ssize)
 // ----------------------------------------------------------------------------
 //   Assign the given memory range to the runtime
 // ----------------------------------------------------------------------------
+//   If a separate stack memory range is given, all pointer areas (stack,
+//   locals, directories, return stack) are placed there, and the main
+//   memory range is entirely used for objects.
 {
     LowMem = (object_p) memory;
-    HighMem = (object_p *) (memory + size);
+    if (stack)
+    {
+        HighMem = (object_p *) (stack + ssize);
+        StackLow = (object_p *) stack;
+        ObjHigh = (object_p) (memory + size);
+    }
+    else
+    {
+        HighMem = (object_p *) (memory + size);
+        StackLow = nullptr;
+        ObjHigh = nullptr;
+    }
 
     // Stuff at top of memory
     Returns = HighMem;                          // No return stack
@@ -151,11 +179,17 @@ void runtime::memory(byte *memory, size_t size)
     *Directories = (object_p) home;             // Current search path
     Globals = home->skip();                     // Globals after home
     Temporaries = Globals;                      // Area for temporaries
+    GCWatermark = Temporaries;                  // No old generation
+    directory::globals_moved();                 // Drop directory indexes
     Editing = 0;                                // No editor
     Scratch = 0;                                // No scratchpad
+    Reserved = 0;                               // No reservation
 
     record(runtime, "Memory %p-%p size %u (%uK)",
-           LowMem, HighMem, size, size>>10);
+           LowMem, memory_end(), size, size>>10);
+    if (stack)
+        record(runtime, "Stack %p-%p size %u (%uK)",
+               StackLow, HighMem, ssize, ssize>>10);
     runtime_invariants check;
 }
 
@@ -165,13 +199,108 @@ void runtime::reset()
 //   Reset the runtime to initial state
 // ----------------------------------------------------------------------------
 {
-    memory((byte *) LowMem, (byte_p) HighMem - (byte_p) LowMem);
+    if (StackLow)
+        memory((byte *) LowMem, (byte_p) ObjHigh - (byte_p) LowMem,
+               (byte *) StackLow, (byte_p) HighMem - (byte_p) StackLow);
+    else
+        memory((byte *) LowMem, (byte_p) HighMem - (byte_p) LowMem);
+    runtime_invariants check;
+}
+
+
+bool runtime::resume(const runtime &saved, byte *memory, size_t size,
+                     byte *stack, size_t ssize)
+// ----------------------------------------------------------------------------
+//   Take over the memory of a runtime saved before a soft reset
+// ----------------------------------------------------------------------------
+//   The saved runtime must describe the same memory ranges, its objects
+//   must chain exactly up to the temporaries, and whatever the stack and
+//   directory path point to in memory must be an object. Temporaries in
+//   extended memory are not checked, so there must be none.
+{
+    object_p  low     = object_p(memory);
+    object_p *high    = (object_p *) (stack ? stack + ssize : memory + size);
+    object_p  objhigh = stack ? object_p(memory + size) : nullptr;
+    object_p *stklow  = (object_p *) stack;
+    if (saved.LowMem != low || saved.HighMem != high ||
+        saved.ObjHigh != objhigh || saved.StackLow != stklow ||
+        saved.ExtTemporaries != saved.ExtLow)
+        return false;
+
+    // Check the memory layout
+    object_p  temps = saved.Temporaries;
+    object_p  top   = objhigh ? objhigh : object_p(saved.Stack);
+    object_p *lower = stklow ? stklow : (object_p *) temps;
+    if (saved.Globals < low || saved.Globals > temps ||
+        temps + saved.Editing + saved.Scratch > top ||
+        saved.Stack < lower || saved.Args < saved.Stack ||
+        saved.Undo < saved.Stack || saved.Locals < saved.Stack ||
+        saved.Directories < saved.Locals || saved.XLibs < saved.Directories ||
+        saved.Constants < saved.XLibs || saved.Returns > high ||
+        saved.CallStack > high || saved.Constants > high)
+        return false;
+
+    // Check that objects chain up to the temporaries
+    object_p obj = low;
+    while (obj < temps)
+    {
+        if (obj->type() >= object::NUM_IDS)
+            return false;
+        object_p next = obj->skip();
+        if (next <= obj)
+            return false;
+        obj = next;
+    }
+    if (obj != temps)
+        return false;
+
+    // Check what the stack, saved arguments, locals and path refer to
+    for (object_p *s = saved.Stack; s < saved.XLibs; s++)
+    {
+        object_p o = *s;
+        if (!o)
+            return false;
+        if (o >= low && o < temps && o->type() >= object::NUM_IDS)
+            return false;
+    }
+
+    // Adopt the saved runtime, without the editor content
+    memcpy((void *) this, (const void *) &saved, sizeof(*this));
+    Editing = 0;
+    Scratch = 0;
+    Reserved = 0;
+    directory::globals_moved();
+    recache();
+    record(runtime, "Resumed memory %p-%p with %u bytes of globals",
+           LowMem, memory_end(), (byte_p) Temporaries - (byte_p) Globals);
     runtime_invariants check;
+    return true;
 }
 
 
 
 
+#ifndef LARGE_HOLE_MIN
+// Smallest hole we can leave behind when splitting a free block
+#define LARGE_HOLE_MIN          16
+#endif // LARGE_HOLE_MIN
+
+
+void runtime::extended_memory(byte *memory, size_t size, size_t threshold)
+// ----------------------------------------------------------------------------
+//   Assign a second, slower memory range for large temporaries
+// ----------------------------------------------------------------------------
+{
+    ExtLow = ExtTemporaries = (object_p) memory;
+    ExtHigh = ExtLow + (memory ? size : 0);
+    ExtThreshold = threshold < LARGE_HOLE_MIN ? LARGE_HOLE_MIN : threshold;
+    ExtFree = nullptr;
+    ExtFreeBytes = 0;
+    record(runtime, "Extended memory %p-%p size %u (%uK) for objects >= %u",
+           ExtLow, ExtHigh, size, size>>10, threshold);
+}
+
+
 // ============================================================================
 //
 //    Temporaries
@@ -189,7 +318,7 @@ size_t runtime::available()
 // ----------------------------------------------------------------------------
 {
     size_t aboveTemps = Editing + Scratch + redzone;
-    return (byte *) Stack - (byte *) Temporaries - aboveTemps;
+    return (byte *) objects_end() - (byte *) Temporaries - aboveTemps;
 }
 
 
@@ -197,19 +326,67 @@ size_t runtime::available(size_t size)
 // ----------------------------------------------------------------------------
 //   Check if we have enough for the given size
 // ----------------------------------------------------------------------------
+//   Memory promised to a reservation is not available to other allocations
 {
-    if (available() < size)
+    size_t needed = size + Reserved;
+    if (available() < needed)
     {
-        gc();
+        // Try collecting recent temporaries first, then everything
+        gc(false);
         size_t avail = available();
-        if (avail < size)
-            out_of_memory_error();
-        return avail;
+        if (avail < needed)
+        {
+            if (GCWatermark > Globals)
+            {
+                gc(true);
+                avail = available();
+            }
+            if (avail < needed)
+                out_of_memory_error();
+        }
+        return avail > Reserved ? avail - Reserved : 0;
     }
     return size;
 }
 
 
+bool runtime::reserve(size_t size, size_t &added)
+// ----------------------------------------------------------------------------
+//   Make sure size bytes can be allocated without garbage collection
+// ----------------------------------------------------------------------------
+//   This may collect garbage once. The caller must give back what was added
+//   to the reservation with release(), see struct reservation.
+{
+    added = 0;
+    if (size <= Reserved)
+        return true;            // The enclosing reservation covers it
+    size_t more = size - Reserved;
+    if (available(more) < more)
+        return false;
+    added = more;
+    Reserved += more;
+    record(runtime, "Reserved %u bytes, %u in reservation", more, Reserved);
+    return true;
+}
+
+
+size_t runtime::available_stack(size_t size)
+// ----------------------------------------------------------------------------
+//   Check if we have enough room for the given size of stack pointers
+// ----------------------------------------------------------------------------
+//   When the stack lives in its own memory region, garbage collection
+//   cannot make room for it, so we fail immediately
+{
+    if (!StackLow)
+        return available(size);
+
+    size_t avail = (byte *) Stack - (byte *) StackLow;
+    if (avail < size)
+        out_of_memory_error();
+    return avail;
+}
+
+
 
 // ============================================================================
 //
@@ -348,28 +525,13 @@ void runtime::dump_gc_pointers()
 #endif // SIMULATOR
 
 
-runtime::gcptr::~gcptr()
+static inline uint cache_hash(object_p key)
 // ----------------------------------------------------------------------------
-//   Destructor for a garbage-collected pointer
+//   Hash an object address to find its slot in the cache
 // ----------------------------------------------------------------------------
 {
-    lock it;
-    gcptr *last = nullptr;
-    if (this == rt.GCSafe)
-    {
-        rt.GCSafe = next;
-        return;
-    }
-
-    for (gcptr *gc = rt.GCSafe; gc; gc = gc->next)
-    {
-        if (gc == this)
-        {
-            last->next = gc->next;
-            return;
-        }
-        last = gc;
-    }
+    uintptr_t k = uintptr_t(key);
+    return (uint(k ^ (k >> 13)) * 2654435761U) >> 16;
 }
 
 
@@ -378,15 +540,17 @@ object_p runtime::cached(bool level0, object_p key)
 //   Check if there is a value associated to this object
 // ----------------------------------------------------------------------------
 {
-    size_t max = sizeof(Cache[level0]) / sizeof(Cache[level0][0]);
-    for (uint i = 0; i < max; i += 2)
+    if (!key)
+        return nullptr;
+    const uint mask = CACHE_ENTRIES - 1;
+    cache_entry *entries = Cache[level0];
+    for (uint i = cache_hash(key) & mask; entries[i].key; i = (i + 1) & mask)
     {
-        uint j = (CacheIndex - i) % max;
-        if (Cache[level0][j] == key)
+        if (entries[i].key == key)
         {
             record(cache, "Got %p for %p at %u.%u",
-                   Cache[level0][j+1], key, level0, j);
-            return Cache[level0][j+1];
+                   entries[i].value, key, level0, i);
+            return entries[i].value;
         }
     }
     record(cache, "Did not find %p", key);
@@ -399,81 +563,356 @@ bool runtime::cache(bool level0, object_p key, object_p value)
 //   Cache the value
 // ----------------------------------------------------------------------------
 {
-    size_t max = sizeof(Cache[level0]) / sizeof(Cache[level0][0]);
-    for (uint i = 0; i < max; i += 2)
+    if (!key)
+        return false;
+    const uint mask = CACHE_ENTRIES - 1;
+    cache_entry *entries = Cache[level0];
+    uint i;
+    for (i = cache_hash(key) & mask; entries[i].key; i = (i + 1) & mask)
     {
-        uint j = (CacheIndex - i) % max;
-        if (Cache[level0][j] == key)
+        if (entries[i].key == key)
         {
             record(cache, "Replace %p with %p for %p at %u.%u",
-                   Cache[level0][j+1], value, key, level0, j);
-            Cache[level0][j+1] = value;
+                   entries[i].value, value, key, level0, i);
+            entries[i].value = value;
             return true;
         }
     }
-    CacheIndex = (CacheIndex + 2) % max;
-    record(cache, "Set  %p for %p at %u.%u, erasing %p",
-           value, key, level0, CacheIndex, Cache[level0][CacheIndex+1]);
-    Cache[level0][CacheIndex] = key;
-    Cache[level0][CacheIndex + 1] = value;
+
+    // Keep the load factor low enough for probes to stay short
+    if (4 * CacheCount[level0] >= 3 * CACHE_ENTRIES)
+    {
+        record(cache, "Cache %u full, flushing", level0);
+        memset(entries, 0, sizeof(Cache[level0]));
+        CacheCount[level0] = 0;
+        i = cache_hash(key) & mask;
+    }
+
+    record(cache, "Set  %p for %p at %u.%u", value, key, level0, i);
+    entries[i].key = key;
+    entries[i].value = value;
+    CacheCount[level0]++;
     return false;
 }
 
 
+void runtime::recache()
+// ----------------------------------------------------------------------------
+//   Rebuild the hash tables after cached objects were moved or removed
+// ----------------------------------------------------------------------------
+//   Entries with a null key or value are dropped. The cache is small, so it
+//   is simpler to rebuild it than to maintain tombstones.
+{
+    const uint mask = CACHE_ENTRIES - 1;
+    for (uint l = 0; l < 2; l++)
+    {
+        cache_entry old[CACHE_ENTRIES];
+        memcpy(old, Cache[l], sizeof(old));
+        memset(Cache[l], 0, sizeof(Cache[l]));
+        CacheCount[l] = 0;
+        for (uint e = 0; e < CACHE_ENTRIES; e++)
+        {
+            if (old[e].key && old[e].value)
+            {
+                uint i = cache_hash(old[e].key) & mask;
+                while (Cache[l][i].key)
+                    i = (i + 1) & mask;
+                Cache[l][i] = old[e];
+                CacheCount[l]++;
+            }
+        }
+    }
+}
+
+
 void runtime::uncache(object_p start, size_t sz)
 // ----------------------------------------------------------------------------
-//   Drop the whole cache
+//   Drop cached entries referencing the given range
 // ----------------------------------------------------------------------------
 {
     object_p end = start + sz;
     record(cache, "Clear cache %p-%p sz %u", start, end, sz);
+    bool changed = false;
     for (uint l = 0; l < 2; l++)
     {
-        const uint max = sizeof(Cache[0]) / sizeof(Cache[0][0]);
-        for (uint i = 0; i < max; i++)
+        for (uint i = 0; i < CACHE_ENTRIES; i++)
         {
-            object_p &ptr = Cache[l][i];
-            if (ptr >= start && ptr < end)
-                ptr = nullptr;
+            cache_entry &entry = Cache[l][i];
+            if (!entry.key)
+                continue;
+            if ((entry.key   >= start && entry.key   < end) ||
+                (entry.value >= start && entry.value < end))
+            {
+                entry.key = entry.value = nullptr;
+                changed = true;
+            }
         }
     }
+    if (changed)
+        recache();
 }
 
 
-size_t runtime::gc()
+// ============================================================================
+//
+//   Sorted root set used by the garbage collector
+//
+// ============================================================================
+//   Each root is the address of a pointer slot (stack level, gc-safe pointer,
+//   error message, menu label, ...). Slots are pointer-aligned, so the low
+//   bit is used to mark gc-safe pointers, which are allowed to point right
+//   past the end of the object they protect.
+
+//   Cache keys are marked as weak: they do not keep objects alive, and they
+//   are cleared if the object they point to is recycled.
+
+typedef runtime::gc_root gc_root;
+static const gc_root GC_INCLUSIVE = 1;
+static const gc_root GC_WEAK      = 2;
+static const gc_root GC_FLAGS     = GC_INCLUSIVE | GC_WEAK;
+
+
+static inline byte *gc_root_value(gc_root root)
 // ----------------------------------------------------------------------------
-//   Recycle unused temporaries
+//   Return the pointer currently stored in a root slot
 // ----------------------------------------------------------------------------
-//   Temporaries can only be referenced from the stack
-//   Objects in the global area are copied there, so they need no recycling
-//   This algorithm is linear in number of objects and moves only live data
 {
-    lock     it;
-    uint     now      = sys_current_ms();
+    return *(byte **) (root & ~GC_FLAGS);
+}
+
+
+static inline void gc_root_adjust(gc_root root, intptr_t delta)
+// ----------------------------------------------------------------------------
+//   Adjust the pointer stored in a root slot
+// ----------------------------------------------------------------------------
+{
+    byte **slot = (byte **) (root & ~GC_FLAGS);
+    *slot += delta;
+}
+
+
+static inline void gc_root_clear(gc_root root)
+// ----------------------------------------------------------------------------
+//   Clear the pointer stored in a root slot
+// ----------------------------------------------------------------------------
+{
+    byte **slot = (byte **) (root & ~GC_FLAGS);
+    *slot = nullptr;
+}
+
+
+static void gc_root_sift(gc_root *roots, size_t root, size_t count)
+// ----------------------------------------------------------------------------
+//   Sift down a root in the heap while sorting roots
+// ----------------------------------------------------------------------------
+{
+    while (true)
+    {
+        size_t child = 2 * root + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count &&
+            gc_root_value(roots[child]) < gc_root_value(roots[child + 1]))
+            child++;
+        if (gc_root_value(roots[child]) <= gc_root_value(roots[root]))
+            break;
+        std::swap(roots[root], roots[child]);
+        root = child;
+    }
+}
+
+
+static void gc_root_sort(gc_root *roots, size_t count)
+// ----------------------------------------------------------------------------
+//   Sort roots by the address they point to
+// ----------------------------------------------------------------------------
+//   We use heap sort because it runs in place, without recursion, and
+//   in O(N log N) worst case, which is what we want when memory is low
+{
+    for (size_t i = count / 2; i-- > 0; )
+        gc_root_sift(roots, i, count);
+    for (size_t i = count; i-- > 1; )
+    {
+        std::swap(roots[0], roots[i]);
+        gc_root_sift(roots, 0, i);
+    }
+}
+
+
+gc_root *runtime::gc_roots(object_p first, object_p last, size_t &count)
+// ----------------------------------------------------------------------------
+//   Collect all root slots pointing into the temporaries in free memory
+// ----------------------------------------------------------------------------
+//   Return nullptr if there is not enough free memory to hold all roots,
+//   in which case the caller falls back to the slower scanning collector
+{
+    byte    *lo    = scratchpad() + allocated();
+    byte    *hi    = (byte *) objects_end();
+    uintptr_t mask = sizeof(gc_root) - 1;
+    COMPILE_TIME_ASSERT(sizeof(gc_root) > GC_FLAGS);
+    gc_root *roots = (gc_root *) ((uintptr_t(lo) + mask) & ~mask);
+    gc_root *max   = (gc_root *) hi;
+    gc_root *root  = roots;
+    byte    *start = (byte *) first;
+    byte    *end   = (byte *) last;
+
+#define GC_ROOT(slot, flags)                                            \
+    do                                                                  \
+    {                                                                   \
+        byte *value = (byte *) (slot);                                  \
+        if (value >= start &&                                           \
+            (value < end || ((flags & GC_INCLUSIVE) && value == end)))  \
+        {                                                               \
+            if (root >= max)                                            \
+                return nullptr;                                         \
+            *root++ = gc_root(&(slot)) | (flags);                       \
+        }                                                               \
+    } while (0)
+
+    for (object_p *s = Stack; s < HighMem; s++)
+        GC_ROOT(*s, 0);
+    for (gcptr *p = GCSafe; p; p = p->next)
+        GC_ROOT(p->safe, GC_INCLUSIVE);
+
+    GC_ROOT(Error, 0);
+    GC_ROOT(ErrorSave, 0);
+    GC_ROOT(ErrorSource, 0);
+    GC_ROOT(ErrorCommand, 0);
+    GC_ROOT(ui.command, 0);
+    GC_ROOT(ui.keymap, 0);
+    GC_ROOT(ui.validate_input, 0);
+
+    utf8 *label = (utf8 *) &ui.menuLabel[0][0];
+    for (uint l = 0; l < ui.NUM_MENUS; l++)
+        GC_ROOT(label[l], 0);
+
+    object_p *functions = &ui.function[0][0];
+    const uint nfuncs = sizeof(ui.function) / sizeof(ui.function[0][0]);
+    for (uint k = 0; k < nfuncs; k++)
+        GC_ROOT(functions[k], 0);
+
+    // Cached values survive as long as the object they are cached for
+    for (uint l = 0; l < 2; l++)
+    {
+        for (uint i = 0; i < CACHE_ENTRIES; i++)
+        {
+            if (Cache[l][i].key)
+            {
+                GC_ROOT(Cache[l][i].key, GC_WEAK);
+                GC_ROOT(Cache[l][i].value, 0);
+            }
+        }
+    }
+
+#undef GC_ROOT
+
+    count = root - roots;
+    return roots;
+}
+
+
+static inline void move_bytes(object_p to, object_p from, size_t size)
+// ----------------------------------------------------------------------------
+//   Move a block of memory, using DMA for large moves when available
+// ----------------------------------------------------------------------------
+{
+#if USE_MDMA_MOVE
+    if (size >= MDMA_MOVE_THRESHOLD)
+    {
+        mdma_move((byte *) to, from, size);
+        return;
+    }
+#endif // USE_MDMA_MOVE
+    memmove((byte *) to, (byte *) from, size);
+}
+
+
+HOT size_t runtime::gc_sorted(object_p first, object_p last,
+                              gc_root *roots, size_t count)
+// ----------------------------------------------------------------------------
+//   Compact temporaries using a sorted root set
+// ----------------------------------------------------------------------------
+//   Once roots are sorted, a single walk over objects finds which ones are
+//   referenced, and each root slot is adjusted exactly once when its
+//   object moves. This is O(objects + roots log roots).
+//   Consecutive live objects move by the same amount, so they are moved
+//   together as a single run when the next dead object is found.
+{
     size_t   recycled = 0;
-    object_p first    = (object_p) Globals;
-    object_p last     = Temporaries;
+    size_t   r        = 0;
     object_p free     = first;
+    object_p run      = nullptr;
+    object_p runto    = nullptr;
     object_p next;
 
-    ui.draw_busy(L'●', Settings.GCIconForeground());
+    for (object_p obj = first; obj < last; obj = next)
+    {
+        next = obj->skip();
+        record(gc_details, "Scanning object %p (ends at %p)", obj, next);
 
-    record(gc, "Garbage collection, available %u, range %p-%p",
-           available(), first, last);
-#ifdef SIMULATOR
-    if (!integrity_test(first, last, Stack, XLibs))
+        // Roots pointing inside the object
+        size_t e = r;
+        bool found = false;
+        while (e < count && gc_root_value(roots[e]) < (byte *) next)
+            found |= !(roots[e++] & GC_WEAK);
+
+        // GC-safe pointers may point right at the end of the object
+        for (size_t i = e;
+             !found && i < count && gc_root_value(roots[i]) == (byte *) next;
+             i++)
+            found = roots[i] & GC_INCLUSIVE;
+
+        size_t sz = next - obj;
+        if (found)
+        {
+            intptr_t delta = free - obj;
+            record(gc_details, "Moving %p-%p to %p", obj, next, free);
+            if (delta)
+            {
+                if (!run)
+                {
+                    run = obj;
+                    runto = free;
+                }
+                for (size_t i = r; i < e; i++)
+                    gc_root_adjust(roots[i], delta);
+            }
+            free += sz;
+        }
+        else
+        {
+            if (run)
+            {
+                move_bytes(runto, run, free - runto);
+                GCMoved += free - runto;
+                run = nullptr;
+            }
+            recycled += sz;
+            record(gc_details, "Recycling %p size %u total %u",
+                   obj, sz, recycled);
+            for (size_t i = r; i < e; i++)
+                gc_root_clear(roots[i]);
+        }
+        r = e;
+    }
+    if (run)
     {
-        record(gc_errors, "Integrity test failed pre-collection");
-        RECORDER_TRACE(gc) = 1;
-        dump_object_list("Pre-collection failure",
-                         first, last, Stack, XLibs);
-        integrity_test(first, last, Stack, XLibs);
-        recorder_dump();
+        move_bytes(runto, run, free - runto);
+        GCMoved += free - runto;
     }
-    if (RECORDER_TRACE(gc) > 1)
-        dump_object_list("Pre-collection",
-                         first, last, Stack, XLibs);
-#endif // SIMULATOR
+    return recycled;
+}
+
+
+HOT size_t runtime::gc_scan(object_p first, object_p last)
+// ----------------------------------------------------------------------------
+//   Compact temporaries checking all roots for each object
+// ----------------------------------------------------------------------------
+//   This is the fallback when there is not enough room to sort roots
+{
+    size_t   recycled = 0;
+    object_p free     = first;
+    object_p next;
 
     object_p *firstobjptr = Stack;
     object_p *lastobjptr = HighMem;
@@ -544,6 +983,271 @@ size_t runtime::gc()
                    obj, next - obj, recycled);
         }
     }
+    return recycled;
+}
+
+
+// ============================================================================
+//
+//   Large-object space
+//
+// ============================================================================
+//   Objects in extended memory are never moved: copying a 100K grob or array
+//   on every collection would cost far more than the small objects around
+//   it. Dead objects are instead turned into holes, which are text objects
+//   so that memory can still be walked with skip(). The holes are chained
+//   in address order through their payload, and reused first-fit.
+//   The hole length is encoded as a padded LEB128 of fixed size, so that any
+//   hole size can be represented, including after splitting.
+
+static const size_t LARGE_HOLE_LENGTH = 4;
+
+
+static object_p large_hole(object_p at, size_t size, object_p next)
+// ----------------------------------------------------------------------------
+//   Turn a range of extended memory into a hole linked to the next one
+// ----------------------------------------------------------------------------
+{
+    byte  *p   = leb128((byte *) at, object::ID_text);
+    size_t len = size - (p - (byte *) at) - LARGE_HOLE_LENGTH;
+    for (uint i = 0; i < LARGE_HOLE_LENGTH; i++)
+    {
+        *p++ = (len & 0x7F) | (i + 1 < LARGE_HOLE_LENGTH ? 0x80 : 0);
+        len >>= 7;
+    }
+    memcpy(p, &next, sizeof(next));
+    return at;
+}
+
+
+static object_p large_hole_next(object_p hole)
+// ----------------------------------------------------------------------------
+//   Return the hole following this one in the free list
+// ----------------------------------------------------------------------------
+{
+    byte_p   p    = hole->payload() + LARGE_HOLE_LENGTH;
+    object_p next = nullptr;
+    memcpy(&next, p, sizeof(next));
+    return next;
+}
+
+
+static void large_hole_link(object_p hole, object_p next)
+// ----------------------------------------------------------------------------
+//   Change the hole following this one in the free list
+// ----------------------------------------------------------------------------
+{
+    byte *p = (byte *) hole->payload() + LARGE_HOLE_LENGTH;
+    memcpy(p, &next, sizeof(next));
+}
+
+
+size_t runtime::gc_large()
+// ----------------------------------------------------------------------------
+//   Sweep extended memory without moving anything, rebuilding the free list
+// ----------------------------------------------------------------------------
+//   Adjacent dead objects and old holes are merged into a single hole.
+//   A hole at the top of the used range is simply given back.
+//   Returns the number of bytes that became available.
+{
+    object_p first = ExtLow;
+    object_p last  = ExtTemporaries;
+    size_t   count = 0;
+    gc_root *roots = gc_roots(first, last, count);
+    if (!roots)
+    {
+        // Without a sorted root set, we cannot tell what is live cheaply.
+        // Not freeing anything is always safe.
+        record(gc, "Not enough memory to sort roots for extended memory");
+        return 0;
+    }
+    gc_root_sort(roots, count);
+
+    size_t   oldfree = ExtFreeBytes + (ExtHigh - ExtTemporaries);
+    size_t   r       = 0;
+    object_p hole    = nullptr;
+    object_p tail    = nullptr;
+    object_p next;
+
+    ExtFree = nullptr;
+    ExtFreeBytes = 0;
+    for (object_p obj = first; obj < last; obj = next)
+    {
+        next = obj->skip();
+
+        size_t e = r;
+        bool found = false;
+        while (e < count && gc_root_value(roots[e]) < (byte *) next)
+            found |= !(roots[e++] & GC_WEAK);
+        for (size_t i = e;
+             !found && i < count && gc_root_value(roots[i]) == (byte *) next;
+             i++)
+            found = roots[i] & GC_INCLUSIVE;
+
+        if (found)
+        {
+            if (hole)
+            {
+                size_t sz = obj - hole;
+                large_hole(hole, sz, nullptr);
+                if (tail)
+                    large_hole_link(tail, hole);
+                else
+                    ExtFree = hole;
+                tail = hole;
+                ExtFreeBytes += sz;
+                hole = nullptr;
+            }
+        }
+        else
+        {
+            for (size_t i = r; i < e; i++)
+                gc_root_clear(roots[i]);
+            if (!hole)
+                hole = obj;
+        }
+        r = e;
+    }
+
+    // A trailing hole goes back to the unallocated part
+    if (hole)
+        ExtTemporaries = hole;
+
+    size_t newfree = ExtFreeBytes + (ExtHigh - ExtTemporaries);
+    record(gc, "Extended memory swept, %u bytes in holes, %u at top",
+           ExtFreeBytes, ExtHigh - ExtTemporaries);
+    return newfree > oldfree ? newfree - oldfree : 0;
+}
+
+
+byte *runtime::allocate_hole(size_t size)
+// ----------------------------------------------------------------------------
+//   Allocate from the first hole large enough in extended memory
+// ----------------------------------------------------------------------------
+//   A hole is either used entirely, or split with the remainder kept as
+//   a smaller hole, provided it is large enough to remain a valid hole.
+{
+    COMPILE_TIME_ASSERT(LARGE_HOLE_MIN >=
+                        2 + LARGE_HOLE_LENGTH + sizeof(object_p));
+    object_p prev = nullptr;
+    for (object_p hole = ExtFree; hole; hole = large_hole_next(hole))
+    {
+        size_t   hsz  = hole->size();
+        object_p next = large_hole_next(hole);
+        if (hsz == size || hsz >= size + LARGE_HOLE_MIN)
+        {
+            if (hsz != size)
+                next = large_hole(hole + size, hsz - size, next);
+            if (prev)
+                large_hole_link(prev, next);
+            else
+                ExtFree = next;
+            ExtFreeBytes -= size;
+            return (byte *) hole;
+        }
+        prev = hole;
+    }
+    return nullptr;
+}
+
+
+byte *runtime::allocate_extended(size_t size)
+// ----------------------------------------------------------------------------
+//   Allocate a large temporary in extended memory, or return nullptr
+// ----------------------------------------------------------------------------
+//   A nullptr result is not an error: the caller uses main memory instead
+{
+    if (!ExtLow || size < ExtThreshold)
+        return nullptr;
+    if (byte *reused = allocate_hole(size))
+        return reused;
+
+    size_t avail = ExtHigh - ExtTemporaries;
+    if (avail < size)
+    {
+        size_t recycled = gc_large();
+        recache();
+        record(gc, "Extended memory purged %u, available %u",
+               recycled, ExtHigh - ExtTemporaries);
+        if (byte *reused = allocate_hole(size))
+            return reused;
+        avail = ExtHigh - ExtTemporaries;
+        if (avail < size)
+            return nullptr;
+    }
+    byte *result = (byte *) ExtTemporaries;
+    ExtTemporaries += size;
+    return result;
+}
+
+
+
+size_t runtime::gc_range(object_p first, object_p last)
+// ----------------------------------------------------------------------------
+//   Compact the objects in the given range, return number of bytes freed
+// ----------------------------------------------------------------------------
+{
+    size_t   count = 0;
+    gc_root *roots = gc_roots(first, last, count);
+    if (roots)
+    {
+        record(gc, "Sorting %u roots", count);
+        gc_root_sort(roots, count);
+        return gc_sorted(first, last, roots, count);
+    }
+
+    // The scanning collector does not know about cached values
+    record(gc, "Not enough memory to sort roots, scanning");
+    uncache();
+    return gc_scan(first, last);
+}
+
+
+size_t runtime::gc(bool full)
+// ----------------------------------------------------------------------------
+//   Recycle unused temporaries
+// ----------------------------------------------------------------------------
+//   Temporaries can only be referenced from the stack
+//   Objects in the global area are copied there, so they need no recycling
+//   Roots are first gathered and sorted in free memory, so that a single
+//   pass over objects identifies live data. This moves only live data.
+//   Objects never point to other objects, so older temporaries cannot keep
+//   younger ones alive. A young-generation collection can therefore start at
+//   GCWatermark, leaving objects that survived the previous collection alone.
+{
+    lock     it;
+    uint     now      = sys_current_ms();
+    size_t   recycled = 0;
+    bool     young    = !full && !Settings.FullGarbageCollection() &&
+                        GCWatermark > Globals && GCWatermark < Temporaries;
+    object_p first    = young ? GCWatermark : (object_p) Globals;
+    object_p last     = Temporaries;
+
+    sys_clock_boost();
+    ui.draw_busy(L'●', Settings.GCIconForeground());
+
+    // A full collection is a sign memory is low, drop cached renderings
+    if (!young)
+        uncache();
+
+    record(gc, "%+s garbage collection, available %u, range %p-%p",
+           young ? "Young" : "Full", available(), first, last);
+#ifdef SIMULATOR
+    if (!integrity_test(first, last, Stack, XLibs))
+    {
+        record(gc_errors, "Integrity test failed pre-collection");
+        RECORDER_TRACE(gc) = 1;
+        dump_object_list("Pre-collection failure",
+                         first, last, Stack, XLibs);
+        integrity_test(first, last, Stack, XLibs);
+        recorder_dump();
+    }
+    if (RECORDER_TRACE(gc) > 1)
+        dump_object_list("Pre-collection",
+                         first, last, Stack, XLibs);
+#endif // SIMULATOR
+
+    recycled = gc_range(first, last);
 
     // Move the command line and scratch buffer
     if (Editing + Scratch)
@@ -552,8 +1256,9 @@ size_t runtime::gc()
         move(edit - recycled, edit, Editing + Scratch, 1, true);
     }
 
-    // Adjust Temporaries
+    // Adjust Temporaries, promote survivors to the old generation
     Temporaries -= recycled;
+    GCWatermark = Temporaries;
 
 
 #ifdef SIMULATOR
@@ -574,14 +1279,24 @@ size_t runtime::gc()
     record(gc, "Garbage collection done, purged %u, available %u",
            recycled, available());
 
+    // Sweep the extended memory tier in place, large objects never move
+    if (full && ExtLow)
+    {
+        size_t extrecycled = gc_large();
+        recycled += extrecycled;
+        record(gc, "Extended memory purged %u, available %u",
+               extrecycled, ExtHigh - ExtTemporaries);
+    }
+
     ui.draw_busy();
 
-    // Clear the cache
-    uncache();
+    // Rehash the cache, since cached objects may have moved
+    recache();
 
     // Update statistics
     uint duration = sys_current_ms() - now;
     GCCycles += 1;
+    GCMinor += young;
     GCLPurged = recycled;
     GCLDuration = duration;
     GCPurged += recycled;
@@ -591,6 +1306,34 @@ size_t runtime::gc()
 }
 
 
+bool runtime::memory_low(uint percent)
+// ----------------------------------------------------------------------------
+//   Check if free memory is below the given percentage of object memory
+// ----------------------------------------------------------------------------
+{
+    size_t total = (byte *) memory_end() - (byte *) LowMem;
+    return available() < total / 100 * percent;
+}
+
+
+size_t runtime::idle_gc(uint percent)
+// ----------------------------------------------------------------------------
+//   Collect garbage while waiting for the user, if memory is running low
+// ----------------------------------------------------------------------------
+//   The main loop calls this when no key arrived for a while, so that
+//   collections rarely have to run in the middle of a command or program.
+//   A young collection is tried first, a full one if that was not enough.
+{
+    if (!memory_low(percent))
+        return 0;
+    record(gc, "Idle collection, available %u", available());
+    size_t recycled = gc(false);
+    if (memory_low(percent) && GCWatermark > Globals)
+        recycled += gc(true);
+    return recycled;
+}
+
+
 void runtime::move(object_p to, object_p from,
                    size_t size, size_t overscan, bool scratch)
 // ----------------------------------------------------------------------------
@@ -614,7 +1357,8 @@ void runtime::move(object_p to, object_p from,
         return;
 
     // Move the object in memory
-    memmove((byte *) to, (byte *) from, size);
+    move_bytes(to, from, size);
+    GCMoved += size;
 
     // Adjust the protected pointers
     object_p last = from + size + overscan;
@@ -680,6 +1424,25 @@ void runtime::move(object_p to, object_p from,
     for (uint k = 0; k < max; k++)
         if (functions[k] >= from && functions[k] < last)
             functions[k] += delta;
+
+    // Adjust cached entries, rehash if keys moved
+    bool rehash = false;
+    for (uint l = 0; l < 2; l++)
+    {
+        for (uint i = 0; i < CACHE_ENTRIES; i++)
+        {
+            cache_entry &entry = Cache[l][i];
+            if (entry.key >= from && entry.key < last)
+            {
+                entry.key += delta;
+                rehash = true;
+            }
+            if (entry.value >= from && entry.value < last)
+                entry.value += delta;
+        }
+    }
+    if (rehash)
+        recache();
 }
 
 
@@ -700,6 +1463,10 @@ void runtime::move_globals(object_p to, object_p from)
     if (Globals >= first && Globals < last)             // Storing global var
         Globals += delta;
     Temporaries += delta;
+    GCWatermark += delta;
+    directory::globals_moved();
+    if (GCWatermark < Globals)
+        GCWatermark = Globals;
 
     // Remove all cached entries, they may be covered by what we moved
     uncache(from, moving);
@@ -730,9 +1497,12 @@ size_t runtime::insert(size_t offset, utf8 data, size_t len)
     {
         if (available(len) >= len)
         {
+            // Appending, e.g. when loading a file, does not move anything,
+            // so skip the pointer adjustments in move()
             size_t moved = Scratch + Editing - offset;
             byte_p edr = (byte_p) editor() + offset;
-            move(object_p(edr + len), object_p(edr), moved);
+            if (moved)
+                move(object_p(edr + len), object_p(edr), moved);
             memcpy(editor() + offset, data, len);
             Editing += len;
             return len;
@@ -762,7 +1532,8 @@ size_t runtime::remove(size_t offset, size_t len)
     len = end - offset;
     size_t moving = Scratch + Editing - end;
     byte_p edr = (byte_p) editor() + offset;
-    move(object_p(edr), object_p(edr + len), moving);
+    if (moving && len)
+        move(object_p(edr), object_p(edr + len), moving);
     Editing -= len;
     return len;
 }
@@ -904,6 +1675,13 @@ byte *runtime::allocate(size_t sz)
 //   Allocate additional bytes at end of scratchpad
 // ----------------------------------------------------------------------------
 {
+    if (sz <= Reserved)
+    {
+        Reserved -= sz;
+        byte *scratch = editor() + Editing + Scratch;
+        Scratch += sz;
+        return scratch;
+    }
     if (available(sz) >= sz)
     {
         byte *scratch = editor() + Editing + Scratch;
@@ -968,13 +1746,20 @@ object_p runtime::clone(object_p source)
 // ----------------------------------------------------------------------------
 //   This is useful when storing into a global referenced from the stack
 {
+    // Allocating in either tier may garbage collect and move the source
+    gcp<const object> src = source;
     size_t size = source->size();
+    if (byte *ext = allocate_extended(size))
+    {
+        memmove(ext, +src, size);
+        return object_p(ext);
+    }
     if (available(size) < size)
         return nullptr;
     object_p result = Temporaries;
     Temporaries = object_p((byte *) Temporaries + size);
     move(Temporaries, result, Editing + Scratch, 1, true);
-    memmove((void *) result, source, size);
+    memmove((void *) result, +src, size);
     return result;
 }
 
@@ -1019,7 +1804,7 @@ object_p runtime::clone_if_dynamic(object_p obj)
 //     stay in memory until you use another menu, which is wasteful, since the
 //     command-line used to load the whole state may be quite large
 {
-    if (obj >= LowMem && obj <= object_p(HighMem))
+    if ((obj >= LowMem && obj <= memory_end()) || is_extended(obj))
         obj = clone(obj);
     return obj;
 }
@@ -1098,7 +1883,7 @@ bool runtime::push(object_g obj)
            "Invalid type pushed");
 
     // This may cause garbage collection, hence the need to adjust
-    if (available(sizeof(void *)) < sizeof(void *))
+    if (available_stack(sizeof(void *)) < sizeof(void *))
         return false;
     *(--Stack) = obj;
     return true;
@@ -1268,7 +2053,7 @@ bool runtime::args(uint count)
         if (count > nargs)
         {
             size_t sz = (count - nargs) * sizeof(object_p);
-            if (available(sz) < sz)
+            if (available_stack(sz) < sz)
                 return false;
         }
 
@@ -1290,7 +2075,7 @@ bool runtime::last()
     runtime_invariants check;
     size_t nargs = args();
     size_t sz = nargs * sizeof(object_p);
-    if (available(sz) < sz)
+    if (available_stack(sz) < sz)
         return false;
 
     Stack -= nargs;
@@ -1312,7 +2097,7 @@ bool runtime::last(uint index)
         return false;
     }
     size_t sz = sizeof(object_p);
-    if (available(sz) < sz)
+    if (available_stack(sz) < sz)
         return false;
 
     *--Stack = Args[index];
@@ -1331,18 +2116,27 @@ bool runtime::save()
     if (scount > ucount)
     {
         size_t sz = (scount - ucount) * sizeof(object_p);
-        if (available(sz) < sz)
+        if (available_stack(sz) < sz)
             return false;
     }
 
+    // Commands usually only change the top of the stack. The bottom of the
+    // undo area stays at the same address when the region is resized, so
+    // levels that did not change since the last save need not be copied.
+    size_t same = 0;
+    size_t most = scount < ucount ? scount : ucount;
+    while (same < most && Stack[scount-1-same] == Undo[ucount-1-same])
+        same++;
+
     object_p *ns = Stack + ucount - scount;
     ASSERT(ns + (Undo - Stack) < HighMem);
     ASSERT(Stack + depth() < HighMem);
-    memmove(ns, Stack, (Undo - Stack) * sizeof(object_p));
+    if (ns != Stack)
+        memmove(ns, Stack, (Undo - Stack) * sizeof(object_p));
     Stack = ns;
     Args = Args + ucount - scount;
     Undo = Undo + ucount - scount;
-    memmove(Undo, Stack, depth() * sizeof(object_p));
+    memmove(Undo, Stack, (scount - same) * sizeof(object_p));
 
     return true;
 }
@@ -1359,7 +2153,7 @@ bool runtime::undo()
     if (ucount > scount)
     {
         size_t sz = (ucount - scount) * sizeof(object_p);
-        if (available(sz) < sz)
+        if (available_stack(sz) < sz)
             return false;
     }
 
@@ -1438,7 +2232,7 @@ bool runtime::locals(size_t count)
 
     // Check if we have the memory
     size_t req = count * sizeof(void *);
-    if (available(req) < req)
+    if (available_stack(req) < req)
         return false;
 
     // Move pointers down
@@ -1447,8 +2241,7 @@ bool runtime::locals(size_t count)
     Undo -= count;
     Locals -= count;
     size_t moving = Locals - Stack;
-    for (size_t i = 0; i < moving; i++)
-        Stack[i] = Stack[i + count];
+    memmove(Stack, Stack + count, moving * sizeof(object_p));
 
     // In `→ X Y « X Y - X Y +`, X is level 1 of the stack, Y is level 0
     for (size_t var = 0; var < count; var++)
@@ -1474,15 +2267,12 @@ bool runtime::unlocals(size_t count)
         }
 
         // Move pointers up
-        object_p *oldp = Locals;
         Stack += count;
         Args += count;
         Undo += count;
         Locals += count;
-        object_p *newp = Locals;
         size_t moving = Locals - Stack;
-        for (size_t i = 0; i < moving; i++)
-            *(--newp) = *(--oldp);
+        memmove(Stack, Stack - count, moving * sizeof(object_p));
     }
 
     return true;
@@ -1523,7 +2313,7 @@ bool runtime::enter(directory_p dir)
             return !i || updir(i);
 
     size_t sz = sizeof(directory_p);
-    if (available(sz) < sz)
+    if (available_stack(sz) < sz)
         return false;
 
     // Move pointers down
@@ -1544,6 +2334,55 @@ bool runtime::enter(directory_p dir)
 }
 
 
+bool runtime::load_globals_image(size_t size, image_reader_fn reader, void *arg)
+// ----------------------------------------------------------------------------
+//   Load an image of the global objects, as returned by globals_image()
+// ----------------------------------------------------------------------------
+//   Objects contain no pointers, so the image can be read in place at the
+//   bottom of memory. This resets the runtime, and on failure, leaves it
+//   in the reset state.
+{
+    // Keep some room for temporaries, the stack and the directory path
+    reset();
+    size_t room = (byte_p) objects_end() - (byte_p) LowMem;
+    if (size + 4096 > room || size < size_t(Globals - LowMem))
+    {
+        record(runtime_error, "Image size %u does not fit in %u", size, room);
+        return false;
+    }
+
+    // Read the image in place, and check that it is made of valid objects
+    object_p end = LowMem + size;
+    bool     ok  = reader((byte *) LowMem, size, arg);
+    if (ok)
+        ok = LowMem->type() == object::ID_directory;
+    for (object_p obj = LowMem; ok && obj < end; )
+    {
+        ok = obj->type() < object::NUM_IDS;
+        if (ok)
+        {
+            object_p next = obj->skip();
+            ok = next > obj && next <= end;
+            obj = next;
+        }
+    }
+    if (!ok)
+    {
+        record(runtime_error, "Invalid image of size %u", size);
+        reset();
+        return false;
+    }
+
+    Globals = end;
+    Temporaries = end;
+    GCWatermark = end;
+    directory::globals_moved();
+    uncache();
+    record(runtime, "Loaded image of %u bytes", size);
+    return true;
+}
+
+
 bool runtime::updir(size_t count)
 // ----------------------------------------------------------------------------
 //   Move one directory up
@@ -1592,7 +2431,7 @@ bool runtime::attach(size_t nentries)
         if (nentries > existing)
         {
             size_t needed = (nentries - existing) * sizeof(object_p);
-            if (available(needed) < needed)
+            if (available_stack(needed) < needed)
                 return false;
             for (object_p *ptr = Stack; ptr < Constants; ptr++)
                 ptr[-count] = ptr[0];
@@ -1628,7 +2467,7 @@ bool runtime::constants(size_t nentries)
         if (nentries > existing)
         {
             size_t needed = (nentries - existing) * sizeof(object_p);
-            if (available(needed) < needed)
+            if (available_stack(needed) < needed)
                 return false;
             for (object_p *ptr = Stack; ptr < CallStack; ptr++)
                 ptr[-count] = ptr[0];
@@ -1738,6 +2577,28 @@ bool runtime::run_select_while(bool condition)
 }
 
 
+static bool loop_counter(object_p obj, large &value)
+// ----------------------------------------------------------------------------
+//   Check if a loop counter, step or bound is a small native integer
+// ----------------------------------------------------------------------------
+//   The magnitude is limited to 62 bits so that adding the step can't overflow
+{
+    if (!obj)
+        return false;
+    object::id ty = obj->type();
+    if (ty != object::ID_integer && ty != object::ID_neg_integer)
+        return false;
+    integer_p i = integer_p(obj);
+    if (!i->native())
+        return false;
+    ularge magnitude = i->value<ularge>();
+    if (magnitude >> 62)
+        return false;
+    value = ty == object::ID_neg_integer ? -large(magnitude) : large(magnitude);
+    return true;
+}
+
+
 bool runtime::run_select_start_step(bool for_loop, bool has_step)
 // ----------------------------------------------------------------------------
 //   Select evaluation branches in a for loop
@@ -1753,15 +2614,40 @@ bool runtime::run_select_start_step(bool for_loop, bool has_step)
         return false;
     }
 
-    bool down = false;
+    bool        down = false;
+    bool        finished = false;
     algebraic_g step;
     object::id  ty = for_loop ? object::ID_ForStep : object::ID_StartStep;
+    object_p    sobj = nullptr;
     if (has_step)
     {
-        object_p obj = rt.pop();
-        if (!obj)
+        sobj = rt.pop();
+        if (!sobj)
+            return false;
+    }
+
+    // Fast path for small integer counters, e.g. 1 100000 FOR i ... NEXT
+    if (for_loop)
+        Returns[0] = rt.local(0);
+    large ncur = 0, nlast = 0, nstep = 1;
+    if (loop_counter(Returns[0], ncur) &&
+        loop_counter(Returns[1], nlast) &&
+        (!has_step || loop_counter(sobj, nstep)))
+    {
+        ncur += nstep;
+        finished = nstep < 0 ? ncur < nlast : ncur > nlast;
+        integer_p next = integer::make(ncur);
+        if (!next)
             return false;
-        step = obj->as_algebraic();
+        Returns[0] = next;
+        if (for_loop)
+            rt.local(0, next);
+        goto select;
+    }
+
+    if (has_step)
+    {
+        step = sobj->as_algebraic();
         if (!step)
         {
             object_p cmd = command::static_object(ty);
@@ -1777,31 +2663,33 @@ bool runtime::run_select_start_step(bool for_loop, bool has_step)
             return false;
     }
 
-    // Increment and compare with last iteration
-    if (for_loop)
-        Returns[0] = rt.local(0);
-    algebraic_g cur  = Returns[0] ? Returns[0]->as_algebraic() : nullptr;
-    algebraic_g last = Returns[1] ? Returns[1]->as_algebraic() : nullptr;
-    if (!cur || !last)
     {
-        object_p cmd = command::static_object(ty);
-        rt.command(cmd);
-        return false;
-    }
-    cur = cur + step;
-    last = down ? (cur < last) : (cur > last);
-    if (cur)
-        Returns[0] = cur;
+        // Increment and compare with last iteration
+        algebraic_g cur  = Returns[0] ? Returns[0]->as_algebraic() : nullptr;
+        algebraic_g last = Returns[1] ? Returns[1]->as_algebraic() : nullptr;
+        if (!cur || !last)
+        {
+            object_p cmd = command::static_object(ty);
+            rt.command(cmd);
+            return false;
+        }
+        cur = cur + step;
+        last = down ? (cur < last) : (cur > last);
+        if (cur)
+            Returns[0] = cur;
 
-    // Write the current value in the variable if it's a for loop
-    if (for_loop)
-        rt.local(0, cur);
+        // Write the current value in the variable if it's a for loop
+        if (for_loop)
+            rt.local(0, cur);
 
-    // Check the truth value
-    int finished = last ? last->as_truth(true) : -1;
-    if (finished < 0)
-        return false;
+        // Check the truth value
+        int truth = last ? last->as_truth(true) : -1;
+        if (truth < 0)
+            return false;
+        finished = truth;
+    }
 
+select:
     if (finished)
     {
         call_stack_drop(4);
@@ -1900,30 +2788,65 @@ bool runtime::run_select_case(bool condition)
 }
 
 
+bool runtime::run_skip_to(object_p marker)
+// ----------------------------------------------------------------------------
+//   Pop all frames until the one starting with the marker, included
+// ----------------------------------------------------------------------------
+//   This jumps in one step over the remaining clauses of a case statement,
+//   since they were pushed as a single range. Returns false when a frame of
+//   local variables is in the way, in which case the caller must use
+//   run_next() to release it.
+{
+    runtime_invariants check;
+    for (object_p *r = Returns; r + 2 <= HighMem; r += 2)
+    {
+        if (r[0] == marker)
+        {
+            call_stack_drop(r + 2 - Returns);
+            return true;
+        }
+        if (!r[0] && uintptr_t(r[1]) + 1 != 0)
+            return false;
+    }
+    return false;
+}
+
+
 bool runtime::call_stack_grow(object_p &next, object_p &end)
 // ----------------------------------------------------------------------------
-//   Grow the call stack by a block
+//   Grow the call stack, doubling its size if memory permits
 // ----------------------------------------------------------------------------
+//   Growing is costly since it moves the whole data stack, so deep recursion
+//   grows geometrically. If memory is tight, fall back to a single block.
 {
     runtime_invariants check;
-    size_t   block = sizeof(object_p) * CALLS_BLOCK ;
+    size_t   count = HighMem - CallStack;
+    if (count < CALLS_BLOCK)
+        count = CALLS_BLOCK;
+    size_t   block = sizeof(object_p) * count;
     object_g nextg = next;
     object_g endg  = end;
-    if (available(block) < block)
+    if (available_stack(block) < block)
     {
-        recursion_error();
-        return false;
+        count = CALLS_BLOCK;
+        block = sizeof(object_p) * count;
+        if (available_stack(block) < block)
+        {
+            recursion_error();
+            return false;
+        }
     }
+    record(runtime, "Growing call stack by %u entries", count);
     for (object_p *s = Stack; s < CallStack; s++)
-        s[-CALLS_BLOCK] = s[0];
-    Stack -= CALLS_BLOCK;
-    Args -= CALLS_BLOCK;
-    Undo -= CALLS_BLOCK;
-    Locals -= CALLS_BLOCK;
-    Directories -= CALLS_BLOCK;
-    XLibs -= CALLS_BLOCK;
-    Constants -= CALLS_BLOCK;
-    CallStack -= CALLS_BLOCK;
+        s[-count] = s[0];
+    Stack -= count;
+    Args -= count;
+    Undo -= count;
+    Locals -= count;
+    Directories -= count;
+    XLibs -= count;
+    Constants -= count;
+    CallStack -= count;
     next = nextg;
     end = endg;
     return true;
@@ -1932,20 +2855,25 @@ bool runtime::call_stack_grow(object_p &next, object_p &end)
 
 void runtime::call_stack_drop()
 // ----------------------------------------------------------------------------
-//   Drop the outermost block
+//   Release half of the call stack once it is mostly unused
 // ----------------------------------------------------------------------------
 {
     runtime_invariants check;
-    Stack += CALLS_BLOCK;
-    Args += CALLS_BLOCK;
-    Undo += CALLS_BLOCK;
-    Locals += CALLS_BLOCK;
-    Directories += CALLS_BLOCK;
-    XLibs += CALLS_BLOCK;
-    Constants += CALLS_BLOCK;
-    CallStack += CALLS_BLOCK;
+    size_t count = (HighMem - CallStack) / 2;
+    count -= count % CALLS_BLOCK;
+    if (count < CALLS_BLOCK)
+        count = CALLS_BLOCK;
+    record(runtime, "Shrinking call stack by %u entries", count);
+    Stack += count;
+    Args += count;
+    Undo += count;
+    Locals += count;
+    Directories += count;
+    XLibs += count;
+    Constants += count;
+    CallStack += count;
     for (object_p *s = CallStack-1; s >= Stack; s--)
-        s[0] = s[-CALLS_BLOCK];
+        s[0] = s[-count];
 }
 
 #ifdef DM42
@@ -2103,7 +3031,7 @@ object_p cleaner::adjust(object_p temp)
 //   Check if we can cleanup temporaries
 // ----------------------------------------------------------------------------
 {
-    if (temp && temp > temporaries &&
+    if (temp && temp > temporaries && temp < rt.Temporaries &&
         gccycles == rt.GCCycles + rt.GCUnclear &&
         Settings.AutomaticTemporariesCleanup())
     {
@@ -2120,6 +3048,8 @@ object_p cleaner::adjust(object_p temp)
             rt.command(nullptr);
         temp = temporaries;
         rt.Temporaries = temp + sz;
+        if (rt.GCWatermark > temporaries)
+            rt.GCWatermark = temporaries;
     }
     return temp;
 }
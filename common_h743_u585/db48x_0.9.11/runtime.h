@@ -72,6 +72,10 @@
 //        [Top-level directory of global objects]
 //      LowMem          Bottom of memory
 //
+//   Optionally, everything from Stack to HighMem can be placed in a separate
+//   memory region (e.g. faster DTCM on STM32H7), in which case StackLow is
+//   the bottom of that region and ObjHigh the top of the object region.
+//
 //   When allocating a temporary, we move 'Temporaries' up
 //   When allocating stuff on the stack, we move Stack down
 //   Everything above Stack is word-aligned
@@ -148,9 +152,10 @@ struct runtime
     runtime(byte *mem = nullptr, size_t size = 0);
     ~runtime() {}
 
-    void memory(byte *memory, size_t size);
+    void memory(byte *memory, size_t size,
+                byte *stack = nullptr, size_t ssize = 0);
     // ------------------------------------------------------------------------
-    //   Assign the given memory range to the runtime
+    //   Assign the given memory range(s) to the runtime
     // ------------------------------------------------------------------------
 
     void reset();
@@ -158,6 +163,25 @@ struct runtime
     //   Reset to initial state
     // ------------------------------------------------------------------------
 
+    bool resume(const runtime &saved, byte *memory, size_t size,
+                byte *stack = nullptr, size_t ssize = 0);
+    // ------------------------------------------------------------------------
+    //   Take over memory left by a saved runtime if it is consistent
+    // ------------------------------------------------------------------------
+
+    void extended_memory(byte *memory, size_t size, size_t threshold);
+    // ------------------------------------------------------------------------
+    //   Assign a secondary memory range used for large temporaries
+    // ------------------------------------------------------------------------
+
+    bool is_extended(object_p obj) const
+    // ------------------------------------------------------------------------
+    //   Check if an object lives in the extended memory
+    // ------------------------------------------------------------------------
+    {
+        return obj >= ExtLow && obj < ExtHigh;
+    }
+
     // Amount of space we want to keep between stack top and temporaries
     const uint redzone = 2*sizeof(object_p);;
 
@@ -192,6 +216,53 @@ struct runtime
     //   Check if we have enough for the given size
     // ------------------------------------------------------------------------
 
+    bool reserve(size_t size, size_t &added);
+    // ------------------------------------------------------------------------
+    //   Make sure size bytes can be allocated without garbage collection
+    // ------------------------------------------------------------------------
+
+    void release(size_t added)
+    // ------------------------------------------------------------------------
+    //   Give back to free memory what a reservation added
+    // ------------------------------------------------------------------------
+    {
+        Reserved = Reserved > added ? Reserved - added : 0;
+    }
+
+    size_t reserved() const
+    // ------------------------------------------------------------------------
+    //   Return the number of bytes left in current reservation
+    // ------------------------------------------------------------------------
+    {
+        return Reserved;
+    }
+
+    byte *allocate_extended(size_t size);
+    // ------------------------------------------------------------------------
+    //   Allocate a large temporary in extended memory if possible
+    // ------------------------------------------------------------------------
+
+    size_t available_stack(size_t size);
+    // ------------------------------------------------------------------------
+    //   Check if we have enough room in the stack for the given size
+    // ------------------------------------------------------------------------
+
+    object_p objects_end() const
+    // ------------------------------------------------------------------------
+    //   Return the upper limit for temporaries, editor and scratchpad
+    // ------------------------------------------------------------------------
+    {
+        return ObjHigh ? ObjHigh : object_p(Stack);
+    }
+
+    object_p memory_end() const
+    // ------------------------------------------------------------------------
+    //   Return the end of the memory range where objects can live
+    // ------------------------------------------------------------------------
+    {
+        return ObjHigh ? ObjHigh : object_p(HighMem);
+    }
+
     template <typename Obj, typename ... Args>
     const Obj *make(typename Obj::id type, const Args &... args);
     // ------------------------------------------------------------------------
@@ -248,13 +319,23 @@ struct runtime
     }
 
 
+    bool is_global(object_p obj) const
+    // ------------------------------------------------------------------------
+    //   Check if an object is in the globals area
+    // ------------------------------------------------------------------------
+    {
+        return obj >= LowMem && obj < Globals;
+    }
+
+
     bool is_valid_object(object_p obj)
     // ------------------------------------------------------------------------
     //   Check if the object is valid
     // ------------------------------------------------------------------------
     {
         return !(intptr_t(obj) <= 0x1000 ||
-                 (obj >= Temporaries && obj <= object_p(HighMem)));
+                 (obj >= Temporaries && obj <= memory_end()) ||
+                 (obj >= ExtTemporaries && obj < ExtHigh));
     }
 
 
@@ -347,11 +428,19 @@ struct runtime
     //
     // ========================================================================
 
+    enum { CACHE_ENTRIES = 64 };        // Entries per cache, power of 2
+    struct cache_entry
+    {
+        object_p key;
+        object_p value;
+    };
+
     object_p cached(bool level0, object_p key);
     bool     cache(bool level0, object_p key, object_p value);
     void     uncache(object_p key, size_t sz);
     void     uncache(object_p key)      { uncache(key, 1); }
     void     uncache()                  { uncache(nullptr, ~0UL); }
+    void     recache();
 
 
     // ========================================================================
@@ -360,10 +449,27 @@ struct runtime
     //
     // ========================================================================
 
-    size_t gc();
+    size_t gc(bool full = true);
     // ------------------------------------------------------------------------
     //   Garbage collector (purge unused objects from memory to make space)
     // ------------------------------------------------------------------------
+    //   If full is false, only objects allocated since last collection
+    //   are collected, objects that survived a previous collection stay put
+
+    bool memory_low(uint percent);
+    // ------------------------------------------------------------------------
+    //   Check if free memory is below the given percentage of object memory
+    // ------------------------------------------------------------------------
+
+    size_t idle_gc(uint percent);
+    // ------------------------------------------------------------------------
+    //   Collect garbage ahead of time while idle if memory is low
+    // ------------------------------------------------------------------------
+
+    typedef uintptr_t gc_root;
+    // ------------------------------------------------------------------------
+    //   Address of a pointer slot referencing a temporary during GC
+    // ------------------------------------------------------------------------
 
 
     void move(object_p to, object_p from,
@@ -386,17 +492,23 @@ struct runtime
     {
         gcptr(byte *ptr = nullptr) : safe(ptr)
         {
-            lock it;
-            next = rt.GCSafe;
-            rt.GCSafe = this;
+            link();
         }
         gcptr(const gcptr &o): safe(o.safe)
         {
+            link();
+        }
+        ~gcptr()
+        {
+            // Doubly linked, so that leaving scope out of order is O(1)
             lock it;
-            next = rt.GCSafe;
-            rt.GCSafe = this;
+            if (prev)
+                prev->next = next;
+            else
+                rt.GCSafe = next;
+            if (next)
+                next->prev = prev;
         }
-        ~gcptr();
 
         operator byte  *() const                { return safe; }
         operator byte *&()                      { return safe; }
@@ -416,9 +528,21 @@ struct runtime
             return result;
         }
 
+    private:
+        void link()
+        {
+            lock it;
+            prev = nullptr;
+            next = rt.GCSafe;
+            if (next)
+                next->prev = this;
+            rt.GCSafe = this;
+        }
+
     private:
         byte  *safe;
         gcptr *next;
+        gcptr *prev;
 
         friend struct runtime;
     };
@@ -685,16 +809,22 @@ struct runtime
     //   Select true or false case for case statement
     // ------------------------------------------------------------------------
 
+    bool run_skip_to(object_p marker);
+    // ------------------------------------------------------------------------
+    //   Drop evaluation frames up to the one that would evaluate marker
+    // ------------------------------------------------------------------------
+
 
     bool call_stack_grow(object_p &next, object_p &end);
     void call_stack_drop();
     void call_stack_drop(uint n)
     // ------------------------------------------------------------------------
-    //  Manage the call stack in blocks
+    //  Manage the call stack in blocks, shrink when less than 1/4 is used
     // ------------------------------------------------------------------------
     {
         Returns += n;
-        if (Returns >= CallStack + CALLS_BLOCK)
+        if (Returns >= CallStack + 2 * CALLS_BLOCK &&
+            4 * size_t(HighMem - Returns) <= size_t(HighMem - CallStack))
             call_stack_drop();
     }
 
@@ -901,6 +1031,29 @@ struct runtime
 
     bool is_active_directory(object_p obj) const;
     bool enter(directory_p dir);
+
+
+    // ========================================================================
+    //
+    //   Heap images
+    //
+    // ========================================================================
+
+    typedef bool (*image_reader_fn)(byte *buffer, size_t size, void *arg);
+
+    byte_p globals_image(size_t &size) const
+    // ------------------------------------------------------------------------
+    //   Return the global objects as a position-independent image
+    // ------------------------------------------------------------------------
+    {
+        size = (byte_p) Globals - (byte_p) LowMem;
+        return (byte_p) LowMem;
+    }
+
+    bool load_globals_image(size_t size, image_reader_fn reader, void *arg);
+    // ------------------------------------------------------------------------
+    //   Replace the global objects with an image read by the reader
+    // ------------------------------------------------------------------------
     bool updir(size_t count = 1);
 
 
@@ -1085,7 +1238,7 @@ struct runtime
     //   Check if the command is a user-defined command
     // ------------------------------------------------------------------------
     {
-        return cmd >= utf8(LowMem) && cmd < utf8(HighMem);
+        return cmd >= utf8(LowMem) && cmd < utf8(memory_end());
     }
 
     void clear_error()
@@ -1131,6 +1284,7 @@ protected:
     object_p  Temporaries;  // Temporaries (must be valid objects)
     size_t    Editing;      // Text editor (utf8 encoded)
     size_t    Scratch;      // Scratch pad (may be invalid objects)
+    size_t    Reserved;     // Free bytes promised to a reservation
     object_p *Stack;        // Top of user stack
     object_p *Args;         // Start of save area for last arguments
     object_p *Undo;         // Start of undo stack
@@ -1141,24 +1295,49 @@ protected:
     object_p *CallStack;    // Start of call stack (rounded 16 entries)
     object_p *Returns;      // Start of return stack, end of locals
     object_p *HighMem;      // End of available memory
-    object_p  Cache[2][32]; // 16 Key/Value pairs for stack acceleration
-    uint      CacheIndex;   // Index of latest entry in cache
+    object_p *StackLow;     // Bottom of separate stack memory (if any)
+    object_p  ObjHigh;      // End of object memory if stack is separate
+    object_p  ExtLow;       // Bottom of extended memory (large objects)
+    object_p  ExtTemporaries; // Temporaries in extended memory
+    object_p  ExtHigh;      // End of extended memory
+    size_t    ExtThreshold; // Minimum object size for extended memory
+    object_p  ExtFree;      // First free hole in extended memory
+    size_t    ExtFreeBytes; // Total size of holes in extended memory
+    cache_entry Cache[2][CACHE_ENTRIES]; // Hashed stack rendering cache
+    uint      CacheCount[2];// Number of entries used in each cache
+    object_p  GCWatermark;  // End of objects that survived last collection
     size_t    GCCycles;     // Number of garbage collection cycles
+    size_t    GCMinor;      // Number of young-generation collections
     size_t    GCPurged;     // Number of bytes collected by the GC
     size_t    GCDuration;   // Total duration of GC execution
     size_t    GCLPurged;    // Number of bytes collected during last GC
     size_t    GCLDuration;  // Duration of last GC execution
     size_t    GCCleared;    // Cleaned automatically by `clearer`
     size_t    GCUnclear;    // Disable 'clearer' class
+    size_t    GCAllocated;  // Number of objects allocated
+    size_t    GCMoved;      // Number of bytes moved by move()
     bool      SaveArgs;     // Save arguents (LastArgs)
 
     // Pointers that are GC-adjusted
     static gcptr *GCSafe;
 
+    // Garbage collector internals
+    gc_root *gc_roots(object_p first, object_p last, size_t &count);
+    size_t   gc_sorted(object_p first, object_p last,
+                       gc_root *roots, size_t count);
+    size_t   gc_scan(object_p first, object_p last);
+    size_t   gc_range(object_p first, object_p last);
+    size_t   gc_large();
+    byte    *allocate_hole(size_t size);
+
+    friend struct Benchmark;
     friend struct GarbageCollectorStatistics;
+    friend struct MemoryMap;
     friend struct cleaner;
     friend struct runtime_invariants;
     friend void dump_gc_pointers();
+    friend size_t host_evaluate(const char *request, size_t len,
+                                bool binary, char *reply, size_t max);
 };
 
 template<typename T>
@@ -1225,14 +1404,25 @@ const Obj *runtime::make(typename Obj::id type, const
     record(runtime,
            "Initializing object %p type %d size %u", Temporaries, type, size);
 
-    // Check if we have room (may cause garbage collection)
-    if (available(size) < size)
-        return nullptr;    // Failed to allocate
-    Obj *result = (Obj *) Temporaries;
-    Temporaries = (object *) ((byte *) Temporaries + size);
+    // Large objects go to extended memory if there is some
+    Obj *result = (Obj *) allocate_extended(size);
+    if (!result)
+    {
+        // Inside a reservation, room was checked up front
+        if (size <= Reserved)
+            Reserved -= size;
+
+        // Check if we have room (may cause garbage collection)
+        else if (available(size) < size)
+            return nullptr;    // Failed to allocate
+        result = (Obj *) Temporaries;
+        Temporaries = (object *) ((byte *) Temporaries + size);
+
+        // Move the editor up (available() checked we have room)
+        move(Temporaries, (object_p) result, Editing + Scratch, 1, true);
+    }
 
-    // Move the editor up (available() checked we have room)
-    move(Temporaries, (object_p) result, Editing + Scratch, 1, true);
+    GCAllocated++;
 
     // Initialize the object in place (may GC and move result)
     gcbytes ptr = (byte *) result;
@@ -1295,6 +1485,25 @@ private:
 };
 
 
+struct reservation
+// ----------------------------------------------------------------------------
+//   Reserve memory for a composite object built in several allocations
+// ----------------------------------------------------------------------------
+//   While the reservation lasts, allocations that fit in it neither check
+//   for room nor collect garbage. Allocations that do not fit go through
+//   the usual checks, which may collect garbage, but leave the reserved
+//   bytes alone. Nested reservations share the enclosing one.
+{
+    reservation(size_t size): added(0), valid(rt.reserve(size, added)) {}
+    ~reservation()                      { rt.release(added); }
+    operator bool() const               { return valid; }
+
+private:
+    size_t      added;
+    bool        valid;
+};
+
+
 struct stack_depth_restore
 // ----------------------------------------------------------------------------
 //   Restore the stack depth on exit
@@ -198,6 +198,11 @@ public:
     {
         return digit_separator(BasedSeparatorCommand() - object::ID_BasedSpaces);
     }
+    bool HardwareFloatingPointEnabled() const
+    {
+        // Unless disabled, automatic mode uses the FPU at low precision
+        return HardwareFloatingPoint() || AutoHardwareFloatingPoint();
+    }
     unicode DecimalSeparator() const
     {
         return DecimalComma() ? ',' : '.';
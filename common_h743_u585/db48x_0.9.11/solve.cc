@@ -110,6 +110,104 @@ static algebraic_p difference_for_solve(algebraic_r eq)
     return eq;
 }
 
+
+#ifndef SOLVE_DERIVATIVE_CACHE
+#define SOLVE_DERIVATIVE_CACHE  4
+#endif
+
+static expression_p solve_derivative(program_r eq, symbol_r name)
+// ----------------------------------------------------------------------------
+//   Return the symbolic derivative of eq for Newton steps, if there is one
+// ----------------------------------------------------------------------------
+//   The multiple-equation solver runs the solver over the same equations
+//   again and again, so we keep the last few derivatives, keyed by equation
+//   and variable. Failures are cached as well, as a null derivative.
+{
+    static expression_g equations[SOLVE_DERIVATIVE_CACHE];
+    static symbol_g     names[SOLVE_DERIVATIVE_CACHE];
+    static expression_g derivatives[SOLVE_DERIVATIVE_CACHE];
+    static uint         next = 0;
+
+    expression_g expr = expression::get(eq);
+    if (!expr || !name)
+        return nullptr;
+
+    for (uint i = 0; i < SOLVE_DERIVATIVE_CACHE; i++)
+    {
+        if (equations[i] && names[i] &&
+            expr->is_same_as(+equations[i]) && name->is_same_as(+names[i]))
+        {
+            record(solve, "Cached derivative %t for %t", +derivatives[i], +eq);
+            return derivatives[i];
+        }
+    }
+
+    expression_g deriv = expr->derivative(name);
+    if (!deriv)
+        rt.clear_error();
+    record(solve, "Derivative of %t is %t", +eq, +deriv);
+
+    // Keys are copied, since globals they point to may change in place
+    uint slot = next++ % SOLVE_DERIVATIVE_CACHE;
+    equations[slot] = expression_p(rt.clone(expr));
+    names[slot] = symbol_p(rt.clone(name));
+    derivatives[slot] = deriv;
+    return deriv;
+}
+
+
+#ifndef SOLVE_WARM_START_CACHE
+#define SOLVE_WARM_START_CACHE  4
+#endif
+
+struct solve_warm_start
+// ----------------------------------------------------------------------------
+//   What we remember about the last solution of an equation
+// ----------------------------------------------------------------------------
+{
+    expression_g equation;      // Equation that was solved
+    symbol_g     name;          // Variable it was solved for
+    algebraic_g  root;          // Last root that was found
+    algebraic_g  width;         // Width of the bracket around the root
+    algebraic_g  slope;         // Slope estimate at the root
+};
+
+
+static solve_warm_start *warm_start(program_r eq, symbol_r name, bool create)
+// ----------------------------------------------------------------------------
+//   Find the warm start entry for an equation and variable
+// ----------------------------------------------------------------------------
+//   Solving the same equation again from the solving menu with different
+//   knowns usually finds a root close to the previous one, with a similar
+//   slope, so this gives the solver a much better initial bracket.
+{
+    static solve_warm_start entries[SOLVE_WARM_START_CACHE];
+    static uint             next = 0;
+
+    expression_g expr = expression::get(eq);
+    if (!expr || !name)
+        return nullptr;
+
+    for (uint i = 0; i < SOLVE_WARM_START_CACHE; i++)
+    {
+        solve_warm_start &e = entries[i];
+        if (e.equation && e.name &&
+            expr->is_same_as(+e.equation) && name->is_same_as(+e.name))
+            return &e;
+    }
+    if (!create)
+        return nullptr;
+
+    solve_warm_start &e = entries[next++ % SOLVE_WARM_START_CACHE];
+    e.equation = expression_p(rt.clone(expr));
+    e.name = symbol_p(rt.clone(name));
+    e.root = nullptr;
+    e.width = nullptr;
+    e.slope = nullptr;
+    return &e;
+}
+
+
 algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
 // ----------------------------------------------------------------------------
 //   The core of the solver, numerical solving for a single variable
@@ -121,8 +219,18 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
     algebraic_g nx, px;         // x where f(x) is negative and positive
     algebraic_g sy;
     id          gty = guess->type();
+    bool        single = false;
     save<bool>  nodates(unit::nodates, true);
 
+    // The time value of money equation has a dedicated solver
+    if (symbol_g tvmvar = goal->as_quoted<symbol>())
+    {
+        if (algebraic_p tvm = FinanceSolverMenu::solve(pgm, tvmvar))
+            return tvm;
+        if (rt.error())
+            return nullptr;
+    }
+
     // Convert A=B+C into A-(B+C)
     program_g eq = pgm;
     if (expression_p eqeq = expression::get(eq))
@@ -140,6 +248,7 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
     {
         lx = guess->as_algebraic();
         hx = lx;
+        single = true;
     }
     if (!hx || !lx)
     {
@@ -225,6 +334,24 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
     }
 
     save<symbol_g *> iref(expression::independent, &name);
+
+    // Start from the bracket that worked last time if there is only a guess
+    algebraic_g slope;
+    if (single && !uexpr && !is_complex)
+    {
+        if (solve_warm_start *ws = warm_start(eq, name, false))
+        {
+            if (ws->width)
+                if (algebraic_g whx = lx + ws->width)
+                    if (!whx->is_same_as(+lx))
+                        hx = whx;
+            slope = ws->slope;
+            record(solve, "Warm start from %t width %t slope %t",
+                   +ws->root, +ws->width, +slope);
+        }
+        rt.clear_error();
+    }
+
     int              impr        = Settings.SolverImprecision();
     algebraic_g      yeps        = algebraic::epsilon(impr);
     algebraic_g      xeps        = (lx + hx) * yeps;
@@ -272,6 +399,10 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
         }
     }
 
+    // Use Newton steps when we know the derivative, secant steps otherwise
+    program_g     deriv = uexpr ? nullptr : solve_derivative(eq, name);
+    fast_function fast(eq, +name, fast_function::hardware());
+    fast_function dfast(deriv, +name, deriv && fast_function::hardware());
     for (uint i = 0; i < max; i++)
     {
         if (program::interrupted())
@@ -296,7 +427,7 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
         }
 
         // Evaluate equation
-        y = algebraic::evaluate_function(eq, x);
+        y = fast.evaluate(eq, x);
 
         // If the function evaluates as 10^23 and eps=10^-18, use 10^(23-18)
         if (!i && y && !y->is_zero())
@@ -339,6 +470,26 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
             if (dy->is_zero() || smaller_magnitude(dy, yeps))
             {
                 record(solve, "[%u] Solution=%t value=%t", i, +x, +y);
+                if (!uexpr && !is_complex)
+                {
+                    // Remember bracket and slope for the next warm start
+                    if (solve_warm_start *ws = warm_start(eq, name, true))
+                    {
+                        ws->root = x;
+                        if (lx && ly && !lx->is_same_as(+x))
+                        {
+                            algebraic_g width = x - lx;
+                            algebraic_g wslope = width ? (y - ly) / width
+                                                       : nullptr;
+                            if (width && wslope && !wslope->is_zero(false))
+                            {
+                                ws->width = width;
+                                ws->slope = wslope;
+                            }
+                        }
+                    }
+                    rt.clear_error();
+                }
                 store(x);
                 return x;
             }
@@ -352,6 +503,15 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
                     px = x;
                 ly = y;
                 lx = x;
+                if (slope)
+                {
+                    // Warm start: First step using the last known slope
+                    if (algebraic_g whx = lx - y / slope)
+                        if (!whx->is_same_as(+lx))
+                            hx = whx;
+                    rt.clear_error();
+                    slope = nullptr;
+                }
                 x  = hx;
                 continue;
             }
@@ -435,6 +595,33 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
                     return x;
                 }
 
+                // Newton step from the best point, within the sign change
+                algebraic_g nwx;
+                if (deriv)
+                {
+                    sy = dfast.evaluate(deriv, lx);
+                    if (sy && !sy->is_zero(false))
+                    {
+                        // Reject steps that go far outside the known range
+                        algebraic_g range = maxscale * dx;
+                        sy = ly / sy;
+                        if (sy && range && !smaller_magnitude(range, sy))
+                            nwx = lx - sy;
+                    }
+                    if (nwx && nx && px && !is_complex)
+                    {
+                        sy = (nwx - nx) * (nwx - px);
+                        if (!sy || !sy->is_negative(false))
+                        {
+                            record(solve, "[%u] Newton %t outside [%t, %t]",
+                                   i, +nwx, +nx, +px);
+                            nwx = (nx + px) / two;
+                        }
+                    }
+                    if (!nwx && rt.error())
+                        rt.clear_error();
+                }
+
                 // Check the y interval
                 dy = hy - ly;
                 if (!dy)
@@ -442,7 +629,15 @@ algebraic_p Root::solve(program_r pgm, algebraic_r goal, algebraic_r guess)
                     store(x);
                     return nullptr;
                 }
-                if (dy->is_zero(false))
+                if (nwx)
+                {
+                    // Derivative known: Newton-Raphson step
+                    is_constant = false;
+                    x = nwx;
+                    record(solve, "[%u] Newton to %t [%t, %t]",
+                           i, +x, +lx, +hx);
+                }
+                else if (dy->is_zero(false))
                 {
                     record(solve,
                            "[%u] Unmoving %t [%t, %t]", +hy, +lx, +hx);
@@ -810,10 +1005,100 @@ list_p Root::multiple_equation_solver(list_r eqs, list_r names, list_r guesses)
 }
 
 
+struct broyden_data
+// ----------------------------------------------------------------------------
+//   Data for the rank-one update of the inverse Jacobian
+// ----------------------------------------------------------------------------
+{
+    array_g     h;              // Current inverse Jacobian
+    array_g     u;              // (s - H.y) / (s.H.y)
+    array_g     w;              // H^T.s
+};
+
+
+static object_p broyden_item(size_t rows, size_t columns,
+                             size_t r, size_t c, void *data)
+// ----------------------------------------------------------------------------
+//   Compute one element of the updated inverse Jacobian, H + u.w^T
+// ----------------------------------------------------------------------------
+{
+    broyden_data &b   = *((broyden_data *) data);
+    algebraic_g   hrc = algebraic_p(b.h->at(r, c));
+    algebraic_g   ur  = b.u->algebraic_child(r);
+    algebraic_g   wc  = b.w->algebraic_child(c);
+    if (!hrc || !ur || !wc)
+        return nullptr;
+    hrc = hrc + ur * wc;
+    return +hrc;
+}
+
+
+static array_p broyden_update(array_r h, array_r s, array_r y)
+// ----------------------------------------------------------------------------
+//   Sherman-Morrison update of the inverse Jacobian after a step
+// ----------------------------------------------------------------------------
+//   s is the step between two evaluations, y the change in values.
+//   This uses Broyden's "good" update H' = H + (s-H.y).(s^T.H) / (s^T.H.y),
+//   which keeps the inverse up to date without evaluating a new Jacobian
+//   or inverting it again. Return null if the update is degenerate.
+{
+    size_t       n  = s->items();
+    array_g      hy = h * y;
+    array_g      ht = h->transpose();
+    broyden_data b;
+    b.h = h;
+    b.w = ht * s;
+    if (!hy || !b.w)
+        return nullptr;
+    algebraic_g den = array::dot(s, hy);
+    if (!den || den->is_zero(false))
+        return nullptr;
+    b.u = s - hy;
+    if (!b.u)
+        return nullptr;
+    algebraic_g u = algebraic_p(+b.u);
+    u = u / den;
+    b.u = u ? u->as<array>() : nullptr;
+    if (!b.u)
+        return nullptr;
+    return array::build(n, n, broyden_item, &b);
+}
+
+
+static list_p jacobi_derivatives(list_r eqs, list_r vars, size_t n)
+// ----------------------------------------------------------------------------
+//   Build the list of symbolic partial derivatives, row by row
+// ----------------------------------------------------------------------------
+{
+    size_t depth = rt.depth();
+    size_t row   = 0;
+    for (object_p eqo : *eqs)
+    {
+        if (row++ >= n)
+            break;
+        program_g eq = expression::get(eqo);
+        for (object_p varo : *vars)
+        {
+            symbol_g     var   = varo->as_quoted<symbol>();
+            expression_p deriv = var ? solve_derivative(eq, var) : nullptr;
+            if (!deriv || !rt.push(deriv))
+            {
+                rt.drop(rt.depth() - depth);
+                return nullptr;
+            }
+        }
+    }
+    return list::list_from_stack(n * n);
+}
+
+
 bool Root::jacobi_solver(list_g &eqs, list_g &vars, list_g &guesses)
 // ----------------------------------------------------------------------------
 //  Compute a Jacobian when there is cross-talk between variables
 // ----------------------------------------------------------------------------
+//  The Jacobian is computed from symbolic derivatives when they are known,
+//  by shifting each variable otherwise. It is then inverted once and kept
+//  up to date with Broyden updates, and only rebuilt when things go wrong.
 {
     size_t n = vars->items();
     ASSERT("We need more equations than variables" && n <= eqs->items());
@@ -831,9 +1116,13 @@ bool Root::jacobi_solver(list_g &eqs, list_g &vars, list_g &guesses)
     int            errs  = 0;
     bool           back  = false; // Go backwards
     array_g        j, v, d;
+    array_g        h, x, fv;      // Inverse Jacobian, position, values
+    array_g        lastx, lastf;  // Position and values at last evaluation
     algebraic_g    magnitude, last, forward;
+    list_g         derivs = jacobi_derivatives(eqs, vars, n);
 
-    record(jsolve, "Solve for %t in %t guesses %t", +vars, +eqs, +guesses);
+    record(jsolve, "Solve for %t in %t guesses %t derivatives %t",
+           +vars, +eqs, +guesses, +derivs);
 
     while (iter++ < max)
     {
@@ -903,9 +1192,44 @@ bool Root::jacobi_solver(list_g &eqs, list_g &vars, list_g &guesses)
         if (smaller_magnitude(magnitude, eps))
             break;
 
+        // Collect the values, and try a Broyden update from last evaluation
+        if (neqs < n)
+        {
+            rt.drop(neqs);
+            h = nullptr;
+            lastx = nullptr;
+            continue;
+        }
+        fv = array::from_stack(n, 0);
+        x = array_p(+guesses);
+        if (!fv || !x)
+            goto error;
+        if (errs)
+        {
+            // Variables were shuffled, x is not where we evaluated
+            h = nullptr;
+            lastx = nullptr;
+        }
+        else
+        {
+            if (h && lastx && lastf)
+            {
+                array_g sx = x - lastx;
+                array_g sy = fv - lastf;
+                h = sx && sy ? broyden_update(h, sx, sy) : nullptr;
+                if (!h)
+                    rt.clear_error();
+                record(jsolve, "Broyden update %t", +h);
+            }
+            lastx = x;
+            lastf = fv;
+        }
+
         // Check if we are going in the wrong direction
         if (last && smaller_magnitude(last, magnitude))
         {
+            // Do not trust the updated Jacobian any longer
+            h = nullptr;
             if (!back)
             {
                 record(jsolve, "Worse than  %t, try backwards", +last);
@@ -930,58 +1254,87 @@ bool Root::jacobi_solver(list_g &eqs, list_g &vars, list_g &guesses)
         }
         last = magnitude;
 
-        // Compute the Jacobi matrix by shifting each variable
-        gi = guesses->begin();
-        size_t column = 0;
-        for (object_g varo : *vars)
+        if (!h && derivs)
         {
-            // Put (1+eps)*value into the variable
-            object_p valo = *gi;
-            algebraic_g val = valo->as_algebraic();
-            if (!val)
-                goto error;
-            algebraic_g dx = val;
-            val = val * oeps;
-            if (val->is_same_as(*gi))
-                val = val + oeps;
-            dx = dx - val;
-            if (!directory::store_here(varo, +val))
-                goto error;
-
-            // Evaluate each expression and subtract current value
-            neqs = 0;
-            for (object_p eqo : *eqs)
+            // Evaluate the symbolic Jacobian at the current position
+            size_t pushed = 0;
+            for (object_p dydx : *derivs)
             {
-                if (neqs >= n)
+                algebraic_g da = dydx->as_algebraic();
+                da = da ? da->evaluate() : nullptr;
+                if (!da || !rt.push(+da))
                     break;
-                expression_p eq = expression::get(eqo);
-                if (!eq)
-                    goto error;
-                algebraic_g now = eq->evaluate();
-                algebraic_g dydx = rt.stack(column + n - 1)->as_algebraic();
-                dydx = (dydx - now) / dx;
-                if (!dydx || !rt.push(+dydx))
+                pushed++;
+            }
+            if (pushed == n * n)
+            {
+                j = array::from_stack(n, n);
+                h = j ? j->invert() : nullptr;
+                if (!h)
                     goto error;
-                neqs++;
             }
+            else
+            {
+                // Fall back to shifting variables from now on
+                record(jsolve, "Cannot evaluate derivatives: %+s", rt.error());
+                rt.drop(pushed);
+                rt.clear_error();
+                derivs = nullptr;
+            }
+        }
+        if (!h)
+        {
+            // Compute the Jacobi matrix by shifting each variable
+            gi = guesses->begin();
+            for (object_g varo : *vars)
+            {
+                // Put (1+eps)*value into the variable
+                object_p valo = *gi;
+                algebraic_g val = valo->as_algebraic();
+                if (!val)
+                    goto error;
+                algebraic_g dx = val;
+                val = val * oeps;
+                if (val->is_same_as(*gi))
+                    val = val + oeps;
+                dx = dx - val;
+                if (!directory::store_here(varo, +val))
+                    goto error;
 
-            // We added a column
-            column += n;
+                // Evaluate each expression and subtract current value
+                neqs = 0;
+                for (object_p eqo : *eqs)
+                {
+                    if (neqs >= n)
+                        break;
+                    expression_p eq = expression::get(eqo);
+                    if (!eq)
+                        goto error;
+                    algebraic_g now = eq->evaluate();
+                    algebraic_g dydx = fv->algebraic_child(neqs);
+                    dydx = (dydx - now) / dx;
+                    if (!dydx || !rt.push(+dydx))
+                        goto error;
+                    neqs++;
+                }
 
-            // Restore original value
-            valo = *gi;
-            if (!directory::store_here(varo, valo))
+                // Restore original value
+                valo = *gi;
+                if (!directory::store_here(varo, valo))
+                    goto error;
+                ++gi;
+            }
+
+            // It's a bit inefficient to create arrays here, but save code space
+            j = array::from_stack(n, n, true);
+            h = j ? j->invert() : nullptr;
+            if (!h)
                 goto error;
-            ++gi;
         }
 
-        // It's a bit inefficient to create arrays here, but save code space
-        j = array::from_stack(n, n, true);
-        v = array::from_stack(n, 0);
-        d = v / j;
-        record(jsolve, "Jacobian %t values %t delta %t", +j, +v, +d);
-        v = array_p(+guesses);
-        v = v - d;
+        d = h * fv;
+        record(jsolve, "Inverse Jacobian %t values %t delta %t", +h, +fv, +d);
+        v = x - d;
         if (!v)
             goto error;
 
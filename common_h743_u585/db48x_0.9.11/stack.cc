@@ -144,6 +144,9 @@ uint stack::draw_stack()
     object_g cached;
     char     buf[16];
 
+    // Text rendering stops when the visible rows are filled
+    size_t   budget    = ((bottom - top) / lineHeight + 1) * avail;
+
     // Invalidate cache if settings changed
     static uint settingsHash = 0;
     uint hash = Settings.hash() ^ (interactive ? 0x4242 : 0) ;
@@ -185,10 +188,7 @@ uint stack::draw_stack()
                           grob::pattern::white,
                           true);
                 g.duration = level == 0 ? rtime : stime;
-                do
-                {
-                    graph = obj->graph(g);
-                } while (!graph && !rt.error() && autoScale && g.reduce_font());
+                graph = obj->fit_graph(g, autoScale);
 
                 if (graph)
                 {
@@ -222,6 +222,41 @@ uint stack::draw_stack()
             }
         }
 
+        // Text that fit on one line may have been cached as a bitmap
+        bool textmap = false;
+        if (!graph && cached)
+        {
+            if (grob_p gr = cached->as<grob>())
+            {
+                // Only reuse it if it still fits, e.g. after depth grew
+                if (gr->width() < avail)
+                {
+                    graph = gr;
+                    textmap = true;
+                    w = gr->width();
+#ifdef SIMULATOR
+                    if (level == 0)
+                    {
+                        extern int last_key;
+                        bool     ml = !interactive && (level ? sml : rml);
+                        renderer r(nullptr, ~0U, true, ml);
+                        size_t   len = obj->render(r);
+                        utf8     out = r.text();
+                        int      key = last_key;
+                        output(key, obj->type(), out, len);
+                        record(tests_rpl,
+                               "Stack key %d X-reg %+s size %u %s",
+                               key, object::name(obj->type()), len, out);
+                    }
+#endif // SIMULATOR
+                }
+                else
+                {
+                    cached = nullptr;
+                }
+            }
+        }
+
         y -= lineHeight;
         coord ytop = y < top ? top : y;
         coord yb   = y + lineHeight-1;
@@ -242,7 +277,8 @@ uint stack::draw_stack()
             {
                 grob::surface s = graph->pixels();
                 Screen.draw(s, LCD_W - 2 - w, y, fg);
-                Screen.draw_background(s, LCD_W - 2 - w, y, bg);
+                if (!textmap)
+                    Screen.draw_background(s, LCD_W - 2 - w, y, bg);
             }
         }
         else
@@ -260,7 +296,7 @@ uint stack::draw_stack()
             else
             {
                 // Text rendering
-                renderer r(nullptr, ~0U, true, ml);
+                renderer r(nullptr, budget, true, ml);
                 len = obj->render(r);
                 out = r.text();
                 gcutf8 saveOut = out;
@@ -277,20 +313,39 @@ uint stack::draw_stack()
 #ifdef SIMULATOR
             if (level == 0)
             {
+                // Tests check the full rendering, not the truncated one
                 extern int last_key;
-                int key = last_key;
-                output(key, obj->type(), out, len);
+                int      key  = last_key;
+                renderer full(nullptr, ~0U, true, ml);
+                utf8     fout = out;
+                size_t   flen = len;
+                if (len >= budget)
+                {
+                    flen = obj->render(full);
+                    fout = full.text();
+                }
+                output(key, obj->type(), fout, flen);
                 record(tests_rpl,
                        "Stack key %d X-reg %+s size %u %s",
-                       key, object::name(obj->type()), len, out);
+                       key, object::name(obj->type()), flen, fout);
+                out = rendered ? rendered->value(&len) : out;
             }
 #endif
+            // If the output budget was exhausted, drop any partial character
+            bool cut = len >= budget;
+            if (cut)
+            {
+                while (len && (out[len - 1] & 0xC0) == 0x80)
+                    len--;
+                if (len && out[len - 1] >= 0xC0)
+                    len--;
+            }
             w = font->width(out, len);
 
-            if (w >= avail || memchr(out, '\n', len))
+            if (cut || w >= avail || memchr(out, '\n', len))
             {
                 uint availRows = (y + lineHeight - 1 - top) / lineHeight;
-                bool dots      = !ml || w >= avail * availRows;
+                bool dots      = cut || !ml || w >= avail * availRows;
 
                 if (!dots)
                 {
@@ -350,17 +405,40 @@ uint stack::draw_stack()
                     coord   skip  = font->width(sep) * 3 / 2;
                     size    offs  = lineHeight / 5;
 
+                    // A truncated rendering has no tail to show
+                    if (cut)
+                        split = LCD_W - 2 - skip;
+
                     Screen.clip(x, ytop, split, yb);
                     Screen.text(x, y, out, len, font, fg);
                     Screen.clip(split, ytop, split + skip, yb);
                     Screen.glyph(split + skip/8, y - offs, sep, font,
                                  pattern::gray50);
-                    Screen.clip(split+skip, ytop, LCD_W, yb);
-                    Screen.text(LCD_W - 2 - w, y, out, len, font, fg);
+                    if (!cut)
+                    {
+                        Screen.clip(split+skip, ytop, LCD_W, yb);
+                        Screen.text(LCD_W - 2 - w, y, out, len, font, fg);
+                    }
                 }
             }
+            else if (grob_g map = rendered && w
+                                  ? grob::make(w, lineHeight)
+                                  : nullptr)
+            {
+                // Cache the rendered line, so that the next redraw is a blit
+                out = rendered->value(&len);
+                grob::surface s = map->pixels();
+                s.fill(grob::pattern::white);
+                s.text(0, 0, out, len, font, grob::pattern::black);
+                rt.cache(level == 0, +obj, +map);
+                if (rml == sml)
+                    rt.cache(level != 0, +obj, +map);
+                Screen.draw(s, LCD_W - 2 - w, y, fg);
+            }
             else
             {
+                if (rendered)
+                    out = rendered->value(&len);
                 Screen.text(LCD_W - 2 - w, y, out, len, font, fg);
             }
 
@@ -34,6 +34,8 @@
 #include "compare.h"
 #include "dmcp.h"
 #include "expression.h"
+#include "file.h"
+#include "files.h"
 #include "integer.h"
 #include "tag.h"
 #include "variables.h"
@@ -293,6 +295,581 @@ bool StatsData::Access::write(object_p name) const
 
 
 
+// ============================================================================
+//
+//   Incremental statistics
+//
+// ============================================================================
+//   Summary statistics are kept in running accumulators that `Σ+` updates
+//   with each new row, so that commands like `MEAN`, `SDEV`, `CORR` or `LR`
+//   do not have to go through the whole data set each time.
+//   The accumulators are keyed by the `ΣData` object in memory and by the
+//   directory generation, which changes whenever a global variable is stored,
+//   purged or edited in place, so that storing it wholesale, removing data or
+//   editing the variable invalidates them. Checking this does not depend on
+//   the size of the data. They are then rebuilt in a single pass when first
+//   needed. Data that is not a global object, e.g. read from a file, is
+//   never cached, since another temporary can later have the same address.
+//
+//   There are two groups of accumulators:
+//   - Per-column values: total, minimum, maximum, and Welford's running mean
+//     and sum of squared deviations. These are arrays if there are several
+//     columns, like the results of the corresponding commands.
+//   - Values for the X and Y columns transformed for each fit model: sums of
+//     values, squares and products, as well as running means and co-moments.
+//     These are only valid if all rows have both X and Y columns.
+//     All the models that are needed are computed in a single traversal,
+//     and the logarithms of X and Y are computed at most once per row.
+//   Sums are accumulated in the same order as a full pass would, so that
+//   they give the exact same results. Variances and covariances use the
+//   numerically stable Welford update instead of a second pass, so that
+//   `VAR`, `SDEV`, `PVAR`, `PSDEV`, `COV`, `PCOV` and `CORR` can differ from
+//   the two-pass results in the last digits.
+
+static algebraic_p fit_value(object::id model, size_t xcol, size_t ycol,
+                             algebraic_r x, size_t col)
+// ----------------------------------------------------------------------------
+//   Adjust data for the given fit model, see StatsAccess::fit_transform
+// ----------------------------------------------------------------------------
+{
+    bool dolog = false;
+    switch (model)
+    {
+    default:
+    case object::ID_LinearFit:                                          break;
+    case object::ID_ExponentialFit: dolog = col == ycol;                break;
+    case object::ID_LogarithmicFit: dolog = col == xcol;                break;
+    case object::ID_PowerFit:       dolog = col == xcol || col == ycol; break;
+    }
+    if (dolog)
+        return ln::evaluate(x);
+    return x;
+}
+
+
+struct StatsFitSums
+// ----------------------------------------------------------------------------
+//   Running sums for the X and Y columns, transformed for one fit model
+// ----------------------------------------------------------------------------
+{
+    StatsFitSums()
+        : valid(false),
+          sx(), sy(), sxy(), sx2(), sy2(), mx(), my(), m2x(), m2y(), cxy()
+    {}
+
+    void        reset();
+    bool        add(algebraic_r x, algebraic_r y, size_t count);
+
+    bool        valid;
+    algebraic_g sx;
+    algebraic_g sy;
+    algebraic_g sxy;
+    algebraic_g sx2;
+    algebraic_g sy2;
+    algebraic_g mx;
+    algebraic_g my;
+    algebraic_g m2x;
+    algebraic_g m2y;
+    algebraic_g cxy;
+};
+
+
+struct StatsAccumulators
+// ----------------------------------------------------------------------------
+//   Running statistics for the current ΣData
+// ----------------------------------------------------------------------------
+{
+    enum { FITS = object::ID_LogarithmicFit - object::ID_LinearFit + 1 };
+    typedef uint fit_mask;
+
+    StatsAccumulators()
+        : data(nullptr), generation(0), settings(0),
+          rows(0), columns(0), valid(false),
+          total(), minimum(), maximum(), mean(), m2(),
+          xcol(0), ycol(0), fits()
+    {}
+
+    static StatsAccumulators &current();
+    static uint32_t           mode();
+    static array_p            variable();
+    static fit_mask           mask(object::id model)
+    {
+        return 1U << (model - object::ID_LinearFit);
+    }
+
+    void        reset();
+    bool        matches(array_p data) const;
+    void        key(array_p data);
+    bool        add(object_p row);
+    fit_mask    add_fits(object_p row, size_t count, fit_mask models);
+    bool        sync(array_p data);
+    fit_mask    sync(array_p data, fit_mask models, size_t xcol, size_t ycol);
+    fit_mask    valid_fits() const;
+
+    object_p    data;           // ΣData object the values were computed for
+    uint        generation;     // Directory generation at that time
+    uint32_t    settings;       // Settings that change the results
+    size_t      rows;           // Number of rows accumulated
+    size_t      columns;        // Number of columns in each row
+    bool        valid;          // Per-column accumulators are valid
+    algebraic_g total;
+    algebraic_g minimum;
+    algebraic_g maximum;
+    algebraic_g mean;
+    algebraic_g m2;
+
+    size_t      xcol;           // X and Y columns for the fit sums
+    size_t      ycol;
+    StatsFitSums fits[FITS];    // Indexed by fit model
+};
+
+
+StatsAccumulators &StatsAccumulators::current()
+// ----------------------------------------------------------------------------
+//   Return the accumulators, created on first use
+// ----------------------------------------------------------------------------
+{
+    static StatsAccumulators accumulators;
+    return accumulators;
+}
+
+
+uint32_t StatsAccumulators::mode()
+// ----------------------------------------------------------------------------
+//   The settings that change the results of the computations
+// ----------------------------------------------------------------------------
+{
+    return (Settings.Precision() << 1) | Settings.HardwareFloatingPointEnabled();
+}
+
+
+array_p StatsAccumulators::variable()
+// ----------------------------------------------------------------------------
+//   Return the ΣData array as stored, following an indirection by name
+// ----------------------------------------------------------------------------
+{
+    object_p obj = directory::recall_all(StatsData::Access::name(), false);
+    if (obj)
+    {
+        object::id oty = obj->type();
+        if (oty == object::ID_text || oty == object::ID_symbol)
+            obj = directory::recall_all(obj, false);
+    }
+    return obj ? obj->as<array>() : nullptr;
+}
+
+
+bool StatsAccumulators::matches(array_p values) const
+// ----------------------------------------------------------------------------
+//   Check if the accumulators were computed for the given data
+// ----------------------------------------------------------------------------
+{
+    return valid && values &&
+        object_p(values) == data &&
+        generation == directory::generation &&
+        settings == mode();
+}
+
+
+void StatsAccumulators::key(array_p values)
+// ----------------------------------------------------------------------------
+//   Record the data the accumulators are computed for, if it is global
+// ----------------------------------------------------------------------------
+{
+    bool global = values && rt.is_global(values);
+    data = global ? object_p(values) : nullptr;
+    generation = directory::generation;
+    settings = mode();
+}
+
+
+void StatsAccumulators::reset()
+// ----------------------------------------------------------------------------
+//   Invalidate all accumulators
+// ----------------------------------------------------------------------------
+{
+    data = nullptr;
+    generation = 0;
+    settings = 0;
+    rows = 0;
+    columns = 0;
+    valid = false;
+    total = minimum = maximum = mean = m2 = nullptr;
+    for (StatsFitSums &fit : fits)
+        fit.reset();
+}
+
+
+StatsAccumulators::fit_mask StatsAccumulators::valid_fits() const
+// ----------------------------------------------------------------------------
+//   Return the models for which we have valid fit sums
+// ----------------------------------------------------------------------------
+{
+    fit_mask result = 0;
+    for (uint f = 0; f < FITS; f++)
+        if (fits[f].valid)
+            result |= 1U << f;
+    return result;
+}
+
+
+void StatsFitSums::reset()
+// ----------------------------------------------------------------------------
+//   Reset the sums for a new pass
+// ----------------------------------------------------------------------------
+{
+    valid = false;
+    sx = sy = sxy = sx2 = sy2 = m2x = m2y = cxy = integer::make(0);
+    mx = my = nullptr;
+}
+
+
+bool StatsFitSums::add(algebraic_r x, algebraic_r y, size_t count)
+// ----------------------------------------------------------------------------
+//   Add transformed X and Y values to the sums
+// ----------------------------------------------------------------------------
+{
+    sx  = sx + x;
+    sy  = sy + y;
+    sxy = sxy + x * y;
+    sx2 = sx2 + x * x;
+    sy2 = sy2 + y * y;
+    if (count == 1)
+    {
+        mx = x;
+        my = y;
+    }
+    else
+    {
+        algebraic_g n  = integer::make(count);
+        algebraic_g dx = x - mx;
+        algebraic_g dy = y - my;
+        mx  = mx + dx / n;
+        my  = my + dy / n;
+        m2x = m2x + dx * (x - mx);
+        m2y = m2y + dy * (y - my);
+        cxy = cxy + dx * (y - my);
+    }
+    return sx && sy && sxy && sx2 && sy2 && mx && my && m2x && m2y && cxy;
+}
+
+
+typedef algebraic_p (*column_fn)(algebraic_r a, algebraic_r b, algebraic_r c);
+
+static algebraic_p columnwise(column_fn op,
+                              algebraic_r a, algebraic_r b, algebraic_r c)
+// ----------------------------------------------------------------------------
+//   Apply an operation column by column, c may be a scalar
+// ----------------------------------------------------------------------------
+{
+    array_g aa = a->as<array>();
+    if (!aa)
+        return op(a, b, c);
+
+    array_g ba = b->as<array>();
+    if (!ba)
+    {
+        rt.invalid_stats_data_error();
+        return nullptr;
+    }
+    array_g         ca = c->as<array>();
+    array::iterator bi = ba->begin();
+    array::iterator ci = ca ? ca->begin() : ba->begin();
+    algebraic_g     x, y, z;
+    scribble        scr;
+    for (object_p aobj : *aa)
+    {
+        object_p bobj = *bi++;
+        object_p cobj = ca ? *ci++ : +c;
+        if (!bobj || !cobj)
+        {
+            rt.invalid_stats_data_error();
+            return nullptr;
+        }
+        x = aobj->as_algebraic();
+        y = bobj->as_algebraic();
+        z = cobj->as_algebraic();
+        if (!x || !y || !z)
+            return nullptr;
+        x = op(x, y, z);
+        if (!x || !rt.append(+x))
+            return nullptr;
+    }
+    return array_p(array::make(object::ID_array, scr.scratch(), scr.growth()));
+}
+
+
+static algebraic_p column_zero(algebraic_r, algebraic_r, algebraic_r)
+// ----------------------------------------------------------------------------
+//   Initial value for the sum of squared deviations
+// ----------------------------------------------------------------------------
+{
+    return integer::make(0);
+}
+
+
+static algebraic_p column_add(algebraic_r s, algebraic_r x, algebraic_r)
+// ----------------------------------------------------------------------------
+//   Add a value to the total
+// ----------------------------------------------------------------------------
+{
+    return s + x;
+}
+
+
+static algebraic_p column_min(algebraic_r s, algebraic_r x, algebraic_r)
+// ----------------------------------------------------------------------------
+//   Keep the smallest value
+// ----------------------------------------------------------------------------
+{
+    int test = 0;
+    comparison::compare(&test, s, x);
+    return test < 0 ? s : x;
+}
+
+
+static algebraic_p column_max(algebraic_r s, algebraic_r x, algebraic_r)
+// ----------------------------------------------------------------------------
+//   Keep the largest value
+// ----------------------------------------------------------------------------
+{
+    int test = 0;
+    comparison::compare(&test, s, x);
+    return test > 0 ? s : x;
+}
+
+
+static algebraic_p column_mean(algebraic_r mean, algebraic_r x, algebraic_r n)
+// ----------------------------------------------------------------------------
+//   Welford update of the running mean
+// ----------------------------------------------------------------------------
+{
+    return mean + (x - mean) / n;
+}
+
+
+static algebraic_p column_dev(algebraic_r x, algebraic_r prev, algebraic_r mean)
+// ----------------------------------------------------------------------------
+//   Welford increment of the sum of squared deviations
+// ----------------------------------------------------------------------------
+{
+    return (x - prev) * (x - mean);
+}
+
+
+bool StatsAccumulators::add(object_p robj)
+// ----------------------------------------------------------------------------
+//   Add a row to the per-column accumulators
+// ----------------------------------------------------------------------------
+{
+    array_p ra = robj->as<array>();
+    if (!rows)
+        columns = ra ? ra->items() : 1;
+    if (ra && columns == 1)
+        robj = ra->objects();
+    if (!robj || (!robj->is_real() && !robj->is_complex() && columns == 1))
+    {
+        rt.invalid_stats_data_error();
+        return false;
+    }
+
+    algebraic_g x = algebraic_p(robj);
+    if (!rows)
+    {
+        total = minimum = maximum = mean = x;
+        m2 = columnwise(column_zero, x, x, x);
+    }
+    else
+    {
+        algebraic_g n    = integer::make(rows + 1);
+        algebraic_g prev = mean;
+        total   = columnwise(column_add, total, x, x);
+        minimum = columnwise(column_min, minimum, x, x);
+        maximum = columnwise(column_max, maximum, x, x);
+        mean    = columnwise(column_mean, mean, x, n);
+        algebraic_g dev = columnwise(column_dev, x, prev, mean);
+        m2      = dev ? columnwise(column_add, m2, dev, dev) : nullptr;
+    }
+    rows++;
+    return total && minimum && maximum && mean && m2;
+}
+
+
+StatsAccumulators::fit_mask
+StatsAccumulators::add_fits(object_p robj, size_t count, fit_mask models)
+// ----------------------------------------------------------------------------
+//   Add a row to the fit sums for the given models, return those that worked
+// ----------------------------------------------------------------------------
+{
+    array_g ra = robj->as<array>();
+    if (!ra)
+        return 0;
+
+    algebraic_g x, y;
+    size_t      col = 1;
+    for (object_p item : *ra)
+    {
+        if (!item->is_real() && !item->is_complex())
+            return 0;
+        if (col == xcol)
+            x = algebraic_p(item);
+        if (col == ycol)
+            y = algebraic_p(item);
+        if (x && y)
+            break;
+        col++;
+    }
+    if (!x || !y)
+        return 0;
+
+    // Compute logarithms only once, and only if some model needs them
+    fit_mask logx = mask(object::ID_LogarithmicFit) | mask(object::ID_PowerFit);
+    fit_mask logy = mask(object::ID_ExponentialFit) | mask(object::ID_PowerFit);
+    if (xcol == ycol)
+        logx = logy = logx | logy;
+    algebraic_g lx, ly;
+    if (models & logx)
+    {
+        lx = fit_value(object::ID_LogarithmicFit, xcol, ycol, x, xcol);
+        if (!lx)
+        {
+            rt.clear_error();
+            models &= ~logx;
+        }
+    }
+    if (models & logy)
+    {
+        ly = fit_value(object::ID_ExponentialFit, xcol, ycol, y, ycol);
+        if (!ly)
+        {
+            rt.clear_error();
+            models &= ~logy;
+        }
+    }
+
+    for (uint f = 0; f < FITS; f++)
+    {
+        if (~models & (1U << f))
+            continue;
+        fit_mask    m  = 1U << f;
+        algebraic_g fx = (m & logx) ? lx : x;
+        algebraic_g fy = (m & logy) ? ly : y;
+        if (!fits[f].add(fx, fy, count))
+        {
+            rt.clear_error();
+            models &= ~m;
+        }
+    }
+    return models;
+}
+
+
+bool StatsAccumulators::sync(array_p data)
+// ----------------------------------------------------------------------------
+//   Make sure the per-column accumulators match the data
+// ----------------------------------------------------------------------------
+{
+    if (matches(data))
+        return true;
+
+    reset();
+    if (!data)
+        return false;
+    array_g values = data;
+    for (object_p row : *values)
+    {
+        if (!add(row))
+        {
+            reset();
+            rt.clear_error();
+            return false;
+        }
+    }
+    key(data);
+    valid = true;
+    return true;
+}
+
+
+StatsAccumulators::fit_mask
+StatsAccumulators::sync(array_p data, fit_mask models, size_t xc, size_t yc)
+// ----------------------------------------------------------------------------
+//   Make sure the fit sums match the data, return the valid requested models
+// ----------------------------------------------------------------------------
+{
+    if (!sync(data))
+        return 0;
+    if (xcol != xc || ycol != yc)
+    {
+        for (StatsFitSums &fit : fits)
+            fit.reset();
+        xcol = xc;
+        ycol = yc;
+    }
+
+    // Compute all missing models in a single pass
+    fit_mask missing = models & ~valid_fits();
+    if (missing)
+    {
+        for (uint f = 0; f < FITS; f++)
+            if (missing & (1U << f))
+                fits[f].reset();
+
+        array_g values = data;
+        size_t  count  = 0;
+        for (object_p row : *values)
+        {
+            missing = add_fits(row, ++count, missing);
+            if (!missing)
+                break;
+        }
+        if (!count)
+            missing = 0;
+        for (uint f = 0; f < FITS; f++)
+            if (missing & (1U << f))
+                fits[f].valid = true;
+    }
+    return models & valid_fits();
+}
+
+
+const StatsAccumulators *StatsAccess::accumulators() const
+// ----------------------------------------------------------------------------
+//   Return valid per-column accumulators for the data, or nullptr
+// ----------------------------------------------------------------------------
+{
+    StatsAccumulators &acc = StatsAccumulators::current();
+    if (!acc.sync(data))
+        return nullptr;
+    return &acc;
+}
+
+
+const StatsFitSums *StatsAccess::pair_accumulators() const
+// ----------------------------------------------------------------------------
+//   Return valid X and Y accumulators for the data and model, or nullptr
+// ----------------------------------------------------------------------------
+{
+    StatsAccumulators &acc = StatsAccumulators::current();
+    StatsAccumulators::fit_mask m = StatsAccumulators::mask(model);
+    if (!acc.sync(data, m, xcol, ycol))
+        return nullptr;
+    return &acc.fits[model - object::ID_LinearFit];
+}
+
+
+void StatsAccess::prepare_fits() const
+// ----------------------------------------------------------------------------
+//   Compute the X and Y accumulators for all fit models in a single pass
+// ----------------------------------------------------------------------------
+{
+    StatsAccumulators &acc = StatsAccumulators::current();
+    acc.sync(data, (1U << StatsAccumulators::FITS) - 1, xcol, ycol);
+}
+
+
+
+
 // ============================================================================
 //
 //   Statistics data entry
@@ -341,7 +918,40 @@ COMMAND_BODY(AddData)
 
             if (!stats.data)
                 stats.data = array_p(array::make(ID_array, nullptr, 0));
+
+            // Update the accumulators if they match the current data
+            StatsAccumulators &acc = StatsAccumulators::current();
+            object_g row = value;
+            bool incremental = acc.matches(stats.data);
             stats.data = stats.data->append(value);
+            if (incremental && stats.data)
+            {
+                if (acc.add(row))
+                {
+                    // Fit sums that cannot take the new row are invalidated
+                    StatsAccumulators::fit_mask fits = acc.valid_fits();
+                    fits &= ~acc.add_fits(row, acc.rows, fits);
+                    for (uint f = 0; f < StatsAccumulators::FITS; f++)
+                        if (fits & (1U << f))
+                            acc.fits[f].valid = false;
+
+                    // Store now to key the accumulators on the new variable
+                    if (stats.write())
+                    {
+                        stats.original_data = stats.data;
+                        acc.key(StatsAccumulators::variable());
+                    }
+                    else
+                    {
+                        acc.reset();
+                    }
+                }
+                else
+                {
+                    acc.reset();
+                    rt.clear_error();
+                }
+            }
             rt.drop();
             return OK;
         }
@@ -472,18 +1082,7 @@ algebraic_p StatsAccess::fit_transform(algebraic_r x, uint col) const
 //   3. Log fit:        y = a*ln(x) + b
 //   4. Power fit:      ln(y) = a*ln(x) + ln(b)
 {
-    bool dolog = false;
-    switch (model)
-    {
-    default:
-    case object::ID_LinearFit:                                          break;
-    case object::ID_ExponentialFit: dolog = col == ycol;                break;
-    case object::ID_LogarithmicFit: dolog = col == xcol;                break;
-    case object::ID_PowerFit:       dolog = col == xcol || col == ycol; break;
-    }
-    if (dolog)
-        return ln::evaluate(x);
-    return x;
+    return fit_value(model, xcol, ycol, x, col);
 }
 
 
@@ -660,6 +1259,8 @@ algebraic_p StatsAccess::sum_x() const
 //   Return the sum of values in the X column
 // ----------------------------------------------------------------------------
 {
+    if (const StatsFitSums *acc = pair_accumulators())
+        return acc->sx;
     return sum(sum1, xcol);
 }
 
@@ -669,6 +1270,8 @@ algebraic_p StatsAccess::sum_y() const
 //   Return the sum of values in the Y column
 // ----------------------------------------------------------------------------
 {
+    if (const StatsFitSums *acc = pair_accumulators())
+        return acc->sy;
     return sum(sum1, ycol);
 }
 
@@ -678,6 +1281,8 @@ algebraic_p StatsAccess::sum_xy() const
 //   Return the sum of product of values in X and Y column
 // ----------------------------------------------------------------------------
 {
+    if (const StatsFitSums *acc = pair_accumulators())
+        return acc->sxy;
     return sum(sumxy, xcol, ycol);
 }
 
@@ -687,6 +1292,8 @@ algebraic_p StatsAccess::sum_x2() const
 //   Return the sum of squares of values in the X column
 // ----------------------------------------------------------------------------
 {
+    if (const StatsFitSums *acc = pair_accumulators())
+        return acc->sx2;
     return sum(sum2, xcol);
 }
 
@@ -696,6 +1303,8 @@ algebraic_p StatsAccess::sum_y2() const
 //   Return the sum of squares of values in the Y column
 // ----------------------------------------------------------------------------
 {
+    if (const StatsFitSums *acc = pair_accumulators())
+        return acc->sy2;
     return sum(sum2, ycol);
 }
 
@@ -846,31 +1455,232 @@ algebraic_p StatsAccess::total() const
 //  Perform a sum of the columns
 // ----------------------------------------------------------------------------
 {
+    if (const StatsAccumulators *acc = accumulators())
+        return acc->total;
     return total(sum1);
 }
 
 
-algebraic_p StatsAccess::min() const
-// ----------------------------------------------------------------------------
-//  Find the minimum of all columns
-// ----------------------------------------------------------------------------
-{
-    return total(smallest);
+algebraic_p StatsAccess::min() const
+// ----------------------------------------------------------------------------
+//  Find the minimum of all columns
+// ----------------------------------------------------------------------------
+{
+    if (const StatsAccumulators *acc = accumulators())
+        return acc->minimum;
+    return total(smallest);
+}
+
+
+algebraic_p StatsAccess::max() const
+// ----------------------------------------------------------------------------
+//  Find the maximum of all columns
+// ----------------------------------------------------------------------------
+{
+    if (const StatsAccumulators *acc = accumulators())
+        return acc->maximum;
+    return total(largest);
+}
+
+
+algebraic_p StatsAccess::average() const
+// ----------------------------------------------------------------------------
+//   Compute the average value
+// ----------------------------------------------------------------------------
+{
+    if (rows <= 0)
+    {
+        rt.insufficient_stats_data_error();
+        return nullptr;
+    }
+    if (algebraic_g sum = total())
+    {
+        algebraic_g count = integer::make(rows);
+        sum = sum / count;
+        return sum;
+    }
+    return nullptr;
+}
+
+
+// ============================================================================
+//
+//   Order statistics
+//
+// ============================================================================
+//   The median and percentiles are computed by selection rather than by
+//   sorting the data. The values of a column are pushed on the stack, which
+//   acts as the index array, and a three-way quickselect partially orders
+//   them in place until the requested rank is found. This is linear on
+//   average and does not need a sorted copy of the data. If partitioning
+//   degenerates, the remaining range is heap-sorted, which bounds the worst
+//   case to O(n log n) like an introselect.
+
+static inline int stats_compare(size_t i, size_t j)
+// ----------------------------------------------------------------------------
+//   Compare two stack items by value
+// ----------------------------------------------------------------------------
+{
+    object_p x = rt.stack(i);
+    object_p y = rt.stack(j);
+    return value_compare(&x, &y);
+}
+
+
+static inline void stats_swap(size_t i, size_t j)
+// ----------------------------------------------------------------------------
+//   Swap two stack items
+// ----------------------------------------------------------------------------
+{
+    if (i != j)
+    {
+        object_p x = rt.stack(i);
+        rt.stack(i, rt.stack(j));
+        rt.stack(j, x);
+    }
+}
+
+
+static void stats_sift(size_t lo, size_t root, size_t count)
+// ----------------------------------------------------------------------------
+//   Sift down in a max-heap of count items starting at lo
+// ----------------------------------------------------------------------------
+{
+    while (2 * root + 1 < count)
+    {
+        size_t child = 2 * root + 1;
+        if (child + 1 < count && stats_compare(lo + child, lo + child + 1) < 0)
+            child++;
+        if (stats_compare(lo + root, lo + child) >= 0)
+            return;
+        stats_swap(lo + root, lo + child);
+        root = child;
+    }
+}
+
+
+static void stats_heapsort(size_t lo, size_t hi)
+// ----------------------------------------------------------------------------
+//   Sort stack items lo to hi included
+// ----------------------------------------------------------------------------
+{
+    size_t count = hi - lo + 1;
+    for (size_t i = count / 2; i --> 0; )
+        stats_sift(lo, i, count);
+    for (size_t end = count; end --> 1; )
+    {
+        stats_swap(lo, lo + end);
+        stats_sift(lo, 0, end);
+    }
+}
+
+
+static bool stats_select(size_t count, size_t k)
+// ----------------------------------------------------------------------------
+//   Reorder the top count stack items so that item k has rank k
+// ----------------------------------------------------------------------------
+{
+    size_t lo    = 0;
+    size_t hi    = count - 1;
+    uint   limit = 8;
+    for (size_t n = count; n > 1; n /= 2)
+        limit += 2;
+
+    while (lo < hi)
+    {
+        if (!limit--)
+        {
+            stats_heapsort(lo, hi);
+            break;
+        }
+
+        // Median of three as the pivot
+        size_t mid = lo + (hi - lo) / 2;
+        if (stats_compare(mid, lo) < 0)
+            stats_swap(mid, lo);
+        if (stats_compare(hi, lo) < 0)
+            stats_swap(hi, lo);
+        if (stats_compare(hi, mid) < 0)
+            stats_swap(hi, mid);
+        stats_swap(lo, mid);
+
+        // Three-way partition: [lo,lt) < pivot, [lt,gt] == pivot, (gt,hi] >
+        size_t lt = lo;
+        size_t gt = hi;
+        size_t i  = lo + 1;
+        while (i <= gt)
+        {
+            int test = stats_compare(i, lt);
+            if (test < 0)
+                stats_swap(lt++, i++);
+            else if (test > 0)
+                stats_swap(i, gt--);
+            else
+                i++;
+        }
+        if (rt.error())
+            return false;
+
+        if (k < lt)
+            hi = lt - 1;
+        else if (k > gt)
+            lo = gt + 1;
+        else
+            break;
+    }
+    return !rt.error();
 }
 
 
-algebraic_p StatsAccess::max() const
+static algebraic_p stats_quantile(size_t count, algebraic_r percent)
 // ----------------------------------------------------------------------------
-//  Find the maximum of all columns
+//   Return the median or a percentile of the top count stack items
 // ----------------------------------------------------------------------------
+//   Percentiles interpolate linearly between the closest ranks, so that the
+//   50th percentile is the median.
 {
-    return total(largest);
+    size_t      rank = (count - 1) / 2;
+    bool        pair = !(count & 1);
+    algebraic_g frac;
+    if (percent)
+    {
+        algebraic_g h = integer::make(count - 1);
+        h = h * percent / integer::make(100);
+        algebraic_g lo = floor::run(h);
+        if (!lo)
+            return nullptr;
+        rank = lo->as_uint32(0, true);
+        if (rt.error())
+            return nullptr;
+        frac = h - lo;
+        if (!frac)
+            return nullptr;
+        pair = !frac->is_zero(false) && rank + 1 < count;
+    }
+
+    if (!stats_select(count, rank))
+        return nullptr;
+    algebraic_g low = rt.stack(rank)->as_algebraic();
+    if (!pair)
+        return low;
+
+    // The next rank is the smallest item after the selected one
+    size_t next = rank + 1;
+    for (size_t i = next + 1; i < count; i++)
+        if (stats_compare(i, next) < 0)
+            next = i;
+    algebraic_g high = rt.stack(next)->as_algebraic();
+    if (!low || !high)
+        return nullptr;
+    if (percent)
+        return low + frac * (high - low);
+    return (low + high) / integer::make(2);
 }
 
 
-algebraic_p StatsAccess::average() const
+algebraic_p StatsAccess::quantile(algebraic_r percent) const
 // ----------------------------------------------------------------------------
-//   Compute the average value
+//   Compute the median or a percentile of each column
 // ----------------------------------------------------------------------------
 {
     if (rows <= 0)
@@ -878,74 +1688,78 @@ algebraic_p StatsAccess::average() const
         rt.insufficient_stats_data_error();
         return nullptr;
     }
-    if (algebraic_g sum = total())
+
+    scribble    scr;
+    algebraic_g m;
+    for (size_t c = 0; c < columns; c++)
     {
-        algebraic_g count = integer::make(rows);
-        sum = sum / count;
-        return sum;
+        // Push the values of the column
+        stack_depth_restore sdr;
+        for (object_p row : *data)
+        {
+            object_p item = row;
+            if (array_p ra = row->as<array>())
+                item = ra->at(c);
+            else if (c)
+                item = nullptr;
+            if (!item || (!item->is_real() && !item->is_complex()))
+            {
+                rt.invalid_stats_data_error();
+                return nullptr;
+            }
+            if (!rt.push(item))
+                return nullptr;
+        }
+
+        m = stats_quantile(sdr.count(), percent);
+        if (columns == 1)
+            return m;
+        if (!m || !rt.append(+m))
+            return nullptr;
     }
-    return nullptr;
+    return list::make(data->type(), scr.scratch(), scr.growth());
 }
 
 
-static algebraic_p list_median(list_g &data)
+algebraic_p StatsAccess::median() const
 // ----------------------------------------------------------------------------
-//   Find the median in a one-dimensional sorted list or array
+//   Compute the median
 // ----------------------------------------------------------------------------
 {
-    // List needs to be sorted
-    data = data->sort();
-    if (!data)
-        return nullptr;
-
-    size_t count = data->items();
-    if (count & 1)
-        return data->at(count/2)->as_algebraic();
-
-    size_t      half = count / 2;
-    algebraic_g two  = integer::make(2);
-    algebraic_g l   = data->at(half - 1)->as_algebraic();
-    algebraic_g h   = data->at(half - 0)->as_algebraic();
-    return (l + h) / two;
+    return quantile(nullptr);
 }
 
 
-algebraic_p StatsAccess::median() const
+algebraic_p StatsAccess::percentile() const
 // ----------------------------------------------------------------------------
-//   Compute the median
+//   Compute a percentile, taking the percentage from the stack
 // ----------------------------------------------------------------------------
 {
-    if (rows <= 0)
-    {
-        rt.insufficient_stats_data_error();
-        return nullptr;
-    }
-
-    scribble    scr;
-    algebraic_g m;
-    for (size_t c = 0; c < columns; c++)
+    if (object_p obj = rt.pop())
     {
-        object_p col = data->column(c);
-        if (list_g lcol = col->as_array_or_list())
+        if (!obj->is_real())
         {
-            m = list_median(lcol);
-            if (columns == 1)
-                return m;
-            if (!m || !rt.append(+m))
-                return nullptr;
+            rt.type_error();
+            return nullptr;
         }
-        else if (c == 0 && columns == 1)
+        algebraic_g percent = algebraic_p(obj);
+        algebraic_g hundred = integer::make(100);
+        if (percent->is_negative(false))
         {
-            list_g d = +data;
-            return list_median(d);
+            rt.domain_error();
+            return nullptr;
         }
-        else
+        algebraic_g test = percent > hundred;
+        if (!test)
+            return nullptr;
+        if (test->as_truth(false))
         {
-            rt.invalid_stats_data_error();
+            rt.domain_error();
             return nullptr;
         }
+        return quantile(percent);
     }
-    return list::make(data->type(), scr.scratch(), scr.growth());
+    return nullptr;
 }
 
 
@@ -969,6 +1783,11 @@ algebraic_p StatsAccess::variance() const
         rt.insufficient_stats_data_error();
         return nullptr;
     }
+    if (const StatsAccumulators *acc = accumulators())
+    {
+        algebraic_g num = integer::make(rows - 1);
+        return acc->m2 / num;
+    }
     if (algebraic_g mean = average())
     {
         algebraic_g sum = total(do_variance, mean);
@@ -1003,6 +1822,12 @@ algebraic_p StatsAccess::correlation() const
         return nullptr;
     }
 
+    if (const StatsFitSums *acc = pair_accumulators())
+    {
+        algebraic_g den = acc->m2x * acc->m2y;
+        return acc->cxy / sqrt::evaluate(den);
+    }
+
     algebraic_g n     = integer::make(rows);
     algebraic_g avg_x = sum_x() / n;
     algebraic_g avg_y = sum_y() / n;
@@ -1061,6 +1886,12 @@ algebraic_p StatsAccess::covariance(bool population) const
         rt.insufficient_stats_data_error();
         return nullptr;
     }
+    if (const StatsFitSums *acc = pair_accumulators())
+    {
+        algebraic_g n = integer::make(rows - !population);
+        return acc->cxy / n;
+    }
+
     algebraic_g n     = integer::make(rows);
     algebraic_g avg_x = sum_x() / n;
     algebraic_g avg_y = sum_y() / n;
@@ -1255,6 +2086,11 @@ algebraic_p StatsAccess::population_variance() const
         rt.insufficient_stats_data_error();
         return nullptr;
     }
+    if (const StatsAccumulators *acc = accumulators())
+    {
+        algebraic_g num = integer::make(rows);
+        return acc->m2 / num;
+    }
     if (algebraic_g mean = average())
     {
         algebraic_g sum = total(do_popvar, mean);
@@ -1298,6 +2134,383 @@ object::result StatsAccess::evaluate(eval_fn op, bool two_columns)
 
 
 
+// ============================================================================
+//
+//   Frequency bins
+//
+// ============================================================================
+//   `Bins` counts the values of the independent column that fall in each bin,
+//   as well as the values below or above all bins, in a single pass.
+//   Uniform bins are given by a minimum and a width, and the bin index is
+//   computed directly as the floor of (x - min) / width. Hardware doubles are
+//   used when the value is clearly inside a bin, and exact arithmetic is only
+//   used close to a bin boundary or for values that have no double form.
+//   If the width is a list or array of increasing upper bounds, the bins can
+//   have different widths, and each value is located with a binary search.
+//   When ΣData names a CSV file, the file is read one row at a time and only
+//   the independent column is parsed, so that large logs are never loaded.
+
+#ifndef STATS_BINS_MARGIN
+// Distance to a bin boundary, relative to x/width, where doubles are not used
+#define STATS_BINS_MARGIN       1e-9
+#endif // STATS_BINS_MARGIN
+
+struct stats_bins
+// ----------------------------------------------------------------------------
+//   Accumulate frequency counts
+// ----------------------------------------------------------------------------
+//   Upper bounds for non-uniform bins are kept on the stack so that they can
+//   be indexed directly, bound i being at level i.
+{
+    stats_bins(algebraic_r xmin, object_r width, size_t count);
+    ~stats_bins();
+
+    bool        add(object_p value);
+    bool        scan(const StatsAccess &stats);
+    bool        stream(text_p name, size_t xcol);
+    bool        push() const;
+    operator bool() const       { return counts; }
+
+    algebraic_g xmin;
+    algebraic_g width;
+    size_t      count;
+    size_t      base;                   // Stack depth for bounds
+    uint32_t   *counts;
+    uint32_t    below;
+    uint32_t    above;
+    double      dmin;
+    double      dwidth;
+    bool        bounds;
+    bool        fast;
+};
+
+
+stats_bins::stats_bins(algebraic_r xmin, object_r width, size_t count)
+// ----------------------------------------------------------------------------
+//   Check the bins and allocate the counters
+// ----------------------------------------------------------------------------
+    : xmin(xmin), width(), count(count), base(rt.depth()), counts(nullptr),
+      below(0), above(0), dmin(0), dwidth(0), bounds(false), fast(false)
+{
+    if (list_p edges = width->as_array_or_list())
+    {
+        // Push the bounds in reverse order and check they are increasing
+        algebraic_g last = xmin;
+        algebraic_g edge;
+        size_t      n    = 0;
+        for (object_p obj : *edges)
+        {
+            if (!obj->is_real())
+            {
+                rt.type_error();
+                return;
+            }
+            edge = algebraic_p(obj);
+            int cmp = 0;
+            if (!comparison::compare(&cmp, last, edge))
+                return;
+            if (cmp >= 0)
+            {
+                rt.domain_error();
+                return;
+            }
+            last = edge;
+            n++;
+        }
+        if (n != count)
+        {
+            rt.dimension_error();
+            return;
+        }
+        for (size_t i = n; i --> 0; )
+            if (!rt.push(edges->at(i)))
+                return;
+        bounds = true;
+    }
+    else
+    {
+        if (!width->is_real())
+        {
+            rt.type_error();
+            return;
+        }
+        this->width = algebraic_p(+width);
+        if (this->width->is_negative(false) || this->width->is_zero(false))
+        {
+            rt.domain_error();
+            return;
+        }
+        fast = (fast_function::real_value(+xmin, dmin) &&
+                fast_function::real_value(+width, dwidth) &&
+                std::isfinite(dmin) && std::isfinite(dwidth) && dwidth > 0);
+    }
+
+    counts = (uint32_t *) calloc(count, sizeof(uint32_t));
+    if (!counts)
+        rt.out_of_memory_error();
+}
+
+
+stats_bins::~stats_bins()
+// ----------------------------------------------------------------------------
+//   Release the counters and the bounds
+// ----------------------------------------------------------------------------
+{
+    free(counts);
+    size_t now = rt.depth();
+    if (now > base)
+        rt.drop(now - base);
+}
+
+
+bool stats_bins::add(object_p value)
+// ----------------------------------------------------------------------------
+//   Count one value
+// ----------------------------------------------------------------------------
+{
+    if (!value || !value->is_real())
+    {
+        if (!rt.error())
+            rt.invalid_stats_data_error();
+        return false;
+    }
+
+    double dx = 0;
+    if (fast && fast_function::real_value(value, dx) && std::isfinite(dx))
+    {
+        double t      = (dx - dmin) / dwidth;
+        double margin = STATS_BINS_MARGIN
+                      * (1 + (fabs(dx) + fabs(dmin)) / dwidth);
+        if (t < -margin)
+        {
+            below++;
+            return true;
+        }
+        if (t >= double(count) + margin)
+        {
+            above++;
+            return true;
+        }
+        double f = ::floor(t);
+        if (f >= 0 && t - f > margin && f + 1 - t > margin)
+        {
+            counts[size_t(f)]++;
+            return true;
+        }
+    }
+
+    // Exact computation
+    algebraic_g x   = algebraic_p(value);
+    int         cmp = 0;
+    if (!comparison::compare(&cmp, x, xmin))
+        return false;
+    if (cmp < 0)
+    {
+        below++;
+        return true;
+    }
+
+    size_t index = count;
+    if (bounds)
+    {
+        // Find the first upper bound that is larger than x
+        size_t      lo = 0;
+        size_t      hi = count;
+        algebraic_g edge;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            edge = rt.stack(mid)->as_algebraic();
+            if (!edge || !comparison::compare(&cmp, x, edge))
+                return false;
+            if (cmp < 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        index = lo;
+    }
+    else
+    {
+        algebraic_g t = (x - xmin) / width;
+        t = floor::run(t);
+        if (!t)
+            return false;
+        algebraic_g n = integer::make(count);
+        if (!comparison::compare(&cmp, t, n))
+            return false;
+        if (cmp < 0)
+        {
+            index = t->as_uint32(0, true);
+            if (rt.error())
+                return false;
+        }
+    }
+
+    if (index < count)
+        counts[index]++;
+    else
+        above++;
+    return true;
+}
+
+
+bool stats_bins::scan(const StatsAccess &stats)
+// ----------------------------------------------------------------------------
+//   Count the values of the independent column in ΣData
+// ----------------------------------------------------------------------------
+{
+    size_t xcol = stats.xcol;
+    if (xcol < 1 || xcol > stats.columns)
+    {
+        rt.invalid_stats_parameters_error();
+        return false;
+    }
+    for (object_p row : *stats.data)
+    {
+        object_p item = row;
+        if (array_p ra = row->as<array>())
+            item = ra->at(xcol - 1);
+        if (!add(item))
+            return false;
+    }
+    return true;
+}
+
+
+bool stats_bins::stream(text_p name, size_t xcol)
+// ----------------------------------------------------------------------------
+//   Count the values of the independent column in a CSV file
+// ----------------------------------------------------------------------------
+//   Separators are recognized like in files::recall_list, but only the
+//   items of the independent column are parsed.
+{
+    files_g disk = files::make("data");
+    text_g  path = disk->filename(name);
+    if (!path)
+        return false;
+    file f(path, file::READING);
+    if (!f.valid())
+    {
+        if (!rt.error())
+            rt.error(f.error());
+        return false;
+    }
+
+    size_t col   = 1;
+    size_t bytes = 0;
+    uint   nonsp = 0;
+    uint   paren = 0;
+    uint   brack = 0;
+    uint   curly = 0;
+    bool   intxt = false;
+    bool   ineqn = false;
+    bool   seen  = false;
+    rt.clear();
+    for (unicode c = f.get(); ; c = f.get())
+    {
+        switch(c)
+        {
+        case '(':       paren++; break;
+        case ')':       paren--; break;
+        case '[':       brack++; break;
+        case ']':       brack--; break;
+        case '{':       curly++; break;
+        case '}':       curly--; break;
+        case '"':       intxt = !intxt; break;
+        case '\'':      ineqn = !ineqn; break;
+        }
+        bool sepok = !paren && !brack && !curly && !intxt && !ineqn;
+
+        if (!c || (sepok && (c == ',' || c == ';' || c == '\n')))
+        {
+            if (col == xcol && nonsp)
+            {
+                text_p parsed = rt.close_editor(true);
+                size_t len    = 0;
+                utf8   txt    = parsed ? parsed->value(&len) : nullptr;
+                object_p item = txt ? object::parse(txt, len) : nullptr;
+                rt.clear();
+                if (!add(item))
+                    return false;
+                seen = true;
+            }
+            if (c == ',' || c == ';')
+            {
+                col++;
+            }
+            else
+            {
+                // A non-empty row must have the independent column
+                if (!seen && (col > 1 || nonsp))
+                {
+                    rt.invalid_stats_data_error();
+                    return false;
+                }
+                col  = 1;
+                seen = false;
+            }
+            rt.clear();
+            bytes = 0;
+            nonsp = 0;
+            if (!c)
+                break;
+        }
+        else if (col == xcol)
+        {
+            if (!isspace(c))
+                nonsp++;
+            byte buffer[4];
+            size_t count = utf8_encode(c, buffer);
+            rt.insert(bytes, buffer, count);
+            bytes += count;
+        }
+    }
+    rt.clear();
+    return true;
+}
+
+
+bool stats_bins::push() const
+// ----------------------------------------------------------------------------
+//   Push the frequencies and the outliers
+// ----------------------------------------------------------------------------
+{
+    // Drop the bounds and the arguments
+    size_t now = rt.depth();
+    if (now > base)
+        rt.drop(now - base);
+    rt.drop(3);
+
+    for (size_t i = 0; i < count; i++)
+        if (!rt.push(integer::make(counts[i])))
+            return false;
+    if (!list::push_list_from_stack(count, object::ID_array))
+        return false;
+    if (!rt.push(integer::make(below)) || !rt.push(integer::make(above)))
+        return false;
+    return list::push_list_from_stack(2, object::ID_array) == object::OK;
+}
+
+
+static text_p stats_stream_file()
+// ----------------------------------------------------------------------------
+//   Return the CSV file ΣData refers to, if any
+// ----------------------------------------------------------------------------
+{
+    object_p obj = directory::recall_all(StatsData::Access::name(), false);
+    if (obj && obj->type() == object::ID_symbol)
+        obj = directory::recall_all(obj, false);
+    if (!obj || obj->type() != object::ID_text)
+        return nullptr;
+    size_t len = 0;
+    utf8   txt = text_p(obj)->value(&len);
+    if (len < 4 || strncasecmp(cstring(txt + len - 4), ".csv", 4) != 0)
+        return nullptr;
+    return text_p(obj);
+}
+
+
 // ============================================================================
 //
 //   User-level data analysis commands
@@ -1341,6 +2554,15 @@ COMMAND_BODY(Median)
 
 
 
+COMMAND_BODY(Percentile)
+// ----------------------------------------------------------------------------
+//  Find a percentile of the input data
+// ----------------------------------------------------------------------------
+{
+    return StatsAccess::evaluate(&StatsAccess::percentile, false);
+}
+
+
 COMMAND_BODY(MinData)
 // ----------------------------------------------------------------------------
 //  Find the minimum of all data
@@ -1478,11 +2700,45 @@ COMMAND_BODY(PopulationCovariance)
 
 COMMAND_BODY(FrequencyBins)
 // ----------------------------------------------------------------------------
-//  Compute frequency bits for the independent column in the data
+//  Compute frequency bins for the independent column in the data
 // ----------------------------------------------------------------------------
+//  Level 3 is the minimum, level 2 the bin width or a list of upper bounds,
+//  and level 1 the number of bins. This returns an array with the count for
+//  each bin and an array with the number of values below and above the bins.
 {
-    rt.unimplemented_error();
-    return ERROR;
+    algebraic_g xmin  = rt.stack(2)->as_real();
+    object_g    width = rt.stack(1);
+    uint32_t    count = rt.stack(0)->as_uint32(1, true);
+    if (rt.error())
+        return ERROR;
+    if (!xmin || !width)
+    {
+        rt.type_error();
+        return ERROR;
+    }
+    if (!count)
+    {
+        rt.domain_error();
+        return ERROR;
+    }
+
+    stats_bins bins(xmin, width, count);
+    if (!bins)
+        return ERROR;
+
+    if (text_g csv = stats_stream_file())
+    {
+        StatsParameters::Access parms;
+        if (!bins.stream(csv, parms.xcol))
+            return ERROR;
+    }
+    else
+    {
+        StatsAccess stats;
+        if (!stats || !bins.scan(stats))
+            return ERROR;
+    }
+    return bins.push() ? OK : ERROR;
 }
 
 
@@ -1620,6 +2876,7 @@ COMMAND_BODY(BestFit)
     StatsAccess stats;
     if (!stats)
         return ERROR;
+    stats.prepare_fits();
 
     algebraic_g best_correlation, correlation, test;
     algebraic_g best_slope, best_intercept;
@@ -1717,8 +2974,13 @@ COMMAND_BODY(LogarithmicFit)
 
 RECORDER(acorn, 16, "Additive congruential random number generator (ACORN)");
 
-static bignum_g        *acorn       = nullptr;
+//   The ACORN state is kept in machine words, acorn_words per entry, in
+//   little-endian order. This computes the same sequence as additions of
+//   based bignums truncated to RandomGeneratorBits, without allocating.
+
+static ularge          *acorn       = nullptr;
 static size_t           acorn_order = 0;
+static size_t           acorn_words = 0;
 
 
 static void random_seed(ularge seed)
@@ -1733,9 +2995,10 @@ static void random_seed(ularge seed)
     if (~seed & 1)
         seed = ~seed;
 
+    memset(acorn, 0, acorn_order * acorn_words * sizeof(ularge));
     for (size_t i = 0; i < acorn_order; i++)
     {
-        acorn[i] = rt.make<based_bignum>(seed);
+        acorn[i * acorn_words] = seed;
         record(acorn, "  [%u] = %lu", i, seed);
         seed *= 0x1081 + (i << 13);
     }
@@ -1747,6 +3010,29 @@ static void random_init()
 //   Initialization of the random number generator data
 // ----------------------------------------------------------------------------
 {
+    size_t words = (Settings.RandomGeneratorBits() + 63) / 64;
+    if (acorn && acorn_order == Settings.RandomGeneratorOrder() &&
+        acorn_words != words)
+    {
+        // Entries are below 2^bits, so we can keep the low words of each
+        record(acorn, "Resizing entries from %u to %u words",
+               acorn_words, words);
+        ularge *resized = (ularge *) calloc(acorn_order * words,
+                                            sizeof(ularge));
+        if (!resized)
+        {
+            rt.out_of_memory_error();
+            return;
+        }
+        size_t keep = std::min(words, acorn_words);
+        for (size_t i = 0; i < acorn_order; i++)
+            memcpy(resized + i * words, acorn + i * acorn_words,
+                   keep * sizeof(ularge));
+        free(acorn);
+        acorn = resized;
+        acorn_words = words;
+    }
+
     if (!acorn || acorn_order != Settings.RandomGeneratorOrder())
     {
         record(acorn, "Initializing from %p order %u to %u",
@@ -1755,13 +3041,9 @@ static void random_init()
         ularge seed;
         if (acorn)
         {
-            seed = acorn[0]->value<ularge>();
+            seed = acorn[0];
             record(acorn, "Freeing %p size %u, seed %lu",
                    acorn, acorn_order, seed);
-
-            // No operator new[] nor operator delete[] in embedded runtime
-            for (size_t i = acorn_order; i --> 0; )
-                (acorn + i)->~bignum_g();
             free(acorn);
             acorn = nullptr;
         }
@@ -1771,9 +3053,9 @@ static void random_init()
             record(acorn, "Initialize with random seed %lu", seed);
         }
         acorn_order = Settings.RandomGeneratorOrder();
+        acorn_words = words;
 
-        // No operator new[] nor operator delete[] in embedded runtime
-        acorn = (bignum_g *) calloc(acorn_order, sizeof(bignum_g));
+        acorn = (ularge *) calloc(acorn_order * acorn_words, sizeof(ularge));
         record(acorn, "Allocated %p size %u", acorn, acorn_order);
         if (!acorn)
         {
@@ -1782,10 +3064,6 @@ static void random_init()
         }
         else
         {
-            // Initialize the smart pointers
-            for (size_t i = 0; i < acorn_order; i++)
-                new(acorn + i) bignum_g;
-
             // Populate the original seed
             random_seed(seed);
         }
@@ -1797,19 +3075,36 @@ algebraic_p random_number()
 // ----------------------------------------------------------------------------
 //   Compute a random number between 0 and 1 using ACORN algorithm
 // ----------------------------------------------------------------------------
-//   This is computed using the current wordsize
+//   This is computed using RandomGeneratorBits
 {
     random_init();
+    if (!acorn || acorn_order < 2)
+        return nullptr;
 
-    // Compute the next iteration for ACORN
-    settings::SaveWordSize sws(Settings.RandomGeneratorBits());
-    bignum_p last = nullptr;
+    // Compute the next iteration for ACORN, modulo 2^bits
+    uint   bits  = Settings.RandomGeneratorBits();
+    size_t words = acorn_words;
+    ularge mask  = bits % 64 ? (1ULL << (bits % 64)) - 1 : ~0ULL;
     for (size_t k = 1; k < acorn_order; k++)
-        last = acorn[k] = acorn[k] + acorn[k-1];
+    {
+        ularge       *dst   = acorn + k * words;
+        const ularge *src   = dst - words;
+        ularge        carry = 0;
+        for (size_t w = 0; w < words; w++)
+        {
+            ularge sum = dst[w] + carry;
+            carry = sum < carry;
+            sum += src[w];
+            carry += sum < src[w];
+            dst[w] = sum;
+        }
+        dst[words - 1] &= mask;
+    }
 
     // Now generate a decimal between 0 and 1 with it
-    decimal_p result = decimal::from_random_seed(last);
-    record(acorn, "Random number %t decimal %t", last, result);
+    const ularge *last   = acorn + (acorn_order - 1) * words;
+    decimal_p     result = decimal::from_random_seed(last, words);
+    record(acorn, "Random number %lu decimal %t", last[0], result);
     return result;
 }
 
@@ -96,6 +96,9 @@ struct StatsData : command
 };
 
 
+struct StatsAccumulators;
+struct StatsFitSums;
+
 struct StatsAccess : StatsParameters::Access, StatsData::Access
 // ----------------------------------------------------------------------------
 //   Access to stats for processing operations
@@ -111,6 +114,9 @@ struct StatsAccess : StatsParameters::Access, StatsData::Access
     algebraic_p         sum(sum_fn op, uint xcol) const;
     algebraic_p         sum(sxy_fn op, uint xcol, uint ycol) const;
     algebraic_p         fit_transform(algebraic_r x, uint scol) const;
+    const StatsAccumulators *accumulators() const;
+    const StatsFitSums      *pair_accumulators() const;
+    void                     prepare_fits() const;
 
     algebraic_p         num_rows() const;
     algebraic_p         sum_x() const;
@@ -124,6 +130,8 @@ struct StatsAccess : StatsParameters::Access, StatsData::Access
     algebraic_p         max() const;
     algebraic_p         average() const;
     algebraic_p         median() const;
+    algebraic_p         percentile() const;
+    algebraic_p         quantile(algebraic_r percent) const;
     algebraic_p         variance() const;
     algebraic_p         standard_deviation() const;
     algebraic_p         correlation() const;
@@ -173,6 +181,7 @@ COMMAND_DECLARE(ClearData,0);
 COMMAND_DECLARE(DataSize,0);
 COMMAND_DECLARE(Average,0);
 COMMAND_DECLARE(Median,0);
+COMMAND_DECLARE(Percentile,1);
 COMMAND_DECLARE(MinData,0);
 COMMAND_DECLARE(MaxData,0);
 COMMAND_DECLARE(SumOfX,0);
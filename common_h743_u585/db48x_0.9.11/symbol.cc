@@ -60,7 +60,7 @@ EVAL_BODY(symbol)
                 if (rt.push(u))
                     return OK;
         }
-        else if (object_p found = directory::recall_all(o, false))
+        else if (object_p found = directory::recall_resolved(o))
         {
             return program::run_program(found);
         }
@@ -158,16 +158,146 @@ bool symbol::store(object_g value) const
 }
 
 
+// ============================================================================
+//
+//   Interned names
+//
+// ============================================================================
+//   Each distinct name gets a small ID, the index of its entry in a table
+//   that holds a copy of the name. Symbols in global objects, i.e. names in
+//   directories and in stored programs, cache their ID in a side table keyed
+//   by address, valid until global objects move. Comparing two such symbols
+//   is then comparing IDs. Names are case-folded if IgnoreSymbolCase is set,
+//   and the table starts over when that setting changes or when it is full.
+
+enum
+{
+    INTERN_NAMES        = 512,          // Distinct names (power of 2)
+    INTERN_POOL         = 4096,         // Bytes for the copies of names
+    INTERN_CACHE        = 256,          // Cached symbol IDs (power of 2)
+};
+
+struct interned_name
+// ----------------------------------------------------------------------------
+//   A distinct name in the intern table
+// ----------------------------------------------------------------------------
+{
+    uint        hash;
+    uint16_t    offset;                 // Offset of the name in intern_pool
+    uint16_t    length;                 // Zero for a free entry
+};
+
+struct interned_symbol
+// ----------------------------------------------------------------------------
+//   The ID of a symbol in a global object
+// ----------------------------------------------------------------------------
+{
+    object_p    symbol;
+    uint        generation;             // Directory generation when cached
+    uint        epoch;                  // Intern table epoch when cached
+    uint        id;
+};
+
+static interned_name   intern_names[INTERN_NAMES];
+static char            intern_pool[INTERN_POOL];
+static uint            intern_used   = 0;
+static uint            intern_count  = 0;
+static uint            intern_epoch  = 1;
+static bool            intern_folded = false;
+static interned_symbol intern_cache[INTERN_CACHE];
+
+
+static uint intern_name(utf8 txt, size_t len)
+// ----------------------------------------------------------------------------
+//   Return the ID for a name, adding it to the table if necessary
+// ----------------------------------------------------------------------------
+{
+    bool folded = Settings.IgnoreSymbolCase();
+    if (folded != intern_folded ||
+        intern_count >= INTERN_NAMES * 3 / 4 ||
+        intern_used + len > INTERN_POOL)
+    {
+        if (len > INTERN_POOL / 8)
+            return 0;
+        memset(intern_names, 0, sizeof(intern_names));
+        intern_used = 0;
+        intern_count = 0;
+        intern_folded = folded;
+        intern_epoch++;
+    }
+
+    uint hash = 2166136261U;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (folded ? tolower(txt[i]) : txt[i])) * 16777619U;
+
+    uint mask = INTERN_NAMES - 1;
+    uint i    = hash & mask;
+    for (; intern_names[i].length; i = (i + 1) & mask)
+    {
+        interned_name &n = intern_names[i];
+        if (n.hash == hash && n.length == len &&
+            symbol::compare(utf8(intern_pool + n.offset), txt, len) == 0)
+            return i + 1;
+    }
+
+    interned_name &n = intern_names[i];
+    n.hash = hash;
+    n.offset = intern_used;
+    n.length = len;
+    memcpy(intern_pool + intern_used, txt, len);
+    intern_used += len;
+    intern_count++;
+    return i + 1;
+}
+
+
+uint symbol::interned() const
+// ----------------------------------------------------------------------------
+//   Return the interned ID for a symbol in a global object, 0 if none
+// ----------------------------------------------------------------------------
+{
+    if (!rt.is_global(this))
+        return 0;
+
+    uintptr_t        key   = uintptr_t(this);
+    interned_symbol &entry = intern_cache[(key ^ (key >> 7)) & (INTERN_CACHE-1)];
+    uint             gen   = directory::generation;
+    if (entry.symbol == this && entry.generation == gen &&
+        entry.epoch == intern_epoch &&
+        intern_folded == Settings.IgnoreSymbolCase())
+        return entry.id;
+
+    size_t sz  = 0;
+    utf8   txt = value(&sz);
+    uint   id  = intern_name(txt, sz);
+    if (id)
+    {
+        entry.symbol = this;
+        entry.generation = gen;
+        entry.epoch = intern_epoch;
+        entry.id = id;
+    }
+    return id;
+}
+
+
 bool symbol::is_same_as(symbol_p other) const
 // ----------------------------------------------------------------------------
 //   Return true of two symbols represent the same thing
 // ----------------------------------------------------------------------------
 {
+    if (this == other)
+        return true;
     size_t sz, osz;
     utf8 txt = value(&sz);
     utf8 otxt = other->value(&osz);
     if (sz != osz)
         return false;
+    uint id    = interned();
+    uint epoch = intern_epoch;
+    uint oid   = id ? other->interned() : 0;
+    if (oid && epoch == intern_epoch)         // Table did not start over
+        return id == oid;
     return compare(txt, otxt, sz) == 0;
 }
 
@@ -74,6 +74,7 @@ struct symbol : text
     object_p recall(bool noerror = true) const;
     bool     store(object_g obj) const;
     bool     is_same_as(symbol_p other) const;
+    uint     interned() const;
 
     bool     matches(cstring name) const
     {
@@ -157,6 +157,7 @@ TESTS(probabilities,    "Probabilities");
 TESTS(sumprod,          "Sums and products");
 TESTS(poly,             "Polynomials");
 TESTS(quorem,           "Quotient and remainder");
+TESTS(bignums,          "Big integer algorithms");
 TESTS(expr,             "Operations on expressions");
 TESTS(random,           "Random number generation");
 TESTS(library,          "Library entries");
@@ -275,6 +276,7 @@ void tests::run(uint onlyCurrent)
         sum_and_product();
         polynomials();
         quotient_and_remainder();
+        big_integer_algorithms();
         expression_operations();
         random_number_generation();
         object_structure();
@@ -12146,6 +12148,108 @@ void tests::quotient_and_remainder()
 }
 
 
+void tests::big_integer_algorithms()
+// ----------------------------------------------------------------------------
+//   Division, decimal conversion, GCD and modular arithmetic on big integers
+// ----------------------------------------------------------------------------
+{
+    BEGIN(bignums);
+
+    step("Decimal conversion of a multi-limb integer")
+        .test(CLEAR,
+              "123456789012345678901234567890"
+              "123456789012345678901234567890 1 +", ENTER)
+        .expect("123 456 789 012 345 678 901 234 567 890 "
+                "123 456 789 012 345 678 901 234 567 891");
+
+    step("Division with a multi-limb divisor")
+        .test(CLEAR, "10 40 ^ 7 + 10 20 ^ 3 + IDIV2", ENTER)
+        .expect("R:16")
+        .test(BSP)
+        .expect("Q:99 999 999 999 999 999 997");
+    step("Division with a large remainder")
+        .test(CLEAR, "2 200 ^ 3 50 ^ IDIV2", ENTER)
+        .expect("R:249 667 313 308 346 329 176 559")
+        .test(BSP)
+        .expect("Q:2 238 393 297 946 874 000 179 418 290 327 143 433");
+    step("Exact division of multi-limb integers")
+        .test(CLEAR, "2 128 ^ 1 - 2 64 ^ 1 + IDIV2", ENTER)
+        .expect("R:0")
+        .test(BSP)
+        .expect("Q:18 446 744 073 709 551 615");
+
+    step("Fraction reduced by a multi-limb GCD")
+        .test(CLEAR, "2 70 ^ 3 * 2 69 ^ 9 * /", ENTER)
+        .expect("²/₃");
+    step("Fraction with a GCD larger than 64 bits")
+        .test(CLEAR, "3 50 ^ 7 * 3 50 ^ 11 * /", ENTER)
+        .expect("⁷/₁₁");
+
+    step("PowMod with an odd modulus")
+        .test(CLEAR, "2 100 1000000007 PowMod", ENTER)
+        .expect("976 371 285");
+    step("PowMod with an even modulus")
+        .test(CLEAR, "3 200 2 64 ^ PowMod", ENTER)
+        .expect("6 627 890 308 811 632 801");
+    step("PowMod with a multi-limb odd modulus")
+        .test(CLEAR, "5 117 2 89 ^ 1 - PowMod", ENTER)
+        .expect("498 886 828 433 761 650 252 165 339");
+    step("PowMod with a zero exponent")
+        .test(CLEAR, "7 0 2 PowMod", ENTER)
+        .expect("1");
+    step("PowMod with modulus 1")
+        .test(CLEAR, "7 0 1 PowMod", ENTER)
+        .expect("0")
+        .test(CLEAR, "7 5 1 PowMod", ENTER)
+        .expect("0");
+    step("PowMod with a negative base")
+        .test(CLEAR, "-2 3 7 PowMod", ENTER)
+        .expect("6")
+        .test(CLEAR, "-5 3 12 PowMod", ENTER)
+        .expect("7");
+    step("PowMod with a negative modulus")
+        .test(CLEAR, "3 4 -7 PowMod", ENTER)
+        .expect("4");
+    step("PowMod with a negative exponent")
+        .test(CLEAR, "3 -1 7 PowMod", ENTER)
+        .expect("5")
+        .test(CLEAR, "2 -1 1000000007 PowMod", ENTER)
+        .expect("500 000 004");
+    step("PowMod with a negative exponent and no inverse")
+        .test(CLEAR, "6 -1 9 PowMod", ENTER)
+        .error("Bad argument value");
+    step("PowMod with a zero modulus")
+        .test(CLEAR, "2 3 0 PowMod", ENTER)
+        .error("Divide by zero");
+    step("PowMod with a non-integer argument")
+        .test(CLEAR, "2.5 3 7 PowMod", ENTER)
+        .error("Bad argument type");
+
+    step("ModInv")
+        .test(CLEAR, "3 7 ModInv", ENTER)
+        .expect("5")
+        .test(CLEAR, "17 3120 ModInv", ENTER)
+        .expect("2 753");
+    step("ModInv with a multi-limb modulus")
+        .test(CLEAR, "12345678901234567890 2 89 ^ 1 - ModInv", ENTER)
+        .expect("338 604 421 359 886 006 294 785 622");
+    step("ModInv with a negative operand")
+        .test(CLEAR, "-3 7 ModInv", ENTER)
+        .expect("2");
+    step("ModInv with modulus 1")
+        .test(CLEAR, "5 1 ModInv", ENTER)
+        .expect("0");
+    step("ModInv of a value that is not invertible")
+        .test(CLEAR, "6 9 ModInv", ENTER)
+        .error("Bad argument value")
+        .test(CLEAR, "0 7 ModInv", ENTER)
+        .error("Bad argument value");
+    step("ModInv with a zero modulus")
+        .test(CLEAR, "3 0 ModInv", ENTER)
+        .error("Divide by zero");
+}
+
+
 void tests::expression_operations()
 // ----------------------------------------------------------------------------
 //   Operations on expressions
@@ -135,6 +135,7 @@ struct tests
     void sum_and_product();
     void polynomials();
     void quotient_and_remainder();
+    void big_integer_algorithms();
     void expression_operations();
     void random_number_generation();
     void object_structure();
@@ -129,15 +129,9 @@ text_g operator+(text_r x, text_r y)
         return x;
     object::id type = x->type();
     size_t sx = 0, sy = 0;
-    utf8 tx = x->value(&sx);
-    utf8 ty = y->value(&sy);
-    text_g concat = rt.make<text>(type, tx, sx + sy);
-    if (concat)
-    {
-        utf8 tc = concat->value();
-        memcpy((byte *) tc + sx, (byte *) ty, sy);
-    }
-    return concat;
+    gcutf8 tx = x->value(&sx);
+    gcutf8 ty = y->value(&sy);
+    return rt.make<text>(type, tx, sx, ty, sy);
 }
 
 
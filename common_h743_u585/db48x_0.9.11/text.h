@@ -75,11 +75,27 @@ struct text : algebraic
         }
     }
 
+    text(id type, gcutf8 first, size_t flen, gcutf8 second, size_t slen)
+        : algebraic(type)
+    {
+        byte *p = (byte *) payload();
+        p = leb128(p, flen + slen);
+        memcpy(p, (utf8) first, flen);
+        memcpy(p + flen, (utf8) second, slen);
+    }
+
     static size_t required_memory(id i, gcutf8 UNUSED str, size_t len)
     {
         return leb128size(i) + leb128size(len) + len;
     }
 
+    static size_t required_memory(id i,
+                                  gcutf8 UNUSED first, size_t flen,
+                                  gcutf8 UNUSED second, size_t slen)
+    {
+        return leb128size(i) + leb128size(flen + slen) + flen + slen;
+    }
+
     static size_t required_memory(id i, gcutf8 UNUSED str,
                                   size_t len, size_t quotes)
     {
@@ -56,6 +56,16 @@ typedef unsigned           unicode;
 #define INLINE  __attribute__((always_inline))
 #define NOINLINE  __attribute__((noinline))
 
+// Functions run from ITCM on the DBh743, see USE_ITCM_CODE
+#if USE_ITCM_CODE
+#define HOT  __attribute__((section(".ITCM_CODE"), noinline))
+#else
+#define HOT
+#endif // USE_ITCM_CODE
+
+// Functions run once, e.g. at boot, grouped away from the evaluator code
+#define COLD __attribute__((cold, noinline))
+
 template <typename value_type>
 struct save
 // ----------------------------------------------------------------------------
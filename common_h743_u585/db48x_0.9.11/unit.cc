@@ -1020,6 +1020,75 @@ bool unit::convert(algebraic_g &x, bool error) const
 }
 
 
+#ifndef UNIT_FACTOR_CACHE
+#define UNIT_FACTOR_CACHE       8
+#endif
+
+struct unit_factor
+// ----------------------------------------------------------------------------
+//   A cached linear conversion factor between two unit expressions
+// ----------------------------------------------------------------------------
+{
+    algebraic_g to;             // Destination unit expression
+    algebraic_g from;           // Source unit expression
+    algebraic_g factor;         // Real factor, from = factor * to
+    uint        used;           // Last use, for least-recently-used eviction
+};
+
+
+static unit_factor *unit_factor_find(algebraic_r to, algebraic_r from,
+                                     bool create)
+// ----------------------------------------------------------------------------
+//   Find the conversion factor entry between two unit expressions
+// ----------------------------------------------------------------------------
+//   Converting repeatedly between the same units (e.g. when logging data in
+//   mixed units) would otherwise look up the base units and re-derive the
+//   factor symbolically every time. Non-linear conversions like °C to °F
+//   depend on the value, and are never cached.
+//   The factors depend on the settings and on the unit definitions, which
+//   may be loaded from disk, so the cache is flushed when either changes.
+{
+    static unit_factor unit_factors[UNIT_FACTOR_CACHE];
+    static uint        settings   = 0;
+    static uint        generation = 0;
+    static uint        clock      = 0;
+    uint               set        = Settings.hash();
+    uint               gen        = file::generation();
+    if (set != settings || gen != generation)
+    {
+        record(units, "Settings or files changed, flushing conversion factors");
+        for (uint i = 0; i < UNIT_FACTOR_CACHE; i++)
+            unit_factors[i] = unit_factor();
+        settings = set;
+        generation = gen;
+    }
+
+    uint oldest = 0;
+    for (uint i = 0; i < UNIT_FACTOR_CACHE; i++)
+    {
+        unit_factor &e = unit_factors[i];
+        if (e.to && e.from &&
+            to->is_same_as(+e.to) && from->is_same_as(+e.from))
+        {
+            e.used = ++clock;
+            return &e;
+        }
+        if (e.used < unit_factors[oldest].used)
+            oldest = i;
+    }
+    if (!create)
+        return nullptr;
+
+    // Keys are copied, since the objects they point to may change in place
+    unit_factor &e = unit_factors[oldest];
+    e.to = algebraic_p(rt.clone(+to));
+    e.from = algebraic_p(rt.clone(+from));
+    e.factor = nullptr;
+    e.used = ++clock;
+    return &e;
+}
+
+
 bool unit::convert(unit_g &x, bool error) const
 // ----------------------------------------------------------------------------
 //   Convert a unit object to the current unit
@@ -1041,7 +1110,24 @@ bool unit::convert(unit_g &x, bool error) const
 
     if (!unit::mode)
     {
-        save<bool> sumode(unit::mode, true);
+        // Check if we already know the factor between these units
+        if (unit_factor *cached = unit_factor_find(u, o, false))
+        {
+            record(units, "Cached factor %t from %t to %t",
+                   +cached->factor, +o, +u);
+            algebraic_g v = x->value();
+            algebraic_g f = cached->factor;
+            {
+                settings::SaveAutoSimplify sas(false);
+                v = v * f;
+            }
+            x = unit_p(unit::simple(v, svu));
+            return true;
+        }
+
+        save<bool>  sumode(unit::mode, true);
+        algebraic_g svo    = o;
+        bool        linear = true;
 
         // Evaluate the unit expression for this one
         u = u->evaluate();
@@ -1075,6 +1161,7 @@ bool unit::convert(unit_g &x, bool error) const
                     return false;
                 x = unit_p(unit::simple(o, ounit));
                 o = unit::simple(integer::make(1), ounit);
+                linear = false;
             }
         }
         // If the expression is in the destination
@@ -1117,6 +1204,7 @@ bool unit::convert(unit_g &x, bool error) const
                     udef = ue->evaluate();
                     x = unit_p(unit::simple(udef, +xname));
                     u = unit::simple(integer::make(1), +tname);
+                    linear = false;
                 }
             }
         }
@@ -1149,6 +1237,10 @@ bool unit::convert(unit_g &x, bool error) const
             return false;
         }
 
+        if (linear)
+            if (unit_factor *entry = unit_factor_find(svu, svo, true))
+                entry->factor = o;
+
         algebraic_g v = x->value();
         {
             settings::SaveAutoSimplify sas(false);
@@ -1469,7 +1561,18 @@ symbol_p unit_file::lookup(gcutf8 what, size_t len, bool menu, bool seek0)
 
     def = nullptr;
     if (seek0)
-        seek(0);
+    {
+        // Go directly to the first row that may match
+        uint row = 0;
+        uint reject = menu ? 0 : INDEX_HIDDEN;
+        uint want = menu ? INDEX_MENU : 0;
+        if (!indexed())
+            seek(0);
+        else if (index_find(what, len, want, reject, row))
+            seek(row);
+        else
+            return nullptr;
+    }
     while (valid())
     {
         byte c = getchar();
@@ -1612,6 +1715,263 @@ symbol_p unit_file::next(bool menu)
 
 
 
+// ============================================================================
+//
+//   Index of the rows in unit files
+//
+// ============================================================================
+//   Each file is scanned once to record a hash of the first column of each
+//   row with the position of the row, sorted by hash. The index is rebuilt
+//   when the size or modification time of the file changes.
+
+struct unit_file_entry
+// ----------------------------------------------------------------------------
+//   An entry in the index
+// ----------------------------------------------------------------------------
+{
+    uint32_t    key;            // Hash of the first column
+    uint32_t    position;       // Position of the row in the file
+    uint16_t    ordinal;        // Index among definitions after first menu
+    uint16_t    flags;          // Kind of row
+};
+
+
+struct unit_file::index
+// ----------------------------------------------------------------------------
+//   The index for one file
+// ----------------------------------------------------------------------------
+{
+    cstring     name;           // File name
+    uint        size;           // File size when indexed
+    uint        stamp;          // File modification time when indexed
+    uint        first;          // First entry in the pool
+    uint        count;          // Number of entries
+    uint        definitions;    // Number of definitions after first menu
+};
+
+static unit_file_entry   unit_file_entries[UNIT_FILE_INDEX_ENTRIES];
+static unit_file::index  unit_file_indexes[UNIT_FILE_INDEXES];
+static uint              unit_file_used = 0; // Entries used in pool
+
+
+static uint32_t unit_file_key(utf8 name, size_t len)
+// ----------------------------------------------------------------------------
+//   Hash the first column of a row
+// ----------------------------------------------------------------------------
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ name[i]) * 16777619u;
+    return hash;
+}
+
+
+static int unit_file_compare(const unit_file_entry *a,
+                             const unit_file_entry *b)
+// ----------------------------------------------------------------------------
+//   Sort entries by key, then by position in the file
+// ----------------------------------------------------------------------------
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    return a->position < b->position ? -1 : a->position > b->position;
+}
+
+
+unit_file::index *unit_file::indexed()
+// ----------------------------------------------------------------------------
+//   Return an up-to-date index for the file, or nullptr if none
+// ----------------------------------------------------------------------------
+{
+    if (!valid() || !name)
+        return nullptr;
+
+    // The host changed the disk: file stamps may not show it, drop all
+    static uint generation = 0;
+    if (generation != file::generation())
+    {
+        for (index &i : unit_file_indexes)
+            i.name = nullptr;
+        unit_file_used = 0;
+        generation = file::generation();
+    }
+
+    uint   size  = this->size();
+    uint   stamp = modified();
+    index *idx   = nullptr;
+    index *free  = nullptr;
+    for (index &i : unit_file_indexes)
+    {
+        if (!i.name)
+        {
+            if (!free)
+                free = &i;
+        }
+        else if (strcmp(i.name, name) == 0)
+        {
+            idx = &i;
+            break;
+        }
+    }
+
+    if (idx)
+    {
+        if (idx->size == size && idx->stamp == stamp)
+            return idx->count || !size ? idx : nullptr;
+
+        // The file changed: drop all indexes, they share the pool
+        for (index &i : unit_file_indexes)
+            i.name = nullptr;
+        unit_file_used = 0;
+        idx = &unit_file_indexes[0];
+    }
+    else if (free)
+    {
+        idx = free;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    // Scan the file, recording rows
+    idx->name        = name;
+    idx->size        = size;
+    idx->stamp       = stamp;
+    idx->first       = unit_file_used;
+    idx->count       = 0;
+    idx->definitions = 0;
+
+    uint     column  = 0;
+    bool     quoted  = false;
+    bool     hidden  = false;
+    bool     menus   = false;
+    bool     ok      = true;
+    uint     row     = 0;
+    uint32_t key     = 2166136261u;
+    bool     eqfirst = false;
+    size_t   chars   = 0;
+
+    seek(0);
+    while (ok)
+    {
+        char c = getchar();
+        if (c == '"')
+        {
+            quoted = !quoted;
+            if (!quoted)
+                column++;
+        }
+        else if (c == '\n' || !c)
+        {
+            if (column)
+            {
+                unit_file_entry e = { key, row, 0xFFFF, 0 };
+                if (column == 1)
+                {
+                    e.flags = INDEX_MENU;
+                    hidden = eqfirst;
+                    menus = true;
+                }
+                else
+                {
+                    if (hidden)
+                        e.flags |= INDEX_HIDDEN;
+                    if (menus)
+                    {
+                        e.flags |= INDEX_DEFINITION;
+                        e.ordinal = idx->definitions++;
+                    }
+                }
+                if (unit_file_used >= UNIT_FILE_INDEX_ENTRIES ||
+                    idx->definitions >= 0xFFFF)
+                    ok = false;
+                else
+                    unit_file_entries[unit_file_used++] = e;
+            }
+            if (!c)
+                break;
+            column  = 0;
+            key     = 2166136261u;
+            chars   = 0;
+            eqfirst = false;
+            row     = position();
+        }
+        else if (quoted && column == 0)
+        {
+            if (!chars++)
+                eqfirst = c == '=';
+            key = (key ^ byte(c)) * 16777619u;
+        }
+    }
+    seek(0);
+
+    if (!ok)
+    {
+        // Does not fit, do not retry until the file changes
+        unit_file_used = idx->first;
+        idx->count = 0;
+        return nullptr;
+    }
+
+    idx->count = unit_file_used - idx->first;
+    typedef int (*qsort_fn)(const void *, const void*);
+    qsort(unit_file_entries + idx->first, idx->count, sizeof(unit_file_entry),
+          qsort_fn(unit_file_compare));
+    record(units, "Indexed %s, %u rows", name, idx->count);
+    return idx;
+}
+
+
+bool unit_file::index_find(utf8 what, size_t len, uint want, uint reject,
+                           uint &from, uint *ordinal)
+// ----------------------------------------------------------------------------
+//   Find the first row at or after 'from' with given name and flags
+// ----------------------------------------------------------------------------
+//   Since two names may have the same hash, the caller must check the row
+{
+    index *idx = indexed();
+    if (!idx)
+        return false;
+
+    uint32_t         key = unit_file_key(what, len);
+    unit_file_entry *e   = unit_file_entries + idx->first;
+    uint             lo  = 0;
+    uint             hi  = idx->count;
+    while (lo < hi)
+    {
+        uint mid = (lo + hi) / 2;
+        if (e[mid].key < key ||
+            (e[mid].key == key && e[mid].position < from))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < idx->count && e[lo].key == key; lo++)
+    {
+        if ((e[lo].flags & want) == want && !(e[lo].flags & reject))
+        {
+            from = e[lo].position;
+            if (ordinal)
+                *ordinal = e[lo].ordinal;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+uint unit_file::index_definitions()
+// ----------------------------------------------------------------------------
+//   Number of definitions after the first menu, ~0U if there is no index
+// ----------------------------------------------------------------------------
+{
+    index *idx = indexed();
+    return idx ? idx->definitions : ~0U;
+}
+
+
+
 // ============================================================================
 //
 //   Build a units menu
@@ -113,6 +113,22 @@ struct unit_file : file
 
     symbol_p    lookup(gcutf8 what,size_t len,bool menu=false,bool seek0=true);
     symbol_p    next(bool menu = false);
+
+    // Index of the rows in the file, built when the file changes
+    enum index_flags
+    {
+        INDEX_MENU       = 1,   // Row is a menu (single column)
+        INDEX_HIDDEN     = 2,   // Definition in a menu beginning with '='
+        INDEX_DEFINITION = 4,   // Definition after the first menu
+    };
+    bool        index_find(utf8 what, size_t len, uint want, uint reject,
+                           uint &from, uint *ordinal = nullptr);
+    uint        index_definitions();
+
+    struct index;
+
+protected:
+    index *     indexed();
 };
 
 
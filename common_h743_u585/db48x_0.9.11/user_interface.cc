@@ -34,6 +34,7 @@
 #include "characters.h"
 #include "command.h"
 #include "custom.h"
+#include "datetime.h"
 #include "dmcp.h"
 #include "expression.h"
 #include "files.h"
@@ -78,6 +79,7 @@ RECORDER(tests_ui,      16, "Test interaction with user interface");
 RECORDER(keymap_warning, 8, "Warnings about invalid keymaps");
 
 #define NUM_TOPICS      (sizeof(topics) / sizeof(topics[0]))
+#define NUM_PAGES       (sizeof(pageStart) / sizeof(pageStart[0]))
 
 
 user_interface::user_interface()
@@ -91,6 +93,9 @@ user_interface::user_interface()
       topic(0),
       topicsHistory(0),
       topics(),
+      pagesHistory(0),
+      pageStart(),
+      pageLines(),
       image(nullptr),
       impos(0),
       cursor(0),
@@ -106,6 +111,12 @@ user_interface::user_interface()
       edRows(0),
       edRow(0),
       edColumn(0),
+      edDisplay(0),
+      edLineStart(0),
+      edSkip(0),
+      edTop(0),
+      edY(0),
+      edXoffset(0),
       menuStack(),
       pageStack(),
       menuPage(),
@@ -145,6 +156,7 @@ user_interface::user_interface()
       dirtyMenu(false),
       dirtyStack(false),
       dirtyCommand(false),
+      edDrawn(false),
       dirtyHelp(false),
       autoComplete(false),
       adjustSeps(false),
@@ -152,6 +164,8 @@ user_interface::user_interface()
       doubleRelease(false),
       batteryLow(false),
       keymap(),
+      keymapIndex(),
+      keymapIndexed(false),
       helpfile(),
       validate_input()
 {
@@ -511,6 +525,141 @@ void user_interface::clear_editor()
 }
 
 
+// ============================================================================
+//
+//   Command-line history ring
+//
+// ============================================================================
+//   Command-line history is kept outside of object memory, so that it does
+//   not pin memory or get moved by every garbage collection. Entries are
+//   appended to a ring buffer, and overwriting the oldest bytes drops the
+//   history entries that used them. Entries larger than EDITOR_RING_MAX are
+//   not kept. The ring can live in a memory bank that is not cleared on a
+//   soft reset, in which case the history survives it.
+
+#ifndef EDITOR_RING_SIZE
+// Size of the buffer holding command-line history
+#define EDITOR_RING_SIZE        (1024*8)
+#endif // EDITOR_RING_SIZE
+
+#ifndef EDITOR_RING_MAX
+// Largest command line kept in history
+#define EDITOR_RING_MAX         (EDITOR_RING_SIZE / 4)
+#endif // EDITOR_RING_MAX
+
+#define EDITOR_RING_MAGIC       0xED17C0DE
+
+struct editor_ring
+// ----------------------------------------------------------------------------
+//   Ring buffer and index of the command-line history
+// ----------------------------------------------------------------------------
+{
+    uint32_t magic;                             // EDITOR_RING_MAGIC
+    uint32_t head;                              // Next offset to write
+    uint32_t offset[user_interface::HISTORY];   // Start of each entry
+    uint32_t length[user_interface::HISTORY];   // Length, 0 if empty
+    byte     data[EDITOR_RING_SIZE];
+};
+
+#ifdef EDITOR_RING_SECTION
+static editor_ring __attribute__((section(EDITOR_RING_SECTION), aligned(32)))
+                   editor_history_ring;
+#else // !EDITOR_RING_SECTION
+static editor_ring editor_history_ring;
+#endif // EDITOR_RING_SECTION
+
+
+static editor_ring &editor_ring_check()
+// ----------------------------------------------------------------------------
+//   Return the ring, resetting it if its content is not consistent
+// ----------------------------------------------------------------------------
+//   This catches uninitialized memory after a cold boot or a firmware change
+{
+    static bool   checked = false;
+    editor_ring  &ring    = editor_history_ring;
+    if (!checked)
+    {
+        checked = true;
+        bool ok = ring.magic == EDITOR_RING_MAGIC &&
+                  ring.head <= EDITOR_RING_SIZE;
+        for (uint i = 0; ok && i < user_interface::HISTORY; i++)
+            ok = ring.offset[i] <= EDITOR_RING_SIZE &&
+                 ring.length[i] <= EDITOR_RING_SIZE - ring.offset[i];
+        if (!ok)
+        {
+            memset(&ring, 0, sizeof(ring) - sizeof(ring.data));
+            ring.magic = EDITOR_RING_MAGIC;
+        }
+    }
+    return ring;
+}
+
+
+utf8 user_interface::editor_ring_fetch(uint index, size_t *len)
+// ----------------------------------------------------------------------------
+//   Return the history entry at the given index, or nullptr if empty
+// ----------------------------------------------------------------------------
+{
+    editor_ring &ring = editor_ring_check();
+    if (!ring.length[index])
+        return nullptr;
+    if (len)
+        *len = ring.length[index];
+    return utf8(ring.data + ring.offset[index]);
+}
+
+
+bool user_interface::editor_ring_same(uint index, utf8 src, size_t len)
+// ----------------------------------------------------------------------------
+//   Check if the history entry at the given index has the given content
+// ----------------------------------------------------------------------------
+{
+    size_t hlen = 0;
+    utf8   hist = editor_ring_fetch(index, &hlen);
+    return hist && hlen == len && memcmp(hist, src, len) == 0;
+}
+
+
+void user_interface::editor_ring_swap(uint a, uint b)
+// ----------------------------------------------------------------------------
+//   Exchange two history entries, without moving their content
+// ----------------------------------------------------------------------------
+{
+    editor_ring &ring = editor_ring_check();
+    std::swap(ring.offset[a], ring.offset[b]);
+    std::swap(ring.length[a], ring.length[b]);
+}
+
+
+void user_interface::editor_ring_store(uint index, utf8 src, size_t len)
+// ----------------------------------------------------------------------------
+//   Copy a command line into the ring as the given history entry
+// ----------------------------------------------------------------------------
+{
+    editor_ring &ring = editor_ring_check();
+    ring.length[index] = 0;
+    if (!len || len > EDITOR_RING_MAX)
+        return;
+
+    // Entries are contiguous, wrap around if there is not enough room
+    uint32_t start = ring.head;
+    if (start + len > EDITOR_RING_SIZE)
+        start = 0;
+    uint32_t end = start + len;
+
+    // Drop older entries that the new one overwrites
+    for (uint i = 0; i < HISTORY; i++)
+        if (ring.length[i] &&
+            ring.offset[i] < end && ring.offset[i] + ring.length[i] > start)
+            ring.length[i] = 0;
+
+    memcpy(ring.data + start, src, len);
+    ring.offset[index] = start;
+    ring.length[index] = len;
+    ring.head = end;
+}
+
+
 text_p user_interface::editor_save(bool rewinding)
 // ----------------------------------------------------------------------------
 //   Save current editor content for history
@@ -528,19 +677,21 @@ text_p user_interface::editor_save(text_r &editor, bool rewinding)
 //   Save text as editor content for history
 // ----------------------------------------------------------------------------
 {
-    bool found = false;
-    uint base = rewinding ? cmdHistoryIndex : cmdIndex;
+    size_t len = 0;
+    utf8   src = editor->value(&len);
+    bool   found = false;
+    uint   base = rewinding ? cmdHistoryIndex : cmdIndex;
     for (uint h = 1; !found && h < HISTORY; h++)
     {
         uint i = (base + HISTORY - h) % HISTORY;
-        if (history[i] && editor->is_same_as(history[i]))
+        if (editor_ring_same(i, src, len))
         {
-            std::swap(history[base], history[i]);
+            editor_ring_swap(base, i);
             found = true;
         }
     }
     if (!found)
-        history[base] = editor;
+        editor_ring_store(base, src, len);
     if (!rewinding)
     {
         cmdIndex = (cmdIndex + 1) % HISTORY;
@@ -560,11 +711,10 @@ bool user_interface::editor_history(bool back)
     {
         uint next = cmdHistoryIndex + (back ? 1 : HISTORY - 1);
         cmdHistoryIndex = next % HISTORY;
-        if (history[cmdHistoryIndex])
+        size_t sz = 0;
+        if (utf8 ed = editor_ring_fetch(cmdHistoryIndex, &sz))
         {
-            size_t sz = 0;
-            gcutf8 ed = history[cmdHistoryIndex]->value(&sz);
-            rt.edit(+ed, sz);
+            rt.edit(ed, sz);
             cursor = 0;
             select = ~0U;
             alpha = xshift = shift = false;
@@ -586,6 +736,7 @@ void user_interface::clear_help()
     command     = nullptr;
     help        = -1u;
     line        = 0;
+    pagesHistory = 0;
     image       = nullptr;
     impos       = 0;
     topic       = 0;
@@ -1584,6 +1735,86 @@ bool user_interface::draw_graphics(bool erase)
 }
 
 
+#ifndef MENU_TILES
+#ifdef CONFIG_COLOR
+#define MENU_TILES      0       // Too much memory for rendered color labels
+#else
+#define MENU_TILES      36      // Two looks for each of the 18 labels
+#endif
+#endif
+#define MENU_TILE_W     72      // Maximum width of a cached menu label
+#define MENU_TILE_H     32      // Maximum height of a cached menu label
+#define MENU_TILE_LABEL 20      // Maximum length of a cached label text
+
+#if MENU_TILES
+struct menu_tile
+// ----------------------------------------------------------------------------
+//   A rendered menu label, ready to blit back on screen
+// ----------------------------------------------------------------------------
+//   Shift toggles and page flips redraw the same few labels, alternating
+//   between the selected and unselected appearance. Each label is a tab
+//   with a measured and centered text and possibly a marker, all of which
+//   depends only on what is in the key below, so the result is reused.
+{
+    uint32_t theme;                     // Font, size and colors
+    unicode  marker;                    // Marker on the key
+    bool     align;                     // Marker alignment
+    bool     alt;                       // Not on the selected plane
+    uint8_t  len;                       // Length of label text
+    char     label[MENU_TILE_LABEL];    // Label text
+    uint     used;                      // Last use, for eviction
+    pixword  pixels[(MENU_TILE_W * MENU_TILE_H * BITS_PER_PIXEL + 31) / 32];
+
+    surface tile(size w, size h)
+    {
+        return surface(pixels, w, h, MENU_TILE_W);
+    }
+};
+
+static menu_tile menu_tiles[MENU_TILES];
+
+
+static menu_tile *menu_tile_find(uint32_t theme, utf8 label, size_t len,
+                                 unicode marker, bool align, bool alt,
+                                 bool create)
+// ----------------------------------------------------------------------------
+//   Find a cached menu label, or the least recently used tile to replace it
+// ----------------------------------------------------------------------------
+{
+    static uint clock = 0;
+    if (len > MENU_TILE_LABEL)
+        return nullptr;
+
+    uint oldest = 0;
+    for (uint t = 0; t < MENU_TILES; t++)
+    {
+        menu_tile &mt = menu_tiles[t];
+        if (mt.used && mt.theme == theme && mt.len == len &&
+            mt.marker == marker && mt.align == align && mt.alt == alt &&
+            memcmp(mt.label, label, len) == 0)
+        {
+            mt.used = ++clock;
+            return &mt;
+        }
+        if (mt.used < menu_tiles[oldest].used)
+            oldest = t;
+    }
+    if (!create)
+        return nullptr;
+
+    menu_tile &mt = menu_tiles[oldest];
+    mt.theme = theme;
+    mt.marker = marker;
+    mt.align = align;
+    mt.alt = alt;
+    mt.len = len;
+    memcpy(mt.label, label, len);
+    mt.used = ++clock;
+    return &mt;
+}
+#endif // MENU_TILES
+
+
 bool user_interface::draw_menus()
 // ----------------------------------------------------------------------------
 //   Draw the softkey menus
@@ -1652,6 +1883,26 @@ bool user_interface::draw_menus()
         shplane = 0;
     }
 
+#if MENU_TILES
+    // Everything that changes the look of all labels at once
+    const uint64_t looks[] =
+    {
+        uint64_t(uintptr_t(font)),
+        uint64_t(mw << 16 | mh << 1 | square),
+        Settings.MenuBackground(),
+        Settings.RoundMenuBackground(),
+        Settings.RoundMenuForeground(),
+        Settings.SquareMenuForeground(),
+        Settings.SquareMenuBackground(),
+        Settings.SkippedMenuBackground(),
+        Settings.SelectedMenuForeground(),
+        Settings.UnimplementedForeground(),
+    };
+    uint32_t theme = 0;
+    for (uint64_t look : looks)
+        theme = 0x1081 * (0x1081 * theme ^ uint32_t(look)) ^ (look >> 32);
+#endif // MENU_TILES
+
     settings::SaveTabWidth stw(0);
     for (int plane = 0; plane < planes; plane++)
     {
@@ -1702,6 +1953,48 @@ bool user_interface::draw_menus()
                 ? Settings.RoundMenuBackground()
                 : Settings.RoundMenuForeground();
 
+#if MENU_TILES
+            // Check if we already rendered this label
+            rect       krect(mrect.x1, mrect.y1,
+                             mrect.x2 + square, mrect.y2 + square);
+            menu_tile *tile  = nullptr;
+            utf8       tlbl  = utf8(labels[m]);
+            size_t     tlen  = 0;
+            unicode    tmark = 0;
+            bool       talgn = false;
+            if (tlbl && !animating &&
+                krect.width() <= MENU_TILE_W && krect.height() <= MENU_TILE_H)
+            {
+                if (*tlbl == object::ID_symbol || *tlbl == object::ID_text)
+                {
+                    tlbl++;
+                    tlen = leb128<size_t>(tlbl);
+                }
+                else
+                {
+                    tlen = strlen(cstring(tlbl));
+                }
+                if (!help && !Stack.interactive)
+                {
+                    tmark = menuMarker[plane][m];
+                    talgn = menuMarkerAlign[plane][m];
+                }
+                if (tmark != L'◥')
+                {
+                    tile = menu_tile_find(theme, tlbl, tlen, tmark, talgn, alt,
+                                          false);
+                    if (tile)
+                    {
+                        surface ts = tile->tile(krect.width(), krect.height());
+                        Screen.copy(ts, krect);
+                        continue;
+                    }
+                    tile = menu_tile_find(theme, tlbl, tlen, tmark, talgn, alt,
+                                          true);
+                }
+            }
+#endif // MENU_TILES
+
             if (square)
             {
                 mrect.x2++;
@@ -1835,6 +2128,22 @@ bool user_interface::draw_menus()
                 }
                 Screen.clip(clip);
             }
+
+#if MENU_TILES
+            // Keep the rendered label, unless it scrolls
+            if (tile)
+            {
+                if (menuAnimate & animask)
+                {
+                    tile->used = 0;
+                }
+                else
+                {
+                    surface ts = tile->tile(krect.width(), krect.height());
+                    ts.copy(Screen, ts.area(), point(krect.x1, krect.y1));
+                }
+            }
+#endif // MENU_TILES
         }
     }
     if (square && shplane < visiblePlanes)
@@ -1860,13 +2169,33 @@ bool user_interface::draw_menus()
 static const size header_width = 248;
 
 
+struct header_cache
+// ----------------------------------------------------------------------------
+//   Last texts drawn in the header, to only redraw the glyphs that changed
+// ----------------------------------------------------------------------------
+{
+    bool        valid;
+    uint32_t    looks;          // Hash of font and colors
+    coord       timeX;          // Position of the time
+    char        date[32];
+    char        time[16];
+    char        name[32];
+
+    static header_cache last;
+};
+header_cache header_cache::last;
+
+
 bool user_interface::draw_header()
 // ----------------------------------------------------------------------------
 //   Draw the header with the state name
 // ----------------------------------------------------------------------------
 {
     if (freezeHeader || graphics)
+    {
+        header_cache::last.valid = false;
         return false;
+    }
 
     bool changed = force;
     if (!day || Settings.ShowDate() || Settings.ShowTime())
@@ -1882,11 +2211,7 @@ bool user_interface::draw_header()
                 day = dt.day;
                 month = dt.month;
                 year = dt.year;
-                changed = true;
-            }
-            if (dow != tm.dow)
-            {
-                dow = tm.dow;
+                dow = day_of_week(dt);
                 changed = true;
             }
         }
@@ -1942,6 +2267,7 @@ bool user_interface::draw_header()
         // Case of a custom header
         if (pgm)
         {
+            header_cache::last.valid = false;
             stack_depth_restore sdr;
             error_save errs;
             bool fh = freezeHeader;
@@ -1984,13 +2310,11 @@ bool user_interface::draw_header()
             return false;
         }
 
-        coord  x  = 1;
-        Screen.fill(header, pattern(Settings.HeaderBackground()));
-
-        // Read the real-time clock
+        // Build the date, time and state name texts
+        char dtext[32] = "";
+        char ttext[16] = "";
         if (Settings.ShowDate())
         {
-            renderer r;
             char mname[4];
             if (Settings.ShowMonthName())
                 snprintf(mname, 4, "%s", get_month_shortcut(month));
@@ -2002,44 +2326,103 @@ bool user_interface::draw_header()
             else
                 snprintf(ytext, 6, "%d", year);
 
+            char wday[8] = "";
             if (Settings.ShowDayOfWeek())
-                r.printf("%s ", get_wday_shortcut(dow));
+                snprintf(wday, 8, "%s ", get_wday_shortcut(dow));
 
-            char sep   = Settings.DateSeparator();
-            uint index = 2 * Settings.YearFirst() + Settings.MonthBeforeDay();
+            char   sep   = Settings.DateSeparator();
+            uint   index = 2 * Settings.YearFirst() + Settings.MonthBeforeDay();
+            size_t dsz   = sizeof(dtext);
             switch(index)
             {
-            case 0: r.printf("%d%c%s%c%s ", day, sep, mname, sep, ytext); break;
-            case 1: r.printf("%s%c%d%c%s ", mname, sep, day, sep, ytext); break;
-            case 2: r.printf("%s%c%d%c%s ", ytext, sep, day, sep, mname); break;
-            case 3: r.printf("%s%c%s%c%d ", ytext, sep, mname, sep, day); break;
+            case 0: snprintf(dtext, dsz, "%s%d%c%s%c%s ",
+                             wday, day, sep, mname, sep, ytext); break;
+            case 1: snprintf(dtext, dsz, "%s%s%c%d%c%s ",
+                             wday, mname, sep, day, sep, ytext); break;
+            case 2: snprintf(dtext, dsz, "%s%s%c%d%c%s ",
+                             wday, ytext, sep, day, sep, mname); break;
+            case 3: snprintf(dtext, dsz, "%s%s%c%s%c%d ",
+                             wday, ytext, sep, mname, sep, day); break;
             }
-            pattern datecol = Settings.DateForeground();
-            x = Screen.text(x, 0, r.text(), r.size(), hdr_font, datecol);
         }
         if (Settings.ShowTime())
         {
-            renderer r;
-            r.printf("%d", Settings.Time24H() ? hour : hour % 12);
-            r.printf(":%02d", minute);
-            if (Settings.ShowSeconds())
-                r.printf(":%02d", second);
-            if (Settings.Time12H())
-                r.printf("%c", hour < 12 ? 'A' : 'P');
-            r.printf(" ");
-            pattern timecol = Settings.TimeForeground();
-            x = Screen.text(x, 0, r.text(), r.size(), hdr_font, timecol);
+            size_t tsz = sizeof(ttext);
+            size_t t   = snprintf(ttext, tsz, "%d:%02d",
+                                  Settings.Time24H() ? hour : hour % 12,
+                                  minute);
+            if (Settings.ShowSeconds() && t < tsz)
+                t += snprintf(ttext + t, tsz - t, ":%02d", second);
+            if (Settings.Time12H() && t < tsz)
+                t += snprintf(ttext + t, tsz - t, "%c", hour < 12 ? 'A' : 'P');
+            if (t < tsz)
+                snprintf(ttext + t, tsz - t, " ");
+        }
+        cstring name = state_name();
+
+        // Check if only some characters in the time changed
+        pattern  bgcol   = Settings.HeaderBackground();
+        pattern  datecol = Settings.DateForeground();
+        pattern  timecol = Settings.TimeForeground();
+        pattern  namecol = Settings.StateNameForeground();
+        uint32_t looks   = uint32_t(uintptr_t(hdr_font)) ^ header_width;
+        looks = 0x1081 * looks ^ uint32_t(bgcol.bits);
+        looks = 0x1081 * looks ^ uint32_t(datecol.bits);
+        looks = 0x1081 * looks ^ uint32_t(timecol.bits);
+        looks = 0x1081 * looks ^ uint32_t(namecol.bits);
+
+        header_cache &hc = header_cache::last;
+        size_t tlen = strlen(ttext);
+        if (!force && hc.valid && hc.looks == looks &&
+            strcmp(hc.date, dtext) == 0 &&
+            strncmp(hc.name, name, sizeof(hc.name)) == 0 &&
+            strlen(name) < sizeof(hc.name) &&
+            strlen(hc.time) == tlen)
+        {
+            size_t first = 0;
+            while (first < tlen && hc.time[first] == ttext[first])
+                first++;
+            utf8   oldt = utf8(hc.time + first);
+            utf8   newt = utf8(ttext + first);
+            size_t tail = tlen - first;
+            if (tail == 0)
+                return false;
+            if (hdr_font->width(oldt, tail) == hdr_font->width(newt, tail))
+            {
+                coord x0 = hc.timeX + hdr_font->width(utf8(ttext), first);
+                coord x1 = x0 + hdr_font->width(newt, tail) - 1;
+                rect  cells(x0, 0, x1, hdr_bottom);
+                cells &= header;
+                Screen.fill(cells, bgcol);
+                Screen.clip(header);
+                Screen.text(x0, 0, newt, tail, hdr_font, timecol);
+                Screen.clip(clip);
+                draw_dirty(cells);
+                memcpy(hc.time, ttext, sizeof(hc.time));
+                record(user_interface, "Header redraw of %u time glyphs", tail);
+                return true;
+            }
         }
 
-        renderer r;
-        r.printf("%s", state_name());
+        coord  x  = 1;
+        Screen.fill(header, bgcol);
+        if (*dtext)
+            x = Screen.text(x, 0, utf8(dtext), hdr_font, datecol);
+        hc.timeX = x;
+        if (*ttext)
+            x = Screen.text(x, 0, utf8(ttext), hdr_font, timecol);
 
-        pattern namecol = Settings.StateNameForeground();
         Screen.clip(header);
-        x = Screen.text(x, 0, r.text(), r.size(), hdr_font, namecol);
+        x = Screen.text(x, 0, utf8(name), hdr_font, namecol);
         Screen.clip(clip);
         draw_dirty(header);
 
+        hc.valid = true;
+        hc.looks = looks;
+        memcpy(hc.date, dtext, sizeof(hc.date));
+        memcpy(hc.time, ttext, sizeof(hc.time));
+        strncpy(hc.name, name, sizeof(hc.name));
+
         if (x > coord(header_width))
             x = header_width;
         busyLeft = x;
@@ -2063,9 +2446,11 @@ bool user_interface::draw_battery(bool now)
 //    Draw the battery information
 // ----------------------------------------------------------------------------
 {
+    static uint32_t drawn = 0;  // Hash of what was last drawn
     if (freezeHeader || graphics)
     {
         program::last_power_check = ~time;
+        drawn = 0;
         return false;
     }
 
@@ -2114,6 +2499,21 @@ bool user_interface::draw_battery(bool now)
         blink = (time / 512) & 1;
     }
 
+    // Only redraw if something visible changed
+    uint32_t looks = vdd;
+    looks = 0x1081 * looks ^ (usb ? 1 + time / usb_period % 4 : 0);
+    looks = 0x1081 * looks ^ (blink | Settings.ShowVoltage() << 1);
+    looks = 0x1081 * looks ^ uint32_t(vpat.bits) ^ uint32_t(bg.bits);
+    looks = 0x1081 * looks ^ uint32_t(uintptr_t(hdr_font));
+    if (!force && looks == drawn)
+    {
+        draw_refresh(usb ? std::min(refresh, usb_period) : refresh);
+        if (program::low_battery())
+            power_off(false);
+        return false;
+    }
+    drawn = looks;
+
     if (Settings.ShowVoltage())
     {
         char buffer[16];
@@ -2417,6 +2817,7 @@ bool user_interface::draw_editor()
             stackBottom = ns;
             dirtyStack = true;
         }
+        edDrawn = false;
         return false;
     }
 
@@ -2433,6 +2834,9 @@ bool user_interface::draw_editor()
     byte *wed = (byte *) ed;
     wed[len] = 0;               // Ensure utf8_next does not go into the woods
 
+    // If rows are unchanged, we may only need to redraw the cursor row
+    bool incremental = edRows && edDrawn && !force;
+
     // Count rows to check if we need to switch to stack font
 reposition:
     if (!edRows)
@@ -2496,6 +2900,8 @@ reposition:
         bool  done = up && edrow == 0;
         bool  repo = false;
 
+        incremental = false;
+
         record(text_editor,
                "Moving %+s%+s edrow=%d target=%d curs=%d cursx=%d edcx=%d",
                up ? "up" : "", down ? "down" : "",
@@ -2567,6 +2973,7 @@ reposition:
     int   clippedRows     = (availableHeight + lineHeight - 1) / lineHeight;
     utf8  display         = ed;
     coord y               = bottom - rows * lineHeight;
+    int   skip            = 0;
 
     blitter::rect clip = Screen.clip();
     Screen.clip(0, top, LCD_W, bottom);
@@ -2575,7 +2982,7 @@ reposition:
     {
         // Skip rows to show the cursor
         int half = fullRows / 2;
-        int skip = edrow < half         ? 0
+        skip     = edrow < half         ? 0
                  : edrow >= rows - half ? rows - fullRows
                                         : edrow - half;
         record(text_editor,
@@ -2585,14 +2992,21 @@ reposition:
                clippedRows,
                skip);
 
-        for (int r = 0; r < skip; r++)
+        if (incremental && skip == edSkip)
+        {
+            display = ed + edDisplay;
+        }
+        else
         {
-            do
+            for (int r = 0; r < skip; r++)
+            {
+                do
+                    display = utf8_next(display);
+                while (*display != '\n');
+            }
+            if (skip)
                 display = utf8_next(display);
-            while (*display != '\n');
         }
-        if (skip)
-            display = utf8_next(display);
         record(text_editor, "Truncated from %d to %d, text=%s",
                rows, clippedRows, display);
         rows = clippedRows;
@@ -2613,14 +3027,46 @@ reposition:
 
     if (y < top)
         y = top;
-    if (stackBottom != y - 1)
+
+    // Check if only the cursor row needs to be redrawn, e.g. after a key
+    incremental = (incremental              &&
+                   skip == edSkip           &&
+                   top == edTop             &&
+                   y == edY                 &&
+                   xoffset == edXoffset     &&
+                   stackBottom == y - 1     &&
+                   !~select && !~searching);
+    edDisplay = display - ed;
+    edSkip    = skip;
+    edTop     = top;
+    edY       = y;
+    edXoffset = xoffset;
+    edDrawn   = true;
+
+    uint rowStart = display - ed;
+    if (incremental)
+    {
+        coord ry = y + (edrow - skip) * lineHeight;
+        rect  edline(0, ry, LCD_W, ry + lineHeight - 1);
+        Screen.fill(edline, Settings.EditorBackground());
+        draw_dirty(edline);
+        record(text_editor, "Redraw row at %d from %u", ry, edLineStart);
+        rowStart = edLineStart;
+        display  = ed + rowStart;
+        y        = ry;
+        rows     = 1;
+    }
+    else
     {
-        stackBottom = y - 1;
-        dirtyStack  = true;
+        if (stackBottom != y - 1)
+        {
+            stackBottom = y - 1;
+            dirtyStack  = true;
+        }
+        rect edbck(0, stackBottom, LCD_W, bottom);
+        Screen.fill(edbck, Settings.EditorBackground());
+        draw_dirty(edbck);
     }
-    rect edbck(0, stackBottom, LCD_W, bottom);
-    Screen.fill(edbck, Settings.EditorBackground());
-    draw_dirty(edbck);
 
     while (r < rows && display <= last)
     {
@@ -2629,6 +3075,7 @@ reposition:
         {
             cx = x;
             cy = y;
+            edLineStart = rowStart;
         }
         if (display >= last)
             break;
@@ -2645,6 +3092,7 @@ reposition:
             y += lineHeight;
             x  = -xoffset;
             r++;
+            rowStart = display - ed;
             continue;
         }
         int cw = font->width(c);
@@ -2667,6 +3115,7 @@ reposition:
     {
         cx = x;
         cy = y;
+        edLineStart = rowStart;
     }
 
     Screen.clip(clip);
@@ -2675,6 +3124,36 @@ reposition:
 }
 
 
+#ifndef CURSOR_SAVE_W
+#define CURSOR_SAVE_W   48      // Maximum width of the area under the cursor
+#endif // CURSOR_SAVE_W
+#ifndef CURSOR_SAVE_H
+#define CURSOR_SAVE_H   64      // Maximum height of the area under the cursor
+#endif // CURSOR_SAVE_H
+
+struct cursor_save
+// ----------------------------------------------------------------------------
+//   The pixels under the cursor, to make it blink without redrawing text
+// ----------------------------------------------------------------------------
+//   When the cursor is drawn, the pixels under it are saved first. A blink
+//   tick that hides the cursor copies them back, and the next tick draws
+//   the cursor over them again, so that blinking renders no glyph and only
+//   dirties the lines covered by the cursor. Any other drawing of the cursor
+//   saves the pixels again.
+{
+    rect    area;                       // Screen area that was saved
+    bool    valid;                      // Saved pixels match the screen
+    pixword pixels[(CURSOR_SAVE_W * CURSOR_SAVE_H * BITS_PER_PIXEL + 31) / 32];
+
+    surface saved(size w, size h)
+    {
+        return surface(pixels, w, h, CURSOR_SAVE_W);
+    }
+};
+
+static cursor_save cursor_under;
+
+
 bool user_interface::draw_cursor(int show, uint ncursor)
 // ----------------------------------------------------------------------------
 //   Draw the cursor at the location
@@ -2726,10 +3205,30 @@ bool user_interface::draw_cursor(int show, uint ncursor)
     rect    clip       = Screen.clip();
     coord   ytop       = stackTop + 1;
     coord   ybot       = LCD_H - menuHeight;
+    coord   csrx       = cx;
+    coord   csry       = cy + (ch - csrh)/2;
+    rect    area(csrx, std::min(cy, coord(csry - 1)),
+                 csrx + csrw, std::max(coord(cy + ch - 1), coord(csry + csrh)));
+
+    // Blink ticks reuse the pixels saved under the cursor if still valid
+    cursor_save &under = cursor_under;
+    bool tick = !show && !force && program::animated();
+    bool same = tick && under.valid &&
+        under.area.x1 == area.x1 && under.area.y1 == area.y1 &&
+        under.area.x2 == area.x2 && under.area.y2 == area.y2;
+    if (!same)
+        under.valid = false;
 
     Screen.clip(0, ytop, LCD_W, ybot);
+    if (same && !blink)
+    {
+        surface s = under.saved(area.width(), area.height());
+        Screen.copy(s, area);
+        draw_dirty(area);
+    }
+
     bool spaces = false;
-    while (x <= cx + csrw + 1)
+    while (!same && x <= cx + csrw + 1)
     {
         unicode cchar  = p < last ? utf8_codepoint(p) : ' ';
         if (cchar == '\n')
@@ -2758,8 +3257,14 @@ bool user_interface::draw_cursor(int show, uint ncursor)
 
     if (blink)
     {
-        coord csrx = cx;
-        coord csry = cy + (ch - csrh)/2;
+        if (!under.valid &&
+            area.width() <= CURSOR_SAVE_W && area.height() <= CURSOR_SAVE_H)
+        {
+            surface s = under.saved(area.width(), area.height());
+            s.copy(Screen, s.area(), point(area.x1, area.y1));
+            under.area = area;
+            under.valid = true;
+        }
         Screen.invert(csrx, cy, csrx+1, cy + ch - 1);
         rect  r(csrx, csry - 1, csrx+csrw, csry + csrh);
         pattern border = alpha
@@ -3026,13 +3531,8 @@ bool user_interface::draw_object(object_p objp, uint top, uint bottom)
               grob::pattern::black, grob::pattern::white,
               true);
     g.reduce_font();
-    grob_g graph = nullptr;
     object_g obj = objp;
-    do
-    {
-        graph = obj->graph(g);
-    } while (!graph && !rt.error() &&
-             Settings.AutoScaleStack() && g.reduce_font());
+    grob_g graph = obj->fit_graph(g, Settings.AutoScaleStack());
 
     if (graph)
     {
@@ -3077,6 +3577,221 @@ bool user_interface::transient_object(object_p obj)
 }
 
 
+// ============================================================================
+//
+//   Help index
+//
+// ============================================================================
+//   The help index file has one "position:## Topic" line per topic.
+//   It is loaded once in RAM as a table of topic keys sorted with their
+//   position in the help file, so that looking up a topic is a binary search.
+//   Commands also get an entry for their identifier, which matches any
+//   alternate spelling of the command. Since keys are hashes, the heading at
+//   an indexed position is compared with the topic before it is used.
+
+struct help_index_entry
+// ----------------------------------------------------------------------------
+//   An entry in the help index
+// ----------------------------------------------------------------------------
+{
+    uint32_t    key;            // Hash of the topic, or command identifier
+    uint32_t    position;       // Position of the topic in the help file
+};
+
+static help_index_entry help_index[HELP_INDEX_ENTRIES];
+static uint             help_index_count  = 0;
+static uint             help_index_source = 0; // Size of index file loaded
+static bool             help_index_ready  = false;
+static uint             help_index_disk   = 0; // Disk generation when loaded
+
+
+static uint32_t help_topic_key(byte_p topic, size_t len)
+// ----------------------------------------------------------------------------
+//   Hash a topic the way topics are compared, i.e. case and '-' independent
+// ----------------------------------------------------------------------------
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        byte c = topic[i];
+        if (c == '-')
+            c = ' ';
+        hash = (hash ^ byte(tolower(c))) * 16777619u;
+    }
+    return hash & 0x7FFFFFFF;
+}
+
+
+static inline uint32_t help_command_key(object::id cmd)
+// ----------------------------------------------------------------------------
+//   The key for commands does not collide with topic keys
+// ----------------------------------------------------------------------------
+{
+    return 0x80000000u | cmd;
+}
+
+
+static int help_index_compare(const help_index_entry *a,
+                              const help_index_entry *b)
+// ----------------------------------------------------------------------------
+//   Sort entries by key, and for the same key by position in the help file
+// ----------------------------------------------------------------------------
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    return a->position < b->position ? -1 : a->position > b->position;
+}
+
+
+static bool help_index_add(uint32_t key, uint32_t position)
+// ----------------------------------------------------------------------------
+//   Add an entry to the help index
+// ----------------------------------------------------------------------------
+{
+    if (help_index_count >= HELP_INDEX_ENTRIES)
+        return false;
+    help_index[help_index_count].key = key;
+    help_index[help_index_count].position = position;
+    help_index_count++;
+    return true;
+}
+
+
+static void help_index_load(file &index, uint size)
+// ----------------------------------------------------------------------------
+//   Load the help index file in RAM
+// ----------------------------------------------------------------------------
+{
+    byte   ref[80];
+    size_t refidx = 0;
+    bool   ok     = true;
+
+    help_index_count  = 0;
+    help_index_source = size;
+    help_index_disk   = file::generation();
+    for (char c = index.getchar(); ok && c; c = index.getchar())
+    {
+        if (c != '\n')
+        {
+            if (refidx < sizeof(ref))
+                ref[refidx++] = c;
+            continue;
+        }
+
+        byte_p   p        = ref;
+        byte_p   end      = ref + refidx;
+        uint32_t position = 0;
+        uint     level    = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            position = 10 * position + *p++ - '0';
+        while (p < end && *p++ != ':')
+            /* nop */;
+        while (p < end && *p++ == '#')
+            level++;
+        while (p < end && *p == ' ')
+            p++;
+        size_t len = end - p;
+
+        ok = help_index_add(help_topic_key(p, len), position);
+
+        // Second and third level sections match all spellings of a command
+        if (ok && level >= 2)
+            if (object::id cmd = command::lookup(p, len))
+                ok = help_index_add(help_command_key(cmd), position);
+        refidx = 0;
+    }
+
+    typedef int (*qsort_fn)(const void *, const void*);
+    if (ok)
+        qsort(help_index, help_index_count, sizeof(help_index_entry),
+              qsort_fn(help_index_compare));
+    else
+        help_index_count = 0;
+    help_index_ready = ok;
+    record(help, "Help index loaded %u entries %+s",
+           help_index_count, ok ? "ok" : "overflow");
+}
+
+
+static bool help_index_find(uint32_t key, uint &slot)
+// ----------------------------------------------------------------------------
+//   Binary search for the first entry for a key in the help index
+// ----------------------------------------------------------------------------
+{
+    uint lo = 0;
+    uint hi = help_index_count;
+    while (lo < hi)
+    {
+        uint mid = (lo + hi) / 2;
+        if (help_index[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo >= help_index_count || help_index[lo].key != key)
+        return false;
+    slot = lo;
+    return true;
+}
+
+
+static bool help_topic_at(file &help, uint position,
+                          utf8 topic, size_t len, object::id cmd)
+// ----------------------------------------------------------------------------
+//   Check if the heading at the given position in the help file is the topic
+// ----------------------------------------------------------------------------
+{
+    byte   ref[80];
+    size_t refidx = 0;
+    uint   level  = 0;
+    help.seek(position);
+    char c = help.getchar();
+    while (c == '#')
+    {
+        level++;
+        c = help.getchar();
+    }
+    while (c == ' ')
+        c = help.getchar();
+    while (c && c != '\n' && refidx < sizeof(ref))
+    {
+        ref[refidx++] = c;
+        c = help.getchar();
+    }
+
+    // Same comparison as when scanning the help file
+    bool found = refidx == len;
+    for (uint i = 0; found && i < len; i++)
+        found = (tolower(ref[i]) == tolower(topic[i]) ||
+                 (ref[i] == ' ' && topic[i] == '-'));
+    if (!found && cmd && level >= 2)
+        found = command::lookup(ref, refidx) == cmd;
+    return found;
+}
+
+
+static bool help_index_verify(file &help, uint32_t key,
+                              utf8 topic, size_t len, object::id cmd,
+                              uint &position)
+// ----------------------------------------------------------------------------
+//   Find the first position for a key where the help file has the topic
+// ----------------------------------------------------------------------------
+{
+    uint slot = 0;
+    if (!help_index_find(key, slot))
+        return false;
+    for (; slot < help_index_count && help_index[slot].key == key; slot++)
+    {
+        if (help_topic_at(help, help_index[slot].position, topic, len, cmd))
+        {
+            position = help_index[slot].position;
+            return true;
+        }
+    }
+    return false;
+}
+
+
 void user_interface::load_help(utf8 topic, size_t len)
 // ----------------------------------------------------------------------------
 //   Find the help message associated with the topic
@@ -3120,6 +3835,7 @@ void user_interface::load_help(utf8 topic, size_t len)
     bool       matching = false;
     uint       topicpos = 0;
     bool       found    = false;
+    bool       indexed  = false;
     uint       idxpos   = 0;
 
     // Check if the index exists. If so, scan it
@@ -3127,7 +3843,28 @@ void user_interface::load_help(utf8 topic, size_t len)
         file index(HELPINDEX_NAME, file::READING);
         if (index.valid())
         {
-            for (char c = index.getchar(); !found && c; c = index.getchar())
+            // Reload the index when the file changes
+            uint size = index.size();
+            if (size != help_index_source ||
+                help_index_disk != file::generation())
+            {
+                help_index_load(index, size);
+                index.seek(0);
+            }
+
+            // Check if the topic can be in the help file at all
+            if (help_index_ready)
+            {
+                uint slot = 0;
+                found = help_index_find(help_topic_key(topic, len), slot) ||
+                    (cmd && help_index_find(help_command_key(cmd), slot));
+                indexed = found;
+            }
+
+            // Index too large for RAM, scan it
+            for (char c = help_index_ready ? 0 : index.getchar();
+                 !found && c;
+                 c = index.getchar())
             {
                 if (c == '\n')
                 {
@@ -3194,6 +3931,27 @@ void user_interface::load_help(utf8 topic, size_t len)
         }
     }
 
+    // Pick the earliest of the topic and command matches in the help file
+    if (indexed)
+    {
+        uint cmdpos = 0;
+        found = help_index_verify(helpfile, help_topic_key(topic, len),
+                                  topic, len, cmd, idxpos);
+        if (cmd && help_index_verify(helpfile, help_command_key(cmd),
+                                     topic, len, cmd, cmdpos))
+        {
+            if (!found || cmdpos < idxpos)
+                idxpos = cmdpos;
+            found = true;
+        }
+        if (!found)
+            goto notfound;
+        if (!isvar)
+            found = false;
+        else
+            topicpos = idxpos;
+    }
+
     helpfile.seek(idxpos);
     for (char c = helpfile.getchar(); !found && c; c = helpfile.getchar())
     {
@@ -3249,6 +4007,7 @@ void user_interface::load_help(utf8 topic, size_t len)
     {
         help = topicpos;
         line = 0;
+        pagesHistory = 0;
         record(help, "Found topic %s at position %u level %u",
                topic, helpfile.position(), level);
 
@@ -3410,8 +4169,23 @@ restart:
             }
             else if (last == '\n' && line > 0 && y < ytop - 2*LCD_H)
             {
+                // Remember where the previous page started
+                uint next = ytop + 2 - y;
+                if (pagesHistory >= NUM_PAGES)
+                {
+                    for (uint i = 1; i < NUM_PAGES; i++)
+                    {
+                        pageStart[i - 1] = pageStart[i];
+                        pageLines[i - 1] = pageLines[i];
+                    }
+                    pagesHistory--;
+                }
+                pageStart[pagesHistory] = help;
+                pageLines[pagesHistory] = line - next;
+                pagesHistory++;
+
                 help = helpfile.position();
-                line = ytop + 2 - y;
+                line = next;
             }
         }
 
@@ -4200,6 +4974,13 @@ bool user_interface::handle_help(int &key)
     case KEY_UP:
     case KEY_8:
     case KEY_SUB:
+        // Go back to previous pages we know the exact position of
+        while (line <= count * height && pagesHistory)
+        {
+            pagesHistory--;
+            help = pageStart[pagesHistory];
+            line += pageLines[pagesHistory];
+        }
         if (line > count * height)
         {
             line -= count * height;
@@ -4277,6 +5058,7 @@ bool user_interface::handle_help(int &key)
             {
                 help = topics[topicsHistory-1];
                 line = 0;
+                pagesHistory = 0;
                 dirtyHelp = true;
                 break;
             }
@@ -5415,6 +6197,160 @@ static const byte *const defaultCommand[user_interface::NUM_PLANES] =
 };
 
 
+// ============================================================================
+//
+//   Compiled keymaps
+//
+// ============================================================================
+//   Parsing a keymap source at boot is slow, so the resulting list is saved
+//   next to the source with a .48c extension. It is used as long as the
+//   source keeps the same time stamp and size, and the binary format of
+//   objects did not change, as checked with files::id_checksum().
+
+struct keymap_header
+// ----------------------------------------------------------------------------
+//   Header for a compiled keymap file
+// ----------------------------------------------------------------------------
+{
+    byte        magic[4];               // FILE_MAGIC
+    uint32_t    checksum;               // files::id_checksum()
+    uint32_t    stamp;                  // Time stamp of the source
+    uint32_t    size;                   // Size of the source
+    uint32_t    object_size;            // Size of the keymap list that follows
+};
+
+
+static cstring keymap_compiled_name(cstring name, char *buf, size_t max)
+// ----------------------------------------------------------------------------
+//   Build the name of the compiled keymap for a given source
+// ----------------------------------------------------------------------------
+{
+    cstring ext = file::extension(name);
+    size_t  len = ext ? size_t(ext - name) : strlen(name);
+    if (len + 5 > max)
+        return nullptr;
+    memcpy(buf, name, len);
+    memcpy(buf + len, ".48c", 5);
+    return buf;
+}
+
+
+static void keymap_header_init(keymap_header &hdr, file &source)
+// ----------------------------------------------------------------------------
+//   Build the expected header for a keymap source
+// ----------------------------------------------------------------------------
+{
+    static const byte magic[] = FILE_MAGIC;
+    COMPILE_TIME_ASSERT(sizeof(magic) == sizeof(hdr.magic));
+    memcpy(hdr.magic, magic, sizeof(magic));
+    hdr.checksum    = files::id_checksum();
+    hdr.stamp       = source.modified();
+    hdr.size        = source.size();
+    hdr.object_size = 0;
+}
+
+
+static list_p keymap_load_compiled(cstring name, keymap_header &expected)
+// ----------------------------------------------------------------------------
+//   Load a compiled keymap if it is up to date, with a single block read
+// ----------------------------------------------------------------------------
+{
+    // Without a time stamp, we cannot know if the source was edited
+    char path[96];
+    if (!expected.stamp || rt.allocated() ||
+        !keymap_compiled_name(name, path, sizeof(path)))
+        return nullptr;
+
+    file compiled(path, file::READING);
+    if (!compiled.valid())
+        return nullptr;
+
+    keymap_header hdr;
+    if (!compiled.read((char *) &hdr, sizeof(hdr)) ||
+        memcmp(hdr.magic, expected.magic, sizeof(hdr.magic)) != 0 ||
+        hdr.checksum != expected.checksum ||
+        hdr.stamp != expected.stamp ||
+        hdr.size != expected.size ||
+        hdr.object_size + sizeof(hdr) != compiled.size())
+    {
+        record(keymap_warning, "%s is out of date", path);
+        return nullptr;
+    }
+
+    byte *ptr = rt.allocate(hdr.object_size);
+    if (!ptr)
+        return nullptr;
+    if (!compiled.read((char *) ptr, hdr.object_size))
+    {
+        rt.free(hdr.object_size);
+        return nullptr;
+    }
+    object_p obj = rt.temporary();
+    if (!obj || obj->type() != object::ID_list ||
+        obj->size() != hdr.object_size)
+    {
+        record(keymap_warning, "%s does not contain a valid keymap", path);
+        return nullptr;
+    }
+    record(user_interface, "Loaded compiled keymap %s", path);
+    return list_p(obj);
+}
+
+
+static void keymap_save_compiled(cstring name, keymap_header &hdr,
+                                 list_p keymap)
+// ----------------------------------------------------------------------------
+//   Save a compiled keymap next to its source
+// ----------------------------------------------------------------------------
+//   Failing to save is not an error, the source will be parsed next time
+{
+    char path[96];
+    if (!hdr.stamp || !keymap_compiled_name(name, path, sizeof(path)))
+        return;
+    hdr.object_size = keymap->size();
+    file compiled(path, file::WRITING);
+    if (!compiled.valid() ||
+        !compiled.write((cstring) &hdr, sizeof(hdr)) ||
+        !compiled.write((cstring) keymap, hdr.object_size))
+        record(keymap_warning, "Could not save %s", path);
+}
+
+
+void user_interface::index_keymap()
+// ----------------------------------------------------------------------------
+//   Record the offset of each key object in the keymap for direct lookup
+// ----------------------------------------------------------------------------
+//   Offsets are relative to the keymap, so they do not change when the
+//   garbage collector moves it. A zero offset means the key is not mapped.
+{
+    memset(keymapIndex, 0, sizeof(keymapIndex));
+    keymapIndexed = false;
+    if (!keymap || keymap->size() > 0xFFFF)
+        return;
+
+    const uint nplanes = sizeof(keymapIndex) / sizeof(keymapIndex[0]);
+    byte_p     base    = byte_p(keymap);
+    uint       p       = 0;
+    for (object_p planeobj : *keymap)
+    {
+        if (p >= nplanes)
+            break;
+        if (list_p plane = planeobj->as_array_or_list())
+        {
+            uint k = 0;
+            for (object_p keyobj : *plane)
+            {
+                if (k >= NUM_KEYS)
+                    break;
+                keymapIndex[p][k++] = byte_p(keyobj) - base;
+            }
+        }
+        p++;
+    }
+    keymapIndexed = true;
+}
+
+
 bool user_interface::load_keymap(cstring name)
 // ----------------------------------------------------------------------------
 //   Load the keymap from a file
@@ -5428,6 +6364,19 @@ bool user_interface::load_keymap(cstring name)
         return false;
     }
 
+    keymap_header hdr;
+    keymap_header_init(hdr, kmap);
+    if (list_p compiled = keymap_load_compiled(name, hdr))
+    {
+        keymap = compiled;
+        index_keymap();
+#if SIMULATOR
+        ui_load_keymap(name);
+#endif // SIMULATOR
+        return true;
+    }
+    kmap.seek(0);
+
     static byte buffer[80];
     size_t      idx = 0;
     uint        key = 0;
@@ -5499,6 +6448,8 @@ bool user_interface::load_keymap(cstring name)
     if (result)
     {
         keymap = result;
+        index_keymap();
+        keymap_save_compiled(name, hdr, keymap);
 #if SIMULATOR
         ui_load_keymap(name);
 #endif // SIMULATOR
@@ -5524,10 +6475,20 @@ object_p user_interface::object_for_key(int key)
     }
 
     if (keymap && key > 0 && key <= NUM_KEYS)
-        if (object_p planeobj = keymap->at(plane + NUM_PLANES * alpha_plane()))
+    {
+        uint kplane = plane + NUM_PLANES * alpha_plane();
+        if (keymapIndexed)
+        {
+            if (uint offset = keymapIndex[kplane][key-1])
+                return object_p(byte_p(keymap) + offset);
+        }
+        else if (object_p planeobj = keymap->at(kplane))
+        {
             if (list_p plane = planeobj->as_array_or_list())
                 if (object_p keyobj = plane->at(key-1))
                     return keyobj;
+        }
+    }
 
     const byte *ptr = defaultCommand[plane] + 2 * (key - 1);
     if (*ptr)
@@ -6375,13 +7336,8 @@ bool user_interface::do_search(unicode with, bool restart)
         if (last + (with != 0) > max)
             continue;
 
-        // Otherwise, loop inside buffer
-        for (uint s = search; check && s < last; s = utf8_next(ed, s, max))
-        {
-            unicode sc = utf8_codepoint(ed + s);
-            unicode rc = utf8_codepoint(ed + ref + s - search);
-            check = towlower(sc) == towlower(rc);
-        }
+        // Otherwise, compare with the selection
+        check = utf8_match_nocase(ed + search, ed + ref, selected);
 
         if (check && with)
         {
@@ -6665,28 +7621,15 @@ size_t user_interface::replace(utf8 oldData, utf8 newData)
 {
     const byte *ed    = rt.editor();
     const byte *find  = ed + cursor;
-    bool        found = true;
-
-    size_t len = strlen(cstring(oldData));
-    for (uint f = 0; found && f < len; f = utf8_next(oldData, f, len))
-    {
-        unicode fc = utf8_codepoint(oldData + f);
-        unicode ec = utf8_codepoint(find + f);
-        found = towlower(fc) == towlower(ec);
-    }
+    size_t      len   = strlen(cstring(oldData));
+    bool        found = utf8_match_nocase(oldData, find, len);
 
     // Also remove newData, to avoid duplicates
     size_t newLen = strlen(cstring(newData));
     if (!found)
     {
-        found = true;
         len = newLen;
-        for (uint f = 0; found && f < len; f = utf8_next(newData, f, len))
-        {
-            unicode fc = utf8_codepoint(newData + f);
-            unicode ec = utf8_codepoint(find + f);
-            found = towlower(fc) == towlower(ec);
-        }
+        found = utf8_match_nocase(newData, find, len);
     }
 
     size_t removed = 0;
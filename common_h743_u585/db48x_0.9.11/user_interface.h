@@ -212,6 +212,10 @@ struct user_interface
 
     text_p      editor_save(text_r ed, bool rewinding = false);
     text_p      editor_save(bool rewinding = false);
+    utf8        editor_ring_fetch(uint index, size_t *len);
+    bool        editor_ring_same(uint index, utf8 src, size_t len);
+    void        editor_ring_swap(uint a, uint b);
+    void        editor_ring_store(uint index, utf8 src, size_t len);
     bool        editor_history(bool back = false);
     bool        editor_select();
     bool        editor_word_left();
@@ -233,6 +237,7 @@ struct user_interface
     void        load_help(utf8 topic, size_t len = 0);
 
     bool        load_keymap(cstring filename);
+    void        index_keymap();
 
 protected:
     bool        handle_screen_capture(int key);
@@ -259,6 +264,9 @@ protected:
     uint     topic;             // Offset of topic being highlighted
     uint     topicsHistory;     // History depth
     uint     topics[8];         // Topics history
+    uint     pagesHistory;      // Depth of page history
+    uint     pageStart[16];     // Help position of previous pages
+    uint     pageLines[16];     // Distance from previous to next page
     grob_g   image;             // Image loaded in help file
     uint     impos;             // Position of image file
     uint     cursor;            // Cursor position in buffer
@@ -273,6 +281,12 @@ protected:
     uint     edRows;            // Editor rows
     int      edRow;             // Current editor row
     int      edColumn;          // Current editor column (in pixels)
+    uint     edDisplay;         // Offset of first editor row on screen
+    uint     edLineStart;       // Offset of the start of the cursor row
+    int      edSkip;            // Editor rows scrolled off the top
+    coord    edTop;             // Editor clip top when last drawn
+    coord    edY;               // Position of first editor row when drawn
+    coord    edXoffset;         // Horizontal offset when last drawn
     id       menuStack[HISTORY];// Current and past menus
     uint     pageStack[HISTORY];// Current and past menus pages
     uint     menuPage;          // Current menu page
@@ -297,7 +311,6 @@ protected:
     uint     editingLevel;      // Stack level being edited
     uint     cmdIndex;          // Command index for next command to save
     uint     cmdHistoryIndex;   // Command index for next command history
-    text_g   history[HISTORY];  // Command-line history
     text_g   clipboard;         // Clipboard for copy/paste operations
     bool     shift        : 1;  // Normal shift active
     bool     xshift       : 1;  // Extended shift active (simulate Right)
@@ -321,6 +334,7 @@ protected:
     bool     dirtyStack   : 1;  // Need to redraw the stack
     bool     dirtyCommand : 1;  // Need to redraw the command
     bool     dirtyEditor  : 1;  // Need to redraw the text editor
+    bool     edDrawn      : 1;  // Editor positions above are valid
     bool     dirtyHelp    : 1;  // Need to redraw the help
     bool     autoComplete : 1;  // Menu is auto-complete
     bool     adjustSeps   : 1;  // Need to adjust separators
@@ -334,6 +348,8 @@ protected:
 protected:
     // Key mappings
     list_p   keymap;
+    uint16_t keymapIndex[NUM_PLANES * NUM_PLANES][NUM_KEYS];
+    bool     keymapIndexed;
     object_p function[NUM_PLANES][NUM_SOFTKEYS];
     cstring  menuLabel[NUM_PLANES][NUM_SOFTKEYS];
     uint16_t menuMarker[NUM_PLANES][NUM_SOFTKEYS];
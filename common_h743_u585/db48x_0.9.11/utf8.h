@@ -33,6 +33,7 @@
 
 #include <ctype.h>
 #include <string.h>
+#include <wctype.h>
 
 
 inline bool is_utf8_first(byte b)
@@ -248,6 +249,36 @@ inline uint utf8_length(utf8 text)
 }
 
 
+inline bool utf8_match_nocase(utf8 text, utf8 ref, size_t len)
+// ----------------------------------------------------------------------------
+//    Check if `len` bytes of text match the reference, ignoring case
+// ----------------------------------------------------------------------------
+//    ASCII is compared byte by byte, only other characters are decoded
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        byte tc = text[i];
+        byte rc = ref[i];
+        if (tc < 0x80 && rc < 0x80)
+        {
+            if (tc != rc && tolower(tc) != tolower(rc))
+                return false;
+            i++;
+        }
+        else
+        {
+            unicode tcp = utf8_codepoint(text + i);
+            unicode rcp = utf8_codepoint(ref + i);
+            if (towlower(tcp) != towlower(rcp))
+                return false;
+            i = utf8_next(text, i, len);
+        }
+    }
+    return true;
+}
+
+
 inline void utf8_reverse(byte *start, byte *end, bool multibyte = true)
 // ----------------------------------------------------------------------------
 //   Reverse a utf8-encded string
@@ -339,26 +370,185 @@ inline bool utf8_more(utf8 start, utf8 current, size_t size)
 //   Symbol classification
 //
 // ============================================================================
+//   Scanners and editor word navigation call these for every character, so
+//   code points are classified by a two-level table built at compile time
+//   from the lists of special characters below. The first level selects a
+//   page of 256 code points, and pages without special characters share a
+//   single default page.
 
-inline bool is_valid_in_name(unicode cp)
+enum utf8_class
 // ----------------------------------------------------------------------------
-//   Check if character is valid in a name after the initial character
+//   Classes of characters
 // ----------------------------------------------------------------------------
 {
-    if (cp == (cp & 0x7F) && isalnum(cp))
-        return true;
-    static utf8 valid = utf8("$%&?");
-    for (utf8 p = valid; *p; p = utf8_next(p))
-        if (cp == utf8_codepoint(p))
+    UTF8_NAME           = 1,    // Valid in a name, see is_valid_in_name
+    UTF8_INITIAL        = 2,    // Valid as initial, is_valid_as_name_initial
+    UTF8_SEPARATOR      = 4,    // Separator, see is_separator
+    UTF8_SEPDIGIT       = 8,    // See is_separator_or_digit
+    UTF8_FUNCTION       = 16,   // See is_valid_in_function_name
+    UTF8_CONSTANT       = 32,   // See is_valid_in_constant_name
+
+    // Class of code points not listed as special
+    UTF8_DEFAULT        = UTF8_NAME | UTF8_INITIAL | UTF8_FUNCTION | UTF8_CONSTANT
+};
+
+
+// Non-ASCII code points with special classes
+static constexpr char32_t utf8_not_in_name[]   = U"÷×·↑−∕∗∂⁻¹²³«»ⅈ∡ ≤≠≥⨯⋅▶";
+static constexpr char32_t utf8_not_initial[]   = U"ⒸⒺⓁ";
+static constexpr char32_t utf8_separators[]    = U"≤≠≥«»";
+static constexpr char32_t utf8_sepdigits[]     = U"÷×·↑≤≠≥«»⁳";
+static constexpr char32_t utf8_in_function[]   = U"⁻¹²³";
+static constexpr char32_t utf8_in_constant[]   = U"ⅈ−";
+static constexpr const char32_t *utf8_specials[] =
+{
+    utf8_not_in_name, utf8_not_initial, utf8_separators,
+    utf8_sepdigits,   utf8_in_function, utf8_in_constant
+};
+
+
+constexpr bool utf8_listed(const char32_t *list, unicode cp)
+// ----------------------------------------------------------------------------
+//   Check if a code point is in one of the lists above
+// ----------------------------------------------------------------------------
+{
+    for (; *list; list++)
+        if (unicode(*list) == cp)
             return true;
-    if (cp < unicode(0x80))
-        return false;
+    return false;
+}
 
-    static utf8 invalid = utf8("÷×·↑−∕∗∂⁻¹²³«»ⅈ∡ ;,.'\"<=>≤≠≥[](){}«»\n\t⨯⋅▶");
-    for (utf8 p = invalid; *p; p = utf8_next(p))
-        if (cp == utf8_codepoint(p))
-            return false;
-    return true;
+
+constexpr byte utf8_compute_class(unicode cp)
+// ----------------------------------------------------------------------------
+//   Compute the classes of a code point, only used to build the table
+// ----------------------------------------------------------------------------
+{
+    enum
+    {
+        N = UTF8_NAME | UTF8_FUNCTION | UTF8_CONSTANT,
+        I = UTF8_INITIAL, S = UTF8_SEPARATOR, D = UTF8_SEPDIGIT
+    };
+    constexpr byte ascii[128] =
+    {
+        0,   0,   0,   0,   0,   0,   0,   0,   // 00
+        0,   S|D, S|D, 0,   0,   0,   0,   0,   // 08
+        0,   0,   0,   0,   0,   0,   0,   0,   // 10
+        0,   0,   0,   0,   0,   0,   0,   0,   // 18
+        S|D, 0,   S|D, 0,   N|I, N|I, N|I, S|D, // 20
+        S|D, S|D, D,   0,   S|D, 0,   S|D, D,   // 28
+        N|D, N|D, N|D, N|D, N|D, N|D, N|D, N|D, // 30
+        N|D, N|D, 0,   S|D, S|D, S|D, S|D, N|I, // 38
+        0,   N|I, N|I, N|I, N|I, N|I, N|I, N|I, // 40
+        N|I, N|I, N|I, N|I, N|I, N|I, N|I, N|I, // 48
+        N|I, N|I, N|I, N|I, N|I, N|I, N|I, N|I, // 50
+        N|I, N|I, N|I, S|D, 0,   S|D, D,   D,   // 58
+        0,   N|I, N|I, N|I, N|I, N|I, N|I, N|I, // 60
+        N|I, N|I, N|I, N|I, N|I, N|I, N|I, N|I, // 68
+        N|I, N|I, N|I, N|I, N|I, N|I, N|I, N|I, // 70
+        N|I, N|I, N|I, S|D, 0,   S|D, 0,   0,   // 78
+    };
+    if (cp < 0x80)
+        return ascii[cp];
+
+    bool name = !utf8_listed(utf8_not_in_name, cp);
+    byte cls  = 0;
+    if (name)
+        cls |= UTF8_NAME;
+    if ((name || cp == L'−') && !utf8_listed(utf8_not_initial, cp))
+        cls |= UTF8_INITIAL;
+    if (utf8_listed(utf8_separators, cp))
+        cls |= UTF8_SEPARATOR;
+    if (utf8_listed(utf8_sepdigits, cp))
+        cls |= UTF8_SEPDIGIT;
+    if (name || utf8_listed(utf8_in_function, cp))
+        cls |= UTF8_FUNCTION;
+    if (name || utf8_listed(utf8_in_constant, cp))
+        cls |= UTF8_CONSTANT;
+    return cls;
+}
+
+
+constexpr bool utf8_special_page(uint page)
+// ----------------------------------------------------------------------------
+//   Check if a page of 256 code points has special characters
+// ----------------------------------------------------------------------------
+{
+    for (const char32_t *list : utf8_specials)
+        for (const char32_t *p = list; *p; p++)
+            if (uint(*p >> 8) == page)
+                return true;
+    return false;
+}
+
+
+constexpr uint utf8_class_pages()
+// ----------------------------------------------------------------------------
+//   Count pages in the table: default, ASCII and those with special characters
+// ----------------------------------------------------------------------------
+{
+    uint pages = 2;
+    for (uint page = 1; page < 256; page++)
+        if (utf8_special_page(page))
+            pages++;
+    return pages;
+}
+
+
+struct utf8_class_table
+// ----------------------------------------------------------------------------
+//   Two-level classification table for code points below 0x10000
+// ----------------------------------------------------------------------------
+{
+    byte index[256];                    // Page for code point >> 8
+    byte pages[utf8_class_pages()][256];// Classes for code point & 0xFF
+};
+
+
+constexpr utf8_class_table utf8_build_class_table()
+// ----------------------------------------------------------------------------
+//   Build the classification table at compile time
+// ----------------------------------------------------------------------------
+{
+    utf8_class_table table{};
+    for (uint c = 0; c < 256; c++)
+        table.pages[0][c] = UTF8_DEFAULT;
+
+    uint next = 1;
+    for (uint page = 0; page < 256; page++)
+    {
+        if (page && !utf8_special_page(page))
+            continue;
+        table.index[page] = next;
+        for (uint c = 0; c < 256; c++)
+            table.pages[next][c] = utf8_compute_class(page * 256 + c);
+        next++;
+    }
+    return table;
+}
+
+
+// Flash-resident table, 256 bytes per page with special characters
+static constexpr utf8_class_table utf8_classes = utf8_build_class_table();
+
+
+inline byte utf8_class(unicode cp)
+// ----------------------------------------------------------------------------
+//   Return the classes of a code point
+// ----------------------------------------------------------------------------
+{
+    if (cp >= 0x10000)
+        return UTF8_DEFAULT;
+    return utf8_classes.pages[utf8_classes.index[cp >> 8]][cp & 0xFF];
+}
+
+
+inline bool is_valid_in_name(unicode cp)
+// ----------------------------------------------------------------------------
+//   Check if character is valid in a name after the initial character
+// ----------------------------------------------------------------------------
+{
+    return utf8_class(cp) & UTF8_NAME;
 }
 
 
@@ -377,8 +567,7 @@ inline bool is_valid_in_function_name(unicode cp)
 // ----------------------------------------------------------------------------
 {
     // Functions like ΣX² or sin⁻¹ are valid
-    return (cp == L'⁻' || cp == L'¹' || cp == L'²' || cp == L'³' ||
-            is_valid_in_name(cp));
+    return utf8_class(cp) & UTF8_FUNCTION;
 }
 
 
@@ -396,7 +585,7 @@ inline bool is_valid_in_constant_name(unicode cp)
 //   In constants, we accept a few additional characters
 // ----------------------------------------------------------------------------
 {
-    return cp == L'ⅈ' || cp == L'−' || is_valid_in_name(cp);
+    return utf8_class(cp) & UTF8_CONSTANT;
 }
 
 
@@ -414,13 +603,7 @@ inline bool is_valid_as_name_initial(unicode cp)
 //   Check if character is valid as initial of a name
 // ----------------------------------------------------------------------------
 {
-    if (isdigit(cp))
-        return false;
-    static utf8 invalid = utf8("ⒸⒺⓁ");
-    for (utf8 p = invalid; *p; p = utf8_next(p))
-        if (cp == utf8_codepoint(p))
-            return false;
-    return cp == L'−' || is_valid_in_name(cp);
+    return utf8_class(cp) & UTF8_INITIAL;
 }
 
 
@@ -438,11 +621,7 @@ inline bool is_separator(unicode code)
 //   Check if the code point at given string is a separator
 // ----------------------------------------------------------------------------
 {
-    static utf8 separators = utf8(" ;,.'\"<=>≤≠≥[](){}«»\n\t");
-    for (utf8 p = separators; *p; p = utf8_next(p))
-        if (code == utf8_codepoint(p))
-            return true;
-    return false;
+    return utf8_class(code) & UTF8_SEPARATOR;
 }
 
 
@@ -461,11 +640,7 @@ inline bool is_separator_or_digit(unicode code)
 //   Check if the code point at given string is a separator
 // ----------------------------------------------------------------------------
 {
-    static utf8 seps = utf8(" ÷×·↑/*^;,.'\"<=>≤≠≥[](){}«»_\n\t0123456789⁳");
-    for (utf8 p = seps; *p; p = utf8_next(p))
-        if (code == utf8_codepoint(p))
-            return true;
-    return false;
+    return utf8_class(code) & UTF8_SEPDIGIT;
 }
 
 
@@ -43,4 +43,28 @@ inline char *  strend(char *s)          { return s + strlen(s); }
 char *render_u64(char *buffer, ularge value);
 char *render_i64(char *buffer, large value);
 
+
+inline ularge mul_wide(ularge a, ularge b, ularge &hi)
+// ----------------------------------------------------------------------------
+//   Full 64x64 bit product, returns the low half
+// ----------------------------------------------------------------------------
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 p = (unsigned __int128) a * b;
+    hi = ularge(p >> 64);
+    return ularge(p);
+#else // !__SIZEOF_INT128__
+    ularge al  = uint32_t(a);
+    ularge ah  = a >> 32;
+    ularge bl  = uint32_t(b);
+    ularge bh  = b >> 32;
+    ularge ll  = al * bl;
+    ularge lh  = al * bh;
+    ularge hl  = ah * bl;
+    ularge mid = (ll >> 32) + uint32_t(lh) + uint32_t(hl);
+    hi = ah * bh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return (mid << 32) | uint32_t(ll);
+#endif // __SIZEOF_INT128__
+}
+
 #endif // UTIL_H
@@ -38,7 +38,9 @@
 #include "list.h"
 #include "locals.h"
 #include "parser.h"
+#include "program.h"
 #include "renderer.h"
+#include "sysmenu.h"
 #include "tag.h"
 
 RECORDER(directory,       16, "Directories");
@@ -276,6 +278,8 @@ object_p directory::store(object_g name, object_g value)
         // Move memory above storage if necessary
         if (vs != es)
             rt.move_globals((object_p) evalue + vs, (object_p) evalue + es);
+        else
+            globals_moved();    // Value may be an indexed directory
 
         // Copy new value into storage location
         memmove((byte *) evalue, (byte *) value, vs);
@@ -314,6 +318,11 @@ object_p directory::store(object_g name, object_g value)
     // Adjust all directory sizes
      adjust_sizes(thisdir, delta);
 
+#if USE_STATE_JOURNAL
+    // Record the change to persistent state
+    state_journal(thisdir, name, value);
+#endif // USE_STATE_JOURNAL
+
     // Refresh the variables menu
     ui.menu_refresh(ID_VariablesMenu);
     if (nty == ID_CustomMenu)
@@ -376,11 +385,173 @@ void directory::adjust_sizes(directory_r thisdir, int delta)
 }
 
 
+// ============================================================================
+//
+//   Directory name index
+//
+// ============================================================================
+
+uint directory::generation = 0;
+
+enum
+{
+    DIR_INDEX_SIZE       = 1024,        // Number of slots (power of 2)
+    DIR_INDEX_DIRS       = 8,           // Number of indexed directories
+    DIR_INDEX_MIN_SIZE   = 256,         // Index directories larger than this
+};
+
+struct directory_index_entry
+// ----------------------------------------------------------------------------
+//   An entry in the directory index
+// ----------------------------------------------------------------------------
+{
+    object_p    name;                   // Name in the directory
+    uint        hash;                   // Hash for directory and name
+};
+
+static directory_index_entry dir_index[DIR_INDEX_SIZE];
+static directory_p           dir_indexed[DIR_INDEX_DIRS];
+static uint                  dir_index_count      = 0;
+static uint                  dir_index_generation = ~0U;
+
+
+static uint directory_name_hash(directory_p dir, object_p name, size_t sz)
+// ----------------------------------------------------------------------------
+//   Hash a name for a given directory
+// ----------------------------------------------------------------------------
+//   ASCII case is folded, since symbols may be compared ignoring case
+{
+    uint   hash = uint(uintptr_t(dir)) * 2654435761U;
+    byte_p p    = byte_p(name);
+    for (size_t i = 0; i < sz; i++)
+    {
+        byte c = p[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        hash = (hash ^ c) * 16777619U;
+    }
+    return hash;
+}
+
+
+static inline bool directory_same_name(object_p name, size_t ns,
+                                       object_p ref,  size_t rsize,
+                                       symbol_p rsym)
+// ----------------------------------------------------------------------------
+//   Check if a directory name matches the reference
+// ----------------------------------------------------------------------------
+{
+    if (name == ref)          // Optimization when name is from directory
+        return true;
+    if (ns != rsize)
+        return false;
+    if (rsym)
+    {
+        // Regular symbols: case insensitive comparison
+        if (symbol_p nsym = name->as<symbol>())
+            return rsym->is_same_as(nsym);
+        return false;
+    }
+
+    // Special symbols, e.g. ΣData
+    return memcmp(cstring(name), cstring(ref), rsize) == 0;
+}
+
+
+object_p directory::indexed_lookup(object_p ref) const
+// ----------------------------------------------------------------------------
+//   Lookup a name using the directory index, building it if necessary
+// ----------------------------------------------------------------------------
+//   Return `this` when the index cannot be used for this directory
+{
+    const uint mask = DIR_INDEX_SIZE - 1;
+    byte_p     p    = payload();
+    size_t     size = leb128<size_t>(p);
+
+    // Only index large directories that do not move with GC
+    if (size < DIR_INDEX_MIN_SIZE || !rt.is_global(this))
+        return this;
+
+    // Globals moved: throw away the whole index
+    if (dir_index_generation != generation)
+    {
+        memset(dir_index, 0, sizeof(dir_index));
+        memset(dir_indexed, 0, sizeof(dir_indexed));
+        dir_index_count = 0;
+        dir_index_generation = generation;
+    }
+
+    // Check if this directory was indexed, if not index it
+    uint d;
+    for (d = 0; d < DIR_INDEX_DIRS && dir_indexed[d]; d++)
+        if (dir_indexed[d] == this)
+            break;
+    if (d >= DIR_INDEX_DIRS || !dir_indexed[d])
+    {
+        // Count entries to check that we have room
+        uint entries = enumerate(nullptr, nullptr);
+        if (d >= DIR_INDEX_DIRS ||
+            4 * (dir_index_count + entries) > 3 * DIR_INDEX_SIZE)
+        {
+            if (4 * entries > 3 * DIR_INDEX_SIZE)
+                return this;    // Too large for the index
+            memset(dir_index, 0, sizeof(dir_index));
+            memset(dir_indexed, 0, sizeof(dir_indexed));
+            dir_index_count = 0;
+            d = 0;
+        }
+
+        record(directory, "Indexing directory %p with %u entries",
+               this, entries);
+        dir_indexed[d] = this;
+        byte_p   ip    = p;
+        size_t   isize = size;
+        while (isize)
+        {
+            object_p name = object_p(ip);
+            size_t   ns   = name->size();
+            object_p value = name + ns;
+            size_t   vs   = value->size();
+            if (ns + vs > isize)
+                break;
+            uint hash = directory_name_hash(this, name, ns);
+            uint i = hash & mask;
+            while (dir_index[i].name)
+                i = (i + 1) & mask;
+            dir_index[i].name = name;
+            dir_index[i].hash = hash;
+            dir_index_count++;
+            ip += ns + vs;
+            isize -= ns + vs;
+        }
+    }
+
+    // Probe the index
+    size_t   rsize = ref->size();
+    symbol_p rsym  = ref->as<symbol>();
+    uint     hash  = directory_name_hash(this, ref, rsize);
+    object_p first = object_p(p);
+    object_p last  = first + size;
+    for (uint i = hash & mask; dir_index[i].name; i = (i + 1) & mask)
+    {
+        object_p name = dir_index[i].name;
+        if (dir_index[i].hash == hash && name >= first && name < last)
+            if (directory_same_name(name, name->size(), ref, rsize, rsym))
+                return name;
+    }
+    return nullptr;
+}
+
+
 object_p directory::lookup(object_p ref) const
 // ----------------------------------------------------------------------------
 //   Find if the name exists in the directory, if so return pointer to it
 // ----------------------------------------------------------------------------
 {
+    object_p indexed = indexed_lookup(ref);
+    if (indexed != this)
+        return indexed;
+
     byte_p   p     = payload();
     size_t   size  = leb128<size_t>(p);
     size_t   rsize = ref->size();
@@ -390,24 +561,8 @@ object_p directory::lookup(object_p ref) const
     {
         object_p name = (object_p) p;
         size_t ns = name->size();
-        if (name == ref)          // Optimization when name is from directory
+        if (directory_same_name(name, ns, ref, rsize, rsym))
             return name;
-        if (ns == rsize)
-        {
-            if (rsym)
-            {
-                // Regular symbols: case insensitive comparison
-                if (symbol_p nsym = name->as<symbol>())
-                    if (rsym->is_same_as(nsym))
-                        return name;
-            }
-            else
-            {
-                // Special symbols, e.g. ΣData
-                if (memcmp(cstring(name), cstring(ref), rsize) == 0)
-                    return name;
-            }
-        }
 
         p += ns;
         object_p value = (object_p) p;
@@ -436,8 +591,13 @@ object_p directory::recall(object_p ref) const
 // ----------------------------------------------------------------------------
 {
     if (object_p found = lookup(ref))
-        // The value follows the name
-        return found->skip();
+    {
+        // The value follows the name, packed values are rebuilt
+        object_p value = found->skip();
+        if (value->type() == ID_packed)
+            return packed_p(value)->unpack();
+        return value;
+    }
     return nullptr;
 }
 
@@ -524,6 +684,55 @@ object_p directory::recall_all(object_p name, bool report_missing)
 }
 
 
+enum { RESOLVED_NAMES = 64 };           // Resolved names (power of 2)
+
+struct resolved_name
+// ----------------------------------------------------------------------------
+//   A name in a global program that was resolved to a global value
+// ----------------------------------------------------------------------------
+{
+    object_p    name;                   // Symbol in a global program
+    directory_p dir;                    // Current directory when resolved
+    object_p    value;                  // Resolved value
+    uint        generation;             // Generation when it was resolved
+};
+
+static resolved_name resolved[RESOLVED_NAMES];
+
+
+object_p directory::recall_resolved(object_p name)
+// ----------------------------------------------------------------------------
+//   Recall a symbol, caching the lookup for symbols in global objects
+// ----------------------------------------------------------------------------
+//   Symbols in global programs, e.g. loop bodies, are looked up repeatedly.
+//   The cached value remains valid until the current directory changes or
+//   global objects move or change, which bumps the directory generation.
+//   A directory identifies the whole search path, since its parents are
+//   the directories that physically contain it.
+{
+    if (!rt.is_global(name) || name->type() != ID_symbol ||
+        expression::independent || expression::dependent)
+        return recall_all(name, false);
+
+    directory_p    dir   = rt.variables(0);
+    uintptr_t      key   = uintptr_t(name);
+    resolved_name &entry = resolved[(key ^ (key >> 7)) & (RESOLVED_NAMES-1)];
+    if (entry.name == name && entry.dir == dir &&
+        entry.generation == generation)
+        return entry.value;
+
+    object_p value = recall_all(name, false);
+    if (value && rt.is_global(value))
+    {
+        entry.name = name;
+        entry.dir = dir;
+        entry.value = value;
+        entry.generation = generation;
+    }
+    return value;
+}
+
+
 object_p directory::store_here(object_p name, object_p value)
 // ----------------------------------------------------------------------------
 //  Store a variable in the current directory
@@ -622,6 +831,10 @@ size_t directory::purge(object_p name)
         object_p body   = header;
         size_t   old    = leb128<size_t>(body); // Old size of directory
 
+#if USE_STATE_JOURNAL
+        state_journal(thisdir, name, nullptr);
+#endif // USE_STATE_JOURNAL
+
         rt.clone_global(value, vs);
         rt.move_globals(name, name + purged);
 
@@ -659,17 +872,22 @@ size_t directory::purge_all(object_p namep)
 }
 
 
-size_t directory::enumerate(enumeration_fn callback, void *arg) const
+size_t directory::enumerate(enumeration_fn callback, void *arg,
+                            size_t first, size_t count) const
 // ----------------------------------------------------------------------------
-//   Process all the variables in turn, return number of true values
+//   Process variables in turn, return number of true values
 // ----------------------------------------------------------------------------
+//   The callback is only invoked for `count` variables starting at `first`,
+//   so that menus only build labels for the variables they actually show
 {
     gcbytes base  = payload();
     byte_p  p     = base;
     size_t  size  = leb128<size_t>(p);
-    size_t  count = 0;
+    size_t  last  = first + count < first ? ~0UL : first + count;
+    size_t  index = 0;
+    count = 0;
 
-    while (size)
+    while (size && index < last)
     {
         object_p name = object_p(p);
         size_t   ns   = name->size();
@@ -689,12 +907,15 @@ size_t directory::enumerate(enumeration_fn callback, void *arg) const
         }
 
         // Stash in a gcp: the callback may cause garbage collection
-        base = p;
-        if (!callback || callback(name, value, arg))
-            count++;
+        if (index++ >= first)
+        {
+            base = p;
+            if (!callback || callback(name, value, arg))
+                count++;
+            p = base;
+        }
 
         size -= (ns + vs);
-        p = base;
     }
 
     return count;
@@ -778,8 +999,16 @@ COMMAND_BODY(Sto)
 // ----------------------------------------------------------------------------
 {
     // Check that we have two objects in the stack
-    object_p name = rt.stack(0);
-    object_p value = rt.stack(1);
+    object_g name = rt.stack(0);
+    object_g value = rt.stack(1);
+
+    // Fold constants in programs if requested
+    if (value && value->type() == ID_program && Settings.CompilePrograms())
+    {
+        program_g source = program_p(+value);
+        value = compiled::make(source);
+    }
+
     if (name && value && directory::store_here(name, value))
     {
         rt.drop(2);
@@ -973,6 +1202,323 @@ COMMAND_BODY(Mem)
 }
 
 
+// ============================================================================
+//
+//   Packed global values
+//
+// ============================================================================
+//   Each sequence is a token with the number of literals in the high nibble
+//   and the match length minus PACK_MIN_MATCH in the low nibble, the value
+//   15 meaning that more length bytes follow, then the literals, then a
+//   two-byte offset back into the unpacked data. The last sequence only has
+//   literals, and ends where the original size is reached.
+
+enum
+{
+    PACK_MIN_MATCH      = 4,            // Shortest match that is encoded
+    PACK_HASH_BITS      = 12,           // Size of the match finder table
+    PACK_MAX_OFFSET     = 0xFFFF,       // Farthest match
+};
+
+
+static inline uint pack_hash(byte_p p)
+// ----------------------------------------------------------------------------
+//   Hash the next PACK_MIN_MATCH bytes
+// ----------------------------------------------------------------------------
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761U) >> (32 - PACK_HASH_BITS);
+}
+
+
+static byte *pack_length(byte *out, size_t len)
+// ----------------------------------------------------------------------------
+//   Write the remainder of a length that did not fit in the token
+// ----------------------------------------------------------------------------
+{
+    for (; len >= 255; len -= 255)
+        *out++ = 255;
+    *out++ = byte(len);
+    return out;
+}
+
+
+static byte *pack_sequence(byte *out, byte_p lit, size_t nlit,
+                           size_t offset, size_t match)
+// ----------------------------------------------------------------------------
+//   Write literals followed by a match, or only literals if match is 0
+// ----------------------------------------------------------------------------
+{
+    size_t mcode = match ? match - PACK_MIN_MATCH : 0;
+    *out++ = byte((nlit < 15 ? nlit : 15) << 4 | (mcode < 15 ? mcode : 15));
+    if (nlit >= 15)
+        out = pack_length(out, nlit - 15);
+    memcpy(out, lit, nlit);
+    out += nlit;
+    if (match)
+    {
+        *out++ = byte(offset);
+        *out++ = byte(offset >> 8);
+        if (mcode >= 15)
+            out = pack_length(out, mcode - 15);
+    }
+    return out;
+}
+
+
+static size_t pack_bytes(byte_p in, size_t size, byte *out, uint32_t *table)
+// ----------------------------------------------------------------------------
+//   Compress size bytes, return the compressed size
+// ----------------------------------------------------------------------------
+{
+    byte  *start  = out;
+    size_t anchor = 0;
+    size_t i      = 0;
+    memset(table, 0xFF, sizeof(uint32_t) << PACK_HASH_BITS);
+    while (i + PACK_MIN_MATCH <= size)
+    {
+        uint     h    = pack_hash(in + i);
+        uint32_t cand = table[h];
+        table[h] = i;
+        if (cand != ~0U && i - cand <= PACK_MAX_OFFSET &&
+            memcmp(in + cand, in + i, PACK_MIN_MATCH) == 0)
+        {
+            size_t len = PACK_MIN_MATCH;
+            while (i + len < size && in[cand + len] == in[i + len])
+                len++;
+            out = pack_sequence(out, in + anchor, i - anchor, i - cand, len);
+            i += len;
+            anchor = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    out = pack_sequence(out, in + anchor, size - anchor, 0, 0);
+    return out - start;
+}
+
+
+static bool unpack_bytes(byte_p in, size_t insize, byte *out, size_t size)
+// ----------------------------------------------------------------------------
+//   Uncompress exactly size bytes, return false if the data is inconsistent
+// ----------------------------------------------------------------------------
+{
+    byte_p end = in + insize;
+    size_t o   = 0;
+    while (in < end)
+    {
+        byte   token = *in++;
+        size_t nlit  = token >> 4;
+        if (nlit == 15)
+            for (byte b = 255; b == 255 && in < end; nlit += b)
+                b = *in++;
+        if (nlit > size - o || nlit > size_t(end - in))
+            return false;
+        memcpy(out + o, in, nlit);
+        in += nlit;
+        o += nlit;
+        if (o == size)
+            return in == end;
+
+        if (end - in < 2)
+            return false;
+        size_t offset = in[0] | (in[1] << 8);
+        size_t match  = (token & 15) + PACK_MIN_MATCH;
+        in += 2;
+        if ((token & 15) == 15)
+            for (byte b = 255; b == 255 && in < end; match += b)
+                b = *in++;
+        if (!offset || offset > o || match > size - o)
+            return false;
+        for (size_t m = 0; m < match; m++, o++)
+            out[o] = out[o - offset];
+    }
+    return false;
+}
+
+
+struct unpacked_object : object
+// ----------------------------------------------------------------------------
+//   Build the original object directly in a new temporary
+// ----------------------------------------------------------------------------
+{
+    unpacked_object(id type, packed_g src, bool *ok) : object(type)
+    {
+        size_t sz   = 0;
+        byte_p data = src->value(&sz);
+        byte_p p    = data;
+        size_t size = leb128<size_t>(p);
+        *ok = unpack_bytes(p, sz - (p - data), (byte *) this, size);
+    }
+
+    static size_t required_memory(id UNUSED type, packed_g src, bool *UNUSED ok)
+    {
+        return src->unpacked_size();
+    }
+};
+
+
+packed_p packed::make(object_r value)
+// ----------------------------------------------------------------------------
+//   Compress an object, return nullptr if that does not save memory
+// ----------------------------------------------------------------------------
+{
+    if (!value)
+        return nullptr;
+    size_t size   = value->size();
+    size_t header = leb128size(size);
+    size_t worst  = header + size + size / 255 + 16;
+    size_t table  = sizeof(uint32_t) << PACK_HASH_BITS;
+    scribble scr;
+    byte *buffer = rt.allocate(worst + table + sizeof(uint32_t)); // May GC
+    if (!buffer)
+        return nullptr;
+    uint32_t *hash = (uint32_t *) (uintptr_t(buffer + worst + 3) & ~3);
+    leb128(buffer, size);
+    size_t packed_size = header + pack_bytes(byte_p(+value), size,
+                                             buffer + header, hash);
+    record(directory, "Packed %u bytes into %u", size, packed_size);
+    if (packed_size + leb128size(packed_size) + 1 >= size)
+        return nullptr;
+    gcbytes data = buffer;
+    return rt.make<packed>(ID_packed, data, packed_size);
+}
+
+
+size_t packed::unpacked_size() const
+// ----------------------------------------------------------------------------
+//   The size of the original object
+// ----------------------------------------------------------------------------
+{
+    byte_p p = value(nullptr);
+    return leb128<size_t>(p);
+}
+
+
+object_p packed::unpack() const
+// ----------------------------------------------------------------------------
+//   Rebuild the original object as a temporary
+// ----------------------------------------------------------------------------
+{
+    packed_g src = this;
+    bool     ok  = false;
+    object_p obj = rt.make<unpacked_object>(ID_object, src, &ok);
+    if (!obj)
+        return nullptr;
+    if (!ok || obj->type() >= NUM_IDS || obj->size() != src->unpacked_size())
+    {
+        record(directory_error, "Inconsistent packed object %p", +src);
+        rt.invalid_object_error();
+        return nullptr;
+    }
+    return obj;
+}
+
+
+EVAL_BODY(packed)
+// ----------------------------------------------------------------------------
+//   Evaluate the original object
+// ----------------------------------------------------------------------------
+{
+    if (object_p obj = o->unpack())
+        return obj->evaluate();
+    return ERROR;
+}
+
+
+HELP_BODY(packed)
+// ----------------------------------------------------------------------------
+//   Help topic for packed values
+// ----------------------------------------------------------------------------
+{
+    return utf8("Packed variables");
+}
+
+
+RENDER_BODY(packed)
+// ----------------------------------------------------------------------------
+//   Render the original object, so that saved states keep the value
+// ----------------------------------------------------------------------------
+{
+    if (object_g obj = o->unpack())
+        obj->render(r);
+    return r.size();
+}
+
+
+static object::result pack_variable(bool pack)
+// ----------------------------------------------------------------------------
+//   Replace a variable in the current directory with its packed form or back
+// ----------------------------------------------------------------------------
+{
+    object_g name = rt.stack(0);
+    if (!name)
+        return object::ERROR;
+    if (object_p quoted = name->as_quoted(object::ID_object))
+        name = quoted;
+
+    directory *dir = rt.variables(0);
+    if (!dir)
+    {
+        rt.no_directory_error();
+        return object::ERROR;
+    }
+    object_p found = dir->lookup(name);
+    if (!found)
+    {
+        rt.undefined_name_error();
+        return object::ERROR;
+    }
+
+    // Directories must remain directories to be entered and searched
+    object_g value = found->skip();
+    if (pack && value->type() == object::ID_directory)
+    {
+        rt.type_error();
+        return object::ERROR;
+    }
+
+    object_g replaced = nullptr;
+    bool     is_packed = value->type() == object::ID_packed;
+    if (pack && !is_packed)
+        replaced = packed::make(value);
+    else if (!pack && is_packed)
+        replaced = packed_p(+value)->unpack();
+    if (rt.error())
+        return object::ERROR;
+
+    if (replaced)
+    {
+        dir = rt.variables(0);
+        if (!dir->store(name, replaced))
+            return object::ERROR;
+    }
+    rt.drop();
+    return object::OK;
+}
+
+
+COMMAND_BODY(Pack)
+// ----------------------------------------------------------------------------
+//   Compress a variable in the current directory if this saves memory
+// ----------------------------------------------------------------------------
+{
+    return pack_variable(true);
+}
+
+
+COMMAND_BODY(Unpack)
+// ----------------------------------------------------------------------------
+//   Store the uncompressed value of a packed variable
+// ----------------------------------------------------------------------------
+{
+    return pack_variable(false);
+}
+
+
 COMMAND_BODY(GarbageCollect)
 // ----------------------------------------------------------------------------
 //   Run the garbage collector
@@ -997,16 +1543,23 @@ COMMAND_BODY(GarbageCollectorStatistics)
     tag_g lpurged   = tag::make("LastPurged",   integer::make(rt.GCLPurged));
     tag_g lduration = tag::make("LastDuration", integer::make(rt.GCLDuration));
     tag_g cleared   = tag::make("Cleared",      integer::make(rt.GCCleared));
+    tag_g minor     = tag::make("Young",        integer::make(rt.GCMinor));
+    tag_g allocated = tag::make("Allocated",    integer::make(rt.GCAllocated));
+    tag_g moved     = tag::make("Moved",        integer::make(rt.GCMoved));
 
-    if (cycles && purged && duration && lpurged && lduration && cleared)
+    if (cycles && purged && duration && lpurged && lduration && cleared &&
+        minor && allocated && moved)
     {
         scribble scr;
         if (rt.append(cycles)    &&
+            rt.append(minor)     &&
             rt.append(purged)    &&
             rt.append(duration)  &&
             rt.append(lpurged)   &&
             rt.append(lduration) &&
-            rt.append(cleared))
+            rt.append(cleared)   &&
+            rt.append(allocated) &&
+            rt.append(moved))
         {
             size_t sz = scr.growth();
             gcbytes data = scr.scratch();
@@ -1017,11 +1570,14 @@ COMMAND_BODY(GarbageCollectorStatistics)
                     if (Settings.GCStatsClearAfterRead())
                     {
                         rt.GCCycles            = 0;
+                        rt.GCMinor             = 0;
                         rt.GCPurged            = 0;
                         rt.GCDuration          = 0;
                         rt.GCLPurged           = 0;
                         rt.GCLDuration         = 0;
                         rt.GCCleared           = 0;
+                        rt.GCAllocated         = 0;
+                        rt.GCMoved             = 0;
                     }
                     return OK;
                 }
@@ -1059,6 +1615,150 @@ COMMAND_BODY(SystemMemory)
 }
 
 
+static uint32_t memmap_temporaries[object::NUM_IDS];
+static uint32_t memmap_variables[object::NUM_IDS];
+
+static bool memmap_variable(object_p name, object_p value, void *)
+// ----------------------------------------------------------------------------
+//   Count bytes of a variable by type, looking inside directories
+// ----------------------------------------------------------------------------
+{
+    memmap_variables[name->type()] += name->size();
+    if (directory_p dir = value->as<directory>())
+        dir->enumerate(memmap_variable, nullptr);
+    else
+        memmap_variables[value->type()] += value->size();
+    return true;
+}
+
+
+static bool memmap_append(cstring name, size_t bytes)
+// ----------------------------------------------------------------------------
+//   Append a Name:bytes entry to the scratchpad
+// ----------------------------------------------------------------------------
+{
+    tag_g entry = tag::make(name, integer::make(bytes));
+    return entry && rt.append(entry);
+}
+
+
+static list_p memmap_types(uint32_t *bytes)
+// ----------------------------------------------------------------------------
+//   Return a list of Type:bytes entries, largest first
+// ----------------------------------------------------------------------------
+{
+    scribble scr;
+    for (;;)
+    {
+        uint best = 0;
+        for (uint i = 1; i < object::NUM_IDS; i++)
+            if (bytes[i] > bytes[best])
+                best = i;
+        if (!bytes[best])
+            break;
+        if (!memmap_append(cstring(object::fancy(object::id(best))),
+                           bytes[best]))
+            return nullptr;
+        bytes[best] = 0;
+    }
+    gcbytes data = scr.scratch();
+    return list::make(object::ID_list, data, scr.growth());
+}
+
+
+COMMAND_BODY(MemoryMap)
+// ----------------------------------------------------------------------------
+//   Return bytes used per memory area and per object type
+// ----------------------------------------------------------------------------
+//   Temporaries are walked as they are, including garbage not yet collected.
+//   Variables are counted through directories, so that a large directory
+//   shows as the objects it contains. For pointer areas, the Held entries
+//   give the size of temporaries they refer to, i.e. what they keep the GC
+//   from recycling. A temporary referenced from two areas counts in both.
+{
+    const size_t ptr = sizeof(object_p);
+    struct memmap_area
+    {
+        cstring   name;
+        object_p *low, *high;
+        bool      objects;      // Points to object starts
+        size_t    held;
+    } areas[] =
+    {
+        { "Stack",       rt.Stack,       rt.Args,        true,  0 },
+        { "LastArgs",    rt.Args,        rt.Undo,        true,  0 },
+        { "Undo",        rt.Undo,        rt.Locals,      true,  0 },
+        { "Locals",      rt.Locals,      rt.Directories, true,  0 },
+        { "Directories", rt.Directories, rt.XLibs,       false, 0 },
+        { "Libraries",   rt.XLibs,       rt.Constants,   true,  0 },
+        { "Constants",   rt.Constants,   rt.CallStack,   true,  0 },
+        { "Calls",       rt.CallStack,   rt.HighMem,     false, 0 },
+    };
+    const uint count = sizeof(areas) / sizeof(areas[0]);
+
+    // Gather everything before allocating anything
+    memset(memmap_temporaries, 0, sizeof(memmap_temporaries));
+    memset(memmap_variables, 0, sizeof(memmap_variables));
+    for (object_p obj = rt.Globals; obj < rt.Temporaries; obj = obj->skip())
+        memmap_temporaries[obj->type()] += obj->size();
+    rt.homedir()->enumerate(memmap_variable, nullptr);
+    for (uint a = 0; a < count; a++)
+        if (areas[a].objects)
+            for (object_p *p = areas[a].low; p < areas[a].high; p++)
+                if (*p >= rt.Globals && *p < rt.Temporaries)
+                    areas[a].held += (*p)->size();
+    size_t globals = rt.Globals - rt.LowMem;
+    size_t temps   = rt.Temporaries - rt.Globals;
+    size_t editor  = rt.Editing;
+    size_t scratch = rt.Scratch;
+    size_t avail   = rt.available();
+    size_t stfree  = rt.StackLow ? (rt.Stack - rt.StackLow) * ptr : 0;
+    size_t ext     = rt.ExtLow ? rt.ExtTemporaries - rt.ExtLow : 0;
+
+    list_g area_list, held_list;
+    {
+        scribble scr;
+        if (!memmap_append("Globals", globals) ||
+            !memmap_append("Temporaries", temps) ||
+            !memmap_append("Editor", editor) ||
+            !memmap_append("Scratch", scratch) ||
+            !memmap_append("Free", avail) ||
+            (rt.StackLow && !memmap_append("StackFree", stfree)) ||
+            (rt.ExtLow && !memmap_append("Extended", ext)))
+            return ERROR;
+        for (uint a = 0; a < count; a++)
+            if (!memmap_append(areas[a].name,
+                               (areas[a].high - areas[a].low) * ptr))
+                return ERROR;
+        gcbytes data = scr.scratch();
+        area_list = list::make(ID_list, data, scr.growth());
+    }
+    {
+        scribble scr;
+        for (uint a = 0; a < count; a++)
+            if (areas[a].objects && !memmap_append(areas[a].name, areas[a].held))
+                return ERROR;
+        gcbytes data = scr.scratch();
+        held_list = list::make(ID_list, data, scr.growth());
+    }
+    list_g temp_list = memmap_types(memmap_temporaries);
+    list_g var_list  = memmap_types(memmap_variables);
+    if (!area_list || !held_list || !temp_list || !var_list)
+        return ERROR;
+
+    tag_g areas_tag = tag::make("Areas",       +area_list);
+    tag_g held_tag  = tag::make("Held",        +held_list);
+    tag_g temps_tag = tag::make("Temporaries", +temp_list);
+    tag_g vars_tag  = tag::make("Variables",   +var_list);
+    if (!areas_tag || !held_tag || !temps_tag || !vars_tag)
+        return ERROR;
+    list_g result = list::make(areas_tag, held_tag, temps_tag, vars_tag);
+    if (result && rt.push(+result))
+        return OK;
+    return ERROR;
+}
+
+
 COMMAND_BODY(Home)
 // ----------------------------------------------------------------------------
 //   Return the home directory
@@ -1368,20 +2068,21 @@ void VariablesMenu::list_variables(info &mi)
         return;
     }
 
+    // Only visit the variables shown on the current page
     uint skip = mi.skip;
+    uint keys = ui.NUM_SOFTKEYS;
+    mi.skip   = 0;
     mi.plane  = 0;
     mi.planes = 1;
-    dir->enumerate(evaluate_variable, &mi);
+    dir->enumerate(evaluate_variable, &mi, skip, keys);
     mi.plane  = 1;
     mi.planes = 2;
-    mi.skip   = skip;
     mi.index  = mi.plane * ui.NUM_SOFTKEYS;
-    dir->enumerate(recall_variable, &mi);
+    dir->enumerate(recall_variable, &mi, skip, keys);
     mi.plane  = 2;
     mi.planes = 3;
     mi.index  = mi.plane * ui.NUM_SOFTKEYS;
-    mi.skip   = skip;
-    dir->enumerate(store_variable, &mi);
+    dir->enumerate(store_variable, &mi, skip, keys);
 
     for (uint k = 0; k < ui.NUM_SOFTKEYS - (mi.pages > 1); k++)
     {
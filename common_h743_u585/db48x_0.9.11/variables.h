@@ -49,6 +49,11 @@
 //   fine. Note that local variables, which are more important for the
 //   performance of programs.
 //
+//   For large global directories, a side hash index maps names to their
+//   position in the directory. Global directories only move when some global
+//   object is stored or purged, so the index is built lazily and dropped
+//   every time globals move, which bumps directory::generation.
+//
 //   Catalogs are the only mutable RPL objects.
 //   They can change when objects are stored or purged.
 
@@ -106,6 +111,11 @@ struct directory : list
     //    Check if a name exists in the directory, return value ptr if it does
     // ------------------------------------------------------------------------
 
+    static object_p recall_resolved(object_p name);
+    // ------------------------------------------------------------------------
+    //    Recall a name, remembering the result for names in global programs
+    // ------------------------------------------------------------------------
+
     static object_p store_here(object_p name, object_p value);
     // ------------------------------------------------------------------------
     //    Store in the current directory, or fail if it does not exist
@@ -151,9 +161,10 @@ struct directory : list
 
 
     typedef bool (*enumeration_fn)(object_p name, object_p obj, void *arg);
-    size_t enumerate(enumeration_fn callback, void *arg) const;
+    size_t enumerate(enumeration_fn callback, void *arg,
+                     size_t first = 0, size_t count = ~0UL) const;
     // ------------------------------------------------------------------------
-    //   Enumerate all the variables in the directory, return count of true
+    //   Enumerate variables in the directory, return count of true
     // ------------------------------------------------------------------------
 
     static bool render_name(object_p name, object_p obj, void *renderer_ptr);
@@ -176,6 +187,16 @@ struct directory : list
     //   Check if something is a valid symbol
     // ------------------------------------------------------------------------
 
+    static void globals_moved()
+    // ------------------------------------------------------------------------
+    //   Indicate that global objects moved, invalidating name indexes
+    // ------------------------------------------------------------------------
+    {
+        generation++;
+    }
+
+    static uint generation;     // Changes each time global objects move
+
 public:
     OBJECT_DECL(directory);
     PARSE_DECL(directory);
@@ -183,6 +204,34 @@ public:
 
 private:
     static void adjust_sizes(directory_r dir, int delta);
+    object_p    indexed_lookup(object_p ref) const;
+};
+
+
+GCP(packed);
+
+struct packed : text
+// ----------------------------------------------------------------------------
+//   A compressed global value, unpacked into a temporary when recalled
+// ----------------------------------------------------------------------------
+//   The payload is the size of the original object, followed by its bytes
+//   compressed with a byte-oriented LZ77 in the style of LZ4. Only values
+//   stored with the Pack command are compressed, since each recall has to
+//   unpack them, so it is meant for large and rarely used variables.
+//   directory::recall unpacks them, so that all lookups see the original.
+//   Directories are never packed, since they are entered and searched.
+{
+    packed(id type, gcbytes data, size_t len): text(type, data, len) {}
+
+    static packed_p make(object_r value);
+    object_p        unpack() const;
+    size_t          unpacked_size() const;
+
+public:
+    OBJECT_DECL(packed);
+    EVAL_DECL(packed);
+    HELP_DECL(packed);
+    RENDER_DECL(packed);
 };
 
 
@@ -209,6 +258,9 @@ COMMAND_DECLARE(TVars, 1);
 COMMAND_DECLARE(Mem,0);
 COMMAND_DECLARE(FreeMemory,0);
 COMMAND_DECLARE(SystemMemory,0);
+COMMAND_DECLARE(MemoryMap,0);
+COMMAND_DECLARE(Pack,1);
+COMMAND_DECLARE(Unpack,1);
 COMMAND_DECLARE(GarbageCollect,0);
 COMMAND_DECLARE(GarbageCollectorStatistics,0);
 
@@ -12,6 +12,9 @@ undefined symbol hrtc referenced by symbol rtc_read (section .text.rtc_read in f
 //#include "IP.h"
 #include <stdio.h>
 #include "LS027B7DH01.h"
+#if USE_SDMMC_DMA
+#include "FS.h"
+#endif
 
 OS_MAILBOX      Mb_Keyboard;
 //OS_EVENT  _EV_KEYB;
@@ -19,6 +22,23 @@ OS_MAILBOX      Mb_Keyboard;
 
 uint32_t Cnt_ms ;       // à éviter
 uint64_t scrut_last;
+volatile uint32_t kb_exit_posted = 0;
+volatile uint32_t kb_exit_taken = 0;
+#if USE_RTT_SCRIPT
+volatile uint32_t script_posted = 0;
+#endif // USE_RTT_SCRIPT
+#if USE_MSC_SNAPSHOT
+volatile uint32_t msc_changed = 0;
+volatile uint32_t msc_posted = 0;
+volatile uint32_t msc_last_write = 0;
+
+void msc_host_write(void)
+{
+   // Record time of the last write, KbdTask waits for the host to be idle
+   msc_last_write = sys_current_ms();
+   msc_changed = 1;
+}
+#endif // USE_MSC_SNAPSHOT
 bool usb_connected;
 int aa;  // for compiling tests.cc
 
@@ -35,6 +55,14 @@ uint32_t blink_cnt=0;
 
 void Ti_cb_Count_ms(void)
 {
+#if USE_TICKLESS_IDLE
+   // No heartbeat, so that this timer does not wake up the core every 2 ms.
+   // It runs again while blink_error() shows an error sequence.
+   if (blink_seq_nb == blk_ok){
+      BSP_ClrLED(0);
+      return;
+   }
+#endif // USE_TICKLESS_IDLE
    OS_TIMER_Restart(&T_Cnt_ms);
    Cnt_ms += 2;
 
@@ -55,10 +83,138 @@ void blink_error(uint32_t errnb){
       blink_seq_nb = errnb;
       blink_seq=0;
       blink_cnt=0;
+#if USE_TICKLESS_IDLE
+      if (errnb != blk_ok) OS_TIMER_Restart(&T_Cnt_ms);
+#endif // USE_TICKLESS_IDLE
+   }
+}
+
+
+#if USE_TICKLESS_IDLE
+// ============================================================================
+//
+//   Tickless idle
+//
+// ============================================================================
+/* OS_Idle() calls db_idle() in a loop while all tasks wait. The system tick
+   is stopped, and the RTC wake-up timer is programmed for the next embOS
+   timeout, i.e. the next keyboard poll, the end of the RPL task wait or a
+   task delay. A key press wakes up earlier through the column EXTI lines.
+   Long waits use STOP mode if the RPL task waits for a key with no write or
+   LCD transfer in flight, since STOP mode also stops the SPI and SD clocks.
+   Leaving STOP mode restarts the PLL, which is why short waits use WFI. */
+
+// Ticks counted by the RTC wake-up timer, RTCCLK/16 for a 32768 Hz LSE
+#define IDLE_RTC_HZ           (2048)
+// Longest wait, below one turn of the RTC sub-second counter
+#define IDLE_MAX_TICKS        (999)
+
+extern void SystemClock_Config(void);
+
+volatile uint32_t idle_stop_allowed  = 0;
+volatile uint32_t idle_wakeup_us     = 0;
+volatile uint32_t idle_wakeup_us_max = 0;
+static OS_TIME    idle_elapsed       = 0;
+static bool       idle_tickless      = false;
+
+
+static uint32_t idle_rtc_ssr(void)
+{
+   uint32_t ssr = RTC->SSR;
+   (void) RTC->DR;                      // Unlock the calendar shadow registers
+   return ssr;
+}
+
+
+static void idle_end(void)
+/* Called by embOS on the first interrupt after OS_TICKLESS_Start(),
+   and by db_idle() itself in case no embOS interrupt woke the core up */
+{
+   if (!idle_tickless)
+      return;
+   idle_tickless = false;
+   OS_TICKLESS_AdjustTime(idle_elapsed);
+   SysTick->VAL = 0;
+   SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+   OS_TICKLESS_Stop();
+}
+
+
+void db_idle(void)
+{
+   static bool started = false;
+
+   OS_INT_Disable();
+   OS_TIME idle = OS_TICKLESS_GetNumIdleTicks();
+   if (idle < TICKLESS_MIN_TICKS){
+      OS_INT_Enable();
+      __WFI();
+      return;
+   }
+   if (!started){
+      NVIC_SetPriority(RTC_WKUP_IRQn, NVIC_GetPriority(COL_1_EXTI_IRQn));
+      NVIC_EnableIRQ(RTC_WKUP_IRQn);
+      started = true;
    }
+   if (idle > IDLE_MAX_TICKS)
+      idle = IDLE_MAX_TICKS;
+
+   bool stop = idle >= TICKLESS_STOP_TICKS && idle_stop_allowed &&
+               hlcd.transfer_complete;
+   uint32_t prescaler = hrtc.Init.SynchPrediv + 1;
+   uint32_t counts = (uint32_t) idle * IDLE_RTC_HZ / 1000;
+   uint32_t ssr = idle_rtc_ssr();
+
+   HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, counts - 1, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
+   idle_elapsed = idle;
+   idle_tickless = true;
+   OS_TICKLESS_Start(idle, &idle_end);
+   SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+   SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+
+   // Wake up on pending interrupts, but only take them once clocks run again
+   __disable_irq();
+   OS_INT_Enable();
+   if (stop){
+      uint32_t d1cpre = RCC->D1CFGR & RCC_D1CFGR_D1CPRE;
+      HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+      uint32_t start = DWT->CYCCNT;
+      SystemClock_Config();
+      // Keep the divider of the clock governor, SysTick was set up for it
+      MODIFY_REG(RCC->D1CFGR, RCC_D1CFGR_D1CPRE, d1cpre);
+      SystemCoreClockUpdate();
+      // Counted as if running from HSI all along, so rather pessimistic
+      uint32_t us = (DWT->CYCCNT - start) / (HSI_VALUE / 1000000);
+      idle_wakeup_us = us;
+      if (us > idle_wakeup_us_max) idle_wakeup_us_max = us;
+      HAL_RTC_WaitForSynchro(&hrtc);    // Shadow registers stop in STOP mode
+   } else {
+      __WFI();
+   }
+
+   if (!__HAL_RTC_WAKEUPTIMER_GET_FLAG(&hrtc, RTC_FLAG_WUTF)){
+      // Woken up early, e.g. by a key: count elapsed sub-seconds
+      uint32_t sub = (ssr + prescaler - idle_rtc_ssr()) % prescaler;
+      OS_TIME elapsed = (OS_TIME) (sub * 1000 / prescaler);
+      if (elapsed < idle)
+         idle_elapsed = elapsed;
+   }
+   HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
+   OS_INT_Disable();
+   idle_end();
+   OS_INT_Enable();
+   __enable_irq();
 }
 
 
+void RTC_WKUP_IRQHandler(void){
+   OS_INT_Enter();
+   HAL_RTCEx_WakeUpTimerIRQHandler(&hrtc);
+   OS_INT_Leave();
+}
+#endif // USE_TICKLESS_IDLE
+
+
 void Error_Handler(void){
    while(1){
       OS_TASK_Delay(50);
@@ -264,7 +420,7 @@ void bkSRAM_WriteString(uint16_t read_adress, char* write_data, uint32_t length)
    BKPSRAM_CLK_ON;
 // char * pstring =  (char*) (0x38800000 + read_adress*0x100);
    memcpy( (void*) (BKPSRAM_ADD + read_adress*0x100), write_data, siz);
-   #if  DBh743
+   #if  DBh743 && !USE_MPU_PROFILE
       SCB_CleanDCache_by_Addr((uint32_t *)(BKPSRAM_ADD + read_adress),256);
    #endif
    BKPSRAM_CLK_OFF;
@@ -285,13 +441,464 @@ void bkSRAM_WriteVariable(uint16_t write_adress,uint32_t vall)
    HAL_PWR_EnableBkUpAccess();
    BKPSRAM_CLK_ON;
    *(__IO uint32_t*)(BKPSRAM_ADD + write_adress) = vall ;
-   #if  DBh743
+   #if  DBh743 && !USE_MPU_PROFILE
       SCB_CleanDCache_by_Addr((uint32_t *)(BKPSRAM_ADD + write_adress),8);
    #endif
    BKPSRAM_CLK_OFF;
    HAL_PWR_DisableBkUpAccess();
 }
 
+bool bkSRAM_Read(uint32_t offset, void *data, uint32_t length)
+{
+   if (offset > BKPSRAM_SIZE || length > BKPSRAM_SIZE - offset)
+      return false;
+   HAL_PWR_EnableBkUpAccess();
+   BKPSRAM_CLK_ON;
+   memcpy(data, (void *)(BKPSRAM_ADD + offset), length);
+   BKPSRAM_CLK_OFF;
+   HAL_PWR_DisableBkUpAccess();
+   return true;
+}
+
+bool bkSRAM_Write(uint32_t offset, const void *data, uint32_t length)
+{
+   if (offset > BKPSRAM_SIZE || length > BKPSRAM_SIZE - offset)
+      return false;
+   HAL_PWR_EnableBkUpAccess();
+   BKPSRAM_CLK_ON;
+   memcpy((void *)(BKPSRAM_ADD + offset), data, length);
+   #if  DBh743 && !USE_MPU_PROFILE
+      SCB_CleanDCache_by_Addr((uint32_t *)(BKPSRAM_ADD + offset), length);
+   #endif
+   BKPSRAM_CLK_OFF;
+   HAL_PWR_DisableBkUpAccess();
+   return true;
+}
+
+
+#if USE_MPU_PROFILE
+/*  MPU and cache policy
+    The regions replace whatever the startup code left. Higher region
+    numbers win where regions overlap. Everything not covered keeps the
+    default memory map, e.g. flash and the memory-mapped QSPI.
+    - AXI SRAM (runtime memory, sdmmc_bounce) and D2 SRAM1/2 (pinned files):
+      normal, write-back, read and write allocate
+    - SRAM3: normal, not cacheable, for DMA buffers (DMA_BUFFER_SECTION),
+      so that the DMA always sees what the CPU wrote
+    - Backup SRAM: write-through, so that writes reach it without a clean
+    - Peripherals: shareable device, never executed
+*/
+static void mpu_region(uint8_t number, uint32_t base, uint8_t size,
+                       uint8_t tex, uint8_t cacheable, uint8_t bufferable,
+                       uint8_t shareable, uint8_t no_exec)
+{
+   MPU_Region_InitTypeDef region = {0};
+   region.Enable           = MPU_REGION_ENABLE;
+   region.Number           = number;
+   region.BaseAddress      = base;
+   region.Size             = size;
+   region.SubRegionDisable = 0x00;
+   region.TypeExtField     = tex;
+   region.AccessPermission = MPU_REGION_FULL_ACCESS;
+   region.DisableExec      = no_exec;
+   region.IsShareable      = shareable;
+   region.IsCacheable      = cacheable;
+   region.IsBufferable     = bufferable;
+   HAL_MPU_ConfigRegion(&region);
+}
+
+void mpu_configure(void)
+{
+   uint32_t primask = __get_PRIMASK();
+   __disable_irq();
+
+   // Dirty lines must reach memory before some of it becomes uncached
+   SCB_CleanInvalidateDCache();
+   HAL_MPU_Disable();
+
+   mpu_region(0, 0x24000000, MPU_REGION_SIZE_512KB,
+              MPU_TEX_LEVEL1, MPU_ACCESS_CACHEABLE, MPU_ACCESS_BUFFERABLE,
+              MPU_ACCESS_NOT_SHAREABLE, MPU_INSTRUCTION_ACCESS_ENABLE);
+   mpu_region(1, 0x30000000, MPU_REGION_SIZE_256KB,
+              MPU_TEX_LEVEL1, MPU_ACCESS_CACHEABLE, MPU_ACCESS_BUFFERABLE,
+              MPU_ACCESS_NOT_SHAREABLE, MPU_INSTRUCTION_ACCESS_DISABLE);
+   mpu_region(2, 0x30040000, MPU_REGION_SIZE_32KB,
+              MPU_TEX_LEVEL1, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE,
+              MPU_ACCESS_SHAREABLE, MPU_INSTRUCTION_ACCESS_DISABLE);
+   mpu_region(3, BKPSRAM_ADD, MPU_REGION_SIZE_4KB,
+              MPU_TEX_LEVEL0, MPU_ACCESS_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE,
+              MPU_ACCESS_NOT_SHAREABLE, MPU_INSTRUCTION_ACCESS_DISABLE);
+   mpu_region(4, 0x40000000, MPU_REGION_SIZE_512MB,
+              MPU_TEX_LEVEL0, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_BUFFERABLE,
+              MPU_ACCESS_SHAREABLE, MPU_INSTRUCTION_ACCESS_DISABLE);
+
+   HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+   __set_PRIMASK(primask);
+   SEGGER_RTT_printf(0, "\nMPU profile set");
+}
+#endif // USE_MPU_PROFILE
+
+
+#if USE_XIP_LIBRARY
+/*  QSPI user area of the DMCP API
+   On the h743, this is the top of internal flash bank 2, which is always
+   memory-mapped. Writes are in whole 32-byte flash words, and erasing
+   clears the whole area.
+*/
+#define XIP_LIBRARY_WORD  (32)
+
+uint8_t *qspi_user_addr()
+{
+   return (uint8_t *) XIP_LIBRARY_BASE;
+}
+
+int qspi_user_size()
+{
+   return XIP_LIBRARY_SIZE;
+}
+
+int qspi_user_write(uint8_t *data, int size, int offset, int erase)
+{
+   bool ok = true;
+   if (offset < 0 || size < 0 || offset > XIP_LIBRARY_SIZE ||
+       size > XIP_LIBRARY_SIZE - offset ||
+       (offset % XIP_LIBRARY_WORD) || (size % XIP_LIBRARY_WORD))
+      return -1;
+
+   HAL_FLASH_Unlock();
+   if (erase)
+   {
+      FLASH_EraseInitTypeDef sectors = {0};
+      uint32_t               failed  = 0;
+      sectors.TypeErase    = FLASH_TYPEERASE_SECTORS;
+      sectors.Banks        = FLASH_BANK_2;
+      sectors.Sector       = XIP_LIBRARY_SECTOR;
+      sectors.NbSectors    = XIP_LIBRARY_SIZE / FLASH_SECTOR_SIZE;
+      sectors.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+      ok = HAL_FLASHEx_Erase(&sectors, &failed) == HAL_OK;
+   }
+   for (int i = 0; ok && i < size; i += XIP_LIBRARY_WORD)
+   {
+      uint32_t word[XIP_LIBRARY_WORD / sizeof(uint32_t)];
+      memcpy(word, data + i, XIP_LIBRARY_WORD);
+      ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD,
+                             XIP_LIBRARY_BASE + offset + i,
+                             (uint32_t) word) == HAL_OK;
+   }
+   HAL_FLASH_Lock();
+
+   // Reads after this must see the new flash contents
+   if (erase)
+      SCB_InvalidateDCache_by_Addr((uint32_t *) XIP_LIBRARY_BASE,
+                                   XIP_LIBRARY_SIZE);
+   else if (size)
+      SCB_InvalidateDCache_by_Addr((uint32_t *) (XIP_LIBRARY_BASE + offset),
+                                   size);
+   return ok ? 0 : -1;
+}
+#endif // USE_XIP_LIBRARY
+
+
+#if USE_MDMA_MOVE
+/*  Memory moves with MDMA
+   The MDMA only copies whole cache lines of the destination, so that they can
+   be invalidated without losing CPU writes. The unaligned head and tail are
+   copied by the CPU, before or after the DMA depending on the direction, and
+   chunks are never larger than the move distance, so they never overlap.
+*/
+#define MDMA_MOVE_CHUNK   (65536)
+#define MDMA_MOVE_LINE    (32)
+
+static MDMA_HandleTypeDef hmdma_move;
+static bool mdma_move_ready = false;
+static bool mdma_move_failed = false;
+
+static bool mdma_move_init(void)
+{
+   __HAL_RCC_MDMA_CLK_ENABLE();
+   hmdma_move.Instance                      = MDMA_Channel0;
+   hmdma_move.Init.Request                  = MDMA_REQUEST_SW;
+   hmdma_move.Init.TransferTriggerMode      = MDMA_BLOCK_TRANSFER;
+   hmdma_move.Init.Priority                 = MDMA_PRIORITY_HIGH;
+   hmdma_move.Init.Endianness               = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+   hmdma_move.Init.SourceInc                = MDMA_SRC_INC_BYTE;
+   hmdma_move.Init.DestinationInc           = MDMA_DEST_INC_BYTE;
+   hmdma_move.Init.SourceDataSize           = MDMA_SRC_DATASIZE_BYTE;
+   hmdma_move.Init.DestDataSize             = MDMA_DEST_DATASIZE_BYTE;
+   hmdma_move.Init.DataAlignment            = MDMA_DATAALIGN_PACKENABLE;
+   hmdma_move.Init.BufferTransferLength     = 128;
+   hmdma_move.Init.SourceBurst              = MDMA_SOURCE_BURST_SINGLE;
+   hmdma_move.Init.DestBurst                = MDMA_DEST_BURST_SINGLE;
+   hmdma_move.Init.SourceBlockAddressOffset = 0;
+   hmdma_move.Init.DestBlockAddressOffset   = 0;
+   return HAL_MDMA_Init(&hmdma_move) == HAL_OK;
+}
+
+void mdma_move(void *to, const void *from, uint32_t size)
+{
+   uint8_t *dst = (uint8_t *) to;
+   const uint8_t *src = (const uint8_t *) from;
+   uint32_t dist = dst > src ? dst - src : src - dst;
+
+   if (size < MDMA_MOVE_THRESHOLD || dist < MDMA_MOVE_THRESHOLD || mdma_move_failed){
+      memmove(to, from, size);
+      return;
+   }
+   if (!mdma_move_ready){
+      mdma_move_ready = mdma_move_init();
+      mdma_move_failed = !mdma_move_ready;
+      if (mdma_move_failed){
+         memmove(to, from, size);
+         return;
+      }
+   }
+
+   // Whole destination cache lines are done by DMA, the rest by CPU
+   uint32_t head = (MDMA_MOVE_LINE - ((uintptr_t) dst % MDMA_MOVE_LINE)) % MDMA_MOVE_LINE;
+   uint32_t tail = ((uintptr_t) dst + size) % MDMA_MOVE_LINE;
+   uint32_t body = size - head - tail;
+   bool down = dst < src;
+
+   // Edge that must be copied first so that its source is not overwritten
+   if (down)
+      memmove(dst, src, head);
+   else
+      memmove(dst + size - tail, src + size - tail, tail);
+
+   // write back dirty lines, MDMA reads memory, not the D-cache
+   const uint8_t *lo = down ? dst : src;
+   uintptr_t first = (uintptr_t) lo & ~(MDMA_MOVE_LINE - 1);
+   uintptr_t last = (uintptr_t) lo + dist + size;
+   SCB_CleanDCache_by_Addr((uint32_t *) first, last - first);
+
+   uint32_t chunk = dist < MDMA_MOVE_CHUNK ? dist : MDMA_MOVE_CHUNK;
+   uint32_t done = 0;
+   while (done < body){
+      uint32_t len = body - done < chunk ? body - done : chunk;
+      uint32_t off = head + (down ? done : body - done - len);
+      if (HAL_MDMA_Start(&hmdma_move, (uint32_t) (src + off), (uint32_t) (dst + off), len, 1) != HAL_OK
+          || HAL_MDMA_PollForTransfer(&hmdma_move, HAL_MDMA_FULL_TRANSFER, 100) != HAL_OK){
+         SEGGER_RTT_printf(0, "MDMA move error %x\n", HAL_MDMA_GetError(&hmdma_move));
+         HAL_MDMA_Abort(&hmdma_move);
+         mdma_move_failed = true;
+         break;
+      }
+      done += len;
+   }
+
+   // Drop stale destination lines, they only hold bytes written by DMA
+   SCB_InvalidateDCache_by_Addr((uint32_t *) (dst + head), body);
+
+   // On error, finish with the CPU: the remaining source was not touched
+   if (done < body){
+      if (down)
+         memmove(dst + head + done, src + head + done, body - done);
+      else
+         memmove(dst + head, src + head, body - done);
+   }
+
+   // Edge that must be copied last
+   if (down)
+      memmove(dst + size - tail, src + size - tail, tail);
+   else
+      memmove(dst, src, head);
+}
+#endif
+
+
+#if USE_SDMMC_DMA
+/*  SD card on SDMMC1
+   The card uses a 4-bit bus, and reads and writes of many sectors are a
+   single multi-block command using the SDMMC internal DMA, which emFile
+   sees as a plain device driver. The IDMA only reaches AXI SRAM, and cache
+   maintenance is by whole lines, so other buffers go through sdmmc_bounce.
+   Written lines are cleaned before the DMA reads them, read lines are
+   invalidated before and after the DMA, for lines fetched speculatively.
+*/
+#define SDMMC_SECTOR      (512)
+#define SDMMC_LINE        (32)
+#define SDMMC_AXI_SIZE    (1024*512)
+
+static SD_HandleTypeDef hsd_card;
+static OS_EVENT sdmmc_event;
+static volatile bool sdmmc_failed = false;
+static bool sdmmc_ready = false;
+static bool sdmmc_event_ready = false;
+static uint8_t __attribute__((section(".AXI_RAM1"), aligned(32))) sdmmc_bounce[SDMMC_BOUNCE * SDMMC_SECTOR];
+
+void SDMMC1_IRQHandler(void){
+   OS_INT_Enter();
+   HAL_SD_IRQHandler(&hsd_card);
+   OS_INT_Leave();
+}
+
+void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd){
+   OS_EVENT_Set(&sdmmc_event);
+}
+
+void HAL_SD_RxCpltCallback(SD_HandleTypeDef *hsd){
+   OS_EVENT_Set(&sdmmc_event);
+}
+
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd){
+   sdmmc_failed = true;
+   OS_EVENT_Set(&sdmmc_event);
+}
+
+static bool sdmmc_direct(const void *buffer){
+   uintptr_t addr = (uintptr_t) buffer;
+   return addr % SDMMC_LINE == 0 &&
+      addr >= D1_AXISRAM_BASE && addr < D1_AXISRAM_BASE + SDMMC_AXI_SIZE;
+}
+
+static int sdmmc_init(U8 unit){
+   if (sdmmc_ready)
+      return 0;
+   if (!sdmmc_event_ready){
+      OS_EVENT_Create(&sdmmc_event);
+      sdmmc_event_ready = true;
+   }
+   hsd_card.Instance                 = SDMMC1;
+   hsd_card.Init.ClockEdge           = SDMMC_CLOCK_EDGE_RISING;
+   hsd_card.Init.ClockPowerSave      = SDMMC_CLOCK_POWER_SAVE_DISABLE;
+   hsd_card.Init.BusWide             = SDMMC_BUS_WIDE_4B;
+   hsd_card.Init.HardwareFlowControl = SDMMC_HARDWARE_FLOW_CONTROL_ENABLE;
+   hsd_card.Init.ClockDiv            = SDMMC_CLOCK_DIV;
+   if (HAL_SD_Init(&hsd_card) != HAL_OK){
+      SEGGER_RTT_printf(0, "SD init error %x\n", HAL_SD_GetError(&hsd_card));
+      return -1;
+   }
+   HAL_NVIC_SetPriority(SDMMC1_IRQn, 12, 0);
+   HAL_NVIC_EnableIRQ(SDMMC1_IRQn);
+   sdmmc_ready = true;
+   return 0;
+}
+
+// Wait for the end of a transfer, then for the card to be done programming
+static int sdmmc_wait(void){
+   uint32_t start = sys_current_ms();
+   if (OS_EVENT_GetTimed(&sdmmc_event, SDMMC_TIMEOUT) != 0 || sdmmc_failed){
+      SEGGER_RTT_printf(0, "SD transfer error %x\n", HAL_SD_GetError(&hsd_card));
+      HAL_SD_Abort(&hsd_card);
+      return -1;
+   }
+   while (HAL_SD_GetCardState(&hsd_card) != HAL_SD_CARD_TRANSFER){
+      if (sys_current_ms() - start > SDMMC_TIMEOUT)
+         return -1;
+      OS_TASK_Delay(1);
+   }
+   return 0;
+}
+
+static int sdmmc_read(U8 unit, U32 sector, void *buffer, U32 count){
+   uint8_t *dst = (uint8_t *) buffer;
+   while (count){
+      bool direct = sdmmc_direct(dst);
+      U32 n = direct || count < SDMMC_BOUNCE ? count : SDMMC_BOUNCE;
+      uint8_t *buf = direct ? dst : sdmmc_bounce;
+      uint32_t size = n * SDMMC_SECTOR;
+
+      SCB_InvalidateDCache_by_Addr((uint32_t *) buf, size);
+      OS_EVENT_Reset(&sdmmc_event);
+      sdmmc_failed = false;
+      if (HAL_SD_ReadBlocks_DMA(&hsd_card, buf, sector, n) != HAL_OK || sdmmc_wait())
+         return -1;
+      SCB_InvalidateDCache_by_Addr((uint32_t *) buf, size);
+      if (!direct)
+         memcpy(dst, sdmmc_bounce, size);
+
+      dst += size;
+      sector += n;
+      count -= n;
+   }
+   return 0;
+}
+
+static int sdmmc_write(U8 unit, U32 sector, const void *buffer, U32 count, U8 repeat){
+   const uint8_t *src = (const uint8_t *) buffer;
+   while (count){
+      bool direct = !repeat && sdmmc_direct(src);
+      U32 n = direct || count < SDMMC_BOUNCE ? count : SDMMC_BOUNCE;
+      const uint8_t *buf = src;
+      uint32_t size = n * SDMMC_SECTOR;
+
+      // With repeat, the same sector is written n times
+      if (!direct){
+         for (U32 i = 0; i < n; i++)
+            memcpy(sdmmc_bounce + i * SDMMC_SECTOR, repeat ? src : src + i * SDMMC_SECTOR, SDMMC_SECTOR);
+         buf = sdmmc_bounce;
+      }
+      SCB_CleanDCache_by_Addr((uint32_t *) buf, size);
+      OS_EVENT_Reset(&sdmmc_event);
+      sdmmc_failed = false;
+      if (HAL_SD_WriteBlocks_DMA(&hsd_card, buf, sector, n) != HAL_OK || sdmmc_wait())
+         return -1;
+
+      if (!repeat)
+         src += size;
+      sector += n;
+      count -= n;
+   }
+   return 0;
+}
+
+static int sdmmc_ioctl(U8 unit, I32 cmd, I32 aux, void *buffer){
+   HAL_SD_CardInfoTypeDef card;
+   FS_DEV_INFO *info;
+   switch (cmd){
+   case FS_CMD_GET_DEVINFO:
+      if (sdmmc_init(unit) || HAL_SD_GetCardInfo(&hsd_card, &card) != HAL_OK)
+         return -1;
+      info = (FS_DEV_INFO *) buffer;
+      info->NumSectors     = card.LogBlockNbr;
+      info->BytesPerSector = card.LogBlockSize;
+      return 0;
+   case FS_CMD_UNMOUNT:
+   case FS_CMD_UNMOUNT_FORCED:
+      if (sdmmc_ready){
+         HAL_NVIC_DisableIRQ(SDMMC1_IRQn);
+         HAL_SD_DeInit(&hsd_card);
+         sdmmc_ready = false;
+      }
+      return 0;
+   default:
+      return -1;
+   }
+}
+
+static const char *sdmmc_name(U8 unit){
+   return "mmc";
+}
+
+static int sdmmc_add(void){
+   return 0;
+}
+
+static int sdmmc_status(U8 unit){
+   return FS_MEDIA_IS_PRESENT;
+}
+
+static int sdmmc_units(void){
+   return 1;
+}
+
+static const FS_DEVICE_TYPE sdmmc_driver = {
+   sdmmc_name,
+   sdmmc_add,
+   sdmmc_read,
+   sdmmc_write,
+   sdmmc_ioctl,
+   sdmmc_init,
+   sdmmc_status,
+   sdmmc_units
+};
+
+void sdmmc_add_device(void){
+   FS_AddDevice(&sdmmc_driver);
+}
+#endif // USE_SDMMC_DMA
+
+
 bool bkSRAM_Init(void)
 {
    HAL_FLASH_Unlock();
@@ -168,6 +168,10 @@ extern DMA_HandleTypeDef handle_GPDMA1_Channel0;
 #endif // db_h743
 
 #define BKPSRAMMAGIC (0x11d23346)
+// Backup SRAM: magic at 0, settings strings in 0x100-0xAFF, then the journal
+#define BKPSRAM_SIZE            (0x1000)
+#define BKPSRAM_JOURNAL         (0xB00)
+#define BKPSRAM_JOURNAL_SIZE    (BKPSRAM_SIZE - BKPSRAM_JOURNAL)
 
 extern OS_MAILBOX       Mb_Keyboard;
 extern OS_EVENT         _EV_KEYB;
@@ -177,6 +181,38 @@ extern uint32_t      Cnt_ms ;
 
 extern uint64_t   scrut_last;
 
+/* [EXIT] presses put in Mb_Keyboard by KbdTask, and taken out by the RPL
+   task. Each counter has a single writer, so reading whether an [EXIT] is
+   pending needs no kernel lock, see key_exit_pending() */
+extern volatile uint32_t kb_exit_posted;
+extern volatile uint32_t kb_exit_taken;
+
+#if USE_RTT_SCRIPT
+/* Sent by KbdTask to the RPL task when the host sends script input on
+   RTT_SCRIPT_CHANNEL. Set by KbdTask and cleared by the RPL task before it
+   reads the channel, so that only one message is pending at a time */
+#define SCRIPT_MESSAGE           0xfffffffc
+extern volatile uint32_t script_posted;
+#endif // USE_RTT_SCRIPT
+
+#if USE_USB_EVAL
+/* Sent by the USB evaluation task to the RPL task when requests are queued.
+   The CDC-ACM interface must be added by the USB setup before USBD_Start */
+#define USB_EVAL_MESSAGE         0xfffffffb
+void usb_eval_add(void);
+#endif // USE_USB_EVAL
+
+#if USE_MSC_SNAPSHOT
+/* Sent by KbdTask to the RPL task once the host stopped writing to the disk
+   for MSC_QUIET_PERIOD ms. msc_host_write() must be called by the MSC
+   storage driver for each write by the host */
+#define MSC_CHANGED_MESSAGE      0xfffffffa
+extern volatile uint32_t msc_changed;
+extern volatile uint32_t msc_posted;
+extern volatile uint32_t msc_last_write;
+void msc_host_write(void);
+#endif // USE_MSC_SNAPSHOT
+
 typedef enum {
    SYS_nothing =0,
    SYS_1sec,
@@ -266,10 +302,16 @@ extern const char kb_fct_name[][3];
 #define KB_MAX_KEY 4
 #define KB_SHIFT_SCRUT 3
 
+#define KB_EXIT_KEY        (81)     // [EXIT] in KbdTask key numbers
 #define KB_SCRUT_PERIOD    (15)
 #define KB_REPEAT_PERIOD   (1500)
 #define KB_REPEAT_COUNT    (KB_REPEAT_PERIOD/KB_SCRUT_PERIOD+1)
-#define KB_VALID_COUNT     (3)
+
+/* scrutation only while keys are down, started by EXTI on the columns */
+#define KB_BURST_PERIOD    (2)      // ms between scans while a key is down
+#define KB_IDLE_PERIOD     (100)    // ms between wake-ups with no key down
+#define KB_DEBOUNCE_TIME   (6)      // ms a key must stay down to be valid
+#define KB_VALID_COUNT     (KB_DEBOUNCE_TIME/KB_BURST_PERIOD)
 
 #define KB_DB_FIRST_REPEAT (1000)
 #define KB_DB_FIRST_PERIOD (100)
@@ -405,6 +447,15 @@ typedef struct {
 void Ti_cb_Count_ms(void);
 void blink_error(uint32_t errnb);
 
+#if USE_TICKLESS_IDLE
+/* Tickless idle, called by OS_Idle(). STOP mode is only used while the RPL
+   task sets idle_stop_allowed. Wake-up times from STOP are in us. */
+void db_idle(void);
+extern volatile uint32_t idle_stop_allowed;
+extern volatile uint32_t idle_wakeup_us;
+extern volatile uint32_t idle_wakeup_us_max;
+#endif // USE_TICKLESS_IDLE
+
 
 extern RTC_HandleTypeDef hrtc;
 
@@ -468,6 +519,23 @@ void bkSRAM_ReadString(uint16_t read_adress, char* read_data, uint32_t length);
 void bkSRAM_WriteString(uint16_t read_adress, char* write_data, uint32_t length);
 void bkSRAM_ReadVariable(uint16_t read_adress, uint32_t* read_data);
 void bkSRAM_WriteVariable(uint16_t write_adress,uint32_t vall);
+bool bkSRAM_Read(uint32_t offset, void *data, uint32_t length);
+bool bkSRAM_Write(uint32_t offset, const void *data, uint32_t length);
+#if USE_MPU_PROFILE
+void mpu_configure(void);
+#endif // USE_MPU_PROFILE
+
+void mdma_move(void *to, const void *from, uint32_t size);
+
+#if USE_SDMMC_DMA
+// Called from FS_X_AddDevices() to use the SDMMC1 driver for the SD card
+void sdmmc_add_device(void);
+#endif // USE_SDMMC_DMA
+
+// Provided by the BSP QSPI driver, which restores memory-mapped mode after
+// each call. Erase covers at least the given size from RESOURCE_FLASH_BASE.
+bool resource_flash_erase(uint32_t size);
+bool resource_flash_write(uint32_t offset, const void *data, uint32_t length);
 
 
 //void ntp_convert_to_local_time_TZ(const IP_NTP_TIMESTAMP* ntp_time,const char* tz_name, local_time_t* local_time);
@@ -34,15 +34,18 @@
 
 #include "datetime.h"
 #include "dmcp_fonts.c"
+#include "file.h"
 #include "recorder.h"
 
 
 #include "db_hardware_def.h"
 #include "LS027B7DH01.h"
+#include "sysmenu.h"
 
 
 #include "target.h"
 #include "tests.h"
+#include "text.h"
 #include "types.h"
 
 #include <iostream>
@@ -175,7 +178,38 @@ void LCD_power_on()
     record(dmcp, "LCD_power_on");
 }
 
-uint32_t read_power_voltage()
+// ============================================================================
+//
+//   Power supply sampling
+//
+// ============================================================================
+//   The voltage is sampled at most every POWER_SAMPLE_PERIOD microseconds and
+//   averaged over the last POWER_SAMPLES samples. Readers only get the latest
+//   filtered value, so that battery checks in hot loops cost nothing and are
+//   less noisy. A background conversion can feed power_sample_push directly.
+
+#ifndef POWER_SAMPLE_PERIOD
+#define POWER_SAMPLE_PERIOD     250000
+#endif
+
+#ifndef POWER_SAMPLES
+#define POWER_SAMPLES           4
+#endif
+
+static struct power_samples
+{
+    uint64_t    last;                   // Time of last sample
+    uint32_t    sum;                    // Sum of samples in the ring
+    uint16_t    ring[POWER_SAMPLES];    // Last samples in mV
+    uint16_t    count;                  // Number of valid samples
+    uint16_t    index;                  // Next sample to replace
+} power;
+
+
+static uint32_t power_voltage_raw()
+// ----------------------------------------------------------------------------
+//   Read the supply voltage in mV
+// ----------------------------------------------------------------------------
 {
     const uint vmax = 3000;
     const uint vmin = 2600;
@@ -184,15 +218,51 @@ uint32_t read_power_voltage()
 //    return ui_battery() * (vmax - vmin) / 1000 + vmin;
 }
 
+
+void power_sample_push(uint32_t mv)
+// ----------------------------------------------------------------------------
+//   Add a sample to the averaging ring
+// ----------------------------------------------------------------------------
+{
+    if (power.count == POWER_SAMPLES)
+        power.sum -= power.ring[power.index];
+    else
+        power.count++;
+    power.ring[power.index] = mv;
+    power.sum += mv;
+    power.index = (power.index + 1) % POWER_SAMPLES;
+}
+
+
+static uint32_t power_sample()
+// ----------------------------------------------------------------------------
+//   Return the filtered voltage, sampling again if the last sample is old
+// ----------------------------------------------------------------------------
+{
+    uint64_t now = sys_current_us();
+    if (!power.count || now - power.last >= POWER_SAMPLE_PERIOD)
+    {
+        power.last = now;
+        power_sample_push(power_voltage_raw());
+    }
+    return power.sum / power.count;
+}
+
+
+uint32_t read_power_voltage()
+{
+    return power_sample();
+}
+
 int get_vbat()
 {
-    return read_power_voltage();
+    return power_sample();
 }
 
 int get_lowbat_state()
 {
     const uint vlow = 2450;
-    return read_power_voltage() < vlow;
+    return power_sample() < vlow;
 }
 
 int usb_powered()
@@ -200,11 +270,177 @@ int usb_powered()
     return ui_charging();
 }
 
+// ============================================================================
+//
+//   Screenshots
+//
+// ============================================================================
+//   The framebuffer is copied as a 1bpp BMP into the background I/O staging
+//   buffer, so that the key press returns as soon as the copy is done, and
+//   further drawing cannot alter the picture while the SD card is written.
+
+#ifndef SCREENSHOT_DIR
+// Directory where screenshots are saved
+#define SCREENSHOT_DIR          "SCREENS"
+#endif // SCREENSHOT_DIR
+
+#ifndef SCREENSHOT_MAX
+// Maximum number of screenshot files, named SCREENS/SCR0001.BMP and up
+#define SCREENSHOT_MAX          9999
+#endif // SCREENSHOT_MAX
+
+enum screenshot_layout
+// ----------------------------------------------------------------------------
+//   Layout of the BMP file for a screenshot
+// ----------------------------------------------------------------------------
+{
+    SCR_SCAN    = LCD_SCANLINE / 8,             // Bytes per framebuffer row
+    SCR_ROW     = (LCD_W + 31) / 32 * 4,        // Bytes per padded BMP row
+    SCR_HEADER  = 14 + 40 + 8,                  // File + info header, palette
+    SCR_PIXELS  = SCR_ROW * LCD_H,
+    SCR_SIZE    = SCR_HEADER + SCR_PIXELS,
+};
+
+
+static void screenshot_le(byte *p, uint32_t value, uint bytes)
+// ----------------------------------------------------------------------------
+//   Write a little-endian value in a BMP header
+// ----------------------------------------------------------------------------
+{
+    for (uint i = 0; i < bytes; i++)
+        p[i] = value >> (8 * i);
+}
+
+
+static void screenshot_header(byte *hdr)
+// ----------------------------------------------------------------------------
+//   Build the BMP file and info headers and the palette
+// ----------------------------------------------------------------------------
+{
+    memset(hdr, 0, SCR_HEADER);
+    hdr[0] = 'B';
+    hdr[1] = 'M';
+    screenshot_le(hdr +  2, SCR_SIZE,   4);   // File size
+    screenshot_le(hdr + 10, SCR_HEADER, 4);   // Offset to pixels
+    screenshot_le(hdr + 14, 40,         4);   // Info header size
+    screenshot_le(hdr + 18, LCD_W,      4);   // Width
+    screenshot_le(hdr + 22, LCD_H,      4);   // Height, bottom-up rows
+    screenshot_le(hdr + 26, 1,          2);   // Planes
+    screenshot_le(hdr + 28, 1,          2);   // Bits per pixel
+    screenshot_le(hdr + 34, SCR_PIXELS, 4);   // Image size
+    screenshot_le(hdr + 38, 2835,       4);   // 72 dpi horizontally
+    screenshot_le(hdr + 42, 2835,       4);   // 72 dpi vertically
+    screenshot_le(hdr + 46, 2,          4);   // Colors in palette
+    screenshot_le(hdr + 50, 2,          4);   // Important colors
+
+    // Palette: the bit value the blitter uses for black is black in the BMP
+    bool ink = pattern(color(0, 0, 0)).bits & 1;
+    memset(hdr + 54 + 4 * !ink, 0xFF, 3);
+}
+
+
+static void screenshot_row(byte *row, uint r)
+// ----------------------------------------------------------------------------
+//   Convert BMP row r (counted from the bottom) from the framebuffer
+// ----------------------------------------------------------------------------
+//   The BMP format stores the leftmost pixel in the most significant bit
+{
+    const byte *scan = LCD_GetFramebuffer() + SCR_SCAN * (LCD_H - 1 - r);
+#if USE_NATIVE_LCD
+    // Pixels in panel order, leftmost pixel in the least significant bit
+    static const byte rev[16] =
+    {
+        0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+        0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF
+    };
+    for (uint c = 0; c < SCR_SCAN; c++)
+        row[c] = (rev[scan[c] & 0xF] << 4) | rev[scan[c] >> 4];
+#else
+    // X axis is reversed, so reversing bytes puts pixels in BMP order
+    for (uint c = 0; c < SCR_SCAN; c++)
+        row[c] = scan[SCR_SCAN - 1 - c];
+#endif // USE_NATIVE_LCD
+    memset(row + SCR_SCAN, 0, SCR_ROW - SCR_SCAN);
+}
+
+
+static cstring screenshot_name()
+// ----------------------------------------------------------------------------
+//   Find the next free screenshot file name
+// ----------------------------------------------------------------------------
+//   Existing files are only probed for the first screenshot after boot
+{
+    static char name[32];
+    static uint next = 0;
+    bool        scan = next == 0;
+    if (scan)
+    {
+        check_create_dir(SCREENSHOT_DIR);
+        next = 1;
+    }
+    for (; next <= SCREENSHOT_MAX; next++)
+    {
+        snprintf(name, sizeof(name), SCREENSHOT_DIR "/SCR%04u.BMP", next);
+        if (!scan)
+            break;
+        file probe(name, file::READING);
+        if (!probe.valid())
+            break;
+    }
+    if (next > SCREENSHOT_MAX)
+        return nullptr;
+    next++;
+    return name;
+}
+
+
 int create_screenshot(int report_error)
+// ----------------------------------------------------------------------------
+//   Save the current screen as a BMP file, return 2 on error
+// ----------------------------------------------------------------------------
 {
-    record(dmcp_notyet,
-           "create_screenshot(%d) not implemented", report_error);
-    ui_screenshot();
+    cstring name = screenshot_name();
+    if (!name)
+    {
+        record(dmcp_error, "No free screenshot file name");
+        return report_error ? 2 : 0;
+    }
+
+#if USE_ASYNC_IO
+    // Copy the whole screen in the staging buffer and let the I/O task write
+    if (byte *buf = file::async_start(text::make(name), SCR_SIZE))
+    {
+        screenshot_header(buf);
+        for (uint r = 0; r < LCD_H; r++)
+            screenshot_row(buf + SCR_HEADER + SCR_ROW * r, r);
+        file::async_submit();
+        record(dmcp, "Queued screenshot %s", name);
+        return 0;
+    }
+#endif // USE_ASYNC_IO
+
+    // Otherwise write synchronously, one row at a time
+    file f(name, file::WRITING);
+    bool ok = f.valid();
+    if (ok)
+    {
+        byte hdr[SCR_HEADER];
+        screenshot_header(hdr);
+        ok = f.write((const char *) hdr, sizeof(hdr));
+        byte row[SCR_ROW];
+        for (uint r = 0; ok && r < LCD_H; r++)
+        {
+            screenshot_row(row, r);
+            ok = f.write((const char *) row, sizeof(row));
+        }
+    }
+    if (!ok)
+    {
+        record(dmcp_error, "Failed to write screenshot %s: %s",
+               name, f.error());
+        return report_error ? 2 : 0;
+    }
+    record(dmcp, "Wrote screenshot %s", name);
     return 0;
 }
 
@@ -357,6 +593,14 @@ st_key_data drcvd;
    }
 }
 
+int key_exit_pending()
+/* Check whether an [EXIT] press is waiting in the key buffer.
+   This is a single load, without the kernel lock of OS_MAILBOX_Peek
+*/
+{
+   return (int32_t) (kb_exit_posted - kb_exit_taken) > 0;
+}
+
 int key_remaining()
 /* key number in the buffer */
 {
@@ -377,7 +621,12 @@ st_key_data drcvd;
    if ( 0 == result)
    { // an event key is here, format db48 
       if ((drcvd.sys == false)&&(drcvd.keys.released == true)) return 0;
-      if ((drcvd.sys == false)&&(drcvd.keys.released == false)) return key_DB_to_DM(drcvd.keys.key);
+      if ((drcvd.sys == false)&&(drcvd.keys.released == false))
+      {
+         if (drcvd.keys.key == KB_EXIT_KEY)
+            kb_exit_taken++;
+         return key_DB_to_DM(drcvd.keys.key);
+      }
    }
    return -10;
 }
@@ -407,6 +656,7 @@ void key_pop_all()
 /* Remove all keys from key buffer. */
 {
    OS_MAILBOX_Clear(&Mb_Keyboard);
+   kb_exit_taken = kb_exit_posted;
 }
 
 int key_push_notused(int k)
@@ -433,6 +683,7 @@ void wait_for_key_press()
 st_key_data drcvd;
 // OS_MAILBOX_Clear(&Mb_Keyboard);
    SEGGER_RTT_printf(0, "\nWaiting for key press");
+   refresh_dirty_now();
    while(1){
       char result = OS_MAILBOX_GetTimed(&Mb_Keyboard, &drcvd, 5000);
       if (result==0)
@@ -441,7 +692,7 @@ st_key_data drcvd;
 
       }
    }
-   OS_MAILBOX_Clear(&Mb_Keyboard);
+   key_pop_all();
 }
 
 
@@ -453,6 +704,7 @@ void wait_for_key_release(int tout)
 {
 st_key_data drcvd;
    SEGGER_RTT_printf(0, "\nWaiting for key release");
+   refresh_dirty_now();
    while(1){
       char result = OS_MAILBOX_GetTimed(&Mb_Keyboard, &drcvd, 5000);
       if (result==0)
@@ -461,7 +713,7 @@ st_key_data drcvd;
    
       }
    }
-   OS_MAILBOX_Clear(&Mb_Keyboard);
+   key_pop_all();
 }
 
 int read_key_notused(int *k1, int *k2)
@@ -519,10 +771,41 @@ LCD_ClearFramebuffer( &hlcd);
 
 static uint32_t last_warning = 0;
 
-inline void lcd_set_pixel(int x, int y)
+static void lcd_mark_rows(int y, int h)
+// ----------------------------------------------------------------------------
+//   Mark the rows touched by a drawing operation as modified
+// ----------------------------------------------------------------------------
 {
+    if (y < 0)
+    {
+        h += y;
+        y = 0;
+    }
+    if (y + h > LCD_H)
+        h = LCD_H - y;
+    for (int r = y; r < y + h; r++)
+        LCD_MarkLineModified(&hlcd, r);
+}
 
-LCD_SetPixel( &hlcd, x, y, 1);
+static void lcd_fill(int x, int y, int w, int h, int val)
+// ----------------------------------------------------------------------------
+//   Fill a rectangle using the blitter, ignoring the RPL clipping
+// ----------------------------------------------------------------------------
+//   Like lcd_pixel, a non-zero val is white and zero is black
+{
+    if (w <= 0 || h <= 0)
+        return;
+    rect clip = Screen.clip();
+    Screen.clip(Screen.area());
+    Screen.fill(x, y, x + w - 1, y + h - 1,
+                val ? pattern::white : pattern::black);
+    Screen.clip(clip);
+    lcd_mark_rows(y, h);
+}
+
+inline void lcd_set_pixel(int x, int y)
+{
+    lcd_fill(x, y, 1, 1, 0);
 /*    if (x < 0 || x > LCD_W || y < 0 || y > LCD_H)
     {
         uint now = sys_current_ms();
@@ -541,7 +824,7 @@ LCD_SetPixel( &hlcd, x, y, 1);
 
 inline void lcd_clear_pixel(int x, int y)
 {
-LCD_SetPixel( &hlcd, x, y, 0);
+    lcd_fill(x, y, 1, 1, 1);
 
 /*    if (x < 0 || x > LCD_W || y < 0 || y > LCD_H)
     {
@@ -640,9 +923,7 @@ void lcd_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, int val)
             y = h = 0;
     }
 
-    for (uint r = y; r < y + h; r++)
-        for (uint c = x; c < x + w; c++)
-            lcd_pixel(c, r, val);
+    lcd_fill(x, y, w, h, val);
 }
 
 int lcd_fontWidth(disp_stat_t * ds)
@@ -891,30 +1172,50 @@ inline void lcd_writeTextInternal(disp_stat_t *ds, const char *text, int write)
                 continue;
             }
 
-            for (int r = 0; r < cy; r++)
-                for (int c = 0; c < cx + cols; c++)
-                    lcd_pixel(x+c, y+r, color);
+            // Background above, left of and below the glyph bitmap
+            int width = cx + cols;
+            if (ds->bgfill)
+            {
+                lcd_fill(x, y, width, height, color);
+            }
+            else
+            {
+                lcd_fill(x, y, width, cy, color);
+                lcd_fill(x, y + cy, cx, rows, color);
+                lcd_fill(x, y + cy + rows, width, height - cy - rows, color);
+            }
 
+            // Convert rows to a one-word-per-row bitmap in the bit order of
+            // the screen surface, like the RPL fonts, then draw it in one
+            // blit. Surfaces with a swapped X axis copy words mirrored, so
+            // the leftmost pixel then goes in the highest bit of the glyph
+            bool    swap = surface::horizontal_swap();
+            pixword bits[64];
+            if (rows > (int) (sizeof(bits) / sizeof(bits[0])))
+                rows = sizeof(bits) / sizeof(bits[0]);
             for (int r = 0; r < rows; r++)
             {
                 int data = 0;
                 for (int c = 0; c < cols; c += 8)
                     data |= *dp++ << c;
 
-                for (int c = 0; c < cx; c++)
-                    lcd_pixel(x+c, y+r, color);
-
+                pixword row = 0;
                 for (int c = 0; c < cols; c++)
-                {
-                    int val = (data >> (cols - c - 1)) & 1;
-                    if (val || ds->bgfill)
-                        lcd_pixel(x + c + cx, y + r + cy, val != color);
-                }
+                    if ((data >> (cols - c - 1)) & 1)
+                        row |= 1U << (swap ? cols - c - 1 : c);
+                bits[r] = row;
+            }
+            if (rows > 0 && cols > 0)
+            {
+                blitter::surface<blitter::MONOCHROME> glyph(bits, cols,
+                                                            rows, 32);
+                rect clip = Screen.clip();
+                Screen.clip(Screen.area());
+                Screen.draw(glyph, x + cx, y + cy,
+                            color ? pattern::black : pattern::white);
+                Screen.clip(clip);
+                lcd_mark_rows(y + cy, rows);
             }
-
-            for (uint r = cy + rows; r < height; r++)
-                for (int c = 0; c < cx + cols; c++)
-                    lcd_pixel(x+c, y+r, color);
 
 
             x += cx + cols + xspc;
@@ -982,6 +1283,7 @@ int sys_free_mem()
 
 void sys_delay(uint32_t ms_delay)
 {
+    refresh_dirty_now();
     ui_ms_sleep(ms_delay);
 }
 
@@ -1047,6 +1349,185 @@ int sys_timer_timeout(int timer_ix)
 }
 
 
+#if USE_FILE_SELECTOR
+// ============================================================================
+//
+//   Directory listings for the file selector
+//
+// ============================================================================
+//   Listings are kept sorted as they are read, a few entries at a time
+//   between keys, so that the first screen shows up right away. A listing
+//   is kept until file::listing_generation() says that files were created
+//   or removed, or until another directory needs its slot.
+
+struct dir_listing
+// ----------------------------------------------------------------------------
+//   The sorted names of the files with a given extension in a directory
+// ----------------------------------------------------------------------------
+{
+    char         dir[64];                       // Directory, emFile format
+    char         ext[8];                        // Extension, e.g. ".48S"
+    uint         generation;                    // When listing was read
+    uint         count;                         // Number of names
+    uint         used;                          // Bytes used in names
+    bool         valid;                         // Listing in use
+    bool         reading;                       // Still reading directory
+    bool         full;                          // Some files did not fit
+    uint16_t     order[DIR_LISTING_FILES];      // Offsets of sorted names
+    char         names[DIR_LISTING_NAMES];
+    FS_FIND_DATA find;
+
+    cstring      name(uint i) const { return names + order[i]; }
+    bool         add(cstring file);
+    bool         read(uint max);
+};
+
+static dir_listing dir_listings[DIR_LISTINGS];
+static uint        dir_listing_last = 0;        // Slot reused last
+
+
+bool dir_listing::add(cstring file)
+// ----------------------------------------------------------------------------
+//   Insert a name at its sorted position
+// ----------------------------------------------------------------------------
+{
+    size_t len = strlen(file) + 1;
+    if (count >= DIR_LISTING_FILES || used + len > sizeof(names))
+        return false;
+    uint lo = 0, hi = count;
+    while (lo < hi)
+    {
+        uint mid = (lo + hi) / 2;
+        if (strcasecmp(name(mid), file) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    memmove(order + lo + 1, order + lo, (count - lo) * sizeof(order[0]));
+    order[lo] = used;
+    memcpy(names + used, file, len);
+    used += len;
+    count++;
+    return true;
+}
+
+
+bool dir_listing::read(uint max)
+// ----------------------------------------------------------------------------
+//   Read up to max more directory entries, return true if some were added
+// ----------------------------------------------------------------------------
+{
+    bool added = false;
+    char file[64];
+    size_t elen = strlen(ext);
+#if USE_ASYNC_IO
+    if (reading)
+        file::io_wait();
+#endif // USE_ASYNC_IO
+    while (reading && max--)
+    {
+        int found = used || count || full
+            ? FS_FindNextFile(&find)
+            : FS_FindFirstFile(&find, dir, file, sizeof(file)) == 0;
+        if (!found)
+        {
+            FS_FindClose(&find);
+            reading = false;
+            break;
+        }
+        cstring fname = find.sFileName;
+        size_t  flen  = strlen(fname);
+        if (find.Attributes & FS_ATTR_DIRECTORY)
+            continue;
+        if (flen < elen || strcasecmp(fname + flen - elen, ext) != 0)
+            continue;
+        if (add(fname))
+            added = true;
+        else
+            full = true;
+    }
+    return added;
+}
+
+
+static dir_listing &dir_listing_for(cstring dir, cstring ext)
+// ----------------------------------------------------------------------------
+//   Find or start the listing for a directory
+// ----------------------------------------------------------------------------
+{
+    char path[sizeof(dir_listings[0].dir)];
+    uint i = 0;
+    for (cstring p = dir; *p && i < sizeof(path) - 1; p++)
+        path[i++] = *p == '/' ? '\\' : *p;
+    path[i] = 0;
+
+    uint generation = file::listing_generation();
+    for (dir_listing &l : dir_listings)
+        if (l.valid && !l.reading && l.generation == generation &&
+            strcmp(l.dir, path) == 0 && strcasecmp(l.ext, ext) == 0)
+            return l;
+
+    dir_listing_last = (dir_listing_last + 1) % DIR_LISTINGS;
+    dir_listing &l = dir_listings[dir_listing_last];
+    strcpy(l.dir, path);
+    snprintf(l.ext, sizeof(l.ext), "%s", ext);
+    l.generation = generation;
+    l.count      = 0;
+    l.used       = 0;
+    l.valid      = true;
+    l.reading    = true;
+    l.full       = false;
+    record(dmcp, "Reading listing of %s for %s", path, ext);
+    return l;
+}
+
+
+static void file_selection_draw(cstring title, dir_listing &l,
+                                uint first, uint rows, uint line, bool fresh)
+// ----------------------------------------------------------------------------
+//   Draw visible lines of the listing, the optional "new file" line is -1
+// ----------------------------------------------------------------------------
+{
+    t24->xoffs = 0;
+    lcd_writeClr(t24);
+    lcd_writeClr(t20);
+    lcd_clear_buf();
+    lcd_putsR(t20, title);
+    for (uint r = 0; r < rows; r++)
+    {
+        uint i = first + r;
+        t24->inv = i == line;
+        if (fresh && i == 0)
+            lcd_printAt(t24, r + 1, "[New file]");
+        else if (i - fresh < l.count)
+            lcd_printAt(t24, r + 1, "%s", l.name(i - fresh));
+        else if (i - fresh == l.count && l.reading)
+            lcd_printAt(t24, r + 1, "...");
+    }
+    t24->inv = 0;
+    lcd_refresh();
+}
+
+
+static bool file_selection_confirm(cstring fname)
+// ----------------------------------------------------------------------------
+//   Confirm that we can overwrite a file
+// ----------------------------------------------------------------------------
+{
+    lcd_writeClr(t24);
+    lcd_clear_buf();
+    lcd_putsR(t20, "Overwrite file");
+    lcd_printAt(t24, 2, "%s", fname);
+    lcd_printAt(t24, 4, "ENTER to overwrite");
+    lcd_printAt(t24, 5, "EXIT to cancel");
+    lcd_refresh();
+    while (!test_command && key_empty())
+        OS_TASK_Delay(100);
+    return !test_command && key_pop() == KEY_ENTER;
+}
+#endif // USE_FILE_SELECTOR
+
+
 int file_selection_screen(const char   *title,
                           const char   *base_dir,
                           const char   *ext,
@@ -1061,9 +1542,118 @@ int file_selection_screen(const char   *title,
     if (*base_dir == '/' || *base_dir == '\\')
         base_dir++;
 
+#if USE_FILE_SELECTOR
+    dir_listing &l     = dir_listing_for(base_dir, ext);
+    uint         fresh = disp_new ? 1 : 0;
+    uint         rows  = LCD_H / lcd_lineHeight(t24) - 1;
+    uint         first = 0;
+    uint         line  = 0;
+    bool         draw  = true;
+    char         fpath[sizeof(l.dir) + 64];
+
+    while (true)
+    {
+        // Read entries until a key arrives, redraw as visible lines change
+        if (l.read(draw ? rows : 16) || draw)
+            file_selection_draw(title, l, first, rows, line, fresh);
+        draw = false;
+        while (!test_command && key_empty())
+        {
+            if (l.reading)
+            {
+                if (l.read(16))
+                    file_selection_draw(title, l, first, rows, line, fresh);
+                if (!l.reading)
+                    file_selection_draw(title, l, first, rows, line, fresh);
+            }
+            else
+            {
+                OS_TASK_Delay(100);
+            }
+        }
+        if (test_command)
+            break;
+
+        uint total = l.count + fresh;
+        int  key   = key_pop();
+        switch (key)
+        {
+        case KEY_UP:
+            if (line > 0)
+                line--;
+            break;
+        case KEY_DOWN:
+            if (line + 1 < total)
+                line++;
+            break;
+        case KEY_ENTER:
+        {
+            // A new file needs a name that does not exist yet
+            char fname[32];
+            if (fresh && line == 0)
+            {
+                while (l.reading)
+                    l.read(~0U);
+                bool exists = true;
+                for (uint n = 1; exists; n++)
+                {
+                    snprintf(fname, sizeof(fname), "DB48X%u%s", n, ext);
+                    exists = false;
+                    for (uint i = 0; !exists && i < l.count; i++)
+                        exists = strcasecmp(l.name(i), fname) == 0;
+                }
+            }
+            else if (line < total)
+            {
+                snprintf(fname, sizeof(fname), "%s", l.name(line - fresh));
+                if (overwrite_check && !file_selection_confirm(fname))
+                {
+                    draw = true;
+                    break;
+                }
+            }
+            else
+            {
+                break;
+            }
+
+            // The callback can use the disk, stop reading the directory
+            if (l.reading)
+            {
+                FS_FindClose(&l.find);
+                l.valid = false;
+            }
+            snprintf(fpath, sizeof(fpath), "%s/%s", base_dir, fname);
+            return sel_fn(fpath, fname, data);
+        }
+        case -1:
+            // Signals that main application is exiting, leave all dialogs
+        case KEY_EXIT:
+            if (l.reading)
+            {
+                FS_FindClose(&l.find);
+                l.valid = false;
+            }
+            return MRET_EXIT;
+        }
+
+        // Scroll to keep the selected line visible
+        if (line < first)
+            first = line;
+        else if (line >= first + rows)
+            first = line + 1 - rows;
+        draw = true;
+    }
+    if (l.reading)
+    {
+        FS_FindClose(&l.find);
+        l.valid = false;
+    }
+#else // !USE_FILE_SELECTOR
     ret = ui_file_selector(title, base_dir, ext,
                            sel_fn, data,
                            disp_new, overwrite_check);
+#endif // USE_FILE_SELECTOR
 
     return ret;
 }
@@ -1089,8 +1679,532 @@ extern uint32_t Cnt_ms ;
 
 uint32_t sys_current_ms()
 {
-
+#if USE_TICKLESS_IDLE
+    // Cnt_ms stops along with the heartbeat, embOS time is kept while idle
+    return OS_TIME_GetTicks32();
+#else // !USE_TICKLESS_IDLE
     return Cnt_ms;
+#endif // USE_TICKLESS_IDLE
+}
+
+
+// ============================================================================
+//
+//   Microsecond clock
+//
+// ============================================================================
+//   The DWT cycle counter has sub-microsecond resolution and costs a single
+//   load, but it wraps after a few seconds and may stop while the core
+//   sleeps. It is extended to 64 bits on each read. Each interval is checked
+//   against the millisecond counter, which is trusted instead when they
+//   disagree, e.g. after the RPL task waited for a key for a long time.
+
+#ifndef US_CLOCK_TOLERANCE
+// Disagreement in ms between DWT and millisecond counter that is accepted
+#define US_CLOCK_TOLERANCE      4
+#endif // US_CLOCK_TOLERANCE
+
+uint64_t sys_current_us()
+{
+    static bool     started     = false;
+    static uint32_t last_cycles = 0;
+    static uint32_t last_ms     = 0;
+    static uint32_t remainder   = 0;        // Cycles not yet counted in us
+    static uint64_t total       = 0;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!started)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if DBh743
+        DWT->LAR = 0xC5ACCE55;                  // Unlock DWT on Cortex-M7
+#endif // DBh743
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        last_ms = sys_current_ms();
+        started = true;
+    }
+
+    uint32_t mhz     = SystemCoreClock / 1000000;
+    uint32_t cycles  = DWT->CYCCNT;
+    uint32_t ms      = sys_current_ms();
+    uint32_t dcycles = cycles - last_cycles;
+    uint32_t dms     = ms - last_ms;
+    uint32_t wrap_ms = 0xFFFFFFFFu / (mhz * 1000) / 2;
+    uint32_t dwt_ms  = dcycles / (mhz * 1000);
+    last_cycles = cycles;
+    last_ms = ms;
+    if (dms < wrap_ms &&
+        dwt_ms + US_CLOCK_TOLERANCE >= dms &&
+        dwt_ms <= dms + US_CLOCK_TOLERANCE)
+    {
+        uint64_t elapsed = uint64_t(dcycles) + remainder;
+        total += elapsed / mhz;
+        remainder = elapsed % mhz;
+    }
+    else
+    {
+        total += uint64_t(dms) * 1000;
+        remainder = 0;
+    }
+    uint64_t result = total;
+    __set_PRIMASK(primask);
+    return result;
+}
+
+
+uint32_t sys_core_mhz()
+// ----------------------------------------------------------------------------
+//   Current core clock in MHz, to convert microseconds to cycles
+// ----------------------------------------------------------------------------
+{
+    return SystemCoreClock / 1000000;
+}
+
+
+#if USE_RTT_RECORDER
+// ============================================================================
+//
+//   Binary recorder over RTT
+//
+// ============================================================================
+//   An event is a header word (0xDB, argument count, 16-bit sequence number),
+//   then the recorder, the DWT cycle count, the format and the arguments.
+//   Recorders and formats are addresses, which the host resolves from the
+//   ELF file, so nothing is formatted on the target. Events that do not fit
+//   in the channel buffer are dropped and counted instead of blocking.
+
+#ifndef RECORDER_MAX_ARGS
+// Arguments beyond this count are not sent
+#define RECORDER_MAX_ARGS       8
+#endif // RECORDER_MAX_ARGS
+
+#ifndef RECORDER_RTT_INPUT
+// Size of the buffer receiving trace settings from the host
+#define RECORDER_RTT_INPUT      64
+#endif // RECORDER_RTT_INPUT
+
+recorder_info   *recorder_list    = nullptr;
+uint32_t         recorder_dropped = 0;
+static uint32_t  recorder_seq     = 0;
+static bool      recorder_started = false;
+static byte      recorder_buffer[RECORDER_RTT_BUFFER];
+static char      recorder_input[RECORDER_RTT_INPUT];
+
+
+recorder_info::recorder_info(cstring name, cstring info)
+// ----------------------------------------------------------------------------
+//   Register a recorder, initially disabled
+// ----------------------------------------------------------------------------
+    : name(name), info(info), next(recorder_list), trace(0)
+{
+    recorder_list = this;
+}
+
+
+static void recorder_start()
+// ----------------------------------------------------------------------------
+//   Configure the RTT channel on first use
+// ----------------------------------------------------------------------------
+{
+    SEGGER_RTT_ConfigUpBuffer(RECORDER_RTT_CHANNEL, "Recorder",
+                              recorder_buffer, sizeof(recorder_buffer),
+                              SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+    SEGGER_RTT_ConfigDownBuffer(RECORDER_RTT_CHANNEL, "Recorder",
+                                recorder_input, sizeof(recorder_input),
+                                SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+    recorder_started = true;
+}
+
+
+void recorder_rtt(recorder_info &rec, cstring format,
+                  unsigned nargs, const uintptr_t *args)
+// ----------------------------------------------------------------------------
+//   Send an event for an enabled recorder
+// ----------------------------------------------------------------------------
+{
+    if (nargs > RECORDER_MAX_ARGS)
+        nargs = RECORDER_MAX_ARGS;
+    uint32_t event[4 + RECORDER_MAX_ARGS];
+    event[1] = uint32_t(uintptr_t(&rec));
+    event[3] = uint32_t(uintptr_t(format));
+    for (unsigned a = 0; a < nargs; a++)
+        event[4 + a] = uint32_t(args[a]);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!recorder_started)
+        recorder_start();
+    event[0] = 0xDB000000 | (nargs << 16) | (recorder_seq++ & 0xFFFF);
+    event[2] = DWT->CYCCNT;
+    if (!SEGGER_RTT_WriteNoLock(RECORDER_RTT_CHANNEL,
+                                event, (4 + nargs) * sizeof(uint32_t)))
+        recorder_dropped++;
+    __set_PRIMASK(primask);
+}
+
+
+void recorder_trace_set(cstring spec)
+// ----------------------------------------------------------------------------
+//   Set traces from a "name=value,name,..." spec, "all" matches all names
+// ----------------------------------------------------------------------------
+{
+    while (*spec)
+    {
+        cstring end = spec;
+        while (*end && *end != ',' && *end != '=')
+            end++;
+        size_t    len   = end - spec;
+        bool      all   = len == 3 && strncmp(spec, "all", 3) == 0;
+        uintptr_t value = 1;
+        if (*end == '=')
+            value = strtoul(end + 1, (char **) &end, 0);
+        for (recorder_info *rec = recorder_list; rec; rec = rec->next)
+            if (all || (strncmp(rec->name, spec, len) == 0 && !rec->name[len]))
+                rec->trace = value;
+        while (*end && *end != ',')
+            end++;
+        spec = *end ? end + 1 : end;
+    }
+}
+
+
+void recorder_poll()
+// ----------------------------------------------------------------------------
+//   Apply trace settings sent by the host, one per line
+// ----------------------------------------------------------------------------
+{
+    static char line[RECORDER_RTT_INPUT];
+    static uint len = 0;
+    char        c;
+
+    if (!recorder_started)
+        recorder_start();
+    while (SEGGER_RTT_Read(RECORDER_RTT_CHANNEL, &c, 1) == 1)
+    {
+        if (c == '\n' || c == '\r')
+        {
+            line[len] = 0;
+            recorder_trace_set(line);
+            record(dmcp, "Trace settings [%s]", line);
+            len = 0;
+        }
+        else if (len < sizeof(line) - 1)
+        {
+            line[len++] = c;
+        }
+    }
+}
+#endif // USE_RTT_RECORDER
+
+
+// ============================================================================
+//
+//   Clock governor
+//
+// ============================================================================
+//   While the RPL task waits for a key, the D1 core prescaler divides the
+//   CPU clock, along with the AHB and APB buses. The PLL, voltage scaling and
+//   flash wait states stay as configured for full speed, so that going back
+//   takes a few bus cycles rather than a PLL relock.
+//   - SPI4 is moved to the HSI kernel clock once, at the same bit rate, so
+//     that LCD transfers run at the same speed in both modes.
+//   - SDMMC1 has its own PLL kernel clock. Scaling is skipped while
+//     background writes are pending, to keep the bus ahead of the card.
+//   - SysTick is reloaded for the new clock, including the current period,
+//     so that embOS time does not drift at each switch.
+
+#if USE_CLOCK_SCALING
+static bool     clock_ready        = false;
+static bool     clock_low          = false;
+static uint32_t clock_full_div     = 0;
+static uint32_t clock_switch_count = 0;
+static uint32_t clock_switch_max   = 0;
+
+
+static bool clock_setup()
+// ----------------------------------------------------------------------------
+//   Move SPI4 to the HSI kernel clock, keeping its current bit rate
+// ----------------------------------------------------------------------------
+{
+    if (!(RCC->CR & RCC_CR_HSIRDY) ||
+        !hlcd.transfer_complete || (SPI4->CR1 & SPI_CR1_SPE))
+        return false;
+
+    uint32_t hsi  = HSI_VALUE >> ((RCC->CR & RCC_CR_HSIDIV) >> RCC_CR_HSIDIV_Pos);
+    uint32_t mbr  = (SPI4->CFG1 & SPI_CFG1_MBR) >> SPI_CFG1_MBR_Pos;
+    uint32_t rate = HAL_RCC_GetPCLK2Freq() >> (mbr + 1);
+    uint32_t div  = 0;
+    while (div < 7 && (hsi >> (div + 1)) > rate)
+        div++;
+    __HAL_RCC_SPI45_CONFIG(RCC_SPI45CLKSOURCE_HSI);
+    MODIFY_REG(SPI4->CFG1, SPI_CFG1_MBR, div << SPI_CFG1_MBR_Pos);
+    hspi4.Init.BaudRatePrescaler = div << SPI_CFG1_MBR_Pos;
+    clock_full_div = RCC->D1CFGR & RCC_D1CFGR_D1CPRE;
+    record(lcd, "SPI4 on HSI %u Hz, divider %u for %u bps",
+           hsi, 2 << div, rate);
+    return true;
+}
+
+
+static void clock_set(bool low)
+// ----------------------------------------------------------------------------
+//   Switch the core prescaler, and adjust SysTick to the new clock
+// ----------------------------------------------------------------------------
+{
+    sys_current_us();                   // Count DWT cycles at the old clock
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t start = DWT->CYCCNT;
+    uint32_t old   = SystemCoreClock;
+    uint32_t val   = SysTick->VAL;
+    uint32_t load  = SysTick->LOAD;
+    MODIFY_REG(RCC->D1CFGR, RCC_D1CFGR_D1CPRE,
+               low ? CLOCK_IDLE_DIV : clock_full_div);
+    (void) RCC->D1CFGR;
+    SystemCoreClockUpdate();
+    uint32_t now = SystemCoreClock;
+
+    // Finish the current tick at the new clock, then run normal ticks
+    uint32_t rest = uint32_t(uint64_t(val) * now / old);
+    SysTick->LOAD = rest ? rest : 1;
+    SysTick->VAL = 0;
+    while (SysTick->VAL == 0)
+        /* Wait for the reload */;
+    SysTick->LOAD = uint32_t(uint64_t(load + 1) * now / old) - 1;
+    clock_low = low;
+
+    uint32_t us = (DWT->CYCCNT - start) / (now / 1000000);
+    __set_PRIMASK(primask);
+
+    clock_switch_count++;
+    if (clock_switch_max < us)
+        clock_switch_max = us;
+}
+#endif // USE_CLOCK_SCALING
+
+
+void sys_clock_boost()
+// ----------------------------------------------------------------------------
+//   Run at full speed, e.g. when starting a program or a garbage collection
+// ----------------------------------------------------------------------------
+{
+#if USE_CLOCK_SCALING
+    if (clock_low)
+        clock_set(false);
+#endif // USE_CLOCK_SCALING
+}
+
+
+void sys_clock_idle()
+// ----------------------------------------------------------------------------
+//   Slow down while waiting for a key, unless SPI4 is not ready for it yet
+// ----------------------------------------------------------------------------
+{
+#if USE_CLOCK_SCALING
+    if (clock_low)
+        return;
+#if USE_ASYNC_IO
+    if (file::io_pending())
+        return;
+#endif // USE_ASYNC_IO
+    OS_TASK_EnterRegion();
+    if (!clock_ready)
+        clock_ready = clock_setup();
+    if (clock_ready)
+        clock_set(true);
+    OS_TASK_LeaveRegion();
+#endif // USE_CLOCK_SCALING
+}
+
+
+uint32_t sys_clock_switches()
+// ----------------------------------------------------------------------------
+//   Number of clock switches
+// ----------------------------------------------------------------------------
+{
+#if USE_CLOCK_SCALING
+    return clock_switch_count;
+#else // !USE_CLOCK_SCALING
+    return 0;
+#endif // USE_CLOCK_SCALING
+}
+
+
+uint32_t sys_clock_switch_us()
+// ----------------------------------------------------------------------------
+//   Longest clock switch in microseconds
+// ----------------------------------------------------------------------------
+{
+#if USE_CLOCK_SCALING
+    return clock_switch_max;
+#else // !USE_CLOCK_SCALING
+    return 0;
+#endif // USE_CLOCK_SCALING
+}
+
+
+void sys_clock_stats_clear()
+// ----------------------------------------------------------------------------
+//   Reset clock switch statistics
+// ----------------------------------------------------------------------------
+{
+#if USE_CLOCK_SCALING
+    clock_switch_count = 0;
+    clock_switch_max   = 0;
+#endif // USE_CLOCK_SCALING
+}
+
+
+
+// ============================================================================
+//
+//   Key latency
+//
+// ============================================================================
+//   A key press is stamped when the keyboard task posts it, then at each
+//   stage until the DMA transfer that shows its result completes. Stages
+//   only advance in order, so releases, repeats and type-ahead keys do not
+//   restart a measurement in flight. A sample that does not reach the panel,
+//   e.g. because nothing changed on screen, is dropped after a while.
+//   Stamps may come from the SPI interrupt, so samples are updated with
+//   interrupts masked.
+
+#ifndef KEY_LATENCY_TIMEOUT
+// Time in us after which a key that did not reach the panel is dropped
+#define KEY_LATENCY_TIMEOUT     1000000
+#endif // KEY_LATENCY_TIMEOUT
+
+#if USE_KEY_LATENCY
+static uint32_t key_stamp[KEY_STAGES];
+static int      key_current = -1;       // Last stage reached, -1 if none
+static uint32_t key_total[KEY_LATENCY_SAMPLES];
+static uint64_t key_stage_sum[KEY_STAGES];
+static uint32_t key_count = 0;
+#endif // USE_KEY_LATENCY
+
+
+void sys_key_stage(enum key_stage stage)
+// ----------------------------------------------------------------------------
+//   Record that the current key press reached the given stage
+// ----------------------------------------------------------------------------
+{
+#if USE_KEY_LATENCY
+    uint32_t now = uint32_t(sys_current_us());
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (stage == KEY_STAGE_SCAN)
+    {
+        if (key_current < 0 ||
+            now - key_stamp[KEY_STAGE_SCAN] > KEY_LATENCY_TIMEOUT)
+        {
+            key_stamp[KEY_STAGE_SCAN] = now;
+            key_current = KEY_STAGE_SCAN;
+        }
+    }
+    else if (key_current == stage - 1)
+    {
+        key_stamp[stage] = now;
+        key_current = stage;
+        if (stage == KEY_STAGE_SHOWN)
+        {
+            for (int s = KEY_STAGE_RECEIVED; s < KEY_STAGES; s++)
+                key_stage_sum[s] += key_stamp[s] - key_stamp[s - 1];
+            key_total[key_count % KEY_LATENCY_SAMPLES] =
+                now - key_stamp[KEY_STAGE_SCAN];
+            key_count++;
+            key_current = -1;
+        }
+    }
+    __set_PRIMASK(primask);
+#else // !USE_KEY_LATENCY
+    (void) stage;
+#endif // USE_KEY_LATENCY
+}
+
+
+uint32_t sys_key_samples()
+// ----------------------------------------------------------------------------
+//   Number of key presses measured up to the panel
+// ----------------------------------------------------------------------------
+{
+#if USE_KEY_LATENCY
+    return key_count;
+#else // !USE_KEY_LATENCY
+    return 0;
+#endif // USE_KEY_LATENCY
+}
+
+
+uint32_t sys_key_latency_us(uint32_t percent)
+// ----------------------------------------------------------------------------
+//   Percentile of the key to display latency over the latest samples
+// ----------------------------------------------------------------------------
+{
+#if USE_KEY_LATENCY
+    uint32_t sorted[KEY_LATENCY_SAMPLES];
+    uint32_t count = key_count;
+    if (count > KEY_LATENCY_SAMPLES)
+        count = KEY_LATENCY_SAMPLES;
+    if (!count)
+        return 0;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0; i < count; i++)
+        sorted[i] = key_total[i];
+    __set_PRIMASK(primask);
+
+    // Insertion sort, there are few samples
+    for (uint32_t i = 1; i < count; i++)
+    {
+        uint32_t v = sorted[i];
+        uint32_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    uint32_t rank = (count * percent + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+#else // !USE_KEY_LATENCY
+    (void) percent;
+    return 0;
+#endif // USE_KEY_LATENCY
+}
+
+
+uint32_t sys_key_stage_us(enum key_stage stage)
+// ----------------------------------------------------------------------------
+//   Average time in us from the previous stage to the given stage
+// ----------------------------------------------------------------------------
+{
+#if USE_KEY_LATENCY
+    if (!key_count || stage <= KEY_STAGE_SCAN || stage >= KEY_STAGES)
+        return 0;
+    return uint32_t(key_stage_sum[stage] / key_count);
+#else // !USE_KEY_LATENCY
+    (void) stage;
+    return 0;
+#endif // USE_KEY_LATENCY
+}
+
+
+void sys_key_stats_clear()
+// ----------------------------------------------------------------------------
+//   Reset key latency statistics
+// ----------------------------------------------------------------------------
+{
+#if USE_KEY_LATENCY
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (int s = 0; s < KEY_STAGES; s++)
+        key_stage_sum[s] = 0;
+    key_count = 0;
+    key_current = -1;
+    __set_PRIMASK(primask);
+#endif // USE_KEY_LATENCY
 }
 /*
 
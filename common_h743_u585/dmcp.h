@@ -399,6 +399,7 @@ void rtc_wakeup_delay();
 
 // ==== VBAT
 uint32_t read_power_voltage();
+void power_sample_push(uint32_t mv);
 int get_lowbat_state();
 int get_vbat();
 
@@ -889,6 +890,7 @@ int create_screenshot(int report_error);
 //  Key buffer functions
 // ---------------------------
 int key_empty();
+int key_exit_pending();
 int key_push(int k1);
 int key_tail();
 int key_pop();
@@ -961,6 +963,31 @@ void sys_delay(uint32_t ms_delay);
 // Current systick count
 uint32_t sys_tick_count();
 uint32_t sys_current_ms();
+uint64_t sys_current_us();
+uint32_t sys_core_mhz();
+
+// Clock governor: full speed while computing, slower while waiting for keys
+void     sys_clock_boost();
+void     sys_clock_idle();
+uint32_t sys_clock_switches();
+uint32_t sys_clock_switch_us();
+void     sys_clock_stats_clear();
+
+// Key press to display latency, measured in stages for the latest keys
+enum key_stage
+{
+    KEY_STAGE_SCAN,             // Scanned and posted by the keyboard task
+    KEY_STAGE_RECEIVED,         // Taken from the mailbox by the RPL task
+    KEY_STAGE_HANDLED,          // Processed by handle_key()
+    KEY_STAGE_DRAWN,            // Drawn in the framebuffer by redraw_lcd()
+    KEY_STAGE_SHOWN,            // Sent to the panel by the SPI DMA
+    KEY_STAGES
+};
+void     sys_key_stage(enum key_stage stage);
+uint32_t sys_key_samples();
+uint32_t sys_key_latency_us(uint32_t percent);
+uint32_t sys_key_stage_us(enum key_stage stage);
+void     sys_key_stats_clear();
 
 // Critical sections
 void sys_critical_start();
@@ -34,10 +34,13 @@
 #include "text.h"
 #include "utf8.h"
 
+#include <stdio.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "version.h"
 #include "SEGGER_RTT.h"
+#include "db_hardware_def.h"
 
 
 
@@ -47,6 +50,8 @@ RECORDER(file_error,    16, "File errors");
 
 // The one and only open file in DMCP...
 file *file::current = nullptr;
+uint  file::disk_generation = 0;
+uint  file::listing_changes = 0;
 
 
 // ============================================================================
@@ -69,23 +74,110 @@ missing from std fs library
 
 
 #if USE_EmFile
-static inline int fgetc_(FS_FILE *f)
+// ============================================================================
+//
+//   Read-ahead buffer
+//
+// ============================================================================
+//   emFile reads byte by byte are very slow on the SD card, so reads go
+//   through a buffer. Seeking within the buffer is free, and seeking before
+//   it fills the buffer backwards, so that rfind() remains fast.
+//   When writing, the same buffer collects data until it is full, the file
+//   is closed, or we seek, so that the SD card sees large sequential writes.
+
+byte file::buffer[file::BUFFER_SIZE];
+uint file::buffer_start = 0;
+uint file::buffer_size  = 0;
+uint file::buffer_index = 0;
+
+#if USE_COMPRESSED_FILES
+// Block buffers for compressed files, see "Compressed files" below
+static const byte zmagic[4] = { 0xDB, 0x5A, 0x4C, 0x34 };
+static const uint ZHEADER   = sizeof(zmagic);
+COMPILE_TIME_ASSERT(COMPRESSED_BLOCK < 0x10000);
+
+static byte zblock[COMPRESSED_BLOCK];   // Uncompressed data
+static byte zpacked[COMPRESSED_BLOCK];  // Compressed data
+static uint zblock_start = 0;           // Uncompressed position of zblock[0]
+static uint zblock_size  = 0;           // Bytes valid or pending in zblock
+static uint zblock_index = 0;           // Read position in zblock
+static uint znext        = ZHEADER;     // File offset of next block header
+#endif // USE_COMPRESSED_FILES
+
+
+void file::refill(uint off)
 // ----------------------------------------------------------------------------
-//   Read one character from a file - Wrapper for DMCP filesystem
+//   Fill the buffer so that it contains the given offset
 // ----------------------------------------------------------------------------
 {
-    UINT br                     = 0;
-   unsigned char c;
- if (f == NULL) {
-        return EOF;
+    uint start = off;
+    if (off < buffer_start)
+    {
+        // Reading backwards: keep a little room for reading forward
+        const uint ahead = 16;
+        start = off + ahead > BUFFER_SIZE ? off + ahead - BUFFER_SIZE : 0;
     }
-    
-    if (FS_FRead(&c, 1, 1, f) != 1) {
-        return EOF;
+    buffer_start = start;
+    buffer_index = off - start;
+    buffer_size  = 0;
+    if (data && FS_FSeek(data, start, FS_FILE_BEGIN) == 0)
+        buffer_size = FS_FRead(buffer, 1, BUFFER_SIZE, data);
+    record(file, "Refill %u at %u, got %u", off, start, buffer_size);
+}
+
+
+int file::next_byte()
+// ----------------------------------------------------------------------------
+//   Read the next byte from the buffer, refilling it as necessary
+// ----------------------------------------------------------------------------
+{
+#if USE_MAPPED_FILES
+    if (mapped)
+        return mapped_pos < mapped_size ? mapped[mapped_pos++] : EOF;
+#endif // USE_MAPPED_FILES
+#if USE_COMPRESSED_FILES
+    if (compressed)
+        return zfill() ? zblock[zblock_index++] : EOF;
+#endif // USE_COMPRESSED_FILES
+    if (buffer_index >= buffer_size)
+    {
+        refill(buffer_start + buffer_index);
+        if (buffer_index >= buffer_size)
+            return EOF;
     }
-    
-    return (int)c;
+    return buffer[buffer_index++];
 }
+#endif // USE_EmFile
+
+
+bool file::flush()
+// ----------------------------------------------------------------------------
+//   Write pending data to the file
+// ----------------------------------------------------------------------------
+{
+#if USE_EmFile
+#if USE_COMPRESSED_FILES
+    if (compressed && writing && !zflush())
+        return false;
+#endif // USE_COMPRESSED_FILES
+    if (!writing || !buffer_size)
+        return true;
+    uint count = data ? FS_FWrite(buffer, 1, buffer_size, data) : 0;
+    record(file, "Flush %u bytes at %u, wrote %u",
+           buffer_size, buffer_start, count);
+    if (count != buffer_size)
+        f_eof = true;
+    buffer_start += buffer_size;
+    buffer_size = 0;
+    return !f_eof;
+#else
+    return true;
+#endif // USE_EmFile
+}
+
+
+#if USE_EmFile
+
 
 /*
 static inline int fputc_(int c, FS_FILE *f )
@@ -206,7 +298,43 @@ void file::open(cstring path, mode wrmode)
 {
     bool reading = wrmode == READING;
     bool append  = wrmode == APPEND;
-    writing      = append || wrmode == WRITING;
+    writing      = append || wrmode == WRITING || wrmode == COMPRESSING;
+    if (writing)
+        listing_changes++;
+#if USE_COMPRESSED_FILES
+    if (!append)
+        compressed = false;
+#endif // USE_COMPRESSED_FILES
+
+#if USE_MAPPED_FILES
+    mapped = nullptr;
+#if USE_RESOURCE_FLASH
+    if (reading)
+        mapped = resource(path, &mapped_size);
+#endif // USE_RESOURCE_FLASH
+#if USE_PINNED_FILES
+    mapped_stamp = 0;
+    if (!reading)
+        unpin(path, strlen(path));
+    else if (!mapped)
+        mapped = pinned(path, &mapped_size, &mapped_stamp);
+    if (mapped_stamp)
+        pinned_users++;
+#endif // USE_PINNED_FILES
+    if (mapped)
+    {
+        name       = path;
+        mapped_pos = 0;
+        f_eof      = false;
+        previous   = nullptr;
+        return;
+    }
+#endif // USE_MAPPED_FILES
+
+#if USE_ASYNC_IO
+    io_wait();
+#endif // USE_ASYNC_IO
+
     previous     = current;
     if (previous)
         previous->close(false);
@@ -233,6 +361,14 @@ void file::open(cstring path, mode wrmode)
    int err = FS_FOpenEx(n_name, reading ? "r" : append ? "a" : "w+", &data);
    SEGGER_RTT_printf(0, "\nopen : %s => %s", n_name,  err ? FS_ErrorNo2Text(err): "ok");
    f_eof = false;
+   buffer_start = buffer_size = buffer_index = 0;
+   if (append && data && FS_FSeek(data, 0, FS_FILE_END) == 0)
+      buffer_start = FS_FTell(data);
+#if USE_COMPRESSED_FILES
+   // Appending to a compressed file only happens when reopening it
+   if (!append && data)
+      compressed = zstart(wrmode == COMPRESSING);
+#endif // USE_COMPRESSED_FILES
 #else // !SIMULATOR
     if (writing)
         sys_disk_write_enable(1);
@@ -260,6 +396,10 @@ void file::reopen()
     open(name, writing ? APPEND : READING);
     if (valid() && !writing)
         seek(closed);
+#if USE_COMPRESSED_FILES
+    if (valid() && writing && compressed)
+        zappend(closed);
+#endif // USE_COMPRESSED_FILES
 }
 
 
@@ -268,6 +408,21 @@ void file::close(bool reopen)
 //    Close the help file
 // ----------------------------------------------------------------------------
 {
+#if USE_MAPPED_FILES
+    if (mapped)
+    {
+        // Other files were left open
+        closed = mapped_pos;
+        mapped = nullptr;
+#if USE_PINNED_FILES
+        if (mapped_stamp)
+            pinned_users--;
+        mapped_stamp = 0;
+#endif // USE_PINNED_FILES
+        return;
+    }
+#endif // USE_MAPPED_FILES
+
     if (valid())
     {
 #if (SIMULATOR & ! USE_EmFile)
@@ -276,9 +431,11 @@ void file::close(bool reopen)
         data = nullptr;
 #elif USE_EmFile
 
-closed = FS_FTell(data);
-      FS_FClose(data);
+        flush();
+        closed = position();
+        FS_FClose(data);
         data = nullptr;
+        buffer_start = buffer_size = buffer_index = 0;
 #else
         closed = ftell(data);
         fclose(data);
@@ -301,19 +458,18 @@ bool file::put(unicode cp)
 //   Emit a unicode character in the file
 // ----------------------------------------------------------------------------
 {
-    byte   buffer[4];
-    size_t count = utf8_encode(cp, buffer);
+    byte   encoded[4];
+    size_t count = utf8_encode(cp, encoded);
 
 #if (SIMULATOR & ! USE_EmFile)
-    return fwrite(buffer, 1, count, data) == count;
+    return fwrite(encoded, 1, count, data) == count;
 
 #elif  USE_EmFile
-    f_eof =  FS_FWrite(buffer, 1, count, data) != count;
-    return !f_eof;
+    return write((const char *) encoded, count);
 
 #else
     UINT bw = 0;
-    return f_write(&data, buffer, count, &bw) == FR_OK && bw == count;
+    return f_write(&data, encoded, count, &bw) == FR_OK && bw == count;
 #endif
 }
 
@@ -326,8 +482,16 @@ bool file::put(char c)
 #if (SIMULATOR & ! USE_EmFile)
     return fwrite(&c, 1, 1, data) == 1;
 #elif  USE_EmFile
-    f_eof =  FS_FWrite(&c, 1, 1, data) != 1;
-    return !f_eof;
+#if USE_COMPRESSED_FILES
+    if (compressed)
+        return zwrite(&c, 1);
+#endif // USE_COMPRESSED_FILES
+    if (buffer_size < BUFFER_SIZE)
+    {
+        buffer[buffer_size++] = c;
+        return !f_eof;
+    }
+    return write_raw(&c, 1);
 
 #else
     UINT bw = 0;
@@ -344,8 +508,11 @@ bool file::write(const char *buf, size_t len)
 #if (SIMULATOR & ! USE_EmFile)
     return fwrite(buf, 1, len, data) == len;
 #elif  USE_EmFile
-    f_eof =  FS_FWrite(buf, 1, len, data) != len;
-    return !f_eof;
+#if USE_COMPRESSED_FILES
+    if (compressed)
+        return zwrite(buf, len);
+#endif // USE_COMPRESSED_FILES
+    return write_raw(buf, len);
 #else
     UINT bw = 0;
     return f_write(&data, buf, len, &bw) == FR_OK && bw == len;
@@ -353,17 +520,65 @@ bool file::write(const char *buf, size_t len)
 }
 
 
+#if USE_EmFile
+bool file::write_raw(const char *buf, size_t len)
+// ----------------------------------------------------------------------------
+//   Write data to the file itself, through the buffer
+// ----------------------------------------------------------------------------
+{
+    // Fill the buffer, flushing it when full
+    while (len && len + buffer_size >= BUFFER_SIZE && buffer_size)
+    {
+        uint count = BUFFER_SIZE - buffer_size;
+        memcpy(buffer + buffer_size, buf, count);
+        buffer_size += count;
+        buf += count;
+        len -= count;
+        if (!flush())
+            return false;
+    }
+
+    // Large writes go directly to the file
+    if (len >= BUFFER_SIZE)
+    {
+        uint count = FS_FWrite(buf, 1, len, data);
+        buffer_start += count;
+        if (count != len)
+            f_eof = true;
+        return !f_eof;
+    }
+
+    memcpy(buffer + buffer_size, buf, len);
+    buffer_size += len;
+    return !f_eof;
+}
+#endif // USE_EmFile
+
+
 bool file::read(char *buf, size_t len)
 // ----------------------------------------------------------------------------
 //   Read data from a file
 // ----------------------------------------------------------------------------
 {
+#if USE_MAPPED_FILES
+    if (mapped)
+    {
+        uint avail = mapped_pos < mapped_size ? mapped_size - mapped_pos : 0;
+        uint count = len < avail ? len : avail;
+        memcpy(buf, mapped + mapped_pos, count);
+        mapped_pos += count;
+        f_eof = count != len;
+        return !f_eof;
+    }
+#endif // USE_MAPPED_FILES
 #if (SIMULATOR & ! USE_EmFile)
     return fread(buf, 1, len, data) == len;
 #elif  USE_EmFile
-
-    f_eof =  FS_FRead(buf, 1, len, data) != len;
-    return !f_eof;
+#if USE_COMPRESSED_FILES
+    if (compressed)
+        return zread(buf, len);
+#endif // USE_COMPRESSED_FILES
+    return read_raw(buf, len);
 #else
     UINT bw = 0;
     return f_read(&data, buf, len, &bw) == FR_OK && bw == len;
@@ -371,25 +586,58 @@ bool file::read(char *buf, size_t len)
 }
 
 
+#if USE_EmFile
+bool file::read_raw(char *buf, size_t len)
+// ----------------------------------------------------------------------------
+//   Read data from the file itself, through the buffer
+// ----------------------------------------------------------------------------
+{
+    // Take what we can from the buffer
+    uint avail = buffer_index < buffer_size ? buffer_size - buffer_index : 0;
+    uint count = len < avail ? len : avail;
+    memcpy(buf, buffer + buffer_index, count);
+    buffer_index += count;
+    buf += count;
+    len -= count;
+
+    // Large reads go directly to the file, smaller ones through the buffer
+    // The position is that of the file itself, even for compressed files
+    uint off = buffer_start + buffer_index;
+    if (len >= BUFFER_SIZE)
+    {
+        count = FS_FSeek(data, off, FS_FILE_BEGIN) == 0
+            ? FS_FRead(buf, 1, len, data) : 0;
+        buffer_start = off + count;
+        buffer_size = buffer_index = 0;
+        len -= count;
+    }
+    else if (len)
+    {
+        refill(off);
+        count = buffer_index < buffer_size ? buffer_size - buffer_index : 0;
+        if (count > len)
+            count = len;
+        memcpy(buf, buffer + buffer_index, count);
+        buffer_index += count;
+        len -= count;
+    }
+    f_eof = len != 0;
+    return !f_eof;
+}
+#endif // USE_EmFile
+
+
 char file::getchar()
 // ----------------------------------------------------------------------------
 //   Read char code at offset
 // ----------------------------------------------------------------------------
 {
 #if USE_EmFile
-   unsigned char c;
-    if (data == NULL) {
-      f_eof = true;
-      c = 0;
-        return c;
-    }
-    if (FS_FRead(&c, 1, 1, data) != 1) {
-      f_eof = true;
-      c = 0;
-        return c;
-    }    
-   f_eof = false;
-   return (int)c;
+    int c = valid() ? next_byte() : EOF;
+    f_eof = c == EOF;
+    if (f_eof)
+        c = 0;
+    return c;
 #else
     int c = valid() ? fgetc(data) : 0;
     if (c == EOF)
@@ -404,7 +652,7 @@ unicode file::get()
 //   Read UTF8 code at offset
 // ----------------------------------------------------------------------------
 {
-    unicode code = valid() ? fgetc_(data) : unicode(EOF);
+    unicode code = valid() ? next_byte() : unicode(EOF);
     if (code == unicode(EOF)){
       f_eof = true;
        return 0;
@@ -414,21 +662,987 @@ unicode file::get()
         // Reference: Wikipedia UTF-8 description
         if ((code & 0xE0)      == 0xC0)
             code = ((code & 0x1F)        <<  6)
-                |  (fgetc_(data) & 0x3F);
+                |  (next_byte() & 0x3F);
         else if ((code & 0xF0) == 0xE0)
             code = ((code & 0xF)         << 12)
-                |  ((fgetc_(data) & 0x3F) <<  6)
-                |   (fgetc_(data) & 0x3F);
+                |  ((next_byte() & 0x3F) <<  6)
+                |   (next_byte() & 0x3F);
         else if ((code & 0xF8) == 0xF0)
             code = ((code & 0xF)         << 18)
-                |  ((fgetc_(data) & 0x3F) << 12)
-                |  ((fgetc_(data) & 0x3F) << 6)
-                |   (fgetc_(data) & 0x3F);
+                |  ((next_byte() & 0x3F) << 12)
+                |  ((next_byte() & 0x3F) << 6)
+                |   (next_byte() & 0x3F);
     }
     return code;
 }
 
 
+#if USE_COMPRESSED_FILES
+// ============================================================================
+//
+//   Compressed files
+//
+// ============================================================================
+//   A compressed file starts with a 4-byte magic number, followed by blocks
+//   of at most COMPRESSED_BLOCK bytes of data. Each block has a header with
+//   the 16-bit little-endian sizes of the data and of what follows. If both
+//   are equal, the data is stored as is, otherwise it is in LZ4 block format.
+//   Blocks are independent, so that appending after reopening a file simply
+//   adds blocks, and skipping forward only reads block headers.
+
+#ifndef COMPRESSED_HASH_BITS
+// Size of the match finder table when compressing, as a power of two
+#define COMPRESSED_HASH_BITS    10
+#endif // COMPRESSED_HASH_BITS
+
+static uint16_t zhash[1 << COMPRESSED_HASH_BITS];
+
+
+static inline uint32_t zread32(const byte *p)
+// ----------------------------------------------------------------------------
+//   Read four bytes for the match finder
+// ----------------------------------------------------------------------------
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static inline uint zhash_of(const byte *p)
+// ----------------------------------------------------------------------------
+//   Hash the four bytes at the given position
+// ----------------------------------------------------------------------------
+{
+    return (zread32(p) * 2654435761u) >> (32 - COMPRESSED_HASH_BITS);
+}
+
+
+static byte *zlength(byte *out, byte *end, uint len)
+// ----------------------------------------------------------------------------
+//   Emit the extra bytes of a literal or match length
+// ----------------------------------------------------------------------------
+{
+    for (; len >= 255; len -= 255)
+    {
+        if (out >= end)
+            return nullptr;
+        *out++ = 255;
+    }
+    if (out >= end)
+        return nullptr;
+    *out++ = len;
+    return out;
+}
+
+
+static byte *zsequence(byte *out, byte *end,
+                       const byte *lit, uint litlen, uint offset, uint mlen)
+// ----------------------------------------------------------------------------
+//   Emit one sequence, literals then an optional match
+// ----------------------------------------------------------------------------
+{
+    if (out >= end)
+        return nullptr;
+    byte *token = out++;
+    *token = (litlen >= 15 ? 15 : litlen) << 4;
+    if (litlen >= 15 && !(out = zlength(out, end, litlen - 15)))
+        return nullptr;
+    if (litlen > uint(end - out))
+        return nullptr;
+    memcpy(out, lit, litlen);
+    out += litlen;
+    if (!offset)
+        return out;
+    if (end - out < 2)
+        return nullptr;
+    *out++ = offset;
+    *out++ = offset >> 8;
+    mlen -= 4;
+    *token |= mlen >= 15 ? 15 : mlen;
+    if (mlen >= 15 && !(out = zlength(out, end, mlen - 15)))
+        return nullptr;
+    return out;
+}
+
+
+static uint zpack(const byte *src, uint size, byte *dst, uint max)
+// ----------------------------------------------------------------------------
+//   Compress a block in LZ4 block format, return 0 if it does not shrink
+// ----------------------------------------------------------------------------
+//   As required by the format, the last 5 bytes are literals, and no match
+//   starts in the last 12 bytes. Blocks are below 64K, so positions fit in
+//   16 bits in the match finder table.
+{
+    const uint last  = 5;
+    const uint limit = 12;
+    byte      *out   = dst;
+    byte      *end   = dst + (max < size ? max : size);
+    uint       lit   = 0;
+    uint       pos   = 0;
+
+    memset(zhash, 0, sizeof(zhash));
+    if (size > limit)
+    {
+        while (pos + limit < size)
+        {
+            uint h   = zhash_of(src + pos);
+            uint ref = zhash[h];
+            zhash[h] = pos;
+            if (ref < pos && pos - ref < 0x10000 &&
+                zread32(src + ref) == zread32(src + pos))
+            {
+                uint mlen = 4;
+                while (pos + mlen + last < size &&
+                       src[ref + mlen] == src[pos + mlen])
+                    mlen++;
+                out = zsequence(out, end, src + lit, pos - lit, pos - ref, mlen);
+                if (!out)
+                    return 0;
+                pos += mlen;
+                lit = pos;
+            }
+            else
+            {
+                pos++;
+            }
+        }
+    }
+    out = zsequence(out, end, src + lit, size - lit, 0, 0);
+    if (!out || out >= end)
+        return 0;
+    return out - dst;
+}
+
+
+static uint zunpack(const byte *src, uint size, byte *dst, uint max)
+// ----------------------------------------------------------------------------
+//   Decompress a block in LZ4 block format, return decompressed size
+// ----------------------------------------------------------------------------
+//   All lengths and offsets are checked, so a damaged file cannot cause
+//   writes outside of the output buffer
+{
+    const byte *in    = src;
+    const byte *inend = src + size;
+    byte       *out   = dst;
+    byte       *end   = dst + max;
+    while (in < inend)
+    {
+        uint token = *in++;
+        uint len   = token >> 4;
+        if (len == 15)
+        {
+            uint more;
+            do
+            {
+                if (in >= inend)
+                    return 0;
+                more = *in++;
+                len += more;
+            } while (more == 255);
+        }
+        if (len > uint(inend - in) || len > uint(end - out))
+            return 0;
+        memcpy(out, in, len);
+        in += len;
+        out += len;
+        if (in >= inend)
+            break;
+
+        if (inend - in < 2)
+            return 0;
+        uint offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (!offset || offset > uint(out - dst))
+            return 0;
+        len = (token & 15);
+        if (len == 15)
+        {
+            uint more;
+            do
+            {
+                if (in >= inend)
+                    return 0;
+                more = *in++;
+                len += more;
+            } while (more == 255);
+        }
+        len += 4;
+        if (len > uint(end - out))
+            return 0;
+        const byte *ref = out - offset;
+        while (len--)
+            *out++ = *ref++;
+    }
+    return out - dst;
+}
+
+
+bool file::zstart(bool compress)
+// ----------------------------------------------------------------------------
+//   Prepare a newly opened file, return true if it is compressed
+// ----------------------------------------------------------------------------
+{
+    zblock_start = zblock_size = zblock_index = 0;
+    znext = ZHEADER;
+    if (compress)
+        return write_raw(cstring(zmagic), sizeof(zmagic));
+    if (writing)
+        return false;
+
+    byte magic[sizeof(zmagic)];
+    if (read_raw((char *) magic, sizeof(magic)) &&
+        memcmp(magic, zmagic, sizeof(zmagic)) == 0)
+        return true;
+    seek_raw(0);
+    f_eof = false;
+    return false;
+}
+
+
+void file::zappend(uint position)
+// ----------------------------------------------------------------------------
+//   Continue writing a compressed file after it was reopened
+// ----------------------------------------------------------------------------
+{
+    zblock_start = position;
+    zblock_size = zblock_index = 0;
+}
+
+
+uint file::zposition()
+// ----------------------------------------------------------------------------
+//   Position in the uncompressed data
+// ----------------------------------------------------------------------------
+{
+    return zblock_start + (writing ? zblock_size : zblock_index);
+}
+
+
+bool file::zheader(uint &raw, uint &packed)
+// ----------------------------------------------------------------------------
+//   Read the header of the next block, return false at end of file
+// ----------------------------------------------------------------------------
+{
+    byte hdr[4];
+    seek_raw(znext);
+    if (!read_raw((char *) hdr, sizeof(hdr)))
+        return false;
+    raw    = hdr[0] | (hdr[1] << 8);
+    packed = hdr[2] | (hdr[3] << 8);
+    if (!raw || raw > COMPRESSED_BLOCK || packed > raw)
+    {
+        record(file_error, "Invalid compressed block at %u in %s",
+               znext, name);
+        f_eof = true;
+        return false;
+    }
+    return true;
+}
+
+
+bool file::zfill()
+// ----------------------------------------------------------------------------
+//   Make sure there is data to read in the block buffer
+// ----------------------------------------------------------------------------
+{
+    if (zblock_index < zblock_size)
+        return true;
+
+    uint raw = 0, packed = 0;
+    zblock_start += zblock_size;
+    zblock_size = zblock_index = 0;
+    if (!zheader(raw, packed))
+        return false;
+
+    bool ok = packed == raw
+        ? read_raw((char *) zblock, raw)
+        : (read_raw((char *) zpacked, packed) &&
+           zunpack(zpacked, packed, zblock, raw) == raw);
+    if (!ok)
+    {
+        record(file_error, "Could not read compressed block at %u in %s",
+               znext, name);
+        f_eof = true;
+        return false;
+    }
+    znext += sizeof(uint32_t) + packed;
+    zblock_size = raw;
+    return true;
+}
+
+
+void file::zseek(uint off)
+// ----------------------------------------------------------------------------
+//   Move to an uncompressed position, skipping blocks without unpacking them
+// ----------------------------------------------------------------------------
+{
+    if (off >= zblock_start && off <= zblock_start + zblock_size)
+    {
+        zblock_index = off - zblock_start;
+        return;
+    }
+    if (off < zblock_start)
+    {
+        zblock_start = 0;
+        znext = ZHEADER;
+    }
+    else
+    {
+        zblock_start += zblock_size;
+    }
+    zblock_size = zblock_index = 0;
+
+    uint raw = 0, packed = 0;
+    while (zheader(raw, packed) && zblock_start + raw <= off)
+    {
+        zblock_start += raw;
+        znext += sizeof(uint32_t) + packed;
+    }
+    if (zfill())
+        zblock_index = off - zblock_start;
+}
+
+
+bool file::zread(char *buf, size_t len)
+// ----------------------------------------------------------------------------
+//   Read uncompressed data
+// ----------------------------------------------------------------------------
+{
+    while (len && zfill())
+    {
+        uint count = zblock_size - zblock_index;
+        if (count > len)
+            count = len;
+        memcpy(buf, zblock + zblock_index, count);
+        zblock_index += count;
+        buf += count;
+        len -= count;
+    }
+    f_eof = len != 0;
+    return !f_eof;
+}
+
+
+bool file::zwrite(const char *buf, size_t len)
+// ----------------------------------------------------------------------------
+//   Write data, compressing each block when it is full
+// ----------------------------------------------------------------------------
+{
+    while (len)
+    {
+        uint count = COMPRESSED_BLOCK - zblock_size;
+        if (count > len)
+            count = len;
+        memcpy(zblock + zblock_size, buf, count);
+        zblock_size += count;
+        buf += count;
+        len -= count;
+        if (zblock_size == COMPRESSED_BLOCK && !zflush())
+            return false;
+    }
+    return !f_eof;
+}
+
+
+bool file::zflush()
+// ----------------------------------------------------------------------------
+//   Compress and write the pending block
+// ----------------------------------------------------------------------------
+{
+    uint raw = zblock_size;
+    if (!raw)
+        return true;
+
+    // Reset first, since writing may flush, which comes back here
+    zblock_start += raw;
+    zblock_size = 0;
+
+    uint   packed = zpack(zblock, raw, zpacked, sizeof(zpacked));
+    byte_p src    = packed ? zpacked : zblock;
+    if (!packed)
+        packed = raw;
+    byte hdr[4] = { byte(raw), byte(raw >> 8), byte(packed), byte(packed >> 8) };
+    record(file, "Compressed block %u bytes into %u", raw, packed);
+    return write_raw(cstring(hdr), sizeof(hdr)) &&
+           write_raw(cstring(src), packed);
+}
+#endif // USE_COMPRESSED_FILES
+
+
+#if USE_RESOURCE_FLASH
+// ============================================================================
+//
+//   Resource flash
+//
+// ============================================================================
+//   Read-only files such as fonts and help are copied from the disk to a
+//   memory-mapped flash, where they can be used directly. The header is
+//   written last, so that an interrupted load leaves no resources.
+
+bool file::resources_enabled = true;
+
+
+byte_p file::resource(cstring path, uint *size)
+// ----------------------------------------------------------------------------
+//   Return the data for a path in the resource flash, or nullptr
+// ----------------------------------------------------------------------------
+{
+    const resource_header *hdr = (const resource_header *) RESOURCE_FLASH_BASE;
+    if (!resources_enabled || hdr->magic != RESOURCE_MAGIC ||
+        hdr->size > RESOURCE_FLASH_SIZE ||
+        hdr->count > RESOURCE_FLASH_SIZE / sizeof(resource_entry))
+        return nullptr;
+
+    while (*path == '/')
+        path++;
+    const resource_entry *entry = (const resource_entry *) (hdr + 1);
+    for (uint i = 0; i < hdr->count; i++, entry++)
+    {
+        if (strncmp(entry->name, path, sizeof(entry->name)) == 0 &&
+            entry->offset <= hdr->size &&
+            entry->size <= hdr->size - entry->offset)
+        {
+            if (size)
+                *size = entry->size;
+            return byte_p(RESOURCE_FLASH_BASE) + entry->offset;
+        }
+    }
+    return nullptr;
+}
+
+
+void file::resources_enable(bool enable)
+// ----------------------------------------------------------------------------
+//   Enable or disable use of the resource flash, e.g. while loading it
+// ----------------------------------------------------------------------------
+{
+    resources_enabled = enable;
+}
+
+
+bool file::load_resources(const cstring *paths, uint count)
+// ----------------------------------------------------------------------------
+//   Copy the given files from the disk into the resource flash
+// ----------------------------------------------------------------------------
+//   Missing files are skipped. The caller must not use any resource.
+{
+    resource_entry  entries[16];
+    cstring         sources[16];
+    resource_header hdr   = { RESOURCE_MAGIC, 0, 0, 0 };
+    bool            ok    = true;
+
+    // Read sizes from the disk, not from the flash we are about to erase
+    resources_enable(false);
+    if (count > sizeof(entries) / sizeof(entries[0]))
+        count = sizeof(entries) / sizeof(entries[0]);
+    hdr.size = sizeof(hdr) + count * sizeof(resource_entry);
+    for (uint i = 0; ok && i < count; i++)
+    {
+        cstring path = paths[i];
+        while (*path == '/')
+            path++;
+        file src(paths[i], READING);
+        if (src.valid() && strlen(path) < sizeof(entries[0].name))
+        {
+            sources[hdr.count] = paths[i];
+            resource_entry &e = entries[hdr.count++];
+            memset(&e, 0, sizeof(e));
+            strcpy(e.name, path);
+            e.size = src.size();
+            e.offset = hdr.size;
+            hdr.size += (e.size + 3) & ~3;
+            ok = hdr.size <= RESOURCE_FLASH_SIZE;
+        }
+    }
+    record(file, "Loading %u resources, %u bytes", hdr.count, hdr.size);
+
+    // Erase and write directory, then data, then header
+    ok = ok && resource_flash_erase(hdr.size);
+    ok = ok && resource_flash_write(sizeof(hdr), entries,
+                                    hdr.count * sizeof(resource_entry));
+    for (uint i = 0; ok && i < hdr.count; i++)
+    {
+        file src(sources[i], READING);
+        char chunk[256];
+        for (uint done = 0; ok && done < entries[i].size; done += sizeof(chunk))
+        {
+            uint len = entries[i].size - done;
+            if (len > sizeof(chunk))
+                len = sizeof(chunk);
+            ok = src.read(chunk, len) &&
+                resource_flash_write(entries[i].offset + done, chunk, len);
+        }
+    }
+    ok = ok && resource_flash_write(0, &hdr, sizeof(hdr));
+    if (!ok)
+        record(file_error, "Loading resources failed");
+
+    resources_enable(true);
+    return ok;
+}
+#endif // USE_RESOURCE_FLASH
+
+
+#if USE_PINNED_FILES
+// ============================================================================
+//
+//   Files pinned in RAM
+//
+// ============================================================================
+//   Small index and configuration files are opened again and again, e.g.
+//   the help index on each help key, or config/*.csv for each menu. The
+//   first read copies the whole file into a RAM pool, and later opens read
+//   it from there without walking directories and the FAT. Writing or
+//   removing a file unpins it, and host changes to the disk unpin all.
+
+struct pinned_file
+// ----------------------------------------------------------------------------
+//   A file whose data is in the pool
+// ----------------------------------------------------------------------------
+{
+    char        name[64];       // Path, empty if the entry is free
+    uint        offset;         // Offset of data in pinned_pool
+    uint        size;           // Size of data
+    uint        stamp;          // Modification time
+    uint        generation;     // Disk generation when pinned
+};
+
+static pinned_file pinned_files[PINNED_FILES];
+static byte __attribute__((section(PINNED_FILES_SECTION), aligned(32)))
+                   pinned_pool[PINNED_FILES_POOL];
+static uint        pinned_used = 0;
+uint               file::pinned_users = 0;
+
+
+static bool pinned_match(cstring pinned, cstring path, size_t len)
+// ----------------------------------------------------------------------------
+//   Compare paths, ignoring case, leading and kind of separators
+// ----------------------------------------------------------------------------
+{
+    while (len && (*path == '/' || *path == '\\'))
+    {
+        path++;
+        len--;
+    }
+    for (; len && *pinned; pinned++, path++, len--)
+    {
+        char a = *pinned == '\\' ? '/' : tolower(*pinned);
+        char b = *path == '\\' ? '/' : tolower(*path);
+        if (a != b)
+            return false;
+    }
+    return !len && !*pinned;
+}
+
+
+static bool pinnable(cstring path)
+// ----------------------------------------------------------------------------
+//   Check if the file is one of the kinds we pin
+// ----------------------------------------------------------------------------
+{
+    cstring ext = file::extension(path);
+    return ext && (strcasecmp(ext, ".idx") == 0 ||
+                   strcasecmp(ext, ".csv") == 0 ||
+                   strcasecmp(ext, ".cfg") == 0);
+}
+
+
+byte_p file::pinned(cstring path, uint *size, uint *stamp)
+// ----------------------------------------------------------------------------
+//   Return the data of a pinned file, pinning it if possible
+// ----------------------------------------------------------------------------
+{
+    if (!pinnable(path))
+        return nullptr;
+
+    size_t       len  = strlen(path);
+    pinned_file *free = nullptr;
+    for (pinned_file &p : pinned_files)
+    {
+        if (!p.name[0] || p.generation != disk_generation)
+        {
+            if (!free)
+                free = &p;
+        }
+        else if (pinned_match(p.name, path, len))
+        {
+            *size  = p.size;
+            *stamp = p.stamp;
+            return pinned_pool + p.offset;
+        }
+    }
+
+    // Read the whole file, and its time stamp
+    char n_name[sizeof(free->name)];
+    uint ii = 0;
+    while (*path == '/')
+        path++;
+    for (cstring p = path; *p && ii < sizeof(n_name) - 1; p++)
+        n_name[ii++] = *p == '/' ? '\\' : *p;
+    n_name[ii] = 0;
+    if (path[ii])
+        return nullptr;
+
+#if USE_ASYNC_IO
+    io_wait();
+#endif // USE_ASYNC_IO
+    FS_FILE *data = nullptr;
+    if (FS_FOpenEx(n_name, "r", &data) != 0 || !data)
+        return nullptr;
+    uint fsize = FS_GetFileSize(data);
+    U32  fstamp = 0;
+    if (fsize > PINNED_FILE_MAX ||
+        FS_GetFileTimeEx(n_name, &fstamp, FS_FILETIME_MODIFY) != 0 ||
+        !fstamp)
+    {
+        FS_FClose(data);
+        return nullptr;
+    }
+
+    // When the pool is full, start over unless pinned data is being read
+    if (!free || pinned_used + fsize > sizeof(pinned_pool))
+    {
+        if (pinned_users)
+        {
+            FS_FClose(data);
+            return nullptr;
+        }
+        for (pinned_file &p : pinned_files)
+            p.name[0] = 0;
+        pinned_used = 0;
+        free = &pinned_files[0];
+    }
+
+    byte *buf = pinned_pool + pinned_used;
+    bool  ok  = FS_FRead(buf, 1, fsize, data) == fsize;
+    FS_FClose(data);
+    if (!ok)
+        return nullptr;
+
+    strcpy(free->name, n_name);
+    free->offset     = pinned_used;
+    free->size       = fsize;
+    free->stamp      = fstamp;
+    free->generation = disk_generation;
+    pinned_used += (fsize + 3) & ~3;
+    record(file, "Pinned %s, %u bytes, %u used", n_name, fsize, pinned_used);
+
+    *size  = fsize;
+    *stamp = fstamp;
+    return buf;
+}
+
+
+void file::unpin(cstring path, size_t len)
+// ----------------------------------------------------------------------------
+//   Unpin a file before it is written or removed
+// ----------------------------------------------------------------------------
+//   The data stays in the pool until it is reclaimed, so that files being
+//   read keep valid data
+{
+    for (pinned_file &p : pinned_files)
+        if (p.name[0] && pinned_match(p.name, path, len))
+            p.name[0] = 0;
+}
+#endif // USE_PINNED_FILES
+
+
+#if USE_ASYNC_IO
+// ============================================================================
+//
+//   Background writes
+//
+// ============================================================================
+//   A whole file is copied into a staging buffer, and a separate task writes
+//   it to the SD card while the RPL task keeps handling keys and the display.
+//
+//   emFile is not built with its OS locking layer, so the two tasks must
+//   never be inside it at the same time. The lock is the queue itself: the
+//   RPL task calls io_wait() before any other emFile call, which returns
+//   once the I/O task has closed its last file, and it only queues a write
+//   while no file is open. The I/O task does not use the shared file buffer.
+//
+//   A failed write is kept until io_error() reports it, either when the
+//   RPL task is told the writes are done, or on the next background store.
+
+struct io_job
+// ----------------------------------------------------------------------------
+//   A pending write of a whole file
+// ----------------------------------------------------------------------------
+{
+    char        name[80];       // emFile path, with '\\' separators
+    byte *      data;           // Data in io_buffer
+    uint        size;           // Size of data
+};
+
+static io_job        io_jobs[ASYNC_IO_JOBS];
+static byte          io_buffer[ASYNC_IO_BUFFER];
+static uint          io_used    = 0;     // Bytes staged since queue was empty
+static volatile uint io_queued  = 0;     // Jobs submitted by the RPL task
+static volatile uint io_done    = 0;     // Jobs completed by the I/O task
+static volatile bool io_failed  = false; // A write failed, see io_failure
+static char          io_failure[96];     // Message for the failed write
+static bool          io_started = false;
+static byte          io_messages[ASYNC_IO_JOBS];
+static OS_MAILBOX    io_mailbox;
+static OS_TASK       io_tcb;
+static OS_STACKPTR int io_stack[512];
+
+
+static void io_path(char *dst, size_t max, cstring src, size_t len)
+// ----------------------------------------------------------------------------
+//   Convert a path to emFile separators
+// ----------------------------------------------------------------------------
+{
+    uint ii = 0;
+    for (uint i = 0; i < len && src[i] && ii < max - 1; i++)
+        dst[ii++] = src[i] == '/' ? '\\' : src[i];
+    dst[ii] = 0;
+}
+
+
+static void io_task()
+// ----------------------------------------------------------------------------
+//   Write the files queued by the RPL task
+// ----------------------------------------------------------------------------
+{
+    while (true)
+    {
+        byte index = 0;
+        OS_MAILBOX_GetBlocked(&io_mailbox, &index);
+
+        io_job  &job  = io_jobs[index];
+        FS_FILE *data = nullptr;
+        int      err  = FS_FOpenEx(job.name, "w", &data);
+        bool     ok   = err == 0 && data;
+        if (ok)
+        {
+            ok = FS_FWrite(job.data, 1, job.size, data) == job.size;
+            ok = FS_FClose(data) == 0 && ok;
+        }
+        if (!ok)
+        {
+            record(file_error, "Background write of %u bytes to %s failed",
+                   job.size, job.name);
+            if (!io_failed)
+            {
+                snprintf(io_failure, sizeof(io_failure),
+                         "Writing %s failed", job.name);
+                io_failed = true;
+            }
+        }
+        SEGGER_RTT_printf(0, "\nwrite : %s => %s", job.name, ok ? "ok" : "err");
+
+        // Tell the RPL task when all writes are done to clear the annunciator
+        io_done = io_done + 1;
+        if (io_done == io_queued)
+        {
+            uint32_t msg = IO_DONE_MESSAGE;
+            OS_MAILBOX_Put(&Mb_Keyboard, &msg);
+        }
+    }
+}
+
+
+void file::io_start()
+// ----------------------------------------------------------------------------
+//   Start the background I/O task
+// ----------------------------------------------------------------------------
+{
+    if (io_started)
+        return;
+    OS_MAILBOX_Create(&io_mailbox, 1, ASYNC_IO_JOBS, io_messages);
+    OS_TASK_CREATE(&io_tcb, "FileIO", ASYNC_IO_PRIORITY, io_task, io_stack);
+    io_started = true;
+}
+
+
+uint file::io_pending()
+// ----------------------------------------------------------------------------
+//   Return the number of writes not yet completed
+// ----------------------------------------------------------------------------
+{
+    return io_queued - io_done;
+}
+
+
+byte *file::async_start(text_p path, size_t size)
+// ----------------------------------------------------------------------------
+//   Return a staging buffer for the whole content of a file, or nullptr
+// ----------------------------------------------------------------------------
+//   The caller fills the buffer, then calls async_submit(). When this
+//   returns nullptr, the caller must write the file synchronously.
+{
+    if (!io_started || !path || current)
+        return nullptr;
+
+    size_t len  = 0;
+    utf8   name = path->value(&len);
+#if USE_PINNED_FILES
+    unpin(cstring(name), len);
+#endif // USE_PINNED_FILES
+    listing_changes++;
+    if (io_pending() == 0)
+        io_used = 0;
+    if (io_pending() >= ASYNC_IO_JOBS ||
+        len >= sizeof(io_jobs[0].name) ||
+        size > ASYNC_IO_BUFFER - io_used)
+        return nullptr;
+
+    io_job &job = io_jobs[io_queued % ASYNC_IO_JOBS];
+    io_path(job.name, sizeof(job.name), cstring(name), len);
+    job.data = io_buffer + io_used;
+    job.size = size;
+    io_used += (size + 3) & ~3;
+    return job.data;
+}
+
+
+void file::async_submit()
+// ----------------------------------------------------------------------------
+//   Queue the job prepared by async_start()
+// ----------------------------------------------------------------------------
+{
+    byte index = io_queued % ASYNC_IO_JOBS;
+    record(file, "Queue write of %u bytes to %s",
+           io_jobs[index].size, io_jobs[index].name);
+    io_queued = io_queued + 1;
+    OS_MAILBOX_Put(&io_mailbox, &index);
+}
+
+
+void file::io_wait()
+// ----------------------------------------------------------------------------
+//   Wait for pending writes before the RPL task uses emFile
+// ----------------------------------------------------------------------------
+{
+    while (io_pending())
+        OS_TASK_Delay(2);
+}
+
+
+cstring file::io_error()
+// ----------------------------------------------------------------------------
+//   Return the message for a failed background write once, or nullptr
+// ----------------------------------------------------------------------------
+{
+    if (!io_failed)
+        return nullptr;
+    io_failed = false;
+    return io_failure;
+}
+#endif // USE_ASYNC_IO
+
+
+#if USE_SECTOR_CACHE
+// ============================================================================
+//
+//   Sector cache
+//
+// ============================================================================
+//   On the u585, the flash is on a slow SPI bus. emFile keeps recently used
+//   sectors in RAM, and keeps writes there until cache_flush(), so that the
+//   FAT and directory sectors updated by each small file are written once.
+
+static U32 sector_cache[SECTOR_CACHE_SIZE / sizeof(U32)];
+
+
+void file::cache_start()
+// ----------------------------------------------------------------------------
+//   Assign the sector cache to the volume
+// ----------------------------------------------------------------------------
+{
+    U32 used = FS_AssignCache("", sector_cache, sizeof(sector_cache),
+                              FS_CACHE_RW);
+    FS_CACHE_SetMode("", FS_SECTOR_TYPE_MASK_ALL, FS_CACHE_MODE_WB);
+    record(file, "Sector cache of %u bytes, %u used",
+           sizeof(sector_cache), used);
+}
+
+
+void file::cache_flush()
+// ----------------------------------------------------------------------------
+//   Write dirty sectors to the flash
+// ----------------------------------------------------------------------------
+{
+#if USE_ASYNC_IO
+    io_wait();
+#endif // USE_ASYNC_IO
+    if (FS_CACHE_Clean("") != 0)
+        record(file_error, "Writing the sector cache failed");
+}
+#endif // USE_SECTOR_CACHE
+
+
+#if USE_MSC_SNAPSHOT
+bool file::host_changed()
+// ----------------------------------------------------------------------------
+//   Drop all cached disk state after the host wrote to the disk over USB
+// ----------------------------------------------------------------------------
+//   The host writes sectors behind emFile, so FAT and sector caches are
+//   stale. Our own pending sectors are discarded rather than written back,
+//   since they could overwrite what the host just wrote. This returns false
+//   if a file is open, since unmounting would invalidate its handle.
+{
+#if USE_ASYNC_IO
+    io_wait();
+#endif // USE_ASYNC_IO
+    if (current)
+    {
+        record(file_error, "Host change with %s open", current->name);
+        return false;
+    }
+
+#if USE_EmFile
+    FS_CACHE_Invalidate("");
+    FS_Unmount("");
+    FS_Mount("");
+    buffer_start = 0;
+    buffer_size  = 0;
+    buffer_index = 0;
+#endif // USE_EmFile
+
+#if USE_RESOURCE_FLASH
+    // Resources are copies of files the host may have changed
+    resources_enable(false);
+#endif // USE_RESOURCE_FLASH
+
+    disk_generation++;
+    listing_changes++;
+    record(file, "Host changed the disk, generation %u", disk_generation);
+    return true;
+}
+#endif // USE_MSC_SNAPSHOT
+
+
+uint file::modified()
+// ----------------------------------------------------------------------------
+//    Return the modification time stamp of the file, 0 if unknown
+// ----------------------------------------------------------------------------
+{
+#if USE_EmFile
+    char     n_name[256] = {0};
+    uint32_t ii          = 0;
+    if (!name)
+        return 0;
+#if USE_PINNED_FILES
+    if (mapped && mapped_stamp)
+        return mapped_stamp;
+#endif // USE_PINNED_FILES
+#if USE_ASYNC_IO
+    io_wait();
+#endif // USE_ASYNC_IO
+    for (cstring p = name; *p && ii < sizeof(n_name) - 1; p++)
+        n_name[ii++] = *p == '/' ? '\\' : *p;
+    U32 stamp = 0;
+    if (FS_GetFileTimeEx(n_name, &stamp, FS_FILETIME_MODIFY) == 0)
+        return stamp;
+#endif // USE_EmFile
+    return 0;
+}
+
+
 uint file::find(unicode cp)
 // ----------------------------------------------------------------------------
 //    Find a given code point in file looking forward
@@ -439,7 +1653,7 @@ uint file::find(unicode cp)
     uint    off;
     do
     {
-        off = ftell_(data);
+        off = position();
         c   = get();
     } while (c && c != cp);
     return off;
@@ -457,7 +1671,7 @@ uint file::find(unicode cp1, unicode cp2)
     bool    in = false;
     do
     {
-        off = ftell_(data);
+        off = position();
         c   = get();
     } while (c && c != cp1 && (c != cp2 || (in = !in)));
     return off;
@@ -470,13 +1684,13 @@ uint file::rfind(unicode  cp)
 // ----------------------------------------------------------------------------
 //    Return position right before code point, position file right after it
 {
-    uint    off = ftell_(data);
+    uint    off = position();
     unicode c;
     do
     {
         if (off == 0)
             break;
-        fseek_(data, --off, SEEK_SET);
+        seek(--off);
         c = get();
     }
     while (c != cp);
@@ -490,14 +1704,14 @@ uint file::rfind(unicode  cp1, unicode cp2)
 // ----------------------------------------------------------------------------
 //    Return position right before code point, position file right after it
 {
-    uint    off = ftell_(data);
+    uint    off = position();
     unicode c;
     bool    in = false;
     do
     {
         if (off == 0)
             break;
-        fseek_(data, --off, SEEK_SET);
+        seek(--off);
         c = get();
     }
     while (c != cp1 && (c != cp2 || (in = !in)));
@@ -575,6 +1789,13 @@ bool file::unlink(cstring file)
 #if (SIMULATOR & ! USE_EmFile)
     return ::unlink(file) == 0;
 #elif  USE_EmFile
+#if USE_ASYNC_IO
+  io_wait();
+#endif // USE_ASYNC_IO
+#if USE_PINNED_FILES
+  unpin(file, strlen(file));
+#endif // USE_PINNED_FILES
+  listing_changes++;
   return FS_Remove(file) == FS_ERRCODE_OK;
 #else // !SIMULATOR
     return f_unlink(file) == FR_OK;
@@ -43,6 +43,9 @@
 // For the text pointer variant of the constructor
 typedef const struct text *text_p;
 
+// Files read directly from memory, in the resource flash or pinned in RAM
+#define USE_MAPPED_FILES        (USE_RESOURCE_FLASH || USE_PINNED_FILES)
+
 
 struct file
 // ----------------------------------------------------------------------------
@@ -51,7 +54,7 @@ struct file
 //   This class deals with a linked list of files, because DMCP has a really
 //   annoying limit where only one file can be open at a time.
 {
-    enum mode { READING, WRITING, APPEND };
+    enum mode { READING, WRITING, APPEND, COMPRESSING };
     file();
     file(cstring path, mode wrmode);
     file(text_p path, mode wrmode);
@@ -66,6 +69,7 @@ struct file
     bool    put(unicode out);
     bool    put(char c);
     bool    write(const char *buf, size_t len);
+    bool    flush();
     bool    read(char *buf, size_t len);
     unicode get();
     unicode get(uint offset);
@@ -73,6 +77,8 @@ struct file
     void    seek(uint offset);
     unicode peek();
     uint    position();
+    uint    size();
+    uint    modified();
     uint    find(unicode cp);
     uint    find(unicode cp1, unicode cp2);
     uint    rfind(unicode cp);
@@ -86,8 +92,43 @@ struct file
     static cstring extension(cstring path);
     static cstring basename(cstring path);
 
+#if USE_RESOURCE_FLASH
+    static byte_p  resource(cstring path, uint *size = nullptr);
+    static bool    load_resources(const cstring *paths, uint count);
+    static void    resources_enable(bool enable);
+#endif // USE_RESOURCE_FLASH
+
+#if USE_ASYNC_IO
+    static void    io_start();
+    static byte *  async_start(text_p path, size_t size);
+    static void    async_submit();
+    static void    io_wait();
+    static uint    io_pending();
+    static cstring io_error();
+#endif // USE_ASYNC_IO
+
+#if USE_PINNED_FILES
+    static byte_p  pinned(cstring path, uint *size, uint *stamp);
+    static void    unpin(cstring path, size_t len);
+#endif // USE_PINNED_FILES
+
+#if USE_SECTOR_CACHE
+    static void    cache_start();
+    static void    cache_flush();
+#endif // USE_SECTOR_CACHE
+
+    // Bumped when the host changed the disk, to invalidate cached indexes
+    static uint    generation()         { return disk_generation; }
+    // Bumped when files may have been created or removed
+    static uint    listing_generation() { return listing_changes; }
+#if USE_MSC_SNAPSHOT
+    static bool    host_changed();
+#endif // USE_MSC_SNAPSHOT
+
 protected:
     static file *current;       // Only one open file at a time
+    static uint  disk_generation;
+    static uint  listing_changes;
 #if (SIMULATOR & !Db_TEST)
     typedef FILE *FIL;
 #elif USE_EmFile
@@ -100,11 +141,86 @@ protected:
     file *      previous;       // Previous file to reopen when closing
     bool        writing;        // Should we reopen for writing
 	bool		f_eof;
+
+#if USE_EmFile
+    // Read-ahead or write-behind buffer, shared since only one file is open
+    enum { BUFFER_SIZE = FILE_BUFFER_SIZE };
+    static byte buffer[BUFFER_SIZE];
+    static uint buffer_start;   // File position of buffer[0]
+    static uint buffer_size;    // Number of valid or pending bytes in buffer
+    static uint buffer_index;   // Current read index in buffer
+
+    int     next_byte();
+    void    refill(uint off);
+    void    seek_raw(uint off);
+    bool    read_raw(char *buf, size_t len);
+    bool    write_raw(const char *buf, size_t len);
+#endif // USE_EmFile
+
+#if USE_COMPRESSED_FILES
+    // Compressed files go through a block buffer, shared like the above
+    bool    compressed = false;    // Reading or writing compressed blocks
+    bool    zstart(bool compress);
+    void    zappend(uint position);
+    bool    zheader(uint &raw, uint &packed);
+    bool    zfill();
+    bool    zread(char *buf, size_t len);
+    bool    zwrite(const char *buf, size_t len);
+    bool    zflush();
+    void    zseek(uint off);
+    uint    zposition();
+#endif // USE_COMPRESSED_FILES
+
+#if USE_MAPPED_FILES
+    // Files in memory are read directly, without closing others
+    byte_p      mapped      = nullptr; // Data in memory-mapped flash or RAM
+    uint        mapped_size = 0;       // Size of the data
+    uint        mapped_pos  = 0;       // Current read position
+#endif // USE_MAPPED_FILES
+#if USE_PINNED_FILES
+    uint        mapped_stamp = 0;      // Modification time if pinned in RAM
+    static uint pinned_users;          // Open files reading the pool
+#endif // USE_PINNED_FILES
+#if USE_RESOURCE_FLASH
+    static bool resources_enabled;
+#endif // USE_RESOURCE_FLASH
+};
+
+
+#if USE_RESOURCE_FLASH
+struct resource_header
+// ----------------------------------------------------------------------------
+//   Header of the resource flash, followed by the directory
+// ----------------------------------------------------------------------------
+{
+    uint32_t    magic;          // RESOURCE_MAGIC when loading was complete
+    uint32_t    count;          // Number of entries in directory
+    uint32_t    size;           // Total size used in flash
+    uint32_t    reserved;
 };
 
 
+struct resource_entry
+// ----------------------------------------------------------------------------
+//   An entry in the directory of the resource flash
+// ----------------------------------------------------------------------------
+{
+    char        name[56];       // Path without leading '/'
+    uint32_t    offset;         // Offset of data from RESOURCE_FLASH_BASE
+    uint32_t    size;           // Size of data
+};
+
+#define RESOURCE_MAGIC  0x53455230      // "0RES"
+#endif // USE_RESOURCE_FLASH
+
+
 #define MAGIC_SAVE_STATE         0x05121968
 
+#if USE_ASYNC_IO
+// Message sent to the keyboard mailbox when background writes complete
+#define IO_DONE_MESSAGE          0xfffffffd
+#endif // USE_ASYNC_IO
+
 
 // ============================================================================
 //
@@ -138,6 +254,8 @@ inline bool file::valid()
 {
 #if SIMULATOR
     return data          != 0;
+#elif USE_MAPPED_FILES
+    return data          != 0 || mapped;
 #elif USE_EmFile
     return data          != 0;
 
@@ -152,8 +270,22 @@ inline void file::seek(uint off)
 //    Move the read position in the data file
 // ----------------------------------------------------------------------------
 {
+#if USE_MAPPED_FILES
+    if (mapped)
+    {
+        mapped_pos = off;
+        return;
+    }
+#endif // USE_MAPPED_FILES
+#if USE_COMPRESSED_FILES
+    if (compressed && !writing)
+    {
+        zseek(off);
+        return;
+    }
+#endif // USE_COMPRESSED_FILES
 #if USE_EmFile
-	FS_FSeek(data, off, FS_FILE_BEGIN);
+    seek_raw(off);
 #else
     fseek(data, off, SEEK_SET);
 #endif
@@ -161,6 +293,26 @@ inline void file::seek(uint off)
 }
 
 
+#if USE_EmFile
+inline void file::seek_raw(uint off)
+// ----------------------------------------------------------------------------
+//    Move the position in the file itself, through the buffer
+// ----------------------------------------------------------------------------
+{
+    if (writing)
+    {
+        flush();
+        FS_FSeek(data, off, FS_FILE_BEGIN);
+        buffer_start = off;
+    }
+    else if (off >= buffer_start && off <= buffer_start + buffer_size)
+        buffer_index = off - buffer_start;
+    else
+        refill(off);
+}
+#endif // USE_EmFile
+
+
 inline unicode file::peek()
 // ----------------------------------------------------------------------------
 //    Look at what is as current position without moving it
@@ -168,7 +320,7 @@ inline unicode file::peek()
 {
 
 #if USE_EmFile
-    uint off       = FS_FTell(data);
+    uint off       = position();
     unicode result = get();
     seek(off);
     return result;
@@ -199,8 +351,16 @@ inline uint file::position()
 //   Return current position in help file
 // ----------------------------------------------------------------------------
 {
+#if USE_MAPPED_FILES
+    if (mapped)
+        return mapped_pos;
+#endif // USE_MAPPED_FILES
+#if USE_COMPRESSED_FILES
+    if (compressed)
+        return zposition();
+#endif // USE_COMPRESSED_FILES
 #if USE_EmFile
-	return FS_FTell(data);
+    return buffer_start + (writing ? buffer_size : buffer_index);
 #else
     return FS_FTell(data);
 #endif
@@ -208,6 +368,26 @@ inline uint file::position()
 }
 
 
+inline uint file::size()
+// ----------------------------------------------------------------------------
+//   Return the size of the file
+// ----------------------------------------------------------------------------
+{
+#if USE_MAPPED_FILES
+    if (mapped)
+        return mapped_size;
+#endif // USE_MAPPED_FILES
+#if USE_EmFile
+    uint result = data ? FS_GetFileSize(data) : 0;
+    if (writing && data && buffer_start + buffer_size > result)
+        result = buffer_start + buffer_size;
+    return result;
+#else
+    return f_size(&data);
+#endif
+}
+
+
 inline bool file::eof()
 // ----------------------------------------------------------------------------
 //   Indicate if end of file
@@ -312,6 +312,27 @@ void Kbd_Scrut_Set(keyb_mode mode)
 }
 
 
+bool Kbd_Keys_Down(keyboard *p_kbd)
+// true if a key was seen down by the last scrutation, even if not yet valid
+{
+   if (p_kbd->raw)
+      return true;
+   for (uint32_t ii = 0; ii < KB_MAX_KEY; ii++)
+      if (p_kbd->key_time[ii])
+         return true;
+   return false;
+}
+
+bool Kbd_Column_Low(void)
+// with all rows low (kb_scrut_int), true if a key is already down
+// catches a key pressed before the interrupts were enabled
+{
+   for (uint32_t i_col = 0; i_col < KB_COL; i_col++)
+      if (HAL_GPIO_ReadPin(kbd_col[i_col].gpio, kbd_col[i_col].pin) == GPIO_PIN_RESET)
+         return true;
+   return false;
+}
+
 uint64_t Scrutation(keyboard *p_kbd)
 // scrutation clavier
 {
@@ -360,7 +381,10 @@ st_key_data dts;
             }
             if    (dts.keys.key)     {
                dts.keys.released = 0;      
-               OS_MAILBOX_Put(&Mb_Keyboard, &dts);     // nouvelle touche pressée             
+               sys_key_stage(KEY_STAGE_SCAN);
+               if (OS_MAILBOX_Put(&Mb_Keyboard, &dts) == 0 &&   // nouvelle touche pressée
+                   dts.keys.key == KB_EXIT_KEY)
+                  kb_exit_posted++;             
             }
             if (key_pressed_counting == false){
                for (uint32_t ii = 0; ii < KB_MAX_KEY; ii++){
@@ -386,6 +410,11 @@ st_key_data dts;
                      dts.keys.released = 1;
                      p_kbd->key_time[ii] = 0;
                      p_kbd->key_value[ii] = 0;
+                  }else if (key_value_act == p_kbd->key_value[ii])
+                  {
+                     // bounce before the key was valid, restart debounce
+                     p_kbd->key_time[ii] = 0;
+                     p_kbd->key_value[ii] = 0;
                   }else 
                   {
                      if (p_kbd->key_time[ii] >= KB_VALID_COUNT){
@@ -498,7 +527,8 @@ void Send_key(uint8_t key){
    dts.keys.key2 = 0;
    dts.keys.key3 = 0;
    dts.keys.released = 0;
-   OS_MAILBOX_Put(&Mb_Keyboard, &dts); // press             
+   if (OS_MAILBOX_Put(&Mb_Keyboard, &dts) == 0 && key == KB_EXIT_KEY) // press
+      kb_exit_posted++;             
    dts.keys.released = 1;
    OS_MAILBOX_Put(&Mb_Keyboard, &dts); // release        
 }
@@ -519,6 +549,9 @@ void KbdTask(void)
 // KeyboardInit();
    st_key_data dts;
    char result = 0;
+   bool armed = false;                    // waiting for a column interrupt
+   uint32_t last = sys_current_ms();      // last update of sleeping_soon
+   uint32_t second = last;                // last SYS_1sec event
 
    for (uint32_t ii = 0; ii < KB_MAX_KEY; ii++){
       keybd.key_value[ii] = 0; 
@@ -526,6 +559,7 @@ void KbdTask(void)
    }
    while(1) 
    {
+      uint32_t now;
       switch (db_power_state){
          case PW_wake_up:
             // wait for [exit] release
@@ -549,12 +583,30 @@ void KbdTask(void)
 // add power wake up confirmation from db ???
 
          case PW_running:
-            OS_TASK_Delay(KB_SCRUT_PERIOD);
-            keybd.sleeping_soon +=KB_SCRUT_PERIOD ;
-            scrut_last = Scrutation( &keybd);
+            // no key down: no scrutation until a column interrupt
+            // key down: short burst scrutation for debounce and release
+            if (!Kbd_Keys_Down(&keybd)) {
+               if (!armed) {
+                  Kbd_Scrut_Set(kb_scrut_int);
+                  armed = true;
+               }
+               if (Kbd_Column_Low() ||
+                   OS_EVENT_GetTimed(&KBD_Event, KB_IDLE_PERIOD) == 0) {
+                  Kbd_Scrut_Set(kb_scrut_std);
+                  armed = false;
+               }
+            } else {
+               OS_TASK_Delay(KB_BURST_PERIOD);
+            }
+            now = sys_current_ms();
+            keybd.sleeping_soon += now - last;
+            last = now;
+            if (!armed)
+               scrut_last = Scrutation( &keybd);
             if (keybd.sleeping_soon > 30000) {
                db_power_state = PW_sleeping;
                Kbd_Scrut_Set(kb_scrut_int);
+               armed = false;
                SEGGER_RTT_printf(0, "\nPW_Entering sleep");
             }
             break;
@@ -565,6 +617,7 @@ void KbdTask(void)
                // wake up from interrupt, normal scrutation
                Kbd_Scrut_Set(kb_scrut_std);
                keybd.sleeping_soon = 0;
+               last = sys_current_ms();
                db_power_state = PW_running;
             }
             else {
@@ -602,11 +655,14 @@ void KbdTask(void)
             OS_EVENT_GetBlocked(&KBD_Event);
             db_power_state = PW_wake_up;
             keybd.sleeping_soon = 0;
+            last = sys_current_ms();
             break;
        }
-      if ( keybd.sleeping_soon % 1000 >= 1000-KB_SCRUT_PERIOD) 
-      // sending sys 1sec         
+      now = sys_current_ms();
+      if (db_power_state == PW_running && now - second >= 1000) 
+      // sending sys 1sec, without catching up after a long wait
       {
+         second = now - second >= 2000 ? now : second + 1000;
          dts.sys = 1;
          dts.sys_cmd = SYS_1sec;
          OS_MAILBOX_Put(&Mb_Keyboard, &dts);  
@@ -635,6 +691,23 @@ void KbdTask(void)
             SEGGER_RTT_printf(0, "\nYou pressed: %c (0x%02X)", key, key);
          }
       } 
+#if USE_RTT_SCRIPT
+      // Wake up the RPL task when the host sent script input
+      if (!script_posted && SEGGER_RTT_HasData(RTT_SCRIPT_CHANNEL)) {
+         uint32_t msg = SCRIPT_MESSAGE;
+         script_posted = 1;
+         OS_MAILBOX_Put(&Mb_Keyboard, &msg);
+      }
+#endif // USE_RTT_SCRIPT
+#if USE_MSC_SNAPSHOT
+      // Resynchronize the RPL task with the disk once the host is idle
+      if (msc_changed && !msc_posted &&
+          sys_current_ms() - msc_last_write >= MSC_QUIET_PERIOD) {
+         uint32_t msg = MSC_CHANGED_MESSAGE;
+         msc_posted = 1;
+         OS_MAILBOX_Put(&Mb_Keyboard, &msg);
+      }
+#endif // USE_MSC_SNAPSHOT
    }
 }
 
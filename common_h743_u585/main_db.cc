@@ -76,7 +76,10 @@ essai avec spi sdcard
 #include "blitter.h"
 #include "dmcp.h"
 #include "expression.h"
+#include "file.h"
+#include "files.h"
 #include "font.h"
+#include "library.h"
 #include "program.h"
 #include "recorder.h"
 #include "stack.h"
@@ -89,6 +92,10 @@ essai avec spi sdcard
 #include "RTOS.h"
 #include "FS.h"
 #include "FS_OS.h"
+#if USE_USB_EVAL
+#  include "USB.h"
+#  include "USB_CDC.h"
+#endif // USE_USB_EVAL
 
 
 #include "db_hardware_def.h"
@@ -124,13 +131,23 @@ extern "C" {
 surface Screen((pixword *) LCD_GetFramebuffer(), LCD_W, LCD_H, LCD_SCANLINE, LCD_W);
 
 // Reserve memory for db48x, 448ko / 512
-#if DBh743
+#if USE_WARM_RESUME
+// Not initialized, since objects left by a soft reset can be taken over
+static uint8_t __attribute__((section(".AXI_RAM1"), aligned(32))) db48x_mem[1024*448];
+#elif DBh743
 static uint8_t __attribute__((section(".AXI_RAM1"), aligned(32))) db48x_mem[1024*448] = {0};
 #elif DBu585
 static uint8_t __attribute__((section(".SRAM3"), aligned(32))) db48x_mem[1024*448] = {0};
 
 #endif
 
+// Stack, locals and return stack in zero-wait-state DTCM, 64ko / 128
+#if USE_DTCM_STACK && USE_WARM_RESUME
+static uint8_t __attribute__((section(".DTCM_RAM"), aligned(32))) db48x_stack[1024*64];
+#elif USE_DTCM_STACK
+static uint8_t __attribute__((section(".DTCM_RAM"), aligned(32))) db48x_stack[1024*64] = {0};
+#endif
+
 // Pre-built patterns for shades of grey
 const pattern pattern::black   = pattern(0, 0, 0);
 const pattern pattern::gray10  = pattern(32, 32, 32);
@@ -171,7 +188,14 @@ void mark_dirty(uint row)
 // ----------------------------------------------------------------------------
 {
 #if ( DBh743| DBu585)
+#if USE_LCD_TASK
+   // The display task reads the modified lines table
+   OS_TASK_EnterRegion();
+   LCD_MarkLineModified(&hlcd, row);
+   OS_TASK_LeaveRegion();
+#else
    LCD_MarkLineModified(&hlcd, row);
+#endif // USE_LCD_TASK
 #else
     if (row < LCD_H)
     {
@@ -194,20 +218,144 @@ void mark_dirty(uint row)
 }
 
 
-void refresh_dirty()
+static uint last_refresh    = 0;
+static volatile bool refresh_pending = false;
+
+
+static void lcd_update()
 // ----------------------------------------------------------------------------
-//  Send an LCD refresh request for the area dirtied by drawing
+//  Build and submit the DMA buffer for the lines dirtied by drawing
 // ----------------------------------------------------------------------------
 {
     uint start = sys_current_ms();
+    last_refresh = start;
+    refresh_pending = false;
+#if USE_LCD_TASK
+   OS_TASK_EnterRegion();
+#endif // USE_LCD_TASK
    LCD_Status_t lcd_res = LCD_UpdateModifiedLines(&hlcd);
-   if (lcd_res != LCD_OK)  SEGGER_RTT_printf(0, "\nT%06d:Lcd update err :%s, %d <ref < %d", Cnt_ms%1000000, LCD_Status_Desc[lcd_res], row_min, row_max);
+#if USE_LCD_TASK
+   OS_TASK_LeaveRegion();
+#endif // USE_LCD_TASK
+   if (lcd_res != LCD_OK)  SEGGER_RTT_printf(0, "\nT%06d:Lcd update err :%s, %d <ref < %d", sys_current_ms()%1000000, LCD_Status_Desc[lcd_res], row_min, row_max);
     row_min = ~0;
     row_max = 0;
     program::refresh_time += sys_current_ms() - start;
 }
 
 
+#if USE_LCD_TASK
+// ============================================================================
+//
+//   Display task
+//
+// ============================================================================
+//   The RPL task only draws in the framebuffer and marks dirty lines. This
+//   task builds and submits the DMA buffers, at most once per frame period,
+//   so that a plot drawn during a long computation shows up while it runs,
+//   instead of when the computation ends. It has a higher priority than the
+//   RPL task, so an immediate refresh is done before refresh_dirty_now()
+//   returns. The modified lines table is only accessed without preemption.
+
+static OS_EVENT        lcd_event;
+static OS_TASK         lcd_tcb;
+static OS_STACKPTR int lcd_stack[256];
+static volatile bool   lcd_now = false;
+static bool            lcd_started = false;
+
+
+static void lcd_task()
+// ----------------------------------------------------------------------------
+//   Wait for refresh requests and send dirty lines to the panel
+// ----------------------------------------------------------------------------
+{
+    while (true)
+    {
+        OS_EVENT_GetBlocked(&lcd_event);
+#if LCD_FRAME_PERIOD
+        uint elapsed = sys_current_ms() - last_refresh;
+        if (!lcd_now && elapsed < LCD_FRAME_PERIOD)
+            OS_TASK_Delay(LCD_FRAME_PERIOD - elapsed);
+#endif // LCD_FRAME_PERIOD
+        lcd_now = false;
+        lcd_update();
+    }
+}
+
+
+static void lcd_task_start()
+// ----------------------------------------------------------------------------
+//   Start the display task
+// ----------------------------------------------------------------------------
+{
+    OS_EVENT_Create(&lcd_event);
+    OS_TASK_CREATE(&lcd_tcb, "Display", LCD_TASK_PRIORITY, lcd_task, lcd_stack);
+    lcd_started = true;
+}
+#endif // USE_LCD_TASK
+
+
+void refresh_dirty()
+// ----------------------------------------------------------------------------
+//  Send an LCD refresh request, at most once per frame
+// ----------------------------------------------------------------------------
+//  Dirty lines accumulate until the frame period elapsed. Whoever waits
+//  for a key or for time to pass calls refresh_dirty_now() before that.
+{
+#if USE_LCD_TASK
+    if (lcd_started)
+    {
+        if (!refresh_pending)
+        {
+            refresh_pending = true;
+            OS_EVENT_Set(&lcd_event);
+        }
+        return;
+    }
+#endif // USE_LCD_TASK
+#if LCD_FRAME_PERIOD
+    if (sys_current_ms() - last_refresh < LCD_FRAME_PERIOD)
+    {
+        refresh_pending = true;
+        return;
+    }
+#endif // LCD_FRAME_PERIOD
+    refresh_dirty_now();
+}
+
+
+void refresh_dirty_now()
+// ----------------------------------------------------------------------------
+//  Send an LCD refresh request for the area dirtied by drawing
+// ----------------------------------------------------------------------------
+{
+#if USE_LCD_TASK
+    if (lcd_started)
+    {
+        lcd_now = true;
+        OS_EVENT_Set(&lcd_event);
+        return;
+    }
+#endif // USE_LCD_TASK
+    lcd_update();
+}
+
+
+static void lcd_update_all()
+// ----------------------------------------------------------------------------
+//  Send the whole framebuffer to the panel
+// ----------------------------------------------------------------------------
+{
+#if USE_LCD_TASK
+    OS_TASK_EnterRegion();
+#endif // USE_LCD_TASK
+    LCD_UpdateDisplay(&hlcd);
+#if USE_LCD_TASK
+    OS_TASK_LeaveRegion();
+#endif // USE_LCD_TASK
+}
+
+
 void set_timer(uint timerid, uint period)
 // ----------------------------------------------------------------------------
 //   Conditionally set a timer based on period
@@ -258,8 +406,15 @@ void redraw_lcd(bool force)
     }
     ui.draw_error();
 
-    // Refresh the screen
-    refresh_dirty();
+#if USE_ASYNC_IO
+    // Show that files are still being written, cleared by IO_DONE_MESSAGE
+    if (file::io_pending())
+        ui.draw_busy(L'▼', Settings.RunningIconForeground());
+#endif // USE_ASYNC_IO
+
+    // Refresh the screen, without waiting for the frame period
+    sys_key_stage(KEY_STAGE_DRAWN);
+    refresh_dirty_now();
 
     // Compute next refresh
     uint end = sys_current_ms();
@@ -318,6 +473,10 @@ static void redraw_periodics()
 }
 
 
+#if USE_STEADY_REPEAT
+static uint32_t repeat_due = 0;         // Time when next key repeat is due
+#endif // USE_STEADY_REPEAT
+
 static void handle_key(int key, bool repeating, bool talpha)
 // ----------------------------------------------------------------------------
 //   Handle all user-interface keys
@@ -330,10 +489,69 @@ static void handle_key(int key, bool repeating, bool talpha)
 
     // Key repeat timer
     if (ui.repeating())
+    {
+#if USE_STEADY_REPEAT
+        // Count the period from when the repeat was due, not from now
+        uint32_t now = sys_current_ms();
+        if (repeating)
+            repeat_due += KB_DB_FIRST_PERIOD;
+        else
+            repeat_due = now + KB_DB_FIRST_REPEAT;
+        int32_t delay = int32_t(repeat_due - now);
+        sys_timer_start(TIMER0, delay > 0 ? delay : 1);
+#else
         sys_timer_start(TIMER0, repeating ? KB_DB_FIRST_PERIOD : KB_DB_FIRST_REPEAT);
+#endif // USE_STEADY_REPEAT
+    }
 }
 
 
+#if USE_STEADY_REPEAT
+static uint32_t repeat_wait(uint32_t wait)
+// ----------------------------------------------------------------------------
+//   Shorten the wait for keys so that the next repeat is not late
+// ----------------------------------------------------------------------------
+{
+    if (!sys_timer_active(TIMER0))
+        return wait;
+    int32_t left = int32_t(repeat_due - sys_current_ms());
+    if (left <= 0)
+        return 1;               // Mailbox timeouts must be at least 1ms
+    return uint32_t(left) < wait ? left : wait;
+}
+
+
+static void handle_repeats(int key, bool talpha)
+// ----------------------------------------------------------------------------
+//   Catch up with repeats that were missed while busy, without redrawing
+// ----------------------------------------------------------------------------
+//   Each missed repeat still does its work, e.g. moves the cursor, so that
+//   navigation speed does not depend on how long the redraw takes. We stop
+//   as soon as another key event, e.g. the release, is waiting.
+{
+    uint count = 0;
+    while (count < KB_REPEAT_COALESCE &&
+           sys_timer_active(TIMER0) &&
+           int32_t(sys_current_ms() - repeat_due) >= 0 &&
+           !OS_MAILBOX_GetMessageCnt(&Mb_Keyboard))
+    {
+        handle_key(key, true, talpha);
+        count++;
+    }
+
+    // Drop what we could not catch up with rather than bursting later
+    uint32_t now = sys_current_ms();
+    if (sys_timer_active(TIMER0) && int32_t(now - repeat_due) >= 0)
+    {
+        repeat_due = now + KB_DB_FIRST_PERIOD;
+        sys_timer_start(TIMER0, KB_DB_FIRST_PERIOD);
+    }
+    if (count)
+        record(main, "Coalesced %u repeats of key %d", count, key);
+}
+#endif // USE_STEADY_REPEAT
+
+
 void db48x_set_beep_mute(int val)
 // ----------------------------------------------------------------------------
 //   Set the beep flag (shared with firmware)
@@ -395,12 +613,811 @@ bool load_saved_keymap(cstring name)
 }
 
 
+// ============================================================================
+//
+//   Staged boot
+//
+// ============================================================================
+//   An empty stack is drawn as soon as the runtime is ready, then the saved
+//   state is restored. The keymap is only loaded from the main loop, once
+//   the restored stack is on screen. The help index is already built on the
+//   first help lookup. Each phase is timed and logged on RTT.
+
+static uint64_t boot_start          = 0;
+static uint64_t boot_last           = 0;
+static bool     boot_keymap_pending = false;
+
+
+static void boot_phase(cstring name)
+// ----------------------------------------------------------------------------
+//   Log the duration of a boot phase
+// ----------------------------------------------------------------------------
+{
+    uint64_t now = sys_current_us();
+    SEGGER_RTT_printf(0, "\nBoot %s: %u us, total %u us",
+                      name, uint(now - boot_last), uint(now - boot_start));
+    record(main, "Boot %s %llu us", name, now - boot_last);
+    boot_last = now;
+}
+
+
+static COLD void boot_deferred()
+// ----------------------------------------------------------------------------
+//   Boot work that can wait until the restored stack is shown
+// ----------------------------------------------------------------------------
+{
+    if (!boot_keymap_pending)
+        return;
+    boot_keymap_pending = false;
+
+    bool res = load_saved_keymap();
+    SEGGER_RTT_printf(0,  "\nLoad keymap : %s\n", res ? "ok":"err");
+    boot_phase("keymap");
+}
+
+
+#if USE_WARM_RESUME
+// ============================================================================
+//
+//   Warm resume
+//
+// ============================================================================
+//   On a soft reset, the runtime and settings are copied next to the object
+//   memory, which the reset does not clear. At boot, if the copy is intact
+//   and was made by this very firmware, the runtime takes over the objects
+//   where they are instead of reloading the state from the SD card. The copy
+//   is only made while the RPL task waits for a key, when memory is
+//   consistent, so a reset while a program runs still reloads the state.
+
+#define WARM_MAGIC      0x4D524157      // "WARM"
+
+struct warm_image
+// ----------------------------------------------------------------------------
+//   Copy of the runtime and settings kept across a soft reset
+// ----------------------------------------------------------------------------
+{
+    uint32_t    magic;                  // WARM_MAGIC
+    uint32_t    build;                  // Identifies the firmware
+    uint32_t    sizes;                  // Size of runtime and settings
+    uint32_t    sum;                    // Checksum of all the above
+    alignas(8) byte runtime_copy[sizeof(runtime)];
+    alignas(8) byte settings_copy[sizeof(settings)];
+};
+static warm_image __attribute__((section(".AXI_RAM1"), aligned(32))) warm;
+
+
+static uint32_t warm_build()
+// ----------------------------------------------------------------------------
+//   Identify the firmware, since objects refer to commands and fonts in flash
+// ----------------------------------------------------------------------------
+{
+    uint32_t sum = files::id_checksum();
+    for (cstring p = __DATE__ " " __TIME__; *p; p++)
+        sum = 0x1081 * sum ^ byte(*p);
+    return sum;
+}
+
+
+static uint32_t warm_sum()
+// ----------------------------------------------------------------------------
+//   Checksum of the warm image, including runtime header and memory bounds
+// ----------------------------------------------------------------------------
+{
+    uint32_t sum  = warm.build ^ warm.sizes;
+    byte_p   p    = byte_p(warm.runtime_copy);
+    byte_p   last = byte_p(warm.settings_copy) + sizeof(warm.settings_copy);
+    for (; p < last; p++)
+        sum = 0x1081 * sum ^ *p;
+    return sum;
+}
+
+
+static void warm_save()
+// ----------------------------------------------------------------------------
+//   Save the runtime before a soft reset, while the RPL task is idle
+// ----------------------------------------------------------------------------
+{
+    memcpy(warm.runtime_copy, (const void *) &rt, sizeof(rt));
+    memcpy(warm.settings_copy, (const void *) &Settings, sizeof(Settings));
+    warm.build = warm_build();
+    warm.sizes = sizeof(runtime) * 0x10001u ^ sizeof(settings);
+    warm.sum   = warm_sum();
+    warm.magic = WARM_MAGIC;
+
+    // The reset does not write back the data cache
+    SCB_CleanDCache();
+}
+
+
+static bool warm_resume()
+// ----------------------------------------------------------------------------
+//   Take over the memory left by a soft reset if the warm image is valid
+// ----------------------------------------------------------------------------
+{
+    bool valid = warm.magic == WARM_MAGIC &&
+        warm.build == warm_build() &&
+        warm.sizes == (sizeof(runtime) * 0x10001u ^ sizeof(settings)) &&
+        warm.sum == warm_sum();
+
+    // Use the image at most once, in case what it holds makes us reset
+    warm.magic = 0;
+    if (!valid)
+        return false;
+
+    const runtime &saved = *(const runtime *) warm.runtime_copy;
+#if USE_DTCM_STACK
+    valid = rt.resume(saved, db48x_mem, sizeof(db48x_mem),
+                      db48x_stack, sizeof(db48x_stack));
+#else
+    valid = rt.resume(saved, db48x_mem, sizeof(db48x_mem));
+#endif
+    if (valid)
+        memcpy((void *) &Settings, warm.settings_copy, sizeof(Settings));
+    SEGGER_RTT_printf(0, "\nWarm resume : %s", valid ? "ok" : "rejected");
+    return valid;
+}
+#endif // USE_WARM_RESUME
+
+
+#if USE_RTT_SCRIPT || USE_USB_EVAL
+// ============================================================================
+//
+//   Evaluation of requests sent by the host
+//
+// ============================================================================
+//   Requests are RPL source or binary objects in the .48b file format.
+//   The reply is "ok <us> <allocated> <collections> <depth> <top of stack>"
+//   or "error <us> <message>", rendered on a single line.
+//   Results stay on the stack, so that requests can build on each other.
+
+static object_p host_binary(const byte *data, size_t len)
+// ----------------------------------------------------------------------------
+//   Load a binary object in .48b format from the host into a temporary
+// ----------------------------------------------------------------------------
+{
+    static const byte magic[] = FILE_MAGIC;
+    uint32_t          check   = files::id_checksum();
+    size_t            header  = sizeof(magic) + sizeof(check);
+    if (len <= header || memcmp(data, magic, sizeof(magic)) != 0)
+    {
+        rt.invalid_magic_number_error();
+        return nullptr;
+    }
+    if (memcmp(data + sizeof(magic), &check, sizeof(check)) != 0)
+    {
+        rt.incompatible_binary_error();
+        return nullptr;
+    }
+
+    // Build the object in the scratchpad, like files::recall_binary
+    data += header;
+    len -= header;
+    if (rt.allocated())
+    {
+        rt.unable_to_allocate_error();
+        return nullptr;
+    }
+    byte *ptr = rt.allocate(len);
+    if (!ptr)
+        return nullptr;
+    memcpy(ptr, data, len);
+    object_p result = rt.temporary();
+    if (!result)
+    {
+        rt.free(len);
+        rt.unable_to_allocate_error();
+        return nullptr;
+    }
+    if (result->type() >= object::NUM_IDS || result->size() != len)
+    {
+        rt.invalid_object_in_file_error();
+        return nullptr;
+    }
+    return result;
+}
+
+
+size_t host_evaluate(cstring request, size_t len, bool binary,
+                     char *reply, size_t max)
+// ----------------------------------------------------------------------------
+//   Evaluate a request from the host and render the reply
+// ----------------------------------------------------------------------------
+{
+    size_t   allocated = rt.GCAllocated;
+    size_t   cycles    = rt.GCCycles;
+    uint64_t start     = sys_current_us();
+    bool     ok        = false;
+    object_g obj       = binary
+        ? host_binary(reinterpret_cast<const byte *>(request), len)
+        : object_p(program::parse(utf8(request), len));
+    if (obj)
+        ok = program::run(+obj, true) == object::OK;
+    uint64_t elapsed   = sys_current_us() - start;
+
+    if (!ok || rt.error())
+    {
+        utf8   msg  = rt.error();
+        size_t rlen = snprintf(reply, max, "error %llu %s",
+                               (unsigned long long) elapsed,
+                               msg ? cstring(msg) : "Syntax error");
+        rt.clear_error();
+        return std::min(rlen, max - 1);
+    }
+
+    size_t depth = rt.depth();
+    size_t rlen  = snprintf(reply, max, "ok %llu %u %u %u ",
+                            (unsigned long long) elapsed,
+                            uint(rt.GCAllocated - allocated),
+                            uint(rt.GCCycles - cycles),
+                            uint(depth));
+    rlen = std::min(rlen, max - 1);
+    if (depth)
+    {
+        if (object_p top = rt.top())
+        {
+            renderer r(reply + rlen, max - 1 - rlen, true);
+            top->render(r);
+            rlen += r.size();
+        }
+    }
+    reply[rlen] = 0;
+    return rlen;
+}
+#endif // USE_RTT_SCRIPT || USE_USB_EVAL
+
+
+#if USE_RTT_SCRIPT
+// ============================================================================
+//
+//   Script channel for automated runs from the host
+//
+// ============================================================================
+//   Each line sent by the host on RTT_SCRIPT_CHANNEL is a command:
+//   - "rpl <source>" evaluates the RPL source like the command line, and
+//     replies like host_evaluate()
+//   - "key <k1> <k2> ..." injects key presses, using KbdTask key numbers
+//   - "bench gc <n>" or "bench draw <n>" times n garbage collections or
+//     full screen redraws, to compare memory and cache configurations
+//   - "layout" lists the code addresses most often sampled, and "layout 0"
+//     clears the samples, see USE_CODE_PROFILE
+
+extern "C" void Send_key(uint8_t key);
+static char script_output[RTT_SCRIPT_OUTPUT];
+static char script_input[RTT_SCRIPT_INPUT];
+
+
+static void script_start()
+// ----------------------------------------------------------------------------
+//   Configure the RTT channel for scripts
+// ----------------------------------------------------------------------------
+{
+    SEGGER_RTT_ConfigUpBuffer(RTT_SCRIPT_CHANNEL, "Script",
+                              script_output, sizeof(script_output),
+                              SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL);
+    SEGGER_RTT_ConfigDownBuffer(RTT_SCRIPT_CHANNEL, "Script",
+                                script_input, sizeof(script_input),
+                                SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+}
+
+
+static void script_reply(cstring text, size_t len)
+// ----------------------------------------------------------------------------
+//   Send a reply line to the host
+// ----------------------------------------------------------------------------
+{
+    SEGGER_RTT_Write(RTT_SCRIPT_CHANNEL, text, len);
+    SEGGER_RTT_Write(RTT_SCRIPT_CHANNEL, "\n", 1);
+}
+
+
+static void script_rpl(cstring source)
+// ----------------------------------------------------------------------------
+//   Evaluate RPL source and report result and timings
+// ----------------------------------------------------------------------------
+{
+    static char reply[RTT_SCRIPT_OUTPUT];
+    size_t len = host_evaluate(source, strlen(source), false,
+                               reply, sizeof(reply));
+    script_reply(reply, len);
+}
+
+
+static void script_keys(cstring keys)
+// ----------------------------------------------------------------------------
+//   Inject key presses
+// ----------------------------------------------------------------------------
+{
+    char *end = nullptr;
+    uint  sent = 0;
+    for (uint key = strtoul(keys, &end, 10); end != keys;
+         key = strtoul(keys, &end, 10))
+    {
+        Send_key(key);
+        sent++;
+        keys = end;
+    }
+    char reply[32];
+    size_t len = snprintf(reply, sizeof(reply), "ok %u keys", sent);
+    script_reply(reply, len);
+}
+
+
+static void script_bench(cstring what)
+// ----------------------------------------------------------------------------
+//   Time repeated garbage collections or screen redraws
+// ----------------------------------------------------------------------------
+{
+    bool gc   = strncmp(what, "gc", 2) == 0;
+    bool draw = strncmp(what, "draw", 4) == 0;
+    char reply[128];
+    if (!gc && !draw)
+    {
+        script_reply("error Unknown benchmark", 23);
+        return;
+    }
+
+    uint     count = strtoul(what + (gc ? 2 : 4), nullptr, 10);
+    uint64_t best  = ~0ULL;
+    uint64_t total = 0;
+    size_t   freed = 0;
+    if (!count)
+        count = 1;
+    for (uint i = 0; i < count; i++)
+    {
+        uint64_t start = sys_current_us();
+        if (gc)
+            freed += rt.gc();
+        else
+            redraw_lcd(true);
+        uint64_t duration = sys_current_us() - start;
+        total += duration;
+        if (best > duration)
+            best = duration;
+    }
+    record(main, "Benchmark %s %u times took %llu us", what, count,
+           (unsigned long long) total);
+    size_t len = snprintf(reply, sizeof(reply),
+                          "ok %s n=%u avg=%lluus min=%lluus freed=%u mpu=%u",
+                          gc ? "gc" : "draw", count,
+                          (unsigned long long) (total / count),
+                          (unsigned long long) best,
+                          (uint) freed, (uint) USE_MPU_PROFILE);
+    script_reply(reply, len);
+}
+
+
+#if USE_CODE_PROFILE
+// ============================================================================
+//
+//   Sampling code profiler for the hot/cold code layout
+//
+// ============================================================================
+//   The tick hook samples the PC where the RPL task or another task was
+//   interrupted, i.e. the return address in the exception frame on the
+//   process stack, and counts it per CODE_PROFILE_GRAIN bytes of code.
+//   Samples taken while another interrupt was active are ignored. The host
+//   resolves the addresses from the ELF file into the linker ordering file.
+
+struct code_sample
+// ----------------------------------------------------------------------------
+//   Number of samples in a code granule
+// ----------------------------------------------------------------------------
+{
+    uint32_t address;
+    uint32_t count;
+};
+
+static code_sample  code_samples[CODE_PROFILE_SLOTS];
+static uint32_t     code_samples_lost = 0;
+static OS_TICK_HOOK code_profile_hook;
+
+
+static void code_profile_tick()
+// ----------------------------------------------------------------------------
+//   Count the PC of the interrupted task
+// ----------------------------------------------------------------------------
+{
+    // Only sample thread code, the tick is the only active exception
+    if (!(SCB->ICSR & SCB_ICSR_RETTOBASE_Msk))
+        return;
+    const uint32_t *frame = (const uint32_t *) __get_PSP();
+    uint32_t        pc    = frame[6] & ~(CODE_PROFILE_GRAIN - 1);
+    uint            hash  = (pc / CODE_PROFILE_GRAIN) % CODE_PROFILE_SLOTS;
+    for (uint probe = 0; probe < 8; probe++)
+    {
+        code_sample &s = code_samples[(hash + probe) % CODE_PROFILE_SLOTS];
+        if (s.address == pc || !s.count)
+        {
+            s.address = pc;
+            s.count++;
+            return;
+        }
+    }
+    code_samples_lost++;
+}
+
+
+static void code_profile_start()
+// ----------------------------------------------------------------------------
+//   Start sampling on each tick
+// ----------------------------------------------------------------------------
+{
+    OS_TICK_AddHook(&code_profile_hook, code_profile_tick);
+}
+
+
+static void script_layout(cstring args)
+// ----------------------------------------------------------------------------
+//   Send the most sampled code addresses, hottest first
+// ----------------------------------------------------------------------------
+//   Each line is "<address> <samples>", then "ok <total> <lost>"
+{
+    char reply[48];
+    if (*args == '0')
+    {
+        memset(code_samples, 0, sizeof(code_samples));
+        code_samples_lost = 0;
+        script_reply("ok cleared", 10);
+        return;
+    }
+
+    static code_sample sorted[CODE_PROFILE_SLOTS];
+    uint               count = 0;
+    uint32_t           total = 0;
+    memcpy(sorted, code_samples, sizeof(sorted));
+    for (const code_sample &s : sorted)
+    {
+        if (s.count)
+        {
+            sorted[count++] = s;
+            total += s.count;
+        }
+    }
+    std::sort(sorted, sorted + count,
+              [](const code_sample &a, const code_sample &b)
+              { return a.count > b.count; });
+    for (uint i = 0; i < count; i++)
+    {
+        size_t len = snprintf(reply, sizeof(reply), "0x%08X %u",
+                              (uint) sorted[i].address,
+                              (uint) sorted[i].count);
+        script_reply(reply, len);
+    }
+    size_t len = snprintf(reply, sizeof(reply), "ok %u %u",
+                          (uint) total, (uint) code_samples_lost);
+    script_reply(reply, len);
+}
+#endif // USE_CODE_PROFILE
+
+
+static void script_poll()
+// ----------------------------------------------------------------------------
+//   Process script lines sent by the host
+// ----------------------------------------------------------------------------
+{
+    static char line[RTT_SCRIPT_INPUT];
+    static uint len = 0;
+    char        c;
+
+    script_posted = 0;          // New input after this posts a new message
+    while (SEGGER_RTT_Read(RTT_SCRIPT_CHANNEL, &c, 1) == 1)
+    {
+        if (c == '\n' || c == '\r')
+        {
+            line[len] = 0;
+            if (strncmp(line, "rpl ", 4) == 0)
+                script_rpl(line + 4);
+            else if (strncmp(line, "key ", 4) == 0)
+                script_keys(line + 4);
+            else if (strncmp(line, "bench ", 6) == 0)
+                script_bench(line + 6);
+#if USE_CODE_PROFILE
+            else if (strncmp(line, "layout", 6) == 0)
+                script_layout(line + 6 + (line[6] == ' '));
+#endif // USE_CODE_PROFILE
+            else if (len)
+                script_reply("error Unknown command", 21);
+            len = 0;
+        }
+        else if (len < sizeof(line) - 1)
+        {
+            line[len++] = c;
+        }
+    }
+    redraw_lcd(true);
+}
+#endif // USE_RTT_SCRIPT
+
+
+#if USE_USB_EVAL
+// ============================================================================
+//
+//   Batch evaluation over USB
+//
+// ============================================================================
+//   The host sends requests on a CDC-ACM serial port:
+//   - "rpl <source>" evaluates one line of RPL source
+//   - "obj <size>" followed by <size> bytes evaluates a .48b binary object
+//   Each request gets one reply line, in order, from host_evaluate().
+//
+//   The USB task fills a queue of request slots, the RPL task evaluates them
+//   in slices between keys, and the USB task then sends the replies and
+//   reuses the slots. When all slots are busy, the USB task stops reading,
+//   and the USB flow control throttles the host. Neither waits for the other.
+
+enum usb_kind : byte
+// ----------------------------------------------------------------------------
+//   Kind of request in a slot
+// ----------------------------------------------------------------------------
+{
+    USB_SOURCE,                 // RPL source
+    USB_BINARY,                 // Binary object in .48b format
+    USB_TOO_LARGE,              // Request does not fit in a slot
+    USB_UNKNOWN,                // Unknown command
+};
+
+
+struct usb_request
+// ----------------------------------------------------------------------------
+//   A request and its reply
+// ----------------------------------------------------------------------------
+{
+    usb_kind    kind;
+    uint        size;                   // Size of request in data
+    uint        length;                 // Size of reply, including \n
+    char        data[USB_EVAL_REQUEST];
+    char        reply[USB_EVAL_REPLY];
+};
+
+static usb_request     usb_requests[USB_EVAL_QUEUE];
+static volatile uint   usb_received  = 0;   // Requests queued by USB task
+static volatile uint   usb_evaluated = 0;   // Requests evaluated by RPL task
+static volatile uint   usb_sent      = 0;   // Replies sent by USB task
+static volatile bool   usb_posted    = false;
+static USB_CDC_HANDLE  usb_cdc;
+static bool            usb_added     = false;
+static byte            usb_out[USB_HS_BULK_MAX_PACKET_SIZE];
+static OS_TASK         usb_tcb;
+static OS_STACKPTR int usb_stack[512];
+
+
+void usb_eval_add()
+// ----------------------------------------------------------------------------
+//   Add the CDC-ACM interface, must be called before USBD_Start()
+// ----------------------------------------------------------------------------
+{
+    USB_CDC_INIT_DATA init;
+    memset(&init, 0, sizeof(init));
+    init.EPIn  = USBD_AddEP(USB_DIR_IN, USB_TRANSFER_TYPE_BULK, 0, NULL, 0);
+    init.EPOut = USBD_AddEP(USB_DIR_OUT, USB_TRANSFER_TYPE_BULK, 0,
+                            usb_out, sizeof(usb_out));
+    init.EPInt = USBD_AddEP(USB_DIR_IN, USB_TRANSFER_TYPE_INT, 8, NULL, 0);
+    usb_cdc    = USBD_CDC_Add(&init);
+    usb_added  = true;
+}
+
+
+static void usb_post()
+// ----------------------------------------------------------------------------
+//   Tell the RPL task that there are requests to evaluate
+// ----------------------------------------------------------------------------
+{
+    if (!usb_posted)
+    {
+        uint32_t msg = USB_EVAL_MESSAGE;
+        usb_posted = true;
+        OS_MAILBOX_Put(&Mb_Keyboard, &msg);
+    }
+}
+
+
+static void usb_flush()
+// ----------------------------------------------------------------------------
+//   Send the replies of evaluated requests, and release their slots
+// ----------------------------------------------------------------------------
+{
+    while (usb_sent != usb_evaluated)
+    {
+        usb_request &req = usb_requests[usb_sent % USB_EVAL_QUEUE];
+        if (USBD_CDC_Write(usb_cdc, req.reply, req.length, 1000) < 0)
+            record(main_error, "Lost USB reply of %u bytes", req.length);
+        usb_sent = usb_sent + 1;
+    }
+}
+
+
+static bool usb_header(usb_request &req, uint &expected)
+// ----------------------------------------------------------------------------
+//   Check a request line, return true if the request is complete
+// ----------------------------------------------------------------------------
+{
+    uint len = req.size;
+    if (len >= sizeof(req.data))
+    {
+        req.kind = USB_TOO_LARGE;
+        return true;
+    }
+    req.data[len] = 0;
+    if (strncmp(req.data, "rpl ", 4) == 0)
+    {
+        req.kind = USB_SOURCE;
+        req.size = len - 4;
+        memmove(req.data, req.data + 4, req.size);
+        return true;
+    }
+    if (strncmp(req.data, "obj ", 4) == 0)
+    {
+        expected = strtoul(req.data + 4, nullptr, 10);
+        req.kind = expected <= sizeof(req.data) ? USB_BINARY : USB_TOO_LARGE;
+        req.size = 0;
+        return expected == 0;
+    }
+    req.kind = USB_UNKNOWN;
+    return true;
+}
+
+
+static void usb_task()
+// ----------------------------------------------------------------------------
+//   Queue requests from the host and send back the replies
+// ----------------------------------------------------------------------------
+{
+    static byte chunk[USB_HS_BULK_MAX_PACKET_SIZE];
+    int         len      = 0;           // Bytes in chunk
+    int         pos      = 0;           // Bytes of chunk already consumed
+    uint        expected = 0;           // Binary bytes still expected
+    bool        filling  = false;       // Current slot holds partial request
+
+    while (true)
+    {
+        usb_flush();
+        if ((USBD_GetState() & (USB_STAT_CONFIGURED | USB_STAT_SUSPENDED))
+            != USB_STAT_CONFIGURED)
+        {
+            OS_TASK_Delay(50);
+            continue;
+        }
+        if (pos >= len)
+        {
+            pos = 0;
+            len = USBD_CDC_Receive(usb_cdc, chunk, sizeof(chunk),
+                                   USB_EVAL_POLL);
+            if (len <= 0)
+                len = 0;
+            continue;
+        }
+
+        // Wait for a free slot, this throttles the host
+        if (usb_received - usb_sent >= USB_EVAL_QUEUE)
+        {
+            OS_TASK_Delay(1);
+            continue;
+        }
+
+        usb_request &req  = usb_requests[usb_received % USB_EVAL_QUEUE];
+        bool         done = false;
+        if (!filling)
+        {
+            req.size = 0;
+            filling  = true;
+        }
+        while (pos < len && !done)
+        {
+            char c = chunk[pos++];
+            if (expected)
+            {
+                if (req.size < sizeof(req.data))
+                    req.data[req.size] = c;
+                req.size++;
+                done = --expected == 0;
+            }
+            else if (c == '\n' || c == '\r')
+            {
+                if (req.size)
+                    done = usb_header(req, expected);
+            }
+            else
+            {
+                if (req.size < sizeof(req.data))
+                    req.data[req.size] = c;
+                req.size++;
+            }
+        }
+        if (done)
+        {
+            filling      = false;
+            usb_received = usb_received + 1;
+            usb_post();
+        }
+    }
+}
+
+
+static void usb_eval_start()
+// ----------------------------------------------------------------------------
+//   Start the USB evaluation task if the CDC interface was added
+// ----------------------------------------------------------------------------
+{
+    if (!usb_added)
+        return;
+    OS_TASK_CREATE(&usb_tcb, "UsbEval", USB_EVAL_PRIORITY, usb_task, usb_stack);
+}
+
+
+static void usb_eval_poll()
+// ----------------------------------------------------------------------------
+//   Evaluate queued requests for at most USB_EVAL_SLICE ms
+// ----------------------------------------------------------------------------
+{
+    uint start = sys_current_ms();
+    usb_posted = false;
+    while (usb_evaluated != usb_received)
+    {
+        usb_request &req = usb_requests[usb_evaluated % USB_EVAL_QUEUE];
+        size_t       max = sizeof(req.reply) - 1;
+        switch (req.kind)
+        {
+        case USB_SOURCE:
+        case USB_BINARY:
+            req.length = host_evaluate(req.data, req.size,
+                                       req.kind == USB_BINARY,
+                                       req.reply, max);
+            break;
+        case USB_TOO_LARGE:
+            req.length = snprintf(req.reply, max, "error 0 Request too large");
+            break;
+        default:
+            req.length = snprintf(req.reply, max, "error 0 Unknown command");
+            break;
+        }
+        req.reply[req.length++] = '\n';
+        usb_evaluated = usb_evaluated + 1;
+
+        // Let keys and the display through, come back later for the rest
+        if (usb_evaluated != usb_received &&
+            (sys_current_ms() - start >= USB_EVAL_SLICE ||
+             OS_MAILBOX_GetMessageCnt(&Mb_Keyboard)))
+        {
+            usb_post();
+            break;
+        }
+    }
+    redraw_lcd(true);
+}
+#endif // USE_USB_EVAL
+
+
+#if USE_MSC_SNAPSHOT
+static void msc_refresh()
+// ----------------------------------------------------------------------------
+//   Resynchronize with the disk after the host wrote to it over USB
+// ----------------------------------------------------------------------------
+{
+    msc_changed = 0;
+    msc_posted  = 0;
+    if (!file::host_changed())
+    {
+        // Try again on next message from KbdTask
+        msc_changed = 1;
+        return;
+    }
+
+    // Libraries are loaded again from the disk when next used
+    for (size_t i = 0; i < rt.xlibs(); i++)
+        rt.xlib(i, nullptr);
+    redraw_lcd(true);
+}
+#endif // USE_MSC_SNAPSHOT
+
+
 extern uint memory_size;
-void program_init()
+COLD void program_init()
 // ----------------------------------------------------------------------------
 //   Initialize the program
 // ----------------------------------------------------------------------------
 {
+    boot_start = boot_last = sys_current_us();
+
     // Setup application menu callbacks
     run_menu_item_app = menu_item_run;
     menu_line_str_app = menu_item_description;
@@ -413,29 +1430,92 @@ void program_init()
 
     // Setup default fonts
     font_defaults();
+    boot_phase("fonts");
 
-#if (DBh743 | DBu585)
-    rt.memory(db48x_mem, sizeof(db48x_mem));
+    bool resumed = false;
+#if USE_WARM_RESUME
+    resumed = warm_resume();
+#endif // USE_WARM_RESUME
+    if (!resumed)
+    {
+#if USE_DTCM_STACK
+        rt.memory(db48x_mem, sizeof(db48x_mem),
+                  db48x_stack, sizeof(db48x_stack));
+#elif (DBh743 | DBu585)
+        rt.memory(db48x_mem, sizeof(db48x_mem));
 #elif SIMULATOR
-    // Give 4K bytes to the runtime to stress-test the GC
-    size_t size = 1024 * memory_size;
-    byte *memory = (byte *) malloc(size);
-    rt.memory(memory, size);
+        // Give 4K bytes to the runtime to stress-test the GC
+        size_t size = 1024 * memory_size;
+        byte *memory = (byte *) malloc(size);
+        rt.memory(memory, size);
 
 #else
-    // Give as much as memory as possible to the runtime
-    // Experimentally, this is the amount of memory we need to leave free
-    size_t size = sys_free_mem() - 10 * 1024;
-    byte *memory = (byte *) malloc(size);
-    rt.memory(memory, size);
+        // Give as much as memory as possible to the runtime
+        // Experimentally, this is the amount of memory we need to leave free
+        size_t size = sys_free_mem() - 10 * 1024;
+        byte *memory = (byte *) malloc(size);
+        rt.memory(memory, size);
+
+
+#endif
+    }
+
+#if USE_QSPI_HEAP
+    // Large arrays, grobs and texts go to external RAM
+    rt.extended_memory((byte *) QSPI_HEAP_BASE, QSPI_HEAP_SIZE,
+                       QSPI_HEAP_THRESHOLD);
+#endif
+    boot_phase("memory");
 
+#if USE_ASYNC_IO
+    // Background writes to the SD card
+    file::io_start();
+#endif
+
+#if USE_SECTOR_CACHE
+    // Sectors of the SPI flash kept in RAM
+    file::cache_start();
+#endif
+
+#if USE_LCD_TASK
+    // Submission of LCD updates
+    lcd_task_start();
+#endif
+
+#if USE_RTT_RECORDER
+    // Recorders enabled at boot, the host can change them later
+    recorder_trace_set(RECORDER_TRACES);
+#endif
 
+#if USE_RTT_SCRIPT
+    // Scripts and benchmarks driven by the host
+    script_start();
 #endif
+#if USE_CODE_PROFILE
+    code_profile_start();
+#endif // USE_CODE_PROFILE
+
+#if USE_USB_EVAL
+    // Batch evaluation from a PC over USB
+    usb_eval_start();
+#endif
+
+#if USE_XIP_LIBRARY
+    // Before anything refers to libraries installed in flash
+    if (!resumed)
+        xlib::prepare_flash();
+#endif
+    boot_phase("tasks");
+
+    // Show the stack before loading the state, which can take a while
+    redraw_lcd(true);
+    boot_phase("first frame");
 
     // Check if we have a state file to load
-    load_system_state();
-    bool res = load_saved_keymap();
-    SEGGER_RTT_printf(0,  "\nLoad keymap : %s\n", res ? "ok":"err");
+    if (!resumed)
+        load_system_state();
+    boot_phase(resumed ? "warm resume" : "state");
+    boot_keymap_pending = true;
 
     // Enable wakeup each minute (for clock update)
     SET_ST(STAT_CLK_WKUP_ENABLE);
@@ -489,6 +1569,13 @@ void power_check(bool running, bool showimage)
              else
                  lcd_refresh_wait();
 
+#if USE_ASYNC_IO
+             // Do not switch off with files half written
+             file::io_wait();
+#endif
+#if USE_SECTOR_CACHE
+             file::cache_flush();
+#endif
              sys_critical_start();
              SET_ST(STAT_SUSPENDED);
              LCD_power_off(0);
@@ -545,7 +1632,7 @@ void power_check(bool running, bool showimage)
    }
     // We definitely reached active state, clear suspended flag
     CLR_ST(STAT_SUSPENDED);
-    LCD_UpdateDisplay(&hlcd);
+    lcd_update_all();
 }
 
 #ifndef SIMULATOR
@@ -582,6 +1669,8 @@ extern "C" void program_main()
     // Initialization
     program_init();
     redraw_lcd(true);
+    boot_phase("restored frame");
+    boot_deferred();
     last_keystroke_time = program::read_time();
 
     // Main loop
@@ -799,6 +1888,9 @@ extern "C" void dbu585_main_2()
    bool transalpha = false;
    bool key_release = false;
 
+#if USE_MPU_PROFILE
+   mpu_configure();
+#endif // USE_MPU_PROFILE
    bool res_init_sram = bkSRAM_Init();
    SEGGER_RTT_printf(0,  "\nCheck Sram Backup :  %s, struct kbd %d", res_init_sram ? "ok":"initialized", sizeof(drcvd));
 
@@ -807,6 +1899,8 @@ extern "C" void dbu585_main_2()
    // Initialization
    program_init();
    redraw_lcd(true);
+   boot_phase("restored frame");
+   boot_deferred();
    last_keystroke_time = program::read_time();
 db_power_state = PW_running;
    // Main loop
@@ -839,6 +1933,8 @@ db_power_state = PW_running;
          } else {
             key = key_DB_to_DM(drcvd.keys.key);
             key_release = false;
+            if (drcvd.keys.key == KB_EXIT_KEY)
+               kb_exit_taken++;
          }
          key_p1 = key_DB_to_DM(drcvd.keys.key1);
          key_p2 = key_DB_to_DM(drcvd.keys.key2);
@@ -869,6 +1965,9 @@ SEGGER_RTT_printf(0, "\nkey %02d %02d %02d %02d, %02d, %02d, %02d %s %02d",
          //SEGGER_RTT_printf(0, "\nsys %07X", drcvd.sys_cmd);
          switch (drcvd.sys_cmd) {
             case SYS_RESET:
+#if USE_WARM_RESUME
+               warm_save();
+#endif // USE_WARM_RESUME
                ui.draw_message("F1 F6 EXIT : reboot");
                while(1){}
                break;
@@ -887,7 +1986,7 @@ SEGGER_RTT_printf(0, "\nkey %02d %02d %02d %02d, %02d, %02d, %02d %s %02d",
                // We definitely reached active state, clear suspended flag
                key = -1;
                key_release = false;
-               LCD_UpdateDisplay(&hlcd);
+               lcd_update_all();
                redraw_lcd(true);
                break;
 
@@ -973,7 +2072,13 @@ extern "C" void dbu585_main_new()
    uint32_t wt_sleeping = 60000;        // each minute for time refresh
    bool transalpha = false;
    bool key_release = false;
+#if USE_IDLE_GC
+   bool idle_gc_done = false;           // Collected since last key
+#endif // USE_IDLE_GC
 
+#if USE_MPU_PROFILE
+   mpu_configure();
+#endif // USE_MPU_PROFILE
    bool res_init_sram = bkSRAM_Init();
    SEGGER_RTT_printf(0,  "\nCheck Sram Backup :  %s", res_init_sram ? "ok":"initialized");
 
@@ -981,6 +2086,8 @@ extern "C" void dbu585_main_new()
    // Initialization
    program_init();
    redraw_lcd(true);
+   boot_phase("restored frame");
+   boot_deferred();
    last_keystroke_time = program::read_time();
 
    // Main loop
@@ -994,7 +2101,41 @@ extern "C" void dbu585_main_new()
       uint32_t tin = sys_current_ms();
 //    program::active_time += tin - last_awake;
 
-      char result = OS_MAILBOX_GetTimed(&Mb_Keyboard, &keybdata, wt_sleeping);
+#if USE_LCD_EXTCOMIN
+      // Without a clock to update, the panel does not need idle refreshes
+      wt_sleeping = hlcd.hw_vcom && !Settings.ShowTime() ? LCD_IDLE_PERIOD : 60000;
+#endif
+      // Show anything drawn during the last frame before waiting
+      if (refresh_pending)
+          refresh_dirty_now();
+#if USE_TICKLESS_IDLE
+      // Background writes need the SD clock, which STOP mode turns off
+      idle_stop_allowed = true;
+#if USE_ASYNC_IO
+      idle_stop_allowed = !file::io_pending();
+#endif // USE_ASYNC_IO
+#endif // USE_TICKLESS_IDLE
+#if USE_RTT_RECORDER
+      recorder_poll();
+#endif // USE_RTT_RECORDER
+      uint32_t wt_wait = wt_sleeping;
+#if USE_IDLE_GC
+      // Wake up shortly to collect garbage if memory is getting low
+      bool idle_gc = !idle_gc_done && rt.memory_low(IDLE_GC_PERCENT);
+      if (idle_gc && wt_wait > IDLE_GC_DELAY)
+         wt_wait = IDLE_GC_DELAY;
+#endif // USE_IDLE_GC
+#if USE_STEADY_REPEAT
+      // Wake up when the next key repeat is due while a key is held
+      if (key > 0)
+         wt_wait = repeat_wait(wt_wait);
+#endif // USE_STEADY_REPEAT
+      sys_clock_idle();
+      char result = OS_MAILBOX_GetTimed(&Mb_Keyboard, &keybdata, wt_wait);
+      sys_clock_boost();
+#if USE_TICKLESS_IDLE
+      idle_stop_allowed = false;
+#endif // USE_TICKLESS_IDLE
 //      char result = 0;
 //      OS_MAILBOX_GetBlocked(&Mb_Keyboard, &keybdata);
 // utiliser une union, struct pour keybdata ????
@@ -1005,6 +2146,9 @@ extern "C" void dbu585_main_new()
          program::sleeping_time += sys_current_ms() - tin;
          tin = sys_current_ms();
          if (0xffffffff == keybdata){     
+#if USE_WARM_RESUME
+            warm_save();
+#endif // USE_WARM_RESUME
             ui.draw_message("F1 F6 EXIT : reboot");
             while(1){}
          }
@@ -1015,8 +2159,52 @@ extern "C" void dbu585_main_new()
             key = -1;
             key_release = false;
          }
+#if USE_ASYNC_IO
+         else if (IO_DONE_MESSAGE == keybdata){
+            // Background writes are done, clear the annunciator
+            ui.draw_busy(0, pattern::black);
+            if (cstring err = file::io_error())
+            {
+               rt.error(err);
+               redraw_lcd(true);
+            }
+            hadKey = false;
+            key = -1;
+            key_release = false;
+         }
+#endif
+#if USE_RTT_SCRIPT
+         else if (SCRIPT_MESSAGE == keybdata){
+            // The host sent script input
+            script_poll();
+            hadKey = false;
+            key = -1;
+            key_release = false;
+         }
+#endif // USE_RTT_SCRIPT
+#if USE_USB_EVAL
+         else if (USB_EVAL_MESSAGE == keybdata){
+            // Requests from the host are queued
+            usb_eval_poll();
+            hadKey = false;
+            key = -1;
+            key_release = false;
+         }
+#endif // USE_USB_EVAL
+#if USE_MSC_SNAPSHOT
+         else if (MSC_CHANGED_MESSAGE == keybdata){
+            // The host is done writing to the disk
+            msc_refresh();
+            hadKey = false;
+            key = -1;
+            key_release = false;
+         }
+#endif // USE_MSC_SNAPSHOT
          else {
             hadKey = true;
+#if USE_IDLE_GC
+            idle_gc_done = false;
+#endif // USE_IDLE_GC
             key_tmp = keybdata & 0xff;
             if (key_tmp>100) { // release
                key = 0;
@@ -1025,6 +2213,9 @@ extern "C" void dbu585_main_new()
             } else {
                key = key_DB_to_DM(key_tmp);
                key_release = false;
+               if (key_tmp == KB_EXIT_KEY)
+                  kb_exit_taken++;
+               sys_key_stage(KEY_STAGE_RECEIVED);
             }
             key_p1 = key_DB_to_DM((keybdata>>8) & 0xff);
             key_p2 = key_DB_to_DM((keybdata>>16) & 0xff);
@@ -1055,9 +2246,21 @@ SEGGER_RTT_printf(0, "\nkey %02d %02d %02d %03d, %02d, %02d, %02d %s %02d",
             }
         } // end get key event
       else { // waiting time out
+#if USE_IDLE_GC
+         if (idle_gc)
+         {
+            size_t purged = rt.idle_gc(IDLE_GC_PERCENT);
+            record(main, "Idle collection purged %u", purged);
+            idle_gc_done = true;
+         }
+         else
+#endif // USE_IDLE_GC
          redraw_periodics();
-         program::sleeping_time += wt_sleeping;
+         program::sleeping_time += wt_wait;
          if (key == 0)  key = -1;
+#if USE_STATE_JOURNAL
+         state_journal_idle();
+#endif
 // gestion power off / sleeping à faire ici ????????????????????
 
       }
@@ -1083,7 +2286,12 @@ SEGGER_RTT_printf(0, "\nkey %02d %02d %02d %03d, %02d, %02d, %02d %s %02d",
 
             record(main, "Handle key %d last %d", key, last_key);
             handle_key(key, repeating, transalpha);
+#if USE_STEADY_REPEAT
+            if (repeating)
+                handle_repeats(key, transalpha);
+#endif // USE_STEADY_REPEAT
             record(main, "Did key %d last %d", key, last_key);
+            sys_key_stage(KEY_STAGE_HANDLED);
             program::run_cycles++;
          program::active_time += sys_current_ms() - tin;
             // Redraw the LCD unless there is some type-ahead
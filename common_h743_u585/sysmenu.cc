@@ -33,6 +33,8 @@
 
 #include "dmcp.h"
 #include "file.h"
+#include "files.h"
+#include "font.h"
 //#include "main.h"
 #include "object.h"
 #include "program.h"
@@ -252,6 +254,432 @@ static bool state_save_variable(object_p name, object_p obj, void *renderer_ptr)
 }
 
 
+// ============================================================================
+//
+//   Binary state images
+//
+// ============================================================================
+//   A state image (.48i) is written next to the .48s source state. It holds
+//   the global objects, which contain no pointers and can be loaded as is,
+//   the directory path as offsets, the stack objects and the settings.
+//   It is only used if the firmware has the same object IDs and the .48s
+//   file did not change since, otherwise we parse the source state.
+
+#define STATE_IMAGE_KIND        0x32474D49      // "IMG2"
+
+static bool is_valid_state_file(cstring filename);
+
+struct state_image_header
+// ----------------------------------------------------------------------------
+//   Header of a state image
+// ----------------------------------------------------------------------------
+{
+    byte        magic[4];               // FILE_MAGIC
+    uint32_t    kind;                   // STATE_IMAGE_KIND
+    uint32_t    checksum;               // files::id_checksum()
+    uint32_t    settings_size;          // sizeof(settings)
+    uint32_t    source_size;            // Size of the matching .48s file
+    uint32_t    source_stamp;           // Modification time of that file
+    uint32_t    globals_size;           // Size of global objects
+    uint32_t    path_depth;             // Directories below home
+    uint32_t    stack_depth;            // Objects on the stack
+};
+
+
+struct state_image_io
+// ----------------------------------------------------------------------------
+//   Reading or writing a state image while computing its checksum
+// ----------------------------------------------------------------------------
+{
+    state_image_io(file &f): f(f), sum(0) {}
+
+    bool write(const void *data, size_t len)
+    {
+        update(data, len);
+        return f.write(cstring(data), len);
+    }
+
+    bool read(void *data, size_t len)
+    {
+        if (!f.read((char *) data, len))
+            return false;
+        update(data, len);
+        return true;
+    }
+
+    void update(const void *data, size_t len)
+    {
+        byte_p p = byte_p(data);
+        for (size_t i = 0; i < len; i++)
+            sum = 0x1081 * sum ^ p[i];
+    }
+
+    static bool reader(byte *buffer, size_t size, void *io)
+    {
+        return ((state_image_io *) io)->read(buffer, size);
+    }
+
+    file     &f;
+    uint32_t  sum;
+};
+
+
+static cstring state_image_name(cstring path)
+// ----------------------------------------------------------------------------
+//   Return the name of the image file for a given state file
+// ----------------------------------------------------------------------------
+{
+    static char name[80];
+    size_t len = strlen(path);
+    if (len >= sizeof(name) || !is_valid_state_file(path))
+        return nullptr;
+    memcpy(name, path, len + 1);
+    name[len - 1] = 'i';
+    return name;
+}
+
+
+#if USE_STATE_JOURNAL
+// ============================================================================
+//
+//   State journal
+//
+// ============================================================================
+//   Changes to the HOME directory are recorded in backup SRAM as they happen,
+//   as a list of name and value pairs (purges have no value) that applies to
+//   the state image with the given checksum. When the journal is full, or
+//   when a change cannot be recorded, we save the whole state while idle,
+//   which starts a new journal.
+
+#define STATE_JOURNAL_MAGIC     0x4C4E524A      // "JRNL"
+
+struct state_journal_header
+// ----------------------------------------------------------------------------
+//   Header of the journal in backup SRAM
+// ----------------------------------------------------------------------------
+{
+    uint32_t    magic;                  // STATE_JOURNAL_MAGIC
+    uint32_t    base;                   // Checksum of the base image
+    uint32_t    used;                   // Bytes of committed records
+};
+
+
+struct state_journal_record
+// ----------------------------------------------------------------------------
+//   A record in the journal, followed by the name and value
+// ----------------------------------------------------------------------------
+{
+    uint16_t    name_size;              // Size of the name
+    uint16_t    value_size;             // Size of the value, 0 when purging
+};
+
+
+static uint32_t journal_used      = 0;    // Bytes used in journal
+static bool     journal_stopped   = true; // Cannot record changes until saved
+static bool     journal_pending   = false;// Changes not recorded in journal
+static bool     journal_replaying = false;// Replaying the journal
+
+
+static void state_journal_reset(uint32_t base)
+// ----------------------------------------------------------------------------
+//   Start a new empty journal for the given base image
+// ----------------------------------------------------------------------------
+{
+    state_journal_header hdr = { STATE_JOURNAL_MAGIC, base, 0 };
+    bkSRAM_Write(BKPSRAM_JOURNAL, &hdr, sizeof(hdr));
+    journal_used = 0;
+    journal_stopped = base == 0;
+}
+
+
+void state_journal(const directory *dir, const object *name,
+                   const object *value)
+// ----------------------------------------------------------------------------
+//   Record a change in a directory
+// ----------------------------------------------------------------------------
+{
+    // Changes to temporary directories are not part of the state
+    if (journal_replaying || !rt.is_global(dir))
+        return;
+    if (journal_stopped || dir != rt.homedir())
+    {
+        journal_stopped = true;
+        journal_pending = true;
+        return;
+    }
+
+    state_journal_record rec;
+    size_t ns    = name->size();
+    size_t vs    = value ? value->size() : 0;
+    size_t total = sizeof(rec) + ns + vs;
+    size_t room  = BKPSRAM_JOURNAL_SIZE - sizeof(state_journal_header);
+    if (ns > 0xFFFF || vs > 0xFFFF || journal_used + total > room)
+    {
+        journal_stopped = true;
+        journal_pending = true;
+        return;
+    }
+
+    // Write the record, then commit it by updating the header
+    rec.name_size = ns;
+    rec.value_size = vs;
+    uint32_t offset = BKPSRAM_JOURNAL + sizeof(state_journal_header)
+        + journal_used;
+    bkSRAM_Write(offset, &rec, sizeof(rec));
+    bkSRAM_Write(offset + sizeof(rec), name, ns);
+    if (vs)
+        bkSRAM_Write(offset + sizeof(rec) + ns, value, vs);
+    journal_used += total;
+    bkSRAM_Write(BKPSRAM_JOURNAL + offsetof(state_journal_header, used),
+                 &journal_used, sizeof(journal_used));
+}
+
+
+static object_p state_journal_object(uint32_t offset, size_t size)
+// ----------------------------------------------------------------------------
+//   Read an object from the journal into a temporary
+// ----------------------------------------------------------------------------
+{
+    byte *buffer = rt.allocate(size);
+    if (!buffer)
+        return nullptr;
+    bkSRAM_Read(offset, buffer, size);
+    object_p obj = rt.temporary();
+    if (obj->type() >= object::NUM_IDS || obj->size() != size)
+        return nullptr;
+    return obj;
+}
+
+
+static void state_journal_replay(uint32_t base)
+// ----------------------------------------------------------------------------
+//   Replay the journal if it applies to the image that was loaded
+// ----------------------------------------------------------------------------
+{
+    state_journal_header hdr;
+    size_t room = BKPSRAM_JOURNAL_SIZE - sizeof(hdr);
+    if (!bkSRAM_Read(BKPSRAM_JOURNAL, &hdr, sizeof(hdr)) ||
+        hdr.magic != STATE_JOURNAL_MAGIC || hdr.base != base ||
+        hdr.used > room)
+    {
+        state_journal_reset(base);
+        return;
+    }
+
+    uint32_t used = 0;
+    uint32_t start = BKPSRAM_JOURNAL + sizeof(hdr);
+    journal_replaying = true;
+    while (used + sizeof(state_journal_record) <= hdr.used)
+    {
+        state_journal_record rec;
+        bkSRAM_Read(start + used, &rec, sizeof(rec));
+        size_t total = sizeof(rec) + rec.name_size + rec.value_size;
+        if (used + total > hdr.used)
+            break;
+
+        uint32_t offset = start + used + sizeof(rec);
+        object_g name = state_journal_object(offset, rec.name_size);
+        if (!name)
+            break;
+        directory *home = rt.homedir();
+        if (rec.value_size)
+        {
+            object_g value = state_journal_object(offset + rec.name_size,
+                                                  rec.value_size);
+            if (!value || !home->store(name, value))
+                break;
+        }
+        else
+        {
+            home->purge(name);
+        }
+        used += total;
+    }
+    journal_replaying = false;
+    rt.clear_error();
+
+    // Keep what could be replayed, and continue from there
+    journal_used = used;
+    journal_stopped = false;
+    if (used != hdr.used)
+        bkSRAM_Write(BKPSRAM_JOURNAL + offsetof(state_journal_header, used),
+                     &journal_used, sizeof(journal_used));
+}
+
+
+void state_journal_idle()
+// ----------------------------------------------------------------------------
+//   When idle, save the state if the journal could not record changes
+// ----------------------------------------------------------------------------
+//   A full save to the disk can take a while and overwrites the state
+//   file, so this only happens with the SaveStateWhenIdle setting
+{
+    if (journal_pending && Settings.SaveStateWhenIdle() && sys_disk_ok())
+    {
+        journal_pending = false;
+        save_system_state();
+        redraw_lcd(true);
+    }
+}
+#endif // USE_STATE_JOURNAL
+
+
+static bool state_image_save(cstring path,
+                             uint source_size, uint source_stamp)
+// ----------------------------------------------------------------------------
+//   Save a binary image of the state next to the state file
+// ----------------------------------------------------------------------------
+{
+    cstring name = state_image_name(path);
+    if (!name)
+        return false;
+
+    bool ok = false;
+    {
+        file img(name, files::write_mode());
+        if (img.valid())
+        {
+            state_image_io     io(img);
+            size_t             gsize = 0;
+            byte_p             globals = rt.globals_image(gsize);
+            uint               dirs = rt.directories();
+            uint               depth = rt.depth();
+            state_image_header hdr =
+            {
+                FILE_MAGIC,
+                STATE_IMAGE_KIND,
+                files::id_checksum(),
+                sizeof(settings),
+                source_size,
+                source_stamp,
+                uint32_t(gsize),
+                dirs - 1,
+                depth
+            };
+            ok = io.write(&hdr, sizeof(hdr))
+                && io.write(&Settings, sizeof(Settings))
+                && io.write(globals, gsize);
+
+            // Directory path from home, as offsets in the image
+            for (uint d = dirs - 1; ok && d-- > 0; )
+            {
+                uint32_t offset = byte_p(rt.variables(d)) - globals;
+                ok = io.write(&offset, sizeof(offset));
+            }
+
+            // Stack objects, starting with the deepest one
+            while (ok && depth-- > 0)
+            {
+                object_p obj  = rt.stack(depth);
+                uint32_t size = obj->size();
+                ok = io.write(&size, sizeof(size))
+                    && io.write(obj, size);
+            }
+
+            uint32_t sum = io.sum;
+            ok = ok && img.write(cstring(&sum), sizeof(sum)) && img.flush();
+#if USE_STATE_JOURNAL
+            state_journal_reset(ok ? sum : 0);
+#endif // USE_STATE_JOURNAL
+        }
+    }
+    if (!ok)
+        file::unlink(name);
+    return ok;
+}
+
+
+static bool state_image_load(cstring path)
+// ----------------------------------------------------------------------------
+//   Load the binary image matching a state file if it is valid
+// ----------------------------------------------------------------------------
+//   On failure, the runtime may be reset, and the source state is loaded
+{
+    cstring name = state_image_name(path);
+    if (!name)
+        return false;
+
+    // Check that the source state did not change since the image was made.
+    // The size alone misses edits that keep it, e.g. changing one digit
+    uint source_size  = 0;
+    uint source_stamp = 0;
+    {
+        file source(path, file::READING);
+        if (!source.valid())
+            return false;
+        source_size  = source.size();
+        source_stamp = source.modified();
+    }
+
+    file img(name, file::READING);
+    if (!img.valid())
+        return false;
+
+    state_image_io     io(img);
+    state_image_header hdr;
+    byte               magic[] = FILE_MAGIC;
+    if (!io.read(&hdr, sizeof(hdr))                             ||
+        memcmp(hdr.magic, magic, sizeof(magic)) != 0            ||
+        hdr.kind != STATE_IMAGE_KIND                            ||
+        hdr.checksum != files::id_checksum()                    ||
+        hdr.settings_size != sizeof(settings)                   ||
+        hdr.source_size != source_size                          ||
+        hdr.source_stamp != source_stamp)
+        return false;
+
+    settings loaded;
+    if (!io.read(&loaded, sizeof(loaded)))
+        return false;
+
+    ui.draw_message("Load state", "Loading state image...", name);
+    if (!rt.load_globals_image(hdr.globals_size, io.reader, &io))
+        return false;
+
+    size_t gsize   = 0;
+    byte_p globals = rt.globals_image(gsize);
+    bool   ok      = true;
+    for (uint d = 0; ok && d < hdr.path_depth; d++)
+    {
+        uint32_t offset = 0;
+        ok = io.read(&offset, sizeof(offset)) && offset < gsize;
+        if (ok)
+        {
+            directory_p dir = directory_p(globals + offset);
+            ok = dir->type() == object::ID_directory && rt.enter(dir);
+        }
+    }
+
+    for (uint d = 0; ok && d < hdr.stack_depth; d++)
+    {
+        uint32_t size = 0;
+        byte    *buffer = nullptr;
+        ok = io.read(&size, sizeof(size)) && (buffer = rt.allocate(size));
+        ok = ok && io.read(buffer, size);
+        if (ok)
+        {
+            object_p obj = rt.temporary();
+            ok = obj->type() < object::NUM_IDS && obj->size() == size
+                && rt.push(obj);
+        }
+    }
+
+    uint32_t computed = io.sum;
+    uint32_t sum = 0;
+    ok = ok && img.read((char *) &sum, sizeof(sum)) && sum == computed;
+    if (!ok)
+    {
+        rt.reset();
+        return false;
+    }
+
+    Settings = loaded;
+#if USE_STATE_JOURNAL
+    state_journal_replay(computed);
+#endif // USE_STATE_JOURNAL
+    return true;
+}
+
+
 static int state_save_callback(cstring fpath, cstring fname, void *)
 // ----------------------------------------------------------------------------
 //   Callback when a file is selected
@@ -261,7 +689,7 @@ static int state_save_callback(cstring fpath, cstring fname, void *)
     ui.draw_message("Saving state...", fname);
 
     // Open save file name
-    file prog(fpath, file::WRITING);
+    file prog(fpath, files::write_mode());
     if (!prog.valid())
     {
         ui.draw_message("State save failed", prog.error(), fpath);
@@ -309,6 +737,20 @@ static int state_save_callback(cstring fpath, cstring fname, void *)
     // Restore the settings we had
     Settings = saved;
 
+    // Save a binary image matching this source state
+    prog.flush();
+    uint source_size = prog.size();
+    prog.close();
+    uint source_stamp = 0;
+    {
+        file source(fpath, file::READING);
+        source_stamp = source.modified();
+    }
+    state_image_save(fpath, source_size, source_stamp);
+#if USE_SECTOR_CACHE
+    file::cache_flush();
+#endif // USE_SECTOR_CACHE
+
     // Store the state file name so that we automatically reload it
     set_reset_state_file(fpath);
 
@@ -374,6 +816,85 @@ static bool danger_will_robinson(cstring header,
 }
 
 
+enum state_load_status
+// ----------------------------------------------------------------------------
+//   Result of running one part of a state file
+// ----------------------------------------------------------------------------
+{
+    STATE_LOAD_OK,              // Part was run (or was empty)
+    STATE_LOAD_INCOMPLETE,      // Part does not parse yet, need more input
+    STATE_LOAD_ERROR,           // Syntax or execution error
+};
+
+
+static state_load_status state_load_run(bool last)
+// ----------------------------------------------------------------------------
+//   Parse and run what was read from the state file so far
+// ----------------------------------------------------------------------------
+//   The editor holds the input read so far. If it does not parse and this
+//   is not the end of the file, it is put back in the editor to be
+//   completed by more input, e.g. for a program containing a blank line.
+{
+    size_t edlen = rt.editing();
+    if (!edlen)
+        return STATE_LOAD_OK;
+
+    text_g edstr = rt.close_editor(true, false);
+    if (!edstr)
+    {
+        rt.out_of_memory_error();
+        return STATE_LOAD_ERROR;
+    }
+
+    // Need to re-fetch editor length after text conversion
+    gcutf8 editor = edstr->value(&edlen);
+    bool dc = Settings.DecimalComma();
+    Settings.DecimalComma(false);
+    bool store_at_end = Settings.StoreAtEnd();
+    Settings.StoreAtEnd(true);
+    program_g cmds = program::parse(editor, edlen);
+    Settings.DecimalComma(dc);
+    if (cmds)
+    {
+        // We successfully parsed the input
+        rt.clear();
+        object::result exec = cmds->run();
+        Settings.StoreAtEnd(store_at_end);
+        if (exec != object::OK)
+        {
+            ui.draw_error();
+            return STATE_LOAD_ERROR;
+        }
+
+        // Clone all objects on the stack so that we can purge
+        // the command-line above.
+        rt.clone_stack();
+        return STATE_LOAD_OK;
+    }
+
+    Settings.StoreAtEnd(store_at_end);
+    utf8 ed = editor;
+    if (!last)
+    {
+        // Probably an incomplete object, wait for more input
+        rt.clear_error();
+        if (!rt.edit(ed, edlen))
+            return STATE_LOAD_ERROR;
+        return STATE_LOAD_INCOMPLETE;
+    }
+
+    utf8 pos = rt.source();
+    if (!rt.error())
+        rt.syntax_error();
+    beep(3300, 100);
+    if (pos >= editor && pos <= ed + edlen)
+        ui.cursor_position(pos - ed);
+    if (!rt.edit(ed, edlen))
+        ui.cursor_position(0);
+    return STATE_LOAD_ERROR;
+}
+
+
 static int state_load_callback(cstring path, cstring name, void *merge)
 // ----------------------------------------------------------------------------
 //   Callback when a file is selected for loading
@@ -395,6 +916,9 @@ static int state_load_callback(cstring path, cstring name, void *merge)
         rt.reset();
         Settings = settings();
         load_saved_keymap();
+#if USE_STATE_JOURNAL
+        state_journal_reset(0);
+#endif // USE_STATE_JOURNAL
     }
 
     // Display the name of the file being saved
@@ -413,71 +937,53 @@ static int state_load_callback(cstring path, cstring name, void *merge)
             return 1;
         }
 
-        // Loop on the input file and process it as if it was being typed
-        size_t bytes = 0;
+        // Loop on the input file and process it as if it was being typed,
+        // running what we have at blank lines, which usually end a variable.
+        // The input since the last part that ran is parsed again each time,
+        // so after an incomplete part, wait until it doubled in size, which
+        // keeps the parsing time linear for large objects.
+        const size_t batch = 4096;
+        byte         buffer[256];
+        size_t       buffered = 0;
+        size_t       line = 0;
+        size_t       retry = 0;
+        unicode      last = 0;
         rt.clear();
 
-        for (unicode c = prog.get(); c; c = prog.get())
+        for (unicode c = prog.get(); true; c = prog.get())
         {
-            byte buffer[4];
-            size_t count = utf8_encode(c, buffer);
-            rt.insert(bytes, buffer, count);
-            bytes += count;
-        }
-    }
-
-    // End of file: execute the command we typed
-    size_t edlen = rt.editing();
-    if (edlen)
-    {
-        text_g edstr = rt.close_editor(true, false);
-        if (edstr)
-        {
-            // Need to re-fetch editor length after text conversion
-            gcutf8 editor = edstr->value(&edlen);
-            bool dc = Settings.DecimalComma();
-            Settings.DecimalComma(false);
-            bool store_at_end = Settings.StoreAtEnd();
-            Settings.StoreAtEnd(true);
-            program_g cmds = program::parse(editor, edlen);
-            Settings.DecimalComma(dc);
-            if (cmds)
+            if (c)
+            {
+                buffered += utf8_encode(c, buffer + buffered);
+                line += c != '\r';
+            }
+            bool eol = c == '\n' || !c;
+            if (eol || buffered + 4 > sizeof(buffer))
             {
-                // We successfully parsed the line
-                rt.clear();
-                object::result exec = cmds->run();
-                Settings.StoreAtEnd(store_at_end);
-                if (exec != object::OK)
+                if (buffered && !rt.insert(rt.editing(), buffer, buffered))
                 {
-                    ui.draw_error();
+                    rt.out_of_memory_error();
                     return 1;
                 }
-
-                // Clone all objects on the stack so that we can purge
-                // the command-line above.
-                rt.clone_stack();
+                buffered = 0;
             }
-            else
+            if (eol)
             {
-                utf8 pos = rt.source();
-                utf8 ed = editor;
-
-                Settings.StoreAtEnd(store_at_end);
-                if (!rt.error())
-                    rt.syntax_error();
-                beep(3300, 100);
-                if (pos >= editor && pos <= ed + edlen)
-                    ui.cursor_position(pos - ed);
-                if (!rt.edit(ed, edlen))
-                    ui.cursor_position(0);
-
-                return 1;
+                bool   blank = line == 1 && last == '\n';
+                size_t input = rt.editing();
+                if (!c || ((blank || input >= batch) && input >= retry))
+                {
+                    state_load_status st = state_load_run(!c);
+                    if (st == STATE_LOAD_ERROR)
+                        return 1;
+                    retry = st == STATE_LOAD_INCOMPLETE ? 2 * input : 0;
+                }
+                line = 0;
             }
-        }
-        else
-        {
-            rt.out_of_memory_error();
-            return 1;
+            if (!c)
+                break;
+            if (c != '\r')
+                last = c;
         }
     }
 
@@ -614,6 +1120,40 @@ static int keymap_load()
 }
 
 
+#if USE_RESOURCE_FLASH
+static int resource_load()
+// ----------------------------------------------------------------------------
+//   Load fonts and help from the disk into the resource flash
+// ----------------------------------------------------------------------------
+{
+    static const cstring resources[] =
+    {
+        HELPFILE_NAME,
+        HELPINDEX_NAME,
+        "fonts/HelpFont.dbf",
+        "fonts/ReducedFont.dbf",
+        "fonts/StackFont.dbf",
+        "fonts/EditorFont.dbf",
+    };
+
+    // Nothing may use the resource flash while it is being rewritten
+    ui.clear_help();
+    file::resources_enable(false);
+    font_defaults();
+    ui.draw_message("Load QSPI", "Loading fonts and help...");
+
+    uint count = sizeof(resources) / sizeof(resources[0]);
+    bool ok = file::load_resources(resources, count);
+    font_defaults();
+    ui.draw_message(ok ? "Load QSPI" : "QSPI load failed",
+                    ok ? "Fonts and help loaded" : "Could not write flash",
+                    "Press a key to continue");
+    wait_for_key_press();
+    return MRET_EXIT;
+}
+#endif // USE_RESOURCE_FLASH
+
+
 #if   (SIMULATOR & ! Db_TEST)
 int       ui_wrap_io(file_sel_fn callback,
                      const char *path,
@@ -673,7 +1213,7 @@ bool load_system_state()
         // legitimately return a .f42 file if we just switched from DM42.
         char *state = get_reset_state_file();
         if (is_valid_state_file(state))
-            return load_state_file(state);
+            return state_image_load(state) || load_state_file(state);
     }
     return false;
 }
@@ -735,6 +1275,9 @@ int menu_item_run(uint8_t menu_id)
     case MI_DB48_FLASH:
         Settings.SilentBeepOn(!Settings.SilentBeepOn());                break;
     case MI_DB48_KEYMAP:   ret = keymap_load();                         break;
+#if USE_RESOURCE_FLASH
+    case MI_LOAD_QSPI:     ret = resource_load();                       break;
+#endif // USE_RESOURCE_FLASH
 
     case MI_48STATUS:
         ret = handle_menu(&status_bar_menu, MENU_ADD, 0);               break;
@@ -82,8 +82,16 @@ void                  power_off(bool offimg);
 void                  system_setup();
 void                  mark_dirty(uint row);
 void                  refresh_dirty();
+void                  refresh_dirty_now();
 void                  redraw_lcd(bool force);
 void                  set_timer(uint timerid, uint period);
+#if USE_STATE_JOURNAL
+struct object;
+struct directory;
+void                  state_journal(const directory *dir,
+                                    const object *name, const object *value);
+void                  state_journal_idle();
+#endif // USE_STATE_JOURNAL
 #if SIMULATOR
 void                  process_test_key(int key);
 void                  process_test_commands();
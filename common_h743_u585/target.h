@@ -57,6 +57,10 @@ enum target
 using surface = blitter::surface<blitter::mode::RGB_16BPP>;
 using color   = blitter::color  <blitter::mode::RGB_16BPP>;
 using pattern = blitter::pattern<blitter::mode::RGB_16BPP>;
+#elif USE_NATIVE_LCD
+using surface = blitter::surface<blitter::mode::MONOCHROME_NATIVE>;
+using color   = blitter::color  <blitter::mode::MONOCHROME_NATIVE>;
+using pattern = blitter::pattern<blitter::mode::MONOCHROME_NATIVE>;
 #else
 using surface = blitter::surface<blitter::mode::MONOCHROME_REVERSE>;
 using color   = blitter::color  <blitter::mode::MONOCHROME_REVERSE>;
@@ -21,6 +21,9 @@
 
 #define HELPINDEX_NAME "/help/db48x.idx"
 #define HELPFILE_NAME "/help/db48x.md"
+#define HELP_INDEX_ENTRIES (4096)       // Help index entries cached in RAM
+#define UNIT_FILE_INDEX_ENTRIES (4096)  // Rows of config/*.csv indexed in RAM
+#define UNIT_FILE_INDEXES  (8)          // Number of config files indexed
 
 
 #if  DBh743
@@ -35,6 +38,214 @@
 #endif
 #define USE_EmFile   (DBh743 | DBu585)
 
+// Put the RPL stack in DTCM (section .DTCM_RAM), objects stay in AXI RAM
+#define USE_DTCM_STACK (DBh743)
+
+// Run the evaluator hot path from zero-wait ITCM (section .ITCM_CODE).
+// The linker placement must load that section in flash and copy it at reset.
+#define USE_ITCM_CODE (DBh743)
+
+// Large temporaries in memory-mapped QSPI RAM (BSP must enable mapped mode)
+#define USE_QSPI_HEAP       (0)
+#define QSPI_HEAP_BASE      (0x90000000)
+#define QSPI_HEAP_SIZE      (1024*1024*8)
+#define QSPI_HEAP_THRESHOLD (1024*2)
+
+// Collect garbage while waiting for keys when less than IDLE_GC_PERCENT of
+// object memory is free and no key arrived for IDLE_GC_DELAY milliseconds
+#define USE_IDLE_GC         (1)
+#define IDLE_GC_DELAY       (300)
+#define IDLE_GC_PERCENT     (25)
+
+// Large runtime memory moves (GC, globals, editor) done by MDMA
+#define USE_MDMA_MOVE       (DBh743)
+#define MDMA_MOVE_THRESHOLD (1024*4)
+
+// Explicit MPU layout set at boot: AXI and D2 RAM write-back/write-allocate,
+// DMA buffers in non-cacheable DMA_BUFFER_SECTION, backup SRAM write-through
+// and peripherals as device memory, so that the LCD and backup SRAM writes
+// need no cache clean. "bench gc" and "bench draw" on the script channel
+// time the garbage collector and the screen redraw to compare builds.
+#define USE_MPU_PROFILE     (DBh743)
+#define DMA_BUFFER_SECTION  ".SRAM3"
+
+// Journal changes to the HOME directory in backup SRAM between state saves
+#define USE_STATE_JOURNAL   (DBh743)
+
+// Take over the objects left in RAM by a soft reset (F1+F6+EXIT) instead of
+// reloading the state. The startup code must not clear the .AXI_RAM1 and
+// .DTCM_RAM sections.
+#define USE_WARM_RESUME     (DBh743)
+
+// Install attached libraries in flash and run them in place. On the h743,
+// this uses the last two sectors of internal flash bank 2, which the linker
+// script must leave free. Off until the linker scripts reserve them.
+#define USE_XIP_LIBRARY     (0)
+#define XIP_LIBRARY_BASE    (0x081C0000)
+#define XIP_LIBRARY_SIZE    (1024*256)
+#define XIP_LIBRARY_SECTOR  (6)
+
+// Read-only fonts and help files in memory-mapped QSPI flash, loaded from
+// the disk with "Load QSPI from FAT" (BSP must provide resource_flash_*)
+#define USE_RESOURCE_FLASH  (0)
+#define RESOURCE_FLASH_BASE (0x90000000)
+#define RESOURCE_FLASH_SIZE (1024*1024*16)
+
+// emFile write-back sector cache for the slow SPI flash of the u585, where
+// dirty sectors are written when a state is saved and before switching off,
+// and a larger file read-ahead buffer for sequential scans of help and CSV.
+#define USE_SECTOR_CACHE    (DBu585)
+#define SECTOR_CACHE_SIZE   (1024*32)
+#if DBu585
+#define FILE_BUFFER_SIZE    (1024*8)
+#else
+#define FILE_BUFFER_SIZE    (1024*2)
+#endif
+
+// File selector for states and keymaps, with the sorted listing of the last
+// DIR_LISTINGS directories kept in RAM until files are created or removed.
+// The first screen is shown while the rest of the directory is being read.
+#define USE_FILE_SELECTOR   (USE_EmFile)
+#define DIR_LISTINGS        (2)
+#define DIR_LISTING_FILES   (512)
+#define DIR_LISTING_NAMES   (1024*8)
+
+// Keep small index and configuration files (.idx, .csv, .cfg) read from the
+// disk in a RAM pool, so that opening them again does not touch the disk.
+// The pool is in D2 SRAM1, otherwise unused, which the linker must place.
+#define USE_PINNED_FILES    (DBh743)
+#define PINNED_FILES        (16)
+#define PINNED_FILES_POOL   (1024*128)
+#define PINNED_FILE_MAX     (1024*64)
+#define PINNED_FILES_SECTION ".SRAM1"
+
+// Command-line history in a ring buffer outside of object memory. On the
+// h743 it is in D3 SRAM4, which the startup code must not clear, so that
+// the history survives a soft reset.
+#define EDITOR_RING_SIZE    (1024*16)
+#if DBh743
+#define EDITOR_RING_SECTION ".SRAM4"
+#endif
+
+// Save state and object files as LZ4 blocks of COMPRESSED_BLOCK bytes when
+// the CompressFiles setting is set. Compressed files are recognized from
+// their header when reading, whatever the setting.
+#define USE_COMPRESSED_FILES (USE_EmFile)
+#define COMPRESSED_BLOCK    (1024*4)
+
+// Write whole files from a background task, so that the RPL task does not
+// wait for the SD card. Larger files are written synchronously. A failed
+// write is reported when the writes complete or on the next store.
+#define USE_ASYNC_IO        (DBh743)
+#define ASYNC_IO_BUFFER     (1024*32)
+#define ASYNC_IO_JOBS       (4)
+#define ASYNC_IO_PRIORITY   (50)
+
+// Screen surface in the Sharp panel's own pixel order, so that the LCD
+// driver sends framebuffer lines as they are instead of mirroring them.
+// Off until glyphs and REVERSE bitmaps are stored in that order, since the
+// blitter copies their words as they are
+#define USE_NATIVE_LCD      (0)
+
+// Drive the panel VCOM from a timer on EXTCOMIN instead of the VCOM bit of
+// SPI commands. The board must tie EXTMODE high, and the BSP must provide
+// lcd_extcomin_start(). Idle refreshes can then be far apart.
+#define USE_LCD_EXTCOMIN    (0)
+#define LCD_EXTCOMIN_HZ     (1)
+#define LCD_IDLE_PERIOD     (60000*10)
+
+// Minimum interval in ms between LCD updates requested while drawing,
+// e.g. by plots or the busy indicator. Key handling flushes immediately.
+#define LCD_FRAME_PERIOD    (33)
+
+// Submit LCD updates from a separate task, so that drawing done during a
+// long computation shows up at the frame rate. The task priority must be
+// above that of the RPL task.
+#define USE_LCD_TASK        (DBh743)
+#define LCD_TASK_PRIORITY   (120)
+
+// Glyph cache entries (a power of two) and code point ranges for all fonts.
+// The glyph table is allocated from the C heap, the ranges are static.
+#define FONT_CACHE_GLYPHS   (512)
+#define FONT_CACHE_RANGES   (256)
+
+// Stop the system tick while all tasks wait, and sleep until the next embOS
+// timeout, programmed in the RTC wake-up timer, or until a key interrupt.
+// The BSP's OS_Idle() must call db_idle(), and export SystemClock_Config()
+// so that waits longer than TICKLESS_STOP_TICKS can use STOP mode.
+#define USE_TICKLESS_IDLE   (DBh743)
+#define TICKLESS_MIN_TICKS  (2)
+#define TICKLESS_STOP_TICKS (20)
+
+// Divide the core clock while the RPL task waits for a key, and run at full
+// speed while it works. The value is an RCC D1CPRE setting. SPI4 is moved
+// to the HSI kernel clock so that the LCD bit rate does not change.
+#define USE_CLOCK_SCALING   (DBh743)
+#define CLOCK_IDLE_DIV      (RCC_SYSCLK_DIV8)
+
+// Send record() events as binary data on an RTT channel. Recorders are off
+// until enabled by RECORDER_TRACES or a "name=value,..." line sent by the
+// host on the same channel, e.g. "gc,lcd" or "all=0".
+#define USE_RTT_RECORDER    (DBh743)
+#define RECORDER_RTT_CHANNEL (1)
+#define RECORDER_RTT_BUFFER (1024*8)
+#define RECORDER_TRACES     ""
+
+// Evaluate RPL sources and inject keys sent by the host on an RTT channel,
+// one command per line, replying with the result and timings of each, e.g.
+// "rpl 1 100 START 2 √ DROP NEXT" or "key 41 85", for on-target benchmarks
+#define USE_RTT_SCRIPT      (DBh743)
+#define RTT_SCRIPT_CHANNEL  (2)
+#define RTT_SCRIPT_INPUT    (1024)
+#define RTT_SCRIPT_OUTPUT   (1024)
+
+// Profiling build for the code layout: sample the interrupted PC on each
+// tick, and list the hottest code with "layout" on the script channel.
+// The host maps the addresses to functions with addr2line to build the
+// linker ordering file, and functions to move to ITCM are marked HOT.
+// Code run once at boot is marked COLD and kept away from the hot code.
+#define USE_CODE_PROFILE    (0 && USE_RTT_SCRIPT)
+#define CODE_PROFILE_SLOTS  (2048)
+#define CODE_PROFILE_GRAIN  (16)
+
+// Evaluate RPL sources and binary objects sent by a PC on a USB CDC-ACM
+// serial port, next to the USB disk. Up to USB_EVAL_QUEUE requests are
+// pipelined, and the host is throttled when all of them are pending.
+// The RPL task evaluates them for at most USB_EVAL_SLICE ms between keys.
+#define USE_USB_EVAL        (DBh743)
+#define USB_EVAL_QUEUE      (8)
+#define USB_EVAL_REQUEST    (2048)
+#define USB_EVAL_REPLY      (1024)
+#define USB_EVAL_PRIORITY   (40)
+#define USB_EVAL_POLL       (1)
+#define USB_EVAL_SLICE      (20)
+
+// Resynchronize with the disk when the host wrote to it over USB MSC.
+// Once the host has been idle for MSC_QUIET_PERIOD ms, the emFile caches
+// are dropped, the volume is remounted, and db48x drops cached indexes.
+#define USE_MSC_SNAPSHOT    (DBh743)
+#define MSC_QUIET_PERIOD    (500)
+
+// emFile driver for the SD card on SDMMC1 with a 4-bit bus and multi-block
+// IDMA transfers. Buffers the IDMA cannot reach, or not aligned on a cache
+// line, go through a bounce buffer of SDMMC_BOUNCE sectors in AXI SRAM.
+// SDMMC_CK is the SDMMC kernel clock divided by 2 * SDMMC_CLOCK_DIV.
+#define USE_SDMMC_DMA       (DBh743)
+#define SDMMC_CLOCK_DIV     (2)
+#define SDMMC_BOUNCE        (32)
+#define SDMMC_TIMEOUT       (1000)
+
+// Time key presses from the keyboard scan to the end of the LCD transfer
+// showing their result, in stages, over the last KEY_LATENCY_SAMPLES keys
+#define USE_KEY_LATENCY     (DBh743)
+#define KEY_LATENCY_SAMPLES (64)
+
+// Key repeats scheduled from when they were due rather than when the last
+// one was handled. Repeats missed while busy are caught up, at most
+// KB_REPEAT_COALESCE at a time and with a single redraw
+#define USE_STEADY_REPEAT   (1)
+#define KB_REPEAT_COALESCE  (8)
+
 
 
 
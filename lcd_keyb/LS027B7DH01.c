@@ -3,6 +3,7 @@
 #include "SEGGER_RTT.h" // utilisation SEGGER_RTT_printf
 
 #include "LS027B7DH01.h"
+#include "dmcp.h"
 
 /**************************************************************************
     Sharp Memory Display Connector, Adafruit
@@ -22,7 +23,11 @@
  **************************************************************************/
 
 //#define DEBUG_LCD 1
+#if USE_NATIVE_LCD
+#define MIRROR 0                // Screen surface already in panel order
+#else
 #define MIRROR 1
+#endif
 
 extern uint32_t Cnt_ms ; 
 /*
@@ -33,7 +38,26 @@ extern uint32_t Cnt_ms ;
 
 uint8_t lcd_framebuffer[LCD_TOTAL_BYTES] = {0};
 
-static uint8_t  __attribute__((aligned(32))) lcd_dma_buffer[LCD_MAX_DMA_SIZE] = {0};
+/* Ping-pong DMA buffers: one is sent while the next frame is built in the
+   other. A frame built while the SPI is busy is queued, and the transfer
+   complete callback starts it, so drawing never waits for the SPI.
+*/
+#define LCD_DMA_STRIDE  ((LCD_MAX_DMA_SIZE + 31) & ~31) // Whole cache lines
+#if USE_MPU_PROFILE
+/* Not cacheable, see mpu_configure(), cleared by LCD_Init */
+static uint8_t  __attribute__((section(DMA_BUFFER_SECTION), aligned(32)))
+                lcd_dma_buffer[2][LCD_DMA_STRIDE];
+#else
+static uint8_t  __attribute__((aligned(32))) lcd_dma_buffer[2][LCD_DMA_STRIDE] = {0};
+#endif
+static volatile uint8_t  lcd_dma_active = 0;  // Buffer being sent
+static volatile uint16_t lcd_dma_queued = 0;  // Size of queued buffer, 0 if none
+static bool lcd_queued_lines[LCD_HEIGHT];     // Lines in the queued buffer
+
+/* Copy of the framebuffer as last put in a DMA buffer, to skip lines that
+   were marked as modified but did not actually change */
+static uint8_t lcd_shadow[LCD_TOTAL_BYTES];
+static bool    lcd_shadow_valid = false;
 
 
 const char LCD_status_Desc[LCD_LAST][LCD_MESSAGE_LENGTH] = {
@@ -52,7 +76,7 @@ static LCD_Handle_t *g_hlcd = NULL; // Global handle for DMA callback
 
 /* Private function prototypes */
 static LCD_Status_t LCD_SendCommand(LCD_Handle_t *hlcd, uint8_t cmd);
-static uint16_t LCD_BuildDMABuffer(LCD_Handle_t *hlcd, uint8_t *buffer);
+static uint16_t LCD_BuildDMABuffer(LCD_Handle_t *hlcd, uint8_t *buffer, bool merge);
 static void LCD_UpdateModifiedRange(LCD_Handle_t *hlcd, uint16_t line);
 
 
@@ -65,6 +89,9 @@ LCD_Handle_t				hlcd;
 void LCD_SPI_TxCpltCallback(SPI_HandleTypeDef *spi);
 uint8_t MX_SPI4_Init(void);
 void MX_DMA_Init(void);
+#if USE_LCD_EXTCOMIN
+bool lcd_extcomin_start(uint32_t hz);   // BSP, timer output on EXTCOMIN
+#endif
 
 
 /**
@@ -122,6 +149,10 @@ included in MX_SPI4_Init()
     hlcd->config.timeout_ms = 1000;
     hlcd->vcom_state = false;
     hlcd->transfer_complete = true;
+#if USE_LCD_EXTCOMIN
+    /* Fall back to software VCOM if the timer cannot be started */
+    hlcd->hw_vcom = lcd_extcomin_start(LCD_EXTCOMIN_HZ);
+#endif
 
     /* Initialize modified lines tracking */
     memset(&hlcd->modified, 0, sizeof(LCD_ModifiedLines_t));
@@ -150,7 +181,7 @@ HAL_StatusTypeDef status2;
 
     /* Clear static buffers */
     memset(lcd_framebuffer, 0, LCD_TOTAL_BYTES);
-    memset(lcd_dma_buffer, 0, LCD_MAX_DMA_SIZE);
+    memset(lcd_dma_buffer, 0, sizeof(lcd_dma_buffer));
  
     hlcd->initialized = true; // LCD_Clear() check initialized !
 
@@ -179,7 +210,7 @@ uint8_t* LCD_GetFramebuffer(void)
  */
 uint8_t* LCD_GetDMABuffer(void)
 {
-    return lcd_dma_buffer;
+    return lcd_dma_buffer[lcd_dma_active];
 }
 
 /**
@@ -213,9 +244,10 @@ LCD_Status_t LCD_DeInit(LCD_Handle_t *hlcd)
 
     /* Clear static buffers */
     memset(lcd_framebuffer, 0, LCD_TOTAL_BYTES);
-    memset(lcd_dma_buffer, 0, LCD_MAX_DMA_SIZE);
+    memset(lcd_dma_buffer, 0, sizeof(lcd_dma_buffer));
 
     hlcd->initialized = false;
+    lcd_shadow_valid = false;
     g_hlcd = NULL;
 
     return LCD_OK;
@@ -251,6 +283,8 @@ LCD_Status_t LCD_Clear(LCD_Handle_t *hlcd)
 
     /* Clear framebuffer and modified lines */
     memset(lcd_framebuffer, 0xff, LCD_TOTAL_BYTES);
+    memset(lcd_shadow, 0xff, LCD_TOTAL_BYTES);
+    lcd_shadow_valid = true;
     LCD_ClearModifiedLines(hlcd);
 
     return LCD_OK;
@@ -285,8 +319,9 @@ LCD_Status_t LCD_UpdateDisplay(LCD_Handle_t *hlcd)
         return LCD_ERROR;
     }
 
-    /* Mark all lines as modified */
+    /* Mark all lines as modified, and send them even if unchanged */
     LCD_MarkAllLinesModified(hlcd);
+    lcd_shadow_valid = false;
 
     /* Update all modified lines */
     return LCD_UpdateModifiedLines(hlcd);
@@ -309,6 +344,53 @@ LCD_Status_t LCD_UpdateModifiedLines(LCD_Handle_t *hlcd)
         return LCD_OK;
     }
 
+    if (hlcd->config.use_dma) {
+        /* Take back a queued buffer that did not start yet, to add new lines */
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        bool merge = lcd_dma_queued != 0;
+        bool busy  = !hlcd->transfer_complete;
+        lcd_dma_queued = 0;
+        __set_PRIMASK(primask);
+        if (!merge) {
+            memset(lcd_queued_lines, false, LCD_HEIGHT);
+        }
+
+        /* Build in the buffer that is not being sent */
+        uint8_t  next     = busy ? lcd_dma_active ^ 1 : lcd_dma_active;
+        uint8_t *buffer   = lcd_dma_buffer[next];
+        LCD_ToggleVCOM(hlcd);
+        uint16_t dma_size = LCD_BuildDMABuffer(hlcd, buffer, merge);
+        if (dma_size == 0) {
+            /* Software VCOM must still alternate when no line changed */
+            if (!hlcd->hw_vcom && !busy) {
+                return LCD_SendCommand(hlcd, hlcd->vcom_state ? LCD_CMD_VCOM : 0);
+            }
+            return LCD_OK;
+        }
+#if !USE_MPU_PROFILE
+        // for h7, clean Dcache
+        SCB_CleanDCache_by_Addr((uint32_t*)buffer, dma_size);
+#endif
+
+        /* Start now if the SPI is idle, otherwise let the callback start it */
+        HAL_StatusTypeDef hal_status = HAL_OK;
+        __disable_irq();
+        if (hlcd->transfer_complete) {
+            lcd_dma_active = next;
+            hlcd->transfer_complete = false;
+            HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
+            hal_status = HAL_SPI_Transmit_DMA(hlcd->config.hspi, buffer, dma_size);
+            if (hal_status != HAL_OK) {
+                hlcd->transfer_complete = true;
+            }
+        } else {
+            lcd_dma_queued = dma_size;
+        }
+        __set_PRIMASK(primask);
+        return hal_status == HAL_OK ? LCD_OK : LCD_DMA1;
+    }
+
     /* Wait for any ongoing transfer */
     LCD_Status_t status = LCD_WaitForTransfer(hlcd);
     if (status != LCD_OK) {
@@ -321,41 +403,30 @@ LCD_Status_t LCD_UpdateModifiedLines(LCD_Handle_t *hlcd)
     /* Build DMA buffer with only modified lines 
 	   And clear modified lines
 	*/
-    uint16_t dma_size = LCD_BuildDMABuffer(hlcd, lcd_dma_buffer);
+    uint8_t *buffer = lcd_dma_buffer[lcd_dma_active];
+    memset(lcd_queued_lines, false, LCD_HEIGHT);
+    uint16_t dma_size = LCD_BuildDMABuffer(hlcd, buffer, false);
 
     if (dma_size == 0) {
+        /* Software VCOM must still alternate when no line changed */
+        if (!hlcd->hw_vcom) {
+            return LCD_SendCommand(hlcd, hlcd->vcom_state ? LCD_CMD_VCOM : 0);
+        }
         return LCD_OK;
     }
-// for h7, clean Dcache
-SCB_CleanDCache_by_Addr((uint32_t*)lcd_dma_buffer, sizeof(lcd_dma_buffer));
-
 
-    /* Send data */
+    /* Polling transfer */
     hlcd->transfer_complete = false;
+    HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
+    HAL_StatusTypeDef hal_status = HAL_SPI_Transmit(hlcd->config.hspi, 
+                                                   buffer, 
+                                                   dma_size, 
+                                                   hlcd->config.timeout_ms);
+    hlcd->transfer_complete = true;
+    HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_RESET);
 
-    if (hlcd->config.use_dma) {
-			/* Single DMA transfer with all modified lines */
-			HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
-			HAL_StatusTypeDef hal_status = HAL_SPI_Transmit_DMA(hlcd->config.hspi, 
-                                                           lcd_dma_buffer, 
-                                                           dma_size);
-	        if (hal_status != HAL_OK) {
-	            hlcd->transfer_complete = true;
-	            return LCD_DMA1;
-	        }
-    } else {
-        /* Polling transfer */
-		HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
-        HAL_StatusTypeDef hal_status = HAL_SPI_Transmit(hlcd->config.hspi, 
-                                                       lcd_dma_buffer, 
-                                                       dma_size, 
-                                                       hlcd->config.timeout_ms);
-        hlcd->transfer_complete = true;
-		HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_RESET);
-
-        if (hal_status != HAL_OK) {
-            return LCD_DMA2;
-        }
+    if (hal_status != HAL_OK) {
+        return LCD_DMA2;
     }
     return LCD_OK;
 }
@@ -553,10 +624,11 @@ uint16_t LCD_GetModifiedLinesCount(LCD_Handle_t *hlcd)
  * @brief Toggle VCOM state (must be called periodically)
  * @param hlcd: LCD handle
  * it's only a boolean flag, no direct action on display, soft VCOM
+ * nothing to do when EXTCOMIN is driven by a timer
  */
 void LCD_ToggleVCOM(LCD_Handle_t *hlcd)
 {
-    if (hlcd) {
+    if (hlcd && !hlcd->hw_vcom) {
         hlcd->vcom_state = !hlcd->vcom_state;
     }
 }
@@ -601,7 +673,19 @@ void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *spi)
 		HAL_SPI_StateTypeDef status = HAL_SPI_GetState(spi);
 		SEGGER_RTT_printf(0, "\nSPI4 Ended Call back Status ( 1 ready) %02x ", (int)status );
 #endif
+        /* Start the frame that was built while this one was sent */
+        uint16_t queued = lcd_dma_queued;
+        lcd_dma_queued = 0;
+        if (queued) {
+            lcd_dma_active ^= 1;
+            HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
+            if (HAL_SPI_Transmit_DMA(spi, lcd_dma_buffer[lcd_dma_active], queued) == HAL_OK) {
+                return;
+            }
+            HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_RESET);
+        }
         g_hlcd->transfer_complete = true;
+        sys_key_stage(KEY_STAGE_SHOWN);
         /* Clear modified lines after successful DMA transfer  NO at the end of dma_buff contruction */
     }
 }
@@ -692,8 +776,9 @@ void SPI4_IRQHandler(void)
  */
 static LCD_Status_t LCD_SendCommand(LCD_Handle_t *hlcd, uint8_t cmd)
 {
-    lcd_dma_buffer[0] = cmd;
-    lcd_dma_buffer[1] = 0x00; // Dummy byte
+    uint8_t *buffer = lcd_dma_buffer[lcd_dma_active];
+    buffer[0] = cmd;
+    buffer[1] = 0x00; // Dummy byte
 
     hlcd->transfer_complete = false;
 
@@ -701,7 +786,10 @@ static LCD_Status_t LCD_SendCommand(LCD_Handle_t *hlcd, uint8_t cmd)
     if (hlcd->config.use_dma) {
 
 		HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
-        hal_status = HAL_SPI_Transmit_DMA(hlcd->config.hspi, lcd_dma_buffer, 2);
+#if !USE_MPU_PROFILE
+        SCB_CleanDCache_by_Addr((uint32_t*)buffer, 2);
+#endif
+        hal_status = HAL_SPI_Transmit_DMA(hlcd->config.hspi, buffer, 2);
         if (hal_status != HAL_OK) {
             hlcd->transfer_complete = true;
             return LCD_ERROR;
@@ -709,7 +797,7 @@ static LCD_Status_t LCD_SendCommand(LCD_Handle_t *hlcd, uint8_t cmd)
     } else {
 		HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_SET);
 
-        hal_status = HAL_SPI_Transmit(hlcd->config.hspi, lcd_dma_buffer, 2, hlcd->config.timeout_ms);
+        hal_status = HAL_SPI_Transmit(hlcd->config.hspi, buffer, 2, hlcd->config.timeout_ms);
 		HAL_GPIO_WritePin(LCD_CS_GPIO_Port, LCD_CS_Pin, GPIO_PIN_RESET);
         hlcd->transfer_complete = true;
         if (hal_status != HAL_OK) {
@@ -725,15 +813,24 @@ static LCD_Status_t LCD_SendCommand(LCD_Handle_t *hlcd, uint8_t cmd)
  * @brief Build DMA buffer with only modified lines
  * @param hlcd: LCD handle
  * @param buffer: DMA buffer to fill
+ * @param merge: also include lines of a queued buffer that was taken back
  * clear modified flags
  * @retval uint16_t: Size of data in buffer (0 on error)
  */
-static uint16_t LCD_BuildDMABuffer(LCD_Handle_t *hlcd, uint8_t *buffer)
+static uint16_t LCD_BuildDMABuffer(LCD_Handle_t *hlcd, uint8_t *buffer, bool merge)
 {
     if (!hlcd || !buffer || !hlcd->modified.has_changes) {
         return 0;
     }
 
+    if (merge) {
+        for (uint16_t line = 0; line < LCD_HEIGHT; line++) {
+            if (lcd_queued_lines[line]) {
+                hlcd->modified.lines[line] = true;
+            }
+        }
+    }
+
     uint16_t buffer_index = 0;
     uint8_t base_cmd = LCD_CMD_WRITE_LINE | (hlcd->vcom_state ? LCD_CMD_VCOM : 0);
 
@@ -744,6 +841,17 @@ static uint16_t LCD_BuildDMABuffer(LCD_Handle_t *hlcd, uint8_t *buffer)
 		 (line <= hlcd->modified.last_modified)&&0))
 		
 		{
+            /* Skip lines identical to what was sent, unless taken back from
+               a queued buffer that was never sent */
+            uint8_t *fb_line = &lcd_framebuffer[line * LCD_BYTES_PER_LINE];
+            uint8_t *shadow  = &lcd_shadow[line * LCD_BYTES_PER_LINE];
+            if (lcd_shadow_valid && !lcd_queued_lines[line] &&
+                memcmp(fb_line, shadow, LCD_BYTES_PER_LINE) == 0) {
+                continue;
+            }
+            memcpy(shadow, fb_line, LCD_BYTES_PER_LINE);
+            lcd_queued_lines[line] = true;
+
             /* Command byte */
             buffer[buffer_index++] = base_cmd;
             
@@ -772,6 +880,13 @@ static uint16_t LCD_BuildDMABuffer(LCD_Handle_t *hlcd, uint8_t *buffer)
         }
     }
 
+    /* Shadow now matches the panel, skip the transfer if nothing changed */
+    lcd_shadow_valid = true;
+    if (buffer_index == 0) {
+        LCD_ClearModifiedLines(hlcd);
+        return 0;
+    }
+
     /* Add final dummy byte */
     buffer[buffer_index++] = 0x00;
 	LCD_ClearModifiedLines(hlcd);
@@ -1565,7 +1680,7 @@ HAL_StatusTypeDef status2;
     }
     /* Clear static buffers */
     memset(lcd_framebuffer, 0, LCD_TOTAL_BYTES);
-    memset(lcd_dma_buffer, 0, LCD_MAX_DMA_SIZE);
+    memset(lcd_dma_buffer, 0, sizeof(lcd_dma_buffer));
  
     hlcd->initialized = true; // LCD_Clear() check initialized !
 
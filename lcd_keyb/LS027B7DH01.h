@@ -104,6 +104,7 @@ typedef struct {
     LCD_Config_t config;
     LCD_ModifiedLines_t modified;
     bool vcom_state;
+    bool hw_vcom;               // VCOM driven by a timer on EXTCOMIN
     volatile bool transfer_complete;
     bool initialized;
 } LCD_Handle_t;